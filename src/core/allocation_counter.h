@@ -0,0 +1,47 @@
+#ifndef SLAM_CTOR_CORE_ALLOCATION_COUNTER_H
+#define SLAM_CTOR_CORE_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+/* Heap allocations made by the current thread.
+ * Allocations are counted in the opt-in build mode only
+ * (SLAM_CTOR_TRACK_ALLOCATIONS, see utils/allocation_tracking.h that
+ * replaces the global operator new); otherwise counts stay zero.
+ * Client code example:
+ *   auto allocs_before = thread_allocation_count();
+ *   ... // the measured code
+ *   auto allocs = thread_allocation_count() - allocs_before;
+ * NB: allocations made by other threads (e.g. estimation workers)
+ *     are not counted. */
+struct AllocationCount {
+  uint64_t allocs_nm = 0, bytes = 0;
+
+  AllocationCount &operator+=(const AllocationCount &that) {
+    allocs_nm += that.allocs_nm;
+    bytes += that.bytes;
+    return *this;
+  }
+
+  AllocationCount operator-(const AllocationCount &that) const {
+    return AllocationCount{allocs_nm - that.allocs_nm, bytes - that.bytes};
+  }
+};
+
+#ifdef SLAM_CTOR_TRACK_ALLOCATIONS
+constexpr bool Allocations_Are_Tracked = true;
+#else
+constexpr bool Allocations_Are_Tracked = false;
+#endif
+
+// NB: the counter is constant-initialized, so it may be updated
+//     by operator new itself.
+inline AllocationCount &thread_allocation_counter() {
+  thread_local AllocationCount count;
+  return count;
+}
+
+inline AllocationCount thread_allocation_count() {
+  return thread_allocation_counter();
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SLAM_CTOR_CORE_BOUNDED_BUFFER_H
+#define SLAM_CTOR_CORE_BOUNDED_BUFFER_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+/* A ring buffer of at most `capacity` values passed between threads,
+ * e.g. from a producer that prepares data to a consumer that handles it.
+ * A push blocks while the buffer is full and a pop blocks while it is
+ * empty, so the faster side waits for the slower one instead of
+ * accumulating data. Once closed, the buffer accepts no values and is
+ * drained by pops. */
+template <typename T>
+class BoundedBuffer {
+public:
+  explicit BoundedBuffer(std::size_t capacity = 1)
+    : _values(capacity ? capacity : 1) {}
+
+  BoundedBuffer(const BoundedBuffer&) = delete;
+  BoundedBuffer& operator=(const BoundedBuffer&) = delete;
+
+  std::size_t capacity() const { return _values.size(); }
+
+  // Returns false if the buffer is closed, i.e. the value is dropped
+  bool push(T value) {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    _has_room.wait(lock, [this] {
+      return _is_closed || _size < _values.size();
+    });
+    if (_is_closed) { return false; }
+    _values[(_head + _size) % _values.size()] = std::move(value);
+    ++_size;
+    lock.unlock();
+    _has_values.notify_one();
+    return true;
+  }
+
+  // Returns false if the buffer is closed and has no values
+  bool pop(T &value) {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    _has_values.wait(lock, [this] { return _is_closed || _size != 0; });
+    if (_size == 0) { return false; }
+    value = std::move(_values[_head]);
+    _head = (_head + 1) % _values.size();
+    --_size;
+    lock.unlock();
+    _has_room.notify_one();
+    return true;
+  }
+
+  // NB: blocked pushes and pops are released
+  void close() {
+    {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      _is_closed = true;
+    }
+    _has_room.notify_all();
+    _has_values.notify_all();
+  }
+
+private: // fields
+  std::mutex _mutex;
+  std::condition_variable _has_room, _has_values;
+  std::vector<T> _values;
+  std::size_t _head = 0, _size = 0;
+  bool _is_closed = false;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef SLAM_CTOR_CORE_BOUNDED_TASK_QUEUE_H
+#define SLAM_CTOR_CORE_BOUNDED_TASK_QUEUE_H
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* Runs tasks one by one on a dedicated worker thread in submission order.
+ * At most `capacity` tasks are unfinished (i.e. pending or running);
+ * submission blocks while the queue is full, so a slow worker throttles
+ * the producer instead of accumulating a backlog. */
+class BoundedTaskQueue {
+public: // types
+  using Task = std::function<void()>;
+public:
+  explicit BoundedTaskQueue(std::size_t capacity = 1)
+    : _capacity{capacity ? capacity : 1}
+    , _worker{&BoundedTaskQueue::run_tasks, this} {}
+
+  BoundedTaskQueue(const BoundedTaskQueue&) = delete;
+  BoundedTaskQueue& operator=(const BoundedTaskQueue&) = delete;
+
+  // NB: unfinished tasks are completed before the worker stops
+  ~BoundedTaskQueue() {
+    {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      _is_stopped = true;
+    }
+    _has_work.notify_one();
+    _worker.join();
+  }
+
+  std::size_t capacity() const { return _capacity; }
+
+  void push(Task task) {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    _has_room.wait(lock, [this] { return _unfinished_nm < _capacity; });
+    _tasks.push_back(std::move(task));
+    ++_unfinished_nm;
+    lock.unlock();
+    _has_work.notify_one();
+  }
+
+  // Submits the task only if the queue is not full, i.e. never blocks
+  // on a busy worker (the caller is expected to keep the task otherwise)
+  bool try_push(Task &task) {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    if (_capacity <= _unfinished_nm) { return false; }
+    _tasks.push_back(std::move(task));
+    ++_unfinished_nm;
+    lock.unlock();
+    _has_work.notify_one();
+    return true;
+  }
+
+  // Blocks until all submitted tasks are finished
+  void wait_for_idle() {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    _has_room.wait(lock, [this] { return _unfinished_nm == 0; });
+  }
+
+private: // methods
+
+  void run_tasks() {
+    while (true) {
+      auto task = Task{};
+      {
+        auto lock = std::unique_lock<std::mutex>{_mutex};
+        _has_work.wait(lock, [this] { return _is_stopped || !_tasks.empty(); });
+        if (_tasks.empty()) { return; } // stopped, nothing to run
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+      }
+      task();
+      {
+        auto lock = std::unique_lock<std::mutex>{_mutex};
+        --_unfinished_nm;
+      }
+      // both pushers and idle waiters wait for a finished task
+      _has_room.notify_all();
+    }
+  }
+
+private: // fields
+  const std::size_t _capacity;
+  std::mutex _mutex;
+  std::condition_variable _has_work, _has_room;
+  std::deque<Task> _tasks;
+  std::size_t _unfinished_nm = 0;
+  bool _is_stopped = false;
+  // NB: the last field, so the worker starts with the fields initialized
+  std::thread _worker;
+};
+
+#endif
@@ -14,20 +14,20 @@ public:
     : _n{resolution}, _hist(_n, 0) /* NB: () - ctor, not {} - init list */
     , _ang_sum(_n, 0.0) {}
 
+  // PERFORMANCE: directions of points are shared by histograms
+  //              of a scan (see LaserScan2D::features), so a reset
+  //              only bins them.
   auto reset(const LaserScan2D &scan) {
     std::fill(std::begin(_hist), std::end(_hist), 0);
     std::fill(std::begin(_ang_sum), std::end(_ang_sum), 0.0);
 
-    const auto &pts = scan.points();
-    _drift_dirs.resize(pts.size());
-
-    using IndType = LaserScan2D::Points::size_type;
-    for (IndType i = 1; i < pts.size(); ++i) {
-      auto angle = estimate_ox_based_angle(pts[i-1], pts[i]);
+    _features = scan.features();
+    const auto &drift_dirs = _features->drift_dirs;
+    for (std::size_t i = 1; i < drift_dirs.size(); ++i) {
+      auto angle = drift_dirs[i];
       auto hist_i = hist_index(angle);
       _hist[hist_i]++;
       _ang_sum[hist_i] += angle;
-      _drift_dirs[i] = angle;
     }
     return *this;
   }
@@ -39,7 +39,7 @@ public:
     if (pt_i == 0) {
       return pts.size(); // ~ignore the first point
     }
-    return (*this)[hist_index(_drift_dirs[pt_i])];
+    return (*this)[hist_index(_features->drift_dirs[pt_i])];
   }
 
   Storage::size_type max_i() const {
@@ -71,20 +71,11 @@ public:
   static double estimate_ox_based_angle(
     const LaserScan2D::Points::value_type &base,
     const LaserScan2D::Points::value_type &sp) {
+    return estimate_ox_based_angle(sp.x() - base.x(), sp.y() - base.y());
+  }
 
-    auto d_x = sp.x() - base.x();
-    auto d_y = sp.y() - base.y();
-    if (d_y == 0) { // TODO: math utils
-      return 0; // 180 is equivalent to 0
-    }
-    auto d_d = std::sqrt(d_x*d_x + d_y*d_y);
-    auto angle = std::acos(d_x / d_d);
-
-    if (d_y < 0 && d_x != 0) { // TODO: math utils
-      angle = M_PI - angle;
-    }
-
-    return angle;
+  static double estimate_ox_based_angle(double d_x, double d_y) {
+    return ScanFeatures::ox_based_angle(d_x, d_y);
   }
 
 protected:
@@ -98,7 +89,8 @@ protected:
 private:
   Storage::size_type _n;
   Storage _hist;
-  std::vector<double> _ang_sum, _drift_dirs;
+  std::vector<double> _ang_sum;
+  LaserScan2D::FeaturesPtr _features;
 };
 
 #endif
@@ -0,0 +1,175 @@
+#ifndef SLAM_CTOR_CORE_FLAT_CELL_MAP_H
+#define SLAM_CTOR_CORE_FLAT_CELL_MAP_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "geometry_discrete_primitives.h"
+
+/* A hash map of grid cells (e.g. "is the cell seen by the scan") with
+ * open addressing, i.e. slots are stored in a single array and an insertion
+ * allocates nothing unless the map grows.
+ * Slots are stamped with a generation of the map, so a clear
+ * (e.g. between scans) is O(1): it increments the generation and slots
+ * of older ones are treated as empty.
+ * Client code example:
+ *   map.clear();
+ *   for (auto &cell : scan_cells) {
+ *     if (!map.emplace(cell, 0).second) { continue; } // seen by the scan
+ *     ...
+ *   } */
+template <typename Value>
+class FlatCellMap {
+public: // types
+  using Coord = DiscretePoint2D;
+public:
+  explicit FlatCellMap(std::size_t expected_size = 0) {
+    reserve(expected_size);
+  }
+
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  void clear() {
+    _size = 0;
+    if (++_generation != 0) { return; }
+    // NB: the generation wraps around, so stamps are reset
+    for (auto &slot : _slots) { slot.generation = 0; }
+    _generation = 1;
+  }
+
+  // Prepares the map to store a given number of cells without growing
+  void reserve(std::size_t size) {
+    if (size == 0) { return; }
+    auto capacity = Min_Capacity;
+    while (capacity < size * Max_Load_Inv) { capacity *= 2; }
+    if (_slots.size() < capacity) { rehash(capacity); }
+  }
+
+  // Inserts a cell with a given value if the cell is absent;
+  // returns the cell value and whether the cell is inserted.
+  std::pair<Value*, bool> emplace(const Coord &coord,
+                                  const Value &value = Value{}) {
+    if (_slots.size() < (_size + 1) * Max_Load_Inv) {
+      rehash(std::max(2 * _slots.size(), Min_Capacity));
+    }
+    auto &slot = _slots[slot_id(coord)];
+    if (slot.generation == _generation) { return {&slot.value, false}; }
+
+    slot.coord = coord;
+    slot.generation = _generation;
+    slot.value = value;
+    ++_size;
+    return {&slot.value, true};
+  }
+
+  Value *find(const Coord &coord) {
+    if (_size == 0) { return nullptr; }
+    auto &slot = _slots[slot_id(coord)];
+    return slot.generation == _generation ? &slot.value : nullptr;
+  }
+
+  const Value *find(const Coord &coord) const {
+    return const_cast<FlatCellMap*>(this)->find(coord);
+  }
+
+  bool contains(const Coord &coord) const { return find(coord); }
+
+  // Visits cells and their values in an unspecified order
+  template <typename Visitor>
+  void for_each(Visitor &&visitor) const {
+    for (auto &slot : _slots) {
+      if (slot.generation != _generation) { continue; }
+      visitor(slot.coord, slot.value);
+    }
+  }
+
+private: // types
+  struct Slot {
+    Coord coord;
+    uint32_t generation = 0; // 0 - the slot has never been used
+    Value value;
+  };
+private: // consts
+  static constexpr std::size_t Min_Capacity = 64;
+  // NB: the load factor is kept under 1/2, so probe runs are short
+  static constexpr std::size_t Max_Load_Inv = 2;
+private: // methods
+
+  // Fibonacci hashing of a packed coordinate; high bits of the product
+  // depend on all bits of coordinates
+  std::size_t home_slot_id(const Coord &coord) const {
+    auto key = (uint64_t(uint32_t(coord.x)) << 32) | uint32_t(coord.y);
+    return (key * UINT64_C(0x9E3779B97F4A7C15)) >> _hash_shift;
+  }
+
+  // The slot of a cell or the empty one where the cell is to be inserted
+  std::size_t slot_id(const Coord &coord) const {
+    auto mask = _slots.size() - 1;
+    auto id = home_slot_id(coord);
+    while (_slots[id].generation == _generation &&
+           _slots[id].coord != coord) {
+      id = (id + 1) & mask;
+    }
+    return id;
+  }
+
+  void rehash(std::size_t capacity) {
+    assert((capacity & (capacity - 1)) == 0 && "BUG: capacity is not 2^n");
+    auto slots = std::vector<Slot>(capacity);
+    std::swap(_slots, slots);
+    _hash_shift = 64;
+    for (auto c = capacity; 1 < c; c /= 2) { --_hash_shift; }
+
+    auto generation = _generation;
+    _generation = 1;
+    _size = 0;
+    for (auto &slot : slots) {
+      if (slot.generation != generation) { continue; }
+      auto &new_slot = _slots[slot_id(slot.coord)];
+      new_slot.coord = slot.coord;
+      new_slot.generation = _generation;
+      new_slot.value = std::move(slot.value);
+      ++_size;
+    }
+  }
+
+private: // fields
+  std::vector<Slot> _slots;
+  std::size_t _size = 0;
+  uint32_t _generation = 1;
+  unsigned _hash_shift = 64;
+};
+
+template <typename Value>
+constexpr std::size_t FlatCellMap<Value>::Min_Capacity;
+template <typename Value>
+constexpr std::size_t FlatCellMap<Value>::Max_Load_Inv;
+
+/* A set of grid cells on top of FlatCellMap (see it for details) */
+class FlatCellSet {
+public: // types
+  using Coord = DiscretePoint2D;
+public:
+  explicit FlatCellSet(std::size_t expected_size = 0)
+    : _cells{expected_size} {}
+
+  std::size_t size() const { return _cells.size(); }
+  bool empty() const { return _cells.empty(); }
+  void clear() { _cells.clear(); }
+  void reserve(std::size_t size) { _cells.reserve(size); }
+
+  // Returns whether the cell is inserted, i.e. it has not been in the set
+  bool insert(const Coord &coord) { return _cells.emplace(coord).second; }
+  bool contains(const Coord &coord) const { return _cells.contains(coord); }
+
+private: // types
+  struct NoValue {};
+private: // fields
+  FlatCellMap<NoValue> _cells;
+};
+
+#endif
@@ -9,9 +9,9 @@
 #include "math_utils.h"
 
 struct Point2D {
-  Point2D(double x_par = 0, double y_par = 0) : x(x_par), y(y_par) {}
+  Point2D(Real x_par = 0, Real y_par = 0) : x(x_par), y(y_par) {}
 
-  double dist_sq(const Point2D &pt) const {
+  Real dist_sq(const Point2D &pt) const {
     return std::pow(x - pt.x, 2) + std::pow(y - pt.y, 2);
   }
 
@@ -19,15 +19,15 @@ struct Point2D {
     return are_equal(x, that.x) && are_equal(y, that.y);
   }
 
-  Point2D operator*(double scalar) const { return {scalar * x, scalar * y}; }
+  Point2D operator*(Real scalar) const { return {scalar * x, scalar * y}; }
   Point2D operator+(const Point2D& p) const { return {x + p.x, y + p.y}; }
   Point2D operator-(const Point2D& p) const { return {x - p.x, y - p.y}; }
 
 public: // fields
-  double x, y;
+  Real x, y;
 };
 
-inline Point2D operator*(double scalar, const Point2D &p) { return p * scalar; }
+inline Point2D operator*(Real scalar, const Point2D &p) { return p * scalar; }
 
 inline std::ostream &operator<<(std::ostream &stream, const Point2D &pnt) {
   return stream << "(" << pnt.x << ", " << pnt.y << ")";
@@ -71,7 +71,7 @@ public: //methods
     return x_projection_contains(p) && y_projection_contains(p);
   }
 
-  double length_sq() const {
+  Real length_sq() const {
     return std::pow(_end.x - _beg.x, 2) + std::pow(_end.y - _beg.y, 2);
   }
 
@@ -100,7 +100,7 @@ struct Intersection : public Point2D {
     Bot = 0, Left = 1, Top = 2, Right = 3
   };
 
-  Intersection(Location loc, double x, double y) :
+  Intersection(Location loc, Real x, Real y) :
     Point2D{x, y}, location(loc) {}
 
   bool is_horiz() const {
@@ -113,7 +113,7 @@ struct Intersection : public Point2D {
 using Intersections = std::vector<Intersection>;
 
 struct Ray { // in parametric form
-  Ray(double x_s, double x_d, double y_s, double y_d) :
+  Ray(Real x_s, Real x_d, Real y_s, Real y_d) :
     beg{x_s, y_s}, delta{x_d, y_d} {}
 
   explicit Ray(const Segment2D &s) : beg(s.beg()), delta(s.end() - s.beg()) {}
@@ -133,26 +133,26 @@ public:
   }
 
 private:
-  void intersect_horiz_segm(double st_x, double end_x, double y,
+  void intersect_horiz_segm(Real st_x, Real end_x, Real y,
                             Intersection::Location loc,
                             Intersections &consumer) const {
     if (are_equal(delta.y, 0)) { return; }
 
-    double inters_alpha = (y - beg.y) / delta.y;
-    double inters_x = beg.x + inters_alpha * delta.x;
+    Real inters_alpha = (y - beg.y) / delta.y;
+    Real inters_x = beg.x + inters_alpha * delta.x;
     if (inters_x < st_x || end_x < inters_x) // out of segment bounds
       return;
 
     consumer.emplace_back(loc, inters_x, y);
   }
 
-  void intersect_vert_segm(double st_y, double end_y, double x,
+  void intersect_vert_segm(Real st_y, Real end_y, Real x,
                            Intersection::Location loc,
                            Intersections &consumer) const {
     if (are_equal(delta.x, 0)) { return; }
 
-    double inters_alpha = (x - beg.x) / delta.x;
-    double inters_y = beg.y + inters_alpha * delta.y;
+    Real inters_alpha = (x - beg.x) / delta.x;
+    Real inters_y = beg.y + inters_alpha * delta.y;
     if (inters_y < st_y || end_y < inters_y) // out of segment bounds
       return;
 
@@ -167,7 +167,7 @@ private:
   using LVRect = LightWeightRectangle;
 public:
   LightWeightRectangle() : LightWeightRectangle(0, 0, 0, 0) {}
-  LightWeightRectangle(double b, double t, double l, double r)
+  LightWeightRectangle(Real b, Real t, Real l, Real r)
     : _bot{b}, _top{t}, _left{l}, _right{r} {
     assert(_bot <= _top);
     assert(_left <= _right);
@@ -175,16 +175,16 @@ public:
   LightWeightRectangle(const Point2D &p)
     : LightWeightRectangle(p.y, p.y, p.x, p.x) {}
 
-  double bot() const { return _bot; }
-  double top() const { return _top; }
-  double left() const { return _left; }
-  double right() const { return _right; }
+  Real bot() const { return _bot; }
+  Real top() const { return _top; }
+  Real left() const { return _left; }
+  Real right() const { return _right; }
 
-  double vside_len() const { return top() - bot(); }
-  double hside_len() const { return right() - left(); }
+  Real vside_len() const { return top() - bot(); }
+  Real hside_len() const { return right() - left(); }
   bool is_square() const { return vside_len() == hside_len(); }
-  double side() const { return vside_len(); }
-  double area() const { return vside_len() * hside_len(); }
+  Real side() const { return vside_len(); }
+  Real area() const { return vside_len() * hside_len(); }
   Point2D center() const {
     return {left() + hside_len() / 2, bot() + vside_len() / 2};
   }
@@ -203,12 +203,12 @@ public:
   }
 
   LVRect move_center(const Point2D &new_center) const {
-    double half_v = vside_len() / 2, half_h = hside_len() / 2;
+    Real half_v = vside_len() / 2, half_h = hside_len() / 2;
     return {new_center.y - half_v, new_center.y + half_v,
             new_center.x - half_h, new_center.x + half_h};
   }
 
-  auto shrink(double factor) const {
+  auto shrink(Real factor) const {
     auto c = center();
     auto new_hv = vside_len() / (factor * 2),
          new_hh = hside_len() / (factor * 2);
@@ -245,12 +245,17 @@ public:
 
   bool contains(const Point2D &p) const { return contains(p.x, p.y); }
 
-  bool contains(double x, double y) const {
+  bool contains(Real x, Real y) const {
     return are_ordered(left(), x, right()) && are_ordered(bot(), y, top());
   }
 
-  auto intersect(const LightWeightRectangle &that) const {
-    return intersect_internal(that, false);
+  // NB: rectangles that do not intersect give an empty one at (0, 0)
+  LightWeightRectangle intersect(const LightWeightRectangle &that) const {
+    auto bot = std::max(_bot, that._bot), top = std::min(_top, that._top);
+    auto left = std::max(_left, that._left),
+         right = std::min(_right, that._right);
+    if (top < bot || right < left) { return LightWeightRectangle{}; }
+    return LightWeightRectangle{bot, top, left, right};
   }
 
   auto overlap(const LightWeightRectangle &that) const {
@@ -258,59 +263,15 @@ public:
       return intersect(that).area() / area();
     }
     if (that.area()) {
-      return that.contains(left(), bot()) ? 1.0 : 0.0;
+      return that.contains(left(), bot()) ? Real(1) : Real(0);
     }
     // FIXME: the assert below, see unit tests.
     assert(is_point() && that.is_point() && "TODO: support lwr-lines");
-    return *this == that ? 1.0 : 0.0;
-  }
-
-private:
-
-  LightWeightRectangle intersect_internal(const LightWeightRectangle &that,
-                                          bool reversed = false) const {
-    // NB: a naive implementation; straightforward and correct (I hope so).
-    // IDEA: shrink -this- to intersection rectangle.
-
-    // FIXME: @see unit tests
-    unsigned contained_corners_nm = 0;
-    auto cleft = left(), cright = right(), ctop = top(), cbot = bot();
-
-    #define PROCESS_CORNER(horz_id, vert_id)                    \
-      if (contains(that.horz_id(), that.vert_id())) {           \
-        ++contained_corners_nm;                                 \
-        c##horz_id = that.horz_id();                            \
-        c##vert_id = that.vert_id();                            \
-      }
-
-    PROCESS_CORNER(left, bot);
-    PROCESS_CORNER(right, bot);
-    PROCESS_CORNER(left, top);
-    PROCESS_CORNER(right, top);
-
-    #undef PROCESS_CORNER
-
-    // handle corner cases based on a number of contained corners (pun intended)
-    switch (contained_corners_nm) {
-    case 0:
-      /*
-       * Either doesn't overlap or the overlap must be detected
-       * by this-in-that corners analysis (reversed).
-       */
-      // FIXME: awkward stuff
-      return reversed ? LightWeightRectangle{}
-                      : that.intersect_internal(*this, true);
-    case 1: case 2: case 4:
-      break;
-    case 3: default:
-      assert(0 && "Unexpected inclusions number");
-    }
-
-    return LightWeightRectangle{cbot, ctop, cleft, cright};
+    return *this == that ? Real(1) : Real(0);
   }
 
 private: // fields
-  double _bot, _top, _left, _right;
+  Real _bot, _top, _left, _right;
 };
 
 inline std::ostream &operator<<(std::ostream &stream,
@@ -328,7 +289,7 @@ private: // consts
 public: // methods
 
   Rectangle() : Rectangle(0, 0, 0, 0) {}
-  Rectangle(double b, double t, double l, double r)
+  Rectangle(Real b, Real t, Real l, Real r)
     : LightWeightRectangle{b, t, l, r}
     , _edges{
         Segment2D{{ left(), bot()}, {right(), bot()}}, // 0 - bot
@@ -0,0 +1,244 @@
+#ifndef SLAM_CTOR_CORE_INCREMENTAL_SPARSE_CHOLESKY_H
+#define SLAM_CTOR_CORE_INCREMENTAL_SPARSE_CHOLESKY_H
+
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+/* A sparse Cholesky factorization A = L * L^T of a symmetric positive
+ * definite matrix that may be refactored partially.
+ * The factor is computed row by row (an up-looking factorization, see
+ * T. Davis, "Direct Methods for Sparse Linear Systems", 2006): a row k of L
+ * depends on columns [0, k] of the upper triangle of A and on rows [0, k)
+ * of L only. So if columns starting with k0 are modified (e.g. variables
+ * that are appended or touched by a new constraint), rows [0, k0) are kept
+ * and only the rest is refactored. The elimination tree (and so the fill-in)
+ * is extended along with rows, i.e. no symbolic analysis is required.
+ * A solution is updated the same way: the forward substitution is resumed
+ * from the first modified row and the backward one descends the elimination
+ * tree from modified rows while changes exceed a tolerance (the partial
+ * back substitution of iSAM2, Kaess et al., 2012).
+ * NB: the matrix is not reordered, so variables are expected to be numbered
+ *     in a fill-reducing order (e.g. poses of a trajectory by time). */
+class IncrementalSparseCholesky {
+public: // types
+  // The upper triangle part of a column: rows [0, k] of a column k
+  struct Column {
+    std::vector<int> rows;
+    std::vector<double> values;
+
+    void clear() { rows.clear(); values.clear(); }
+    void add(int row, double value) {
+      rows.push_back(row);
+      values.push_back(value);
+    }
+  };
+public:
+
+  int size() const { return int(_columns.size()); }
+
+  // Appended columns are empty and the factor is invalidated from them
+  void resize(int n) {
+    invalidate_from(std::min(n, size()));
+    _unsolved_rows_from = std::min(_unsolved_rows_from, size());
+    _columns.resize(n);
+    _l_rows.resize(n);
+    _l_values.resize(n);
+    _l_patterns.resize(n);
+    _l_pattern_values.resize(n);
+    _parents.resize(n, -1);
+    _children.resize(n);
+    _y.resize(n, 0);
+  }
+
+  // NB: the caller is expected to invalidate the factor from the column
+  Column &column(int k) { return _columns[k]; }
+
+  int valid_rows_nm() const { return _valid_rows_nm; }
+
+  // Drops rows [k0, n) of L
+  void invalidate_from(int k0) {
+    if (_valid_rows_nm <= k0) { return; }
+    // NB: entries of columns are appended by rows, so they are dropped
+    //     in the reverse order.
+    for (int k = _valid_rows_nm - 1; k0 <= k; --k) {
+      for (auto j : _l_patterns[k]) {
+        assert(_l_rows[j].back() == k);
+        _l_rows[j].pop_back();
+        _l_values[j].pop_back();
+        if (k0 <= _parents[j]) { _parents[j] = -1; }
+      }
+      _l_patterns[k].clear();
+      _l_pattern_values[k].clear();
+      _l_rows[k].clear();
+      _l_values[k].clear();
+      _parents[k] = -1;
+      _children[k].clear();
+    }
+    _valid_rows_nm = k0;
+    _unsolved_rows_from = std::min(_unsolved_rows_from, k0);
+  }
+
+  // Refactors invalidated rows; returns false if A is not positive definite
+  // (the factor is invalidated from the failed row then).
+  bool factorize() {
+    // NB: the work buffer is zeroed by row factorizations
+    auto n = std::size_t(size());
+    if (_work.size() < n) {
+      _work.resize(n, 0);
+      _flags.resize(n, 0);
+      _stack.resize(n);
+      _pattern.resize(n);
+    }
+    for (int k = _valid_rows_nm; k < size(); ++k) {
+      auto is_positive = factorize_row(k);
+      _valid_rows_nm = k + 1;
+      if (!is_positive) {
+        invalidate_from(k);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Solves A * x = b with the factor
+  void solve(const std::vector<double> &b, std::vector<double> &x) {
+    x.assign(size(), 0);
+    solve(b, 0, 0, x);
+  }
+
+  // Updates the previous solution x of A * x = b, where rows of b
+  // that precede first_row are the same as the previous ones.
+  // Rows of x that follow the first modified row (of A or b) are recomputed;
+  // preceding rows are recomputed while the change of their ancestor in
+  // the elimination tree exceeds the tolerance. Returns updated rows of x.
+  const std::vector<int>& solve(const std::vector<double> &b, int first_row,
+                                double tolerance, std::vector<double> &x) {
+    assert(_valid_rows_nm == size() && int(b.size()) == size());
+    auto n = size();
+    first_row = std::max(std::min(first_row, _unsolved_rows_from), 0);
+    _unsolved_rows_from = n;
+    x.resize(n, 0);
+    // L * y = b (by rows, preceding rows of y are kept)
+    for (int k = first_row; k < n; ++k) {
+      auto y_k = b[k];
+      auto &pattern = _l_patterns[k];
+      auto &values = _l_pattern_values[k];
+      for (std::size_t p = 0; p < pattern.size(); ++p) {
+        y_k -= values[p] * _y[pattern[p]];
+      }
+      _y[k] = y_k / _l_values[k][0];
+    }
+
+    // L^T * x = y (entries of a column of L are ancestors of the column)
+    _updated_rows.clear();
+    _stack.resize(std::max(_stack.size(), std::size_t(n)));
+    int stack_size = 0;
+    for (int j = n - 1; first_row <= j; --j) {
+      x[j] = back_substitute(j, x);
+      _updated_rows.push_back(j);
+      for (auto child : _children[j]) {
+        if (child < first_row) { _stack[stack_size++] = child; }
+      }
+    }
+    while (0 < stack_size) {
+      auto j = _stack[--stack_size];
+      auto x_j = back_substitute(j, x);
+      if (std::abs(x_j - x[j]) <= tolerance) { continue; }
+      x[j] = x_j;
+      _updated_rows.push_back(j);
+      for (auto child : _children[j]) { _stack[stack_size++] = child; }
+    }
+    return _updated_rows;
+  }
+
+  std::size_t factor_nonzeros_nm() const {
+    std::size_t nnz = 0;
+    for (auto &rows : _l_rows) { nnz += rows.size(); }
+    return nnz;
+  }
+
+private: // methods
+
+  double back_substitute(int j, const std::vector<double> &x) const {
+    auto x_j = _y[j];
+    for (std::size_t p = 1; p < _l_rows[j].size(); ++p) {
+      x_j -= _l_values[j][p] * x[_l_rows[j][p]];
+    }
+    return x_j / _l_values[j][0];
+  }
+
+  bool factorize_row(int k) {
+    // the pattern of the row is the union of etree paths from A's entries
+    // (the etree is extended by unset parents on the way)
+    auto top = int(_columns.size());
+    auto mark = ++_mark;
+    _flags[k] = mark;
+    auto &col = _columns[k];
+    for (std::size_t p = 0; p < col.rows.size(); ++p) {
+      auto i = col.rows[p];
+      assert(i <= k);
+      _work[i] += col.values[p];
+      int len = 0;
+      for (; _flags[i] != mark; i = _parents[i]) {
+        _stack[len++] = i;
+        _flags[i] = mark;
+        if (_parents[i] == -1) {
+          _parents[i] = k;
+          _children[k].push_back(i);
+        }
+      }
+      while (0 < len) { _pattern[--top] = _stack[--len]; }
+    }
+
+    auto d = _work[k];
+    _work[k] = 0;
+    auto &row_pattern = _l_patterns[k];
+    auto &row_values = _l_pattern_values[k];
+    row_pattern.clear();
+    row_values.clear();
+    for (auto n = int(_columns.size()); top < n; ++top) {
+      auto i = _pattern[top];
+      auto l_ki = _work[i] / _l_values[i][0];
+      _work[i] = 0;
+      for (std::size_t p = 1; p < _l_rows[i].size(); ++p) {
+        _work[_l_rows[i][p]] -= _l_values[i][p] * l_ki;
+      }
+      d -= l_ki * l_ki;
+      _l_rows[i].push_back(k);
+      _l_values[i].push_back(l_ki);
+      row_pattern.push_back(i);
+      row_values.push_back(l_ki);
+    }
+    _l_rows[k].push_back(k);
+    _l_values[k].push_back(std::sqrt(std::max(d, 0.0)));
+    return 0 < d;
+  }
+
+private: // fields
+  std::vector<Column> _columns;
+  // columns of L; the first entry of a column is the diagonal one
+  std::vector<std::vector<int>> _l_rows;
+  std::vector<std::vector<double>> _l_values;
+  // off-diagonal entries of rows of L (i.e. L is kept by rows as well)
+  std::vector<std::vector<int>> _l_patterns;
+  std::vector<std::vector<double>> _l_pattern_values;
+  // the elimination tree (-1 is a root or an unknown parent)
+  std::vector<int> _parents;
+  std::vector<std::vector<int>> _children;
+  int _valid_rows_nm = 0;
+  // the solution of L * y = b, it is valid before the row
+  std::vector<double> _y;
+  int _unsolved_rows_from = 0;
+  std::vector<int> _updated_rows;
+  // buffers reused by factorizations
+  std::vector<double> _work;
+  // NB: a row marks visited rows by its own mark, so flags are not reset
+  std::vector<uint64_t> _flags;
+  uint64_t _mark = 0;
+  std::vector<int> _stack, _pattern;
+};
+
+#endif
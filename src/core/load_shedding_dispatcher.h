@@ -0,0 +1,214 @@
+#ifndef SLAM_CTOR_CORE_LOAD_SHEDDING_DISPATCHER_H
+#define SLAM_CTOR_CORE_LOAD_SHEDDING_DISPATCHER_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+enum class OverloadPolicy {
+  // every value is handled in place, i.e. a slow handler delays a producer
+  None,
+  // a handler thread takes the newest value, older pending ones are dropped
+  KeepLatest,
+  // every N-th value is dropped, others are handled in place
+  DropEveryNth,
+  // a handler thread takes values, ones that come while it is busy
+  // are dropped
+  DropWhileBusy,
+  // a handler thread takes values one by one; once at least
+  // catch_up_threshold values wait, they are taken as a single batch
+  // (see LoadSheddingDispatcher::BatchHandler), i.e. nothing is dropped
+  CatchUp
+};
+
+struct LoadSheddingParams {
+  OverloadPolicy policy = OverloadPolicy::None;
+  // N of DropEveryNth (e.g. 2 drops every other value)
+  unsigned drop_period = 2;
+  // the backlog size that is handled as a batch by CatchUp
+  std::size_t catch_up_threshold = 2;
+};
+
+struct LoadSheddingStats {
+  std::size_t received_nm = 0;
+  std::size_t dropped_nm = 0;
+  std::size_t handled_nm = 0;
+  // values that wait for the handler (i.e. the queue depth)
+  std::size_t pending_nm = 0;
+};
+
+/* Passes values (e.g. scans) from a producer to a handler that may be
+ * slower than the producer and sheds values by a given overload policy.
+ * PERFORMANCE: with KeepLatest and DropWhileBusy at most one value waits
+ *              for the handler, so a value is handled at most one handling
+ *              later than it comes regardless of the producer's rate
+ *              (unlike an unbounded queue whose delay grows with time).
+ *              CatchUp keeps every value, but a backlog costs a single
+ *              batch handling (e.g. a scan match per backlog). */
+template <typename T>
+class LoadSheddingDispatcher {
+public:
+  using Handler = std::function<void(T&)>;
+  // values in the arrival order; the default handles them one by one
+  using BatchHandler = std::function<void(std::vector<T>&)>;
+
+  LoadSheddingDispatcher(const LoadSheddingParams &params, Handler handler,
+                         BatchHandler batch_handler = nullptr)
+    : _params{params}, _handler{std::move(handler)}
+    , _batch_handler{std::move(batch_handler)} {
+    if (_params.drop_period == 0) { _params.drop_period = 1; }
+    if (_params.catch_up_threshold == 0) { _params.catch_up_threshold = 1; }
+    if (!_batch_handler) {
+      _batch_handler = [this](std::vector<T> &batch) {
+        for (auto &value : batch) { _handler(value); }
+      };
+    }
+    if (has_handler_thread()) {
+      _handler_thread = std::thread{&LoadSheddingDispatcher::handling_loop,
+                                    this};
+    }
+  }
+
+  LoadSheddingDispatcher(const LoadSheddingDispatcher&) = delete;
+  LoadSheddingDispatcher& operator=(const LoadSheddingDispatcher&) = delete;
+
+  // NB: pending values are dropped
+  ~LoadSheddingDispatcher() {
+    if (!_handler_thread.joinable()) { return; }
+    {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      _is_stopped = true;
+    }
+    _has_value.notify_one();
+    _handler_thread.join();
+  }
+
+  void dispatch(T value) {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    ++_stats.received_nm;
+    switch (_params.policy) {
+    case OverloadPolicy::None:
+      break;
+    case OverloadPolicy::DropEveryNth:
+      if (_stats.received_nm % _params.drop_period == 0) {
+        ++_stats.dropped_nm;
+        return;
+      }
+      break;
+    case OverloadPolicy::KeepLatest:
+      if (_has_pending) { ++_stats.dropped_nm; }
+      pend(std::move(value), lock);
+      return;
+    case OverloadPolicy::DropWhileBusy:
+      if (_is_busy || _has_pending) {
+        ++_stats.dropped_nm;
+        return;
+      }
+      pend(std::move(value), lock);
+      return;
+    case OverloadPolicy::CatchUp:
+      _backlog.push_back(std::move(value));
+      lock.unlock();
+      _has_value.notify_one();
+      return;
+    }
+    lock.unlock();
+
+    // NB: the handler is called in place by the producer
+    _handler(value);
+    lock.lock();
+    ++_stats.handled_nm;
+  }
+
+  LoadSheddingStats stats() const {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    auto stats = _stats;
+    stats.pending_nm = (_has_pending ? 1 : 0) + _backlog.size();
+    return stats;
+  }
+
+private: // methods
+
+  bool has_handler_thread() const {
+    return _params.policy == OverloadPolicy::KeepLatest ||
+           _params.policy == OverloadPolicy::DropWhileBusy ||
+           _params.policy == OverloadPolicy::CatchUp;
+  }
+
+  void pend(T &&value, std::unique_lock<std::mutex> &lock) {
+    _pending = std::move(value);
+    _has_pending = true;
+    lock.unlock();
+    _has_value.notify_one();
+  }
+
+  void handling_loop() {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    while (true) {
+      _has_value.wait(lock, [this] {
+        return _is_stopped || _has_pending || !_backlog.empty();
+      });
+      if (_is_stopped) { return; }
+      if (!_backlog.empty()) {
+        handle_backlog(lock);
+        continue;
+      }
+      auto value = std::move(_pending);
+      _has_pending = false;
+      _is_busy = true;
+      lock.unlock();
+
+      _handler(value);
+      lock.lock();
+      _is_busy = false;
+      ++_stats.handled_nm;
+    }
+  }
+
+  // NB: called with the lock held, returns with it held
+  void handle_backlog(std::unique_lock<std::mutex> &lock) {
+    _batch.clear();
+    if (_backlog.size() < _params.catch_up_threshold) {
+      _batch.push_back(std::move(_backlog.front()));
+      _backlog.pop_front();
+    } else {
+      std::move(_backlog.begin(), _backlog.end(), std::back_inserter(_batch));
+      _backlog.clear();
+    }
+    _is_busy = true;
+    lock.unlock();
+
+    if (_batch.size() == 1) {
+      _handler(_batch.front());
+    } else {
+      _batch_handler(_batch);
+    }
+    lock.lock();
+    _is_busy = false;
+    _stats.handled_nm += _batch.size();
+  }
+
+private: // fields
+  LoadSheddingParams _params;
+  Handler _handler;
+  BatchHandler _batch_handler;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _has_value;
+  T _pending;
+  bool _has_pending = false, _is_busy = false, _is_stopped = false;
+  // values waiting for the CatchUp handling
+  std::deque<T> _backlog;
+  std::vector<T> _batch;
+  LoadSheddingStats _stats;
+
+  std::thread _handler_thread;
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include <cmath>
 #include <tuple>
 #include <algorithm>
+#include <limits>
 
 #include "cell_occupancy_estimator.h"
 
@@ -14,6 +15,119 @@ private: // types
   enum class SegmentPositionType : char {
     Unrelated = 0, LiesInside, StopsInside, StartsInside, Pierces, Touches
   };
+
+  // A crossing of a cell side by a beam (in cell side units)
+  struct SideCrossing {
+    bool is_horiz;   // the side is either bot or top
+    double side_pos; // 0 - the side is bot/left, 1 - top/right
+    double pos;      // the position along the side from its bot/left end
+  };
+
+  // Walks cells of a beam carrying its exit point of a cell to the next one
+  class BeamWalk {
+  public:
+    BeamWalk(const Segment2D &beam, double cell_side)
+      : _bx{beam.beg().x / cell_side}, _by{beam.beg().y / cell_side}
+      , _dx{(beam.end().x - beam.beg().x) / cell_side}
+      , _dy{(beam.end().y - beam.beg().y) / cell_side}
+      , _len{std::sqrt(_dx * _dx + _dy * _dy)} {}
+
+    // Whether pierced cells can be estimated by the walk,
+    // i.e. the beam is not a point and it doesn't lie on a grid line
+    bool is_walkable() const {
+      return 0 < _len && !(_dx == 0 && is_on_grid_line(_bx)) &&
+                         !(_dy == 0 && is_on_grid_line(_by));
+    }
+
+    // Finds the beam entry and exit points of the next cell;
+    // returns false if the cell is not pierced regularly (it contains a beam
+    // end, the beam passes near its vertex or it is not on the beam).
+    bool next_pierced(const RegularSquaresGrid::Coord &cell,
+                      SideCrossing &entry, SideCrossing &exit) {
+      double t_in = 0;
+      if (_has_next && cell == _next_cell) {
+        entry = _next_entry;
+        t_in = _next_t_in;
+      } else {
+        t_in = enter(cell, entry);
+      }
+      auto t_out = leave(cell, exit);
+      // NB: the exit of a vertex pass is not carried as the next cell is
+      //     either diagonal or an unrelated one
+      _has_next = is_regular(exit);
+      if (_has_next) {
+        _next_cell = cell + (exit.is_horiz ?
+          RegularSquaresGrid::Coord{0, 0 < _dy ? 1 : -1} :
+          RegularSquaresGrid::Coord{0 < _dx ? 1 : -1, 0});
+        _next_entry = SideCrossing{exit.is_horiz, 1 - exit.side_pos, exit.pos};
+        _next_t_in = t_out;
+      }
+      return Min_Chord_Len < t_in * _len && t_in < t_out &&
+             Min_Chord_Len < (1 - t_out) * _len &&
+             is_regular(entry) && is_regular(exit);
+    }
+
+  private: // consts
+    // positions closer to a vertex or to a beam end are estimated exactly
+    static constexpr double Min_Chord_Len = 1e-5;
+    static constexpr double Inf = std::numeric_limits<double>::infinity();
+  private: // methods
+    static bool is_on_grid_line(double coord) {
+      return are_equal(coord, std::round(coord));
+    }
+
+    static bool is_regular(const SideCrossing &crossing) {
+      return Min_Chord_Len < crossing.pos &&
+             crossing.pos < 1 - Min_Chord_Len;
+    }
+
+    double enter(const RegularSquaresGrid::Coord &cell, SideCrossing &entry) {
+      if (!is_within(_bx, _dx, cell.x) || !is_within(_by, _dy, cell.y)) {
+        entry = SideCrossing{};
+        return Inf;
+      }
+      auto t_x = cross_param(_bx, _dx, cell.x + (0 < _dx ? 0 : 1), -Inf);
+      auto t_y = cross_param(_by, _dy, cell.y + (0 < _dy ? 0 : 1), -Inf);
+      return cross(cell, t_x, t_y, 0 < _dx ? 0 : 1, 0 < _dy ? 0 : 1,
+                   t_y < t_x, entry);
+    }
+
+    double leave(const RegularSquaresGrid::Coord &cell, SideCrossing &exit) {
+      auto t_x = cross_param(_bx, _dx, cell.x + (0 < _dx ? 1 : 0), Inf);
+      auto t_y = cross_param(_by, _dy, cell.y + (0 < _dy ? 1 : 0), Inf);
+      return cross(cell, t_x, t_y, 0 < _dx ? 1 : 0, 0 < _dy ? 1 : 0,
+                   t_x < t_y, exit);
+    }
+
+    // A beam parallel to an axis pierces cells of its row/column only
+    static bool is_within(double beg, double delta, int cell_coord) {
+      return delta != 0 || (cell_coord < beg && beg < cell_coord + 1);
+    }
+
+    // The beam param of a grid line crossing
+    static double cross_param(double beg, double delta, int line,
+                              double parallel_param) {
+      return delta == 0 ? parallel_param : (line - beg) / delta;
+    }
+
+    double cross(const RegularSquaresGrid::Coord &cell, double t_x, double t_y,
+                 double x_side_pos, double y_side_pos, bool crosses_vert,
+                 SideCrossing &crossing) const {
+      if (crosses_vert) {
+        crossing = {false, x_side_pos, _by + t_x * _dy - cell.y};
+        return t_x;
+      }
+      crossing = {true, y_side_pos, _bx + t_y * _dx - cell.x};
+      return t_y;
+    }
+
+  private: // fields
+    double _bx, _by, _dx, _dy, _len;
+    bool _has_next = false;
+    RegularSquaresGrid::Coord _next_cell;
+    SideCrossing _next_entry;
+    double _next_t_in = 0;
+  };
 public: //methods
 
   AreaOccupancyEstimator(const Occupancy& base_occupied,
@@ -37,7 +151,7 @@ public: //methods
       break;
     case SegmentPositionType::LiesInside:
       return is_occ ? Occupancy::invalid() :
-                      Occupancy{base_empty().prob_occ, _unknown_qual};
+                      Occupancy(base_empty().prob_occ, _unknown_qual);
     case SegmentPositionType::StopsInside:
       break;
     }
@@ -45,7 +159,7 @@ public: //methods
     Intersections intrs = find_intersections(effective_beam, cell, is_occ);
     if (intrs.size() == 1) {
       if (!is_occ) { // StopsInside/FrontEdge/Vertex
-        return Occupancy{base_empty().prob_occ, _unknown_qual};
+        return Occupancy(base_empty().prob_occ, _unknown_qual);
       } else { // occupied, stops at some vertex
         auto raw_intersections = cell.find_intersections(effective_beam);
         switch (raw_intersections.size()) {
@@ -63,6 +177,34 @@ public: //methods
     return estimate_occupancy(chunk_area, cell.area(), is_occ);
   }
 
+  // PERFORMANCE: cells of a beam form a chain, so the beam exit point
+  //   of a cell is its entry point of the next one and a pierced cell
+  //   is estimated by a few arithmetic operations without intersection
+  //   lists. Cells with beam ends and degenerate cases (a beam on a grid
+  //   line, a vertex pass) are estimated exactly.
+  void estimate_beam_occupancies(
+      const Segment2D &beam, const RegularSquaresGrid &grid,
+      const std::vector<RegularSquaresGrid::Coord> &cells,
+      std::vector<Occupancy> &occupancies) override {
+    auto walk = BeamWalk{beam, grid.scale()};
+    if (!walk.is_walkable()) {
+      CellOccupancyEstimator::estimate_beam_occupancies(beam, grid, cells,
+                                                        occupancies);
+      return;
+    }
+
+    occupancies.resize(cells.size());
+    SideCrossing entry, exit;
+    for (std::size_t i = 0; i < cells.size(); ++i) {
+      if (walk.next_pierced(cells[i], entry, exit)) {
+        occupancies[i] = estimate_pierced_occupancy(entry, exit);
+      } else {
+        auto cell_bnds = grid.world_cell_bounds(cells[i]);
+        occupancies[i] = estimate_occupancy(beam, cell_bnds, false);
+      }
+    }
+  }
+
 private: // methods
 
   Segment2D ensure_segment_not_on_edge(const Segment2D& s,
@@ -73,9 +215,11 @@ private: // methods
 
     Point2D shift;
     if (s.is_horiz()) {
-      shift = {0, (are_equal(s.beg().y, cell.top()) ? -1 : 1) * Shift_Amount};
+      shift = Point2D(0, (are_equal(s.beg().y, cell.top()) ? -1 : 1) *
+                        Shift_Amount);
     } else if (s.is_vert()) {
-      shift = {(are_equal(s.beg().x, cell.right()) ? -1 : 1) * Shift_Amount, 0};
+      shift = Point2D((are_equal(s.beg().x, cell.right()) ? -1 : 1) *
+                      Shift_Amount, 0);
     } else {
       assert(false && "BUG: non-axis aligned segment is on rectange edge");
     }
@@ -209,12 +353,30 @@ private: // methods
     assert(0 <= area && area <= bnds.area() && "BUG: AOE area estimation");
     if (is_occ &&
         are_on_the_same_side(inters[0], inters[1],
-                             beam.beg(), {corner_x, corner_y})) {
+                             beam.beg(), Point2D(corner_x, corner_y))) {
       area = bnds.area() - area;
     }
     return area;
   }
 
+  // The pierced cell area estimation (see compute_chunk_area)
+  // in cell side units.
+  Occupancy estimate_pierced_occupancy(const SideCrossing &entry,
+                                       const SideCrossing &exit) {
+    double area = 0;
+    if (entry.is_horiz != exit.is_horiz) {
+      // a triangle with the common corner of the sides
+      auto &horiz = entry.is_horiz ? entry : exit;
+      auto &vert = entry.is_horiz ? exit : entry;
+      area = 0.5 * std::abs(horiz.pos - vert.side_pos) *
+                   std::abs(vert.pos - horiz.side_pos);
+    } else {
+      // a trapezoid with the bottom-left corner
+      area = 0.5 * (entry.pos + exit.pos);
+    }
+    return estimate_occupancy(area, 1, false);
+  }
+
   bool are_on_the_same_side(const Point2D &line_p1, const Point2D &line_p2,
                             const Point2D &p1, const Point2D &p2) {
     double dx = line_p2.x - line_p1.x, dy = line_p2.y - line_p1.y;
@@ -227,15 +389,15 @@ private: // methods
     double area_rate = chunk_area / total_area;
     if (is_occ) {
       // Far ToDo: think about experiment quality metric for an occupied case.
-      return Occupancy{std::max(area_rate, base_empty().prob_occ),
-                       base_occupied().estimation_quality};
+      return Occupancy(std::max<double>(area_rate, base_empty().prob_occ),
+                       base_occupied().estimation_quality);
     } else {
       // TODO: fix scale
       if (0.5 < area_rate) {
         area_rate = 1 - area_rate;
       }
-      return Occupancy{base_empty().prob_occ,
-                       base_empty().estimation_quality * area_rate};
+      return Occupancy(base_empty().prob_occ,
+                       base_empty().estimation_quality * area_rate);
     }
   }
 private:
@@ -243,4 +405,7 @@ private:
   double _unknown_qual;
 };
 
+constexpr double AreaOccupancyEstimator::BeamWalk::Min_Chord_Len;
+constexpr double AreaOccupancyEstimator::BeamWalk::Inf;
+
 #endif
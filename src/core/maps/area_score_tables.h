@@ -0,0 +1,217 @@
+#ifndef SLAM_CTOR_CORE_AREA_SCORE_TABLES_H
+#define SLAM_CTOR_CORE_AREA_SCORE_TABLES_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "grid_map.h"
+#include "max_pooled_score_pyramid.h"
+
+// A flat row-major array of scores of cells of a map
+// (cells outside [min, min + (width, height)) are scored as unknown).
+struct CellScoresView {
+  const double *scores;
+  GridMap::Coord min;
+  int width, height;
+  double scale, unknown_score;
+
+  // Whether scores of all cells of [min_x, max_x] x [min_y, max_y]
+  // (world coordinates) are in the array
+  bool covers(double min_x, double min_y, double max_x, double max_y) const {
+    return min.x <= std::floor(min_x / scale) &&
+           min.y <= std::floor(min_y / scale) &&
+           std::floor(max_x / scale) < min.x + width &&
+           std::floor(max_y / scale) < min.y + height;
+  }
+};
+
+/* Read-only tables of cell scores of a grid map that answer queries
+ * about a rectangle of cells in O(1) regardless of the rectangle size
+ * (see the Max/Mean/Overlap occupancy observation estimators).
+ * A score of a cell is 1 - discrepancy of the expected scan point
+ * observation (an obstacle); cells outside the map are scored as unknown.
+ * - a sum of scores is answered by a summed-area table;
+ * - a max score is answered by a max-pooled pyramid: a rectangle is
+ *   covered by (possibly overlapping) 2^L x 2^L windows with
+ *   2^L <= the rectangle's shorter side, so a square rectangle that
+ *   is shorter than twice the longest window side takes up to 4 lookups.
+ * The tables are refreshed from the live map on sync: only the area
+ * modified since the previous sync is recomputed (the summed-area table
+ * is recomputed above and to the right of the area) unless the map
+ * geometry has changed. */
+class AreaScoreTables {
+public: // types
+  using Coord = GridMap::Coord;
+public: // consts
+  static constexpr unsigned Default_Max_Levels_Nm = 4;
+public:
+  explicit AreaScoreTables(unsigned max_levels_nm = Default_Max_Levels_Nm)
+    : _max_scores{max_levels_nm} {}
+
+  // The observation that is answered by the tables
+  static AreaOccupancyObservation expected_observation() {
+    return MaxPooledScorePyramid::expected_observation();
+  }
+
+  // NB: the obstacle is ignored, i.e. cells are expected to estimate
+  //     discrepancies by occupancy.
+  static bool is_expected(const AreaOccupancyObservation &aoo) {
+    auto expected = expected_observation();
+    return aoo.is_occupied == expected.is_occupied &&
+           aoo.occupancy == expected.occupancy &&
+           aoo.quality == expected.quality;
+  }
+
+  double unknown_score() const { return _unknown_score; }
+
+  std::size_t memory_size() const {
+    return _max_scores.memory_size() +
+           (_scores.capacity() + _sums.capacity() +
+            _row_discrepancies.capacity()) * sizeof(double);
+  }
+
+  CellScoresView cell_scores() const {
+    return {_scores.data(), _min, _width, _height, _scale, _unknown_score};
+  }
+
+  void sync(const GridMap &map) {
+    _max_scores.sync(map);
+
+    auto version = map.version();
+    auto geometry_is_same = _is_built && _scale == map.scale() &&
+      _min == map.internal2external({0, 0}) &&
+      _width == map.width() && _height == map.height();
+    if (geometry_is_same) {
+      auto area = map.modified_area(_version);
+      if (area.is_known) {
+        _version = version;
+        if (!area.is_empty()) { refresh(map, area.min, area.max); }
+        return;
+      }
+    }
+
+    _scale = map.scale();
+    _min = map.internal2external({0, 0});
+    _width = map.width();
+    _height = map.height();
+    _unknown_score = 1.0 - map.new_cell()->discrepancy(expected_observation());
+    _scores.assign(std::size_t(_width) * _height, _unknown_score);
+    _sums.assign(std::size_t(_width + 1) * (_height + 1), 0);
+    _is_built = true;
+    _version = version;
+    refresh(map, _min, _min + Coord{_width - 1, _height - 1});
+  }
+
+  // The max score of cells in [lb, rt]
+  double max_score(const Coord &lb, const Coord &rt) const {
+    if (rt.x < lb.x || rt.y < lb.y) { return 0; }
+    // NB: windows that start outside the map are upper bounds
+    //     (see MaxPooledScorePyramid::score), so the rectangle is clipped.
+    auto in_lb = Coord{std::max(lb.x, _min.x), std::max(lb.y, _min.y)};
+    auto in_rt = Coord{std::min(rt.x, _min.x + _width - 1),
+                       std::min(rt.y, _min.y + _height - 1)};
+    auto max_score = double{0};
+    if (in_lb != lb || in_rt != rt) { max_score = _unknown_score; }
+    if (in_rt.x < in_lb.x || in_rt.y < in_lb.y) { return max_score; }
+
+    auto side_len = std::min(in_rt.x - in_lb.x, in_rt.y - in_lb.y) + 1;
+    unsigned level = 0;
+    while (level + 1 < _max_scores.levels_nm() && (2 << level) <= side_len) {
+      ++level;
+    }
+    int window_len = 1 << level;
+
+    // NB: the last window in a row/column is aligned with the rectangle's
+    //     border, so it may overlap the previous one.
+    for (int y = in_lb.y; ; y += window_len) {
+      auto window_y = std::min(y, in_rt.y - window_len + 1);
+      for (int x = in_lb.x; ; x += window_len) {
+        auto window_x = std::min(x, in_rt.x - window_len + 1);
+        max_score = std::max(max_score, double(_max_scores.score(
+          level, {window_x, window_y})));
+        if (in_rt.x < x + window_len) { break; }
+      }
+      if (in_rt.y < y + window_len) { break; }
+    }
+    return max_score;
+  }
+
+  // The sum of scores of cells in [lb, rt]
+  double score_sum(const Coord &lb, const Coord &rt) const {
+    if (rt.x < lb.x || rt.y < lb.y) { return 0; }
+    auto cells_nm = double(rt.x - lb.x + 1) * (rt.y - lb.y + 1);
+    auto in_lb = Coord{std::max(lb.x - _min.x, 0),
+                       std::max(lb.y - _min.y, 0)};
+    auto in_rt = Coord{std::min(rt.x - _min.x, _width - 1),
+                       std::min(rt.y - _min.y, _height - 1)};
+    if (in_rt.x < in_lb.x || in_rt.y < in_lb.y) {
+      return cells_nm * _unknown_score;
+    }
+
+    auto in_map_sum = sum(in_rt.x + 1, in_rt.y + 1) - sum(in_lb.x, in_rt.y + 1)
+                    - sum(in_rt.x + 1, in_lb.y) + sum(in_lb.x, in_lb.y);
+    auto in_map_cells_nm =
+      double(in_rt.x - in_lb.x + 1) * (in_rt.y - in_lb.y + 1);
+    return in_map_sum + (cells_nm - in_map_cells_nm) * _unknown_score;
+  }
+
+private: // methods
+
+  // The sum of scores of internal cells [0, x) x [0, y)
+  double sum(int x, int y) const {
+    return _sums[std::size_t(y) * (_width + 1) + x];
+  }
+
+  // Recomputes scores in [min, max] and sums that depend on them
+  void refresh(const GridMap &map, const Coord &min, const Coord &max) {
+    auto in_min = Coord{std::max(min.x - _min.x, 0),
+                        std::max(min.y - _min.y, 0)};
+    auto in_max = Coord{std::min(max.x - _min.x, _width - 1),
+                        std::min(max.y - _min.y, _height - 1)};
+    if (in_max.x < in_min.x || in_max.y < in_min.y) { return; }
+
+    // PERFORMANCE: discrepancies are requested per rows
+    //              (see GridMap::row_discrepancies).
+    auto row_len = in_max.x - in_min.x + 1;
+    _row_discrepancies.resize(row_len);
+    for (int y = in_min.y; y <= in_max.y; ++y) {
+      map.row_discrepancies(_min + Coord{in_min.x, y}, row_len,
+                            expected_observation(),
+                            _row_discrepancies.data());
+      auto *row_scores = _scores.data() + std::size_t(y) * _width + in_min.x;
+      for (int i = 0; i < row_len; ++i) {
+        row_scores[i] = 1.0 - _row_discrepancies[i];
+      }
+    }
+
+    // NB: a sum (x, y) covers all cells below and to the left of it
+    auto sums_w = std::size_t(_width + 1);
+    for (int y = in_min.y; y < _height; ++y) {
+      const auto *row_scores = _scores.data() + std::size_t(y) * _width;
+      auto *prev_row_sums = _sums.data() + std::size_t(y) * sums_w;
+      auto *row_sums = prev_row_sums + sums_w;
+      // NB: sums to the left of the area are up to date
+      auto row_sum = row_sums[in_min.x] - prev_row_sums[in_min.x];
+      for (int x = in_min.x; x < _width; ++x) {
+        row_sum += row_scores[x];
+        row_sums[x + 1] = prev_row_sums[x + 1] + row_sum;
+      }
+    }
+  }
+
+private: // fields
+  MaxPooledScorePyramid _max_scores;
+  bool _is_built = false;
+  uint64_t _version = 0;
+  double _scale = 1;
+  Coord _min;
+  int _width = 0, _height = 0;
+  double _unknown_score = 0;
+  std::vector<double> _scores, _sums;
+  // a buffer reused by refreshes
+  std::vector<double> _row_discrepancies;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef SLAM_CTOR_CORE_AREA_SCORE_TABLES_GRID_MAP_H
+#define SLAM_CTOR_CORE_AREA_SCORE_TABLES_GRID_MAP_H
+
+#include <memory>
+#include <vector>
+
+#include "grid_cell.h"
+#include "grid_map.h"
+#include "area_score_tables.h"
+
+/* A grid map decorator that keeps area score tables of the back map,
+ * so Max/Mean/Overlap occupancy observation estimators answer
+ * a scan point's rectangle with a few lookups instead of a discrepancy
+ * request per covered cell.
+ * Tables are refreshed from the back map's modified area on the first
+ * read that follows a modification. */
+template <typename BackGridMap>
+class AreaScoreTablesGridMap : public GridMap {
+public:
+  AreaScoreTablesGridMap(std::shared_ptr<GridCell> prototype,
+                         const GridMapParams& params = MapValues::gmp,
+                         unsigned max_levels_nm =
+                           AreaScoreTables::Default_Max_Levels_Nm)
+    : GridMap{prototype, params}
+    , _back_map{prototype, params}
+    , _max_levels_nm{max_levels_nm}
+    , _tables{max_levels_nm} {}
+
+  //----------------------------------------------------------------------------
+  // RegularSquaresGrid overrides
+
+  Coord origin() const override { return _back_map.origin(); }
+  int width() const override { return _back_map.width(); }
+  int height() const override { return _back_map.height(); }
+  double scale() const override { return _back_map.scale(); }
+  bool has_cell(const Coord &c) const override {
+    return _back_map.has_cell(c);
+  }
+
+  //----------------------------------------------------------------------------
+  // GridMap overrides
+
+  const GridCell& operator[](const Coord &coord) const override {
+    return _back_map[coord];
+  }
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    _back_map.update(area_id, aoo);
+    _tables_are_synced = false;
+  }
+
+  void reset(const Coord &area_id, const GridCell &area) override {
+    _back_map.reset(area_id, area);
+    _tables_are_synced = false;
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    return _back_map.discrepancy(area_id, aoo);
+  }
+
+  void row_discrepancies(const Coord &area_id, int areas_nm,
+                         const AreaOccupancyObservation &aoo,
+                         double *discrepancies) const override {
+    _back_map.row_discrepancies(area_id, areas_nm, aoo, discrepancies);
+  }
+
+  void row_occupancies(const Coord &area_id, int areas_nm,
+                       double *probs) const override {
+    _back_map.row_occupancies(area_id, areas_nm, probs);
+  }
+
+  const AreaScoreTables *area_score_tables() const override {
+    // NB: the tables are a cache, so the sync is logically const
+    if (!_tables_are_synced) {
+      const_cast<AreaScoreTablesGridMap&>(*this).sync_tables();
+    }
+    return &_tables;
+  }
+
+  GridTraversalOrder traversal_order() const override {
+    return _back_map.traversal_order();
+  }
+
+  // the tables are synced on the first read after a modification
+  bool supports_concurrent_reads() const override {
+    return _tables_are_synced && _back_map.supports_concurrent_reads();
+  }
+
+  void prepare_for_reads() override {
+    _back_map.prepare_for_reads();
+    if (!_tables_are_synced) { sync_tables(); }
+  }
+
+  // NB: the tables are a cache, so only the back map is captured
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return _back_map.snapshot();
+  }
+
+  uint64_t version() const override { return _back_map.version(); }
+  uint64_t instance_id() const override {
+    return _back_map.instance_id();
+  }
+
+  // NB: the tables are an overhead of the back map
+  GridMapMemoryUsage memory_usage() const override {
+    auto usage = _back_map.memory_usage();
+    usage.add_overhead(_tables.memory_size());
+    return usage;
+  }
+
+  ModifiedGridArea modified_area(uint64_t since_version) const override {
+    return _back_map.modified_area(since_version);
+  }
+
+  std::vector<char> save_state() const override {
+    return _back_map.save_state();
+  }
+
+  bool load_state(const std::vector<char> &data) override {
+    if (!_back_map.load_state(data)) { return false; }
+    // NB: a loaded state is not tracked as a modification
+    _tables = AreaScoreTables{_max_levels_nm};
+    _tables_are_synced = false;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Own API
+
+  void sync_tables() {
+    _tables.sync(_back_map);
+    _tables_are_synced = true;
+  }
+
+private: // fields
+  BackGridMap _back_map;
+  unsigned _max_levels_nm;
+  AreaScoreTables _tables;
+  bool _tables_are_synced = false;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef SLAM_CTOR_CORE_ASYNC_GRID_MAP_OBSERVER_H
+#define SLAM_CTOR_CORE_ASYNC_GRID_MAP_OBSERVER_H
+
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../states/world.h"
+#include "grid_map.h"
+
+/* Forwards map updates to an observer on a dedicated thread, so a slow
+ * observer (e.g. a map publisher) does not block the mapping.
+ * The observer gets a snapshot of the map; only the latest snapshot
+ * is kept, i.e. intermediate updates are dropped if the observer lags.
+ * Maps that do not support snapshots are observed synchronously.
+ * Updates are throttled by the given clock (the steady one by default),
+ * so the rate may follow the time of the observers (e.g. ROS time that is
+ * simulated on bag playbacks); a clock that goes back restarts the rate.
+ * NB: several observers share a snapshot (e.g. map publishers of
+ *     different resolutions), they are notified one by one. */
+template <typename MapT>
+class AsyncGridMapObserver : public WorldMapObserver<MapT> {
+public: // types
+  // returns the current time in seconds
+  using Clock = std::function<double()>;
+public:
+  AsyncGridMapObserver(std::shared_ptr<WorldMapObserver<GridMap>> observer,
+                       double min_interval_secs = 0,
+                       Clock clock = steady_clock_secs)
+    : _observers{observer}
+    , _min_interval_secs{min_interval_secs}
+    , _clock{std::move(clock)}
+    , _worker{&AsyncGridMapObserver::observe_snapshots, this} {}
+
+  AsyncGridMapObserver(const AsyncGridMapObserver&) = delete;
+  AsyncGridMapObserver& operator=(const AsyncGridMapObserver&) = delete;
+
+  ~AsyncGridMapObserver() {
+    {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      _is_stopped = true;
+    }
+    _has_work.notify_one();
+    _worker.join();
+  }
+
+  // NB: is expected to be called before map updates
+  void subscribe(std::shared_ptr<WorldMapObserver<GridMap>> observer) {
+    auto lock = std::unique_lock<std::mutex>{_mutex};
+    _observers.push_back(observer);
+  }
+
+  void on_map_update(const MapT &map) override {
+    // NB: the snapshot is taken on the mapping thread, so it is throttled
+    auto now = _clock();
+    if (_has_last_update && _last_update_secs <= now &&
+        now - _last_update_secs < _min_interval_secs) {
+      return;
+    }
+    _has_last_update = true;
+    _last_update_secs = now;
+
+    auto snapshot = map.snapshot();
+    if (!snapshot) {
+      for (auto &observer : _observers) { observer->on_map_update(map); }
+      return;
+    }
+    {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      _pending_snapshot = std::move(snapshot);
+    }
+    _has_work.notify_one();
+  }
+
+private: // methods
+
+  static double steady_clock_secs() {
+    return std::chrono::duration<double>{
+      std::chrono::steady_clock::now().time_since_epoch()}.count();
+  }
+
+  void observe_snapshots() {
+    while (true) {
+      auto snapshot = std::shared_ptr<const GridMap>{};
+      {
+        auto lock = std::unique_lock<std::mutex>{_mutex};
+        _has_work.wait(lock, [this] {
+          return _is_stopped || _pending_snapshot;
+        });
+        if (!_pending_snapshot) { return; } // stopped, nothing to observe
+        snapshot = std::move(_pending_snapshot);
+        _pending_snapshot.reset();
+      }
+      for (auto &observer : _observers) {
+        observer->on_map_update(*snapshot);
+      }
+    }
+  }
+
+private: // fields
+  std::vector<std::shared_ptr<WorldMapObserver<GridMap>>> _observers;
+  double _min_interval_secs;
+  Clock _clock;
+  bool _has_last_update = false;
+  double _last_update_secs = 0;
+
+  std::mutex _mutex;
+  std::condition_variable _has_work;
+  std::shared_ptr<const GridMap> _pending_snapshot;
+  bool _is_stopped = false;
+  // NB: the last field, so the worker starts with the fields initialized
+  std::thread _worker;
+};
+
+#endif
@@ -1,8 +1,11 @@
 #ifndef SLAM_CTOR_CORE_CELL_OCCUPANCY_ESTIMATOR_H
 #define SLAM_CTOR_CORE_CELL_OCCUPANCY_ESTIMATOR_H
 
+#include <vector>
+
 #include "../geometry_utils.h"
 #include "../states/state_data.h" // the Occupancy class
+#include "regular_squares_grid.h"
 
 class CellOccupancyEstimator {
 public:
@@ -13,6 +16,19 @@ public:
   virtual Occupancy estimate_occupancy(const Segment2D &beam,
                                        const Rectangle &cell_bnds,
                                        bool is_occ) = 0;
+
+  // Estimates empty cells of a beam, i.e. cells of the grid it passes
+  // in the traversal order (see RegularSquaresGrid::world_to_cells).
+  virtual void estimate_beam_occupancies(
+      const Segment2D &beam, const RegularSquaresGrid &grid,
+      const std::vector<RegularSquaresGrid::Coord> &cells,
+      std::vector<Occupancy> &occupancies) {
+    occupancies.resize(cells.size());
+    for (std::size_t i = 0; i < cells.size(); ++i) {
+      auto cell_bnds = grid.world_cell_bounds(cells[i]);
+      occupancies[i] = estimate_occupancy(beam, cell_bnds, false);
+    }
+  }
 protected:
   const Occupancy& base_occupied() const { return _base_occ; }
   const Occupancy& base_empty() const { return _base_empty; }
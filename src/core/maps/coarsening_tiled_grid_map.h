@@ -0,0 +1,285 @@
+#ifndef SLAM_CTOR_CORE_COARSENING_TILED_GRID_MAP_H
+#define SLAM_CTOR_CORE_COARSENING_TILED_GRID_MAP_H
+
+#include <memory>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+#include "grid_cell.h"
+#include "grid_cell_storages.h"
+#include "grid_map.h"
+#include "sparse_tiled_grid_map.h"
+
+struct TileCoarseningParams {
+  // a tile farther (in meters) than the distance from the last modified
+  // area (i.e. from the robot's working area) is coarsened;
+  // 0 - the distance is not checked
+  double distance = 30;
+  // a tile that hasn't been modified for the number of map updates
+  // is coarsened; 0 - the idle time is not checked
+  uint64_t idle_updates = 0;
+  // tiles are checked once per the number of map updates
+  unsigned check_period = 4096;
+};
+
+/* A sparse tiled map that bounds memory by a level of detail policy:
+ * cold tiles (see TileCoarseningParams) are downsampled in place by
+ * 2^CoarseningBits times per side and are refined on the next write,
+ * so memory tracks the working area while the whole map stays readable.
+ * An area of a coarse tile keeps the most occupied finer area it covers
+ * (as coarser maps of RescalableCachingGridMap do), so obstacles
+ * are kept; a refined area is the coarse one it is covered by.
+ * NB: an unknown area of a block outweighs free ones;
+ *     coarsening is reported as a modification of the tile's areas. */
+template <typename CellStorage, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout,
+          unsigned CoarseningBits = 2>
+class GenericCoarseningTiledGridMap
+  : public GenericSparseTiledGridMap<CellStorage, TileSizeBits, TileLayout> {
+  static_assert(0 < CoarseningBits && CoarseningBits < TileSizeBits,
+                "A coarse tile must have at least 2x2 areas");
+private: // types
+  using Base = GenericSparseTiledGridMap<CellStorage, TileSizeBits,
+                                         TileLayout>;
+  using typename Base::Tile;
+  using typename Base::TileCoordHash;
+  using CoarseTile = GridMapTile<CellStorage, TileSizeBits - CoarseningBits,
+                                 TileLayout>;
+public: // types
+  using typename Base::Coord;
+public:
+  GenericCoarseningTiledGridMap(std::shared_ptr<GridCell> prototype,
+                                const GridMapParams& params = MapValues::gmp,
+                                const TileCoarseningParams &coarsening = {})
+    : Base{prototype, params}, _coarsening{coarsening} {
+    _coarsening.check_period = std::max(1u, _coarsening.check_period);
+  }
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    ensure_refined(area_id);
+    Base::update(area_id, aoo);
+    on_write(area_id);
+  }
+
+  void reset(const Coord &area_id, const GridCell &new_area) override {
+    ensure_refined(area_id);
+    Base::reset(area_id, new_area);
+    on_write(area_id);
+  }
+
+  // PERFORMANCE: coarse tiles are looked up only for areas
+  //              that are out of fine tiles.
+  const GridCell &operator[](const Coord& area_id) const override {
+    if (auto tile = this->find_tile(area_id)) {
+      return CellStorage::cell(tile->cell(area_id));
+    }
+    if (auto coarse_tile = find_coarse_tile(area_id)) {
+      return CellStorage::cell(coarse_tile->cell(coarse_coord(area_id)));
+    }
+    return *this->unknown_cell();
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    if (auto tile = this->find_tile(area_id)) {
+      return CellStorage::discrepancy(tile->cell(area_id), aoo);
+    }
+    if (auto coarse_tile = find_coarse_tile(area_id)) {
+      return CellStorage::discrepancy(
+        coarse_tile->cell(coarse_coord(area_id)), aoo);
+    }
+    return this->unknown_cell()->discrepancy(aoo);
+  }
+
+  bool load_state(const std::vector<char> &data) override {
+    if (!Base::load_state(data)) { return false; }
+    auto header = TiledMapCheckpoint::Header{};
+    std::size_t pos = 0;
+    TiledMapCheckpoint::read_header(data, header, pos);
+
+    // loaded tiles supersede coarse ones
+    if (!header.is_delta) { _coarse_tiles.clear(); }
+    for (auto &tile : this->tiles()) {
+      _coarse_tiles.erase(tile.first);
+      _write_stamps[tile.first] = _updates_nm;
+    }
+    _has_recent_tile = false;
+    return true;
+  }
+
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericCoarseningTiledGridMap>(*this);
+  }
+
+  const TileCoarseningParams &coarsening_params() const { return _coarsening; }
+  std::size_t coarse_tiles_nm() const { return _coarse_tiles.size(); }
+
+  GridMapMemoryUsage memory_usage() const override {
+    auto usage = Base::memory_usage();
+    auto coarse_tile_bytes = CoarseTile::memory_size(*this->unknown_cell());
+    for (auto &coarse_tile : _coarse_tiles) {
+      usage.add_tile(coarse_tile_bytes, coarse_tile.second.use_count());
+    }
+    usage.add_overhead(Base::hash_table_bytes(_coarse_tiles) +
+                       Base::hash_table_bytes(_write_stamps));
+    return usage;
+  }
+
+  // Coarsens cold tiles regardless of the check period
+  void coarsen_cold_tiles() {
+    auto cold_tcs = std::vector<Coord>{};
+    for (auto &tile : this->tiles()) {
+      if (is_cold(tile.first)) { cold_tcs.push_back(tile.first); }
+    }
+    for (auto &tc : cold_tcs) {
+      _coarse_tiles[tc] = coarsen(*this->detach_tile(tc));
+      _write_stamps.erase(tc);
+      // NB: reads of the tile's areas have changed
+      this->on_area_modified(tile_min(tc));
+      this->on_area_modified(tile_min(tc) + Coord{int(Tile::Size) - 1,
+                                                  int(Tile::Size) - 1});
+    }
+  }
+
+protected: // methods
+
+  std::vector<Coord> stored_tile_coords() const override {
+    auto coords = Base::stored_tile_coords();
+    for (auto &tile : _coarse_tiles) { coords.push_back(tile.first); }
+    return coords;
+  }
+
+  // NB: a coarse tile is stored refined, i.e. as a tile of the map
+  std::shared_ptr<const Tile> stored_tile(const Coord &tc) const override {
+    auto coarse_it = _coarse_tiles.find(tc);
+    if (coarse_it == _coarse_tiles.end()) { return Base::stored_tile(tc); }
+    return refine(*coarse_it->second);
+  }
+
+private: // methods
+
+  static Coord tile_min(const Coord &tc) {
+    return {tc.x * int(Tile::Size), tc.y * int(Tile::Size)};
+  }
+
+  // NB: only the lower bits are used by a coarse tile
+  static Coord coarse_coord(const Coord &area_id) {
+    return {area_id.x >> CoarseningBits, area_id.y >> CoarseningBits};
+  }
+
+  const CoarseTile *find_coarse_tile(const Coord &area_id) const {
+    if (_coarse_tiles.empty()) { return nullptr; }
+    auto coarse_it = _coarse_tiles.find(Base::tile_coord(area_id));
+    return coarse_it == _coarse_tiles.end() ? nullptr
+                                            : coarse_it->second.get();
+  }
+
+  template <typename Action>
+  static void for_each_tile_cell_coord(Action action) {
+    auto c = Coord{0, 0};
+    for (c.y = 0; c.y < int(Tile::Size); ++c.y) {
+      for (c.x = 0; c.x < int(Tile::Size); ++c.x) {
+        action(c);
+      }
+    }
+  }
+
+  std::shared_ptr<CoarseTile> coarsen(const Tile &tile) const {
+    constexpr int Block_Mask = (1 << CoarseningBits) - 1;
+    auto coarse_tile = std::make_shared<CoarseTile>(*this->unknown_cell());
+    for_each_tile_cell_coord([&](const Coord &c) {
+      auto &area = CellStorage::cell(tile.cell(c));
+      auto &coarse_area = coarse_tile->cell(coarse_coord(c));
+      bool is_block_start = !(c.x & Block_Mask) && !(c.y & Block_Mask);
+      if (is_block_start ||
+          double(CellStorage::cell(coarse_area)) < double(area)) {
+        CellStorage::reset(coarse_area, area);
+      }
+    });
+    return coarse_tile;
+  }
+
+  std::shared_ptr<Tile> refine(const CoarseTile &coarse_tile) const {
+    auto tile = std::make_shared<Tile>(*this->unknown_cell());
+    for_each_tile_cell_coord([&](const Coord &c) {
+      CellStorage::reset(tile->cell(c), CellStorage::cell(
+                           coarse_tile.cell(coarse_coord(c))));
+    });
+    return tile;
+  }
+
+  void ensure_refined(const Coord &area_id) {
+    if (_coarse_tiles.empty()) { return; }
+    auto tc = Base::tile_coord(area_id);
+    auto coarse_it = _coarse_tiles.find(tc);
+    if (coarse_it == _coarse_tiles.end()) { return; }
+
+    this->attach_tile(tc, refine(*coarse_it->second));
+    _coarse_tiles.erase(coarse_it);
+  }
+
+  void on_write(const Coord &area_id) {
+    ++_updates_nm;
+    _working_area = area_id;
+    auto tc = Base::tile_coord(area_id);
+    // PERFORMANCE: consecutive updates mostly hit the same tile,
+    //              its stamp is refreshed on a check
+    if (!_has_recent_tile || tc != _recent_tile) {
+      _has_recent_tile = true;
+      _recent_tile = tc;
+      _write_stamps[tc] = _updates_nm;
+    }
+    if (_updates_nm % _coarsening.check_period == 0) {
+      _write_stamps[tc] = _updates_nm;
+      coarsen_cold_tiles();
+    }
+  }
+
+  bool is_cold(const Coord &tc) {
+    if (_has_recent_tile && tc == _recent_tile) { return false; }
+
+    auto stamp_it = _write_stamps.find(tc);
+    if (stamp_it == _write_stamps.end()) {
+      // e.g. a tile of a copied map
+      stamp_it = _write_stamps.emplace(tc, _updates_nm).first;
+    }
+    auto idle_updates = _coarsening.idle_updates;
+    if (idle_updates && idle_updates < _updates_nm - stamp_it->second) {
+      return true;
+    }
+    if (_coarsening.distance <= 0) { return false; }
+
+    auto min = tile_min(tc);
+    auto max = min + Coord{int(Tile::Size) - 1, int(Tile::Size) - 1};
+    auto dx = std::max({0, min.x - _working_area.x, _working_area.x - max.x});
+    auto dy = std::max({0, min.y - _working_area.y, _working_area.y - max.y});
+    return _coarsening.distance < std::hypot(dx, dy) * this->scale();
+  }
+
+private: // fields
+  TileCoarseningParams _coarsening;
+  // NB: coarse tiles are never modified, so they are shared by copies
+  std::unordered_map<Coord, std::shared_ptr<CoarseTile>,
+                     TileCoordHash> _coarse_tiles;
+  std::unordered_map<Coord, uint64_t, TileCoordHash> _write_stamps;
+  uint64_t _updates_nm = 0;
+  Coord _working_area;
+  bool _has_recent_tile = false;
+  Coord _recent_tile;
+};
+
+using CoarseningTiledGridMap =
+  GenericCoarseningTiledGridMap<PolymorphicCellStorage>;
+
+template <typename CellT, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+using ValueCoarseningTiledGridMap = GenericCoarseningTiledGridMap<
+  ValueCellStorage<CellT>, TileSizeBits, TileLayout>;
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef SLAM_CTOR_CORE_EXPECTED_RANGE_CACHE_H
+#define SLAM_CTOR_CORE_EXPECTED_RANGE_CACHE_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <unordered_map>
+
+#include "grid_map.h"
+#include "grid_ray_caster.h"
+#include "../flat_cell_map.h"
+
+struct ExpectedRangeCacheParams {
+  // ranges of rays that hit no obstacle
+  double max_range = 15;
+  // rays per lattice point (evenly spread over the full circle)
+  unsigned angle_bins_nm = 180;
+  // the distance between lattice points, in cells
+  unsigned lattice_step = 2;
+  // an area is an obstacle if its occupancy is at least the threshold
+  double obstacle_threshold = 0.6;
+};
+
+/* Expected ranges of rays cast from points of a lattice over a map
+ * (e.g. for a beam model of a scan probability estimator).
+ * A query is answered by the nearest lattice point and the nearest
+ * angle bin; lattice points are centers of every lattice_step-th cell.
+ * Ranges are computed lazily per tile of Tile_Side x Tile_Side lattice
+ * points (see GridRayCaster).
+ * On sync the cache checks the area modified since the previous sync:
+ * only tiles with rays that may pass areas whose obstacle state
+ * has changed (i.e. tiles within the max range of them) are dropped,
+ * so updates of estimates of known obstacles and free space
+ * keep the cache.
+ * NB: the cache is not thread-safe (tiles are filled by queries). */
+class ExpectedRangeCache {
+public: // types
+  using Coord = GridMap::Coord;
+public: // consts
+  static constexpr int Tile_Side = 8;
+public:
+  explicit ExpectedRangeCache(const ExpectedRangeCacheParams &params = {})
+    : _params{params} {
+    _params.angle_bins_nm = std::max(_params.angle_bins_nm, 1u);
+    _params.lattice_step = std::max(_params.lattice_step, 1u);
+    _bin_angle = 2 * M_PI / _params.angle_bins_nm;
+  }
+
+  const ExpectedRangeCacheParams &params() const { return _params; }
+  std::size_t tiles_nm() const { return _tiles.size(); }
+
+  std::size_t memory_size() const {
+    return _tiles.size() * tile_ranges_nm() * sizeof(float);
+  }
+
+  void sync(const GridMap &map) {
+    auto version = map.version();
+    // NB: a map at the same address may be a replaced one
+    if (_map == &map && _map_id == map.instance_id() &&
+        _scale == map.scale()) {
+      auto area = map.modified_area(_version);
+      if (area.is_known) {
+        _version = version;
+        if (!area.is_empty()) { on_area_modified(map, area.min, area.max); }
+        return;
+      }
+    }
+
+    _map = &map;
+    _map_id = map.instance_id();
+    _scale = map.scale();
+    _version = version;
+    _tiles.clear();
+    _last_tile = nullptr;
+    _obstacles.clear();
+    auto min = map.internal2external({0, 0});
+    auto max = min + Coord{map.width() - 1, map.height() - 1};
+    track_obstacles(map, min, max);
+  }
+
+  // The expected range of the ray from the lattice point that is
+  // the nearest to the origin in the bin of the angle.
+  // NB: the map is expected to be synced.
+  double expected_range(const GridMap &map, const Point2D &origin,
+                        double angle) const {
+    auto step = int(_params.lattice_step);
+    auto lattice_id = Coord{
+      int(std::round((origin.x / _scale - 0.5) / step)),
+      int(std::round((origin.y / _scale - 0.5) / step))};
+    auto tile_id = Coord{floor_div(lattice_id.x, Tile_Side),
+                         floor_div(lattice_id.y, Tile_Side)};
+    auto in_tile_id = lattice_id - Coord{tile_id.x * Tile_Side,
+                                         tile_id.y * Tile_Side};
+
+    auto bin = long(std::round(angle / _bin_angle)) %
+               long(_params.angle_bins_nm);
+    if (bin < 0) { bin += _params.angle_bins_nm; }
+
+    const auto &ranges = tile_ranges(map, tile_id);
+    auto point_i = std::size_t(in_tile_id.y) * Tile_Side + in_tile_id.x;
+    return ranges[point_i * _params.angle_bins_nm + bin];
+  }
+
+private: // methods
+
+  static int floor_div(int v, int d) {
+    return v >= 0 ? v / d : -((d - 1 - v) / d);
+  }
+
+  static uint64_t tile_key(const Coord &tile_id) {
+    return (uint64_t(uint32_t(tile_id.x)) << 32) | uint32_t(tile_id.y);
+  }
+
+  std::size_t tile_ranges_nm() const {
+    return std::size_t(Tile_Side) * Tile_Side * _params.angle_bins_nm;
+  }
+
+  bool is_obstacle(const GridMap &map, const Coord &area_id) const {
+    return _params.obstacle_threshold <= double(map[area_id]);
+  }
+
+  // PERFORMANCE: the last tile is looked up first,
+  //              i.e. points of a scan share the lookup.
+  const std::vector<float> &tile_ranges(const GridMap &map,
+                                        const Coord &tile_id) const {
+    auto key = tile_key(tile_id);
+    if (_last_tile && _last_tile_key == key) { return *_last_tile; }
+
+    auto tile_it = _tiles.find(key);
+    if (tile_it == _tiles.end()) {
+      tile_it = _tiles.emplace(key, compute_tile(map, tile_id)).first;
+    }
+    _last_tile_key = key;
+    _last_tile = &tile_it->second;
+    return *_last_tile;
+  }
+
+  std::vector<float> compute_tile(const GridMap &map,
+                                  const Coord &tile_id) const {
+    auto ranges = std::vector<float>(tile_ranges_nm());
+    auto is_obstacle = GridRayCaster::occupancy_threshold(
+      map, _params.obstacle_threshold);
+    auto step = int(_params.lattice_step);
+    auto range_i = std::size_t{0};
+    for (int y = 0; y < Tile_Side; ++y) {
+      for (int x = 0; x < Tile_Side; ++x) {
+        auto cell = Coord{(tile_id.x * Tile_Side + x) * step,
+                          (tile_id.y * Tile_Side + y) * step};
+        auto origin = map.cell_to_world(cell);
+        for (unsigned bin = 0; bin < _params.angle_bins_nm; ++bin) {
+          auto hit = GridRayCaster::cast(map, origin, bin * _bin_angle,
+                                         _params.max_range, is_obstacle);
+          ranges[range_i++] = hit.is_hit ?
+            std::min(hit.range, _params.max_range) : _params.max_range;
+        }
+      }
+    }
+    return ranges;
+  }
+
+  // Tracks obstacles of the area; returns whether some have changed
+  // and the bounding box of changed areas.
+  bool track_obstacles(const GridMap &map, const Coord &min,
+                       const Coord &max, Coord *changed_min = nullptr,
+                       Coord *changed_max = nullptr) {
+    bool is_changed = false;
+    for (int y = min.y; y <= max.y; ++y) {
+      for (int x = min.x; x <= max.x; ++x) {
+        auto area_id = Coord{x, y};
+        auto is_obst = is_obstacle(map, area_id);
+        auto *tracked = _obstacles.find(area_id);
+        if (!tracked) {
+          if (!is_obst) { continue; }
+          tracked = _obstacles.emplace(area_id, false).first;
+        }
+        if (*tracked == is_obst) { continue; }
+        *tracked = is_obst;
+        if (changed_min && changed_max) {
+          *changed_min = is_changed ? Coord{std::min(changed_min->x, x),
+                                            std::min(changed_min->y, y)}
+                                    : area_id;
+          *changed_max = is_changed ? Coord{std::max(changed_max->x, x),
+                                            std::max(changed_max->y, y)}
+                                    : area_id;
+        }
+        is_changed = true;
+      }
+    }
+    return is_changed;
+  }
+
+  void on_area_modified(const GridMap &map, const Coord &min,
+                        const Coord &max) {
+    auto changed_min = Coord{}, changed_max = Coord{};
+    if (!track_obstacles(map, min, max, &changed_min, &changed_max)) {
+      return;
+    }
+
+    // tiles of rays that may reach the changed areas are dropped
+    auto reach = int(std::ceil(_params.max_range / _scale)) + 1;
+    auto tile_cells = Tile_Side * int(_params.lattice_step);
+    auto min_tile = Coord{floor_div(changed_min.x - reach, tile_cells),
+                          floor_div(changed_min.y - reach, tile_cells)};
+    auto max_tile = Coord{floor_div(changed_max.x + reach, tile_cells),
+                          floor_div(changed_max.y + reach, tile_cells)};
+    _last_tile = nullptr;
+    for (auto it = _tiles.begin(); it != _tiles.end();) {
+      auto tile_id = Coord{int(int32_t(it->first >> 32)),
+                           int(int32_t(it->first & 0xFFFFFFFFu))};
+      bool is_reached = min_tile.x <= tile_id.x && tile_id.x <= max_tile.x &&
+                        min_tile.y <= tile_id.y && tile_id.y <= max_tile.y;
+      it = is_reached ? _tiles.erase(it) : std::next(it);
+    }
+  }
+
+private: // fields
+  ExpectedRangeCacheParams _params;
+  double _bin_angle;
+  const GridMap *_map = nullptr;
+  double _scale = 0;
+  uint64_t _map_id = 0, _version = 0;
+  // obstacle states of areas that have been obstacles
+  FlatCellMap<bool> _obstacles;
+  mutable std::unordered_map<uint64_t, std::vector<float>> _tiles;
+  mutable uint64_t _last_tile_key = 0;
+  mutable const std::vector<float> *_last_tile = nullptr;
+};
+
+constexpr int ExpectedRangeCache::Tile_Side;
+
+#endif
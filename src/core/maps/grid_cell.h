@@ -2,9 +2,11 @@
 #define SLAM_CTOR_CORE_GRID_CELL_H
 
 #include <memory>
+#include <algorithm>
 #include "../math_utils.h"
 #include "../states/sensor_data.h"
 #include "../serialization.h"
+#include "grid_cell_pool.h"
 
 class GridCell {
 public:
@@ -15,6 +17,15 @@ public:
   GridCell& operator=(GridCell&& gc) = default;
   virtual ~GridCell() = default;
 
+  // NB: cells (of any descendant type) are allocated from the pool,
+  //     so clone() doesn't hit the global allocator.
+  static void *operator new(std::size_t size) {
+    return GridCellPool::allocate(size);
+  }
+  static void operator delete(void *cell, std::size_t size) {
+    GridCellPool::deallocate(cell, size);
+  }
+
   operator double() const { return occupancy().prob_occ; }
   explicit operator bool() const { return are_equal(double(*this), 0.0); }
   virtual const Occupancy& occupancy() const { return _occupancy; }
@@ -23,10 +34,35 @@ public:
     return std::make_unique<GridCell>(*this);
   }
 
+  // The size of a cell object (e.g. a heap object of a cell map)
+  // NB: descendants override it along with clone
+  virtual std::size_t memory_size() const { return sizeof(GridCell); }
+
   virtual void operator+=(const AreaOccupancyObservation &aoo) {
     _occupancy = aoo.occupancy;
   }
 
+  // Combines the estimate of the area by another map (e.g. of another
+  // robot) with the own one. Estimates are averaged by their qualities;
+  // a cell of the 0.5 probability is unknown, i.e. it is overridden by
+  // the other estimate and doesn't change it.
+  virtual void merge(const GridCell &that) {
+    const auto &that_occ = that.occupancy();
+    if (that_occ.prob_occ == 0.5) { return; }
+    if (_occupancy.prob_occ == 0.5) {
+      _occupancy = that_occ;
+      return;
+    }
+    auto total_quality = _occupancy.estimation_quality +
+                         that_occ.estimation_quality;
+    if (total_quality == 0) { return; }
+    _occupancy.prob_occ =
+      (_occupancy.prob_occ * _occupancy.estimation_quality +
+       that_occ.prob_occ * that_occ.estimation_quality) / total_quality;
+    _occupancy.estimation_quality = std::max(_occupancy.estimation_quality,
+                                             that_occ.estimation_quality);
+  }
+
   // must be in interval [0, 1.0]
   virtual double discrepancy(const AreaOccupancyObservation &aoo) const {
     return std::abs(_occupancy - aoo.occupancy);
@@ -0,0 +1,214 @@
+#ifndef SLAM_CTOR_CORE_GRID_CELL_POOL_H
+#define SLAM_CTOR_CORE_GRID_CELL_POOL_H
+
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <algorithm>
+
+/* A size-segregated slab pool that backs GridCell allocations.
+ * Blocks are carved from large slabs and freed blocks are kept
+ * in per-thread free lists, so cell cloning (e.g. on maps construction,
+ * expansion and tiles copying) doesn't hit the global allocator,
+ * concurrent inserters don't contend and cells of a map are packed densely.
+ * Per-thread lists exchange blocks with the shared pool in batches;
+ * a slab whose blocks are all returned to the shared pool is released
+ * unless it is the only one of its size with free blocks. */
+class GridCellPool {
+public: // consts
+  static constexpr std::size_t Size_Granularity = 16;
+  static constexpr std::size_t Max_Block_Size = 128;
+  static constexpr std::size_t Slab_Size = 64 * 1024;
+  // max number of free blocks of a size a thread keeps;
+  // a half of them is exchanged with the shared pool at once
+  static constexpr std::size_t Thread_Cache_Size = 64;
+public:
+
+  static void *allocate(std::size_t size) {
+    if (Max_Block_Size < size) { return ::operator new(size); }
+    if (ThreadCache::is_destroyed()) {
+      // e.g. a clone made by a destructor of a static object
+      void *block = nullptr;
+      instance().take_blocks(size_class(size), &block, 1);
+      return block;
+    }
+    return ThreadCache::local().allocate(size_class(size));
+  }
+
+  static void deallocate(void *block, std::size_t size) {
+    if (!block) { return; }
+    if (Max_Block_Size < size) { return ::operator delete(block); }
+    if (ThreadCache::is_destroyed()) {
+      instance().return_blocks(size_class(size), &block, 1);
+      return;
+    }
+    ThreadCache::local().deallocate(block, size_class(size));
+  }
+
+  // The number of slabs held by the pool
+  static std::size_t slabs_nm() {
+    auto &pool = instance();
+    std::lock_guard<std::mutex> lock{pool._mutex};
+    return pool._slabs.size();
+  }
+
+private: // types
+  struct FreeBlock { FreeBlock *next; };
+
+  struct Slab {
+    char *memory;
+    FreeBlock *free_list;
+    std::size_t free_nm, blocks_nm;
+  };
+
+  static constexpr std::size_t Size_Classes_Nm =
+    Max_Block_Size / Size_Granularity;
+
+  // PERFORMANCE: blocks are taken and returned without synchronization,
+  //              the shared pool is locked once per a half of the cache.
+  class ThreadCache {
+  public:
+    static ThreadCache &local() {
+      thread_local ThreadCache cache;
+      return cache;
+    }
+
+    // NB: the flag is trivially destructible, so it is valid after
+    //     the cache of the thread is destroyed
+    static bool &is_destroyed() {
+      thread_local bool is_cache_destroyed = false;
+      return is_cache_destroyed;
+    }
+
+    ThreadCache() = default;
+    ThreadCache(const ThreadCache&) = delete;
+    ThreadCache& operator=(const ThreadCache&) = delete;
+
+    ~ThreadCache() {
+      for (std::size_t id = 0; id < Size_Classes_Nm; ++id) {
+        instance().return_blocks(id, _blocks[id], _blocks_nm[id]);
+      }
+      is_destroyed() = true;
+    }
+
+    void *allocate(std::size_t size_class_id) {
+      auto &blocks_nm = _blocks_nm[size_class_id];
+      if (blocks_nm == 0) {
+        blocks_nm = instance().take_blocks(size_class_id,
+                                           _blocks[size_class_id],
+                                           Thread_Cache_Size / 2);
+      }
+      return _blocks[size_class_id][--blocks_nm];
+    }
+
+    void deallocate(void *block, std::size_t size_class_id) {
+      auto &blocks_nm = _blocks_nm[size_class_id];
+      auto *blocks = _blocks[size_class_id];
+      if (blocks_nm == Thread_Cache_Size) {
+        // the least recently freed blocks are returned,
+        // so the recent (hot) ones are reused first
+        constexpr auto Half = Thread_Cache_Size / 2;
+        instance().return_blocks(size_class_id, blocks, Half);
+        std::copy(blocks + Half, blocks + Thread_Cache_Size, blocks);
+        blocks_nm -= Half;
+      }
+      blocks[blocks_nm++] = block;
+    }
+
+  private:
+    void *_blocks[Size_Classes_Nm][Thread_Cache_Size];
+    std::size_t _blocks_nm[Size_Classes_Nm] = {};
+  };
+private: // methods
+
+  // NB: the pool itself (not its slabs) is intentionally leaked,
+  //     so cells of static maps may be freed up to the program exit.
+  static GridCellPool &instance() {
+    static GridCellPool *pool = new GridCellPool;
+    return *pool;
+  }
+
+  static std::size_t size_class(std::size_t size) {
+    return size == 0 ? 0 : (size - 1) / Size_Granularity;
+  }
+
+  // Moves up to blocks_nm free blocks to the buffer (in the reverse address
+  // order, so the ones taken from the buffer's end are sequential);
+  // returns the number of moved blocks.
+  std::size_t take_blocks(std::size_t size_class_id, void **blocks,
+                          std::size_t blocks_nm) {
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto &available = _available[size_class_id];
+    auto taken_nm = std::size_t{0};
+    while (taken_nm < blocks_nm) {
+      if (available.empty()) { add_slab(size_class_id); }
+      auto &slab = *available.back();
+      while (taken_nm < blocks_nm && slab.free_list) {
+        blocks[taken_nm++] = slab.free_list;
+        slab.free_list = slab.free_list->next;
+        --slab.free_nm;
+      }
+      if (!slab.free_list) { available.pop_back(); }
+    }
+    std::reverse(blocks, blocks + taken_nm);
+    return taken_nm;
+  }
+
+  void return_blocks(std::size_t size_class_id, void **blocks,
+                     std::size_t blocks_nm) {
+    std::lock_guard<std::mutex> lock{_mutex};
+    auto &available = _available[size_class_id];
+    for (std::size_t i = 0; i < blocks_nm; ++i) {
+      auto *block = static_cast<char *>(blocks[i]);
+      auto slab_it = std::prev(_slabs.upper_bound(block));
+      auto &slab = slab_it->second;
+      assert(slab.memory <= block && block < slab.memory + Slab_Size);
+
+      auto free_block = reinterpret_cast<FreeBlock *>(block);
+      free_block->next = slab.free_list;
+      slab.free_list = free_block;
+      if (slab.free_nm++ == 0) { available.push_back(&slab); }
+      if (slab.free_nm < slab.blocks_nm || available.size() < 2) {
+        continue;
+      }
+      // the slab is empty and other slabs have free blocks
+      available.erase(std::find(available.begin(), available.end(), &slab));
+      ::operator delete(slab.memory);
+      _slabs.erase(slab_it);
+    }
+  }
+
+  void add_slab(std::size_t size_class_id) {
+    auto block_size = (size_class_id + 1) * Size_Granularity;
+    auto memory = static_cast<char *>(::operator new(Slab_Size));
+    auto &slab = _slabs[memory];
+    auto blocks_nm = Slab_Size / block_size;
+    slab = Slab{memory, nullptr, blocks_nm, blocks_nm};
+    // blocks are linked in the address order, so clones are sequential
+    for (auto block = memory + slab.blocks_nm * block_size; memory < block;) {
+      block -= block_size;
+      auto free_block = reinterpret_cast<FreeBlock *>(block);
+      free_block->next = slab.free_list;
+      slab.free_list = free_block;
+    }
+    _available[size_class_id].push_back(&slab);
+  }
+
+private: // fields
+  std::mutex _mutex;
+  // slabs by their memory (std::map keeps addresses of the values)
+  std::map<char *, Slab> _slabs;
+  // slabs with free blocks per size class
+  std::vector<Slab *> _available[Size_Classes_Nm];
+};
+
+constexpr std::size_t GridCellPool::Size_Granularity;
+constexpr std::size_t GridCellPool::Max_Block_Size;
+constexpr std::size_t GridCellPool::Slab_Size;
+constexpr std::size_t GridCellPool::Thread_Cache_Size;
+constexpr std::size_t GridCellPool::Size_Classes_Nm;
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SLAM_CTOR_CORE_GRID_CELL_STORAGES_H
+#define SLAM_CTOR_CORE_GRID_CELL_STORAGES_H
+
+#include <memory>
+#include <cassert>
+#include <typeinfo>
+
+#include "grid_cell.h"
+
+/* Policies that define how a map keeps its cells */
+
+// Each cell is a separate heap object; any GridCell descendant is supported.
+struct PolymorphicCellStorage {
+  using Element = std::unique_ptr<GridCell>;
+
+  static Element make(const GridCell &prototype) { return prototype.clone(); }
+  static Element copy(const Element &e) { return e->clone(); }
+  static const GridCell &cell(const Element &e) { return *e; }
+  // bytes an element owns outside of a container
+  static std::size_t heap_bytes(const GridCell &prototype) {
+    return prototype.memory_size();
+  }
+
+  static void update(Element &e, const AreaOccupancyObservation &aoo) {
+    *e += aoo;
+  }
+  static void reset(Element &e, const GridCell &new_area) { *e = new_area; }
+  static void merge(Element &e, const GridCell &that) { e->merge(that); }
+  static double discrepancy(const Element &e,
+                            const AreaOccupancyObservation &aoo) {
+    return e->discrepancy(aoo);
+  }
+  static void discrepancies(const Element *es, std::size_t n,
+                            const AreaOccupancyObservation &aoo,
+                            double *discrepancies) {
+    for (std::size_t i = 0; i < n; ++i) {
+      discrepancies[i] = es[i]->discrepancy(aoo);
+    }
+  }
+  static void occupancies(const Element *es, std::size_t n, double *probs) {
+    for (std::size_t i = 0; i < n; ++i) {
+      probs[i] = es[i]->occupancy().prob_occ;
+    }
+  }
+};
+
+// Cells of a known type are stored by value in a single buffer,
+// so the cell access doesn't require a pointer chase.
+template <typename CellT>
+struct ValueCellStorage {
+  using Element = CellT;
+
+  static Element make(const GridCell &prototype) {
+    // NB: a prototype of a derived type would be sliced
+    assert(typeid(prototype) == typeid(CellT));
+    return static_cast<const CellT &>(prototype);
+  }
+  static const Element &copy(const Element &e) { return e; }
+  static const GridCell &cell(const Element &e) { return e; }
+  static std::size_t heap_bytes(const GridCell &) { return 0; }
+
+  // NB: qualified calls are not virtual, so they can be inlined
+  static void update(Element &e, const AreaOccupancyObservation &aoo) {
+    e.CellT::operator+=(aoo);
+  }
+  static void reset(Element &e, const GridCell &new_area) {
+    if (typeid(new_area) == typeid(CellT)) {
+      e = static_cast<const CellT &>(new_area);
+    } else {
+      static_cast<GridCell &>(e) = new_area;
+    }
+  }
+  static void merge(Element &e, const GridCell &that) {
+    e.CellT::merge(that);
+  }
+  static double discrepancy(const Element &e,
+                            const AreaOccupancyObservation &aoo) {
+    return e.CellT::discrepancy(aoo);
+  }
+  // NB: a cell type may provide a batch kernel, e.g. to share
+  //     a conversion of the observation among cells.
+  static void discrepancies(const Element *es, std::size_t n,
+                            const AreaOccupancyObservation &aoo,
+                            double *discrepancies) {
+    discrepancies_impl(es, n, aoo, discrepancies, 0);
+  }
+  static void occupancies(const Element *es, std::size_t n, double *probs) {
+    for (std::size_t i = 0; i < n; ++i) {
+      probs[i] = es[i].CellT::occupancy().prob_occ;
+    }
+  }
+private:
+  template <typename C>
+  static auto discrepancies_impl(const C *es, std::size_t n,
+                                 const AreaOccupancyObservation &aoo,
+                                 double *discrepancies, int)
+    -> decltype(C::discrepancies(es, n, aoo, discrepancies)) {
+    return C::discrepancies(es, n, aoo, discrepancies);
+  }
+  template <typename C>
+  static void discrepancies_impl(const C *es, std::size_t n,
+                                 const AreaOccupancyObservation &aoo,
+                                 double *discrepancies, long) {
+    for (std::size_t i = 0; i < n; ++i) {
+      discrepancies[i] = discrepancy(es[i], aoo);
+    }
+  }
+};
+
+#endif
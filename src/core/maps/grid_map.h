@@ -2,10 +2,15 @@
 #define SLAM_CTOR_CORE_GRID_MAP_H
 
 #include <memory>
+#include <vector>
 
 #include "occupancy_map.h"
 #include "regular_squares_grid.h"
 #include "grid_cell.h"
+#include "grid_map_modifications.h"
+#include "grid_map_memory_usage.h"
+
+class AreaScoreTables;
 
 struct GridMapParams {
   int width_cells, height_cells;
@@ -43,6 +48,7 @@ public:
     auto const_this = static_cast<const decltype(this)>(this);
     auto &area = const_cast<GridCell&>((*const_this)[area_id]);
     area += aoo;
+    on_area_modified(area_id);
   }
 
   double occupancy(const Coord &area_id) const override {
@@ -55,11 +61,202 @@ public:
     auto const_this = static_cast<const decltype(this)>(this);
     auto &area = const_cast<GridCell&>((*const_this)[area_id]);
     area = new_area;
+    on_area_modified(area_id);
   }
 
   virtual const GridCell &operator[](const Coord& coord) const = 0;
 
-  virtual void load_state(const std::vector<char>&) {}
+  // Merges the estimate of the area by another map (e.g. of another
+  // robot) into the area (see GridCell::merge).
+  virtual void merge(const Coord &area_id, const GridCell &that) {
+    auto merged = (*this)[area_id].clone();
+    merged->merge(that);
+    reset(area_id, *merged);
+  }
+
+  // Merges areas of the map of the same scale shifted by the offset
+  // (in areas) into the map (see merge_grid_map for other transforms);
+  // areas outside of a bounded map are skipped.
+  // PERFORMANCE: descendants may merge blocks of areas at once.
+  virtual void merge_shifted(const GridMap &that, const Coord &offset) {
+    for (int y = 0; y < that.height(); ++y) {
+      for (int x = 0; x < that.width(); ++x) {
+        auto that_id = that.internal2external({x, y});
+        auto area_id = that_id + offset;
+        if (!has_cell(area_id)) { continue; }
+        merge(area_id, that[that_id]);
+      }
+    }
+  }
+
+  /* Bulk updates of rectangles of areas (e.g. a synthetic map
+   * construction, map editing, clearing of dynamic areas).
+   * The map is prepared for a rectangle once and its areas are updated
+   * by rows, so descendants are able to write contiguous runs of cells
+   * instead of a virtual call (and a bounds check) per area. */
+
+  // Makes the map hold areas of the rectangle (bounds are inclusive),
+  // e.g. an unbounded map is expanded once instead of on area updates.
+  virtual void reserve_area(const Coord &/*min*/, const Coord &/*max*/) {}
+
+  // Updates a row of areas_nm areas that starts at area_id (along x)
+  // with observations of the areas (an observation per area).
+  virtual void update_row(const Coord &area_id, int areas_nm,
+                          const AreaOccupancyObservation *aoos) {
+    for (int i = 0; i < areas_nm; ++i) {
+      update({area_id.x + i, area_id.y}, aoos[i]);
+    }
+  }
+
+  // Resets a row of areas_nm areas that starts at area_id to the area
+  virtual void reset_row(const Coord &area_id, int areas_nm,
+                         const GridCell &new_area) {
+    for (int i = 0; i < areas_nm; ++i) {
+      reset({area_id.x + i, area_id.y}, new_area);
+    }
+  }
+
+  // Updates each area of the rectangle with the observation
+  void update_area(const Coord &min, const Coord &max,
+                   const AreaOccupancyObservation &aoo) {
+    if (max.x < min.x || max.y < min.y) { return; }
+    reserve_area(min, max);
+    auto aoos = std::vector<AreaOccupancyObservation>(max.x - min.x + 1, aoo);
+    for (int y = min.y; y <= max.y; ++y) {
+      update_row({min.x, y}, int(aoos.size()), aoos.data());
+    }
+  }
+
+  // Resets each area of the rectangle to the area
+  void reset_area(const Coord &min, const Coord &max,
+                  const GridCell &new_area) {
+    if (max.x < min.x || max.y < min.y) { return; }
+    reserve_area(min, max);
+    for (int y = min.y; y <= max.y; ++y) {
+      reset_row({min.x, y}, max.x - min.x + 1, new_area);
+    }
+  }
+
+  // Makes areas of the rectangle unknown (i.e. resets them to the
+  // prototype cell), e.g. to forget a region with dynamic obstacles.
+  void clear_area(const Coord &min, const Coord &max) {
+    reset_area(min, max, *_cell_prototype);
+  }
+
+  // Updates areas of the rectangle that starts at min with a raster
+  // of width x height observations; rows of the raster are stored
+  // one after another starting from the one at min.y.
+  void update_raster(const Coord &min, int width, int height,
+                     const AreaOccupancyObservation *raster) {
+    if (width <= 0 || height <= 0) { return; }
+    reserve_area(min, min + Coord{width - 1, height - 1});
+    for (int y = 0; y < height; ++y) {
+      update_row({min.x, min.y + y}, width, raster + std::size_t(y) * width);
+    }
+  }
+
+  // NB: a shortcut for map[area_id].discrepancy(aoo) that may be
+  //     devirtualized by descendants aware of a concrete cell type.
+  virtual double discrepancy(const Coord &area_id,
+                             const AreaOccupancyObservation &aoo) const {
+    return (*this)[area_id].discrepancy(aoo);
+  }
+
+  // Discrepancies of a row of areas_nm areas that starts at area_id
+  // (along x). A row span is a contiguous run of cells in maps with
+  // a row-major layout, so one call replaces areas_nm virtual calls.
+  virtual void row_discrepancies(const Coord &area_id, int areas_nm,
+                                 const AreaOccupancyObservation &aoo,
+                                 double *discrepancies) const {
+    for (int i = 0; i < areas_nm; ++i) {
+      discrepancies[i] = discrepancy({area_id.x + i, area_id.y}, aoo);
+    }
+  }
+
+  // Occupancy probabilities of a row of areas_nm areas that starts at
+  // area_id (see row_discrepancies), e.g. for a bulk map conversion.
+  virtual void row_occupancies(const Coord &area_id, int areas_nm,
+                               double *probs) const {
+    for (int i = 0; i < areas_nm; ++i) {
+      probs[i] = (*this)[{area_id.x + i, area_id.y}].occupancy().prob_occ;
+    }
+  }
+
+  // Tables that answer queries about rectangles of areas
+  // (nullptr if the map doesn't keep them, see AreaScoreTablesGridMap).
+  virtual const AreaScoreTables *area_score_tables() const { return nullptr; }
+
+  // The areas traversal order that matches the cells layout
+  virtual GridTraversalOrder traversal_order() const {
+    return GridTraversalOrder::Column_Major;
+  }
+
+  /* Concurrent updates (e.g. a multi-threaded scan insertion).
+   * Areas are partitioned into update blocks (e.g. tiles). Once the map
+   * is prepared for a bounding box of areas, areas of the box that belong
+   * to different blocks may be updated by update_concurrently from
+   * different threads; areas of a block must be updated by a single one.
+   * NB: the map must not be accessed in other ways until updates are done. */
+
+  // Returns false if the map doesn't support concurrent updates
+  virtual bool prepare_concurrent_updates(const Coord &/*min*/,
+                                          const Coord &/*max*/) {
+    return false;
+  }
+
+  // Whether the map may be read from several threads at once
+  // (e.g. by a parallel scan matcher) while it is not updated.
+  // NB: maps that modify their state on reads (caches, paging) don't.
+  virtual bool supports_concurrent_reads() const { return true; }
+
+  // Builds caches that are otherwise built lazily on reads
+  // (e.g. once a map is loaded and is read only, see localization_only).
+  virtual void prepare_for_reads() {}
+
+  virtual std::size_t update_block_id(const Coord &/*area_id*/) const {
+    return 0;
+  }
+
+  virtual void update_concurrently(const Coord &area_id,
+                                   const AreaOccupancyObservation &aoo) {
+    update(area_id, aoo);
+  }
+
+  // An immutable copy of the map that may be read from other threads
+  // while the map is updated (nullptr if the map doesn't support it).
+  // NB: it is cheap for maps with copy-on-write storages (e.g. tiled ones).
+  virtual std::shared_ptr<const GridMap> snapshot() const { return nullptr; }
+
+  // The version of the map content; it changes on a modification
+  // that follows a version read (or a map copy).
+  virtual uint64_t version() const { return _modifications.version(); }
+
+  // The id of the map instance that versions refer to; it is unique
+  // among maps and changes on a map copy (or a move), so an observer
+  // that remembers a map by its address tells a replaced map apart.
+  virtual uint64_t instance_id() const {
+    return _modifications.instance_id();
+  }
+
+  // A bounding box of areas modified since the given version.
+  // NB: descendants that implement a modification directly are expected
+  //     to report it with on_area_modified.
+  virtual ModifiedGridArea modified_area(uint64_t since_version) const {
+    return _modifications.modified_area(since_version);
+  }
+
+  // Memory held by the map (see GridMapMemoryUsage)
+  // NB: the default assumes a cell object per area
+  virtual GridMapMemoryUsage memory_usage() const {
+    auto usage = GridMapMemoryUsage{};
+    usage.add_cells(std::size_t(width()) * height() *
+                    _cell_prototype->memory_size());
+    return usage;
+  }
+
+  // Returns false if the state is corrupt or is not supported by the map
+  // (the map is kept then).
+  virtual bool load_state(const std::vector<char>&) { return false; }
   virtual std::vector<char> save_state() const {
       return std::vector<char>();
   }
@@ -67,8 +264,16 @@ public:
 protected:
 
   std::shared_ptr<GridCell> cell_prototype() const { return _cell_prototype; }
+
+  void on_area_modified(const Coord &area_id) {
+    _modifications.on_area_modified(area_id);
+  }
+
+  // E.g. on a load of the whole map
+  void forget_modifications() { _modifications.reset(); }
 private: // fields
   std::shared_ptr<GridCell> _cell_prototype;
+  GridMapModifications _modifications;
 };
 
 #endif
@@ -0,0 +1,60 @@
+#ifndef SLAM_CTOR_CORE_GRID_MAP_MEMORY_USAGE_H
+#define SLAM_CTOR_CORE_GRID_MAP_MEMORY_USAGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/* Memory held by a map (see GridMap::memory_usage).
+ * Tiles shared by copies of a map (e.g. maps of particles or snapshots)
+ * are counted by each copy; the amortized bytes split a shared tile evenly
+ * among its owners, so amortized bytes of copies sum up to the memory
+ * they hold together. */
+struct GridMapMemoryUsage {
+  // cells (including heap objects of cells stored by pointers)
+  std::size_t cells_bytes = 0;
+  // bookkeeping, e.g. a tile index, headroom, derived tables
+  std::size_t overhead_bytes = 0;
+  std::size_t amortized_bytes = 0;
+  // allocated tiles of tiled maps; shared ones have other owners
+  std::size_t tiles_nm = 0, shared_tiles_nm = 0;
+  // total bytes of levels of multi-resolution maps, the finest goes first
+  std::vector<std::size_t> levels_bytes;
+
+  std::size_t total_bytes() const { return cells_bytes + overhead_bytes; }
+
+  void add_cells(std::size_t bytes) {
+    cells_bytes += bytes;
+    amortized_bytes += bytes;
+  }
+
+  void add_overhead(std::size_t bytes, long owners_nm = 1) {
+    overhead_bytes += bytes;
+    amortized_bytes += bytes / std::max(owners_nm, 1l);
+  }
+
+  void add_tile(std::size_t bytes, long owners_nm) {
+    ++tiles_nm;
+    cells_bytes += bytes;
+    amortized_bytes += bytes / std::max(owners_nm, 1l);
+    if (1 < owners_nm) { ++shared_tiles_nm; }
+  }
+
+  // NB: levels are added level-wise
+  GridMapMemoryUsage &operator+=(const GridMapMemoryUsage &that) {
+    cells_bytes += that.cells_bytes;
+    overhead_bytes += that.overhead_bytes;
+    amortized_bytes += that.amortized_bytes;
+    tiles_nm += that.tiles_nm;
+    shared_tiles_nm += that.shared_tiles_nm;
+    if (levels_bytes.size() < that.levels_bytes.size()) {
+      levels_bytes.resize(that.levels_bytes.size(), 0);
+    }
+    for (std::size_t i = 0; i < that.levels_bytes.size(); ++i) {
+      levels_bytes[i] += that.levels_bytes[i];
+    }
+    return *this;
+  }
+};
+
+#endif
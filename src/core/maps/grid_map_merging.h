@@ -0,0 +1,102 @@
+#ifndef SLAM_CTOR_CORE_GRID_MAP_MERGING_H
+#define SLAM_CTOR_CORE_GRID_MAP_MERGING_H
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "grid_map.h"
+#include "../states/robot_pose.h"
+
+// Whether the transform maps areas of the src map to areas of the dst map
+// one-to-one, i.e. it is a shift by a whole number of areas.
+inline bool is_area_aligned_transform(const GridMap &dst, const GridMap &src,
+                                      const RobotPose &src_pose,
+                                      DiscretePoint2D &offset) {
+  static constexpr double Eps = 1e-9;
+  if (Eps < std::abs(std::remainder(src_pose.theta, 2 * M_PI)) ||
+      Eps < std::abs(dst.scale() - src.scale())) {
+    return false;
+  }
+  auto dx = src_pose.x / dst.scale(), dy = src_pose.y / dst.scale();
+  if (Eps < std::abs(dx - std::round(dx)) ||
+      Eps < std::abs(dy - std::round(dy))) {
+    return false;
+  }
+  offset = {int(std::round(dx)), int(std::round(dy))};
+  return true;
+}
+
+/* Merges the src map (e.g. of another robot) into the dst one;
+ * src_pose is the pose of the src map frame in the dst map frame.
+ * Estimates of an area are combined by the rule of the cell type
+ * (see GridCell::merge), unknown areas don't change the dst map.
+ * PERFORMANCE: a shift by whole areas is merged by the dst map
+ *              (see GridMap::merge_shifted), e.g. tiled maps adopt
+ *              tiles of the src map. Otherwise each dst area is resampled
+ *              from the src area its center falls into; src coords
+ *              of a row are computed incrementally in a separate
+ *              (vectorizable) loop.
+ * NB: src must not be dst. */
+inline void merge_grid_map(GridMap &dst, const GridMap &src,
+                           const RobotPose &src_pose) {
+  using Coord = DiscretePoint2D;
+  auto offset = Coord{};
+  if (is_area_aligned_transform(dst, src, src_pose, offset)) {
+    dst.merge_shifted(src, offset);
+    return;
+  }
+  if (src.width() == 0 || src.height() == 0) { return; }
+
+  // the bounding box of the src map in the dst map
+  auto src_min = src.internal2external({0, 0});
+  auto src_max = src.internal2external({src.width(), src.height()});
+  auto src_scale = src.scale(), dst_scale = dst.scale();
+  auto c = std::cos(src_pose.theta), s = std::sin(src_pose.theta);
+  auto min_x = std::numeric_limits<double>::infinity(), min_y = min_x;
+  auto max_x = -min_x, max_y = -min_x;
+  for (auto corner_x : {src_min.x * src_scale, src_max.x * src_scale}) {
+    for (auto corner_y : {src_min.y * src_scale, src_max.y * src_scale}) {
+      auto x = src_pose.x + c * corner_x - s * corner_y;
+      auto y = src_pose.y + s * corner_x + c * corner_y;
+      min_x = std::min(min_x, x);
+      min_y = std::min(min_y, y);
+      max_x = std::max(max_x, x);
+      max_y = std::max(max_y, y);
+    }
+  }
+  auto dst_min = dst.world_to_cell(min_x, min_y);
+  auto dst_max = dst.world_to_cell(max_x, max_y);
+  // NB: an unbounded map grows to the merged area once
+  bool is_prepared = dst.prepare_concurrent_updates(dst_min, dst_max);
+
+  auto row_len = std::size_t(dst_max.x - dst_min.x + 1);
+  auto src_x = std::vector<double>(row_len), src_y = src_x;
+  // the src coords (in areas) of the dst area center step
+  // by the dst rotated scale along a row
+  auto step_x = dst_scale * c / src_scale, step_y = -dst_scale * s / src_scale;
+  for (int y = dst_min.y; y <= dst_max.y; ++y) {
+    auto px = (dst_min.x + 0.5) * dst_scale - src_pose.x;
+    auto py = (y + 0.5) * dst_scale - src_pose.y;
+    auto qx = (c * px + s * py) / src_scale;
+    auto qy = (-s * px + c * py) / src_scale;
+    for (std::size_t i = 0; i < row_len; ++i) {
+      src_x[i] = qx + i * step_x;
+      src_y[i] = qy + i * step_y;
+    }
+    for (std::size_t i = 0; i < row_len; ++i) {
+      auto src_id = Coord{int(std::floor(src_x[i])), int(std::floor(src_y[i]))};
+      // NB: areas outside of the src bounds are unknown
+      if (src_id.x < src_min.x || src_max.x <= src_id.x ||
+          src_id.y < src_min.y || src_max.y <= src_id.y) {
+        continue;
+      }
+      auto dst_id = Coord{dst_min.x + int(i), y};
+      if (!is_prepared && !dst.has_cell(dst_id)) { continue; }
+      dst.merge(dst_id, src[src_id]);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef SLAM_CTOR_CORE_GRID_MAP_MODIFICATIONS_H
+#define SLAM_CTOR_CORE_GRID_MAP_MODIFICATIONS_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <algorithm>
+
+#include "regular_squares_grid.h"
+
+// A bounding box of modified areas (external coordinates, inclusive)
+struct ModifiedGridArea {
+  using Coord = RegularSquaresGrid::Coord;
+
+  bool is_known; // false if modifications are not tracked any more
+  Coord min, max;
+
+  bool is_empty() const { return max.x < min.x || max.y < min.y; }
+};
+
+/* Tracks bounding boxes of modified areas per map version.
+ * A version is bumped by the first modification after it has been read,
+ * so an observer that remembers a version gets the area modified since
+ * then. Only the latest Max_Versions versions are kept.
+ * NB: a copy keeps the version numbering, so it gets a new instance id
+ *     that tells it from the origin (see instance_id). */
+class GridMapModifications {
+public: // types
+  using Coord = RegularSquaresGrid::Coord;
+public: // consts
+  static constexpr std::size_t Max_Versions = 64;
+public:
+  GridMapModifications() = default;
+
+  // NB: a copy may be observed, so the current version is sealed;
+  //     moves are copies, so a moved-to instance gets a new id as well.
+  GridMapModifications(const GridMapModifications &that)
+    : _instance_id{next_instance_id()}
+    , _version{that._version}, _history_begin{that._history_begin}
+    , _is_version_observed{that._is_version_observed}
+    , _versions{that._versions} {
+    that._is_version_observed = true;
+  }
+
+  GridMapModifications& operator=(const GridMapModifications &that) {
+    _instance_id = next_instance_id();
+    _version = that._version;
+    _history_begin = that._history_begin;
+    _is_version_observed = that._is_version_observed;
+    _versions = that._versions;
+    that._is_version_observed = true;
+    return *this;
+  }
+
+  // An id that is unique among instances, i.e. versions of different
+  // instances (e.g. a map and the copy assigned to it) are not comparable.
+  uint64_t instance_id() const { return _instance_id; }
+
+  uint64_t version() const {
+    _is_version_observed = true;
+    return _version;
+  }
+
+  void on_area_modified(const Coord &area_id) {
+    if (_is_version_observed || _versions.empty()) {
+      start_version();
+    }
+    auto &area = _versions.back().area;
+    area.min = {std::min(area.min.x, area_id.x),
+                std::min(area.min.y, area_id.y)};
+    area.max = {std::max(area.max.x, area_id.x),
+                std::max(area.max.y, area_id.y)};
+  }
+
+  // NB: modifications of the given version are not included
+  ModifiedGridArea modified_area(uint64_t since_version) const {
+    auto result = empty_area();
+    result.is_known = _history_begin <= since_version;
+    for (auto &v : _versions) {
+      if (v.version <= since_version) { continue; }
+      result.min = {std::min(result.min.x, v.area.min.x),
+                    std::min(result.min.y, v.area.min.y)};
+      result.max = {std::max(result.max.x, v.area.max.x),
+                    std::max(result.max.y, v.area.max.y)};
+    }
+    return result;
+  }
+
+  // Forgets modifications, e.g. when the whole map is replaced
+  void reset() {
+    _versions.clear();
+    _history_begin = ++_version;
+    _is_version_observed = false;
+  }
+
+private: // types
+  struct VersionModifications {
+    uint64_t version;
+    ModifiedGridArea area;
+  };
+private: // methods
+
+  static uint64_t next_instance_id() {
+    static std::atomic<uint64_t> last_id{0};
+    return ++last_id;
+  }
+
+  static ModifiedGridArea empty_area() {
+    auto min = std::numeric_limits<int>::min();
+    auto max = std::numeric_limits<int>::max();
+    return {true, {max, max}, {min, min}};
+  }
+
+  void start_version() {
+    if (_is_version_observed) { ++_version; }
+    _is_version_observed = false;
+    if (!_versions.empty() && _versions.back().version == _version) {
+      return;
+    }
+    if (_versions.size() == Max_Versions) {
+      _history_begin = _versions.front().version;
+      _versions.pop_front();
+    }
+    _versions.push_back({_version, empty_area()});
+  }
+
+private: // fields
+  uint64_t _instance_id = next_instance_id();
+  uint64_t _version = 0, _history_begin = 0;
+  mutable bool _is_version_observed = false;
+  std::deque<VersionModifications> _versions;
+};
+
+constexpr std::size_t GridMapModifications::Max_Versions;
+
+#endif
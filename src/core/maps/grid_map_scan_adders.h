@@ -2,10 +2,16 @@
 #define SLAM_CTOR_CORE_GRID_MAP_SCAN_ADDERS_H
 
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <tuple>
 
 #include "grid_map.h"
+#include "../thread_pool.h"
 #include "cell_occupancy_estimator.h"
 #include "../states/sensor_data.h"
 #include "../states/world.h"
@@ -45,11 +51,48 @@ private:
 //============================================================================//
 //                   Grid Map Scan Adder                                      //
 
+// A scan to be appended at a pose (see GridMapScanAdder::append_scans)
+struct PosedLaserScan {
+  RobotPose pose;
+  const LaserScan2D *scan;
+  double quality;
+};
+
+enum class ScanInsertionMode {
+  // an observation is applied to the map as soon as it is made
+  Immediate,
+  // observations of a scan are buffered, sorted by their areas location
+  // and applied in a single pass; order of observations of an area is kept,
+  // so the result is the same as of the immediate insertion
+  Batched,
+  // batched, but only the first free observation of an area per scan
+  // is applied (occupied ones are applied as is)
+  Batched_Merged_Free
+};
+
 class GridMapScanAdder {
+public: // consts
+  // a smaller batch is not worth threads spawning
+  static constexpr std::size_t Min_Concurrent_Batch_Size = 2048;
 public:
+  // NB: batched observations are applied by insertion_threads_nm threads
+  //     if the map supports concurrent updates (see GridMap), so concurrent
+  //     insertion implies the batched mode.
   GridMapScanAdder(std::shared_ptr<CellOccupancyEstimator> e,
-                   std::shared_ptr<ObservationMappingQualityEstimator> omqe)
-    : _occ_est{e}, _omqe{omqe} {}
+                   std::shared_ptr<ObservationMappingQualityEstimator> omqe,
+                   ScanInsertionMode insertion_mode =
+                     ScanInsertionMode::Immediate,
+                   unsigned insertion_threads_nm = 1)
+    : _occ_est{e}, _omqe{omqe}, _insertion_mode{insertion_mode}
+    , _insertion_threads_nm{std::max(insertion_threads_nm, 1u)} {
+    if (1 < _insertion_threads_nm &&
+        _insertion_mode == ScanInsertionMode::Immediate) {
+      _insertion_mode = ScanInsertionMode::Batched;
+    }
+  }
+
+  ScanInsertionMode insertion_mode() const { return _insertion_mode; }
+  unsigned insertion_threads_nm() const { return _insertion_threads_nm; }
 
   GridMap& append_scan(GridMap &map, const RobotPose &pose,
                        const LaserScan2D &scan,
@@ -57,6 +100,64 @@ public:
                        double scan_margin = 0.0) const {
     if (scan.points().empty()) { return map; }
 
+    observe_scan(map, pose, scan, scan_quality, scan_margin);
+    if (_insertion_mode != ScanInsertionMode::Immediate) {
+      apply_observations(map, _insertion_mode ==
+                                ScanInsertionMode::Batched_Merged_Free);
+    }
+    return map;
+  }
+
+  // Appends scans (e.g. backlogged ones) as a single batch regardless of
+  // the insertion mode: observations of all scans are sorted and applied
+  // in a single pass, and only the first free observation of an area
+  // per batch is applied (occupied ones are applied as is).
+  GridMap& append_scans(GridMap &map, const std::vector<PosedLaserScan> &scans,
+                        double scan_margin = 0.0) const {
+    _is_batch_forced = true;
+    for (auto &posed : scans) {
+      if (posed.scan->points().empty()) { continue; }
+      observe_scan(map, posed.pose, *posed.scan, posed.quality, scan_margin);
+    }
+    _is_batch_forced = false;
+    if (!_observations.empty()) { apply_observations(map, true); }
+    return map;
+  }
+
+protected:
+  using AOO = AreaOccupancyObservation;
+
+  // NB: descendants are expected to update the map with the method,
+  //     so the insertion mode is taken into account.
+  void observe_area(GridMap &map, const GridMap::Coord &area_id,
+                    const AOO &aoo) const {
+    if (_insertion_mode == ScanInsertionMode::Immediate && !_is_batch_forced) {
+      map.update(area_id, aoo);
+      return;
+    }
+    _observations.push_back({area_id, aoo});
+  }
+
+  auto estimate_occupancy(const Segment2D &beam,
+                          const Rectangle &area_bnds,
+                          bool is_occupied) const {
+    return _occ_est->estimate_occupancy(beam, area_bnds, is_occupied);
+  }
+
+  void estimate_beam_occupancies(const Segment2D &beam, const GridMap &map,
+                                 const std::vector<GridMap::Coord> &cells,
+                                 std::vector<Occupancy> &occupancies) const {
+    _occ_est->estimate_beam_occupancies(beam, map, cells, occupancies);
+  }
+
+  virtual void handle_scan_point(GridMap &map, bool is_occ, double scan_quality,
+                                 const Segment2D &beam) const = 0;
+
+private: // methods
+
+  void observe_scan(GridMap &map, const RobotPose &pose,
+                    const LaserScan2D &scan, double scan_quality,
+                    double scan_margin) const {
     const auto rp = pose.point();
     scan.trig_provider->set_base_angle(pose.theta);
     _omqe->reset(scan);
@@ -70,26 +171,183 @@ public:
       const auto quality = scan_quality * _omqe->quality(points, pt_i);
       handle_scan_point(map, sp.is_occupied(), quality, {rp, wp});
     }
+  }
 
-    return map;
+  // Orders areas the way the map's cells are laid out
+  static uint64_t location_key(const GridMap::Coord &area_id,
+                               GridTraversalOrder order) {
+    // NB: the sign bit is flipped to keep the order of negative coords
+    uint64_t x = uint32_t(area_id.x) ^ 0x80000000u,
+             y = uint32_t(area_id.y) ^ 0x80000000u;
+    return order == GridTraversalOrder::Row_Major ? (y << 32) | x
+                                                  : (x << 32) | y;
   }
 
-protected:
-  using AOO = AreaOccupancyObservation;
-  auto estimate_occupancy(const Segment2D &beam,
-                          const Rectangle &area_bnds,
-                          bool is_occupied) const {
-    return _occ_est->estimate_occupancy(beam, area_bnds, is_occupied);
+  bool prepare_concurrent_updates(GridMap &map) const {
+    if (_insertion_threads_nm < 2 ||
+        _observations.size() < Min_Concurrent_Batch_Size) {
+      return false;
+    }
+    auto min = _observations.front().area_id, max = min;
+    for (auto &observation : _observations) {
+      auto &area_id = observation.area_id;
+      min = {std::min(min.x, area_id.x), std::min(min.y, area_id.y)};
+      max = {std::max(max.x, area_id.x), std::max(max.y, area_id.y)};
+    }
+    return map.prepare_concurrent_updates(min, max);
   }
 
-  virtual void handle_scan_point(GridMap &map, bool is_occ, double scan_quality,
-                                 const Segment2D &beam) const = 0;
+  void apply_observations(GridMap &map, bool merge_free) const {
+    // NB: update blocks are known only after the map is prepared
+    //     (e.g. it may be expanded)
+    bool is_concurrent = prepare_concurrent_updates(map);
+
+    // PERFORMANCE: (block, key, id) entries are sorted instead of
+    //              observations; an id keeps the order of observations
+    //              of an area.
+    auto order = map.traversal_order();
+    _observations_order.clear();
+    _observations_order.reserve(_observations.size());
+    for (uint32_t id = 0; id < _observations.size(); ++id) {
+      auto &area_id = _observations[id].area_id;
+      auto block_id = is_concurrent ? map.update_block_id(area_id) : 0;
+      _observations_order.push_back({block_id, location_key(area_id, order),
+                                     id});
+    }
+    std::sort(_observations_order.begin(), _observations_order.end());
+
+    if (is_concurrent) {
+      apply_observations_concurrently(map, merge_free);
+    } else {
+      apply_sorted_observations(map, 0, _observations_order.size(), false,
+                                merge_free);
+    }
+    _observations.clear();
+  }
+
+  // Distributes update blocks among threads, so areas of a block
+  // are updated by a single thread in the sequential insertion order.
+  void apply_observations_concurrently(GridMap &map, bool merge_free) const {
+    auto total_nm = _observations_order.size();
+    auto chunk_size = (total_nm + _insertion_threads_nm - 1) /
+                      _insertion_threads_nm;
+    auto chunk_bounds = std::vector<std::size_t>{0};
+    while (chunk_bounds.back() < total_nm) {
+      auto chunk_end = std::min(chunk_bounds.back() + chunk_size, total_nm);
+      // a block is not split between chunks
+      while (chunk_end < total_nm &&
+             _observations_order[chunk_end - 1].block_id ==
+               _observations_order[chunk_end].block_id) {
+        ++chunk_end;
+      }
+      chunk_bounds.push_back(chunk_end);
+    }
+    ThreadPool::shared()->parallel_for(
+      chunk_bounds.size() - 1, [&](std::size_t chunk_i) {
+        apply_sorted_observations(map, chunk_bounds[chunk_i],
+                                  chunk_bounds[chunk_i + 1], true,
+                                  merge_free);
+      }, _insertion_threads_nm);
+  }
+
+  void apply_sorted_observations(GridMap &map, std::size_t begin,
+                                 std::size_t end, bool is_concurrent,
+                                 bool merge_free) const {
+    bool is_free_observed = false;
+    for (std::size_t i = begin; i < end; ++i) {
+      auto &entry = _observations_order[i];
+      if (i == begin || _observations_order[i - 1].key != entry.key) {
+        is_free_observed = false;
+      }
+
+      auto &observation = _observations[entry.id];
+      if (!observation.aoo.is_occupied) {
+        if (merge_free && is_free_observed) { continue; }
+        is_free_observed = true;
+      }
+      if (is_concurrent) {
+        map.update_concurrently(observation.area_id, observation.aoo);
+      } else {
+        map.update(observation.area_id, observation.aoo);
+      }
+    }
+  }
 
 public:
   std::shared_ptr<CellOccupancyEstimator> _occ_est;
   std::shared_ptr<ObservationMappingQualityEstimator> _omqe;
+private:
+  struct AreaObservation {
+    GridMap::Coord area_id;
+    AOO aoo;
+  };
+
+  struct ObservationOrder {
+    std::size_t block_id;
+    uint64_t key;
+    uint32_t id;
+
+    bool operator<(const ObservationOrder &that) const {
+      return std::tie(block_id, key, id) <
+             std::tie(that.block_id, that.key, that.id);
+    }
+  };
+
+  ScanInsertionMode _insertion_mode;
+  unsigned _insertion_threads_nm;
+  // observations are buffered by append_scans in any mode
+  mutable bool _is_batch_forced = false;
+  // buffers of the batched insertion reused by scans
+  mutable std::vector<AreaObservation> _observations;
+  mutable std::vector<ObservationOrder> _observations_order;
+};
+
+constexpr std::size_t GridMapScanAdder::Min_Concurrent_Batch_Size;
+
+/* Wall blurring policies of a WallDistanceBlurringScanAdder.
+ * A blurred wall marks free cells that are close to an obstacle
+ * as partially occupied; a policy provides the blur distance in cells. */
+
+struct NoWallBlurring {
+  static constexpr bool Is_Enabled = false;
+
+  NoWallBlurring(double) {}
+  double cell_dist(const GridMap &, const Segment2D &) const { return 0; }
 };
 
+struct FixedWallBlurring {
+  static constexpr bool Is_Enabled = true;
+
+  FixedWallBlurring(double blur_distance) : _blur_distance{blur_distance} {}
+  double cell_dist(const GridMap &map, const Segment2D &) const {
+    return _blur_distance / map.scale();
+  }
+private:
+  double _blur_distance;
+};
+
+// Blur grows with a beam length, the distance is a scaling coefficient
+struct DynamicWallBlurring {
+  static constexpr bool Is_Enabled = true;
+
+  DynamicWallBlurring(double blur_distance)
+    : _blur_scale{std::abs(blur_distance)} {}
+  double cell_dist(const GridMap &map, const Segment2D &beam) const {
+    return _blur_scale / map.scale() * beam.length_sq();
+  }
+private:
+  double _blur_scale;
+};
+
+constexpr bool NoWallBlurring::Is_Enabled;
+constexpr bool FixedWallBlurring::Is_Enabled;
+constexpr bool DynamicWallBlurring::Is_Enabled;
+
+template <typename WallBlurring>
+class GenericWallDistanceBlurringScanAdder;
+
+// NB: the builder produces an adder specialized for a blurring type,
+//     so the no-blur configuration runs a minimal per-cell loop.
 class WallDistanceBlurringScanAdder : public GridMapScanAdder {
 private:
   class WallDistanceBlurringScanAdderBuilder {
@@ -108,16 +366,18 @@ private:
     ADD_SETTER(std::shared_ptr<ObservationMappingQualityEstimator>,
                observation_quality_estimator);
     ADD_SETTER(double, max_usable_range);
+    ADD_SETTER(ScanInsertionMode, insertion_mode);
+    ADD_SETTER(unsigned, insertion_threads_nm);
   #undef ADD_SETTER
 
   public:
     WallDistanceBlurringScanAdderBuilder()
       : _blur_distance{0}
-      , _max_usable_range{std::numeric_limits<double>::infinity()} {}
+      , _max_usable_range{std::numeric_limits<double>::infinity()}
+      , _insertion_mode{ScanInsertionMode::Immediate}
+      , _insertion_threads_nm{1} {}
 
-    auto build() const {
-      return std::make_shared<WallDistanceBlurringScanAdder>(*this);
-    }
+    std::shared_ptr<WallDistanceBlurringScanAdder> build() const;
   };
 public:
   static WallDistanceBlurringScanAdderBuilder builder() {
@@ -127,9 +387,35 @@ public:
   using ScanAdderProperties = WallDistanceBlurringScanAdderBuilder;
   WallDistanceBlurringScanAdder(const ScanAdderProperties &props)
     : GridMapScanAdder{props.occupancy_estimator(),
-                       props.observation_quality_estimator()}
+                       props.observation_quality_estimator(),
+                       props.insertion_mode(),
+                       props.insertion_threads_nm()}
     , _props{props}
     , _max_usable_range_sq{std::pow(_props.max_usable_range(), 2)}{}
+
+  double blur_distance() const { return _props.blur_distance(); }
+
+protected:
+  bool is_usable(const Segment2D &beam) const {
+    return beam.length_sq() <= _max_usable_range_sq;
+  }
+
+private:
+  ScanAdderProperties _props;
+  double _max_usable_range_sq;
+protected:
+  // a rasterized beam and its cells estimates buffers reused by scan points
+  mutable std::vector<GridMap::Coord> _beam_cells;
+  mutable std::vector<Occupancy> _beam_occupancies;
+};
+
+template <typename WallBlurring>
+class GenericWallDistanceBlurringScanAdder
+  : public WallDistanceBlurringScanAdder {
+public:
+  GenericWallDistanceBlurringScanAdder(const ScanAdderProperties &props)
+    : WallDistanceBlurringScanAdder{props}
+    , _blurring{props.blur_distance()} {}
 protected:
 
   // TODO: limit beam randering by distance
@@ -137,29 +423,39 @@ protected:
   // TODO: consider renaming blur to distortion
   void handle_scan_point(GridMap &map, bool is_occ, double scan_quality,
                          const Segment2D &beam) const override {
-    if (_max_usable_range_sq < beam.length_sq()) {
+    if (!is_usable(beam)) {
       return;
     }
-    // TODO: simplify, consider performance if _blur_dist is not set
-    //       (a static factory method)
-    auto robot_pt = map.world_to_cell(beam.beg());
-    auto obst_pt = map.world_to_cell(beam.end());
-    auto obst_dist_sq = robot_pt.dist_sq(obst_pt);
-    auto hole_dist_sq = std::pow(blur_cell_dist(map, beam, is_occ), 2);
 
-    auto pts = map.world_to_cells(beam);
+    auto &pts = _beam_cells;
+    map.world_to_cells(beam, pts);
     auto pt_bounds = map.world_cell_bounds(pts.back());
     auto base_occup = estimate_occupancy(beam, pt_bounds, is_occ);
     auto occ_aoo = AOO{is_occ, base_occup, beam.end(), scan_quality};
-    map.update(pts.back(), occ_aoo);
+    observe_area(map, pts.back(), occ_aoo);
     pts.pop_back();
 
+    auto &occs = _beam_occupancies;
+    estimate_beam_occupancies(beam, map, pts, occs);
     auto empty_aoo = AOO{false, {0, 0}, beam.end(), scan_quality};
-    for (const auto &pt : pts) {
+    if (!WallBlurring::Is_Enabled || !is_occ) { // no wall -> no blurring
+      for (std::size_t i = 0; i < pts.size(); ++i) {
+        empty_aoo.occupancy = occs[i];
+        observe_area(map, pts[i], empty_aoo);
+      }
+      return;
+    }
+
+    auto robot_pt = map.world_to_cell(beam.beg());
+    auto obst_pt = map.world_to_cell(beam.end());
+    auto obst_dist_sq = robot_pt.dist_sq(obst_pt);
+    auto hole_dist = _blurring.cell_dist(map, beam);
+    auto hole_dist_sq = hole_dist * hole_dist;
+    for (std::size_t i = 0; i < pts.size(); ++i) {
+      const auto &pt = pts[i];
       const auto dist_sq = pt.dist_sq(obst_pt);
-      auto pt_bounds = map.world_cell_bounds(pt);
       empty_aoo.is_occupied = false;
-      empty_aoo.occupancy = estimate_occupancy(beam, pt_bounds, false);
+      empty_aoo.occupancy = occs[i];
 
       if (dist_sq < hole_dist_sq && hole_dist_sq < obst_dist_sq) {
         // NB: empty cell occupancy quality is not changed
@@ -167,30 +463,26 @@ protected:
         auto prob_scale = 1.0 - dist_sq / hole_dist_sq;
         empty_aoo.occupancy.prob_occ = base_occup.prob_occ * prob_scale;
       }
-      map.update(pt, empty_aoo);
+      observe_area(map, pt, empty_aoo);
     }
   }
 
 private:
-  // return obstacle blur distance in cells
-  double blur_cell_dist(const GridMap &map, const Segment2D &beam,
-                        bool is_occ) const {
-    if (!is_occ) { // no wall -> no blurring
-      return 0;
-    }
+  WallBlurring _blurring;
+};
 
-    auto blur_dist = _props.blur_distance() / map.scale();
-    if (blur_dist < 0) {
-      // dynamic wall blurring, Hole_Width is a scaling coefficient
-      double dist_sq = beam.length_sq();
-      blur_dist *= -dist_sq;
-    }
-    return blur_dist;
+inline std::shared_ptr<WallDistanceBlurringScanAdder>
+WallDistanceBlurringScanAdder::WallDistanceBlurringScanAdderBuilder::build()
+const {
+  if (_blur_distance == 0) {
+    return std::make_shared<
+      GenericWallDistanceBlurringScanAdder<NoWallBlurring>>(*this);
+  } else if (0 < _blur_distance) {
+    return std::make_shared<
+      GenericWallDistanceBlurringScanAdder<FixedWallBlurring>>(*this);
   }
-
-private:
-  ScanAdderProperties _props;
-  double _max_usable_range_sq;
-};
+  return std::make_shared<
+    GenericWallDistanceBlurringScanAdder<DynamicWallBlurring>>(*this);
+}
 
 #endif
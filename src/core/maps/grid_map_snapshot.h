@@ -0,0 +1,89 @@
+#ifndef SLAM_CTOR_CORE_GRID_MAP_SNAPSHOT_H
+#define SLAM_CTOR_CORE_GRID_MAP_SNAPSHOT_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* A versioned on-disk grid map format: a header followed by a payload
+ * of width * height cells in a row-major order. Cells are stored either
+ * as raw storage elements (trivially copyable ones, e.g. quantized cells),
+ * so a mapped payload is bulk-copied to the map, or as a concatenation
+ * of GridCell::serialize results. */
+struct GridMapSnapshotHeader {
+  static constexpr uint32_t Magic = 0x534d4353; // "SCMS"
+  static constexpr uint32_t Version = 1;
+  enum class PayloadFormat : uint32_t {
+    Serialized_Cells = 0, Raw_Elements = 1
+  };
+
+  uint32_t magic = Magic, version = Version;
+  PayloadFormat payload_format;
+  uint32_t element_size;
+  int32_t width, height, origin_x, origin_y;
+  double scale;
+  uint64_t payload_size;
+
+  bool is_compatible(PayloadFormat format, uint32_t elem_size,
+                     std::size_t snapshot_size) const {
+    return magic == Magic && version == Version &&
+           payload_format == format && element_size == elem_size &&
+           0 <= width && 0 <= height &&
+           sizeof(*this) + payload_size <= snapshot_size;
+  }
+};
+
+constexpr uint32_t GridMapSnapshotHeader::Magic;
+constexpr uint32_t GridMapSnapshotHeader::Version;
+
+// A read-only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) { return; }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && 0 < file_stat.st_size) {
+      void *data = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE,
+                        fd, 0);
+      if (data != MAP_FAILED) {
+        _data = static_cast<const char *>(data);
+        _size = file_stat.st_size;
+      }
+    }
+    close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (_data) { munmap(const_cast<char *>(_data), _size); }
+  }
+
+  bool is_valid() const { return _data != nullptr; }
+  const char *data() const { return _data; }
+  std::size_t size() const { return _size; }
+private:
+  const char *_data = nullptr;
+  std::size_t _size = 0;
+};
+
+// Writes the snapshot with a single sequential write
+inline bool write_grid_map_snapshot(const std::string &path,
+                                    const std::vector<char> &snapshot) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (!file) { return false; }
+  bool is_written = std::fwrite(snapshot.data(), 1, snapshot.size(), file) ==
+                    snapshot.size();
+  return (std::fclose(file) == 0) && is_written;
+}
+
+#endif
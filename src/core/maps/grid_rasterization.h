@@ -1,6 +1,8 @@
 #ifndef SLAM_CTOR_CORE_GRID_RASTERIZATION_H
 #define SLAM_CTOR_CORE_GRID_RASTERIZATION_H
 
+#include <cstddef>
+#include <iterator>
 #include <vector>
 
 #include "../geometry_utils.h"
@@ -11,7 +13,42 @@
 // WA: GridRasterizedRectangle{grid, grid.world_cell_bounds(cell), false}
 //          == { cell }
 class GridRasterizedRectangle {
-  // TODO: make iterable
+public: // types
+  using Coord = RegularSquaresGrid::Coord;
+
+  class Iterator {
+  public: // types
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Coord;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Coord*;
+    using reference = const Coord&;
+  public:
+    Iterator(const GridRasterizedRectangle &rect, const Coord &area_id)
+      : _rect{&rect}, _area_id{area_id} {}
+
+    reference operator*() const { return _area_id; }
+    pointer operator->() const { return &_area_id; }
+
+    Iterator& operator++() {
+      _rect->advance(_area_id);
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      auto prev = *this;
+      ++*this;
+      return prev;
+    }
+
+    bool operator==(const Iterator &that) const {
+      return _area_id == that._area_id;
+    }
+    bool operator!=(const Iterator &that) const { return !(*this == that); }
+  private:
+    const GridRasterizedRectangle *_rect;
+    Coord _area_id;
+  };
 public:
   /* IDEA:
    *
@@ -25,7 +62,10 @@ public:
   */
   GridRasterizedRectangle(const RegularSquaresGrid &grid,
                           const LightWeightRectangle &r,
-                          bool include_border = true) {
+                          bool include_border = true,
+                          GridTraversalOrder order =
+                            GridTraversalOrder::Column_Major)
+    : _order{order} {
     double offset = include_border ? 0 : 1e-9;
     bool area_is_infin = r.area() == RegularSquaresGrid::Dbl_Inf,
          area_is_empty = r.area() == 0;
@@ -55,11 +95,10 @@ public:
 
   RegularSquaresGrid::Coord next() {
     auto area_id = RegularSquaresGrid::Coord{_x, _y};
-    ++_y;
-    if (_rt.y < _y) {
-      _y = _lb.y;
-      ++_x;
-    }
+    auto next_area_id = area_id;
+    advance(next_area_id);
+    _x = next_area_id.x;
+    _y = next_area_id.y;
     return area_id;
   }
 
@@ -69,7 +108,50 @@ public:
     return result;
   }
 
+  //----------------------------------------------------------------------------
+  // Range API (independent of has_next/next)
+
+  bool is_empty() const { return _rt.x < _lb.x || _rt.y < _lb.y; }
+  const Coord &left_bot() const { return _lb; }
+  const Coord &right_top() const { return _rt; }
+
+  Iterator begin() const {
+    return Iterator{*this, is_empty() ? end_id() : _lb};
+  }
+  Iterator end() const { return Iterator{*this, end_id()}; }
+
+  // Calls action(row_begin_area_id, areas_nm) for each row of the rectangle
+  // (from the bottom to the top), so a row is processed as a contiguous run.
+  template <typename Action>
+  void for_each_row(Action action) const {
+    if (is_empty()) { return; }
+    int row_len = _rt.x - _lb.x + 1;
+    for (int y = _lb.y; y <= _rt.y; ++y) {
+      action(Coord{_lb.x, y}, row_len);
+    }
+  }
+
+private: // methods
+
+  void advance(Coord &area_id) const {
+    if (_order == GridTraversalOrder::Column_Major) {
+      if (++area_id.y <= _rt.y) { return; }
+      area_id.y = _lb.y;
+      ++area_id.x;
+    } else {
+      if (++area_id.x <= _rt.x) { return; }
+      area_id.x = _lb.x;
+      ++area_id.y;
+    }
+  }
+
+  Coord end_id() const {
+    return _order == GridTraversalOrder::Column_Major ?
+      Coord{_rt.x + 1, _lb.y} : Coord{_lb.x, _rt.y + 1};
+  }
+
 private:
+  GridTraversalOrder _order;
   RegularSquaresGrid::Coord _lb, _rt;
   int _x, _y;
 };
@@ -0,0 +1,137 @@
+#ifndef SLAM_CTOR_CORE_GRID_RAY_CASTER_H
+#define SLAM_CTOR_CORE_GRID_RAY_CASTER_H
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "grid_map.h"
+#include "../math_utils.h"
+#include "../thread_pool.h"
+
+struct RayCastHit {
+  bool is_hit = false;
+  GridMap::Coord area_id = {0, 0};
+  // the distance from the ray origin to the middle of the area's chord
+  double range = 0;
+};
+
+/* Finds the first obstacle area of a ray (e.g. for scans generation
+ * or expected ranges of a beam model).
+ * Areas are traversed by a DDA (Amanatides & Woo): ray parameters of the
+ * next vertical/horizontal bounds crossings are incremented by a constant,
+ * so a ray stops at the obstacle without the beam rasterization
+ * and without heap allocations.
+ * Areas that are only touched by a ray (a chord of zero length)
+ * are not hits; a ray through a corner of areas moves diagonally. */
+class GridRayCaster {
+public: // consts
+  // a smaller number of rays is not worth a thread's task
+  static constexpr std::size_t Rays_Per_Task = 64;
+public:
+  // NB: rays of a cast are cast by threads_nm threads
+  //     of the shared pool, so the map is read concurrently.
+  explicit GridRayCaster(unsigned threads_nm = 1)
+    : _threads_nm{std::max(threads_nm, 1u)} {}
+
+  unsigned threads_nm() const { return _threads_nm; }
+
+  // The ray is cast from the origin in the angle direction up to
+  // the max range; is_obstacle(const GridMap::Coord &) tells
+  // whether an area stops the ray.
+  template <typename IsObstacle>
+  static RayCastHit cast(const GridMap &map, const Point2D &origin,
+                         double angle, double max_range,
+                         IsObstacle &&is_obstacle) {
+    constexpr auto Inf = std::numeric_limits<double>::infinity();
+    auto scale = map.scale();
+    double dir_x = std::cos(angle), dir_y = std::sin(angle);
+    int step_x = 0 < dir_x ? 1 : -1, step_y = 0 < dir_y ? 1 : -1;
+
+    // NB: an axis-parallel ray never crosses bounds of the other axis
+    auto crossing_t = [scale](int bound_id, double orig, double dir) {
+      return dir == 0 ? Inf : (bound_id * scale - orig) / dir;
+    };
+    auto area_id = map.world_to_cell(origin);
+    auto next_bound_x = area_id.x + (0 < step_x ? 1 : 0),
+         next_bound_y = area_id.y + (0 < step_y ? 1 : 0);
+    double t_max_x = crossing_t(next_bound_x, origin.x, dir_x),
+           t_max_y = crossing_t(next_bound_y, origin.y, dir_y);
+    double t_delta_x = dir_x == 0 ? Inf : scale / std::abs(dir_x),
+           t_delta_y = dir_y == 0 ? Inf : scale / std::abs(dir_y);
+    // the origin area is entered behind the origin
+    double t_in = std::max(dir_x == 0 ? -Inf : t_max_x - t_delta_x,
+                           dir_y == 0 ? -Inf : t_max_y - t_delta_y);
+
+    while (t_in <= max_range) {
+      double t_out = std::min(t_max_x, t_max_y);
+      if (!are_equal(t_in, t_out) && is_obstacle(area_id)) {
+        // NB: the chord is found by the area bounds, so errors
+        //     of the incremented parameters are not accumulated
+        auto in_x = crossing_t(next_bound_x - step_x, origin.x, dir_x),
+             in_y = crossing_t(next_bound_y - step_y, origin.y, dir_y);
+        auto chord_in = std::max(dir_x == 0 ? -Inf : in_x,
+                                 dir_y == 0 ? -Inf : in_y);
+        auto chord_out = std::min(crossing_t(next_bound_x, origin.x, dir_x),
+                                  crossing_t(next_bound_y, origin.y, dir_y));
+        auto hit = RayCastHit{};
+        hit.is_hit = true;
+        hit.area_id = area_id;
+        hit.range = std::abs(chord_in + chord_out) / 2;
+        return hit;
+      }
+
+      // NB: are_equal(infinity, x) is true
+      bool is_corner = dir_x != 0 && dir_y != 0 &&
+                       are_equal(t_max_x, t_max_y);
+      if (is_corner) {
+        next_bound_x += step_x;
+        next_bound_y += step_y;
+        area_id.x += step_x;
+        area_id.y += step_y;
+        t_max_x += t_delta_x;
+        t_max_y += t_delta_y;
+      } else if (t_max_x < t_max_y) {
+        next_bound_x += step_x;
+        area_id.x += step_x;
+        t_max_x += t_delta_x;
+      } else {
+        next_bound_y += step_y;
+        area_id.y += step_y;
+        t_max_y += t_delta_y;
+      }
+      t_in = t_out;
+    }
+    return RayCastHit{};
+  }
+
+  // Casts rays of the given angles, hits[i] is the hit of angles[i].
+  template <typename IsObstacle>
+  void cast(const GridMap &map, const Point2D &origin,
+            const std::vector<double> &angles, double max_range,
+            IsObstacle &&is_obstacle, std::vector<RayCastHit> &hits) const {
+    hits.resize(angles.size());
+    auto tasks_nm = (angles.size() + Rays_Per_Task - 1) / Rays_Per_Task;
+    ThreadPool::shared()->parallel_for(tasks_nm, [&](std::size_t task_i) {
+      auto end = std::min((task_i + 1) * Rays_Per_Task, angles.size());
+      for (auto i = task_i * Rays_Per_Task; i < end; ++i) {
+        hits[i] = cast(map, origin, angles[i], max_range, is_obstacle);
+      }
+    }, _threads_nm);
+  }
+
+  // An area is an obstacle if its occupancy is at least the threshold
+  static auto occupancy_threshold(const GridMap &map, double occ_threshold) {
+    return [&map, occ_threshold](const GridMap::Coord &area_id) {
+      return occ_threshold <= double(map[area_id]);
+    };
+  }
+
+private: // fields
+  unsigned _threads_nm;
+};
+
+constexpr std::size_t GridRayCaster::Rays_Per_Task;
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef SLAM_CTOR_CORE_LAZY_TILED_GRID_MAP_H_INCLUDED
 #define SLAM_CTOR_CORE_LAZY_TILED_GRID_MAP_H_INCLUDED
 
+#include <atomic>
 #include <memory>
 #include <cmath>
 #include <cstring>
@@ -8,26 +9,216 @@
 #include <array>
 #include <algorithm>
 #include <tuple>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <typeinfo>
 
 #include "cell_occupancy_estimator.h"
 #include "grid_cell.h"
+#include "grid_cell_storages.h"
 #include "grid_map.h"
 #include "../geometry_utils.h"
+#include "../serialization.h"
+#include "../trace_recorder.h"
 #include <iostream>
 
-class LazyTiledGridMap : public GridMap {
+/* Layouts of cells inside a tile */
+
+// x-major: neighbours along y are adjacent (a GridRasterizedRectangle order)
+struct ColumnMajorTileLayout {
+  static unsigned index(unsigned x, unsigned y, unsigned tile_size_bits) {
+    return (x << tile_size_bits) | y;
+  }
+};
+
+// Z-order: small square neighbourhoods share cache lines
+struct MortonTileLayout {
+  static unsigned index(unsigned x, unsigned y, unsigned) {
+    return spread_bits(x) | (spread_bits(y) << 1);
+  }
+private:
+  // inserts a zero bit after each bit of a 16-bit value
+  static unsigned spread_bits(unsigned v) {
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  }
+};
+
+/* A square block of cells, the unit of allocation and copy-on-write */
+template <typename CellStorage, unsigned TileSizeBits, typename TileLayout>
+struct GridMapTile {
+  using Element = typename CellStorage::Element;
+  static constexpr unsigned Size = 1 << TileSizeBits;
+  static constexpr unsigned Coord_Mask = Size - 1;
+
+  GridMapTile(const GridCell &dflt) {
+    _cells.reserve(Size * Size);
+    std::generate_n(std::back_inserter(_cells), Size * Size,
+                    [&dflt](){ return CellStorage::make(dflt); });
+  }
+
+  // PERFORMANCE: a single block copy for cells stored by value
+  GridMapTile(const GridMapTile &that) {
+    _cells.reserve(that._cells.size());
+    std::transform(that._cells.begin(), that._cells.end(),
+                   std::back_inserter(_cells), &CellStorage::copy);
+  }
+
+  // Bytes of a tile of cells like the prototype
+  static std::size_t memory_size(const GridCell &prototype) {
+    return sizeof(GridMapTile) +
+           Size * Size * (sizeof(Element) + CellStorage::heap_bytes(prototype));
+  }
+
+  // NB: only the lower TileSizeBits of coordinates are used
+  Element &cell(const RegularSquaresGrid::Coord& cell_coord) {
+    return const_cast<Element &>(
+      static_cast<const GridMapTile*>(this)->cell(cell_coord));
+  }
+
+  const Element &cell(const RegularSquaresGrid::Coord& cell_coord) const {
+    return _cells[TileLayout::index(cell_coord.x & Coord_Mask,
+                                    cell_coord.y & Coord_Mask,
+                                    TileSizeBits)];
+  }
+
+  // PERFORMANCE: raw elements (e.g. quantized cells) are written as is,
+  //              other cells are serialized one by one.
+  void serialize(Serializer &s) const { serialize(s, Has_Raw_Elements{}); }
+
+  // Reads cells written by serialize; returns the position after them.
+  // NB: the buffer cell is of the map's cell type
+  std::size_t deserialize(const std::vector<char> &data, std::size_t pos,
+                          GridCell &buffer) {
+    return deserialize(data, pos, buffer, Has_Raw_Elements{});
+  }
+private: // types
+  using Has_Raw_Elements = std::integral_constant<
+    bool, std::is_trivially_copyable<Element>::value>;
+private: // methods
+  void serialize(Serializer &s, std::true_type) const {
+    s.append(reinterpret_cast<const char *>(_cells.data()),
+             _cells.size() * sizeof(Element));
+  }
+
+  void serialize(Serializer &s, std::false_type) const {
+    for (auto &e : _cells) { s.append(CellStorage::cell(e).serialize()); }
+  }
+
+  std::size_t deserialize(const std::vector<char> &data, std::size_t pos,
+                          GridCell &, std::true_type) {
+    auto bytes = _cells.size() * sizeof(Element);
+    if (data.size() < pos || data.size() - pos < bytes) {
+      // truncated data, see Deserializer::read_value
+      return std::max(pos, data.size()) + bytes;
+    }
+    std::memcpy(_cells.data(), data.data() + pos, bytes);
+    return pos + bytes;
+  }
+
+  std::size_t deserialize(const std::vector<char> &data, std::size_t pos,
+                          GridCell &buffer, std::false_type) {
+    for (auto &e : _cells) {
+      pos = buffer.deserialize(data, pos);
+      e = CellStorage::make(buffer);
+    }
+    return pos;
+  }
+private: // fields
+  std::vector<Element> _cells;
+};
+
+template <typename CellStorage, unsigned TileSizeBits, typename TileLayout>
+constexpr unsigned GridMapTile<CellStorage, TileSizeBits, TileLayout>::Size;
+template <typename CellStorage, unsigned TileSizeBits, typename TileLayout>
+constexpr unsigned
+GridMapTile<CellStorage, TileSizeBits, TileLayout>::Coord_Mask;
+
+/* Tiles of lazy tiled maps that are stored once however many maps
+ * share them (e.g. maps of particles, see GenericLazyTiledGridMap::
+ * save_layout), so a state of the maps grows with their divergence. */
+template <typename Tile>
+class LazyTileTable {
+public: // consts
+  // the id of an unknown tile, it is not stored
+  static constexpr uint32_t No_Tile = std::numeric_limits<uint32_t>::max();
+public:
+  std::size_t size() const { return _tiles.size(); }
+
+  // Returns the id of the tile; a tile is added once
+  uint32_t add(const std::shared_ptr<Tile> &tile) {
+    auto id = _ids.emplace(tile.get(), uint32_t(_tiles.size()));
+    if (id.second) { _tiles.push_back(tile); }
+    return id.first->second;
+  }
+
+  const std::shared_ptr<Tile> &tile(uint32_t id) const {
+    assert(id < _tiles.size());
+    return _tiles[id];
+  }
+
+  void save(Serializer &s) const {
+    s << uint64_t(_tiles.size());
+    for (auto &tile : _tiles) { tile->serialize(s); }
+  }
+
+  // Reads tiles written by save; returns the position after them
+  // (a position past the data's end if the data is truncated).
+  // NB: the prototype is a cell of maps the tiles belong to
+  std::size_t load(const std::vector<char> &data, std::size_t pos,
+                   const GridCell &prototype) {
+    Deserializer d{data, pos};
+    auto tiles_nm = d.read_value<uint64_t>();
+    pos = d.pos();
+    auto buffer = prototype.clone();
+    _ids.clear();
+    _tiles.clear();
+    for (uint64_t i = 0; i < tiles_nm && pos <= data.size(); ++i) {
+      auto tile = std::make_shared<Tile>(prototype);
+      pos = tile->deserialize(data, pos, *buffer);
+      _tiles.push_back(std::move(tile));
+    }
+    return pos;
+  }
+
+private: // fields
+  std::vector<std::shared_ptr<Tile>> _tiles;
+  std::unordered_map<const Tile*, uint32_t> _ids;
+};
+
+template <typename Tile>
+constexpr uint32_t LazyTileTable<Tile>::No_Tile;
+
+// Numbers of modified tiles of a map by their owning
+struct TileSharingStats {
+  // tiles that are owned by the map only
+  std::size_t unique_tiles_nm = 0;
+  // tiles that are shared with other maps (e.g. copies of the map)
+  std::size_t shared_tiles_nm = 0;
+};
+
+template <typename CellStorage, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+class GenericLazyTiledGridMap : public GridMap {
+  static_assert(0 < TileSizeBits && TileSizeBits <= 15,
+                "Tile side must be in [2; 2^15] cells");
 protected:
-  static constexpr unsigned Tile_Size_Bits = 7;
+  static constexpr unsigned Tile_Size_Bits = TileSizeBits;
   static constexpr unsigned Tile_Size = 1 << Tile_Size_Bits;
-  static constexpr unsigned Tile_Coord_Mask = Tile_Size - 1;
 protected:
-  struct Tile;
+  using Tile = GridMapTile<CellStorage, TileSizeBits, TileLayout>;
+public:
+  using TileTable = LazyTileTable<Tile>;
 public:
-  LazyTiledGridMap(std::shared_ptr<GridCell> prototype,
-                   const GridMapParams& params = MapValues::gmp)
+  GenericLazyTiledGridMap(std::shared_ptr<GridCell> prototype,
+                          const GridMapParams& params = MapValues::gmp)
     : GridMap{prototype, params}
     , _unknown_cell{prototype->clone()}
-    , _unknown_tile{std::make_shared<Tile>(_unknown_cell)}
+    , _unknown_tile{std::make_shared<Tile>(*_unknown_cell)}
     , _tiles_nm_x{(GridMap::width() + Tile_Size - 1) / Tile_Size}
     , _tiles_nm_y{(GridMap::height() + Tile_Size - 1) / Tile_Size}
     , _tiles{_tiles_nm_x * _tiles_nm_y, _unknown_tile} {}
@@ -35,43 +226,348 @@ public:
   void update(const Coord &area_id,
               const AreaOccupancyObservation &aoo) override {
     ensure_sole_owning(area_id);
-    GridMap::update(area_id, aoo);
+    CellStorage::update(element_internal(external2internal(area_id)), aoo);
+    this->on_area_modified(area_id);
   }
 
   void reset(const Coord &area_id, const GridCell &new_area) override {
     ensure_sole_owning(area_id);
-    GridMap::reset(area_id, new_area);
+    CellStorage::reset(element_internal(external2internal(area_id)),
+                       new_area);
+    this->on_area_modified(area_id);
+  }
+
+  void merge(const Coord &area_id, const GridCell &that) override {
+    ensure_sole_owning(area_id);
+    CellStorage::merge(element_internal(external2internal(area_id)), that);
+    this->on_area_modified(area_id);
+  }
+
+  // PERFORMANCE: a tile is made solely owned once per its run of the row
+  void update_row(const Coord &area_id, int areas_nm,
+                  const AreaOccupancyObservation *aoos) override {
+    if (!has_row(area_id, areas_nm)) {
+      GridMap::update_row(area_id, areas_nm, aoos);
+      return;
+    }
+    using Element = typename CellStorage::Element;
+    modify_row(area_id, areas_nm, [aoos](Element &e, int i) {
+      CellStorage::update(e, aoos[i]);
+    });
+  }
+
+  void reset_row(const Coord &area_id, int areas_nm,
+                 const GridCell &new_area) override {
+    if (!has_row(area_id, areas_nm)) {
+      GridMap::reset_row(area_id, areas_nm, new_area);
+      return;
+    }
+    using Element = typename CellStorage::Element;
+    modify_row(area_id, areas_nm, [&new_area](Element &e, int) {
+      CellStorage::reset(e, new_area);
+    });
+  }
+
+  // PERFORMANCE: a map of the same type is merged by tiles: its unknown
+  //              tiles are skipped and its tile that lands on an unknown
+  //              tile of the map (the offset is aligned with tiles)
+  //              is shared, i.e. copied on write.
+  void merge_shifted(const GridMap &that, const Coord &offset) override {
+    auto that_map = dynamic_cast<const GenericLazyTiledGridMap *>(&that);
+    if (!that_map || that_map == this ||
+        typeid(*that_map->_unknown_cell) != typeid(*_unknown_cell)) {
+      GridMap::merge_shifted(that, offset);
+      return;
+    }
+
+    for (unsigned tile_y = 0; tile_y < that_map->_tiles_nm_y; ++tile_y) {
+      for (unsigned tile_x = 0; tile_x < that_map->_tiles_nm_x; ++tile_x) {
+        auto that_begin = Coord(tile_x * Tile_Size, tile_y * Tile_Size);
+        const auto &that_tile = that_map->tile(that_begin);
+        if (!that_tile || that_tile == that_map->_unknown_tile) { continue; }
+        merge_tile(that_tile, that_map->internal2external(that_begin) + offset);
+      }
+    }
   }
 
   const GridCell &operator[](const Coord& c) const override {
     return cell_internal(external2internal(c));
   }
 
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    return discrepancy_internal(external2internal(area_id), aoo);
+  }
+
+  // PERFORMANCE: cells of unknown tiles are not read (e.g. by an export
+  //              of a huge sparse map)
+  void row_occupancies(const Coord &area_id, int areas_nm,
+                       double *probs) const override {
+    auto ic = external2internal(area_id);
+    if (!has_internal_cell(ic) ||
+        !has_internal_cell({ic.x + areas_nm - 1, ic.y})) {
+      GridMap::row_occupancies(area_id, areas_nm, probs);
+      return;
+    }
+    row_occupancies_internal(ic, areas_nm, probs);
+  }
+
+  // NB: tiles are update blocks; a tile slot is written only by
+  //     the thread that updates its areas.
+  bool prepare_concurrent_updates(const Coord &min,
+                                  const Coord &max) override {
+    if (!has_internal_cell(external2internal(min)) ||
+        !has_internal_cell(external2internal(max))) {
+      return false;
+    }
+    // the bounding box of updates is reported in advance
+    this->on_area_modified(min);
+    this->on_area_modified(max);
+    return true;
+  }
+
+  std::size_t update_block_id(const Coord &area_id) const override {
+    return tile_id(external2internal(area_id));
+  }
+
+  void update_concurrently(const Coord &area_id,
+                           const AreaOccupancyObservation &aoo) override {
+    ensure_sole_owning(area_id);
+    CellStorage::update(element_internal(external2internal(area_id)), aoo);
+  }
+
+  // NB: tiles are shared with the snapshot until they are modified
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericLazyTiledGridMap>(*this);
+  }
+
+  // NB: copies of a map share its tiles until they are modified,
+  //     so memory grows with divergence of copies rather than their number
+  //     (e.g. maps of particles).
+  TileSharingStats tile_sharing_stats() const {
+    auto stats = TileSharingStats{};
+    for (auto &tile : _tiles) {
+      if (tile == _unknown_tile) { continue; }
+      if (tile.use_count() == 1) {
+        ++stats.unique_tiles_nm;
+      } else {
+        ++stats.shared_tiles_nm;
+      }
+    }
+    return stats;
+  }
+
+  // NB: the unknown tile is shared by copies of the map
+  GridMapMemoryUsage memory_usage() const override {
+    auto tile_bytes = Tile::memory_size(*_unknown_cell);
+    auto usage = GridMapMemoryUsage{};
+    usage.add_overhead(_tiles.capacity() * sizeof(std::shared_ptr<Tile>));
+    usage.add_overhead(tile_bytes, _unknown_tile.use_count());
+    for (auto &tile : _tiles) {
+      if (!tile || tile == _unknown_tile) { continue; }
+      usage.add_tile(tile_bytes, tile.use_count());
+    }
+    return usage;
+  }
+
+  //----------------------------------------------------------------------------
+  // State: a tile table followed by the layout
+
+  std::vector<char> save_state() const override {
+    auto tiles = TileTable{};
+    auto layout = Serializer{};
+    save_layout(layout, tiles);
+    auto state = Serializer{};
+    tiles.save(state);
+    state.append(layout.result());
+    return state.result();
+  }
+
+  bool load_state(const std::vector<char> &data) override {
+    auto tiles = TileTable{};
+    auto pos = tiles.load(data, 0, *_unknown_cell);
+    return pos <= data.size() && load_layout(data, pos, tiles) <= data.size();
+  }
+
+  // Writes the geometry of the map and ids of its tiles in the table
+  // (known tiles are added to it).
+  void save_layout(Serializer &s, TileTable &tiles) const {
+    auto map_origin = origin();
+    s << this->scale() << this->width() << this->height()
+      << map_origin.x << map_origin.y << _tiles_nm_x << _tiles_nm_y;
+    for (auto &tile : _tiles) {
+      bool is_known = tile && tile != _unknown_tile;
+      s << (is_known ? tiles.add(tile) : TileTable::No_Tile);
+    }
+  }
+
+  // Reads a layout written by save_layout; returns the position after it.
+  // A layout that is truncated or refers unknown tiles is rejected
+  // (the map is kept, a position past the data's end is returned).
+  // NB: tiles of the table are shared with other maps that refer them,
+  //     i.e. they are copied on write.
+  std::size_t load_layout(const std::vector<char> &data, std::size_t pos,
+                          const TileTable &tiles) {
+    Deserializer d{data, pos};
+    auto scale = d.read_value<decltype(this->scale())>();
+    auto width = d.read_value<decltype(this->width())>();
+    auto height = d.read_value<decltype(this->height())>();
+    auto map_origin = Coord{};
+    unsigned tiles_nm_x = 0, tiles_nm_y = 0;
+    d >> map_origin.x >> map_origin.y >> tiles_nm_x >> tiles_nm_y;
+    auto tiles_nm = uint64_t(tiles_nm_x) * tiles_nm_y;
+    auto rejected_pos = data.size() + 1;
+    if (d.is_overrun() || !(0 < scale) || width < 0 || height < 0 ||
+        uint64_t(tiles_nm_x) * Tile_Size < uint64_t(width) ||
+        uint64_t(tiles_nm_y) * Tile_Size < uint64_t(height) ||
+        (data.size() - d.pos()) / sizeof(uint32_t) < tiles_nm) {
+      return rejected_pos;
+    }
+
+    auto layout = std::vector<std::shared_ptr<Tile>>(tiles_nm, _unknown_tile);
+    for (auto &tile : layout) {
+      auto tile_id = d.read_value<uint32_t>();
+      if (tile_id == TileTable::No_Tile) { continue; }
+      if (tiles.size() <= tile_id) { return rejected_pos; }
+      tile = tiles.tile(tile_id);
+    }
+
+    this->set_scale(scale);
+    this->set_width(width);
+    this->set_height(height);
+    restore_origin(map_origin);
+    _tiles_nm_x = tiles_nm_x;
+    _tiles_nm_y = tiles_nm_y;
+    _tiles = std::move(layout);
+    this->forget_modifications();
+    return d.pos();
+  }
+
 protected: // methods & types
 
+  // NB: the origin of a bounded map follows its size
+  virtual void restore_origin(const Coord &) {}
+
   const GridCell& cell_internal(const Coord& ic) const {
-    return *tile(ic)->cell(ic);
+    return CellStorage::cell(tile(ic)->cell(ic));
+  }
+
+  double discrepancy_internal(const Coord& ic,
+                              const AreaOccupancyObservation &aoo) const {
+    return CellStorage::discrepancy(tile(ic)->cell(ic), aoo);
+  }
+
+  // NB: the row must be inside the map
+  void row_occupancies_internal(const Coord &ic, int areas_nm,
+                                double *probs) const {
+    auto unknown_prob = _unknown_cell->occupancy().prob_occ;
+    auto coord = ic;
+    while (0 < areas_nm) {
+      int span = std::min<int>(areas_nm,
+                               Tile_Size - (coord.x & (Tile_Size - 1)));
+      auto &tile = this->tile(coord);
+      if (!tile || tile == _unknown_tile) {
+        std::fill(probs, probs + span, unknown_prob);
+      } else {
+        for (int i = 0; i < span; ++i) {
+          CellStorage::occupancies(&tile->cell({coord.x + i, coord.y}), 1,
+                                   probs + i);
+        }
+      }
+      coord.x += span;
+      probs += span;
+      areas_nm -= span;
+    }
   }
 
+  bool has_row(const Coord &area_id, int areas_nm) const {
+    auto ic = external2internal(area_id);
+    return 0 < areas_nm && has_internal_cell(ic) &&
+           has_internal_cell({ic.x + areas_nm - 1, ic.y});
+  }
+
+  // Applies the operation to elements of a row of areas inside the map
+  // (an element and its index in the row) tile by tile.
+  template <typename ElementOp>
+  void modify_row(const Coord &area_id, int areas_nm, ElementOp op) {
+    auto ic = external2internal(area_id);
+    int i = 0;
+    while (i < areas_nm) {
+      int span = std::min<int>(areas_nm - i,
+                               Tile_Size - ((ic.x + i) & (Tile_Size - 1)));
+      ensure_sole_owning({area_id.x + i, area_id.y});
+      auto &tile = this->tile({ic.x + i, ic.y});
+      for (int end = i + span; i < end; ++i) {
+        op(tile->cell({ic.x + i, ic.y}), i);
+      }
+    }
+    this->on_area_modified(area_id);
+    this->on_area_modified({area_id.x + areas_nm - 1, area_id.y});
+  }
+
+  // NB: the tile must be solely owned
+  typename CellStorage::Element &element_internal(const Coord& ic) {
+    return tile(ic)->cell(ic);
+  }
+
+  // NB: copy-on-write is done per tile, cells of a tile are owned by it.
+  //     Maps that share tiles may be updated concurrently (e.g. maps of
+  //     particles): a shared tile is copied and its reference is released;
+  //     a map that sees itself as the sole owner writes the tile after
+  //     an acquire fence, so the writes happen after reads of the tile
+  //     by maps that have released it.
   void ensure_sole_owning(const Coord &area_id) {
     auto coord = external2internal(area_id);
     std::shared_ptr<Tile> &tile = this->tile(coord);
     if (!tile) {
-      tile = std::make_shared<Tile>(_unknown_cell);
+      tile = std::make_shared<Tile>(*_unknown_cell);
     }
     if (1 < tile.use_count()) {
-      tile.reset(new Tile{*tile});
-    }
-
-    std::shared_ptr<GridCell> &cell = tile->cell(coord);
-    if (1 < cell.use_count()) {
-      cell = cell->clone();
+      tile = std::make_shared<Tile>(*tile);
+      return;
     }
+    std::atomic_thread_fence(std::memory_order_acquire);
   }
 
   const std::shared_ptr<GridCell> unknown_cell() const { return _unknown_cell; }
   std::shared_ptr<Tile> unknown_tile() { return _unknown_tile; }
 
+  // Merges the tile (of another map) into areas that start at begin
+  void merge_tile(const std::shared_ptr<Tile> &that_tile,
+                  const Coord &begin) {
+    auto end = begin + Coord(Tile_Size - 1, Tile_Size - 1);
+    // NB: an unbounded map grows to the tile
+    if (!prepare_concurrent_updates(begin, end)) {
+      for (unsigned y = 0; y < Tile_Size; ++y) {
+        for (unsigned x = 0; x < Tile_Size; ++x) {
+          auto area_id = begin + Coord(x, y);
+          if (!this->has_cell(area_id)) { continue; }
+          merge(area_id, CellStorage::cell(that_tile->cell(Coord(x, y))));
+        }
+      }
+      return;
+    }
+
+    auto ic = external2internal(begin);
+    auto is_aligned = !(ic.x & (Tile_Size - 1)) && !(ic.y & (Tile_Size - 1));
+    if (is_aligned) {
+      auto &tile = this->tile(ic);
+      if (!tile || tile == _unknown_tile) {
+        tile = that_tile;
+        return;
+      }
+      ensure_sole_owning(begin);
+    }
+    for (unsigned y = 0; y < Tile_Size; ++y) {
+      for (unsigned x = 0; x < Tile_Size; ++x) {
+        auto area_id = begin + Coord(x, y);
+        if (!is_aligned) { ensure_sole_owning(area_id); }
+        CellStorage::merge(element_internal(external2internal(area_id)),
+                           CellStorage::cell(that_tile->cell(Coord(x, y))));
+      }
+    }
+  }
+
   std::tuple<unsigned, unsigned>
   extra_tiles_nm(int min, int val, int max) const {
     assert(min <= max);
@@ -84,28 +580,13 @@ protected: // methods & types
     return std::make_tuple(prepend_nm, append_nm);
   }
 
-  struct Tile {
-    Tile(std::shared_ptr<GridCell> dflt) {
-      std::fill(_cells.begin(), _cells.end(), dflt);
-    }
-
-    std::shared_ptr<GridCell> &cell(const Coord& cell_coord) {
-      return const_cast<std::shared_ptr<GridCell> &>(
-        static_cast<const Tile*>(this)->cell(cell_coord));
-    }
-
-    const std::shared_ptr<GridCell> &cell(const Coord& cell_coord) const {
-      return _cells[(cell_coord.x & Tile_Coord_Mask) * Tile_Size +
-                    (cell_coord.y & Tile_Coord_Mask)];
-    }
-  private:
-    std::array<std::shared_ptr<GridCell>, Tile_Size*Tile_Size> _cells;
-  };
-
 private: // methods
+  std::size_t tile_id(const Coord &c) const {
+    return (c.y >> Tile_Size_Bits) * _tiles_nm_x + (c.x >> Tile_Size_Bits);
+  }
+
   std::shared_ptr<Tile> &tile(const Coord &c) const {
-    return  _tiles[(c.y >> Tile_Size_Bits) * _tiles_nm_x +
-                   (c.x >> Tile_Size_Bits)];
+    return _tiles[tile_id(c)];
   }
 
 private: // fields
@@ -118,66 +599,142 @@ protected: // fields
 
 /* Unbounded implementation */
 
-class UnboundedLazyTiledGridMap : public LazyTiledGridMap {
+template <typename CellStorage, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+class GenericUnboundedLazyTiledGridMap
+  : public GenericLazyTiledGridMap<CellStorage, TileSizeBits, TileLayout> {
+private: // types
+  using Base = GenericLazyTiledGridMap<CellStorage, TileSizeBits, TileLayout>;
+  using typename Base::Tile;
+  using Base::Tile_Size;
+public:
+  using typename Base::Coord;
 public:
-  UnboundedLazyTiledGridMap(std::shared_ptr<GridCell> prototype,
+  GenericUnboundedLazyTiledGridMap(std::shared_ptr<GridCell> prototype,
       const GridMapParams& params = MapValues::gmp)
-    : LazyTiledGridMap{prototype, params}
+    : Base{prototype, params}
     , _origin{GridMap::origin()} {}
 
   void update(const Coord& area_id,
               const AreaOccupancyObservation &aoo) override {
     ensure_inside(area_id);
-    return LazyTiledGridMap::update(area_id, aoo);
+    return Base::update(area_id, aoo);
   }
 
   void reset(const Coord &area_id, const GridCell &new_area) override {
     ensure_inside(area_id);
-    LazyTiledGridMap::reset(area_id, new_area);
+    Base::reset(area_id, new_area);
+  }
+
+  void merge(const Coord &area_id, const GridCell &that) override {
+    ensure_inside(area_id);
+    Base::merge(area_id, that);
+  }
+
+  void reserve_area(const Coord &min, const Coord &max) override {
+    ensure_inside(min);
+    ensure_inside(max);
+  }
+
+  void update_row(const Coord &area_id, int areas_nm,
+                  const AreaOccupancyObservation *aoos) override {
+    if (areas_nm <= 0) { return; }
+    reserve_area(area_id, {area_id.x + areas_nm - 1, area_id.y});
+    Base::update_row(area_id, areas_nm, aoos);
+  }
+
+  void reset_row(const Coord &area_id, int areas_nm,
+                 const GridCell &new_area) override {
+    if (areas_nm <= 0) { return; }
+    reserve_area(area_id, {area_id.x + areas_nm - 1, area_id.y});
+    Base::reset_row(area_id, areas_nm, new_area);
   }
 
   const GridCell &operator[](const Coord& ec) const override {
-    auto ic = external2internal(ec);
-    if (!LazyTiledGridMap::has_internal_cell(ic)) {
-      return *unknown_cell();
+    auto ic = this->external2internal(ec);
+    if (!Base::has_internal_cell(ic)) {
+      return *this->unknown_cell();
     }
 
-    return LazyTiledGridMap::cell_internal(ic);
+    return Base::cell_internal(ic);
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    auto ic = this->external2internal(area_id);
+    if (!Base::has_internal_cell(ic)) {
+      return this->unknown_cell()->discrepancy(aoo);
+    }
+    return Base::discrepancy_internal(ic, aoo);
   }
 
   DiscretePoint2D origin() const override { return _origin; }
   bool has_cell(const Coord &) const override { return true; }
 
+  void row_occupancies(const Coord &area_id, int areas_nm,
+                       double *probs) const override {
+    auto ic = this->external2internal(area_id);
+    int begin = std::max(0, -ic.x);
+    int end = std::min(areas_nm, this->width() - ic.x);
+    auto unknown_prob = this->unknown_cell()->occupancy().prob_occ;
+    if (ic.y < 0 || this->height() <= ic.y || end <= begin) {
+      std::fill(probs, probs + areas_nm, unknown_prob);
+      return;
+    }
+
+    std::fill(probs, probs + begin, unknown_prob);
+    Base::row_occupancies_internal({ic.x + begin, ic.y}, end - begin,
+                                   probs + begin);
+    std::fill(probs + end, probs + areas_nm, unknown_prob);
+  }
+
+  bool prepare_concurrent_updates(const Coord &min,
+                                  const Coord &max) override {
+    ensure_inside(min);
+    ensure_inside(max);
+    return Base::prepare_concurrent_updates(min, max);
+  }
+
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericUnboundedLazyTiledGridMap>(*this);
+  }
+
 protected:
 
+  void restore_origin(const Coord &origin) override { _origin = origin; }
+
   bool ensure_inside(const DiscretePoint2D &c) {
-    auto coord = external2internal(c);
-    if (LazyTiledGridMap::has_internal_cell(coord)) return false;
+    auto coord = this->external2internal(c);
+    if (Base::has_internal_cell(coord)) return false;
+    TraceScope trace{"ensure_inside", "map"};
+
+    auto &tiles = this->_tiles;
+    auto &tiles_nm_x = this->_tiles_nm_x, &tiles_nm_y = this->_tiles_nm_y;
 
     unsigned prep_x = 0, app_x = 0, prep_y = 0, app_y = 0;
-    std::tie(prep_x, app_x) = extra_tiles_nm(0, coord.x, width());
-    std::tie(prep_y, app_y) = extra_tiles_nm(0, coord.y, height());
+    std::tie(prep_x, app_x) = this->extra_tiles_nm(0, coord.x, this->width());
+    std::tie(prep_y, app_y) = this->extra_tiles_nm(0, coord.y, this->height());
 
-    unsigned new_tiles_nm_x = prep_x + _tiles_nm_x + app_x;
-    unsigned new_tiles_nm_y = prep_y + _tiles_nm_y + app_y;
-    assert(_tiles_nm_x <= new_tiles_nm_x && _tiles_nm_y <= new_tiles_nm_y);
+    unsigned new_tiles_nm_x = prep_x + tiles_nm_x + app_x;
+    unsigned new_tiles_nm_y = prep_y + tiles_nm_y + app_y;
+    assert(tiles_nm_x <= new_tiles_nm_x && tiles_nm_y <= new_tiles_nm_y);
 
     std::vector<std::shared_ptr<Tile>> new_tiles{new_tiles_nm_x*new_tiles_nm_y,
-                                                 unknown_tile()};
-    for (unsigned row_i = 0; row_i != _tiles_nm_y; ++row_i) {
-      std::move(&_tiles[row_i * _tiles_nm_x],       // row begin
-                &_tiles[(row_i + 1) * _tiles_nm_x], // row end
+                                                 this->unknown_tile()};
+    for (unsigned row_i = 0; row_i != tiles_nm_y; ++row_i) {
+      std::move(&tiles[row_i * tiles_nm_x],       // row begin
+                &tiles[(row_i + 1) * tiles_nm_x], // row end
                 &new_tiles[(prep_y + row_i)* new_tiles_nm_x + prep_x]);
     }
 
-    _tiles_nm_x = new_tiles_nm_x;
-    _tiles_nm_y = new_tiles_nm_y;
-    std::swap(_tiles, new_tiles);
-    set_height(_tiles_nm_y * Tile_Size);
-    set_width(_tiles_nm_x * Tile_Size);
+    tiles_nm_x = new_tiles_nm_x;
+    tiles_nm_y = new_tiles_nm_y;
+    std::swap(tiles, new_tiles);
+    this->set_height(tiles_nm_y * Tile_Size);
+    this->set_width(tiles_nm_x * Tile_Size);
     _origin += Coord(prep_x * Tile_Size, prep_y * Tile_Size);
 
-    assert(LazyTiledGridMap::has_cell(c));
+    assert(Base::has_cell(c));
     return true;
   }
 
@@ -185,4 +742,18 @@ private: // fields
     DiscretePoint2D _origin;
 };
 
+using LazyTiledGridMap = GenericLazyTiledGridMap<PolymorphicCellStorage>;
+using UnboundedLazyTiledGridMap =
+  GenericUnboundedLazyTiledGridMap<PolymorphicCellStorage>;
+
+// Tiled maps that keep cells of a known type by value inside tiles
+template <typename CellT, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+using ValueLazyTiledGridMap = GenericLazyTiledGridMap<
+  ValueCellStorage<CellT>, TileSizeBits, TileLayout>;
+template <typename CellT, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+using UnboundedValueLazyTiledGridMap = GenericUnboundedLazyTiledGridMap<
+  ValueCellStorage<CellT>, TileSizeBits, TileLayout>;
+
 #endif
@@ -0,0 +1,261 @@
+#ifndef SLAM_CTOR_CORE_LIKELIHOOD_FIELD_GRID_MAP_H
+#define SLAM_CTOR_CORE_LIKELIHOOD_FIELD_GRID_MAP_H
+
+#include <memory>
+#include <cassert>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "grid_cell.h"
+#include "grid_map.h"
+
+/* A grid map decorator that keeps a likelihood field of the back map:
+ * a per-cell score of the expected scan point observation (an obstacle)
+ * maximized over a (2 * radius + 1)^2 cells neighbourhood.
+ * The field is used to answer discrepancy() of the expected observation,
+ * so ObstacleBasedOccupancyObservationPE with the map estimates
+ * a point with a single flat-array lookup the way
+ * MaxOccupancyObservationPE does for a neighbourhood of the same size.
+ * Modified cells are accumulated and the field is refreshed in a batch
+ * on the next read of the field.
+ * NB: the field follows the back map geometry, so the back map
+ *     is not expected to be rescaled. */
+template <typename BackGridMap>
+class LikelihoodFieldGridMap : public GridMap {
+private: // types
+  struct FieldCell {
+    float cell_score, field_score;
+  };
+public: // consts
+  static constexpr unsigned Default_Radius = 1;
+public:
+  LikelihoodFieldGridMap(std::shared_ptr<GridCell> prototype,
+                         const GridMapParams& params = MapValues::gmp,
+                         unsigned radius = Default_Radius)
+    : GridMap{prototype, params}
+    , _back_map{prototype, params}
+    , _radius(radius)
+    , _unknown_score(score(*prototype)) {}
+
+  // The observation that is answered by the field
+  static AreaOccupancyObservation expected_observation() {
+    return {true, {1.0, 1.0}, {0, 0}, 1.0};
+  }
+
+  //----------------------------------------------------------------------------
+  // RegularSquaresGrid overrides
+
+  Coord origin() const override { return _back_map.origin(); }
+  int width() const override { return _back_map.width(); }
+  int height() const override { return _back_map.height(); }
+  double scale() const override { return _back_map.scale(); }
+  bool has_cell(const Coord &c) const override {
+    return _back_map.has_cell(c);
+  }
+
+  //----------------------------------------------------------------------------
+  // GridMap overrides
+
+  const GridCell& operator[](const Coord &coord) const override {
+    return _back_map[coord];
+  }
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    _back_map.update(area_id, aoo);
+    on_area_update(area_id);
+  }
+
+  void reset(const Coord &area_id, const GridCell &area) override {
+    _back_map.reset(area_id, area);
+    on_area_update(area_id);
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    if (!is_expected(aoo)) { return _back_map.discrepancy(area_id, aoo); }
+
+    // NB: the field is a cache, so the sync is logically const
+    const_cast<LikelihoodFieldGridMap&>(*this).sync_field();
+    auto fc = field_cell(area_id);
+    return 1.0 - (fc ? fc->field_score : _unknown_score);
+  }
+
+  // the field is synced on reads unless it is up to date
+  bool supports_concurrent_reads() const override {
+    return _dirty_area_ids.empty() && _back_map.supports_concurrent_reads();
+  }
+
+  void prepare_for_reads() override {
+    _back_map.prepare_for_reads();
+    sync_field();
+  }
+
+  // NB: the field is a cache, so only the back map is captured
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return _back_map.snapshot();
+  }
+
+  uint64_t version() const override { return _back_map.version(); }
+  uint64_t instance_id() const override {
+    return _back_map.instance_id();
+  }
+
+  // NB: the field is an overhead of the back map
+  GridMapMemoryUsage memory_usage() const override {
+    auto usage = _back_map.memory_usage();
+    usage.add_overhead(_field.capacity() * sizeof(FieldCell) +
+                       _dirty_area_ids.capacity() * sizeof(Coord));
+    return usage;
+  }
+
+  ModifiedGridArea modified_area(uint64_t since_version) const override {
+    return _back_map.modified_area(since_version);
+  }
+
+  std::vector<char> save_state() const override {
+    return _back_map.save_state();
+  }
+
+  bool load_state(const std::vector<char> &data) override {
+    if (!_back_map.load_state(data)) { return false; }
+    _field.clear();
+    _field_w = _field_h = 0;
+    _dirty_area_ids.clear();
+    for (int y = 0; y < _back_map.height(); ++y) {
+      for (int x = 0; x < _back_map.width(); ++x) {
+        on_area_update(_back_map.internal2external({x, y}));
+      }
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  // Own API
+
+  unsigned radius() const { return _radius; }
+
+  void sync_field() {
+    if (_dirty_area_ids.empty()) { return; }
+
+    auto dirty_area_ids = std::move(_dirty_area_ids);
+    _dirty_area_ids.clear();
+    remove_duplicates(dirty_area_ids);
+
+    auto affected_area_ids = std::vector<Coord>{};
+    affected_area_ids.reserve(dirty_area_ids.size());
+    auto expected = expected_observation();
+    for (auto &area_id : dirty_area_ids) {
+      field_cell(area_id)->cell_score =
+        1.0 - _back_map.discrepancy(area_id, expected);
+      for_each_neighbour(area_id, [&](const Coord &c) {
+        affected_area_ids.push_back(c);
+      });
+    }
+
+    remove_duplicates(affected_area_ids);
+    for (auto &area_id : affected_area_ids) {
+      float field_score = 0;
+      for_each_neighbour(area_id, [&](const Coord &c) {
+        auto fc = field_cell(c);
+        field_score = std::max(field_score, fc ? fc->cell_score
+                                               : _unknown_score);
+      });
+      field_cell(area_id)->field_score = field_score;
+    }
+  }
+
+private: // methods
+
+  static float score(const GridCell &cell) {
+    return 1.0 - cell.discrepancy(expected_observation());
+  }
+
+  static bool is_expected(const AreaOccupancyObservation &aoo) {
+    auto expected = expected_observation();
+    return aoo.is_occupied == expected.is_occupied &&
+           aoo.occupancy == expected.occupancy &&
+           aoo.quality == expected.quality;
+  }
+
+  template <typename Action>
+  void for_each_neighbour(const Coord &area_id, Action action) const {
+    int r = _radius;
+    for (int dy = -r; dy <= r; ++dy) {
+      for (int dx = -r; dx <= r; ++dx) {
+        action(area_id + Coord{dx, dy});
+      }
+    }
+  }
+
+  static void remove_duplicates(std::vector<Coord> &area_ids) {
+    std::sort(area_ids.begin(), area_ids.end(),
+              [](const Coord &a, const Coord &b) {
+                return std::tie(a.y, a.x) < std::tie(b.y, b.x);
+              });
+    area_ids.erase(std::unique(area_ids.begin(), area_ids.end()),
+                   area_ids.end());
+  }
+
+  void on_area_update(const Coord &area_id) {
+    int r = _radius;
+    ensure_field_covers(area_id + Coord{-r, -r}, area_id + Coord{r, r});
+    _dirty_area_ids.push_back(area_id);
+  }
+
+  const FieldCell *field_cell(const Coord &c) const {
+    int x = c.x - _field_min.x, y = c.y - _field_min.y;
+    if (x < 0 || _field_w <= x || y < 0 || _field_h <= y) { return nullptr; }
+    return &_field[y * _field_w + x];
+  }
+
+  FieldCell *field_cell(const Coord &c) {
+    return const_cast<FieldCell*>(
+      static_cast<const LikelihoodFieldGridMap&>(*this).field_cell(c));
+  }
+
+  // The field grows twice on an overflow, so growth is amortized.
+  void ensure_field_covers(const Coord &min, const Coord &max) {
+    if (field_cell(min) && field_cell(max)) { return; }
+
+    auto new_min = min, new_max = max;
+    if (_field_w && _field_h) {
+      auto field_max = _field_min + Coord{_field_w - 1, _field_h - 1};
+      new_min = {std::min(new_min.x, _field_min.x - _field_w / 2),
+                 std::min(new_min.y, _field_min.y - _field_h / 2)};
+      new_max = {std::max(new_max.x, field_max.x + _field_w / 2),
+                 std::max(new_max.y, field_max.y + _field_h / 2)};
+    }
+    int new_w = new_max.x - new_min.x + 1, new_h = new_max.y - new_min.y + 1;
+    auto new_field = std::vector<FieldCell>(
+      new_w * new_h, FieldCell{_unknown_score, _unknown_score});
+    for (int y = 0; y < _field_h; ++y) {
+      auto row_begin = _field.begin() + y * _field_w;
+      int new_x = _field_min.x - new_min.x;
+      int new_y = _field_min.y - new_min.y + y;
+      std::copy(row_begin, row_begin + _field_w,
+                new_field.begin() + new_y * new_w + new_x);
+    }
+
+    std::swap(_field, new_field);
+    _field_min = new_min;
+    _field_w = new_w;
+    _field_h = new_h;
+  }
+
+private: // fields
+  BackGridMap _back_map;
+  unsigned _radius;
+  float _unknown_score;
+  std::vector<FieldCell> _field;
+  Coord _field_min;
+  int _field_w = 0, _field_h = 0;
+  std::vector<Coord> _dirty_area_ids;
+};
+
+template <typename BackGridMap>
+constexpr unsigned LikelihoodFieldGridMap<BackGridMap>::Default_Radius;
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef SLAM_CTOR_CORE_LOCAL_SCORE_WINDOW_H
+#define SLAM_CTOR_CORE_LOCAL_SCORE_WINDOW_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "grid_map.h"
+#include "area_score_tables.h"
+
+/* A dense copy of cell scores of a grid map around an area of interest
+ * (e.g. the one a scan is matched in). Scores are the ones of
+ * AreaScoreTables (1 - discrepancy of the expected scan point observation),
+ * but only a window of the map is copied, so a matcher may extract it once
+ * per scan and score candidate poses against a contiguous buffer instead
+ * of the map's (virtual) cell lookups.
+ * A synced window (see sync) persists across matchings: only areas
+ * modified since the previous sync (see GridMap::modified_area) are
+ * copied again, so the buffer may be kept by a scoring backend
+ * that is updated by changed areas only.
+ * NB: an extracted window is a snapshot, i.e. it is not updated with
+ *     the map until the next sync. */
+class LocalScoreWindow {
+public: // types
+  using Coord = GridMap::Coord;
+public:
+
+  // Copies scores of cells that contain [min_x, max_x] x [min_y, max_y]
+  // (world coordinates); cells outside the map are scored as unknown.
+  void extract(const GridMap &map, double min_x, double min_y,
+               double max_x, double max_y) {
+    _map = &map;
+    _map_id = map.instance_id();
+    _version = map.version();
+    _scale = map.scale();
+    _min = Coord{int(std::floor(min_x / _scale)),
+                 int(std::floor(min_y / _scale))};
+    auto max = Coord{int(std::floor(max_x / _scale)),
+                     int(std::floor(max_y / _scale))};
+    _width = std::max(max.x - _min.x + 1, 0);
+    _height = std::max(max.y - _min.y + 1, 0);
+    _unknown_score =
+      1.0 - map.new_cell()->discrepancy(AreaScoreTables::expected_observation());
+    _scores.assign(std::size_t(_width) * _height, _unknown_score);
+    copy_scores(map, _min, max);
+  }
+
+  // Makes the window contain [min_x, max_x] x [min_y, max_y] with scores
+  // of the current map. The window is kept if it still contains the
+  // rectangle, so only areas modified since the last sync are copied;
+  // otherwise the rectangle extended by the slack (in meters) is extracted.
+  // Returns whether the window has been kept.
+  bool sync(const GridMap &map, double min_x, double min_y,
+            double max_x, double max_y, double slack = 0) {
+    auto version = map.version();
+    // NB: a map at the same address may be a replaced one (e.g. a copy
+    //     assigned to it), so its instance is checked as well
+    if (_map == &map && _map_id == map.instance_id() &&
+        _scale == map.scale() && contains(min_x, min_y) &&
+        contains(max_x, max_y)) {
+      auto area = map.modified_area(_version);
+      if (area.is_known) {
+        _version = version;
+        if (area.is_empty()) { return true; }
+        auto max = _min + Coord{_width - 1, _height - 1};
+        copy_scores(map, Coord{std::max(_min.x, area.min.x),
+                               std::max(_min.y, area.min.y)},
+                         Coord{std::min(max.x, area.max.x),
+                               std::min(max.y, area.max.y)});
+        return true;
+      }
+    }
+
+    slack = std::max(slack, 0.0);
+    extract(map, min_x - slack, min_y - slack, max_x + slack, max_y + slack);
+    return false;
+  }
+
+  CellScoresView cell_scores() const {
+    return {_scores.data(), _min, _width, _height, _scale, _unknown_score};
+  }
+
+private: // methods
+
+  bool contains(double x, double y) const {
+    auto x_id = int(std::floor(x / _scale)),
+         y_id = int(std::floor(y / _scale));
+    return _min.x <= x_id && x_id < _min.x + _width &&
+           _min.y <= y_id && y_id < _min.y + _height;
+  }
+
+  // Copies scores of the window's cells of [min; max] that are in the map
+  void copy_scores(const GridMap &map, const Coord &min, const Coord &max) {
+    auto map_min = map.internal2external({0, 0});
+    auto in_min = Coord{std::max(min.x, map_min.x),
+                        std::max(min.y, map_min.y)};
+    auto in_max = Coord{std::min(max.x, map_min.x + map.width() - 1),
+                        std::min(max.y, map_min.y + map.height() - 1)};
+    if (in_max.x < in_min.x || in_max.y < in_min.y) { return; }
+
+    // PERFORMANCE: discrepancies are requested per rows
+    //              (see GridMap::row_discrepancies).
+    auto row_len = in_max.x - in_min.x + 1;
+    _row_discrepancies.resize(row_len);
+    for (int y = in_min.y; y <= in_max.y; ++y) {
+      map.row_discrepancies({in_min.x, y}, row_len,
+                            AreaScoreTables::expected_observation(),
+                            _row_discrepancies.data());
+      auto *row_scores = _scores.data() + std::size_t(y - _min.y) * _width +
+                         (in_min.x - _min.x);
+      for (int i = 0; i < row_len; ++i) {
+        row_scores[i] = 1.0 - _row_discrepancies[i];
+      }
+    }
+  }
+
+private: // fields
+  // the synced map and its version (see sync)
+  const GridMap *_map = nullptr;
+  uint64_t _map_id = 0, _version = 0;
+  double _scale = 1;
+  Coord _min;
+  int _width = 0, _height = 0;
+  double _unknown_score = 0;
+  std::vector<double> _scores;
+  // a buffer reused by copies
+  std::vector<double> _row_discrepancies;
+};
+
+#endif
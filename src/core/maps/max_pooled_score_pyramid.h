@@ -0,0 +1,174 @@
+#ifndef SLAM_CTOR_CORE_MAX_POOLED_SCORE_PYRAMID_H
+#define SLAM_CTOR_CORE_MAX_POOLED_SCORE_PYRAMID_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "grid_map.h"
+
+/* A read-only resolution pyramid of cell scores of a grid map
+ * for multi-resolution scan matching (see M3RSMEngine).
+ * A score of a cell is 1 - discrepancy of the expected scan point
+ * observation (an obstacle). The level L keeps for a cell (x, y) the max
+ * score of the 2^L x 2^L cells window with the bottom left cell (x, y),
+ * so a level lookup is an upper bound of scores of the window's cells.
+ * Levels are flat arrays of the map size (i.e. they are not decimated),
+ * so a window may start at any cell.
+ * The pyramid is refreshed from the live map on sync: only the area
+ * modified since the previous sync is recomputed unless the map geometry
+ * has changed. */
+class MaxPooledScorePyramid {
+public: // types
+  using Coord = GridMap::Coord;
+public:
+  explicit MaxPooledScorePyramid(unsigned levels_nm = 1)
+    : _levels(std::max(levels_nm, 1u)) {}
+
+  // The observation that is scored
+  static AreaOccupancyObservation expected_observation() {
+    return {true, {1.0, 1.0}, {0, 0}, 1.0};
+  }
+
+  unsigned levels_nm() const { return _levels.size(); }
+
+  std::size_t memory_size() const {
+    std::size_t size = 0;
+    for (auto &level : _levels) { size += level.capacity() * sizeof(float); }
+    return size;
+  }
+  double scale() const { return _scale; }
+  float unknown_score() const { return _unknown_score; }
+
+  // The level which windows cover cells of points moved by any translation
+  // in a range of a given length along both axes.
+  static unsigned level(double translation_range, double cell_scale) {
+    // NB: a segment of length l covers at most ceil(l / cell) + 1 cells
+    auto cells_nm = std::ceil(translation_range / cell_scale) + 1;
+    return unsigned(std::ceil(std::log2(std::max(cells_nm, 1.0))));
+  }
+
+  unsigned level(double translation_range) const {
+    return level(translation_range, _scale);
+  }
+
+  // Ensures levels for a given translation range; the pyramid is rebuilt
+  // on the next sync if levels are added.
+  void ensure_levels(double translation_range, double cell_scale) {
+    auto required_levels_nm = level(translation_range, cell_scale) + 1;
+    if (required_levels_nm <= levels_nm()) { return; }
+
+    _levels.resize(required_levels_nm);
+    _is_built = false;
+  }
+
+  void sync(const GridMap &map) {
+    auto version = map.version();
+    auto geometry_is_same = _is_built && _scale == map.scale() &&
+      _min == map.internal2external({0, 0}) &&
+      _width == map.width() && _height == map.height();
+    if (geometry_is_same) {
+      auto area = map.modified_area(_version);
+      if (area.is_known) {
+        _version = version;
+        if (!area.is_empty()) { refresh(map, area.min, area.max); }
+        return;
+      }
+    }
+
+    _scale = map.scale();
+    _min = map.internal2external({0, 0});
+    _width = map.width();
+    _height = map.height();
+    _unknown_score = 1.0 - map.new_cell()->discrepancy(expected_observation());
+    for (auto &level : _levels) {
+      level.assign(std::size_t(_width) * _height, _unknown_score);
+    }
+    _is_built = true;
+    _version = version;
+    refresh(map, _min, _min + Coord{_width - 1, _height - 1});
+  }
+
+  // An upper bound of scores of the window of the level at a given cell.
+  // NB: windows outside the map are scored as unknown cells; a level
+  //     that is not built is scored as the max score (i.e. 1).
+  float score(unsigned level, const Coord &c) const {
+    if (levels_nm() <= level) { return 1.0; }
+    int window_len = 1 << level;
+    int x = c.x - _min.x, y = c.y - _min.y;
+    if (_width <= x || _height <= y ||
+        x + window_len <= 0 || y + window_len <= 0) {
+      return _unknown_score;
+    }
+    if (0 <= x && 0 <= y) { return _levels[level][y * _width + x]; }
+
+    // NB: the window starting at the map bound covers the window's part
+    //     inside the map, so the bound is kept.
+    auto in_map_score =
+      _levels[level][std::max(y, 0) * _width + std::max(x, 0)];
+    return std::max(in_map_score, _unknown_score);
+  }
+
+private: // methods
+
+  // Recomputes areas of levels affected by modified areas in [min, max]
+  void refresh(const GridMap &map, const Coord &min, const Coord &max) {
+    auto in_min = Coord{std::max(min.x - _min.x, 0),
+                        std::max(min.y - _min.y, 0)};
+    auto in_max = Coord{std::min(max.x - _min.x, _width - 1),
+                        std::min(max.y - _min.y, _height - 1)};
+    if (in_max.x < in_min.x || in_max.y < in_min.y) { return; }
+
+    // PERFORMANCE: discrepancies are requested per rows
+    //              (see GridMap::row_discrepancies).
+    auto &scores = _levels[0];
+    auto row_len = in_max.x - in_min.x + 1;
+    _row_discrepancies.resize(row_len);
+    for (int y = in_min.y; y <= in_max.y; ++y) {
+      map.row_discrepancies(_min + Coord{in_min.x, y}, row_len,
+                            expected_observation(),
+                            _row_discrepancies.data());
+      auto *row_scores = scores.data() + y * _width + in_min.x;
+      for (int i = 0; i < row_len; ++i) {
+        row_scores[i] = 1.0 - _row_discrepancies[i];
+      }
+    }
+
+    // windows of the level that contain modified cells start
+    // up to (2^level - 1) cells before them
+    for (unsigned l = 1; l < levels_nm(); ++l) {
+      int half = 1 << (l - 1);
+      in_min = {std::max(in_min.x - half, 0), std::max(in_min.y - half, 0)};
+      const auto &finer = _levels[l - 1];
+      auto &coarser = _levels[l];
+      for (int y = in_min.y; y <= in_max.y; ++y) {
+        for (int x = in_min.x; x <= in_max.x; ++x) {
+          coarser[y * _width + x] = std::max(
+            std::max(finer_score(finer, x, y),
+                     finer_score(finer, x + half, y)),
+            std::max(finer_score(finer, x, y + half),
+                     finer_score(finer, x + half, y + half)));
+        }
+      }
+    }
+  }
+
+  float finer_score(const std::vector<float> &finer, int x, int y) const {
+    if (_width <= x || _height <= y) { return _unknown_score; }
+    return finer[y * _width + x];
+  }
+
+private: // fields
+  std::vector<std::vector<float>> _levels;
+  bool _is_built = false;
+  uint64_t _version = 0;
+  double _scale = 1;
+  Coord _min;
+  int _width = 0, _height = 0;
+  float _unknown_score = 0;
+  // a buffer reused by refreshes
+  std::vector<double> _row_discrepancies;
+};
+
+#endif
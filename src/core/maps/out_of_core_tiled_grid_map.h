@@ -0,0 +1,333 @@
+#ifndef SLAM_CTOR_CORE_OUT_OF_CORE_TILED_GRID_MAP_H
+#define SLAM_CTOR_CORE_OUT_OF_CORE_TILED_GRID_MAP_H
+
+#include <memory>
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+#include "grid_cell.h"
+#include "grid_cell_storages.h"
+#include "grid_map.h"
+#include "sparse_tiled_grid_map.h"
+#include "../serialization.h"
+
+/* A sparse tiled map that keeps at most a given number of tiles in memory.
+ * The least recently accessed tiles are serialized to a backing
+ * (temporary) file and are transparently paged in on access.
+ * File space of a tile is reused once no map copy refers to it,
+ * so the file is bounded by the evicted tiles rather than by evictions.
+ * If the file can't be written, tiles are kept in memory (the error is
+ * reported once); a tile that can't be read back raises runtime_error.
+ * NB: a reference returned by operator[] stays valid until
+ *     an access to another tile. */
+template <typename CellStorage, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+class GenericOutOfCoreTiledGridMap
+  : public GenericSparseTiledGridMap<CellStorage, TileSizeBits, TileLayout> {
+private: // types
+  using Base = GenericSparseTiledGridMap<CellStorage, TileSizeBits,
+                                         TileLayout>;
+  using typename Base::Tile;
+  using typename Base::TileCoordHash;
+  using FileOffset = long;
+
+  // NB: the file is shared by map copies (e.g. snapshots read
+  //     by other threads), a slot is written only when it is free
+  struct BackingFile {
+    BackingFile() : file{std::tmpfile()} {}
+    BackingFile(const BackingFile&) = delete;
+    BackingFile& operator=(const BackingFile&) = delete;
+    ~BackingFile() { if (file) { std::fclose(file); } }
+
+    std::FILE *file;
+    std::mutex mutex;
+    // offsets of free slots by their capacities (in bytes)
+    std::multimap<uint64_t, FileOffset> free_slots;
+    FileOffset end = 0;
+  };
+
+  // The place of an evicted tile in the backing file; it is shared by
+  // map copies and becomes free when the last of them drops it.
+  struct FileSlot {
+    FileSlot(std::shared_ptr<BackingFile> backing_file,
+             FileOffset slot_offset, uint64_t slot_capacity)
+      : file{std::move(backing_file)}
+      , offset{slot_offset}, capacity{slot_capacity} {}
+    FileSlot(const FileSlot&) = delete;
+    FileSlot& operator=(const FileSlot&) = delete;
+    ~FileSlot() {
+      std::lock_guard<std::mutex> lock{file->mutex};
+      file->free_slots.emplace(capacity, offset);
+    }
+
+    std::shared_ptr<BackingFile> file;
+    FileOffset offset;
+    uint64_t capacity;
+  };
+  using SlotPtr = std::shared_ptr<const FileSlot>;
+public: // types
+  using typename Base::Coord;
+public: // consts
+  static constexpr unsigned Default_Resident_Tiles_Budget = 256;
+public:
+  GenericOutOfCoreTiledGridMap(
+      std::shared_ptr<GridCell> prototype,
+      const GridMapParams& params = MapValues::gmp,
+      unsigned resident_tiles_budget = Default_Resident_Tiles_Budget)
+    : Base{prototype, params}
+    , _resident_tiles_budget{std::max(1u, resident_tiles_budget)}
+    , _backing_file{std::make_shared<BackingFile>()} {
+    if (!_backing_file->file) {
+      throw std::runtime_error{"Unable to create a tiles backing file"};
+    }
+  }
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    ensure_resident(area_id);
+    Base::update(area_id, aoo);
+    evict_cold_tiles(); // the update may allocate a tile
+  }
+
+  void reset(const Coord &area_id, const GridCell &new_area) override {
+    ensure_resident(area_id);
+    Base::reset(area_id, new_area);
+    evict_cold_tiles();
+  }
+
+  const GridCell &operator[](const Coord& area_id) const override {
+    ensure_resident(area_id);
+    return Base::operator[](area_id);
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    ensure_resident(area_id);
+    return Base::discrepancy(area_id, aoo);
+  }
+
+  bool load_state(const std::vector<char> &data) override {
+    if (!Base::load_state(data)) { return false; }
+    auto header = TiledMapCheckpoint::Header{};
+    std::size_t pos = 0;
+    TiledMapCheckpoint::read_header(data, header, pos);
+
+    // loaded tiles supersede evicted ones
+    if (!header.is_delta) { _evicted_tiles.clear(); }
+    for (auto &tile : this->tiles()) {
+      _evicted_tiles.erase(tile.first);
+      _access_stamps[tile.first] = ++_access_clock;
+    }
+    _has_recent_tile = false;
+    evict_cold_tiles();
+    return true;
+  }
+
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericOutOfCoreTiledGridMap>(*this);
+  }
+
+  // tiles are paged in on reads
+  bool supports_concurrent_reads() const override { return false; }
+
+  unsigned resident_tiles_budget() const { return _resident_tiles_budget; }
+  std::size_t evicted_tiles_nm() const { return _evicted_tiles.size(); }
+
+  // The size of the backing file (shared by copies of the map)
+  std::size_t backing_file_bytes() const {
+    std::lock_guard<std::mutex> lock{_backing_file->mutex};
+    return std::size_t(_backing_file->end);
+  }
+
+  // Whether tiles are kept in memory since the file can't be written
+  bool is_eviction_failed() const { return _is_eviction_failed; }
+
+  // NB: evicted tiles are in the backing file, only their index is counted
+  GridMapMemoryUsage memory_usage() const override {
+    auto usage = Base::memory_usage();
+    usage.add_overhead(Base::hash_table_bytes(_evicted_tiles) +
+                       Base::hash_table_bytes(_access_stamps));
+    return usage;
+  }
+
+protected: // methods
+
+  std::vector<Coord> stored_tile_coords() const override {
+    auto coords = Base::stored_tile_coords();
+    for (auto &tile : _evicted_tiles) { coords.push_back(tile.first); }
+    return coords;
+  }
+
+  // NB: evicted tiles are read without paging in
+  std::shared_ptr<const Tile> stored_tile(const Coord &tc) const override {
+    auto evicted_it = _evicted_tiles.find(tc);
+    if (evicted_it == _evicted_tiles.end()) {
+      return Base::stored_tile(tc);
+    }
+    auto tile = std::make_shared<Tile>(*this->unknown_cell());
+    read_tile(*evicted_it->second, *tile);
+    return tile;
+  }
+
+private: // methods
+
+  // NB: paging is an implementation detail, so it is logically const
+  void ensure_resident(const Coord &area_id) const {
+    auto tc = Base::tile_coord(area_id);
+    // PERFORMANCE: consecutive accesses mostly hit the same tile
+    if (_has_recent_tile && tc == _recent_tile) { return; }
+
+    auto &mutable_this = const_cast<GenericOutOfCoreTiledGridMap&>(*this);
+    mutable_this.touch(tc);
+    mutable_this.page_in(tc);
+    mutable_this.evict_cold_tiles();
+  }
+
+  void touch(const Coord &tc) {
+    _has_recent_tile = true;
+    _recent_tile = tc;
+    _access_stamps[tc] = ++_access_clock;
+  }
+
+  void page_in(const Coord &tc) {
+    auto evicted_it = _evicted_tiles.find(tc);
+    if (evicted_it == _evicted_tiles.end()) { return; }
+
+    auto tile = std::make_shared<Tile>(*this->unknown_cell());
+    read_tile(*evicted_it->second, *tile);
+    // NB: the slot is free unless a map copy refers to it
+    _evicted_tiles.erase(evicted_it);
+    this->attach_tile(tc, std::move(tile));
+  }
+
+  // Evicts the coldest tiles in a batch to amortize the recency sort.
+  void evict_cold_tiles() {
+    if (_is_eviction_failed ||
+        this->known_tiles_nm() <= _resident_tiles_budget) {
+      return;
+    }
+
+    auto resident = std::vector<std::pair<uint64_t, Coord>>{};
+    resident.reserve(this->tiles().size());
+    for (auto &tile : this->tiles()) {
+      auto stamp_it = _access_stamps.find(tile.first);
+      assert(stamp_it != _access_stamps.end());
+      resident.emplace_back(stamp_it->second, tile.first);
+    }
+    // stamps of non-resident tiles are dropped, they are set on paging in
+    for (auto it = _access_stamps.begin(); it != _access_stamps.end();) {
+      bool is_kept = (_has_recent_tile && it->first == _recent_tile) ||
+                     this->tiles().count(it->first);
+      it = is_kept ? std::next(it) : _access_stamps.erase(it);
+    }
+
+    auto target_nm = _resident_tiles_budget - _resident_tiles_budget / 4;
+    auto evicted_nm = resident.size() - std::max(1u, target_nm);
+    std::nth_element(resident.begin(), resident.begin() + evicted_nm,
+                     resident.end(),
+                     [](const std::pair<uint64_t, Coord> &a,
+                        const std::pair<uint64_t, Coord> &b) {
+                       return a.first < b.first;
+                     });
+    for (unsigned i = 0; i < evicted_nm; ++i) {
+      auto &tc = resident[i].second;
+      assert(!_has_recent_tile || tc != _recent_tile);
+      auto slot = write_tile(*this->tiles().at(tc));
+      if (!slot) {
+        // NB: the failure is reported by users (see is_eviction_failed)
+        _is_eviction_failed = true;
+        return;
+      }
+      this->detach_tile(tc);
+      _evicted_tiles[tc] = std::move(slot);
+    }
+  }
+
+  // Writes the tile to a free slot that fits it or to the end of the file;
+  // returns nullptr on a failure.
+  SlotPtr write_tile(const Tile &tile) {
+    auto data = this->serialize_tile(tile);
+    uint64_t data_size = data.size();
+    auto slot_size = sizeof(data_size) + data_size;
+
+    std::lock_guard<std::mutex> lock{_backing_file->mutex};
+    auto &free_slots = _backing_file->free_slots;
+    auto free_it = free_slots.lower_bound(slot_size);
+    auto is_reused = free_it != free_slots.end();
+    FileOffset offset = is_reused ? free_it->second : _backing_file->end;
+    uint64_t capacity = is_reused ? free_it->first : slot_size;
+
+    auto file = _backing_file->file;
+    auto is_written =
+      std::fseek(file, offset, SEEK_SET) == 0 &&
+      std::fwrite(&data_size, sizeof(data_size), 1, file) == 1 &&
+      std::fwrite(data.data(), 1, data.size(), file) == data.size() &&
+      std::fflush(file) == 0;
+    if (!is_written) {
+      std::clearerr(file);
+      return nullptr;
+    }
+
+    if (is_reused) {
+      free_slots.erase(free_it);
+    } else {
+      _backing_file->end += FileOffset(slot_size);
+    }
+    return std::make_shared<const FileSlot>(_backing_file, offset, capacity);
+  }
+
+  void read_tile(const FileSlot &slot, Tile &tile) const {
+    uint64_t data_size = 0;
+    auto data = std::vector<char>{};
+    {
+      std::lock_guard<std::mutex> lock{_backing_file->mutex};
+      auto file = _backing_file->file;
+      auto is_read =
+        std::fseek(file, slot.offset, SEEK_SET) == 0 &&
+        std::fread(&data_size, sizeof(data_size), 1, file) == 1 &&
+        sizeof(data_size) + data_size <= slot.capacity;
+      if (is_read) {
+        data.resize(data_size);
+        is_read = std::fread(data.data(), 1, data.size(), file) == data_size;
+      }
+      if (!is_read) {
+        std::clearerr(file);
+        throw std::runtime_error{"Unable to read an evicted map tile"};
+      }
+    }
+
+    this->deserialize_tile(data, 0, tile);
+  }
+
+private: // fields
+  unsigned _resident_tiles_budget;
+  std::shared_ptr<BackingFile> _backing_file;
+  std::unordered_map<Coord, SlotPtr, TileCoordHash> _evicted_tiles;
+  std::unordered_map<Coord, uint64_t, TileCoordHash> _access_stamps;
+  uint64_t _access_clock = 0;
+  bool _has_recent_tile = false;
+  Coord _recent_tile;
+  bool _is_eviction_failed = false;
+};
+
+template <typename CellStorage, unsigned TileSizeBits, typename TileLayout>
+constexpr unsigned GenericOutOfCoreTiledGridMap<
+  CellStorage, TileSizeBits, TileLayout>::Default_Resident_Tiles_Budget;
+
+using OutOfCoreTiledGridMap =
+  GenericOutOfCoreTiledGridMap<PolymorphicCellStorage>;
+
+template <typename CellT, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+using ValueOutOfCoreTiledGridMap = GenericOutOfCoreTiledGridMap<
+  ValueCellStorage<CellT>, TileSizeBits, TileLayout>;
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SLAM_CTOR_CORE_PACKED_TBM_CELL_CODEC_H
+#define SLAM_CTOR_CORE_PACKED_TBM_CELL_CODEC_H
+
+#include <type_traits>
+
+#include "quantized_cell_storage.h"
+#include "transferable_belief_model.h"
+
+/* A codec (see QuantizedCellStorage) for cells that keep a belief (TBM)
+ * with normalized conflict (e.g. VinyDSCell, CredibilistCell).
+ * Only unknown/empty/occupied masses are stored (the conflict mass is 0),
+ * the occupancy is derived from the belief by the cell constructor.
+ * Mass is either a floating point type or an unsigned integer one
+ * (a fixed point mass, see UnitFixedPoint).
+ * NB: the cell type must be constructible from a TBM. */
+template <typename CellT, typename Mass = float>
+struct PackedTBMCellCodec {
+  using Cell = CellT;
+  struct Packed {
+    Mass unknown, empty, occupied;
+  };
+
+  static Packed encode(const Cell &c) {
+    const auto &b = c.belief();
+    return {encode_mass(b.unknown()), encode_mass(b.empty()),
+            encode_mass(b.occupied())};
+  }
+
+  static Cell decode(const Packed &p) {
+    return Cell{TBM{decode_mass(p.unknown), decode_mass(p.empty),
+                    decode_mass(p.occupied), 0.0}};
+  }
+
+private:
+  using Is_Floating = std::is_floating_point<Mass>;
+
+  static Mass encode_mass(double m) { return encode_mass(m, Is_Floating{}); }
+  static Mass encode_mass(double m, std::true_type) { return Mass(m); }
+  static Mass encode_mass(double m, std::false_type) {
+    return UnitFixedPoint<Mass>::encode(m);
+  }
+
+  static double decode_mass(Mass m) { return decode_mass(m, Is_Floating{}); }
+  static double decode_mass(Mass m, std::true_type) { return m; }
+  static double decode_mass(Mass m, std::false_type) {
+    return UnitFixedPoint<Mass>::decode(m);
+  }
+};
+
+#endif
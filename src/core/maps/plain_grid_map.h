@@ -5,22 +5,63 @@
 #include <vector>
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <string>
+#include <tuple>
 #include <algorithm>
+#include <type_traits>
 
 #include "grid_map.h"
+#include "grid_cell_storages.h"
+#include "grid_map_snapshot.h"
+#include "../trace_recorder.h"
 
-class PlainGridMap : public GridMap {
+/* Bounded implementation */
+
+template <typename CellStorage>
+class GenericPlainGridMap : public GridMap {
+protected: // types
+  using Cells = std::vector<typename CellStorage::Element>;
 public:
-  // TODO: cp, mv ctors, dtor
-  PlainGridMap(std::shared_ptr<GridCell> prototype,
-               const GridMapParams& params = MapValues::gmp)
-    : GridMap{prototype, params}, _cells(GridMap::height()) {
-    for (auto &row : _cells) {
-      row.reserve(GridMap::width());
-      for (int i = 0; i < GridMap::width(); i++) {
-        row.push_back(prototype->clone());
-      }
-    }
+  // TODO: mv ctors, dtor
+  GenericPlainGridMap(std::shared_ptr<GridCell> prototype,
+                      const GridMapParams& params = MapValues::gmp)
+    : GridMap{prototype, params}
+    , _cells_stride{GridMap::width()}, _cells_offset{0, 0} {
+    _cells.reserve(GridMap::width() * GridMap::height());
+    std::generate_n(std::back_inserter(_cells),
+                    GridMap::width() * GridMap::height(),
+                    [&prototype](){ return CellStorage::make(*prototype); });
+  }
+
+  GenericPlainGridMap(const GenericPlainGridMap &that)
+    : GridMap{that}
+    , _cells_stride{that._cells_stride}, _cells_offset{that._cells_offset} {
+    _cells.reserve(that._cells.size());
+    std::transform(that._cells.begin(), that._cells.end(),
+                   std::back_inserter(_cells), &CellStorage::copy);
+  }
+
+  // NB: a deep copy of cells
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericPlainGridMap>(*this);
+  }
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    CellStorage::update(element_internal(external2internal(area_id)), aoo);
+    this->on_area_modified(area_id);
+  }
+
+  void reset(const Coord &area_id, const GridCell &new_area) override {
+    CellStorage::reset(element_internal(external2internal(area_id)),
+                       new_area);
+    this->on_area_modified(area_id);
+  }
+
+  void merge(const Coord &area_id, const GridCell &that) override {
+    CellStorage::merge(element_internal(external2internal(area_id)), that);
+    this->on_area_modified(area_id);
   }
 
   const GridCell &operator[](const Coord& c) const override {
@@ -29,109 +70,326 @@ public:
     return cell_internal(coord);
   }
 
-protected: // fields
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    auto coord = external2internal(area_id);
+    assert(has_internal_cell(coord));
+    return CellStorage::discrepancy(_cells[cell_index(coord)], aoo);
+  }
+
+  void row_discrepancies(const Coord &area_id, int areas_nm,
+                         const AreaOccupancyObservation &aoo,
+                         double *discrepancies) const override {
+    auto ic = external2internal(area_id);
+    // NB: areas outside of the map are handled by a descendant (if any)
+    int begin = std::max(0, -ic.x);
+    int end = std::min(areas_nm, this->width() - ic.x);
+    if (ic.y < 0 || this->height() <= ic.y || end <= begin) {
+      GridMap::row_discrepancies(area_id, areas_nm, aoo, discrepancies);
+      return;
+    }
+
+    GridMap::row_discrepancies(area_id, begin, aoo, discrepancies);
+    auto row = &_cells[cell_index({ic.x + begin, ic.y})];
+    CellStorage::discrepancies(row, end - begin, aoo, discrepancies + begin);
+    GridMap::row_discrepancies({area_id.x + end, area_id.y}, areas_nm - end,
+                               aoo, discrepancies + end);
+  }
+
+  void row_occupancies(const Coord &area_id, int areas_nm,
+                       double *probs) const override {
+    auto ic = external2internal(area_id);
+    int begin = std::max(0, -ic.x);
+    int end = std::min(areas_nm, this->width() - ic.x);
+    if (ic.y < 0 || this->height() <= ic.y || end <= begin) {
+      GridMap::row_occupancies(area_id, areas_nm, probs);
+      return;
+    }
+
+    GridMap::row_occupancies(area_id, begin, probs);
+    auto row = &_cells[cell_index({ic.x + begin, ic.y})];
+    CellStorage::occupancies(row, end - begin, probs + begin);
+    GridMap::row_occupancies({area_id.x + end, area_id.y}, areas_nm - end,
+                             probs + end);
+  }
+
+  // PERFORMANCE: the part of the row inside the map is a contiguous
+  //              run of cells, its bounds are reported as modified.
+  void update_row(const Coord &area_id, int areas_nm,
+                  const AreaOccupancyObservation *aoos) override {
+    int begin = 0, end = 0;
+    if (!row_span(area_id, areas_nm, begin, end)) {
+      GridMap::update_row(area_id, areas_nm, aoos);
+      return;
+    }
+
+    GridMap::update_row(area_id, begin, aoos);
+    auto ic = external2internal(area_id);
+    auto row = &_cells[cell_index({ic.x + begin, ic.y})];
+    for (int i = begin; i < end; ++i) {
+      CellStorage::update(row[i - begin], aoos[i]);
+    }
+    on_row_modified(area_id, begin, end);
+    GridMap::update_row({area_id.x + end, area_id.y}, areas_nm - end,
+                        aoos + end);
+  }
+
+  void reset_row(const Coord &area_id, int areas_nm,
+                 const GridCell &new_area) override {
+    int begin = 0, end = 0;
+    if (!row_span(area_id, areas_nm, begin, end)) {
+      GridMap::reset_row(area_id, areas_nm, new_area);
+      return;
+    }
+
+    GridMap::reset_row(area_id, begin, new_area);
+    auto ic = external2internal(area_id);
+    auto row = &_cells[cell_index({ic.x + begin, ic.y})];
+    for (int i = begin; i < end; ++i) {
+      CellStorage::reset(row[i - begin], new_area);
+    }
+    on_row_modified(area_id, begin, end);
+    GridMap::reset_row({area_id.x + end, area_id.y}, areas_nm - end,
+                       new_area);
+  }
+
+  GridTraversalOrder traversal_order() const override {
+    return GridTraversalOrder::Row_Major;
+  }
+
+  // NB: cells of the buffer outside of the map (e.g. the headroom
+  //     of the unbounded map) are an overhead
+  GridMapMemoryUsage memory_usage() const override {
+    using Element = typename CellStorage::Element;
+    auto element_bytes = sizeof(Element) +
+                         CellStorage::heap_bytes(*cell_prototype());
+    auto map_cells_nm = std::size_t(this->width()) * this->height();
+    auto usage = GridMapMemoryUsage{};
+    usage.add_cells(map_cells_nm * element_bytes);
+    usage.add_overhead((_cells.size() - map_cells_nm) * element_bytes +
+                       (_cells.capacity() - _cells.size()) * sizeof(Element));
+    return usage;
+  }
+
+protected: // methods
+
+  // NB: cells are stored in a row-major order,
+  //     the map may occupy a part of the buffer (see the unbounded map)
+  std::size_t cell_index(const Coord& ic) const {
+    return (ic.y + _cells_offset.y) * _cells_stride + ic.x + _cells_offset.x;
+  }
 
   const GridCell& cell_internal(const Coord& ic) const {
-    return *_cells[ic.y][ic.x];
+    return CellStorage::cell(_cells[cell_index(ic)]);
+  }
+
+  // The span [begin; end) of the row of areas_nm areas that starts
+  // at area_id that is inside the map; false if there is no such span.
+  bool row_span(const Coord &area_id, int areas_nm,
+                int &begin, int &end) const {
+    auto ic = external2internal(area_id);
+    begin = std::max(0, -ic.x);
+    end = std::min(areas_nm, this->width() - ic.x);
+    return 0 <= ic.y && ic.y < this->height() && begin < end;
+  }
+
+  void on_row_modified(const Coord &area_id, int begin, int end) {
+    this->on_area_modified({area_id.x + begin, area_id.y});
+    this->on_area_modified({area_id.x + end - 1, area_id.y});
   }
 
-  std::vector<std::vector<std::unique_ptr<GridCell>>> _cells;
+  typename CellStorage::Element &element_internal(const Coord& ic) {
+    assert(has_internal_cell(ic));
+    return _cells[cell_index(ic)];
+  }
+
+protected: // fields
+  Cells _cells;
+  int _cells_stride;
+  Coord _cells_offset;
 };
 
 /* Unbounded implementation */
 
-class UnboundedPlainGridMap : public PlainGridMap {
+template <typename CellStorage>
+class GenericUnboundedPlainGridMap : public GenericPlainGridMap<CellStorage> {
+private: // types
+  using Base = GenericPlainGridMap<CellStorage>;
+  using typename Base::Cells;
+public:
+  using typename Base::Coord;
 private: // fields
   static constexpr double Expansion_Rate = 1.2;
+  // the reserved storage around the map (in map's sizes)
+  static constexpr double Growth_Side_Headroom = 0.5;
+  static constexpr double Idle_Side_Headroom = 0.1;
 public: // methods
-  UnboundedPlainGridMap(std::shared_ptr<GridCell> prototype,
-                        const GridMapParams &params = MapValues::gmp)
-    : PlainGridMap{prototype, params}
+  GenericUnboundedPlainGridMap(std::shared_ptr<GridCell> prototype,
+                               const GridMapParams &params = MapValues::gmp)
+    : Base{prototype, params}
     , _origin{GridMap::origin()}, _unknown_cell{prototype->clone()} {}
 
   void update(const Coord &area_id,
               const AreaOccupancyObservation &aoo) override {
     ensure_inside(area_id);
-    PlainGridMap::update(area_id, aoo);
+    Base::update(area_id, aoo);
   }
 
   void reset(const Coord &area_id, const GridCell &new_area) override {
     ensure_inside(area_id);
-    PlainGridMap::reset(area_id, new_area);
+    Base::reset(area_id, new_area);
+  }
+
+  void merge(const Coord &area_id, const GridCell &that) override {
+    ensure_inside(area_id);
+    Base::merge(area_id, that);
+  }
+
+  // NB: the map is expanded to the area with a single reallocation
+  void reserve_area(const Coord &min, const Coord &max) override {
+    ensure_inside(min, max);
+  }
+
+  void update_row(const Coord &area_id, int areas_nm,
+                  const AreaOccupancyObservation *aoos) override {
+    if (areas_nm <= 0) { return; }
+    ensure_inside(area_id, {area_id.x + areas_nm - 1, area_id.y});
+    Base::update_row(area_id, areas_nm, aoos);
+  }
+
+  void reset_row(const Coord &area_id, int areas_nm,
+                 const GridCell &new_area) override {
+    if (areas_nm <= 0) { return; }
+    ensure_inside(area_id, {area_id.x + areas_nm - 1, area_id.y});
+    Base::reset_row(area_id, areas_nm, new_area);
   }
 
   const GridCell &operator[](const Coord& ec) const override {
-    auto ic = external2internal(ec);
-    if (!PlainGridMap::has_internal_cell(ic)) { return *_unknown_cell; }
-    return PlainGridMap::cell_internal(ic);
+    auto ic = this->external2internal(ec);
+    if (!Base::has_internal_cell(ic)) { return *_unknown_cell; }
+    return Base::cell_internal(ic);
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    auto ic = this->external2internal(area_id);
+    if (!Base::has_internal_cell(ic)) {
+      return _unknown_cell->discrepancy(aoo);
+    }
+    return CellStorage::discrepancy(this->_cells[this->cell_index(ic)], aoo);
   }
 
   Coord origin() const override { return _origin; }
 
   bool has_cell(const Coord &) const override { return true; }
 
+  // NB: a deep copy of cells
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericUnboundedPlainGridMap>(*this);
+  }
+
   std::vector<char> save_state() const override {
-    auto w = width(), h = height();
+    auto w = this->width(), h = this->height();
     size_t map_size_bytes = w * h * _unknown_cell->serialize().size();
 
     Serializer s(sizeof(GridMapParams) + sizeof(Coord) + map_size_bytes);
-    s << h << w << scale() << origin().x << origin().y;
+    s << h << w << this->scale() << origin().x << origin().y;
 
     Serializer ms(map_size_bytes);
-    for (auto &row : _cells) {
-      for (auto &cell : row) {
-        ms.append(cell->serialize());
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        ms.append(Base::cell_internal({x, y}).serialize());
       }
     }
   #ifdef COMPRESSED_SERIALIZATION
-    s.append(ms.compressed());
+    s.append(ms.compressed_chunks());
   #else
     s.append(ms.result());
   #endif
     return s.result();
   }
 
-  void load_state(const std::vector<char>& data) override {
-    decltype(width()) w, h;
-    decltype(scale()) s;
+  // NB: a truncated state or one of another cell type is rejected
+  //     (the map is kept).
+  bool load_state(const std::vector<char>& data) override {
+    decltype(this->width()) w = 0, h = 0;
+    decltype(this->scale()) s = 0;
+    auto origin = Coord{0, 0};
 
     Deserializer d(data);
-    d >> h >> w >> s >> _origin.x >> _origin.y;
-
-    set_width(w);
-    set_height(h);
-    set_scale(s);
+    d >> h >> w >> s >> origin.x >> origin.y;
+    if (d.is_overrun() || w < 0 || h < 0 || !(0 < s)) { return false; }
   #ifdef COMPRESSED_SERIALIZATION
-    std::vector<char> map_data = Deserializer::decompress(
-        data.data() + d.pos(), data.size() - d.pos(),
-        w * h * _unknown_cell->serialize().size());
+    std::vector<char> map_data = Deserializer::decompress_chunks(
+        data.data() + d.pos(), data.size() - d.pos());
     size_t pos = 0;
   #else
     const std::vector<char> &map_data = data;
     size_t pos = d.pos();
   #endif
-    _cells.clear();
-    _cells.resize(h);
-    for (auto &row : _cells) {
-      row.reserve(w);
-      for (int i = 0; i < w; ++i) {
-        auto cell = new_cell();
-        pos = cell->deserialize(map_data, pos);
-        row.push_back(std::move(cell));
-      }
+    std::size_t cells_nm = std::size_t(w) * h;
+    auto cell = _unknown_cell->clone();
+    auto cell_size = cell->serialize().size();
+    if (cell_size != 0 && (map_data.size() - pos) / cell_size < cells_nm) {
+      return false;
     }
+    auto cells = decltype(this->_cells){};
+    cells.reserve(cells_nm);
+    for (std::size_t i = 0; i < cells_nm; ++i) {
+      pos = cell->deserialize(map_data, pos);
+      cells.push_back(CellStorage::make(*cell));
+    }
+    if (pos != map_data.size()) { return false; }
+
+    this->set_width(w);
+    this->set_height(h);
+    this->set_scale(s);
+    _origin = origin;
+    this->_cells = std::move(cells);
+    this->_cells_stride = w;
+    this->_cells_offset = Coord{0, 0};
+    this->forget_modifications();
+    return true;
+  }
+
+  // Snapshots are a faster alternative of save_state/load_state
+  // that are stored to files (see grid_map_snapshot.h).
+  bool save_snapshot(const std::string &path) const {
+    return write_grid_map_snapshot(path, make_snapshot(Has_Raw_Elements{}));
+  }
+
+  bool load_snapshot(const std::string &path) {
+    const MappedFile snapshot{path};
+    if (!snapshot.is_valid() ||
+        snapshot.size() < sizeof(GridMapSnapshotHeader)) {
+      return false;
+    }
+    GridMapSnapshotHeader header;
+    std::memcpy(&header, snapshot.data(), sizeof(header));
+    return load_snapshot(header, snapshot.data() + sizeof(header),
+                         snapshot.size(), Has_Raw_Elements{});
   }
 
 protected: // methods
 
-  bool ensure_inside(const Coord &c) {
-    auto coord = external2internal(c);
-    if (PlainGridMap::has_internal_cell(coord)) return false;
+  bool ensure_inside(const Coord &c) { return ensure_inside(c, c); }
+
+  // Expands the map to the rectangle (bounds are inclusive)
+  bool ensure_inside(const Coord &min, const Coord &max) {
+    auto min_coord = this->external2internal(min);
+    auto max_coord = this->external2internal(max);
+    if (Base::has_internal_cell(min_coord) &&
+        Base::has_internal_cell(max_coord)) {
+      return false;
+    }
+    TraceScope trace{"ensure_inside", "map"};
 
-    unsigned w = width(), h = height();
+    unsigned w = this->width(), h = this->height();
     unsigned prep_x = 0, app_x = 0, prep_y = 0, app_y = 0;
-    std::tie(prep_x, app_x) = determine_cells_nm(0, coord.x, w);
-    std::tie(prep_y, app_y) = determine_cells_nm(0, coord.y, h);
+    std::tie(prep_x, std::ignore) = determine_cells_nm(0, min_coord.x, w);
+    std::tie(std::ignore, app_x) = determine_cells_nm(0, max_coord.x, w);
+    std::tie(prep_y, std::ignore) = determine_cells_nm(0, min_coord.y, h);
+    std::tie(std::ignore, app_y) = determine_cells_nm(0, max_coord.y, h);
 
     unsigned new_w = prep_x + w + app_x, new_h = prep_y + h + app_y;
     #define UPDATE_DIM(dim, elem)                                    \
@@ -146,26 +404,165 @@ protected: // methods
     UPDATE_DIM(h, y);
     #undef UPDATE_DIM
 
-    // PERFORMANCE: _cells can be reused
-    std::vector<std::vector<std::unique_ptr<GridCell>>> new_cells{new_h};
-    for (size_t y = 0; y != new_h; ++y) {
-      std::generate_n(std::back_inserter(new_cells[y]), new_w,
-                      [this](){ return this->_unknown_cell->clone(); });
-      if (y < prep_y || prep_y + h <= y) { continue; }
-
-      std::move(_cells[y - prep_y].begin(), _cells[y - prep_y].end(),
-                &new_cells[y][prep_x]);
+    if (!fits_cells_buffer(prep_x, prep_y, new_w, new_h)) {
+      reallocate_cells(prep_x, app_x, prep_y, app_y, new_w, new_h);
     }
+    // NB: the headroom is filled with unknown cells, so the map
+    //     is expanded by an offset update
+    this->_cells_offset += Coord(-int(prep_x), -int(prep_y));
 
-    std::swap(_cells, new_cells);
-    set_height(new_h);
-    set_width(new_w);
+    this->set_height(new_h);
+    this->set_width(new_w);
     _origin += Coord(prep_x, prep_y);
 
-    assert(PlainGridMap::has_cell(c));
+    assert(Base::has_cell(min) && Base::has_cell(max));
+    return true;
+  }
+
+  bool fits_cells_buffer(unsigned prep_x, unsigned prep_y,
+                         unsigned new_w, unsigned new_h) const {
+    int stride = this->_cells_stride;
+    int buffer_h = stride ? this->_cells.size() / stride : 0;
+    auto &offset = this->_cells_offset;
+    return int(prep_x) <= offset.x && int(prep_y) <= offset.y &&
+           offset.x - int(prep_x) + int(new_w) <= stride &&
+           offset.y - int(prep_y) + int(new_h) <= buffer_h;
+  }
+
+  // Allocates a buffer with headroom around the expanded map;
+  // a side the map grows to gets more space, so growth is amortized.
+  void reallocate_cells(unsigned prep_x, unsigned app_x,
+                        unsigned prep_y, unsigned app_y,
+                        unsigned new_w, unsigned new_h) {
+    auto headroom = [](unsigned extra_nm, unsigned dim) -> unsigned {
+      return dim * (extra_nm ? Growth_Side_Headroom : Idle_Side_Headroom);
+    };
+    unsigned pad_l = headroom(prep_x, new_w), pad_r = headroom(app_x, new_w);
+    unsigned pad_b = headroom(prep_y, new_h), pad_t = headroom(app_y, new_h);
+    unsigned cap_w = pad_l + new_w + pad_r, cap_h = pad_b + new_h + pad_t;
+
+    Cells new_cells;
+    new_cells.reserve(cap_w * cap_h);
+    std::generate_n(std::back_inserter(new_cells), cap_w * cap_h,
+                    [this](){ return CellStorage::make(*_unknown_cell); });
+    int w = this->width(), h = this->height();
+    for (int y = 0; y != h; ++y) {
+      auto row_begin = this->_cells.begin() + Base::cell_index({0, y});
+      auto new_row_begin = (pad_b + prep_y + y) * cap_w + pad_l + prep_x;
+      std::move(row_begin, row_begin + w, new_cells.begin() + new_row_begin);
+    }
+
+    std::swap(this->_cells, new_cells);
+    this->_cells_stride = cap_w;
+    // the offset of the current (not expanded) map
+    this->_cells_offset = Coord(pad_l + prep_x, pad_b + prep_y);
+  }
+
+  //----------------------------------------------------------------------------
+  // Snapshots
+
+  using Element = typename CellStorage::Element;
+  using Has_Raw_Elements = std::integral_constant<
+    bool, std::is_trivially_copyable<Element>::value>;
+  using PayloadFormat = GridMapSnapshotHeader::PayloadFormat;
+
+  GridMapSnapshotHeader snapshot_header(PayloadFormat format,
+                                        uint32_t element_size) const {
+    auto header = GridMapSnapshotHeader{};
+    header.payload_format = format;
+    header.element_size = element_size;
+    header.width = this->width();
+    header.height = this->height();
+    header.origin_x = origin().x;
+    header.origin_y = origin().y;
+    header.scale = this->scale();
+    header.payload_size = 0;
+    return header;
+  }
+
+  std::vector<char> make_snapshot(std::true_type /*raw elements*/) const {
+    auto header = snapshot_header(PayloadFormat::Raw_Elements,
+                                  sizeof(Element));
+    std::size_t row_size = header.width * sizeof(Element);
+    header.payload_size = row_size * header.height;
+
+    auto snapshot = std::vector<char>(sizeof(header) + header.payload_size);
+    std::memcpy(snapshot.data(), &header, sizeof(header));
+    char *payload = snapshot.data() + sizeof(header);
+    for (int y = 0; y < header.height; ++y) {
+      std::memcpy(payload + y * row_size,
+                  &this->_cells[Base::cell_index({0, y})], row_size);
+    }
+    return snapshot;
+  }
+
+  // NB: each cell serialization allocates its own buffer
+  std::vector<char> make_snapshot(std::false_type /*raw elements*/) const {
+    auto header = snapshot_header(PayloadFormat::Serialized_Cells,
+                                  _unknown_cell->serialize().size());
+    header.payload_size = std::size_t(header.width) * header.height *
+                          header.element_size;
+
+    auto snapshot = std::vector<char>(sizeof(header));
+    snapshot.reserve(sizeof(header) + header.payload_size);
+    std::memcpy(snapshot.data(), &header, sizeof(header));
+    for (int y = 0; y < header.height; ++y) {
+      for (int x = 0; x < header.width; ++x) {
+        auto cell_data = Base::cell_internal({x, y}).serialize();
+        snapshot.insert(snapshot.end(), cell_data.begin(), cell_data.end());
+      }
+    }
+    assert(snapshot.size() == sizeof(header) + header.payload_size);
+    return snapshot;
+  }
+
+  bool load_snapshot(const GridMapSnapshotHeader &header, const char *payload,
+                     std::size_t snapshot_size, std::true_type) {
+    std::size_t cells_nm = std::size_t(header.width) * header.height;
+    if (!header.is_compatible(PayloadFormat::Raw_Elements, sizeof(Element),
+                              snapshot_size) ||
+        header.payload_size != cells_nm * sizeof(Element)) {
+      return false;
+    }
+
+    auto elements = reinterpret_cast<const Element *>(payload);
+    this->_cells.assign(elements, elements + cells_nm);
+    apply_snapshot_geometry(header);
     return true;
   }
 
+  bool load_snapshot(const GridMapSnapshotHeader &header, const char *payload,
+                     std::size_t snapshot_size, std::false_type) {
+    std::size_t cells_nm = std::size_t(header.width) * header.height;
+    auto cell = _unknown_cell->clone();
+    if (!header.is_compatible(PayloadFormat::Serialized_Cells,
+                              cell->serialize().size(), snapshot_size) ||
+        header.payload_size != cells_nm * header.element_size) {
+      return false;
+    }
+
+    auto data = std::vector<char>(payload, payload + header.payload_size);
+    this->_cells.clear();
+    this->_cells.reserve(cells_nm);
+    std::size_t pos = 0;
+    for (std::size_t i = 0; i < cells_nm; ++i) {
+      pos = cell->deserialize(data, pos);
+      this->_cells.push_back(CellStorage::make(*cell));
+    }
+    apply_snapshot_geometry(header);
+    return true;
+  }
+
+  void apply_snapshot_geometry(const GridMapSnapshotHeader &header) {
+    this->set_width(header.width);
+    this->set_height(header.height);
+    this->set_scale(header.scale);
+    _origin = Coord{header.origin_x, header.origin_y};
+    this->_cells_stride = header.width;
+    this->_cells_offset = Coord{0, 0};
+    this->forget_modifications();
+  }
+
   std::tuple<unsigned, unsigned> determine_cells_nm(
     int min, int val, int max) const {
     assert(min <= max);
@@ -183,4 +580,24 @@ private: // fields
   std::shared_ptr<GridCell> _unknown_cell;
 };
 
+template <typename CellStorage>
+constexpr double GenericUnboundedPlainGridMap<CellStorage>::Expansion_Rate;
+template <typename CellStorage>
+constexpr double
+GenericUnboundedPlainGridMap<CellStorage>::Growth_Side_Headroom;
+template <typename CellStorage>
+constexpr double
+GenericUnboundedPlainGridMap<CellStorage>::Idle_Side_Headroom;
+
+using PlainGridMap = GenericPlainGridMap<PolymorphicCellStorage>;
+using UnboundedPlainGridMap =
+  GenericUnboundedPlainGridMap<PolymorphicCellStorage>;
+
+// Plain maps that keep cells of a known type contiguously
+template <typename CellT>
+using ContiguousPlainGridMap = GenericPlainGridMap<ValueCellStorage<CellT>>;
+template <typename CellT>
+using UnboundedContiguousPlainGridMap =
+  GenericUnboundedPlainGridMap<ValueCellStorage<CellT>>;
+
 #endif
@@ -0,0 +1,122 @@
+#ifndef SLAM_CTOR_CORE_QUANTIZED_CELL_STORAGE_H
+#define SLAM_CTOR_CORE_QUANTIZED_CELL_STORAGE_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <cassert>
+#include <typeinfo>
+#include <algorithm>
+
+#include "grid_cell.h"
+
+/* Fixed point representation of values from [0; 1] */
+template <typename UInt>
+struct UnitFixedPoint {
+  static_assert(std::numeric_limits<UInt>::is_integer &&
+                !std::numeric_limits<UInt>::is_signed,
+                "UnitFixedPoint requires an unsigned integer type");
+
+  static constexpr double Max_Value = std::numeric_limits<UInt>::max();
+
+  static UInt encode(double v) {
+    return static_cast<UInt>(std::lround(std::min(std::max(v, 0.0), 1.0) *
+                                         Max_Value));
+  }
+  static double decode(UInt v) { return v / Max_Value; }
+};
+
+template <typename UInt>
+constexpr double UnitFixedPoint<UInt>::Max_Value;
+
+/* Codecs.
+ * A codec defines a packed representation of a cell (Packed) and
+ * conversions from/to the cell type (Cell).
+ * The cell type must be default constructible. */
+
+// For cells whose state is an occupancy only (prob_occ, quality in [0; 1]).
+template <typename CellT, typename UInt = uint16_t>
+struct QuantizedOccupancyCodec {
+  using Cell = CellT;
+  struct Packed {
+    UInt prob_occ, quality;
+  };
+
+  static Packed encode(const Cell &c) {
+    const auto &occ = c.occupancy();
+    return {UnitFixedPoint<UInt>::encode(occ.prob_occ),
+            UnitFixedPoint<UInt>::encode(occ.estimation_quality)};
+  }
+
+  static Cell decode(const Packed &p) {
+    return Cell{Occupancy(UnitFixedPoint<UInt>::decode(p.prob_occ),
+                          UnitFixedPoint<UInt>::decode(p.quality))};
+  }
+};
+
+/* Keeps cells in packed form, cells are decoded on access.
+ * NB: a reference returned by cell() refers to a thread-local decoded copy
+ *     that stays valid until Decoded_Cells_Nm other cells are decoded
+ *     by the thread. Modifications must be done via update/reset. */
+template <typename Codec>
+struct QuantizedCellStorage {
+  using Element = typename Codec::Packed;
+  using Cell = typename Codec::Cell;
+  static constexpr unsigned Decoded_Cells_Nm = 8;
+
+  static Element make(const GridCell &prototype) {
+    return Codec::encode(as_cell(prototype));
+  }
+  static const Element &copy(const Element &e) { return e; }
+  static std::size_t heap_bytes(const GridCell &) { return 0; }
+
+  static const GridCell &cell(const Element &e) {
+    static thread_local std::array<Cell, Decoded_Cells_Nm> decoded_cells;
+    static thread_local unsigned next_cell_i = 0;
+    auto &decoded = decoded_cells[next_cell_i++ % Decoded_Cells_Nm];
+    decoded = Codec::decode(e);
+    return decoded;
+  }
+
+  static void update(Element &e, const AreaOccupancyObservation &aoo) {
+    auto decoded = Codec::decode(e);
+    decoded.Cell::operator+=(aoo);
+    e = Codec::encode(decoded);
+  }
+  static void reset(Element &e, const GridCell &new_area) {
+    e = Codec::encode(as_cell(new_area));
+  }
+  static void merge(Element &e, const GridCell &that) {
+    auto decoded = Codec::decode(e);
+    decoded.Cell::merge(that);
+    e = Codec::encode(decoded);
+  }
+  static double discrepancy(const Element &e,
+                            const AreaOccupancyObservation &aoo) {
+    return Codec::decode(e).Cell::discrepancy(aoo);
+  }
+  static void discrepancies(const Element *es, std::size_t n,
+                            const AreaOccupancyObservation &aoo,
+                            double *discrepancies) {
+    for (std::size_t i = 0; i < n; ++i) {
+      discrepancies[i] = discrepancy(es[i], aoo);
+    }
+  }
+  static void occupancies(const Element *es, std::size_t n, double *probs) {
+    for (std::size_t i = 0; i < n; ++i) {
+      probs[i] = Codec::decode(es[i]).Cell::occupancy().prob_occ;
+    }
+  }
+
+private:
+  static const Cell &as_cell(const GridCell &c) {
+    assert(typeid(c) == typeid(Cell));
+    return static_cast<const Cell &>(c);
+  }
+};
+
+template <typename Codec>
+constexpr unsigned QuantizedCellStorage<Codec>::Decoded_Cells_Nm;
+
+#endif
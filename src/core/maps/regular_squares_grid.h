@@ -10,6 +10,12 @@
 #include "../math_utils.h"
 #include "../geometry_utils.h"
 
+// Traversal orders of grid areas
+enum class GridTraversalOrder {
+  Column_Major, // neighbours along y are visited sequentially
+  Row_Major     // neighbours along x are visited sequentially
+};
+
 class RegularSquaresGrid {
 public:
   using Coord = DiscretePoint2D;
@@ -54,7 +60,15 @@ public:
 
   // TODO: move resterization to a separate component
   std::vector<Coord> world_to_cells(const Segment2D &s) const {
-    // returns a vector of cells intersected by a given segment.
+    std::vector<Coord> cells;
+    world_to_cells(s, cells);
+    return cells;
+  }
+
+  // PERFORMANCE: the buffer is reused by a caller, so beams of a scan
+  //              are rasterized without heap allocations.
+  void world_to_cells(const Segment2D &s, std::vector<Coord> &cells) const {
+    // fills cells with cells intersected by a given segment.
     // The first cell contains start of the segment, the last - its end.
     // algorithm: modified 4-connection line
     double d_x = s.end().x - s.beg().x, d_y = s.end().y - s.beg().y;
@@ -63,11 +77,11 @@ public:
     Coord pnt = world_to_cell(s.beg());
     const Coord end = world_to_cell(s.end());
     size_t cells_nm = std::abs(end.x - pnt.x) + std::abs(end.y - pnt.y) + 1;
-    std::vector<Coord> cells;
+    cells.clear();
     cells.reserve(cells_nm);
 
     double m_per_cell = scale();
-    Point2D mid_cell{(pnt.x + 0.5) * m_per_cell, (pnt.y + 0.5) * m_per_cell};
+    Point2D mid_cell((pnt.x + 0.5) * m_per_cell, (pnt.y + 0.5) * m_per_cell);
     // NB: y's are multiplied by d_x to eliminate separate vert. line handling
     auto mid_cell_seg_y = d_x * s.beg().y + (mid_cell.x - s.beg().x) * d_y;
     auto e = mid_cell_seg_y - mid_cell.y * d_x; // e = actual_e * d_x
@@ -78,7 +92,8 @@ public:
       cells.push_back(pnt);
       if (pnt == end) { break; }
       if (cells_nm < cells.size()) { // fail-over (fp rounding errors)
-        return DiscreteSegment2D{world_to_cell(s.beg()), end};
+        cells = DiscreteSegment2D{world_to_cell(s.beg()), end};
+        return;
       }
 
       double e_x = e + e_x_inc, e_y = e + e_y_inc;
@@ -97,24 +112,23 @@ public:
         e = e_y;
       }
     }
-    return cells;
   }
 
   Point2D cell_to_world(const Coord &cell) const {
-    return {scale() * (cell.x + 0.5), scale() * (cell.y + 0.5)};
+    return Point2D(scale() * (cell.x + 0.5), scale() * (cell.y + 0.5));
   }
 
   // TODO: consider renaming ~"occupied_space"
   Rectangle world_cell_bounds(const Coord &coord) const {
     auto m_per_cell = scale();
     if (m_per_cell == Dbl_Inf) {
-      return {-Dbl_Inf, Dbl_Inf, -Dbl_Inf, Dbl_Inf};
+      return Rectangle(-Dbl_Inf, Dbl_Inf, -Dbl_Inf, Dbl_Inf);
     }
 
-    return {m_per_cell * coord.y,        // bot
-            m_per_cell * (coord.y + 1),  // top
-            m_per_cell * coord.x,        // left
-            m_per_cell * (coord.x + 1)}; // right
+    return Rectangle(m_per_cell * coord.y,        // bot
+                     m_per_cell * (coord.y + 1),  // top
+                     m_per_cell * coord.x,        // left
+                     m_per_cell * (coord.x + 1)); // right
   }
 
   virtual DiscretePoint2D origin() const {
@@ -3,8 +3,12 @@
 
 #include <memory>
 #include <cassert>
+#include <cmath>
 #include <limits>
 #include <utility>
+#include <tuple>
+#include <vector>
+#include <algorithm>
 
 #include "grid_cell.h"
 #include "grid_map.h"
@@ -24,19 +28,27 @@ public:
     : GridMap{prototype, params}
     , _map_cache{std::make_shared<MapCache>()} {
 
-    // the finest map
+    // the finest map; coarser ones are built on the first request.
     _map_cache->push_back(std::make_unique<BackGridMap>(prototype, params));
-    // the coarsest map
-    auto coarsest_mp = GridMapParams{Coarsest_Map_W, Coarsest_Map_H,
-                                     std::numeric_limits<double>::infinity()};
-    auto coarsest_map = std::make_unique<BackGridMap>(prototype, coarsest_mp);
-    _map_cache->push_back(std::move(coarsest_map));
-    ensure_map_cache_is_continuous();
+    _scale_id = finest_scale_id();
+    _active_map = &map(_scale_id);
+  }
 
-    set_scale_id(finest_scale_id());
+  // NB: each level is copied, so a copy of a map with copy-on-write
+  //     storages (e.g. a tiled one) shares areas until they are modified.
+  RescalableCachingGridMap(const RescalableCachingGridMap &that)
+    : GridMap{that}
+    , _scale_id{that._scale_id}
+    , _map_cache{std::make_shared<MapCache>()}
+    , _dirty_area_ids{that._dirty_area_ids}
+    , _coarser_maps_are_built{that._coarser_maps_are_built} {
+    for (auto &level : *that._map_cache) {
+      _map_cache->push_back(std::make_unique<BackGridMap>(
+        static_cast<const BackGridMap&>(*level)));
+    }
+    _active_map = &map(_scale_id);
   }
 
-  RescalableCachingGridMap(const RescalableCachingGridMap&) = delete;
   RescalableCachingGridMap& operator=(const RescalableCachingGridMap&) = delete;
   RescalableCachingGridMap(RescalableCachingGridMap&&) = default;
   RescalableCachingGridMap& operator=(RescalableCachingGridMap&&) = default;
@@ -45,6 +57,10 @@ public:
   // API for manual scale management.
 
   unsigned scales_nm() const {
+    // NB: coarser maps are a cache, so the sync is logically const
+    auto &mutable_this = const_cast<RescalableCachingGridMap&>(*this);
+    mutable_this.ensure_coarser_maps_are_built();
+    mutable_this.sync_coarser_maps();
     ensure_map_cache_is_continuous();
     return _map_cache->size();
   }
@@ -55,11 +71,29 @@ public:
   unsigned coarsest_scale_id() const { return scales_nm() - 1; }
 
   void set_scale_id(unsigned scale_id) {
-    assert(scale_id < scales_nm());
+    assert(scale_id == finest_scale_id() || scale_id < scales_nm());
+    if (scale_id != finest_scale_id()) { sync_coarser_maps(); }
     _scale_id = scale_id;
     _active_map = &map(_scale_id);
   }
 
+  // Finest map updates are accumulated and propagated to coarser maps
+  // in a batch either on the next switch to a coarser scale or by the call.
+  void sync_coarser_maps() {
+    if (_dirty_area_ids.empty()) { return; }
+
+    auto dirty_area_ids = std::move(_dirty_area_ids);
+    _dirty_area_ids.clear();
+    for (unsigned coarser_scale_id = finest_scale_id() + 1;
+         coarser_scale_id <= coarsest_scale_id(); ++coarser_scale_id) {
+      remove_duplicates(dirty_area_ids);
+      dirty_area_ids = propagate_updates(map(coarser_scale_id - 1),
+                                         map(coarser_scale_id),
+                                         dirty_area_ids);
+      if (dirty_area_ids.empty()) { break; }
+    }
+  }
+
   //----------------------------------------------------------------------------
   // RegularSquaresGrid overrides
 
@@ -72,14 +106,23 @@ public:
   }
 
   void rescale(double target_scale) override {
-    ensure_map_cache_is_continuous();
+    auto finest_scale = map(finest_scale_id()).scale();
+    if (target_scale <= finest_scale) {
+      set_scale_id(finest_scale_id());
+      return;
+    }
 
-    // TODO: replace the linear probing
-    unsigned scale_id = finest_scale_id();
-    while (1) {
-      if (target_scale <= map(scale_id).scale()) {
-        break;
-      }
+    // NB: a scale of a map is Map_Scale_Factor times greater than
+    //     the finer one's, so the id is estimated directly.
+    auto coarsest_id = coarsest_scale_id();
+    auto scale_id = std::min<double>(coarsest_id, std::ceil(
+      std::log(target_scale / finest_scale) / std::log(Map_Scale_Factor)));
+    // compensate rounding errors
+    while (finest_scale_id() < scale_id &&
+           target_scale <= map(scale_id - 1).scale()) {
+      --scale_id;
+    }
+    while (map(scale_id).scale() < target_scale) {
       ++scale_id;
     }
     set_scale_id(scale_id);
@@ -92,6 +135,27 @@ public:
     return active_map()[coord];
   }
 
+  void row_discrepancies(const Coord &area_id, int areas_nm,
+                         const AreaOccupancyObservation &aoo,
+                         double *discrepancies) const override {
+    active_map().row_discrepancies(area_id, areas_nm, aoo, discrepancies);
+  }
+
+  void row_occupancies(const Coord &area_id, int areas_nm,
+                       double *probs) const override {
+    active_map().row_occupancies(area_id, areas_nm, probs);
+  }
+
+  GridTraversalOrder traversal_order() const override {
+    return active_map().traversal_order();
+  }
+
+  // NB: coarser maps are synced on rescaling (and scales_nm), so reads
+  //     at a fixed scale are the ones of the active map.
+  bool supports_concurrent_reads() const override {
+    return active_map().supports_concurrent_reads();
+  }
+
   void update(const Coord &area_id,
               const AreaOccupancyObservation &aoo) override {
     active_map().update(area_id, aoo);
@@ -104,19 +168,90 @@ public:
     on_area_update(area_id);
   }
 
+  // NB: coarser maps are a cache, so only the finest one is captured
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return map(finest_scale_id()).snapshot();
+  }
+
+  uint64_t version() const override {
+    return map(finest_scale_id()).version();
+  }
+
+  uint64_t instance_id() const override {
+    return map(finest_scale_id()).instance_id();
+  }
+
+  ModifiedGridArea modified_area(uint64_t since_version) const override {
+    return map(finest_scale_id()).modified_area(since_version);
+  }
+
+  // NB: coarser maps are an overhead of the finest one;
+  //     levels that are not built yet are not reported
+  GridMapMemoryUsage memory_usage() const override {
+    auto usage = GridMapMemoryUsage{};
+    for (unsigned scale_id = 0; scale_id < _map_cache->size(); ++scale_id) {
+      auto level_usage = map(scale_id).memory_usage();
+      usage.levels_bytes.push_back(level_usage.total_bytes());
+      if (scale_id == finest_scale_id()) {
+        usage += level_usage;
+        continue;
+      }
+      usage.add_overhead(level_usage.total_bytes());
+    }
+    usage.add_overhead(_dirty_area_ids.capacity() * sizeof(Coord));
+    return usage;
+  }
+
 private:
 
   void on_area_update(const Coord &area_id) {
-    using GRRectangle = GridRasterizedRectangle;
     // TODO: update if a "non-finest" cell is updated?
     assert(_scale_id == finest_scale_id());
-    auto modified_area = active_map()[area_id];
-    auto modified_space = active_map().world_cell_bounds(area_id);
+    if (!_coarser_maps_are_built) { return; }
+    _dirty_area_ids.push_back(area_id);
+  }
+
+  void ensure_coarser_maps_are_built() {
+    if (_coarser_maps_are_built) { return; }
+    _coarser_maps_are_built = true;
+
+    // the coarsest map
+    auto coarsest_mp = GridMapParams{Coarsest_Map_W, Coarsest_Map_H,
+                                     std::numeric_limits<double>::infinity()};
+    _map_cache->push_back(std::make_unique<BackGridMap>(cell_prototype(),
+                                                        coarsest_mp));
+    ensure_map_cache_is_continuous();
+
+    // the whole finest map is "updated" to initialize the coarser ones
+    auto &finest_map = map(finest_scale_id());
+    auto coord = Coord{0, 0};
+    for (coord.y = 0; coord.y < finest_map.height(); ++coord.y) {
+      for (coord.x = 0; coord.x < finest_map.width(); ++coord.x) {
+        _dirty_area_ids.push_back(finest_map.internal2external(coord));
+      }
+    }
+  }
+
+  static void remove_duplicates(std::vector<Coord> &area_ids) {
+    std::sort(area_ids.begin(), area_ids.end(),
+              [](const Coord &a, const Coord &b) {
+                return std::tie(a.x, a.y) < std::tie(b.x, b.y);
+              });
+    area_ids.erase(std::unique(area_ids.begin(), area_ids.end()),
+                   area_ids.end());
+  }
+
+  // NB: a coarser area keeps the max of finer areas it covers, so
+  //     propagation of updated finer areas is enough to refresh it.
+  static std::vector<Coord> propagate_updates(
+      const GridMap &finer_map, GridMap &coarser_map,
+      const std::vector<Coord> &finer_area_ids) {
+    using GRRectangle = GridRasterizedRectangle;
+    auto updated_area_ids = std::vector<Coord>{};
+    for (auto &area_id : finer_area_ids) {
+      auto &modified_area = finer_map[area_id];
+      auto modified_space = finer_map.world_cell_bounds(area_id);
 
-    for (unsigned coarser_scale_id = _scale_id + 1;
-         coarser_scale_id <= coarsest_scale_id(); ++coarser_scale_id) {
-      auto& coarser_map = map(coarser_scale_id);
-      bool coarser_area_is_updated = false;
       auto cm_coords = GRRectangle{coarser_map, modified_space, false};
       while (cm_coords.has_next()) {
         auto coord = cm_coords.next();
@@ -124,10 +259,10 @@ private:
         if (double(modified_area) <= double(coarser_area)) { continue; }
 
         coarser_map.reset(coord, modified_area);
-        coarser_area_is_updated = true;
+        updated_area_ids.push_back(coord);
       }
-      if (!coarser_area_is_updated) { break; }
     }
+    return updated_area_ids;
   }
 
   const GridMap& map(unsigned scale_id) const {
@@ -176,6 +311,8 @@ private:
   GridMap *_active_map = nullptr;
   unsigned _scale_id = -1;
   mutable std::shared_ptr<MapCache> _map_cache;
+  std::vector<Coord> _dirty_area_ids;
+  bool _coarser_maps_are_built = false;
 };
 
 // a RAII for const grid map rescaling
@@ -0,0 +1,135 @@
+#ifndef SLAM_CTOR_CORE_SCRATCH_GRID_MAP_H
+#define SLAM_CTOR_CORE_SCRATCH_GRID_MAP_H
+
+#include <memory>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+#include "grid_cell.h"
+#include "grid_cell_storages.h"
+#include "grid_map.h"
+
+/* A bounded map that is reused by short-lived tasks (e.g. a rasterization
+ * of a scan to match another one against it). Before a task the map is
+ * reshaped to cover the task's areas; only cells written since
+ * the previous reshape are reset, so a map that is reused for similar
+ * areas performs neither allocations nor full clears.
+ * Cells are stored by value (see ValueCellStorage) in a row-major order.
+ * NB: the buffer only grows, i.e. it fits the largest area requested. */
+template <typename CellT>
+class ScratchGridMap : public GridMap {
+private: // types
+  using CellStorage = ValueCellStorage<CellT>;
+public:
+  ScratchGridMap(std::shared_ptr<GridCell> prototype, double scale)
+    : GridMap{prototype, {0, 0, scale}}
+    , _unknown_cell{CellStorage::make(*prototype)} {}
+
+  // Resets written cells and makes the map cover [min, max] areas
+  void reshape(const Coord &min, const Coord &max) {
+    assert(min.x <= max.x && min.y <= max.y);
+    for (auto i : _written_cells) {
+      _cells[i] = _unknown_cell;
+      _is_written[i] = false;
+    }
+    _written_cells.clear();
+
+    auto cells_nm = std::size_t(max.x - min.x + 1) * (max.y - min.y + 1);
+    if (_cells.size() < cells_nm) {
+      _cells.resize(cells_nm, _unknown_cell);
+      _is_written.resize(cells_nm, false);
+    }
+    set_width(max.x - min.x + 1);
+    set_height(max.y - min.y + 1);
+    _origin = -min;
+    forget_modifications();
+  }
+
+  Coord origin() const override { return _origin; }
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    CellStorage::update(written_cell(area_id), aoo);
+    on_area_modified(area_id);
+  }
+
+  void reset(const Coord &area_id, const GridCell &new_area) override {
+    CellStorage::reset(written_cell(area_id), new_area);
+    on_area_modified(area_id);
+  }
+
+  const GridCell &operator[](const Coord& c) const override {
+    return CellStorage::cell(_cells[cell_index(c)]);
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    return CellStorage::discrepancy(_cells[cell_index(area_id)], aoo);
+  }
+
+  void row_discrepancies(const Coord &area_id, int areas_nm,
+                         const AreaOccupancyObservation &aoo,
+                         double *discrepancies) const override {
+    auto ic = external2internal(area_id);
+    int begin = std::max(0, -ic.x);
+    int end = std::min(areas_nm, width() - ic.x);
+    if (ic.y < 0 || height() <= ic.y || end <= begin) {
+      std::fill(discrepancies, discrepancies + areas_nm,
+                _unknown_cell.discrepancy(aoo));
+      return;
+    }
+
+    auto unknown_discrepancy = _unknown_cell.discrepancy(aoo);
+    std::fill(discrepancies, discrepancies + begin, unknown_discrepancy);
+    CellStorage::discrepancies(&_cells[cell_index({area_id.x + begin,
+                                                   area_id.y})],
+                               end - begin, aoo, discrepancies + begin);
+    std::fill(discrepancies + end, discrepancies + areas_nm,
+              unknown_discrepancy);
+  }
+
+  GridTraversalOrder traversal_order() const override {
+    return GridTraversalOrder::Row_Major;
+  }
+
+  std::size_t written_cells_nm() const { return _written_cells.size(); }
+
+  // NB: the buffer fits the largest area requested, the rest is an overhead
+  GridMapMemoryUsage memory_usage() const override {
+    auto map_cells_nm = std::size_t(width()) * height();
+    auto usage = GridMapMemoryUsage{};
+    usage.add_cells(map_cells_nm * sizeof(CellT));
+    usage.add_overhead((_cells.capacity() - map_cells_nm) * sizeof(CellT) +
+                       _is_written.capacity() +
+                       _written_cells.capacity() * sizeof(std::size_t));
+    return usage;
+  }
+
+private: // methods
+
+  std::size_t cell_index(const Coord &area_id) const {
+    auto ic = external2internal(area_id);
+    assert(has_internal_cell(ic));
+    return std::size_t(ic.y) * width() + ic.x;
+  }
+
+  CellT &written_cell(const Coord &area_id) {
+    auto i = cell_index(area_id);
+    if (!_is_written[i]) {
+      _is_written[i] = true;
+      _written_cells.push_back(i);
+    }
+    return _cells[i];
+  }
+
+private: // fields
+  CellT _unknown_cell;
+  Coord _origin;
+  std::vector<CellT> _cells;
+  // NB: a flag per cell keeps the list free of duplicates
+  std::vector<char> _is_written;
+  std::vector<std::size_t> _written_cells;
+};
+
+#endif
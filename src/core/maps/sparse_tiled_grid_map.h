@@ -0,0 +1,316 @@
+#ifndef SLAM_CTOR_CORE_SPARSE_TILED_GRID_MAP_H
+#define SLAM_CTOR_CORE_SPARSE_TILED_GRID_MAP_H
+
+#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+
+#include "grid_cell.h"
+#include "grid_cell_storages.h"
+#include "grid_map.h"
+#include "lazy_tiled_grid_map.h"
+#include "tiled_map_checkpoint.h"
+
+/* An unbounded tiled map that keeps only known tiles in a hash table
+ * keyed by a tile coordinate. Unlike GenericUnboundedLazyTiledGridMap,
+ * memory doesn't depend on the bounding box of the explored area,
+ * so it suits large mostly-unknown environments (e.g. long corridors).
+ * NB: width/height/origin describe the bounding box of modified cells
+ *     (extended by the initial map params). */
+template <typename CellStorage, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+class GenericSparseTiledGridMap : public GridMap {
+  static_assert(0 < TileSizeBits && TileSizeBits <= 15,
+                "Tile side must be in [2; 2^15] cells");
+protected: // types
+  using Tile = GridMapTile<CellStorage, TileSizeBits, TileLayout>;
+
+  struct TileCoordHash {
+    std::size_t operator()(const Coord &tc) const {
+      auto key = (uint64_t(uint32_t(tc.x)) << 32) | uint32_t(tc.y);
+      return std::hash<uint64_t>{}(key);
+    }
+  };
+
+  using Tiles = std::unordered_map<Coord, std::shared_ptr<Tile>,
+                                   TileCoordHash>;
+  using TileCoords = std::unordered_set<Coord, TileCoordHash>;
+public:
+  GenericSparseTiledGridMap(std::shared_ptr<GridCell> prototype,
+                            const GridMapParams& params = MapValues::gmp)
+    : GridMap{prototype, params}
+    , _unknown_cell{prototype->clone()}
+    , _bounds_min{-GridMap::origin()}
+    , _bounds_max{_bounds_min + Coord(GridMap::width(), GridMap::height())} {}
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    CellStorage::update(owned_tile(area_id).cell(area_id), aoo);
+    on_area_modified(area_id);
+  }
+
+  void reset(const Coord &area_id, const GridCell &new_area) override {
+    CellStorage::reset(owned_tile(area_id).cell(area_id), new_area);
+    on_area_modified(area_id);
+  }
+
+  const GridCell &operator[](const Coord& area_id) const override {
+    auto tile = find_tile(area_id);
+    if (!tile) { return *_unknown_cell; }
+    return CellStorage::cell(tile->cell(area_id));
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    auto tile = find_tile(area_id);
+    if (!tile) { return _unknown_cell->discrepancy(aoo); }
+    return CellStorage::discrepancy(tile->cell(area_id), aoo);
+  }
+
+  Coord origin() const override {
+    return -_bounds_min;
+  }
+
+  bool has_cell(const Coord &) const override { return true; }
+
+  // NB: tiles are shared with the snapshot until they are modified
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<GenericSparseTiledGridMap>(*this);
+  }
+
+  std::size_t known_tiles_nm() const { return _tiles.size(); }
+
+  // NB: only tiles in memory are counted (see GenericOutOfCoreTiledGridMap)
+  GridMapMemoryUsage memory_usage() const override {
+    auto tile_bytes = Tile::memory_size(*_unknown_cell);
+    auto usage = GridMapMemoryUsage{};
+    usage.add_overhead(hash_table_bytes(_tiles) +
+                       hash_table_bytes(_modified_tiles));
+    for (auto &tile : _tiles) {
+      usage.add_tile(tile_bytes, tile.second.use_count());
+    }
+    return usage;
+  }
+
+  //----------------------------------------------------------------------------
+  // Checkpoints (see tiled_map_checkpoint.h)
+
+  // A full checkpoint
+  std::vector<char> save_state() const override {
+    return make_checkpoint(false, stored_tile_coords());
+  }
+
+  // A full checkpoint that starts a new chain of delta ones
+  std::vector<char> save_full_checkpoint() {
+    reset_modified_tiles();
+    return save_state();
+  }
+
+  // A delta checkpoint with tiles modified since the previous checkpoint
+  std::vector<char> save_delta_checkpoint() {
+    auto checkpoint = make_checkpoint(true, std::vector<Coord>(
+      _modified_tiles.begin(), _modified_tiles.end()));
+    reset_modified_tiles();
+    return checkpoint;
+  }
+
+  // Loads a full checkpoint or applies a delta one; a corrupt checkpoint
+  // or one of a map with another tile size is rejected (the map is kept).
+  bool load_state(const std::vector<char> &data) override {
+    auto header = TiledMapCheckpoint::Header{};
+    auto records = std::vector<TiledMapCheckpoint::TileRecord>{};
+    std::size_t pos = 0;
+    if (!TiledMapCheckpoint::read_header(data, header, pos) ||
+        header.tile_size_bits != TileSizeBits ||
+        !TiledMapCheckpoint::read_tile_records(data, header, pos, records)) {
+      return false;
+    }
+    auto loaded_tiles = std::vector<std::shared_ptr<Tile>>{};
+    loaded_tiles.reserve(records.size());
+    for (auto &record : records) {
+      auto tile = std::make_shared<Tile>(*_unknown_cell);
+      auto tile_end = deserialize_tile(data, record.data_pos, *tile);
+      if (tile_end != record.data_pos + record.data_size) { return false; }
+      loaded_tiles.push_back(std::move(tile));
+    }
+
+    if (!header.is_delta) {
+      _tiles.clear();
+      _bounds_min = header.bounds_min;
+      _bounds_max = header.bounds_max;
+      set_scale(header.scale);
+    } else {
+      extend_bounds(header.bounds_min);
+      extend_bounds(header.bounds_max - Coord{1, 1});
+    }
+    set_width(_bounds_max.x - _bounds_min.x);
+    set_height(_bounds_max.y - _bounds_min.y);
+    for (std::size_t i = 0; i < records.size(); ++i) {
+      _tiles[records[i].tile_coord] = std::move(loaded_tiles[i]);
+    }
+    reset_modified_tiles();
+    forget_modifications();
+    return true;
+  }
+
+  std::size_t modified_tiles_nm() const { return _modified_tiles.size(); }
+
+protected: // methods
+
+  // NB: an arithmetic shift is a floor division for negative coordinates
+  static Coord tile_coord(const Coord &area_id) {
+    return {area_id.x >> TileSizeBits, area_id.y >> TileSizeBits};
+  }
+
+  const Tile *find_tile(const Coord &area_id) const {
+    auto tile_it = _tiles.find(tile_coord(area_id));
+    return tile_it == _tiles.end() ? nullptr : tile_it->second.get();
+  }
+
+  // An estimate of memory of a node based hash table: bucket heads
+  // and nodes that keep a value, a next node pointer and a hash
+  template <typename HashTable>
+  static std::size_t hash_table_bytes(const HashTable &table) {
+    return table.bucket_count() * sizeof(void*) +
+           table.size() * (sizeof(typename HashTable::value_type) +
+                           sizeof(void*) + sizeof(std::size_t));
+  }
+
+  const Tiles &tiles() const { return _tiles; }
+  const std::shared_ptr<GridCell> unknown_cell() const { return _unknown_cell; }
+
+  std::shared_ptr<Tile> detach_tile(const Coord &tc) {
+    auto tile_it = _tiles.find(tc);
+    assert(tile_it != _tiles.end());
+    auto tile = std::move(tile_it->second);
+    _tiles.erase(tile_it);
+    return tile;
+  }
+
+  void attach_tile(const Coord &tc, std::shared_ptr<Tile> tile) {
+    assert(_tiles.find(tc) == _tiles.end());
+    _tiles.emplace(tc, std::move(tile));
+  }
+
+  // Descendants that keep tiles outside of tiles() provide them
+  // for checkpoints.
+  virtual std::vector<Coord> stored_tile_coords() const {
+    auto coords = std::vector<Coord>{};
+    coords.reserve(_tiles.size());
+    for (auto &tile : _tiles) { coords.push_back(tile.first); }
+    return coords;
+  }
+
+  virtual std::shared_ptr<const Tile> stored_tile(const Coord &tc) const {
+    return _tiles.at(tc);
+  }
+
+  std::vector<char> serialize_tile(const Tile &tile) const {
+    auto s = Serializer{};
+    for_each_tile_cell_coord([&](const Coord &c) {
+      s.append(CellStorage::cell(tile.cell(c)).serialize());
+    });
+    return s.result();
+  }
+
+  std::size_t deserialize_tile(const std::vector<char> &data, std::size_t pos,
+                               Tile &tile) const {
+    auto cell = _unknown_cell->clone();
+    for_each_tile_cell_coord([&](const Coord &c) {
+      pos = cell->deserialize(data, pos);
+      CellStorage::reset(tile.cell(c), *cell);
+    });
+    return pos;
+  }
+
+private: // methods
+
+  template <typename Action>
+  static void for_each_tile_cell_coord(Action action) {
+    auto c = Coord{0, 0};
+    for (c.y = 0; c.y < int(Tile::Size); ++c.y) {
+      for (c.x = 0; c.x < int(Tile::Size); ++c.x) {
+        action(c);
+      }
+    }
+  }
+
+  std::vector<char> make_checkpoint(bool is_delta,
+                                    const std::vector<Coord> &tcs) const {
+    auto header = TiledMapCheckpoint::Header{};
+    header.is_delta = is_delta;
+    header.tile_size_bits = TileSizeBits;
+    header.scale = scale();
+    header.bounds_min = _bounds_min;
+    header.bounds_max = _bounds_max;
+    header.tiles_nm = tcs.size();
+
+    auto s = Serializer{};
+    TiledMapCheckpoint::write_header(s, header);
+    for (auto &tc : tcs) {
+      TiledMapCheckpoint::write_tile_record(s, tc,
+                                            serialize_tile(*stored_tile(tc)));
+    }
+    return s.result();
+  }
+
+  // NB: copy-on-write is done per tile, cells of a tile are owned by it.
+  Tile &owned_tile(const Coord &area_id) {
+    extend_bounds(area_id);
+    auto tc = tile_coord(area_id);
+    // PERFORMANCE: consecutive updates mostly hit the same tile
+    if (!_has_last_modified_tile || tc != _last_modified_tile) {
+      _modified_tiles.insert(tc);
+      _has_last_modified_tile = true;
+      _last_modified_tile = tc;
+    }
+    auto &tile = _tiles[tc];
+    if (!tile) {
+      tile = std::make_shared<Tile>(*_unknown_cell);
+    } else if (1 < tile.use_count()) {
+      tile = std::make_shared<Tile>(*tile);
+    }
+    return *tile;
+  }
+
+  void reset_modified_tiles() {
+    _modified_tiles.clear();
+    _has_last_modified_tile = false;
+  }
+
+  void extend_bounds(const Coord &area_id) {
+    if (_bounds_min.x <= area_id.x && area_id.x < _bounds_max.x &&
+        _bounds_min.y <= area_id.y && area_id.y < _bounds_max.y) {
+      return;
+    }
+    _bounds_min = {std::min(_bounds_min.x, area_id.x),
+                   std::min(_bounds_min.y, area_id.y)};
+    _bounds_max = {std::max(_bounds_max.x, area_id.x + 1),
+                   std::max(_bounds_max.y, area_id.y + 1)};
+    set_width(_bounds_max.x - _bounds_min.x);
+    set_height(_bounds_max.y - _bounds_min.y);
+  }
+
+private: // fields
+  std::shared_ptr<GridCell> _unknown_cell;
+  Tiles _tiles;
+  Coord _bounds_min, _bounds_max;
+  // tiles modified since the last checkpoint
+  TileCoords _modified_tiles;
+  bool _has_last_modified_tile = false;
+  Coord _last_modified_tile;
+};
+
+using SparseTiledGridMap = GenericSparseTiledGridMap<PolymorphicCellStorage>;
+
+template <typename CellT, unsigned TileSizeBits = 7,
+          typename TileLayout = ColumnMajorTileLayout>
+using ValueSparseTiledGridMap = GenericSparseTiledGridMap<
+  ValueCellStorage<CellT>, TileSizeBits, TileLayout>;
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef SLAM_CTOR_CORE_TABULATED_AREA_OCCUPANCY_ESTIMATOR_H
+#define SLAM_CTOR_CORE_TABULATED_AREA_OCCUPANCY_ESTIMATOR_H
+
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "area_occupancy_estimator.h"
+
+/* An AreaOccupancyEstimator that looks up estimates of cells pierced
+ * by a beam in a precomputed table.
+ * A cell perimeter is split into 4 * Resolution bins; a pierced cell
+ * estimate depends only on bins of the beam entry and exit points
+ * (the estimate is area-based, so it doesn't depend on the cell size).
+ * Entry/exit points are moved by at most a half of a bin, so the area rate
+ * (and the estimation quality of an empty cell) error is about
+ * 1 / Resolution. Cells that contain beam ends and degenerate cases
+ * (a beam on an edge line, a vertex touch) are estimated exactly. */
+class TabulatedAreaOccupancyEstimator : public CellOccupancyEstimator {
+public: // consts
+  static constexpr unsigned Default_Resolution = 16;
+public:
+  TabulatedAreaOccupancyEstimator(const Occupancy& base_occupied,
+                                  const Occupancy& base_empty,
+                                  unsigned resolution = Default_Resolution)
+    : CellOccupancyEstimator{base_occupied, base_empty}
+    , _exact{base_occupied, base_empty}
+    , _resolution{std::max(resolution, 1u)}
+    , _bins_nm{4 * _resolution} {}
+
+  unsigned resolution() const { return _resolution; }
+
+  Occupancy estimate_occupancy(const Segment2D &beam, const Rectangle &cell,
+                               bool is_occ) override {
+    if (is_occ || cell.contains(beam.beg()) || cell.contains(beam.end()) ||
+        cell.has_on_edge_line(beam)) {
+      return _exact.estimate_occupancy(beam, cell, is_occ);
+    }
+
+    // normalize the beam to a unit cell and clip it (Liang-Barsky)
+    auto side = cell.side();
+    auto bx = (beam.beg().x - cell.left()) / side,
+         by = (beam.beg().y - cell.bot()) / side;
+    auto dx = (beam.end().x - beam.beg().x) / side,
+         dy = (beam.end().y - beam.beg().y) / side;
+    double t_in = 0, t_out = 1;
+    if (!clip(-dx, bx, t_in, t_out) || !clip(dx, 1 - bx, t_in, t_out) ||
+        !clip(-dy, by, t_in, t_out) || !clip(dy, 1 - by, t_in, t_out)) {
+      return Occupancy::invalid(); // unrelated
+    }
+    auto chord_param = t_out - t_in;
+    if (chord_param * chord_param * (dx * dx + dy * dy) <
+        Min_Chord_Len * Min_Chord_Len) {
+      return _exact.estimate_occupancy(beam, cell, is_occ);
+    }
+
+    auto entry_bin = perimeter_bin(bx + t_in * dx, by + t_in * dy);
+    auto exit_bin = perimeter_bin(bx + t_out * dx, by + t_out * dy);
+    if (entry_bin == exit_bin) { // cuts a corner within a bin
+      return _exact.estimate_occupancy(beam, cell, is_occ);
+    }
+    ensure_table(cell);
+    return _table[entry_bin * _bins_nm + exit_bin];
+  }
+
+private: // consts
+  // a shorter normalized chord is treated as a vertex touch
+  static constexpr double Min_Chord_Len = 1e-6;
+private: // methods
+
+  static bool clip(double p, double q, double &t_in, double &t_out) {
+    if (p == 0) { return 0 <= q; }
+    auto t = q / p;
+    if (p < 0) {
+      t_in = std::max(t_in, t);
+    } else {
+      t_out = std::min(t_out, t);
+    }
+    return t_in <= t_out;
+  }
+
+  // Perimeter position: bot [0; 1), right [1; 2), top [2; 3), left [3; 4)
+  unsigned perimeter_bin(double x, double y) const {
+    x = std::min(std::max(x, 0.0), 1.0);
+    y = std::min(std::max(y, 0.0), 1.0);
+    // the point is on the nearest side
+    auto horiz_dist = std::min(y, 1 - y), vert_dist = std::min(x, 1 - x);
+    double pos = 0;
+    if (horiz_dist <= vert_dist) {
+      pos = y < 0.5 ? x : 2 + (1 - x);
+    } else {
+      pos = 0.5 < x ? 1 + y : 3 + (1 - y);
+    }
+    return std::min(unsigned(pos * _resolution), _bins_nm - 1);
+  }
+
+  static Point2D perimeter_point(double pos) {
+    auto side = std::min(int(pos), 3);
+    auto offset = pos - side;
+    switch (side) {
+    case 0: return Point2D(offset, 0);
+    case 1: return Point2D(1, offset);
+    case 2: return Point2D(1 - offset, 1);
+    default: return Point2D(0, 1 - offset);
+    }
+  }
+
+  // NB: the table is built with the first cell seen, so the exact
+  //     estimator works with cells of the actual size.
+  void ensure_table(const Rectangle &cell) {
+    if (!_table.empty()) { return; }
+
+    auto side = cell.side();
+    auto table_cell = Rectangle{0, side, 0, side};
+    _table.reserve(_bins_nm * _bins_nm);
+    for (unsigned entry_bin = 0; entry_bin < _bins_nm; ++entry_bin) {
+      auto entry = perimeter_point((entry_bin + 0.5) / _resolution);
+      for (unsigned exit_bin = 0; exit_bin < _bins_nm; ++exit_bin) {
+        auto exit = perimeter_point((exit_bin + 0.5) / _resolution);
+        auto dir = Point2D{exit.x - entry.x, exit.y - entry.y};
+        if (entry_bin == exit_bin) {
+          _table.push_back(Occupancy::invalid());
+          continue;
+        }
+        // a beam that pierces the cell through the bins centers
+        auto beam = Segment2D{{(entry.x - dir.x) * side,
+                               (entry.y - dir.y) * side},
+                              {(exit.x + dir.x) * side,
+                               (exit.y + dir.y) * side}};
+        _table.push_back(_exact.estimate_occupancy(beam, table_cell, false));
+      }
+    }
+  }
+
+private: // fields
+  AreaOccupancyEstimator _exact;
+  unsigned _resolution, _bins_nm;
+  std::vector<Occupancy> _table;
+};
+
+constexpr unsigned TabulatedAreaOccupancyEstimator::Default_Resolution;
+constexpr double TabulatedAreaOccupancyEstimator::Min_Chord_Len;
+
+#endif
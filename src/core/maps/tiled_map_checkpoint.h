@@ -0,0 +1,164 @@
+#ifndef SLAM_CTOR_CORE_TILED_MAP_CHECKPOINT_H
+#define SLAM_CTOR_CORE_TILED_MAP_CHECKPOINT_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "../serialization.h"
+#include "regular_squares_grid.h"
+
+/* A checkpoint of a tiled map is a header followed by tile records
+ * (a tile coordinate, the size of the tile's data, the data).
+ * A full checkpoint contains all known tiles; a delta one contains tiles
+ * modified since the previous checkpoint and is applied on top of it. */
+struct TiledMapCheckpoint {
+  using Coord = RegularSquaresGrid::Coord;
+
+  static constexpr uint32_t Magic = 0x4b434d54; // "TMCK"
+  static constexpr uint32_t Version = 1;
+  // a tile coordinate and the size of the tile's data
+  static constexpr std::size_t Record_Header_Size =
+    2 * sizeof(Coord::x) + sizeof(uint64_t);
+
+  struct Header {
+    bool is_delta;
+    uint32_t tile_size_bits;
+    double scale;
+    Coord bounds_min, bounds_max;
+    uint64_t tiles_nm;
+  };
+
+  struct TileRecord {
+    Coord tile_coord;
+    std::size_t data_pos, data_size;
+  };
+
+  static void write_header(Serializer &s, const Header &h) {
+    s << Magic << Version << h.is_delta << h.tile_size_bits << h.scale
+      << h.bounds_min.x << h.bounds_min.y << h.bounds_max.x << h.bounds_max.y
+      << h.tiles_nm;
+  }
+
+  static void write_tile_record(Serializer &s, const Coord &tile_coord,
+                                const std::vector<char> &tile_data) {
+    s << tile_coord.x << tile_coord.y << uint64_t(tile_data.size());
+    s.append(tile_data);
+  }
+
+  // Returns false if the data is not a checkpoint or its header is corrupt
+  static bool read_header(const std::vector<char> &data, Header &h,
+                          std::size_t &records_pos) {
+    uint32_t magic = 0, version = 0;
+    Deserializer d(data);
+    d >> magic >> version;
+    if (magic != Magic || version != Version) { return false; }
+    d >> h.is_delta >> h.tile_size_bits >> h.scale
+      >> h.bounds_min.x >> h.bounds_min.y >> h.bounds_max.x >> h.bounds_max.y
+      >> h.tiles_nm;
+    if (d.is_overrun() || !(0 < h.scale) ||
+        h.bounds_max.x < h.bounds_min.x || h.bounds_max.y < h.bounds_min.y ||
+        (data.size() - d.pos()) / Record_Header_Size < h.tiles_nm) {
+      return false;
+    }
+    records_pos = d.pos();
+    return true;
+  }
+
+  // Returns false if a record doesn't fit the data
+  static bool read_tile_records(const std::vector<char> &data,
+                                const Header &h, std::size_t pos,
+                                std::vector<TileRecord> &records) {
+    records.clear();
+    records.reserve(h.tiles_nm);
+    for (uint64_t i = 0; i < h.tiles_nm; ++i) {
+      Deserializer d(data, pos);
+      auto record = TileRecord{};
+      uint64_t data_size = 0;
+      d >> record.tile_coord.x >> record.tile_coord.y >> data_size;
+      if (d.is_overrun() || data.size() - d.pos() < data_size) {
+        return false;
+      }
+      record.data_pos = d.pos();
+      record.data_size = data_size;
+      pos = record.data_pos + record.data_size;
+      records.push_back(record);
+    }
+    return true;
+  }
+
+  // Folds delta checkpoints (in the order they were made) into
+  // the base (full) checkpoint; the result is a full checkpoint
+  // (empty if a checkpoint is invalid or made by a map of another tile size).
+  static std::vector<char> compact(
+      const std::vector<char> &base,
+      const std::vector<std::vector<char>> &deltas) {
+    struct TileData {
+      const std::vector<char> *checkpoint;
+      TileRecord record;
+    };
+    struct CoordHash {
+      std::size_t operator()(const Coord &c) const {
+        return std::hash<uint64_t>{}((uint64_t(uint32_t(c.x)) << 32) |
+                                     uint32_t(c.y));
+      }
+    };
+
+    auto header = Header{};
+    auto latest_tiles = std::unordered_map<Coord, TileData, CoordHash>{};
+    auto tiles_order = std::vector<Coord>{};
+    auto records = std::vector<TileRecord>{};
+    auto fold = [&](const std::vector<char> &checkpoint) {
+      auto h = Header{};
+      std::size_t pos = 0;
+      if (!read_header(checkpoint, h, pos) ||
+          h.tile_size_bits != header.tile_size_bits ||
+          !read_tile_records(checkpoint, h, pos, records)) {
+        return false;
+      }
+      header.bounds_min = {std::min(header.bounds_min.x, h.bounds_min.x),
+                           std::min(header.bounds_min.y, h.bounds_min.y)};
+      header.bounds_max = {std::max(header.bounds_max.x, h.bounds_max.x),
+                           std::max(header.bounds_max.y, h.bounds_max.y)};
+      for (auto &record : records) {
+        auto inserted = latest_tiles.emplace(record.tile_coord,
+                                             TileData{&checkpoint, record});
+        if (inserted.second) {
+          tiles_order.push_back(record.tile_coord);
+        } else {
+          inserted.first->second = TileData{&checkpoint, record};
+        }
+      }
+      return true;
+    };
+
+    std::size_t base_records_pos = 0;
+    if (!read_header(base, header, base_records_pos) || header.is_delta ||
+        !fold(base)) {
+      return {};
+    }
+    for (auto &delta : deltas) {
+      if (!fold(delta)) { return {}; }
+    }
+
+    header.is_delta = false;
+    header.tiles_nm = tiles_order.size();
+    Serializer s;
+    write_header(s, header);
+    for (auto &tile_coord : tiles_order) {
+      auto &tile = latest_tiles.at(tile_coord);
+      auto tile_data_begin = tile.checkpoint->begin() + tile.record.data_pos;
+      write_tile_record(s, tile_coord, std::vector<char>(
+        tile_data_begin, tile_data_begin + tile.record.data_size));
+    }
+    return s.result();
+  }
+};
+
+constexpr uint32_t TiledMapCheckpoint::Magic;
+constexpr uint32_t TiledMapCheckpoint::Version;
+constexpr std::size_t TiledMapCheckpoint::Record_Header_Size;
+
+#endif
@@ -45,7 +45,15 @@ public:
 
   // friend functions
   friend TBM conjunctive(const TBM& lhs, const TBM& rhs);
+  friend double conjunctive_conflict(const TBM& lhs, const TBM& rhs);
   friend TBM disjunctive(const TBM& lhs, const TBM& rhs);
+  friend TBM conjunctive_normalized(const TBM& lhs, double rhs_empty,
+                                    double rhs_occupied);
+
+private:
+  // unnormalized masses of the conjunctive combination
+  static void combine_conjunctive(const double *lhs, const double *rhs,
+                                  double *result);
 };
 
 
@@ -123,25 +131,59 @@ void TBM::normalize_conflict() {
   }
 }
 
-TBM conjunctive(const TBM& lhs, const TBM& rhs) {
-  static const std::size_t max_belief { static_cast<std::size_t>(TBM::MAX_BELIEF) };
-  static_assert(max_belief != 0, "static_cast from TBM::MAX_BELIEF to std::size_t fails");
-
-  std::array<double, max_belief> tmp_beliefs;
-  tmp_beliefs.fill(0.0);
-
-  for (int this_id = 0; this_id < TBM::MAX_BELIEF; ++this_id) {
-    for (int that_id = 0; that_id < TBM::MAX_BELIEF; ++that_id) {
-      tmp_beliefs[this_id | that_id] +=
-        lhs.get(static_cast<TBM::Belief>(this_id)) * rhs.get(static_cast<TBM::Belief>(that_id));
-    }
-  }
+// PERFORMANCE: the 4x4 combination loop is unrolled in closed form
+//              (masses are combined in the loop order, so the result
+//              is the same).
+inline void TBM::combine_conjunctive(const double *l, const double *r,
+                                     double *result) {
+  result[UNKNOWN] = l[UNKNOWN] * r[UNKNOWN];
+  result[EMPTY] = l[UNKNOWN] * r[EMPTY] + l[EMPTY] * r[UNKNOWN] +
+                  l[EMPTY] * r[EMPTY];
+  result[OCCUPIED] = l[UNKNOWN] * r[OCCUPIED] + l[OCCUPIED] * r[UNKNOWN] +
+                     l[OCCUPIED] * r[OCCUPIED];
+  result[CONFLICT] = l[UNKNOWN] * r[CONFLICT] + l[EMPTY] * r[OCCUPIED] +
+                     l[EMPTY] * r[CONFLICT] + l[OCCUPIED] * r[EMPTY] +
+                     l[OCCUPIED] * r[CONFLICT] + l[CONFLICT] * r[UNKNOWN] +
+                     l[CONFLICT] * r[EMPTY] + l[CONFLICT] * r[OCCUPIED] +
+                     l[CONFLICT] * r[CONFLICT];
+}
 
-  TBM tbm(tmp_beliefs.at(0), tmp_beliefs.at(1), tmp_beliefs.at(2), tmp_beliefs.at(3));
+TBM conjunctive(const TBM& lhs, const TBM& rhs) {
+  TBM tbm;
+  TBM::combine_conjunctive(lhs._beliefs, rhs._beliefs, tbm._beliefs);
   tbm.normalize();
   return tbm;
 }
 
+// The conflict mass of the normalized conjunctive combination
+inline double conjunctive_conflict(const TBM& lhs, const TBM& rhs) {
+  double masses[TBM::MAX_BELIEF];
+  TBM::combine_conjunctive(lhs._beliefs, rhs._beliefs, masses);
+  double tot_weight = masses[TBM::UNKNOWN] + masses[TBM::EMPTY] +
+                      masses[TBM::OCCUPIED] + masses[TBM::CONFLICT];
+  return tot_weight == 0.0 ? 0.0 : masses[TBM::CONFLICT] / tot_weight;
+}
+
+// The conjunctive combination with a conflict-free belief given by its
+// empty/occupied masses (the unknown one is the rest) followed by
+// normalize_conflict(), e.g. a cell belief update with an observation.
+// PERFORMANCE: the conflict mass is not computed and masses are
+//              normalized once, so the result is the same up to rounding.
+inline TBM conjunctive_normalized(const TBM& lhs, double rhs_empty,
+                                  double rhs_occupied) {
+  const double *l = lhs._beliefs;
+  double rhs_unknown = 1.0 - rhs_empty - rhs_occupied;
+  double unknown = l[TBM::UNKNOWN] * rhs_unknown;
+  double empty = l[TBM::UNKNOWN] * rhs_empty + l[TBM::EMPTY] * rhs_unknown +
+                 l[TBM::EMPTY] * rhs_empty;
+  double occupied = l[TBM::UNKNOWN] * rhs_occupied +
+                    l[TBM::OCCUPIED] * rhs_unknown +
+                    l[TBM::OCCUPIED] * rhs_occupied;
+  double weight = unknown + empty + occupied;
+  if (weight == 0.0) { return TBM{}; }
+  return TBM{unknown / weight, empty / weight, occupied / weight, 0.0};
+}
+
 TBM disjunctive(const TBM& lhs, const TBM& rhs) {
   static const std::size_t max_belief { static_cast<std::size_t>(TBM::MAX_BELIEF) };
   static_assert(max_belief != 0, "static_cast from TBM::MAX_BELIEF to std::size_t fails");
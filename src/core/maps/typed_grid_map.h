@@ -0,0 +1,80 @@
+#ifndef SLAM_CTOR_CORE_TYPED_GRID_MAP_H
+#define SLAM_CTOR_CORE_TYPED_GRID_MAP_H
+
+#include <memory>
+#include <cassert>
+#include <typeinfo>
+
+#include "plain_grid_map.h"
+
+/* An unbounded plain map of cells of the given type.
+ * Cell operations are called with qualified names, so the compiler is able
+ * to inline them; the GridMap API is implemented on top of the typed one,
+ * so the map can be used as a regular GridMap (e.g. by publishers/dumpers).
+ * NB: CellT must be the most derived type of the stored cells.
+ */
+template <typename CellT>
+class TypedGridMap final
+  : public GenericUnboundedPlainGridMap<ValueCellStorage<CellT>> {
+private: // types
+  using Base = GenericUnboundedPlainGridMap<ValueCellStorage<CellT>>;
+public:
+  using typename Base::Coord;
+  using Cell = CellT;
+public: // methods
+  TypedGridMap(std::shared_ptr<GridCell> prototype,
+               const GridMapParams &params = MapValues::gmp)
+    : Base{prototype, params}
+    , _unknown_cell{ValueCellStorage<CellT>::make(*prototype)} {}
+
+  /* == Typed API == */
+
+  const CellT &cell(const Coord &area_id) const {
+    auto ic = this->external2internal(area_id);
+    if (!this->has_internal_cell(ic)) { return _unknown_cell; }
+    return this->_cells[this->cell_index(ic)];
+  }
+
+  /* == GridMap API == */
+
+  void update(const Coord &area_id,
+              const AreaOccupancyObservation &aoo) override {
+    mutable_cell(area_id).CellT::operator+=(aoo);
+    this->on_area_modified(area_id);
+  }
+
+  void reset(const Coord &area_id, const GridCell &new_area) override {
+    assert(typeid(new_area) == typeid(CellT));
+    mutable_cell(area_id) = static_cast<const CellT &>(new_area);
+    this->on_area_modified(area_id);
+  }
+
+  const GridCell &operator[](const Coord &area_id) const override {
+    return cell(area_id);
+  }
+
+  double occupancy(const Coord &area_id) const override {
+    return cell(area_id).CellT::occupancy().prob_occ;
+  }
+
+  double discrepancy(const Coord &area_id,
+                     const AreaOccupancyObservation &aoo) const override {
+    return cell(area_id).CellT::discrepancy(aoo);
+  }
+
+  std::shared_ptr<const GridMap> snapshot() const override {
+    return std::make_shared<TypedGridMap>(*this);
+  }
+
+private: // methods
+  CellT &mutable_cell(const Coord &area_id) {
+    this->ensure_inside(area_id);
+    auto ic = this->external2internal(area_id);
+    return this->_cells[this->cell_index(ic)];
+  }
+
+private: // fields
+  CellT _unknown_cell;
+};
+
+#endif
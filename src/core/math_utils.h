@@ -4,6 +4,16 @@
 #include <cmath>
 #include <limits>
 
+// The floating point type of geometry and state primitives (points,
+// rectangles, poses, occupancies, scan points). The single-precision build
+// (SLAM_CTOR_SINGLE_PRECISION) halves memory taken by scans and geometry;
+// derived values (e.g. probabilities, scores) stay double.
+#ifdef SLAM_CTOR_SINGLE_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
+
 // TODO: add unit tests for math utils
 
 template <typename T>
@@ -15,7 +25,8 @@ constexpr inline bool are_equal(const T& a, const T& b, const T& eps) {
 constexpr inline bool are_equal(double a, double b) {
   // cmp doubles according to http://realtimecollisiondetection.net/blog/?p=89
   double eps_scale = std::max(1.0, std::max(std::abs(a), std::abs(b)));
-  constexpr double Eps = 1e-7; // num_limits::epsilon is too small
+  // NB: num_limits::epsilon is too small
+  constexpr double Eps = sizeof(Real) < sizeof(double) ? 1e-5 : 1e-7;
   return are_equal(a, b, Eps * eps_scale);
 }
 
@@ -1,11 +1,18 @@
 #ifndef SLAM_CTOR_PARTICLE_FILTER_H_INCLUDED
 #define SLAM_CTOR_PARTICLE_FILTER_H_INCLUDED
 
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <random>
+#include <algorithm>
 #include <unordered_set>
 
+#include "random_utils.h"
+
 /* An element of ParticleFilter. Used to approximate target distribution */
 class Particle {
 public:
@@ -24,46 +31,253 @@ template <typename ParticleT>
 class ParticleFactory {
 public:
   virtual std::shared_ptr<ParticleT> create_particle() = 0;
+
+  // A copy of a particle (e.g. a resampled one)
+  // PERFORMANCE: factories of particles that are expensive to create
+  //              (e.g. ones with maps) are expected to copy-construct them.
+  virtual std::shared_ptr<ParticleT> clone_particle(const ParticleT &p) {
+    auto copy = create_particle();
+    *copy = p;
+    return copy;
+  }
+
   virtual ~ParticleFactory() = default;
 };
 
-template <typename ParticlePtr>
-class UniformResamling { /* Strategy */
+/* A strategy that picks indices of particles that survive resampling.
+ * An index is picked as many times as a particle is copied. */
+class ParticleResampler {
 public:
-  // TODO: should be moved to separate strategy
-  bool resampling_is_required(std::vector<ParticlePtr> particles) {
-    // TODO: resampling is not required if robot haven't traveled far enough
-    // Computer N_eff from gMapping (based on Doucet work)
-    double sq_sum = 0;
-    for (auto &p : particles) {
-      sq_sum += p->weight() * p->weight();
-    }
-    double effective_particles_cnt = 1.0 / sq_sum;
-    return effective_particles_cnt * 2 < particles.size();
-  }
-
-  std::vector<unsigned> resample(std::vector<ParticlePtr> particles) {
-    // TODO: implement O(n) resampling from gmapping
-    //double total_weight = 0;
-    //for (auto &p : particles) { total_weight += particles.weight; }
-    std::vector<unsigned> new_particle_inds(particles.size());
-
-    std::random_device rd;
-    std::mt19937 engine(rd());
-    std::uniform_real_distribution<> uniform_distr(0, 1);
-    for (uint i = 0; i < particles.size(); i++) {
-      double sample = uniform_distr(engine);
-      double total_w = 0;
-      for (uint j = 0; j < particles.size(); j++) {
-        total_w += particles[j]->weight();
-        if (sample < total_w) {
-          new_particle_inds[i] = j;
-          break;
-        }
+  using Engine = Xoshiro256PlusPlus;
+public:
+  ParticleResampler(unsigned seed = std::random_device{}()) : _engine{seed} {}
+  virtual ~ParticleResampler() = default;
+
+  // Fills indices with weights.size() picks (weights may be unnormalized)
+  void resample(const std::vector<double> &weights,
+                std::vector<unsigned> &indices) {
+    resample(weights, weights.size(), indices);
+  }
+
+  // Fills indices with picks_nm picks (e.g. to change the particles number)
+  void resample(const std::vector<double> &weights, std::size_t picks_nm,
+                std::vector<unsigned> &indices) {
+    indices.clear();
+    if (weights.empty() || picks_nm == 0) { return; }
+    pick(weights, picks_nm, indices);
+  }
+
+protected: // methods
+
+  // Appends picks_nm picks to indices; weights are not empty
+  virtual void pick(const std::vector<double> &weights, std::size_t picks_nm,
+                    std::vector<unsigned> &indices) = 0;
+
+  double uniform(double from, double to) {
+    return std::uniform_real_distribution<>{from, to}(_engine);
+  }
+
+  // Picks an index per position of a cumulative weight; positions are
+  // generated in ascending order, so weights are scanned once.
+  template <typename PositionGenerator>
+  static void pick_ascending(const std::vector<double> &weights,
+                             std::size_t picks_nm, PositionGenerator &&next,
+                             std::vector<unsigned> &indices) {
+    if (weights.empty()) { return; }
+    auto last_i = unsigned(weights.size() - 1);
+    unsigned i = 0;
+    auto cumulative_weight = weights[0];
+    for (std::size_t pick_i = 0; pick_i < picks_nm; ++pick_i) {
+      auto position = next(pick_i);
+      // NB: particles with zero weights are never picked
+      while (cumulative_weight <= position && i < last_i) {
+        cumulative_weight += weights[++i];
       }
+      indices.push_back(i);
+    }
+  }
+
+  static double total_weight(const std::vector<double> &weights) {
+    auto total = double{0};
+    for (auto w : weights) { total += w; }
+    return total;
+  }
+
+private: // fields
+  Engine _engine;
+};
+
+/* Picks i.i.d. positions. Sorted positions are generated directly
+ * (as normalized cumulative sums of exponential variates), so the
+ * resampling is O(n) instead of a search per pick. */
+class MultinomialResampler : public ParticleResampler {
+public:
+  using ParticleResampler::ParticleResampler;
+
+protected: // methods
+  void pick(const std::vector<double> &weights, std::size_t picks_nm,
+            std::vector<unsigned> &indices) override {
+    _positions.resize(picks_nm + 1);
+    auto sum = double{0};
+    for (auto &position : _positions) {
+      sum -= std::log(uniform(std::numeric_limits<double>::min(), 1));
+      position = sum;
+    }
+    auto scale = total_weight(weights) / sum;
+    pick_ascending(weights, picks_nm,
+                   [&](std::size_t i) { return _positions[i] * scale; },
+                   indices);
+  }
+
+private: // fields
+  std::vector<double> _positions;
+};
+
+/* Picks positions with a single random offset in evenly spaced strata
+ * (low-variance resampling, used by gmapping). A particle with weight w
+ * is picked floor(n*w) or ceil(n*w) times. */
+class SystematicResampler : public ParticleResampler {
+public:
+  using ParticleResampler::ParticleResampler;
+
+protected: // methods
+  void pick(const std::vector<double> &weights, std::size_t picks_nm,
+            std::vector<unsigned> &indices) override {
+    auto step = total_weight(weights) / picks_nm;
+    auto offset = uniform(0, step);
+    pick_ascending(weights, picks_nm,
+                   [&](std::size_t i) { return offset + i * step; },
+                   indices);
+  }
+};
+
+/* Picks a random position in each of evenly spaced strata */
+class StratifiedResampler : public ParticleResampler {
+public:
+  using ParticleResampler::ParticleResampler;
+
+protected: // methods
+  void pick(const std::vector<double> &weights, std::size_t picks_nm,
+            std::vector<unsigned> &indices) override {
+    auto step = total_weight(weights) / picks_nm;
+    pick_ascending(weights, picks_nm,
+                   [&](std::size_t i) { return (i + uniform(0, 1)) * step; },
+                   indices);
+  }
+};
+
+/* Copies a particle with weight w floor(n*w) times and picks the rest
+ * systematically by residual weights. */
+class ResidualResampler : public ParticleResampler {
+public:
+  using ParticleResampler::ParticleResampler;
+
+protected: // methods
+  void pick(const std::vector<double> &weights, std::size_t picks_nm,
+            std::vector<unsigned> &indices) override {
+    auto copies_per_weight = picks_nm / total_weight(weights);
+    _residuals.resize(weights.size());
+    auto residual_total = double{0};
+    for (unsigned i = 0; i < weights.size(); ++i) {
+      auto copies = weights[i] * copies_per_weight;
+      auto full_copies_nm = std::floor(copies);
+      indices.insert(indices.end(), std::size_t(full_copies_nm), i);
+      _residuals[i] = copies - full_copies_nm;
+      residual_total += _residuals[i];
+    }
+    // NB: full copies may exceed picks_nm because of rounding errors
+    if (picks_nm <= indices.size()) {
+      indices.resize(picks_nm);
+      return;
     }
-    return new_particle_inds;
+    auto residual_picks_nm = picks_nm - indices.size();
+    auto step = residual_total / residual_picks_nm;
+    auto offset = uniform(0, step);
+    pick_ascending(_residuals, residual_picks_nm,
+                   [&](std::size_t i) { return offset + i * step; },
+                   indices);
   }
+
+private: // fields
+  std::vector<double> _residuals;
+};
+
+/* A strategy that chooses the number of particles on resampling */
+template <typename ParticleT>
+class ParticlesNumberAdaptation {
+public:
+  using ParticlePtr = std::shared_ptr<ParticleT>;
+public:
+  virtual ~ParticlesNumberAdaptation() = default;
+
+  // The number of particles to resample given the picked ones
+  // (i.e. the resampling that keeps the number)
+  virtual std::size_t particles_nm(const std::vector<ParticlePtr> &particles,
+                                   const std::vector<unsigned> &picked) = 0;
+};
+
+/* KLD-sampling (Fox, 2003): the number of particles is enough to keep
+ * the KL-divergence between the sampled and the true posterior below
+ * max_error with probability 1 - delta given the number k of pose bins
+ * the particles occupy, i.e. it grows with spread of the particles.
+ * NB: the bins are counted for particles picked at the current number
+ *     instead of picking particles until the number is reached, since
+ *     picks of low-variance resamplers are ordered by particles.
+ *     ParticleT is expected to provide pose() with x, y and theta. */
+template <typename ParticleT>
+class KldParticlesNumberAdaptation
+  : public ParticlesNumberAdaptation<ParticleT> {
+public:
+  using typename ParticlesNumberAdaptation<ParticleT>::ParticlePtr;
+  struct Params {
+    std::size_t min_particles_nm = 10, max_particles_nm = 100;
+    double bin_size_xy = 0.5, bin_size_theta = 0.2;
+    double max_error = 0.05;
+    // the upper 1 - delta quantile of the standard normal distribution
+    double upper_quantile = 2.326; // delta = 0.01
+  };
+public:
+  KldParticlesNumberAdaptation(const Params &params) : _params{params} {}
+
+  std::size_t particles_nm(const std::vector<ParticlePtr> &particles,
+                           const std::vector<unsigned> &picked) override {
+    _bins.clear();
+    for (auto i : picked) { _bins.insert(bin_id(particles[i]->pose())); }
+    auto required_nm = required_particles_nm(_bins.size(), _params.max_error,
+                                             _params.upper_quantile);
+    auto min_nm = std::max<std::size_t>(_params.min_particles_nm, 1);
+    auto max_nm = std::max(_params.max_particles_nm, min_nm);
+    return std::min(std::max(std::size_t(std::ceil(required_nm)), min_nm),
+                    max_nm);
+  }
+
+  // The Wilson-Hilferty approximation of the chi-square quantile
+  static double required_particles_nm(std::size_t bins_nm, double max_error,
+                                      double upper_quantile) {
+    if (bins_nm < 2) { return 0; }
+    auto k = double(bins_nm - 1);
+    auto a = 2 / (9 * k);
+    auto b = 1 - a + std::sqrt(a) * upper_quantile;
+    return k / (2 * max_error) * b * b * b;
+  }
+
+private: // methods
+
+  template <typename PoseT>
+  uint64_t bin_id(const PoseT &pose) const {
+    // NB: 21 bits per coordinate, so bins of far poses may coincide
+    static constexpr uint64_t Mask = (uint64_t(1) << 21) - 1;
+    auto theta = std::remainder(pose.theta, 2 * M_PI);
+    auto x = uint64_t(int64_t(std::floor(pose.x / _params.bin_size_xy)));
+    auto y = uint64_t(int64_t(std::floor(pose.y / _params.bin_size_xy)));
+    auto t = uint64_t(int64_t(std::floor(theta / _params.bin_size_theta)));
+    return ((x & Mask) << 42) | ((y & Mask) << 21) | (t & Mask);
+  }
+
+private: // fields
+  Params _params;
+  // a buffer reused by adaptations
+  std::unordered_set<uint64_t> _bins;
 };
 
 template <typename ParticleT>
@@ -72,57 +286,95 @@ private:
   using ParticlePtr = std::shared_ptr<ParticleT>;
 public: // methods
   ParticleFilter(std::shared_ptr<ParticleFactory<ParticleT>> p_ftry,
-                 unsigned n = 1) : _particle_supplier{p_ftry} {
+                 unsigned n = 1)
+    : _particle_supplier{p_ftry}
+    , _resampler{std::make_shared<SystematicResampler>()} {
+    reset_particles(n);
+  }
+
+  // Replaces particles with n new equally heavy ones
+  // (e.g. to restore saved particles).
+  void reset_particles(unsigned n) {
+    _particles.clear();
     for (unsigned i = 0; i < n; i++) {
-      ParticlePtr particle = p_ftry->create_particle();
+      ParticlePtr particle = _particle_supplier->create_particle();
       particle->set_weight(1.0 / n);
       _particles.push_back(particle);
     }
+    // NB: the last one of equally heavy particles is the heaviest
+    _heaviest_i = n ? n - 1 : 0;
+  }
+
+  void set_resampler(std::shared_ptr<ParticleResampler> resampler) {
+    _resampler = resampler;
+  }
+
+  // NB: the number of particles is kept if the adaptation is not set
+  void set_particles_nm_adaptation(
+      std::shared_ptr<ParticlesNumberAdaptation<ParticleT>> adaptation) {
+    _particles_nm_adaptation = adaptation;
   }
 
   bool try_resample() {
     // TODO: heuristic with traveled distange, move to common sample_particles
-    if (!_resampler.resampling_is_required(_particles)) {
+    collect_weights();
+    if (!resampling_is_required()) {
       return false;
     }
 
-    std::vector<ParticlePtr> new_particles;
-    std::unordered_set<unsigned> new_part_inds;
-    for (unsigned i : _resampler.resample(_particles)) {
-      ParticlePtr sampled = _particles[i];
-      if (new_part_inds.count(i)) {
-        ParticlePtr new_particle = _particle_supplier->create_particle();
-        *new_particle = *sampled;
-        new_particle->sample();
-        sampled = new_particle;
+    _resampler->resample(_weights, _resampled_inds);
+    if (_particles_nm_adaptation) {
+      auto particles_nm = _particles_nm_adaptation->particles_nm(
+        _particles, _resampled_inds);
+      if (particles_nm != _resampled_inds.size()) {
+        _resampler->resample(_weights, particles_nm, _resampled_inds);
+      }
+    }
+
+    // PERFORMANCE: a picked particle is moved to its first position;
+    //              copies (re-sampled) are made only for repeated picks.
+    static constexpr auto Not_Picked = std::numeric_limits<unsigned>::max();
+    _new_positions.assign(_particles.size(), Not_Picked);
+    _resampled_particles.clear();
+    _resampled_particles.reserve(_resampled_inds.size());
+    _weights.clear();
+    for (unsigned i : _resampled_inds) {
+      auto &new_position = _new_positions[i];
+      if (new_position == Not_Picked) {
+        new_position = _resampled_particles.size();
+        _resampled_particles.push_back(std::move(_particles[i]));
       } else {
-        new_part_inds.insert(i);
+        auto copy = _particle_supplier->clone_particle(
+          *_resampled_particles[new_position]);
+        copy->sample();
+        _resampled_particles.push_back(std::move(copy));
       }
-      new_particles.push_back(sampled);
+      _weights.push_back(_resampled_particles.back()->weight());
     }
-    _particles = std::move(new_particles);
-    normalize_weights();
+    _particles.swap(_resampled_particles);
+    // NB: releases particles that have not been picked
+    _resampled_particles.clear();
+    normalize_collected_weights();
     return true;
   }
 
   void normalize_weights() {
-    double total_weight = 0;
-    for (auto &p : _particles) { total_weight += p->weight(); }
-    for (auto &p : _particles) { p->set_weight(p->weight() / total_weight); }
+    collect_weights();
+    normalize_collected_weights();
   }
 
+  // PERFORMANCE: the heaviest particle is tracked by normalizations,
+  //              so it is accessed in O(1).
+  // NB: weights that are updated by particles are taken into account
+  //     once they are normalized (see normalize_weights).
   const ParticleT& heaviest_particle() const {
-    const ParticleT *heaviest = nullptr;
-    for (auto &p : particles()) {
-      if (heaviest && p->weight() < heaviest->weight()) { continue; }
-      heaviest = p.get();
-    }
-    return *heaviest;
+    assert(_heaviest_i < _particles.size());
+    return *_particles[_heaviest_i];
   }
 
   ParticleT& heaviest_particle() {
-    return const_cast<ParticleT&>(
-      static_cast<const ParticleFilter<ParticleT>>(*this).heaviest_particle());
+    assert(_heaviest_i < _particles.size());
+    return *_particles[_heaviest_i];
   }
 
   inline std::vector<ParticlePtr>& particles() { return _particles; }
@@ -130,11 +382,51 @@ public: // methods
     return _particles;
   }
 
+private:
+  // NB: particles update own weights (e.g. on observations),
+  //     so the weights are collected before they are processed
+  void collect_weights() {
+    _weights.clear();
+    for (auto &p : _particles) { _weights.push_back(p->weight()); }
+  }
+
+  void normalize_collected_weights() {
+    double total_weight = 0;
+    for (auto w : _weights) { total_weight += w; }
+    _heaviest_i = 0;
+    for (std::size_t i = 0; i < _particles.size(); ++i) {
+      _weights[i] /= total_weight;
+      _particles[i]->set_weight(_weights[i]);
+      if (_weights[_heaviest_i] <= _weights[i]) { _heaviest_i = i; }
+    }
+  }
+
+  // TODO: should be moved to separate strategy
+  bool resampling_is_required() const {
+    // TODO: resampling is not required if robot haven't traveled far enough
+    // Computer N_eff from gMapping (based on Doucet work)
+    // NB: collected weights may be unnormalized
+    double sum = 0, sq_sum = 0;
+    for (auto w : _weights) {
+      sum += w;
+      sq_sum += w * w;
+    }
+    double effective_particles_cnt = sum * sum / sq_sum;
+    return effective_particles_cnt * 2 < _weights.size();
+  }
+
 private:
   std::shared_ptr<ParticleFactory<ParticleT>> _particle_supplier;
   std::vector<ParticlePtr> _particles;
-  /* TODO: make template parameter/set at runtime */
-  UniformResamling<ParticlePtr> _resampler;
+  std::shared_ptr<ParticleResampler> _resampler;
+  std::shared_ptr<ParticlesNumberAdaptation<ParticleT>>
+    _particles_nm_adaptation;
+  // weights of particles (in the same order)
+  std::vector<double> _weights;
+  std::size_t _heaviest_i = 0;
+  // buffers reused by resamplings
+  std::vector<unsigned> _resampled_inds, _new_positions;
+  std::vector<ParticlePtr> _resampled_particles;
 };
 
 #endif // header-guard
@@ -1,8 +1,197 @@
 #ifndef SLAM_CTOR_CORE_RANDOM_UTILS_H
 #define SLAM_CTOR_CORE_RANDOM_UTILS_H
 
+#include <cmath>
+#include <array>
+#include <limits>
+#include <memory>
+#include <cstdint>
 #include <random>
 
+// Random engines
+
+// A generator that mixes a counter (Steele et al., "Fast splittable
+// pseudorandom number generators"); it seeds other engines.
+class SplitMix64 {
+public:
+  explicit SplitMix64(uint64_t seed) : _state{seed} {}
+
+  uint64_t operator()() {
+    auto z = (_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+private:
+  uint64_t _state;
+};
+
+/* xoshiro256++ (Blackman, Vigna) satisfying UniformRandomBitGenerator.
+ * PERFORMANCE: the state is 32 bytes (std::mt19937 keeps ~5 KB),
+ *              so an engine per particle is cheap to keep and to copy;
+ *              a number is a few shifts and additions.
+ * An engine is defined by a seed and a stream id, so independent engines
+ * (e.g. of particles) are derived from one master seed reproducibly
+ * (see RandomStreams). */
+class Xoshiro256PlusPlus {
+public: // types
+  using result_type = uint64_t;
+public: // methods
+  explicit Xoshiro256PlusPlus(uint64_t seed = 0, uint64_t stream_id = 0) {
+    // NB: states of streams are seeded by different SplitMix64 sequences,
+    //     their overlaps are negligible given the 2^256 - 1 period
+    auto seeder = SplitMix64{seed ^ SplitMix64{stream_id}()};
+    for (auto &word : _state) { word = seeder(); }
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    auto result = rotl(_state[0] + _state[3], 23) + _state[0];
+    auto t = _state[1] << 17;
+    _state[2] ^= _state[0];
+    _state[3] ^= _state[1];
+    _state[1] ^= _state[2];
+    _state[0] ^= _state[3];
+    _state[2] ^= t;
+    _state[3] = rotl(_state[3], 45);
+    return result;
+  }
+
+  bool operator==(const Xoshiro256PlusPlus &that) const {
+    return _state == that._state;
+  }
+  bool operator!=(const Xoshiro256PlusPlus &that) const {
+    return !(*this == that);
+  }
+
+private: // methods
+  static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+private: // fields
+  std::array<uint64_t, 4> _state;
+};
+
+// Engines of consequent streams of a master seed,
+// e.g. an engine per particle that is created or copied
+class RandomStreams {
+public:
+  explicit RandomStreams(uint64_t master_seed) : _seed{master_seed} {}
+
+  Xoshiro256PlusPlus next_engine() {
+    return Xoshiro256PlusPlus{_seed, _next_stream_id++};
+  }
+
+private:
+  uint64_t _seed;
+  uint64_t _next_stream_id = 0;
+};
+
+// 64 random bits of an engine of either 32 or 64 bits (e.g. std::mt19937)
+template <typename Engine>
+uint64_t random_bits64(Engine &engine, std::true_type /*is 64-bit*/) {
+  return uint64_t(engine());
+}
+
+template <typename Engine>
+uint64_t random_bits64(Engine &engine, std::false_type) {
+  static_assert(Engine::min() == 0 && 0xffffffffull <= Engine::max(),
+                "An engine of at least 32 bits is expected");
+  auto high = uint64_t(engine() & 0xffffffffull);
+  return (high << 32) | uint64_t(engine() & 0xffffffffull);
+}
+
+template <typename Engine>
+uint64_t random_bits64(Engine &engine) {
+  using Is64Bit = std::integral_constant<
+    bool, Engine::min() == 0 &&
+          Engine::max() == std::numeric_limits<uint64_t>::max()>;
+  return random_bits64(engine, Is64Bit{});
+}
+
+// A uniform double in (0, 1) made of the 53 upper bits
+inline double open_unit_interval(uint64_t bits) {
+  return ((bits >> 11) + 0.5) * (1.0 / (uint64_t{1} << 53));
+}
+
+/* Samples the standard normal distribution by the ziggurat method
+ * (Marsaglia, Tsang, "The ziggurat method for generating random
+ * variables"; 128 layers).
+ * PERFORMANCE: ~99% of samples take a random number, a table lookup and
+ *              a multiplication; neither logarithms nor cached pairs
+ *              (as std::normal_distribution does), so a sample depends
+ *              only on the engine state.
+ * NB: the layer and the value are taken from different bits of a number. */
+class ZigguratNormal {
+public:
+  template <typename Engine>
+  static double sample(Engine &engine) {
+    auto &t = tables();
+    while (true) {
+      auto bits = random_bits64(engine);
+      auto layer = unsigned(bits & (Layers_Nm - 1));
+      auto hz = int32_t(uint32_t(bits >> 32));
+      auto x = hz * t.w[layer];
+      if (uint32_t(std::abs(int64_t(hz))) < t.k[layer]) { return x; }
+
+      if (layer == 0) { // the tail beyond R
+        double tail_x, tail_y;
+        do {
+          tail_x = -std::log(open_unit_interval(random_bits64(engine))) / R;
+          tail_y = -std::log(open_unit_interval(random_bits64(engine)));
+        } while (tail_y + tail_y < tail_x * tail_x);
+        return 0 < hz ? R + tail_x : -R - tail_x;
+      }
+      // the wedge of the layer
+      auto u = open_unit_interval(random_bits64(engine));
+      if (t.f[layer] + u * (t.f[layer - 1] - t.f[layer]) <
+          std::exp(-0.5 * x * x)) {
+        return x;
+      }
+    }
+  }
+
+private: // consts
+  static constexpr unsigned Layers_Nm = 128;
+  // the start of the tail and the area of a layer
+  static constexpr double R = 3.442619855899, V = 9.91256303526217e-3;
+private: // types
+  struct Tables {
+    std::array<uint32_t, Layers_Nm> k;
+    std::array<double, Layers_Nm> w, f;
+
+    Tables() {
+      const double M = 2147483648.0; // 2^31
+      double dn = R, tn = R;
+      auto q = V / std::exp(-0.5 * dn * dn);
+      k[0] = uint32_t((dn / q) * M);
+      k[1] = 0;
+      w[0] = q / M;
+      w[Layers_Nm - 1] = dn / M;
+      f[0] = 1;
+      f[Layers_Nm - 1] = std::exp(-0.5 * dn * dn);
+      for (unsigned i = Layers_Nm - 2; 1 <= i; --i) {
+        dn = std::sqrt(-2 * std::log(V / dn + std::exp(-0.5 * dn * dn)));
+        k[i + 1] = uint32_t((dn / tn) * M);
+        tn = dn;
+        f[i] = std::exp(-0.5 * dn * dn);
+        w[i] = dn / M;
+      }
+    }
+  };
+private: // methods
+  static const Tables &tables() {
+    static const Tables tables;
+    return tables;
+  }
+};
+
 // Random variables
 
 template<typename T>
@@ -17,10 +206,11 @@ template <typename Engine>
 class GaussianRV1D : public RandomVariable1D<Engine> {
 public:
   GaussianRV1D(double mean, double stddev)
-    : _mean{mean}, _stddev{stddev}, _distr{_mean, _stddev} {}
+    : _mean{mean}, _stddev{stddev} {}
 
+  // PERFORMANCE: sampled by the ziggurat method (see ZigguratNormal)
   double sample(Engine &rnd_engine) override {
-    return _distr(rnd_engine);
+    return _mean + _stddev * ZigguratNormal::sample(rnd_engine);
   }
 
   std::unique_ptr<RandomVariable1D<Engine>> clone() const override {
@@ -30,7 +220,6 @@ public:
 private:
   double _mean;
   double _stddev;
-  std::normal_distribution<> _distr;
 };
 
 template <typename Engine>
@@ -53,4 +242,49 @@ private:
   std::uniform_real_distribution<> _distr;
 };
 
+// Quasi-random sequences
+
+// The radical inverse of an index in a given base, i.e. the index coordinate
+// of the Halton sequence in the dimension with the base.
+inline double radical_inverse(unsigned base, uint64_t index) {
+  auto inverse = double{0};
+  auto digit_weight = 1.0 / base;
+  while (index) {
+    inverse += (index % base) * digit_weight;
+    index /= base;
+    digit_weight /= base;
+  }
+  return inverse;
+}
+
+// The quantile function (the inverse CDF) of the standard normal
+// distribution, p in (0, 1).
+// Acklam's rational approximation, the relative error is below 1.15e-9.
+inline double standard_normal_quantile(double p) {
+  static constexpr double A[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+                                 -2.759285104469687e+02, 1.383577518672690e+02,
+                                 -3.066479806614716e+01, 2.506628277459239e+00};
+  static constexpr double B[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+                                 -1.556989798598866e+02, 6.680131188771972e+01,
+                                 -1.328068155288572e+01};
+  static constexpr double C[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                                 -2.400758277161838e+00, -2.549732539343734e+00,
+                                 4.374664141464968e+00, 2.938163982698783e+00};
+  static constexpr double D[] = {7.784695709041462e-03, 3.224671290700398e-01,
+                                 2.445134137142996e+00, 3.754408661907416e+00};
+  static constexpr double P_Low = 0.02425;
+
+  if (p < P_Low) { // the lower tail
+    auto q = std::sqrt(-2 * std::log(p));
+    return (((((C[0]*q + C[1])*q + C[2])*q + C[3])*q + C[4])*q + C[5]) /
+           ((((D[0]*q + D[1])*q + D[2])*q + D[3])*q + 1);
+  }
+  if (1 - P_Low < p) { // the upper tail
+    return -standard_normal_quantile(1 - p);
+  }
+  auto q = p - 0.5, r = q * q;
+  return (((((A[0]*r + A[1])*r + A[2])*r + A[3])*r + A[4])*r + A[5])*q /
+         (((((B[0]*r + B[1])*r + B[2])*r + B[3])*r + B[4])*r + 1);
+}
+
 #endif
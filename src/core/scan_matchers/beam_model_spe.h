@@ -0,0 +1,138 @@
+#ifndef SLAM_CTOR_CORE_BEAM_MODEL_SPE_H
+#define SLAM_CTOR_CORE_BEAM_MODEL_SPE_H
+
+#include <cmath>
+#include <memory>
+#include <algorithm>
+
+#include "grid_scan_matcher.h"
+#include "weighted_mean_point_probability_spe.h"
+#include "../maps/expected_range_cache.h"
+
+/* Scores a scan by measured ranges of beams against expected ones,
+ * i.e. free space along beams is taken into account in addition to
+ * obstacles at scan points (see WeightedMeanPointProbabilitySPE).
+ * A beam probability is a mix of a hit (a gaussian of the range error)
+ * and of a random measurement (e.g. glass, dynamic obstacles);
+ * a free beam (see ScanPoint2D::is_occupied) is only penalized
+ * by obstacles in front of its end.
+ * The scan probability is the weighted mean of beams probabilities.
+ * Expected ranges are looked up in the cache (see ExpectedRangeCache),
+ * so a beam costs about the same as a point of the endpoint matching.
+ * NB: the sensor is assumed to be in the robot's origin;
+ *     the occupancy observation probability estimator is not used. */
+class BeamModelSPE : public ScanProbabilityEstimator {
+private: // types
+  using SPW = std::shared_ptr<ScanPointWeighting>;
+public: // consts
+  // the number of beams estimated between checks of the rejection
+  // threshold (see SPEParams::rejection_threshold)
+  static constexpr std::size_t Rejection_Check_Period = 16;
+public:
+  BeamModelSPE(OOPE oope, SPW spw,
+               const ExpectedRangeCacheParams &cache_params = {},
+               double hit_sigma = 0.1, double random_weight = 0.05,
+               unsigned skip_rate = 0)
+    : ScanProbabilityEstimator{oope}, _spw{spw}, _ranges{cache_params}
+    , _inv_2_sigma_sq{1.0 / (2 * hit_sigma * hit_sigma)}
+    , _random_weight{random_weight}, _pts_skip_rate{skip_rate} {}
+
+  using ScanProbabilityEstimator::estimate_scan_probability;
+
+  const ExpectedRangeCache &expected_ranges() const { return _ranges; }
+
+  LaserScan2D filter_scan(const LaserScan2D &raw_scan, const RobotPose &pose,
+                          const GridMap &map) override {
+    _ranges.sync(map);
+
+    LaserScan2D scan;
+    scan.trig_provider = raw_scan.trig_provider;
+    scan.trig_provider->set_base_angle(pose.theta);
+    const auto &raw_points = raw_scan.points();
+    for (LaserScan2D::Points::size_type i = 0; i < raw_points.size(); ++i) {
+      if (_pts_skip_rate && i % _pts_skip_rate) { continue; }
+      scan.points().push_back(raw_points[i]);
+    }
+
+    // NB: the scan is estimated for many poses
+    scan.update_soa();
+    _spw->reset(scan);
+    auto weights = std::make_shared<ScanPointWeights>();
+    _spw->weights(scan, weights->values);
+    const auto &soa = scan.soa();
+    for (std::size_t i = 0; i < soa.size(); ++i) {
+      // NB: a point may represent several ones (e.g. a downsampled scan)
+      weights->values[i] *= soa.factors[i];
+      weights->total += weights->values[i];
+    }
+    scan.set_point_weights(weights);
+    return scan;
+  }
+
+  double estimate_scan_probability(const LaserScan2D &scan,
+                                   const RobotPose &pose,
+                                   const GridMap &map,
+                                   const SPEParams &params) const override {
+    // NB: the filtering is optional (see GridScanMatcher)
+    _ranges.sync(map);
+
+    const auto *weights = scan.point_weights();
+    const auto &points = scan.points();
+    auto total_weight = double{0};
+    if (weights) {
+      total_weight = weights->total;
+    } else {
+      _spw->reset(scan);
+      for (LaserScan2D::Points::size_type i = 0; i < points.size(); ++i) {
+        total_weight += _spw->weight(points, i) * points[i].factor();
+      }
+    }
+    if (total_weight == 0) {
+      // TODO: replace with writing to a proper logger
+      std::clog << "WARNING: unknown probability" << std::endl;
+      return unknown_probability();
+    }
+
+    auto max_range = _ranges.params().max_range;
+    auto origin = pose.point();
+    // NB: NaN (an unknown probability) never rejects
+    auto rejection_threshold = params.rejection_threshold * total_weight;
+    auto total_probability = double{0}, remaining_weight = total_weight;
+    for (LaserScan2D::Points::size_type i = 0; i < points.size(); ++i) {
+      const auto &sp = points[i];
+      auto angle = sp.angle() + (params.scan_is_prerotated ? 0 : pose.theta);
+      auto expected = _ranges.expected_range(map, origin, angle);
+      auto measured = std::min(double(sp.range()), max_range);
+      auto error = measured - expected;
+      if (!sp.is_occupied()) { error = std::max(error, 0.0); }
+
+      auto sp_weight = weights ? weights->values[i] :
+                                 _spw->weight(points, i) * sp.factor();
+      total_probability += sp_weight * beam_probability(error);
+      remaining_weight -= sp_weight;
+      if ((i + 1) % Rejection_Check_Period == 0 &&
+          total_probability + remaining_weight <= rejection_threshold) {
+        return (total_probability + remaining_weight) / total_weight;
+      }
+    }
+    return total_probability / total_weight;
+  }
+
+private: // methods
+
+  double beam_probability(double range_error) const {
+    auto hit = std::exp(-range_error * range_error * _inv_2_sigma_sq);
+    return (1 - _random_weight) * hit + _random_weight;
+  }
+
+private: // fields
+  SPW _spw;
+  // NB: tiles of the cache are filled by estimations
+  mutable ExpectedRangeCache _ranges;
+  double _inv_2_sigma_sq, _random_weight;
+  unsigned _pts_skip_rate;
+};
+
+constexpr std::size_t BeamModelSPE::Rejection_Check_Period;
+
+#endif
@@ -6,6 +6,7 @@
 #include "grid_scan_matcher.h"
 #include "m3rsm_engine.h"
 #include "../maps/rescalable_caching_grid_map.h"
+#include "../maps/max_pooled_score_pyramid.h"
 #include "../geometry_primitives.h"
 
 class BruteForceMultiResolutionScanMatcher : public GridScanMatcher {
@@ -25,6 +26,20 @@ public:
     _transl_step = translation_step;
   }
 
+  // NB: the found match doesn't depend on the threads number
+  //     (see M3RSMEngine::set_expansion_threads_nm)
+  void set_estimation_threads_nm(unsigned threads_nm) {
+    _engine.set_expansion_threads_nm(threads_nm);
+  }
+
+  // If set, bounds are looked up in a score pyramid that is kept by
+  // the matcher and refreshed from the map per scan (see
+  // MaxPooledScorePyramid) instead of estimated by the SPE with a rescaled
+  // map. The SPE estimates the probability of the found pose only.
+  void set_uses_score_pyramid(bool uses_score_pyramid) {
+    _uses_score_pyramid = uses_score_pyramid;
+  }
+
   double process_scan(const TransformedLaserScan &raw_scan,
                       const RobotPose &pose,
                       const GridMap &map,
@@ -33,6 +48,9 @@ public:
       obs->on_matching_start(pose, raw_scan, map);
     });
 
+    start_time_budget();
+    const auto vanilla_scale = map.scale();
+
     /* setup engine */
     _engine.reset_engine_state();
     _engine.set_translation_lookup_range(max_x_error(), max_y_error());
@@ -43,19 +61,41 @@ public:
     // NB: Do not make 'rescale' const (doing const_cast client probably
     //     won't forget to save/restore current scale)
     SafeRescalableMap rescalable_map{map};
-    _engine.add_scan_matching_request(scan_probability_estimator(), pose,
-                                      raw_scan.scan, rescalable_map, true);
+    if (_uses_score_pyramid) {
+      sync_pyramid(map);
+      _engine.add_scan_matching_request(_pyramid, scan_probability_estimator(),
+                                        pose, raw_scan.scan, rescalable_map);
+    } else {
+      _engine.add_scan_matching_request(scan_probability_estimator(), pose,
+                                        raw_scan.scan, rescalable_map, true);
+    }
     while (1) {
       auto best_match = _engine.next_best_match(_transl_step);
       assert(best_match.is_valid());
-      if (best_match.is_finest()) {
-        result_pose_delta = {best_match.translation_drift.center(),
-                             best_match.rotation};
-        do_for_each_observer([&result_pose_delta, &best_match](ObsPtr obs) {
+      // NB: once the time budget is exceeded, the center of the most
+      //     promising match is taken as the best pose found so far.
+      auto is_truncated = !best_match.is_finest() &&
+                          time_budget_is_exceeded();
+      if (best_match.is_finest() || is_truncated) {
+        result_pose_delta = RobotPoseDelta(
+          best_match.translation_drift.center(), best_match.rotation);
+        auto best_prob = best_match.prob_upper_bound;
+        if (_uses_score_pyramid || is_truncated) {
+          // the bound of a coarse match is not a probability
+          static_cast<GridMap&>(rescalable_map).rescale(vanilla_scale);
+          // NB: the scan is prerotated
+          auto best_pose = RobotPose{pose.x + result_pose_delta.x,
+                                     pose.y + result_pose_delta.y, 0};
+          best_prob = scan_probability(*best_match.filtered_scan, best_pose,
+                                       map, SPEParams{M3RSMEngine::Rect{},
+                                                      true});
+        }
+        do_for_each_observer([&result_pose_delta, &best_match,
+                              &best_prob](ObsPtr obs) {
             obs->on_matching_end(result_pose_delta, *best_match.filtered_scan,
-                                 best_match.prob_upper_bound);
+                                 best_prob);
         });
-        return best_match.prob_upper_bound;
+        return best_prob;
       }
       // Add exact translation candidates as matches
       // NB: center doesn't guarentee the optimal translation pick
@@ -64,14 +104,29 @@ public:
       crucial_points.push_back(best_match.translation_drift.center());
 
       for (const auto &cp : crucial_points) {
-        _engine.add_match(Match{M3RSMEngine::Rect{cp}, best_match});
+        _engine.add_refined_match(best_match, M3RSMEngine::Rect{cp});
       }
     }
   }
 
+  void prepare_map(const GridMap &map) override {
+    if (_uses_score_pyramid) { sync_pyramid(map); }
+  }
+
+private:
+  void sync_pyramid(const GridMap &map) {
+    // NB: a drift range is twice as long as a max error; merged points
+    //     are looked up in windows up to twice as long as a drift.
+    _pyramid.ensure_levels(4 * std::max(max_x_error(), max_y_error()),
+                           map.scale());
+    _pyramid.sync(map);
+  }
+
 private:
   M3RSMEngine _engine;
   double _ang_step, _transl_step;
+  bool _uses_score_pyramid = false;
+  MaxPooledScorePyramid _pyramid;
 };
 
 #endif // include guard
@@ -2,6 +2,8 @@
 #define SLAM_CTOR_CORE_BRUTE_FORCE_SCAN_MATCHER_H
 
 #include <cassert>
+#include <algorithm>
+#include <vector>
 
 #include "pose_enumeration_scan_matcher.h"
 
@@ -25,12 +27,7 @@ public:
   }
 
   RobotPose next(const RobotPose &prev_pose) override {
-    if (!_base_pose_is_set) {
-      _base_pose = prev_pose;
-      _base_pose_is_set = true;
-    }
-
-    return {_base_pose.x + _x, _base_pose.y + _y, _base_pose.theta + _t};
+    return pose(prev_pose, _x, _y, _t);
   }
 
   void reset() override {
@@ -39,21 +36,44 @@ public:
     _t = _from_t;
   }
 
-  void feedback(bool pose_is_acceptable) override {
+  void feedback(bool pose_is_acceptable) override { advance(_x, _y, _t); }
+
+  // NB: poses of a batch with the same theta are adjacent (x changes first)
+  void next_batch(const RobotPose &prev_pose, std::size_t max_nm,
+                  std::vector<RobotPose> &poses) override {
+    poses.clear();
+    auto x = _x, y = _y, t = _t;
+    while (poses.size() < std::max(max_nm, std::size_t{1}) && t <= _to_t) {
+      poses.push_back(pose(prev_pose, x, y, t));
+      advance(x, y, t);
+    }
+  }
+
+private: // methods
+  RobotPose pose(const RobotPose &prev_pose, double x, double y, double t) {
+    if (!_base_pose_is_set) {
+      _base_pose = prev_pose;
+      _base_pose_is_set = true;
+    }
+
+    return RobotPose(_base_pose.x + x, _base_pose.y + y, _base_pose.theta + t);
+  }
+
+  void advance(double &x, double &y, double &t) const {
     // HACK: use switch falls to simplify code (no nested ifs/d_y, d_t tracking
     switch (0) {
     case 0:
-      if (_x < _to_x) { _x += _step_x; break; }
-      else            { _x = _from_x; /* to Y */ }
+      if (x < _to_x) { x += _step_x; break; }
+      else           { x = _from_x; /* to Y */ }
     case 1:
-      if (_y < _to_y) { _y += _step_y; break; }
-      else            { _y = _from_y; /* to T */ }
+      if (y < _to_y) { y += _step_y; break; }
+      else           { y = _from_y; /* to T */ }
     case 2:
-      _t += _step_t;
+      t += _step_t;
     }
   }
 
-private:
+private: // fields
   // TODO: use std::optional when C++17 is available
   bool _base_pose_is_set;
   RobotPose _base_pose;
@@ -1,13 +1,31 @@
 #ifndef SLAM_CTOR_CORE_CONNECT_THE_DOTS_AMBIOUS_DRIFT_DETECTOR_H
 #define SLAM_CTOR_CORE_CONNECT_THE_DOTS_AMBIOUS_DRIFT_DETECTOR_H
 
+#include <cmath>
+#include <memory>
+#include <vector>
+
 #include "grid_scan_matcher.h"
-#include "pose_enumerators.h"
 #include "../features/angle_histogram.h"
 
+/* Corrects a drift of a match along an ambiguous direction
+ * (e.g. a corridor). A scan is ambiguous if directions between its
+ * consecutive points (see ScanFeatures) are dominated by a single one;
+ * the pose found by the wrapped matcher is refined by a search along
+ * the direction against the scan without points of the dominant one.
+ * PERFORMANCE: the wrapped matcher and the detector share the prefiltered
+ *              scan (see LaserScan2D::prefiltered) with its features,
+ *              so points are filtered once; the re-match is a 1D search
+ *              that is estimated by a single batch. */
 // TODO: do we need it to be a scan matcher?
 // TEMP: implemented as a 'decorator' to be in sync with fmwk
 class ConnectTheDotsAmbiguousDriftDetector : public GridScanMatcher {
+public: // consts
+  static constexpr std::size_t Histogram_Resolution = 20;
+  // the share of points of the dominant direction of an ambiguous scan
+  static constexpr double Ambiguity_Share = 0.4;
+  // the distance of the re-match along the direction (in meters)
+  static constexpr double Drift_Search_Range = 0.25;
 public:
   ConnectTheDotsAmbiguousDriftDetector(std::shared_ptr<GridScanMatcher> sm)
     : GridScanMatcher{sm->scan_probability_estimator()}, _sm{sm} { }
@@ -18,87 +36,110 @@ public:
     _sm->reset_state();
   }
 
+  void prepare_map(const GridMap &map) override { _sm->prepare_map(map); }
+
+  bool last_match_is_converged() const override {
+    return _sm->last_match_is_converged();
+  }
+
+  // Whether the last scan has had a dominant direction
+  bool last_scan_is_ambiguous() const { return _last_scan_is_ambiguous; }
+
   double process_scan(const TransformedLaserScan &raw_scan,
                       const RobotPose &init_pose,
                       const GridMap &map,
                       RobotPoseDelta &pose_delta) override {
+    _last_scan_is_ambiguous = false;
+    const auto *tr_scan = &raw_scan;
+    auto prefiltered_scan = TransformedLaserScan{};
+    if (!raw_scan.scan.prefiltered()) {
+      prefiltered_scan = raw_scan;
+      prefilter_scan(prefiltered_scan.scan);
+      tr_scan = &prefiltered_scan;
+    }
+
     // Estimate best pose delta with wrapped sm
-    auto sm_best_prob = _sm->process_scan(raw_scan, init_pose, map, pose_delta);
+    auto sm_best_prob = _sm->process_scan(*tr_scan, init_pose, map,
+                                          pose_delta);
     auto best_pose = init_pose + pose_delta;
 
-    // Remove points with most popular antigradient
-    auto scan = filter_scan(raw_scan.scan, init_pose, map);
-    auto angle_histogram = AngleHistogram{20}.reset(scan);
+    // NB: the scan is const, so its weights and features are kept
+    const auto scan = filter_scan(tr_scan->scan, best_pose, map);
+    if (scan.points().empty()) { return sm_best_prob; }
+    auto angle_histogram = AngleHistogram{Histogram_Resolution}.reset(scan);
     auto drift_dir_i = angle_histogram.max_i();
-    auto drift_dir = angle_histogram[drift_dir_i];
-    std::cout << drift_dir * 1.0 / scan.points().size() << std::endl;
-    if (drift_dir < 0.4 * scan.points().size()) {
+    auto drift_dir_nm = angle_histogram[drift_dir_i];
+    if (drift_dir_nm < Ambiguity_Share * scan.points().size()) {
       return sm_best_prob;
     }
-    std::cout << "ANALYSIS: " << drift_dir * 1.0 / scan.points().size() << std::endl;
-    // TODO: max is close to avg => ok
-
-    // TODO: move filtering to AngleHistogram
-    LaserScan2D filtered_scan;
-    filtered_scan.trig_provider = scan.trig_provider;
-    auto &scan_pts = filtered_scan.points();
-    for (LaserScan2D::Points::size_type i = 1; i < scan.points().size(); ++i) {
-      auto &sp = scan.points()[i];
-      // TODO: rm by ah index range
-      if (drift_dir == angle_histogram.value(scan.points(), i)) {
-        continue;
-      }
-      scan_pts.push_back(sp);
+    _last_scan_is_ambiguous = true;
+
+    // points of the dominant direction don't constrain the drift
+    auto anchor_scan = drop_points(scan, angle_histogram, drift_dir_nm);
+    if (anchor_scan.points().empty()) { return sm_best_prob; }
+
+    // NB: directions of points are in the robot's frame
+    auto drift_dir = best_pose.theta +
+                     angle_histogram.mean_bin_angle(drift_dir_i);
+    auto step = map.scale();
+    auto steps_nm = int(std::round(Drift_Search_Range / step));
+    _poses.clear();
+    for (int i = -steps_nm; i <= steps_nm; ++i) {
+      _poses.push_back(best_pose + RobotPoseDelta{
+        i * step * std::cos(drift_dir), i * step * std::sin(drift_dir), 0});
     }
+    scan_probabilities(anchor_scan, _poses, map, _probs);
 
-    // Matching agaists filtered scan; BruteForce; move polar
-    auto probs = std::vector<double>{};
-
-    auto hist_step = angle_histogram.angle_step();
-    // FIXME: a hack to exclude base_pose
-
-    auto ang = drift_dir_i * hist_step + hist_step / 2;
-    auto poses = PolarCoordBruteForcePoseEnumerator{
-      //drift_dir_i * hist_step, (drift_dir_i + 1) * hist_step, hist_step / 2,
-      ang, ang, hist_step,
-      -0.25, 0.25, 0.1 /* Q: map scale? */
-    };
-
-    // TODO: Refactoring. Replace with BF sm + observer to log probs
-    auto best_prob = scan_probability(filtered_scan, best_pose, map);
-    while (poses.has_next()) {
-      auto next_pose = poses.next(best_pose);
-      auto next_prob = scan_probability(filtered_scan, next_pose, map);
-      probs.push_back(next_prob);
-      auto next_pose_is_better = best_prob < next_prob;
-      if (next_pose_is_better) {
-        best_prob = next_prob;
-        best_pose = next_pose;
-        std::cout << "2ND Pass Update: " << best_prob << " --> "
-                  << best_pose << std::endl;
-      }
-      poses.feedback(next_pose_is_better);
+    // the matcher's pose is kept unless a shift is strictly better
+    auto best_i = std::size_t(steps_nm);
+    for (std::size_t i = 0; i < _probs.size(); ++i) {
+      if (_probs[best_i] < _probs[i]) { best_i = i; }
     }
+    if (best_i == std::size_t(steps_nm)) { return sm_best_prob; }
 
-    if (1 < probs.size()) {
-      std::sort(probs.begin(), probs.end(), std::greater<double>{});
-      if (are_equal(probs[0], probs[1], 1e-6)) { // or both are shero
-        std::cout << "ALARM: " << probs[0] << " == " << probs[1] << std::endl;
-      }
-    }
+    // NB: the probability by the whole scan hardly depends on the drift,
+    //     so the correction is not checked against the matcher's one
+    pose_delta = _poses[best_i] - init_pose;
+    return scan_probability(scan, _poses[best_i], map);
+  }
+
+private: // methods
 
-    pose_delta = best_pose - init_pose;
-    auto corrected_best_prob = scan_probability(scan, best_pose, map);
-    if (corrected_best_prob < sm_best_prob) {
-      std::cout << "[CtD][Bug] " << corrected_best_prob << " "
-                << sm_best_prob << std::endl;
+  // The scan without points whose histogram value is the given one;
+  // weights of the kept points are kept.
+  static LaserScan2D drop_points(const LaserScan2D &scan,
+                                 const AngleHistogram &histogram,
+                                 unsigned dropped_value) {
+    LaserScan2D filtered_scan;
+    filtered_scan.trig_provider = scan.trig_provider;
+    const auto *weights = scan.point_weights();
+    auto kept_weights = std::make_shared<ScanPointWeights>();
+    auto &scan_pts = filtered_scan.points();
+    const auto &points = scan.points();
+    for (LaserScan2D::Points::size_type i = 0; i < points.size(); ++i) {
+      if (histogram.value(points, i) == dropped_value) { continue; }
+      scan_pts.push_back(points[i]);
+      if (!weights) { continue; }
+      kept_weights->values.push_back(weights->values[i]);
+      kept_weights->total += weights->values[i];
     }
-    return corrected_best_prob;
+
+    // NB: the scan is estimated for all poses of the search at once
+    filtered_scan.update_soa();
+    if (weights) { filtered_scan.set_point_weights(kept_weights); }
+    return filtered_scan;
   }
 
-private:
+private: // fields
   std::shared_ptr<GridScanMatcher> _sm;
+  bool _last_scan_is_ambiguous = false;
+  std::vector<RobotPose> _poses;
+  std::vector<double> _probs;
 };
 
+constexpr std::size_t
+ConnectTheDotsAmbiguousDriftDetector::Histogram_Resolution;
+constexpr double ConnectTheDotsAmbiguousDriftDetector::Ambiguity_Share;
+constexpr double ConnectTheDotsAmbiguousDriftDetector::Drift_Search_Range;
 
 #endif
@@ -0,0 +1,68 @@
+#ifndef SLAM_CTOR_CORE_CORRECTION_PRIOR_MODEL_H
+#define SLAM_CTOR_CORE_CORRECTION_PRIOR_MODEL_H
+
+#include <cmath>
+#include <algorithm>
+
+#include "../states/robot_pose.h"
+
+/* Predicts a correction of the next scan's initial pose by corrections
+ * found for previous scans.
+ * A constant velocity model is assumed: odometry errors of consecutive
+ * scans are alike while a robot drives steadily, so the next correction is
+ * the exponentially smoothed mean of recent ones. The expected error of
+ * the prediction is proportional to the smoothed standard deviation of
+ * the corrections (i.e. odometry noise). */
+class CorrectionPriorModel {
+public: // consts
+  // the number of corrections required for a prediction
+  static constexpr unsigned Min_Corrections_Nm = 2;
+public:
+  // smoothing - the weight of the latest correction in running estimates;
+  // error_factor - the expected error in standard deviations.
+  explicit CorrectionPriorModel(double smoothing = 0.5,
+                                double error_factor = 2)
+    : _smoothing{std::min(std::max(smoothing, 0.0), 1.0)}
+    , _error_factor{error_factor} {}
+
+  bool is_ready() const { return Min_Corrections_Nm <= _corrections_nm; }
+
+  const RobotPoseDelta& predicted_correction() const { return _mean; }
+
+  RobotPoseDelta expected_error() const {
+    return RobotPoseDelta(_error_factor * std::sqrt(_variance.x),
+                          _error_factor * std::sqrt(_variance.y),
+                          _error_factor * std::sqrt(_variance.theta));
+  }
+
+  void update(const RobotPoseDelta &correction) {
+    if (_corrections_nm++ == 0) {
+      _mean = correction;
+      return;
+    }
+
+    // exponentially weighted mean and variance
+    auto diff = correction + (-_mean);
+    _mean += RobotPoseDelta(_smoothing * diff.x, _smoothing * diff.y,
+                            _smoothing * diff.theta);
+    auto update_variance = [this](Real &variance, double d) {
+      variance = (1 - _smoothing) * (variance + _smoothing * d * d);
+    };
+    update_variance(_variance.x, diff.x);
+    update_variance(_variance.y, diff.y);
+    update_variance(_variance.theta, diff.theta);
+  }
+
+  void reset() {
+    _corrections_nm = 0;
+    _mean.reset();
+    _variance.reset();
+  }
+
+private: // fields
+  double _smoothing, _error_factor;
+  unsigned _corrections_nm = 0;
+  RobotPoseDelta _mean, _variance;
+};
+
+#endif
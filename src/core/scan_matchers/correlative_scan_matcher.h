@@ -0,0 +1,206 @@
+#ifndef SLAM_CTOR_CORE_CORRELATIVE_SCAN_MATCHER_H
+#define SLAM_CTOR_CORE_CORRELATIVE_SCAN_MATCHER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "grid_scan_matcher.h"
+
+/* Exhaustive (x, y, theta) search based on Olson (2009),
+ * "Real-Time Correlative Scan Matching".
+ *
+ * A filtered scan is rotated once per rotation step, its points are
+ * converted to cells and the cell offsets are slid over the translation
+ * window, so a candidate is scored with integer lookups and additions
+ * in a table of quantized cell probabilities (1 - cell discrepancy)
+ * that is built once per scan.
+ * Translations are searched with the map resolution within
+ * [-max_x_error, max_x_error] x [-max_y_error, max_y_error];
+ * the returned probability is estimated by the SPE for the found pose.
+ *
+ * NB: the matcher is cheap enough to be a global fallback for a local one
+ *     (e.g. hill climbing) that has lost track. */
+class CorrelativeScanMatcher : public GridScanMatcher {
+public: // consts
+  // cell probabilities are quantized to [0, Score_Resolution]
+  static constexpr int Score_Resolution = 1 << 10;
+public:
+  CorrelativeScanMatcher(SPE estimator,
+                         double max_x_error, double max_y_error,
+                         double from_t, double to_t, double step_t)
+    : GridScanMatcher{estimator, max_x_error, max_y_error,
+                      std::max(std::abs(from_t), std::abs(to_t))}
+    , _from_t{from_t}, _to_t{to_t}, _step_t{step_t} {
+    assert(_from_t <= _to_t && 0 < _step_t);
+  }
+
+  double process_scan(const TransformedLaserScan &raw_scan,
+                      const RobotPose &init_pose,
+                      const GridMap &map,
+                      RobotPoseDelta &pose_delta) override {
+    do_for_each_observer([&init_pose, &raw_scan, &map](ObsPtr obs) {
+      obs->on_matching_start(init_pose, raw_scan, map);
+    });
+
+    auto scan = filter_scan(raw_scan.scan, init_pose, map);
+    if (!scan.has_soa()) { scan.update_soa(); }
+    auto best_pose = init_pose;
+    if (rotate_scan_to_cells(scan.soa(), init_pose, map)) {
+      build_score_table(map);
+      best_pose = find_best_pose(init_pose, map.scale());
+    }
+
+    auto best_pose_prob = scan_probability(scan, best_pose, map);
+    do_for_each_observer([&best_pose, &scan, &best_pose_prob](ObsPtr obs) {
+      obs->on_pose_update(best_pose, scan, best_pose_prob);
+    });
+    pose_delta = best_pose - init_pose;
+    do_for_each_observer([&scan, &pose_delta, &best_pose_prob](ObsPtr obs) {
+      obs->on_matching_end(pose_delta, scan, best_pose_prob);
+    });
+    return best_pose_prob;
+  }
+
+private: // methods
+
+  std::size_t rotations_nm() const {
+    return static_cast<std::size_t>(
+      std::floor((_to_t - _from_t) / _step_t + 1e-9)) + 1;
+  }
+
+  double rotation(std::size_t rotation_i) const {
+    return _from_t + rotation_i * _step_t;
+  }
+
+  // Fills cells of occupied scan points for each rotation and the bounds of
+  // the cells shifted by the translation window. Returns false if there are
+  // no points to match.
+  bool rotate_scan_to_cells(const ScanPointsSoA &soa,
+                            const RobotPose &init_pose, const GridMap &map) {
+    _window_x = std::max(0, int(std::ceil(max_x_error() / map.scale())));
+    _window_y = std::max(0, int(std::ceil(max_y_error() / map.scale())));
+    _cells_xs.clear();
+    _cells_ys.clear();
+    _points_nm = 0;
+    for (std::size_t i = 0; i < soa.size(); ++i) {
+      _points_nm += soa.occupied[i] ? 1 : 0;
+    }
+    if (_points_nm == 0) { return false; }
+
+    _min_cell = {std::numeric_limits<int>::max(),
+                 std::numeric_limits<int>::max()};
+    _max_cell = {std::numeric_limits<int>::min(),
+                 std::numeric_limits<int>::min()};
+    for (std::size_t rot_i = 0; rot_i < rotations_nm(); ++rot_i) {
+      soa.rotate(init_pose.theta + rotation(rot_i), _rotated_xs, _rotated_ys);
+      for (std::size_t i = 0; i < soa.size(); ++i) {
+        if (!soa.occupied[i]) { continue; }
+        auto cell = map.world_to_cell(_rotated_xs[i] + init_pose.x,
+                                      _rotated_ys[i] + init_pose.y);
+        _cells_xs.push_back(cell.x);
+        _cells_ys.push_back(cell.y);
+        _min_cell = {std::min(_min_cell.x, cell.x),
+                     std::min(_min_cell.y, cell.y)};
+        _max_cell = {std::max(_max_cell.x, cell.x),
+                     std::max(_max_cell.y, cell.y)};
+      }
+    }
+    _min_cell = {_min_cell.x - _window_x, _min_cell.y - _window_y};
+    _max_cell = {_max_cell.x + _window_x, _max_cell.y + _window_y};
+    return true;
+  }
+
+  // PERFORMANCE: discrepancies are requested per table rows
+  //              (see GridMap::row_discrepancies).
+  // NB: the obstacle of an expected observation is the center of a row,
+  //     so cells are expected to estimate discrepancies by occupancy.
+  void build_score_table(const GridMap &map) {
+    _table_w = _max_cell.x - _min_cell.x + 1;
+    auto table_h = _max_cell.y - _min_cell.y + 1;
+    _scores.resize(std::size_t(_table_w) * table_h);
+    _row_discrepancies.resize(_table_w);
+    for (int row = 0; row < table_h; ++row) {
+      auto row_begin = GridMap::Coord{_min_cell.x, _min_cell.y + row};
+      auto row_end = GridMap::Coord{_max_cell.x, row_begin.y};
+      auto row_center = (map.world_cell_bounds(row_begin).center() +
+                         map.world_cell_bounds(row_end).center()) * 0.5;
+      auto aoo = AreaOccupancyObservation{true, {1.0, 1.0}, row_center, 1.0};
+      map.row_discrepancies(row_begin, _table_w, aoo,
+                            _row_discrepancies.data());
+      auto *row_scores = _scores.data() + std::size_t(row) * _table_w;
+      for (int i = 0; i < _table_w; ++i) {
+        auto prob = 1.0 - _row_discrepancies[i];
+        row_scores[i] = std::int32_t(std::lround(
+          std::min(1.0, std::max(0.0, prob)) * Score_Resolution));
+      }
+    }
+  }
+
+  // Candidates are ranked by the score, then by the translation in cells
+  // and then by the rotation, so the smallest correction wins ties.
+  RobotPose find_best_pose(const RobotPose &init_pose, double cell_len) {
+    _offsets.resize(_points_nm);
+    auto best_score = std::int64_t{-1};
+    int best_shift = 0, best_dx = 0, best_dy = 0;
+    double best_rotation = 0;
+    for (std::size_t rot_i = 0; rot_i < rotations_nm(); ++rot_i) {
+      // offsets of the points' cells in the table for the translation
+      // (-window_x, -window_y); other translations shift the table origin
+      const auto *cells_xs = _cells_xs.data() + rot_i * _points_nm;
+      const auto *cells_ys = _cells_ys.data() + rot_i * _points_nm;
+      for (std::size_t i = 0; i < _points_nm; ++i) {
+        _offsets[i] =
+          std::ptrdiff_t(cells_ys[i] - _min_cell.y - _window_y) * _table_w +
+          (cells_xs[i] - _min_cell.x - _window_x);
+      }
+
+      auto rot = rotation(rot_i);
+      for (int dy = -_window_y; dy <= _window_y; ++dy) {
+        for (int dx = -_window_x; dx <= _window_x; ++dx) {
+          const auto *scores = _scores.data() +
+            std::ptrdiff_t(dy + _window_y) * _table_w + (dx + _window_x);
+          auto score = std::int64_t{0};
+          for (std::size_t i = 0; i < _points_nm; ++i) {
+            score += scores[_offsets[i]];
+          }
+
+          auto shift = std::abs(dx) + std::abs(dy);
+          auto is_better = best_score < score ||
+            (best_score == score &&
+             (shift < best_shift ||
+              (shift == best_shift &&
+               std::abs(rot) < std::abs(best_rotation))));
+          if (!is_better) { continue; }
+          best_score = score;
+          best_shift = shift;
+          best_dx = dx;
+          best_dy = dy;
+          best_rotation = rot;
+        }
+      }
+    }
+
+    return RobotPose(init_pose.x + best_dx * cell_len,
+                     init_pose.y + best_dy * cell_len,
+                     init_pose.theta + best_rotation);
+  }
+
+private: // fields
+  double _from_t, _to_t, _step_t;
+  // buffers reused by scans
+  int _window_x = 0, _window_y = 0, _table_w = 0;
+  std::size_t _points_nm = 0;
+  GridMap::Coord _min_cell, _max_cell;
+  std::vector<Real> _rotated_xs, _rotated_ys;
+  std::vector<double> _row_discrepancies;
+  std::vector<int> _cells_xs, _cells_ys;
+  std::vector<std::ptrdiff_t> _offsets;
+  std::vector<std::int32_t> _scores;
+};
+
+#endif
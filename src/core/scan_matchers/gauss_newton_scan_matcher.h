@@ -0,0 +1,184 @@
+#ifndef SLAM_CTOR_CORE_GAUSS_NEWTON_SCAN_MATCHER_H
+#define SLAM_CTOR_CORE_GAUSS_NEWTON_SCAN_MATCHER_H
+
+#include <cmath>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+#include "grid_scan_matcher.h"
+#include "../maps/rescalable_caching_grid_map.h"
+
+/* A gradient-based pose refinement based on Kohlbrecher et al. (2011),
+ * "A Flexible and Scalable SLAM System with Full 3D Motion Estimation"
+ * (Hector SLAM).
+ *
+ * A map is treated as a continuous function M of the occupancy score
+ * (1 - cell discrepancy) that is bilinearly interpolated between cell
+ * centers, so both M and its spatial gradient are defined at any point.
+ * The pose that minimizes sum((1 - M(scan point))^2) is found by
+ * Gauss-Newton iterations, so a scan is matched with a few map lookups
+ * per point per iteration rather than with an SPE estimation per pose.
+ * The search runs from coarse to fine scales of a rescalable map
+ * (e.g. RescalableCachingGridMap) to widen the basin of convergence;
+ * other maps are matched at their own scale only.
+ *
+ * NB: the matcher is a local one, so it expects a good initial pose
+ *     (e.g. a pose predicted by odometry). The found pose is rejected
+ *     if the SPE prefers the initial one. */
+class GaussNewtonScanMatcher : public GridScanMatcher {
+public: // consts
+  // an iteration stops a scale if a step is shorter (in cells/radians)
+  static constexpr double Min_Translation_Step = 0.01,
+                          Min_Rotation_Step = 1e-4;
+public:
+  GaussNewtonScanMatcher(SPE estimator,
+                         unsigned max_iterations_nm = 10,
+                         unsigned scales_nm = 3)
+    : GridScanMatcher{estimator}
+    , _max_iterations_nm{std::max(max_iterations_nm, 1u)}
+    , _scales_nm{std::max(scales_nm, 1u)} {}
+
+  double process_scan(const TransformedLaserScan &raw_scan,
+                      const RobotPose &init_pose,
+                      const GridMap &map,
+                      RobotPoseDelta &pose_delta) override {
+    do_for_each_observer([&init_pose, &raw_scan, &map](ObsPtr obs) {
+      obs->on_matching_start(init_pose, raw_scan, map);
+    });
+
+    auto scan = filter_scan(raw_scan.scan, init_pose, map);
+    if (!scan.has_soa()) { scan.update_soa(); }
+    auto pose = init_pose;
+    {
+      // FIXME: API - const cast (inside the RAII obj) to be able to rescale
+      SafeRescalableMap safe_map{map};
+      GridMap &rescalable_map = safe_map;
+      auto finest_scale = map.scale();
+      auto prev_scale = double{0};
+      for (unsigned scale_i = _scales_nm; 0 < scale_i; --scale_i) {
+        rescalable_map.rescale(finest_scale * (1 << (scale_i - 1)));
+        if (rescalable_map.scale() == prev_scale) { continue; }
+        prev_scale = rescalable_map.scale();
+        refine_pose(scan.soa(), rescalable_map, pose);
+      }
+    }
+
+    auto best_pose_prob = scan_probability(scan, pose, map);
+    auto init_pose_prob = scan_probability(scan, init_pose, map);
+    if (std::isnan(best_pose_prob) || best_pose_prob < init_pose_prob) {
+      pose = init_pose;
+      best_pose_prob = init_pose_prob;
+    }
+    do_for_each_observer([&pose, &scan, &best_pose_prob](ObsPtr obs) {
+      obs->on_pose_update(pose, scan, best_pose_prob);
+    });
+    pose_delta = pose - init_pose;
+    do_for_each_observer([&scan, &pose_delta, &best_pose_prob](ObsPtr obs) {
+      obs->on_matching_end(pose_delta, scan, best_pose_prob);
+    });
+    return best_pose_prob;
+  }
+
+private: // types
+  struct InterpolatedScore {
+    double value = 0, d_x = 0, d_y = 0;
+  };
+
+private: // methods
+
+  // Gauss-Newton iterations at the current map scale
+  void refine_pose(const ScanPointsSoA &soa, const GridMap &map,
+                   RobotPose &pose) {
+    TraceScope trace{"gn refinement", "scmtch"};
+    const auto cell_len = map.scale();
+    for (unsigned iter_i = 0; iter_i < _max_iterations_nm; ++iter_i) {
+      soa.rotate(pose.theta, _rotated_xs, _rotated_ys);
+      // the upper triangle of the (symmetric) Hessian approximation J^T * J
+      double h_xx = 0, h_xy = 0, h_xt = 0, h_yy = 0, h_yt = 0, h_tt = 0;
+      // J^T * residual
+      double b_x = 0, b_y = 0, b_t = 0;
+      for (std::size_t i = 0; i < soa.size(); ++i) {
+        if (!soa.occupied[i]) { continue; }
+        auto score = interpolated_score(map, _rotated_xs[i] + pose.x,
+                                        _rotated_ys[i] + pose.y);
+        // d(rotated point)/d(theta) = (-y', x')
+        auto d_t = -_rotated_ys[i] * score.d_x + _rotated_xs[i] * score.d_y;
+        auto residual = 1.0 - score.value;
+        h_xx += score.d_x * score.d_x;
+        h_xy += score.d_x * score.d_y;
+        h_xt += score.d_x * d_t;
+        h_yy += score.d_y * score.d_y;
+        h_yt += score.d_y * d_t;
+        h_tt += d_t * d_t;
+        b_x += score.d_x * residual;
+        b_y += score.d_y * residual;
+        b_t += d_t * residual;
+      }
+
+      // solves H * step = b by Cramer's rule
+      auto det = h_xx * (h_yy * h_tt - h_yt * h_yt) -
+                 h_xy * (h_xy * h_tt - h_yt * h_xt) +
+                 h_xt * (h_xy * h_yt - h_yy * h_xt);
+      if (std::abs(det) < std::numeric_limits<double>::epsilon()) { return; }
+      auto step_x = (b_x * (h_yy * h_tt - h_yt * h_yt) -
+                     h_xy * (b_y * h_tt - h_yt * b_t) +
+                     h_xt * (b_y * h_yt - h_yy * b_t)) / det;
+      auto step_y = (h_xx * (b_y * h_tt - b_t * h_yt) -
+                     b_x * (h_xy * h_tt - h_yt * h_xt) +
+                     h_xt * (h_xy * b_t - b_y * h_xt)) / det;
+      auto step_t = (h_xx * (h_yy * b_t - h_yt * b_y) -
+                     h_xy * (h_xy * b_t - b_y * h_xt) +
+                     b_x * (h_xy * h_yt - h_yy * h_xt)) / det;
+      if (!std::isfinite(step_x) || !std::isfinite(step_y) ||
+          !std::isfinite(step_t)) {
+        return;
+      }
+
+      pose += RobotPoseDelta(step_x, step_y, step_t);
+      auto is_converged =
+        std::abs(step_x) < Min_Translation_Step * cell_len &&
+        std::abs(step_y) < Min_Translation_Step * cell_len &&
+        std::abs(step_t) < Min_Rotation_Step;
+      if (is_converged) { return; }
+    }
+  }
+
+  // The score bilinearly interpolated between centers of 4 cells
+  // around a given point and its gradient.
+  static InterpolatedScore interpolated_score(const GridMap &map,
+                                              double x, double y) {
+    const auto cell_len = map.scale();
+    // NB: the cell (i, j) center is ((i + 0.5) * len, (j + 0.5) * len)
+    auto cell_x = x / cell_len - 0.5, cell_y = y / cell_len - 0.5;
+    auto base_x = std::floor(cell_x), base_y = std::floor(cell_y);
+    auto f_x = cell_x - base_x, f_y = cell_y - base_y;
+    auto base = GridMap::Coord{int(base_x), int(base_y)};
+
+    auto m00 = cell_score(map, base),
+         m10 = cell_score(map, base + GridMap::Coord{1, 0}),
+         m01 = cell_score(map, base + GridMap::Coord{0, 1}),
+         m11 = cell_score(map, base + GridMap::Coord{1, 1});
+
+    auto score = InterpolatedScore{};
+    score.value = (1 - f_y) * ((1 - f_x) * m00 + f_x * m10) +
+                  f_y * ((1 - f_x) * m01 + f_x * m11);
+    score.d_x = ((1 - f_y) * (m10 - m00) + f_y * (m11 - m01)) / cell_len;
+    score.d_y = ((1 - f_x) * (m01 - m00) + f_x * (m11 - m10)) / cell_len;
+    return score;
+  }
+
+  static double cell_score(const GridMap &map, const GridMap::Coord &c) {
+    auto aoo = AreaOccupancyObservation{
+      true, {1.0, 1.0}, map.world_cell_bounds(c).center(), 1.0};
+    return 1.0 - map[c].discrepancy(aoo);
+  }
+
+private: // fields
+  unsigned _max_iterations_nm, _scales_nm;
+  // buffers reused by iterations
+  std::vector<Real> _rotated_xs, _rotated_ys;
+};
+
+#endif
@@ -3,17 +3,44 @@
 
 #include <vector>
 #include <memory>
+#include <chrono>
 #include <algorithm>
 #include <limits>
+#include <functional>
 
 #include "../states/state_data.h"
 #include "../states/sensor_data.h"
 #include "../states/robot_pose.h"
 #include "../maps/occupancy_map.h"
 #include "../maps/grid_map.h"
+#include "../trace_recorder.h"
+
+struct CellScoresView;
+
+// Aggregated scan tests of a matching
+struct ScanTestsSummary {
+  std::size_t tests_nm = 0, pose_updates_nm = 0;
+  double min_score = std::numeric_limits<double>::infinity();
+  double max_score = -std::numeric_limits<double>::infinity();
+  double score_sum = 0;
+
+  void add_test(double score) {
+    ++tests_nm;
+    min_score = std::min(min_score, score);
+    max_score = std::max(max_score, score);
+    score_sum += score;
+  }
+
+  double mean_score() const { return tests_nm ? score_sum / tests_nm : 0; }
+};
 
 class GridScanMatcherObserver {
 public:
+  // on_scan_test is called for each n-th tested pose (n is the period);
+  // 0 disables the calls, so only the summary of tests is reported.
+  // PERFORMANCE: a scan matcher skips per-test dispatch entirely
+  //              if no observer requests it.
+  virtual unsigned scan_test_period() const { return 1; }
   virtual void on_matching_start(const RobotPose &,            /*pose*/
                                  const TransformedLaserScan &, /*scan*/
                                  const GridMap &) {}           /*map*/
@@ -26,6 +53,9 @@ public:
   virtual void on_matching_end(const RobotPose &,   /*delta*/
                                const LaserScan2D &, /* applied scan */
                                double) {};          /*best_score*/
+  // NB: is called before on_matching_end by matchers that test poses
+  virtual void on_scan_tests_summary(const ScanTestsSummary &) {}
+  virtual ~GridScanMatcherObserver() = default;
 };
 
 /* Estimates p(observation | map & area) */
@@ -35,6 +65,9 @@ public:
   virtual double probability(const AreaOccupancyObservation &aoo,
                              const LightWeightRectangle &area,
                              const GridMap &map) const = 0;
+  // Whether the probability is 1 - discrepancy of the obstacle's cell
+  // regardless of the area (so it may be looked up in flat cell scores).
+  virtual bool is_obstacle_cell_based() const { return false; }
   virtual ~OccupancyObservationProbabilityEstimator() = default;
 };
 
@@ -53,6 +86,15 @@ public: // types
     // area in the neighborhood of a scan point that should be analyzed
     LightWeightRectangle sp_analysis_area = {0, 0, 0, 0};
     bool scan_is_prerotated = false;
+    // An estimation may stop once the probability is known to be not
+    // greater than the threshold (e.g. the one of the best pose so far).
+    // The returned value is not greater than the threshold then.
+    // NB: estimators are free to ignore the threshold.
+    double rejection_threshold = -std::numeric_limits<double>::infinity();
+    // Flat scores of map cells around the estimated poses
+    // (see LocalScoreWindow); points they cover may be scored by them
+    // instead of map lookups (see scores_points_by_cells).
+    const CellScoresView *local_scores = nullptr;
   };
   using OOPE = std::shared_ptr<OccupancyObservationProbabilityEstimator>;
 public:
@@ -80,6 +122,14 @@ public:
     return scan;
   }
 
+  // Filters the scan regardless of a pose and a map, so the result may be
+  // set as the prefiltered scan (see LaserScan2D::set_prefiltered) and
+  // shared by estimators of the same configuration.
+  // NB: estimators are free to ignore prefiltered scans.
+  virtual LaserScan2D prefilter_scan(const LaserScan2D &scan) {
+    return scan;
+  }
+
   double estimate_scan_probability(const LaserScan2D &scan,
                                    const RobotPose &pose,
                                    const GridMap &map) const {
@@ -91,6 +141,32 @@ public:
                                            const GridMap &map,
                                            const SPEParams &params) const = 0;
 
+  // Probabilities of a scan for n poses.
+  // Implementations may share work between the poses (e.g. scan
+  // preprocessing or points rotated by the same angle).
+  // NB: concurrent calls are allowed only if supported (see below).
+  virtual void estimate_scan_probabilities(const LaserScan2D &scan,
+                                           const RobotPose *poses,
+                                           std::size_t n,
+                                           const GridMap &map,
+                                           const SPEParams &params,
+                                           double *probabilities) const {
+    for (std::size_t i = 0; i < n; ++i) {
+      probabilities[i] = estimate_scan_probability(scan, poses[i], map, params);
+    }
+  }
+
+  // Whether estimate_scan_probability(-ies) may be called for a given
+  // (filtered) scan and params from several threads at once.
+  virtual bool supports_concurrent_estimations(const LaserScan2D &,
+                                               const SPEParams &) const {
+    return false;
+  }
+
+  // Whether a point's probability is the score of its cell
+  // (so flat cell scores may be used, see SPEParams::local_scores).
+  virtual bool scores_points_by_cells() const { return false; }
+
   virtual ~ScanProbabilityEstimator() = default;
 private:
   OOPE _oope;
@@ -118,6 +194,10 @@ public:
 
   virtual void reset_state() {};
 
+  // Builds matcher structures derived from the map (e.g. a score pyramid)
+  // ahead of matching, e.g. once a read-only map is loaded.
+  virtual void prepare_map(const GridMap &) {}
+
   void subscribe(std::shared_ptr<GridScanMatcherObserver> obs) {
     _observers.push_back(obs);
   }
@@ -134,6 +214,19 @@ public:
     _observers = new_observers;
   }
 
+  // A matching that exceeds the budget stops and returns the best pose
+  // found so far (see last_match_is_converged).
+  // NB: a non-positive budget is unlimited; matchers that don't check
+  //     the budget ignore it.
+  void set_time_budget_ms(double budget_ms) { _time_budget_ms = budget_ms; }
+  double time_budget_ms() const { return _time_budget_ms; }
+
+  // Whether the last matching has finished its search,
+  // i.e. it has not been stopped by the time budget
+  virtual bool last_match_is_converged() const {
+    return _last_match_is_converged;
+  }
+
   void set_lookup_ranges(double x, double y = 0, double th = 0) {
     _max_x_error = x;
     _max_y_error = y;
@@ -145,6 +238,12 @@ public:
     return scan_probability_estimator()->filter_scan(scan, pose, map);
   }
 
+  // Sets the prefiltered scan of the scan (see LaserScan2D::prefiltered)
+  void prefilter_scan(LaserScan2D &scan) {
+    scan.set_prefiltered(std::make_shared<const LaserScan2D>(
+      scan_probability_estimator()->prefilter_scan(scan)));
+  }
+
   double scan_probability(const LaserScan2D &scan, const RobotPose &pose,
                           const GridMap &map) const {
     return _scan_prob_estimator->estimate_scan_probability(scan, pose, map);
@@ -155,6 +254,16 @@ public:
     return _scan_prob_estimator->estimate_scan_probability(scan, pose, map, p);
   }
 
+  void scan_probabilities(const LaserScan2D &scan,
+                          const std::vector<RobotPose> &poses,
+                          const GridMap &map,
+                          std::vector<double> &probabilities,
+                          const SPEParams &p = SPEParams{}) const {
+    probabilities.resize(poses.size());
+    _scan_prob_estimator->estimate_scan_probabilities(
+      scan, poses.data(), poses.size(), map, p, probabilities.data());
+  }
+
   SPE scan_probability_estimator() const {
     return _scan_prob_estimator;
   }
@@ -169,7 +278,13 @@ protected:
     return _observers;
   }
 
-  void do_for_each_observer(std::function<void(ObsPtr)> op) {
+  bool has_observers() const { return !_observers.empty(); }
+
+  // PERFORMANCE: the op is inlined (no std::function), so the dispatch
+  //              is a single branch if there are no observers.
+  template <typename Op>
+  void do_for_each_observer(Op op) {
+    if (!has_observers()) { return; }
     for (auto &obs : observers()) {
       if (auto obs_ptr = obs.lock()) {
         op(obs_ptr);
@@ -177,14 +292,74 @@ protected:
     }
   }
 
+  /* Scan tests reporting (see GridScanMatcherObserver::scan_test_period).
+   * A matching that tests poses calls start_scan_tests once,
+   * on_scan_tested per tested pose, on_scan_tests_pose_update per
+   * accepted one and finish_scan_tests before on_matching_end. */
+
+  void start_scan_tests() {
+    _scan_tests_summary = ScanTestsSummary{};
+    _scan_tests_are_observed = false;
+    do_for_each_observer([this](ObsPtr obs) {
+      _scan_tests_are_observed |= obs->scan_test_period() != 0;
+    });
+  }
+
+  void on_scan_tested(const RobotPose &pose, const LaserScan2D &scan,
+                      double score) {
+    if (!has_observers()) { return; }
+    auto test_i = _scan_tests_summary.tests_nm;
+    _scan_tests_summary.add_test(score);
+    if (!_scan_tests_are_observed) { return; }
+    do_for_each_observer([&](ObsPtr obs) {
+      auto period = obs->scan_test_period();
+      if (period && test_i % period == 0) {
+        obs->on_scan_test(pose, scan, score);
+      }
+    });
+  }
+
+  void on_scan_tests_pose_update() { ++_scan_tests_summary.pose_updates_nm; }
+
+  void finish_scan_tests() {
+    do_for_each_observer([this](ObsPtr obs) {
+      obs->on_scan_tests_summary(_scan_tests_summary);
+    });
+  }
+
+  /* Time budget checks (see set_time_budget_ms).
+   * A matching that respects the budget calls start_time_budget once
+   * and stops the search once time_budget_is_exceeded. */
+
+  void start_time_budget() {
+    _last_match_is_converged = true;
+    if (_time_budget_ms <= 0) { return; }
+    _deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::milli>{_time_budget_ms});
+  }
+
+  // NB: marks the matching as not converged if the budget is exceeded
+  bool time_budget_is_exceeded() {
+    if (_time_budget_ms <= 0 || Clock::now() < _deadline) { return false; }
+    _last_match_is_converged = false;
+    return true;
+  }
+
   double max_x_error() { return _max_x_error; }
   double max_y_error() { return _max_y_error; }
   double max_th_error() { return _max_th_error; }
 
+private: // types
+  using Clock = std::chrono::steady_clock;
 private:
   std::vector<std::weak_ptr<GridScanMatcherObserver>> _observers;
+  ScanTestsSummary _scan_tests_summary;
+  bool _scan_tests_are_observed = false;
   SPE _scan_prob_estimator;
   double _max_x_error = 0, _max_y_error = 0, _max_th_error = 0;
+  double _time_budget_ms = 0;
+  Clock::time_point _deadline;
+  bool _last_match_is_converged = true;
 };
 
 #endif
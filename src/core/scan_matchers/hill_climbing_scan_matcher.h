@@ -2,8 +2,11 @@
 #define SLAM_CTOR_CORE_HILL_CLIMBING_SCAN_MATCHER_H
 
 #include <memory>
+#include <vector>
+#include <algorithm>
 
 #include "pose_enumeration_scan_matcher.h"
+#include "../maps/rescalable_caching_grid_map.h"
 
 // TODO: move to pose enumerators
 class Distorsion1DPoseEnumerator : public PoseEnumerator {
@@ -27,7 +30,7 @@ public:
     auto distorted_pose = _base_pose;
 
     double shift_value = _action_id % DirNm ? -1 : 1;
-    double *shiftee;
+    Real *shiftee;
     switch (_action_id % DimNm) {
     case X:
       shiftee = &distorted_pose.x,     shift_value *= _translation_delta; break;
@@ -47,6 +50,15 @@ public:
   void reset() override {}
   void feedback(bool pose_is_acceptable) override {}
 
+  // NB: all moves are made from the base pose, so they are independent
+  void next_batch(const RobotPose &prev_pose, std::size_t max_nm,
+                  std::vector<RobotPose> &poses) override {
+    poses.clear();
+    while (poses.size() < std::max(max_nm, std::size_t{1}) && has_next()) {
+      poses.push_back(next(prev_pose));
+    }
+  }
+
 private:
   enum Dim {X = 0, Y, Th, DimNm};
   enum Dir {Inc = 0, Dec, DirNm};
@@ -68,7 +80,9 @@ public:
                         double rotation_delta)
     : _max_failed_rounds{max_failed_rounds}
     , _base_translation_delta{translation_delta}
-    , _base_rotation_delta{rotation_delta} {
+    , _base_rotation_delta{rotation_delta}
+    , _initial_translation_delta{translation_delta}
+    , _initial_rotation_delta{rotation_delta} {
     reset();
   }
 
@@ -77,21 +91,21 @@ public:
   }
 
   RobotPose next(const RobotPose &prev_pose) override {
-    if (!_round_pe.has_next()) {
-      if (_round_failed) {
-        _translation_delta *= 0.5;
-        _rotation_delta *= 0.5;
-        ++_failed_rounds;
-      }
-      reset_round(_translation_delta, _rotation_delta);
-    }
+    ensure_round_has_next();
     return _round_pe.next(prev_pose);
   }
 
+  // A batch is a part of a round
+  void next_batch(const RobotPose &prev_pose, std::size_t max_nm,
+                  std::vector<RobotPose> &poses) override {
+    ensure_round_has_next();
+    _round_pe.next_batch(prev_pose, max_nm, poses);
+  }
+
   void reset() override {
     _failed_rounds = 0;
-    _translation_delta = _base_translation_delta;
-    _rotation_delta = _base_rotation_delta;
+    _translation_delta = _initial_translation_delta;
+    _rotation_delta = _initial_rotation_delta;
 
     reset_round(_translation_delta, _rotation_delta);
   }
@@ -101,7 +115,40 @@ public:
     _round_pe.feedback(pose_is_acceptable);
   }
 
+  void set_expected_error(const RobotPoseDelta &error) override {
+    _initial_translation_delta = adapted_step(
+      _base_translation_delta, std::max(std::abs(error.x), std::abs(error.y)));
+    _initial_rotation_delta = adapted_step(_base_rotation_delta,
+                                           std::abs(error.theta));
+  }
+
+  // NB: applied on the next reset
+  void set_initial_deltas(double translation_delta, double rotation_delta) {
+    _initial_translation_delta = translation_delta;
+    _initial_rotation_delta = rotation_delta;
+  }
+  double initial_translation_delta() const {
+    return _initial_translation_delta;
+  }
+  double initial_rotation_delta() const { return _initial_rotation_delta; }
+
+  void set_max_failed_rounds(unsigned max_failed_rounds) {
+    _max_failed_rounds = max_failed_rounds;
+  }
+  unsigned max_failed_rounds() const { return _max_failed_rounds; }
+
 private:
+  void ensure_round_has_next() {
+    if (_round_pe.has_next()) { return; }
+
+    if (_round_failed) {
+      _translation_delta *= 0.5;
+      _rotation_delta *= 0.5;
+      ++_failed_rounds;
+    }
+    reset_round(_translation_delta, _rotation_delta);
+  }
+
   void reset_round(double translation_delta, double rotation_delta) {
     _round_pe = {_translation_delta, _rotation_delta};
     _round_failed = true;
@@ -109,6 +156,7 @@ private:
 private:
   unsigned _max_failed_rounds;
   double _base_translation_delta, _base_rotation_delta;
+  double _initial_translation_delta, _initial_rotation_delta;
 
   unsigned _failed_rounds;
   double _translation_delta, _rotation_delta;
@@ -120,6 +168,10 @@ private:
 class HillClimbingScanMatcher : public PoseEnumerationScanMatcher {
 private:
   using HCPE = FailedRoundsLimitedPoseEnumerator<Distorsion1DPoseEnumerator>;
+public: // consts
+  // failed rounds of a climb on a coarser map; steps are halved per
+  // failed round, so finer steps are left to finer maps
+  static constexpr unsigned Coarse_Failed_Rounds_Nm = 2;
 public:
   // FIXME: update enumerator on set_lookup_ranges update
   HillClimbingScanMatcher(std::shared_ptr<ScanProbabilityEstimator> estimator,
@@ -130,6 +182,68 @@ public:
         std::make_shared<HCPE>(max_lookup_attempts_failed,
                                translation_delta, rotation_delta)
       } {}
+
+  // If the map is rescalable (see RescalableCachingGridMap), the climb
+  // starts on a map that is 2^(scales_nm - 1) times coarser and
+  // is refined on finer ones. A coarse climb starts with a translation
+  // step of the map's cell size.
+  // NB: 1 (the default) climbs on the map's own scale only.
+  void set_scales_nm(unsigned scales_nm) {
+    _scales_nm = std::max(scales_nm, 1u);
+  }
+  unsigned scales_nm() const { return _scales_nm; }
+
+protected: // methods
+
+  // PERFORMANCE: a coarse map is smoother, so large errors are corrected
+  //              by few large steps and finer maps refine a pose that is
+  //              already close to the optimum.
+  // NB: poses are tested (and observers are notified) on coarser maps
+  //     with probabilities estimated by them.
+  void presearch(const LaserScan2D &scan, const GridMap &map,
+                 const SPEParams &map_params, RobotPose &best_pose,
+                 double &best_pose_prob) override {
+    auto hcpe = std::dynamic_pointer_cast<HCPE>(pose_enumerator());
+    if (_scales_nm < 2 || !hcpe) { return; }
+
+    auto init_translation_delta = hcpe->initial_translation_delta();
+    auto init_rotation_delta = hcpe->initial_rotation_delta();
+    auto max_failed_rounds = hcpe->max_failed_rounds();
+    auto pose = best_pose;
+    {
+      // FIXME: API - const cast (inside the RAII obj) to be able to rescale
+      SafeRescalableMap safe_map{map};
+      GridMap &rescalable_map = safe_map;
+      auto finest_scale = map.scale();
+      auto prev_scale = finest_scale;
+      hcpe->set_max_failed_rounds(Coarse_Failed_Rounds_Nm);
+      for (unsigned scale_i = _scales_nm; 1 < scale_i; --scale_i) {
+        rescalable_map.rescale(finest_scale * (1 << (scale_i - 1)));
+        auto scale = rescalable_map.scale();
+        if (scale == prev_scale) { continue; }
+        prev_scale = scale;
+
+        hcpe->set_initial_deltas(std::max(init_translation_delta, scale),
+                                 init_rotation_delta);
+        // NB: local scores are of the map's own scale
+        auto params = SPEParams{};
+        auto pose_prob = scan_probability(scan, pose, rescalable_map, params);
+        search(scan, rescalable_map, params, pose, pose_prob);
+      }
+    }
+    hcpe->set_initial_deltas(init_translation_delta, init_rotation_delta);
+    hcpe->set_max_failed_rounds(max_failed_rounds);
+
+    // NB: a coarse optimum is kept only if it is better on the map
+    auto pose_prob = scan_probability(scan, pose, map, map_params);
+    if (best_pose_prob < pose_prob) {
+      best_pose = pose;
+      best_pose_prob = pose_prob;
+    }
+  }
+
+private: // fields
+  unsigned _scales_nm = 1;
 };
 
 #endif
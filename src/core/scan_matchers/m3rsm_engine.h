@@ -3,11 +3,20 @@
 
 #include <cmath>
 #include <memory>
-#include <queue>
+#include <vector>
+#include <array>
+#include <set>
+#include <limits>
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
+#include <numeric>
+#include <tuple>
+#include <utility>
 
 #include "../geometry_primitives.h"
+#include "../thread_pool.h"
+#include "../maps/max_pooled_score_pyramid.h"
 #include "grid_scan_matcher.h"
 
 // Many-to-Many Multiple Resolution Scan Matching Engine based on Olson (2015).
@@ -17,6 +26,9 @@ private: // types
   using SPEParams = ScanProbabilityEstimator::SPEParams;
   using SPEPtr = std::shared_ptr<ScanProbabilityEstimator>;
   using Rect = decltype(SPEParams{}.sp_analysis_area);
+public: // consts
+  static constexpr std::size_t Unknown_Scan_Id =
+    std::numeric_limits<std::size_t>::max();
 public:
   // result
   double prob_upper_bound; // max scan probability given the assumptions below
@@ -29,12 +41,44 @@ public:
   bool scan_is_prerotated;
   const RobotPose *pose; // owner - user of the engine
   GridMap *map;          // owner - user of the engine
+  // the id of the scan in an engine the match comes from (if any)
+  std::size_t scan_id = Unknown_Scan_Id;
 
   static Match invalid_match() {
     static auto invalid_match = Match{std::numeric_limits<double>::quiet_NaN()};
     return invalid_match;
   }
 
+  static double estimate_prob_upper_bound(ScanProbabilityEstimator &spe,
+                                          const LaserScan2D &filtered_scan,
+                                          bool scan_is_prerotated,
+                                          const RobotPose &pose,
+                                          GridMap &map, double rotation,
+                                          const Rect &translation_drift) {
+    map.rescale(translation_drift.side()); // FIXME: non-squared areas handling
+    return estimate_rescaled_prob_upper_bound(spe, filtered_scan,
+                                              scan_is_prerotated, pose, map,
+                                              rotation, translation_drift);
+  }
+
+  // NB: the map is expected to be rescaled to the drift side
+  static double estimate_rescaled_prob_upper_bound(
+      const ScanProbabilityEstimator &spe, const LaserScan2D &filtered_scan,
+      bool scan_is_prerotated, const RobotPose &pose, const GridMap &map,
+      double rotation, const Rect &translation_drift) {
+    Point2D avg_drift = translation_drift.center();
+
+    auto drifted_pose = pose;
+    if (scan_is_prerotated) {
+      drifted_pose = RobotPose(pose.x + avg_drift.x, pose.y + avg_drift.y, 0);
+    } else {
+      drifted_pose += RobotPoseDelta(avg_drift.x, avg_drift.y, rotation);
+    }
+    return spe.estimate_scan_probability(
+       filtered_scan, drifted_pose, map,
+       SPEParams{translation_drift, scan_is_prerotated});
+  }
+
   Match(double rot, const Rect &tdrift, SPEPtr scan_prob_est,
         std::shared_ptr<LaserScan2D> filtered_lscan, bool is_rotated,
         const RobotPose &robot_pose, GridMap &grid_map, bool is_root = true)
@@ -43,25 +87,17 @@ public:
       , pose{&robot_pose}, map{&grid_map}
       , _abs_rotation{std::abs(rotation)}
       , _drift_amount{tdrift.hside_len() + tdrift.vside_len()} {
-
-    Point2D avg_drift = translation_drift.center();
-
-    auto drifted_pose = *pose;
-    if (scan_is_prerotated) {
-      drifted_pose = {pose->x + avg_drift.x, pose->y + avg_drift.y, 0};
-    } else {
-      drifted_pose += RobotPoseDelta{avg_drift.x, avg_drift.y, rotation};
-    }
     if (scan_is_prerotated && is_root) { filter_prerotated_scan(); }
-    map->rescale(translation_drift.side()); // FIXME: non-squared areas handling
-    prob_upper_bound = spe->estimate_scan_probability(
-       *filtered_scan, drifted_pose, *map,
-       SPEParams{translation_drift, scan_is_prerotated});
+    prob_upper_bound = estimate_prob_upper_bound(
+      *spe, *filtered_scan, scan_is_prerotated, *pose, *map,
+      rotation, translation_drift);
   }
 
   Match(const Rect &tdrift, const Match &that)
       : Match(that.rotation, tdrift, that.spe, that.filtered_scan,
-              that.scan_is_prerotated, *that.pose, *that.map, false) {}
+              that.scan_is_prerotated, *that.pose, *that.map, false) {
+    scan_id = that.scan_id;
+  }
 
   bool is_valid() const { return !std::isnan(prob_upper_bound); }
   double is_finest(double threashold = 0) const {
@@ -70,56 +106,50 @@ public:
 
   // returns true if the matching is _less_ prepefable than a given one
   bool operator<(const Match &that) const {
-    if (!are_equal(prob_upper_bound, that.prob_upper_bound)) {
+    return is_less_preferable(prob_upper_bound, _drift_amount, _abs_rotation,
+                              that.prob_upper_bound, that._drift_amount,
+                              that._abs_rotation);
+  }
+
+  static bool is_less_preferable(double prob, double drift_amount,
+                                 double abs_rotation, double that_prob,
+                                 double that_drift_amount,
+                                 double that_abs_rotation) {
+    if (!are_equal(prob, that_prob)) {
       // greater is "better" -> correctness
-      return less(prob_upper_bound, that.prob_upper_bound);
+      return less(prob, that_prob);
     }
-    if (!are_equal(_drift_amount, that._drift_amount)) {
+    if (!are_equal(drift_amount, that_drift_amount)) {
       // finer is "better" -> speed up
-      return _drift_amount > that._drift_amount;
+      return drift_amount > that_drift_amount;
     }
     // smaller is "better" -> fixes "blindness" of SPE
-    return _abs_rotation > that._abs_rotation;
+    return abs_rotation > that_abs_rotation;
   }
 
 private: // methods
   Match(double prob) : prob_upper_bound{prob}  {}
 
-  void filter_prerotated_scan() {
-    return;
-    /*
-    GridMap::Coord curr_area_id;
-    auto points_in_area = std::vector<ScanPoint2D>{};
-
-    map->rescale(0);
-    auto scan = filtered_scan;
-    auto filtered_pts = std::vector<ScanPoint2D>{};
-    for (const auto &sp : scan->points()) {
-      auto world_point = sp.move_origin(pose->x, pose->y);
-      auto area_id = map->world_to_cell(world_point);
-
-      if (points_in_area.size() == 0 || area_id == curr_area_id) {
-        curr_area_id = area_id;
-        points_in_area.push_back(sp);
-      } else {
-        auto effective_sp = points_in_area[0].set_factor(points_in_area.size());
-        filtered_pts.push_back(effective_sp);
-        //std::cout << points_in_area.size() << std::endl;
-        curr_area_id = area_id;
-        points_in_area.clear();
-      }
-    }
-    if (points_in_area.size()) {
-      auto effective_sp = points_in_area[0].set_factor(points_in_area.size());
-      filtered_pts.push_back(effective_sp);
-    }
-    //std::cout << scan->points().size() << " -> " << filtered_pts.size() << std::endl;
-    scan->points() = std::move(filtered_pts);
-    */
-  }
+  // a match with a known probability (see M3RSMEngine)
+  Match(double prob, double rot, const Rect &tdrift, SPEPtr scan_prob_est,
+        std::shared_ptr<LaserScan2D> filtered_lscan, bool is_rotated,
+        const RobotPose &robot_pose, GridMap &grid_map, std::size_t id)
+    : prob_upper_bound{prob}, rotation{rot}, translation_drift{tdrift}
+    , spe{scan_prob_est}, filtered_scan{filtered_lscan}
+    , scan_is_prerotated{is_rotated}, pose{&robot_pose}, map{&grid_map}
+    , scan_id{id}, _abs_rotation{std::abs(rotation)}
+    , _drift_amount{tdrift.hside_len() + tdrift.vside_len()} {}
+
+  // NB: points of a scan that fall into the same cell are merged
+  //     once per scan by a ScanVoxelDownsampler shared by matching
+  //     and mapping, so a prerotated scan is used as is. Points are merged
+  //     per coarse level for pyramid-based requests (see M3RSMEngine).
+  void filter_prerotated_scan() {}
 
 private: // fields
   double _abs_rotation, _drift_amount;
+
+  friend class M3RSMEngine;
 };
 
 std::ostream& operator<<(std::ostream &os, const Match &match) {
@@ -129,12 +159,74 @@ std::ostream& operator<<(std::ostream &os, const Match &match) {
 }
 
 
+/* PERFORMANCE: matches are kept as compact nodes that refer to the state
+ *              of a scan (an estimator, a filtered scan, etc.) by an index,
+ *              so there is no reference counting per node. Nodes are stored
+ *              in a heap over a vector that keeps its capacity between
+ *              requests, are popped by moving and are split without
+ *              temporary containers, so expanding a node doesn't allocate.
+ *              Matches (i.e. a client API) are created for results only.
+ * Several best nodes may be expanded concurrently (see
+ * set_expansion_threads_nm). Expansions are synchronous: refinements of
+ * a batch are estimated by threads and then added in the order of
+ * the sequential expansion, so the result is the exact best match and
+ * doesn't depend on threads timing. */
 class M3RSMEngine {
 private: // types
-  using Matches = std::priority_queue<Match>;
   using SPEParams = ScanProbabilityEstimator::SPEParams;
 public: // types
   using Rect = decltype(SPEParams{}.sp_analysis_area);
+private: // types
+  // Occupied points of a prerotated scan merged per cells of a coarse grid
+  // (one point per cell weighted by the number of merged points)
+  struct MergedScanPoints {
+    std::vector<int> cells_xs, cells_ys;
+    std::vector<unsigned> weights;
+  };
+
+  // a scan with all that is required to estimate its probability
+  struct ScanState {
+    std::shared_ptr<ScanProbabilityEstimator> spe;
+    std::shared_ptr<LaserScan2D> filtered_scan;
+    bool scan_is_prerotated;
+    const RobotPose *pose; // owner - user of the engine
+    GridMap *map;          // owner - user of the engine
+    // if set, bounds are looked up in the pyramid instead of the SPE ones
+    const MaxPooledScorePyramid *pyramid = nullptr; // owner - user
+    // pyramid-based requests only: merged points per a coarse grid with
+    // 2^i pyramid cells long cells (the 0-th grid is not used)
+    std::vector<MergedScanPoints> merged_points;
+    std::size_t occupied_points_nm = 0;
+  };
+
+  // a finer node to be estimated
+  struct Refinement {
+    double rotation;
+    Rect translation_drift;
+    std::size_t scan_id;
+    double prob_upper_bound;
+  };
+
+  struct Node {
+    double prob_upper_bound, rotation;
+    Rect translation_drift;
+    double abs_rotation, drift_amount;
+    std::size_t scan_id;
+
+    Node(double prob, double rot, const Rect &tdrift, std::size_t id)
+      : prob_upper_bound{prob}, rotation{rot}, translation_drift{tdrift}
+      , abs_rotation{std::abs(rot)}
+      , drift_amount{tdrift.hside_len() + tdrift.vside_len()}
+      , scan_id{id} {}
+
+    bool is_finest() const { return drift_amount <= 0; }
+
+    bool operator<(const Node &that) const {
+      return Match::is_less_preferable(prob_upper_bound, drift_amount,
+                                       abs_rotation, that.prob_upper_bound,
+                                       that.drift_amount, that.abs_rotation);
+    }
+  };
 public:
 
   M3RSMEngine(double max_finest_prob_diff = 0)
@@ -142,9 +234,25 @@ public:
     reset_engine_state();
   }
 
+  // Nodes which bounds are below ratio * (the best probability of a finest
+  // node) - max_finest_prob_diff are pruned. A ratio below 1 keeps nodes
+  // of near-best peaks (see next_peaks).
+  // NB: is expected to be set before requests are added.
+  void set_finest_prob_ratio(double ratio) { _finest_prob_ratio = ratio; }
+  double finest_prob_ratio() const { return _finest_prob_ratio; }
+
+  // Nodes which bounds are below the probability are pruned, i.e. a search
+  // without a match at least that probable ends with an invalid match
+  // as soon as bounds drop below it.
+  // NB: is applied by the next reset_engine_state.
+  void set_min_probability(double prob) { _min_probability = prob; }
+  double min_probability() const { return _min_probability; }
+
+  // NB: storages keep their capacities, so a reused engine doesn't allocate
   void reset_engine_state() {
-    _matches = Matches{};
-    _best_finest_probability = 0.0;
+    _nodes.clear();
+    _scans.clear();
+    _best_finest_probability = _min_probability;
   }
 
   void set_translation_lookup_range(double max_x_error, double max_y_error) {
@@ -157,15 +265,27 @@ public:
     _rotation_resolution = step;
   }
 
-  void add_match(Match&& match) {
-    double match_prob = match.prob_upper_bound;
-    if (match_prob < _best_finest_probability) { return; }
+  // NB: refinements are estimated concurrently only if maps and estimators
+  //     support it (see GridMap::supports_concurrent_reads and
+  //     ScanProbabilityEstimator::supports_concurrent_estimations).
+  void set_expansion_threads_nm(unsigned threads_nm) {
+    _expansion_threads_nm = std::max(threads_nm, 1u);
+  }
+  unsigned expansion_threads_nm() const { return _expansion_threads_nm; }
 
-    if (match.is_finest()) {
-      _best_finest_probability = std::max(_best_finest_probability,
-                                          match_prob - _max_finest_prob_diff);
+  void add_match(Match&& match) {
+    if (match.prob_upper_bound < _best_finest_probability) { return; }
+
+    auto scan_id = match.scan_id;
+    if (scan_id == Match::Unknown_Scan_Id || _scans.size() <= scan_id ||
+        _scans[scan_id].filtered_scan != match.filtered_scan) {
+      scan_id = add_scan(ScanState{std::move(match.spe),
+                                   std::move(match.filtered_scan),
+                                   match.scan_is_prerotated,
+                                   match.pose, match.map});
     }
-    _matches.push(std::move(match));
+    add_node(Node{match.prob_upper_bound, match.rotation,
+                  match.translation_drift, scan_id});
   }
 
   void add_scan_matching_request(std::shared_ptr<ScanProbabilityEstimator> spe,
@@ -174,71 +294,477 @@ public:
                                  bool prerotate_scan = false) {
     // generate pose translation ranges to be checked
     const auto empty_trs_range = Rect{0, 0, 0, 0};
-    const auto entire_trs_range = Rect{-_max_y_error, _max_y_error,
-                                       -_max_x_error, _max_x_error};
+    const auto entire_trs_range = Rect(-_max_y_error, _max_y_error,
+                                       -_max_x_error, _max_x_error);
 
     double rotation_drift = 0;
     auto fscan = std::make_shared<LaserScan2D>(spe->filter_scan(raw_scan, pose,
                                                                 map));
     auto rotation_resolution = _rotation_resolution;
+    auto unrotated_scan_id = Match::Unknown_Scan_Id;
+    if (!prerotate_scan) {
+      unrotated_scan_id = add_scan(ScanState{spe, fscan, false, &pose, &map});
+    }
     while (less_or_equal(2 * rotation_drift, _rotation_sector)) {
       for (auto &rot : std::set<double>{rotation_drift, -rotation_drift}) {
-        auto scan = prerotate_scan ?
-            std::make_shared<LaserScan2D>(fscan->to_cartesian(rot + pose.theta))
-          : fscan;
-        add_match(Match{rot, empty_trs_range, spe,
-                        scan, prerotate_scan, pose, map});
-        add_match(Match{rot, entire_trs_range, spe,
-                        scan, prerotate_scan, pose, map});
+        auto scan_id = unrotated_scan_id;
+        if (prerotate_scan) {
+          auto scan = std::make_shared<LaserScan2D>(
+            fscan->to_cartesian(rot + pose.theta));
+          scan_id = add_scan(ScanState{spe, scan, true, &pose, &map});
+        }
+        add_node(make_node(rot, empty_trs_range, scan_id));
+        add_node(make_node(rot, entire_trs_range, scan_id));
       }
       rotation_drift += rotation_resolution;
     }
   }
 
+  // A request which bounds are mean scores of the prerotated scan's points
+  // looked up in the pyramid of the map (see MaxPooledScorePyramid), so
+  // a bound estimation is a read per point and the map is not rescaled.
+  // NB: the pyramid is expected to be synced with the map and to have
+  //     levels for the translation lookup range.
+  void add_scan_matching_request(const MaxPooledScorePyramid &pyramid,
+                                 std::shared_ptr<ScanProbabilityEstimator> spe,
+                                 const RobotPose &pose,
+                                 const LaserScan2D &raw_scan, GridMap &map) {
+    const auto empty_trs_range = Rect{0, 0, 0, 0};
+    const auto entire_trs_range = Rect(-_max_y_error, _max_y_error,
+                                       -_max_x_error, _max_x_error);
+
+    double rotation_drift = 0;
+    auto fscan = spe->filter_scan(raw_scan, pose, map);
+    while (less_or_equal(2 * rotation_drift, _rotation_sector)) {
+      for (auto &rot : std::set<double>{rotation_drift, -rotation_drift}) {
+        auto scan = std::make_shared<LaserScan2D>(
+          fscan.to_cartesian(rot + pose.theta));
+        scan->update_soa();
+        auto scan_state = ScanState{spe, scan, true, &pose, &map};
+        scan_state.pyramid = &pyramid;
+        merge_scan_points(scan_state);
+        auto scan_id = add_scan(std::move(scan_state));
+        add_node(make_node(rot, empty_trs_range, scan_id));
+        add_node(make_node(rot, entire_trs_range, scan_id));
+      }
+      rotation_drift += _rotation_resolution;
+    }
+  }
+
+  // The bound of a pyramid-based request's scan (scans are numbered in
+  // the order they are added since the last reset) over the drift with
+  // points merged per the grid_i-th coarse grid (0 - points are not merged).
+  // NB: requests use the coarsest grid which cells are not longer than
+  //     a half of the drift; a bound of any grid bounds the drift.
+  double pyramid_bound(std::size_t scan_id, const Rect &drift,
+                       std::size_t grid_i) const {
+    const auto &scan = _scans[scan_id];
+    assert(scan.pyramid && grid_i < scan.merged_points.size());
+    return pyramid_bound(scan, drift, grid_i);
+  }
+
+  // Adds a match of the given one's scan with another translation drift.
+  // NB: unlike Match{drift, match}, the engine's bound is used
+  //     (e.g. a pyramid one).
+  void add_refined_match(const Match &match, const Rect &drift) {
+    if (match.scan_id == Match::Unknown_Scan_Id ||
+        _scans.size() <= match.scan_id ||
+        _scans[match.scan_id].filtered_scan != match.filtered_scan) {
+      add_match(Match{drift, match});
+      return;
+    }
+    add_node(make_node(match.rotation, drift, match.scan_id));
+  }
+
   Match next_best_match(double translation_step) {
-    while (!_matches.empty()) {
-      auto best_match = _matches.top();
-      _matches.pop();
-      auto coarse_drift = best_match.translation_drift;
-      auto should_branch_horz = less(translation_step,
-                                     coarse_drift.hside_len());
-      auto should_branch_vert = less(translation_step,
-                                     coarse_drift.vside_len());
-      if (!should_branch_horz && !should_branch_vert) {
-        return best_match;
+    TraceScope trace{"m3rsm search", "scmtch"};
+    while (!_nodes.empty()) {
+      if (!should_branch(_nodes.front(), translation_step)) {
+        return to_match(pop_best_node());
+      }
+
+      // NB: a leaf stops a batch since it may be the result
+      auto batch_size = _expansion_threads_nm < 2 ? 1 :
+                        _expansion_threads_nm * Expanded_Nodes_Per_Thread;
+      _expanded_nodes.clear();
+      while (!_nodes.empty() && _expanded_nodes.size() < batch_size &&
+             should_branch(_nodes.front(), translation_step)) {
+        _expanded_nodes.push_back(pop_best_node());
       }
-      branch(best_match, should_branch_horz, should_branch_vert);
+      expand_nodes(translation_step);
     }
     return Match::invalid_match();
   }
 
+  // Fills peaks with up to max_peaks_nm finest matches which are
+  // the best ones in their neighbourhoods (from the best to the worst).
+  // Two matches share a neighbourhood if their rotations differ by at most
+  // rotation_dist and their translations by at most translation_dist
+  // along both axes. A leaf match (see next_best_match) is refined to its
+  // center.
+  // PERFORMANCE: peaks are found by a single search, i.e. coarse bounds
+  //              are estimated once for all peaks and nodes that can't
+  //              reach the pruning bound (see set_finest_prob_ratio)
+  //              are dropped.
+  void next_peaks(std::size_t max_peaks_nm, double translation_step,
+                  double translation_dist, double rotation_dist,
+                  std::vector<Match> &peaks) {
+    peaks.clear();
+    while (peaks.size() < max_peaks_nm) {
+      auto match = next_best_match(translation_step);
+      // NB: nodes are popped by bounds, so the rest are pruned too
+      if (!match.is_valid() ||
+          match.prob_upper_bound < _best_finest_probability) {
+        break;
+      }
+      // NB: a leaf near a found peak is dropped without a refinement
+      auto c = match.translation_drift.center();
+      auto is_new_peak = std::none_of(peaks.begin(), peaks.end(),
+                                      [&](const Match &peak) {
+        auto peak_c = peak.translation_drift.center();
+        return less_or_equal(std::abs(match.rotation - peak.rotation),
+                             rotation_dist) &&
+               less_or_equal(std::abs(c.x - peak_c.x), translation_dist) &&
+               less_or_equal(std::abs(c.y - peak_c.y), translation_dist);
+      });
+      if (!is_new_peak) { continue; }
+      if (!match.is_finest()) {
+        add_refined_match(match, Rect{c});
+        continue;
+      }
+      peaks.push_back(std::move(match));
+    }
+  }
+
+private: // consts
+  static constexpr std::size_t Expanded_Nodes_Per_Thread = 2;
 private:
 
-  void branch(const Match &coarse_match, bool is_horz, bool is_vert) {
-    auto coarse_drift = coarse_match.translation_drift;
-    auto finer_drifts = std::vector<Rect>{};
+  static bool should_branch(const Node &node, double translation_step) {
+    return less(translation_step, node.translation_drift.hside_len()) ||
+           less(translation_step, node.translation_drift.vside_len());
+  }
+
+  Node pop_best_node() {
+    std::pop_heap(_nodes.begin(), _nodes.end());
+    auto best_node = std::move(_nodes.back());
+    _nodes.pop_back();
+    return best_node;
+  }
+
+  std::size_t add_scan(ScanState &&scan) {
+    _scans.push_back(std::move(scan));
+    return _scans.size() - 1;
+  }
+
+  Node make_node(double rotation, const Rect &drift, std::size_t scan_id) {
+    auto &scan = _scans[scan_id];
+    if (scan.pyramid) {
+      return Node{pyramid_bound(scan, drift), rotation, drift, scan_id};
+    }
+    auto prob = Match::estimate_prob_upper_bound(
+      *scan.spe, *scan.filtered_scan, scan.scan_is_prerotated,
+      *scan.pose, *scan.map, rotation, drift);
+    return Node{prob, rotation, drift, scan_id};
+  }
+
+  void add_node(Node &&node) {
+    if (node.prob_upper_bound < _best_finest_probability) { return; }
+
+    if (node.is_finest()) {
+      _best_finest_probability = std::max(
+        _best_finest_probability,
+        _finest_prob_ratio * node.prob_upper_bound - _max_finest_prob_diff);
+    }
+    _nodes.push_back(std::move(node));
+    std::push_heap(_nodes.begin(), _nodes.end());
+  }
+
+  Match to_match(const Node &node) const {
+    auto &scan = _scans[node.scan_id];
+    return Match{node.prob_upper_bound, node.rotation, node.translation_drift,
+                 scan.spe, scan.filtered_scan, scan.scan_is_prerotated,
+                 *scan.pose, *scan.map, node.scan_id};
+  }
+
+  void expand_nodes(double translation_step) {
+    _refinements.clear();
+    for (const auto &node : _expanded_nodes) {
+      split(node, less(translation_step, node.translation_drift.hside_len()),
+            less(translation_step, node.translation_drift.vside_len()));
+    }
+    estimate_refinements();
+
+    // update matches with finer ones
+    auto refinement = _refinements.begin();
+    for (const auto &coarse_node : _expanded_nodes) {
+      auto finer_nm = refinements_nm(coarse_node, translation_step);
+      for (std::size_t i = 0; i < finer_nm; ++i, ++refinement) {
+        auto bound = refinement->prob_upper_bound;
+        if (_scans[refinement->scan_id].pyramid) {
+          // NB: pyramid windows are rounded up to 2^level cells, so a finer
+          //     window may cover cells beyond a coarser one. Both bound
+          //     the finer drift, so the tighter one is kept.
+          bound = std::min(bound, coarse_node.prob_upper_bound);
+        }
+        assert(less_or_equal(bound, coarse_node.prob_upper_bound) &&
+               "BUG: Bounding assumption is violated");
+        add_node(Node{bound, refinement->rotation,
+                      refinement->translation_drift, refinement->scan_id});
+      }
+    }
+  }
+
+  static std::size_t refinements_nm(const Node &node,
+                                    double translation_step) {
+    auto is_horz = less(translation_step, node.translation_drift.hside_len());
+    auto is_vert = less(translation_step, node.translation_drift.vside_len());
+    return (is_horz && is_vert) ? 4 : 2;
+  }
+
+  // NB: splits match the ones of LightWeightRectangle (split4_evenly, etc.)
+  void split(const Node &coarse_node, bool is_horz, bool is_vert) {
+    const auto &d = coarse_node.translation_drift;
+    auto c = d.center();
+    auto add_refinement = [this, &coarse_node](const Rect &finer_drift) {
+      _refinements.push_back(Refinement{coarse_node.rotation, finer_drift,
+                                        coarse_node.scan_id, 0});
+    };
 
     if (is_horz && is_vert) {
-      finer_drifts = coarse_drift.split4_evenly();
+      add_refinement(Rect{d.bot(),     c.y, d.left(),       c.x});
+      add_refinement(Rect{    c.y, d.top(), d.left(),       c.x});
+      add_refinement(Rect{d.bot(),     c.y,      c.x, d.right()});
+      add_refinement(Rect{    c.y, d.top(),      c.x, d.right()});
     } else if (is_horz) {
-      finer_drifts = coarse_drift.split_horz();
+      add_refinement(Rect{d.bot(), d.top(), d.left(),       c.x});
+      add_refinement(Rect{d.bot(), d.top(),      c.x, d.right()});
     } else if (is_vert) {
-      finer_drifts = coarse_drift.split_vert();
+      add_refinement(Rect{d.bot(),     c.y, d.left(), d.right()});
+      add_refinement(Rect{    c.y, d.top(), d.left(), d.right()});
     }
+  }
 
-    // update matches with finer ones
-    for (auto& finer_drift : finer_drifts) {
-      auto finer_match = Match{finer_drift, coarse_match};
-      assert(less_or_equal(finer_match.prob_upper_bound,
-                           coarse_match.prob_upper_bound) &&
-             "BUG: Bounding assumption is violated");
-      add_match(std::move(finer_match));
+  // PERFORMANCE: points are merged once per rotation for each coarse grid,
+  //              so coarse bounds are estimated per distinct coarse cells
+  //              rather than per scan points.
+  void merge_scan_points(ScanState &scan) {
+    using Coord = MaxPooledScorePyramid::Coord;
+    const auto &soa = scan.filtered_scan->soa();
+    const auto &pyramid = *scan.pyramid;
+    scan.merged_points.resize(pyramid.levels_nm());
+    scan.occupied_points_nm = 0;
+    // NB: a cell of a grid is split into 2x2 cells of the finer grid,
+    //     so cells of the grid are the halved cells of the finer one.
+    _merged_cells.clear();
+    auto cell_len = 2 * pyramid.scale();
+    for (std::size_t i = 0; i < soa.size(); ++i) {
+      if (!soa.occupied[i]) { continue; }
+      _merged_cells.emplace_back(
+        Coord{int(std::floor((soa.xs[i] + scan.pose->x) / cell_len)),
+              int(std::floor((soa.ys[i] + scan.pose->y) / cell_len))}, 1);
+      ++scan.occupied_points_nm;
+    }
+
+    for (std::size_t grid_i = 1; grid_i < scan.merged_points.size();
+         ++grid_i) {
+      if (1 < grid_i) {
+        for (auto &cell : _merged_cells) {
+          cell.first = {floor_div2(cell.first.x), floor_div2(cell.first.y)};
+        }
+      }
+      std::sort(_merged_cells.begin(), _merged_cells.end(),
+                [](const std::pair<Coord, unsigned> &a,
+                   const std::pair<Coord, unsigned> &b) {
+                  return std::tie(a.first.y, a.first.x) <
+                         std::tie(b.first.y, b.first.x);
+                });
+      // merge weights of duplicates
+      auto merged_end = _merged_cells.begin();
+      for (auto it = _merged_cells.begin(); it != _merged_cells.end(); ++it) {
+        if (merged_end != _merged_cells.begin() &&
+            (merged_end - 1)->first == it->first) {
+          (merged_end - 1)->second += it->second;
+          continue;
+        }
+        *merged_end++ = *it;
+      }
+      _merged_cells.erase(merged_end, _merged_cells.end());
+
+      auto &merged = scan.merged_points[grid_i];
+      merged.cells_xs.clear();
+      merged.cells_ys.clear();
+      merged.weights.clear();
+      for (auto &cell : _merged_cells) {
+        merged.cells_xs.push_back(cell.first.x);
+        merged.cells_ys.push_back(cell.first.y);
+        merged.weights.push_back(cell.second);
+      }
+    }
+  }
+
+  static int floor_div2(int v) { return v >= 0 ? v / 2 : -((1 - v) / 2); }
+
+  // The mean of points' scores bounded over the drift (see
+  // MaxPooledScorePyramid); the pose of a prerotated scan is translated only.
+  // NB: points of a cell of a grid that is not longer than the drift
+  //     are scored together: a point of the cell moved by the drift hits
+  //     a cell of the window that starts at the moved cell's corner and
+  //     covers the cell's and the drift's lengths.
+  static double pyramid_bound(const ScanState &scan, const Rect &drift) {
+    const double scale = scan.pyramid->scale();
+    auto drift_len = std::max(drift.hside_len(), drift.vside_len());
+    auto grid_i = std::size_t{0};
+    while (grid_i + 1 < scan.merged_points.size() &&
+           scale * (1 << (grid_i + 1)) <= drift_len) {
+      ++grid_i;
+    }
+    return pyramid_bound(scan, drift, grid_i);
+  }
+
+  static double pyramid_bound(const ScanState &scan, const Rect &drift,
+                              std::size_t grid_i) {
+    if (scan.occupied_points_nm == 0) { return 0; }
+
+    const auto &pyramid = *scan.pyramid;
+    const double scale = pyramid.scale();
+    auto drift_len = std::max(drift.hside_len(), drift.vside_len());
+    auto total_score = double{0};
+    if (grid_i == 0) {
+      const auto &soa = scan.filtered_scan->soa();
+      auto level = pyramid.level(drift_len);
+      const double d_x = scan.pose->x + drift.left(),
+                   d_y = scan.pose->y + drift.bot();
+      for (std::size_t i = 0; i < soa.size(); ++i) {
+        if (!soa.occupied[i]) { continue; }
+        auto cell = MaxPooledScorePyramid::Coord{
+          int(std::floor((soa.xs[i] + d_x) / scale)),
+          int(std::floor((soa.ys[i] + d_y) / scale))};
+        total_score += pyramid.score(level, cell);
+      }
+      return total_score / scan.occupied_points_nm;
+    }
+
+    const auto &merged = scan.merged_points[grid_i];
+    const double cell_len = scale * (1 << grid_i);
+    auto level = pyramid.level(cell_len + drift_len);
+    for (std::size_t i = 0; i < merged.weights.size(); ++i) {
+      auto cell = MaxPooledScorePyramid::Coord{
+        int(std::floor((merged.cells_xs[i] * cell_len + drift.left()) /
+                       scale)),
+        int(std::floor((merged.cells_ys[i] * cell_len + drift.bot()) /
+                       scale))};
+      total_score += double(merged.weights[i]) * pyramid.score(level, cell);
+    }
+    return total_score / scan.occupied_points_nm;
+  }
+
+  void estimate_refinement(Refinement &r) const {
+    const auto &scan = _scans[r.scan_id];
+    if (scan.pyramid) {
+      r.prob_upper_bound = pyramid_bound(scan, r.translation_drift);
+      return;
+    }
+    r.prob_upper_bound = Match::estimate_rescaled_prob_upper_bound(
+      *scan.spe, *scan.filtered_scan, scan.scan_is_prerotated,
+      *scan.pose, *scan.map, r.rotation, r.translation_drift);
+  }
+
+  // PERFORMANCE: a rescaling changes the map state, so refinements are
+  //              grouped by maps and scales and each group is estimated
+  //              by threads once its map is rescaled.
+  void estimate_refinements() {
+    if (_expansion_threads_nm < 2 || _refinements.size() < 2) {
+      for (auto &r : _refinements) {
+        auto &scan = _scans[r.scan_id];
+        if (!scan.pyramid) { scan.map->rescale(r.translation_drift.side()); }
+        estimate_refinement(r);
+      }
+      return;
+    }
+
+    // NB: pyramid bounds don't need a map (nullptr)
+    auto map_of = [this](std::size_t r_i) -> GridMap* {
+      const auto &scan = _scans[_refinements[r_i].scan_id];
+      return scan.pyramid ? nullptr : scan.map;
+    };
+    auto side_of = [this](std::size_t r_i) {
+      return _refinements[r_i].translation_drift.side();
+    };
+    _refinements_order.resize(_refinements.size());
+    std::iota(_refinements_order.begin(), _refinements_order.end(), 0);
+    std::stable_sort(_refinements_order.begin(), _refinements_order.end(),
+                     [&](std::size_t a, std::size_t b) {
+      if (map_of(a) != map_of(b)) {
+        return std::less<GridMap*>{}(map_of(a), map_of(b));
+      }
+      return map_of(a) && side_of(a) < side_of(b);
+    });
+
+    auto group_begin = std::size_t{0};
+    while (group_begin < _refinements_order.size()) {
+      auto first_r_i = _refinements_order[group_begin];
+      auto group_end = group_begin + 1;
+      while (group_end < _refinements_order.size() &&
+             map_of(_refinements_order[group_end]) == map_of(first_r_i) &&
+             (!map_of(first_r_i) ||
+              side_of(_refinements_order[group_end]) == side_of(first_r_i))) {
+        ++group_end;
+      }
+
+      auto map = map_of(first_r_i);
+      if (map) { map->rescale(side_of(first_r_i)); }
+      estimate_refinements_group(group_begin, group_end,
+                                 !map || map->supports_concurrent_reads());
+      group_begin = group_end;
     }
   }
 
+  void estimate_refinements_group(std::size_t begin, std::size_t end,
+                                  bool map_supports_concurrent_reads) {
+    auto estimate_range = [this](std::size_t range_begin,
+                                 std::size_t range_end) {
+      for (auto i = range_begin; i < range_end; ++i) {
+        estimate_refinement(_refinements[_refinements_order[i]]);
+      }
+    };
+
+    auto is_concurrent = map_supports_concurrent_reads;
+    for (auto i = begin; is_concurrent && i < end; ++i) {
+      const auto &r = _refinements[_refinements_order[i]];
+      const auto &scan = _scans[r.scan_id];
+      is_concurrent = scan.pyramid ||
+        scan.spe->supports_concurrent_estimations(
+          *scan.filtered_scan,
+          SPEParams{r.translation_drift, scan.scan_is_prerotated});
+    }
+    auto threads_nm = std::min<std::size_t>(_expansion_threads_nm,
+                                            end - begin);
+    if (!is_concurrent || threads_nm < 2) {
+      estimate_range(begin, end);
+      return;
+    }
+
+    auto chunk_size = (end - begin + threads_nm - 1) / threads_nm;
+    auto chunks_nm = (end - begin + chunk_size - 1) / chunk_size;
+    ThreadPool::shared()->parallel_for(chunks_nm, [&](std::size_t chunk_i) {
+      auto chunk_begin = begin + chunk_i * chunk_size;
+      estimate_range(chunk_begin, std::min(chunk_begin + chunk_size, end));
+    }, threads_nm);
+  }
+
 private:
   double _max_finest_prob_diff;
-  std::priority_queue<Match> _matches;
+  double _finest_prob_ratio = 1;
+  double _min_probability = 0;
+  std::vector<Node> _nodes; // a max-heap
+  std::vector<ScanState> _scans;
+  unsigned _expansion_threads_nm = 1;
+  // buffers reused by expansions
+  std::vector<Node> _expanded_nodes;
+  std::vector<Refinement> _refinements;
+  std::vector<std::size_t> _refinements_order;
+  std::vector<std::pair<MaxPooledScorePyramid::Coord, unsigned>> _merged_cells;
   double _best_finest_probability;
   double _max_x_error, _max_y_error;
   double _rotation_sector, _rotation_resolution;
@@ -1,25 +1,33 @@
 #ifndef SLAM_CTOR_CORE_MONTE_CARLO_SCAN_MATCHER_H
 #define SLAM_CTOR_CORE_MONTE_CARLO_SCAN_MATCHER_H
 
+#include <cmath>
+#include <cstdint>
 #include <random>
 #include <memory>
+#include <vector>
+#include <algorithm>
 
 #include "../random_utils.h"
 #include "pose_enumeration_scan_matcher.h"
 
 class GaussianPoseEnumerator : public PoseEnumerator {
 protected:
-  using Engine = std::mt19937;
+  using Engine = Xoshiro256PlusPlus;
 public:
   GaussianPoseEnumerator(unsigned seed,
                          double translation_dispersion,
                          double rotation_dispersion,
                          unsigned max_dispersion_failed_attempts,
-                         unsigned max_poses_nm)
+                         unsigned max_poses_nm,
+                         unsigned speculative_poses_nm = 1)
     : _max_failed_attempts_per_shift{max_dispersion_failed_attempts}
     , _max_poses_nm{max_poses_nm}
+    , _speculative_poses_nm{std::max(speculative_poses_nm, 1u)}
     , _base_translation_dispersion{translation_dispersion}
     , _base_rotation_dispersion{rotation_dispersion}
+    , _initial_translation_dispersion{translation_dispersion}
+    , _initial_rotation_dispersion{rotation_dispersion}
     , _pose_shift_rv{GaussianRV1D<Engine>{0, 0},
                      GaussianRV1D<Engine>{0, 0},
                      GaussianRV1D<Engine>{0, 0}}
@@ -33,12 +41,34 @@ public:
   }
 
   RobotPose next(const RobotPose &prev_pose) override {
-    return prev_pose + _pose_shift_rv.sample(_pr_generator);
+    return prev_pose + sample_shift();
+  }
+
+  // Speculative batches: poses are sampled around the same pose with
+  // the same dispersion and feedback is applied afterwards, so the search
+  // differs from the sequential one (but is still deterministic).
+  void next_batch(const RobotPose &prev_pose, std::size_t max_nm,
+                  std::vector<RobotPose> &poses) override {
+    poses.clear();
+    auto batch_size = std::min<std::size_t>({std::max(max_nm, std::size_t{1}),
+                                             _speculative_poses_nm,
+                                             _max_poses_nm - _poses_nm});
+    while (poses.size() < batch_size) {
+      poses.push_back(next(prev_pose));
+    }
   }
 
   void reset() override {
     _poses_nm = 0;
-    reset_shift(_base_translation_dispersion, _base_rotation_dispersion);
+    reset_shift(_initial_translation_dispersion, _initial_rotation_dispersion);
+  }
+
+  void set_expected_error(const RobotPoseDelta &error) override {
+    _initial_translation_dispersion = adapted_step(
+      _base_translation_dispersion,
+      std::max(std::abs(error.x), std::abs(error.y)));
+    _initial_rotation_dispersion = adapted_step(_base_rotation_dispersion,
+                                                std::abs(error.theta));
   }
 
   void feedback(bool pose_is_acceptable) override {
@@ -54,6 +84,16 @@ public:
     }
   }
 
+protected: // methods
+
+  virtual RobotPoseDelta sample_shift() {
+    return _pose_shift_rv.sample(_pr_generator);
+  }
+
+  double translation_dispersion() const { return _translation_dispersion; }
+  double rotation_dispersion() const { return _rotation_dispersion; }
+  Engine& generator() { return _pr_generator; }
+
 private:
   void reset_shift(double new_translation_dispersion,
                    double new_rotation_dispersion) {
@@ -72,31 +112,101 @@ private:
 private:
   // number of poses
   unsigned _max_failed_attempts_per_shift, _max_poses_nm;
+  unsigned _speculative_poses_nm;
   unsigned _failed_attempts_per_shift, _poses_nm;
   // sampling params
   double _base_translation_dispersion, _base_rotation_dispersion;
+  double _initial_translation_dispersion, _initial_rotation_dispersion;
   double _translation_dispersion, _rotation_dispersion;
 
   RobotPoseDeltaRV<Engine> _pose_shift_rv;
   Engine _pr_generator;
 };
 
+/* Samples poses with a scrambled Halton sequence (bases 2, 3 and 5 for x, y
+ * and theta) mapped through the Gaussian quantile function, so shifts
+ * cover the Gaussian evenly rather than cluster as i.i.d. samples do.
+ * The schedule of dispersions is the one of GaussianPoseEnumerator.
+ * NB: the sequence is scrambled by a random shift modulo 1
+ *     (Cranley-Patterson rotation) drawn on each reset. */
+class HaltonGaussianPoseEnumerator : public GaussianPoseEnumerator {
+public:
+  using GaussianPoseEnumerator::GaussianPoseEnumerator;
+
+  void reset() override {
+    GaussianPoseEnumerator::reset();
+    _sample_i = 0;
+    auto shift_rv = std::uniform_real_distribution<>{0, 1};
+    for (auto &shift : _scrambling_shifts) {
+      shift = shift_rv(generator());
+    }
+  }
+
+protected: // methods
+
+  RobotPoseDelta sample_shift() override {
+    // NB: the 0-th element is 0 in all dimensions
+    ++_sample_i;
+    return RobotPoseDelta(
+      translation_dispersion() * standard_normal_quantile(coordinate(0)),
+      translation_dispersion() * standard_normal_quantile(coordinate(1)),
+      rotation_dispersion() * standard_normal_quantile(coordinate(2)));
+  }
+
+private: // methods
+
+  double coordinate(unsigned dim_i) const {
+    static constexpr unsigned Bases[] = {2, 3, 5};
+    static constexpr double Min_Coordinate = 1e-9;
+    auto c = radical_inverse(Bases[dim_i], _sample_i) +
+             _scrambling_shifts[dim_i];
+    c -= std::floor(c);
+    return std::min(std::max(c, Min_Coordinate), 1 - Min_Coordinate);
+  }
+
+private: // fields
+  // NB: the base class constructor calls its own reset, so a sequence
+  //     without scrambling is used until the first reset.
+  uint64_t _sample_i = 0;
+  double _scrambling_shifts[3] = {0, 0, 0};
+};
+
 class MonteCarloScanMatcher : public PoseEnumerationScanMatcher {
 public:
   // FIXME: update enumerator on set_lookup_ranges update
+  // NB: quasi-random sampling uses HaltonGaussianPoseEnumerator
   MonteCarloScanMatcher(std::shared_ptr<ScanProbabilityEstimator> estimator,
                         unsigned seed,
                         double translation_dispersion,
                         double rotation_dispersion,
                         unsigned failed_attempts_per_dispersion,
-                        unsigned total_attempts)
+                        unsigned total_attempts,
+                        unsigned speculative_attempts = 1,
+                        bool is_quasi_random = false)
     : PoseEnumerationScanMatcher{
         estimator,
-        std::make_shared<GaussianPoseEnumerator>(
-          seed, translation_dispersion, rotation_dispersion,
-          failed_attempts_per_dispersion, total_attempts
+        make_pose_enumerator(
+          is_quasi_random, seed, translation_dispersion, rotation_dispersion,
+          failed_attempts_per_dispersion, total_attempts,
+          speculative_attempts
         )
       } {}
+
+private: // methods
+  static std::shared_ptr<PoseEnumerator> make_pose_enumerator(
+      bool is_quasi_random, unsigned seed,
+      double translation_dispersion, double rotation_dispersion,
+      unsigned failed_attempts_per_dispersion, unsigned total_attempts,
+      unsigned speculative_attempts) {
+    if (is_quasi_random) {
+      return std::make_shared<HaltonGaussianPoseEnumerator>(
+        seed, translation_dispersion, rotation_dispersion,
+        failed_attempts_per_dispersion, total_attempts, speculative_attempts);
+    }
+    return std::make_shared<GaussianPoseEnumerator>(
+      seed, translation_dispersion, rotation_dispersion,
+      failed_attempts_per_dispersion, total_attempts, speculative_attempts);
+  }
 };
 
 #endif
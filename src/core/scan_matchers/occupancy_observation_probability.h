@@ -2,24 +2,114 @@
 #define SLAM_CTOR_CORE_OCCUPANCY_OBSERVATION_PROBABILITY_H
 
 #include <cmath>
+#include <algorithm>
 #include "../maps/grid_rasterization.h"
+#include "../maps/area_score_tables.h"
 #include "grid_scan_matcher.h"
 
+/* Calls of a map of a known type.
+ * NB: qualified calls are not virtual, so they can be inlined; the map
+ *     must be of the MapT type exactly (not a descendant). Calls of
+ *     a GridMap stay virtual. */
+template <typename MapT>
+struct StaticMapCalls {
+  static double discrepancy(const MapT &map, const GridMap::Coord &area_id,
+                            const AreaOccupancyObservation &aoo) {
+    return map.MapT::discrepancy(area_id, aoo);
+  }
+  static void row_discrepancies(const MapT &map,
+                                const GridMap::Coord &area_id, int areas_nm,
+                                const AreaOccupancyObservation &aoo,
+                                double *discrepancies) {
+    map.MapT::row_discrepancies(area_id, areas_nm, aoo, discrepancies);
+  }
+  static const AreaScoreTables *area_score_tables(const MapT &map) {
+    return map.MapT::area_score_tables();
+  }
+};
+
+template <>
+struct StaticMapCalls<GridMap> {
+  static double discrepancy(const GridMap &map, const GridMap::Coord &area_id,
+                            const AreaOccupancyObservation &aoo) {
+    return map.discrepancy(area_id, aoo);
+  }
+  static void row_discrepancies(const GridMap &map,
+                                const GridMap::Coord &area_id, int areas_nm,
+                                const AreaOccupancyObservation &aoo,
+                                double *discrepancies) {
+    map.row_discrepancies(area_id, areas_nm, aoo, discrepancies);
+  }
+  static const AreaScoreTables *area_score_tables(const GridMap &map) {
+    return map.area_score_tables();
+  }
+};
+
+// Calls action(area_id, discrepancy) for each area of the rectangle.
+// PERFORMANCE: discrepancies are requested per row spans,
+//              i.e. with a virtual call per span instead of per area
+//              (no virtual calls for a map of a known type).
+template <typename Action, typename MapT = GridMap>
+void for_each_area_discrepancy(const MapT &map,
+                               const LightWeightRectangle &area,
+                               const AreaOccupancyObservation &aoo,
+                               Action action) {
+  using Coord = GridMap::Coord;
+  static constexpr int Max_Span_Len = 32;
+  double discrepancies[Max_Span_Len];
+
+  auto rasterized_area = GridRasterizedRectangle{map, area};
+  rasterized_area.for_each_row([&](const Coord &row_begin, int row_len) {
+    for (int offset = 0; offset < row_len; offset += Max_Span_Len) {
+      int span_len = std::min(Max_Span_Len, row_len - offset);
+      auto span_begin = Coord{row_begin.x + offset, row_begin.y};
+      StaticMapCalls<MapT>::row_discrepancies(map, span_begin, span_len,
+                                              aoo, discrepancies);
+      for (int i = 0; i < span_len; ++i) {
+        action(Coord{span_begin.x + i, span_begin.y}, discrepancies[i]);
+      }
+    }
+  });
+}
+
+// Area score tables of the map if they answer the observation.
+// PERFORMANCE: the tables answer a rectangle with a few lookups
+//              regardless of the number of covered cells.
+template <typename MapT = GridMap>
+const AreaScoreTables *area_score_tables(
+    const MapT &map, const AreaOccupancyObservation &aoo) {
+  return AreaScoreTables::is_expected(aoo) ?
+    StaticMapCalls<MapT>::area_score_tables(map) : nullptr;
+}
+
 // TODO: add an option that alters
 //       aoo.observation quality based on overlap
 //       map.world_cell_bounds(area_id).overlap(area); // NB: order
 
+/* NB: an estimator's map_probability is the probability for a map
+ *     of a known type (see StaticWeightedMeanPointProbabilitySPE). */
+
 class ObstacleBasedOccupancyObservationPE
   : public OccupancyObservationProbabilityEstimator {
 public:
   double probability(const AreaOccupancyObservation &aoo,
-                     const LightWeightRectangle &,
+                     const LightWeightRectangle &area,
                      const GridMap &map) const override {
+    return map_probability(aoo, area, map);
+  }
+
+  template <typename MapT>
+  double map_probability(const AreaOccupancyObservation &aoo,
+                         const LightWeightRectangle &,
+                         const MapT &map) const {
     assert(aoo.is_occupied);
-    double prob = 1.0 - map[map.world_to_cell(aoo.obstacle)].discrepancy(aoo);
+    double prob = 1.0 - StaticMapCalls<MapT>::discrepancy(
+      map, map.world_to_cell(aoo.obstacle), aoo);
     assert(0 <= prob);
     return prob;
   }
+
+  bool is_obstacle_cell_based() const override { return true; }
 };
 
 class MaxOccupancyObservationPE
@@ -28,16 +118,26 @@ public:
   double probability(const AreaOccupancyObservation &aoo,
                      const LightWeightRectangle &area,
                      const GridMap &map) const override {
+    return map_probability(aoo, area, map);
+  }
+
+  template <typename MapT>
+  double map_probability(const AreaOccupancyObservation &aoo,
+                         const LightWeightRectangle &area,
+                         const MapT &map) const {
     assert(aoo.is_occupied);
-    auto max_probability = double{0};
-    auto area_ids = GridRasterizedRectangle{map, area};
+    if (auto tables = area_score_tables(map, aoo)) {
+      auto cells = GridRasterizedRectangle{map, area};
+      return tables->max_score(cells.left_bot(), cells.right_top());
+    }
 
-    while (area_ids.has_next()) {
-      auto area_id = area_ids.next();
-      double obs_prob = 1.0 - map[area_id].discrepancy(aoo);
+    auto max_probability = double{0};
+    for_each_area_discrepancy(map, area, aoo,
+                              [&](const GridMap::Coord &, double discrepancy) {
+      double obs_prob = 1.0 - discrepancy;
       assert(0 <= obs_prob);
       max_probability = std::max(obs_prob, max_probability);
-    }
+    });
     return max_probability;
   }
 };
@@ -48,17 +148,31 @@ public:
   double probability(const AreaOccupancyObservation &aoo,
                      const LightWeightRectangle &area,
                      const GridMap &map) const override {
+    return map_probability(aoo, area, map);
+  }
+
+  template <typename MapT>
+  double map_probability(const AreaOccupancyObservation &aoo,
+                         const LightWeightRectangle &area,
+                         const MapT &map) const {
     assert(aoo.is_occupied);
+    if (auto tables = area_score_tables(map, aoo)) {
+      auto cells = GridRasterizedRectangle{map, area};
+      auto &lb = cells.left_bot(), &rt = cells.right_top();
+      auto area_nm = double(rt.x - lb.x + 1) * (rt.y - lb.y + 1);
+      return tables->score_sum(lb, rt) / area_nm;
+    }
+
     auto tot_probability = double{0};
     auto area_nm = unsigned{0};
 
-    auto area_ids = GridRasterizedRectangle{map, area};
-    while (area_ids.has_next()) {
-      auto obs_prob = 1.0 - map[area_ids.next()].discrepancy(aoo);
+    for_each_area_discrepancy(map, area, aoo,
+                              [&](const GridMap::Coord &, double discrepancy) {
+      auto obs_prob = 1.0 - discrepancy;
       assert(0 <= obs_prob);
       tot_probability += obs_prob;
       area_nm += 1;
-    }
+    });
     return area_nm ? tot_probability / area_nm : 0.5;
   }
 };
@@ -70,20 +184,92 @@ public:
                      const LightWeightRectangle &area,
                      const GridMap &map) const override {
     assert(aoo.is_occupied);
+    auto tables = area_score_tables(map, aoo);
+    if (tables && 0 < area.area() && std::isfinite(area.area())) {
+      return tables_probability(*tables, area, map);
+    }
+
     double tot_probability = 0;
     double tot_weight = 0;
 
-    auto area_ids = GridRasterizedRectangle{map, area};
-    while (area_ids.has_next()) {
-      auto area_id = area_ids.next();
-      auto obs_prob = 1.0 - map[area_id].discrepancy(aoo);
+    for_each_area_discrepancy(map, area, aoo,
+                              [&](const GridMap::Coord &area_id,
+                                  double discrepancy) {
+      auto obs_prob = 1.0 - discrepancy;
       assert(0 <= obs_prob);
       auto weight = area.overlap(map.world_cell_bounds(area_id));
       tot_probability += obs_prob * weight;
       tot_weight += weight;
+    });
+    return tot_weight ? tot_probability / tot_weight : 0.5;
+  }
+
+private: // types
+  // cells [from, to] along an axis that overlap the area by the same length
+  struct OverlapSpan {
+    int from, to;
+    double overlap;
+  };
+
+private: // methods
+
+  // NB: the overlap of a cell is a product of overlaps of its column and
+  //     its row, so the weighted sum is a sum over at most 3x3 rectangles
+  //     of equally weighted cells (border and inner columns/rows).
+  static double tables_probability(const AreaScoreTables &tables,
+                                   const LightWeightRectangle &area,
+                                   const GridMap &map) {
+    auto cells = GridRasterizedRectangle{map, area};
+    auto &lb = cells.left_bot(), &rt = cells.right_top();
+    auto lb_bounds = map.world_cell_bounds(lb),
+         rt_bounds = map.world_cell_bounds(rt);
+
+    OverlapSpan columns[3], rows[3];
+    auto columns_nm = overlap_spans(
+      lb.x, rt.x, map.scale(),
+      overlap(area.left(), area.right(), lb_bounds.left(), lb_bounds.right()),
+      overlap(area.left(), area.right(), rt_bounds.left(), rt_bounds.right()),
+      columns);
+    auto rows_nm = overlap_spans(
+      lb.y, rt.y, map.scale(),
+      overlap(area.bot(), area.top(), lb_bounds.bot(), lb_bounds.top()),
+      overlap(area.bot(), area.top(), rt_bounds.bot(), rt_bounds.top()),
+      rows);
+
+    double tot_probability = 0, tot_weight_x = 0, tot_weight_y = 0;
+    for (unsigned col_i = 0; col_i < columns_nm; ++col_i) {
+      auto &col = columns[col_i];
+      tot_weight_x += col.overlap * (col.to - col.from + 1);
+      for (unsigned row_i = 0; row_i < rows_nm; ++row_i) {
+        auto &row = rows[row_i];
+        if (col_i == 0) {
+          tot_weight_y += row.overlap * (row.to - row.from + 1);
+        }
+        tot_probability += col.overlap * row.overlap *
+          tables.score_sum({col.from, row.from}, {col.to, row.to});
+      }
     }
+    auto tot_weight = tot_weight_x * tot_weight_y;
     return tot_weight ? tot_probability / tot_weight : 0.5;
   }
+
+  static double overlap(double area_beg, double area_end,
+                        double cell_beg, double cell_end) {
+    return std::max(0.0, std::min(area_end, cell_end) -
+                         std::max(area_beg, cell_beg));
+  }
+
+  // Splits cells [from, to] to the first, inner and last cells
+  static unsigned overlap_spans(int from, int to, double cell_len,
+                                double first_overlap, double last_overlap,
+                                OverlapSpan *spans) {
+    unsigned spans_nm = 0;
+    spans[spans_nm++] = {from, from, first_overlap};
+    if (from == to) { return spans_nm; }
+    if (from + 1 < to) { spans[spans_nm++] = {from + 1, to - 1, cell_len}; }
+    spans[spans_nm++] = {to, to, last_overlap};
+    return spans_nm;
+  }
 };
 
 #endif
@@ -3,14 +3,24 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
+#include <algorithm>
 
+#include "../thread_pool.h"
 #include "pose_enumerators.h"
 #include "grid_scan_matcher.h"
+#include "correction_prior_model.h"
+#include "../maps/local_score_window.h"
 
 // TODO: merge the logic with hill climbing scan matcher
 //       create free functions that create scan matchers
 // TODO: move publish transform to observer
 class PoseEnumerationScanMatcher : public GridScanMatcher {
+public: // consts
+  // max number of poses estimated together (see PoseEnumerator::next_batch)
+  static constexpr std::size_t Pose_Batch_Size = 64;
+  // max number of cells of a local score window (see set_local_window_margin)
+  static constexpr std::size_t Max_Local_Window_Cells_Nm = 1 << 18;
 public:
   PoseEnumerationScanMatcher(std::shared_ptr<ScanProbabilityEstimator> spe,
                              std::shared_ptr<PoseEnumerator> pe)
@@ -22,6 +32,35 @@ public:
 
   auto pose_enumerator() const { return _pose_enumerator; }
 
+  // NB: poses of a batch are estimated by estimation_threads_nm threads
+  //     if both the estimator and the map support it; feedback is applied
+  //     afterwards in the enumeration order, so the result doesn't depend
+  //     on the threads number.
+  void set_estimation_threads_nm(unsigned threads_nm) {
+    _estimation_threads_nm = std::max(threads_nm, 1u);
+  }
+  unsigned estimation_threads_nm() const { return _estimation_threads_nm; }
+
+  // If set, the search starts from the initial pose moved by the predicted
+  // correction (if the pose is more probable) and initial steps of the
+  // enumerator are adapted to the expected error of the prediction.
+  // The model is updated with found corrections.
+  void set_correction_prior_model(std::shared_ptr<CorrectionPriorModel> cpm) {
+    _correction_prior_model = cpm;
+  }
+
+  // If the estimator scores points by cells and the map keeps no flat
+  // cell scores (see AreaScoreTablesGridMap), scores of the scan's area
+  // at the initial pose expanded by the margin (in meters) are extracted
+  // once per scan (see LocalScoreWindow). The window is kept while scans
+  // stay in it and is updated by modified areas only; a new window is
+  // extended by the margin once more to be kept by the next scans.
+  // NB: a negative margin disables the extraction.
+  void set_local_window_margin(double margin) {
+    _local_window_margin = margin;
+  }
+  double local_window_margin() const { return _local_window_margin; }
+
   // GridScanMatcher API implementation
 
   void reset_state() override {
@@ -35,49 +74,180 @@ public:
     do_for_each_observer([&init_pose, &raw_scan, &map](ObsPtr obs) {
       obs->on_matching_start(init_pose, raw_scan, map);
     });
+    start_time_budget();
     auto scan = filter_scan(raw_scan.scan, init_pose, map);
+    auto params = SPEParams{};
+    params.local_scores = extract_local_scores(scan, init_pose, map);
     auto best_pose = init_pose;
-    auto best_pose_prob = scan_probability(scan, best_pose, map);
+    auto best_pose_prob = scan_probability(scan, best_pose, map, params);
+    if (_correction_prior_model && _correction_prior_model->is_ready()) {
+      warm_start(scan, map, params, best_pose, best_pose_prob);
+    }
 
-    do_for_each_observer([best_pose, scan, best_pose_prob](ObsPtr obs) {
-      obs->on_scan_test(best_pose, scan, best_pose_prob);
+    start_scan_tests();
+    on_scan_tested(best_pose, scan, best_pose_prob);
+    do_for_each_observer([&best_pose, &scan, &best_pose_prob](ObsPtr obs) {
       obs->on_pose_update(best_pose, scan, best_pose_prob);
     });
 
-    _pose_enumerator->reset();
-    while (_pose_enumerator->has_next()) {
-      auto sampled_pose = _pose_enumerator->next(best_pose);
-      double sampled_scan_prob = scan_probability(scan, sampled_pose, map);
-      do_for_each_observer([&sampled_pose, &scan,
-                            &sampled_scan_prob](ObsPtr obs) {
-        obs->on_scan_test(sampled_pose, scan, sampled_scan_prob);
-      });
-
-      auto pose_is_acceptable = best_pose_prob < sampled_scan_prob;
-      _pose_enumerator->feedback(pose_is_acceptable);
-      if (!pose_is_acceptable) {
-        continue;
-      }
-
-      // update pose
-      best_pose_prob = sampled_scan_prob;
-      best_pose = sampled_pose;
-
-      // notify pose update
-      do_for_each_observer([&best_pose, &scan, &best_pose_prob](ObsPtr obs) {
-        obs->on_pose_update(best_pose, scan, best_pose_prob);
-      });
-    }
+    presearch(scan, map, params, best_pose, best_pose_prob);
+    search(scan, map, params, best_pose, best_pose_prob);
 
     pose_delta = best_pose - init_pose;
+    if (_correction_prior_model) {
+      _correction_prior_model->update(pose_delta);
+    }
+    finish_scan_tests();
     do_for_each_observer([&scan, &pose_delta, &best_pose_prob](ObsPtr obs) {
         obs->on_matching_end(pose_delta, scan, best_pose_prob);
     });
     return best_pose_prob;
   }
 
-private:
+protected: // methods
+
+  // A hook that may move the best pose before the search
+  // (e.g. by a search on a coarser map)
+  virtual void presearch(const LaserScan2D &, const GridMap &,
+                         const SPEParams &, RobotPose &, double &) {}
+
+  // Enumerates poses starting from the best one (see PoseEnumerator)
+  // until the enumerator or the time budget is exhausted.
+  void search(const LaserScan2D &scan, const GridMap &map,
+              const SPEParams &params,
+              RobotPose &best_pose, double &best_pose_prob) {
+    TraceScope trace{"enumeration search", "scmtch"};
+    _pose_enumerator->reset();
+    // NB: the budget is checked per batch
+    while (_pose_enumerator->has_next() && !time_budget_is_exceeded()) {
+      _pose_enumerator->next_batch(best_pose,
+                                   Pose_Batch_Size * _estimation_threads_nm,
+                                   _sampled_poses);
+      estimate_sampled_poses(scan, map, params, best_pose_prob);
+      for (std::size_t i = 0; i < _sampled_poses.size(); ++i) {
+        // speculative poses (see GaussianPoseEnumerator) may be redundant
+        if (i != 0 && !_pose_enumerator->has_next()) { break; }
+
+        const auto &sampled_pose = _sampled_poses[i];
+        double sampled_scan_prob = _sampled_scan_probs[i];
+        on_scan_tested(sampled_pose, scan, sampled_scan_prob);
+
+        auto pose_is_acceptable = best_pose_prob < sampled_scan_prob;
+        _pose_enumerator->feedback(pose_is_acceptable);
+        if (!pose_is_acceptable) {
+          continue;
+        }
+
+        // update pose
+        best_pose_prob = sampled_scan_prob;
+        best_pose = sampled_pose;
+
+        // notify pose update
+        on_scan_tests_pose_update();
+        do_for_each_observer([&best_pose, &scan, &best_pose_prob](ObsPtr obs) {
+          obs->on_pose_update(best_pose, scan, best_pose_prob);
+        });
+      }
+    }
+  }
+
+private: // methods
+
+  // PERFORMANCE: a matching touches a few square meters of the map,
+  //              so candidate poses are scored against a contiguous
+  //              copy of them rather than the whole map.
+  // NB: poses whose points leave the window are estimated by the map.
+  const CellScoresView *extract_local_scores(const LaserScan2D &scan,
+                                             const RobotPose &pose,
+                                             const GridMap &map) {
+    if (_local_window_margin < 0 || !scan.has_soa() ||
+        scan.soa().size() == 0 ||
+        !scan_probability_estimator()->scores_points_by_cells() ||
+        map.area_score_tables()) {
+      return nullptr;
+    }
+
+    scan.soa().to_world(pose, _window_xs, _window_ys);
+    auto xs_range = std::minmax_element(_window_xs.begin(), _window_xs.end());
+    auto ys_range = std::minmax_element(_window_ys.begin(), _window_ys.end());
+    auto min_x = *xs_range.first - _local_window_margin,
+         max_x = *xs_range.second + _local_window_margin;
+    auto min_y = *ys_range.first - _local_window_margin,
+         max_y = *ys_range.second + _local_window_margin;
+    auto window_cells_nm = [&](double slack) {
+      return ((max_x - min_x + 2 * slack) / map.scale() + 2) *
+             ((max_y - min_y + 2 * slack) / map.scale() + 2);
+    };
+    if (Max_Local_Window_Cells_Nm < window_cells_nm(0)) { return nullptr; }
+
+    auto slack = _local_window_margin;
+    if (Max_Local_Window_Cells_Nm < window_cells_nm(slack)) { slack = 0; }
+    _local_window.sync(map, min_x, min_y, max_x, max_y, slack);
+    _local_scores = _local_window.cell_scores();
+    return &_local_scores;
+  }
+
+  void warm_start(const LaserScan2D &scan, const GridMap &map,
+                  const SPEParams &params,
+                  RobotPose &best_pose, double &best_pose_prob) {
+    auto predicted_pose =
+      best_pose + _correction_prior_model->predicted_correction();
+    auto predicted_pose_prob = scan_probability(scan, predicted_pose, map,
+                                                params);
+    if (best_pose_prob < predicted_pose_prob) {
+      best_pose = predicted_pose;
+      best_pose_prob = predicted_pose_prob;
+    }
+    _pose_enumerator->set_expected_error(
+      _correction_prior_model->expected_error());
+  }
+
+  // PERFORMANCE: a pose that can't beat the best one (as of the batch
+  //              start) may be rejected after a part of the scan
+  //              (see SPEParams::rejection_threshold).
+  // NB: the best probability only grows while a batch is handled, so
+  //     feedback is the same as of full estimations; observers may see
+  //     lowered probabilities of rejected poses though.
+  void estimate_sampled_poses(const LaserScan2D &scan, const GridMap &map,
+                              const SPEParams &scan_params,
+                              double best_pose_prob) {
+    auto spe = scan_probability_estimator();
+    auto params = scan_params;
+    params.rejection_threshold = best_pose_prob;
+    auto poses_nm = _sampled_poses.size();
+    auto threads_nm = std::min<std::size_t>(_estimation_threads_nm, poses_nm);
+    if (threads_nm < 2 || !map.supports_concurrent_reads() ||
+        !spe->supports_concurrent_estimations(scan, params)) {
+      scan_probabilities(scan, _sampled_poses, map, _sampled_scan_probs,
+                         params);
+      return;
+    }
+
+    _sampled_scan_probs.resize(poses_nm);
+    auto chunk_size = (poses_nm + threads_nm - 1) / threads_nm;
+    auto estimate_chunk = [&, spe](std::size_t begin, std::size_t end) {
+      spe->estimate_scan_probabilities(
+        scan, _sampled_poses.data() + begin, end - begin, map,
+        params, _sampled_scan_probs.data() + begin);
+    };
+    auto chunks_nm = (poses_nm + chunk_size - 1) / chunk_size;
+    ThreadPool::shared()->parallel_for(chunks_nm, [&](std::size_t chunk_i) {
+      auto begin = chunk_i * chunk_size;
+      estimate_chunk(begin, std::min(begin + chunk_size, poses_nm));
+    }, threads_nm);
+  }
+
+private: // fields
   std::shared_ptr<PoseEnumerator> _pose_enumerator;
+  std::shared_ptr<CorrectionPriorModel> _correction_prior_model;
+  unsigned _estimation_threads_nm = 1;
+  double _local_window_margin = 1.0;
+  LocalScoreWindow _local_window;
+  CellScoresView _local_scores;
+  // buffers reused by scans
+  std::vector<RobotPose> _sampled_poses;
+  std::vector<double> _sampled_scan_probs;
+  std::vector<Real> _window_xs, _window_ys;
 
 };
 
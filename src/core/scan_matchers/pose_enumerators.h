@@ -2,6 +2,8 @@
 #define SLAM_CTOR_CORE_POSE_ENUMERATORS_H
 
 #include <cmath>
+#include <vector>
+#include <algorithm>
 #include "../states/robot_pose.h"
 
 class PoseEnumerator {
@@ -10,7 +12,32 @@ public:
   virtual RobotPose next(const RobotPose &prev_pose) = 0;
   virtual void reset() {};
   virtual void feedback(bool /* pose_is_acceptable */) = 0;
+
+  // Adapts initial steps (applied on reset) to an expected error of
+  // an initial pose (e.g. by recent corrections, see CorrectionPriorModel).
+  virtual void set_expected_error(const RobotPoseDelta & /*error*/) {}
+
+  // Up to max_nm next poses that do not depend on feedback, so they may
+  // be estimated together. A feedback is expected per pose in order.
+  // NB: adaptive enumerators (i.e. ones that depend on feedback)
+  //     enumerate a single pose at a time.
+  virtual void next_batch(const RobotPose &prev_pose, std::size_t /*max_nm*/,
+                          std::vector<RobotPose> &poses) {
+    poses.clear();
+    poses.push_back(next(prev_pose));
+  }
+
   virtual ~PoseEnumerator() {}
+
+protected: // consts
+  // an adapted step is within [base / factor, base * factor]
+  static constexpr double Max_Step_Adaptation_Factor = 4;
+protected: // methods
+  static double adapted_step(double base_step, double expected_error) {
+    return std::min(std::max(expected_error,
+                             base_step / Max_Step_Adaptation_Factor),
+                    base_step * Max_Step_Adaptation_Factor);
+  }
 };
 
 class PolarCoordBruteForcePoseEnumerator : public PoseEnumerator {
@@ -31,29 +58,46 @@ public:
   }
 
   RobotPose next(const RobotPose &prev_pose) override {
+    return pose(prev_pose, _dir, _dst);
+  }
+
+  void reset() override {
+    _dir = _from_dir;
+    _dst = _from_dst;
+  }
+
+  void feedback(bool pose_is_acceptable) override { advance(_dir, _dst); }
+
+  void next_batch(const RobotPose &prev_pose, std::size_t max_nm,
+                  std::vector<RobotPose> &poses) override {
+    poses.clear();
+    auto dir = _dir, dst = _dst;
+    while (poses.size() < std::max(max_nm, std::size_t{1}) &&
+           dst <= _to_dst) {
+      poses.push_back(pose(prev_pose, dir, dst));
+      advance(dir, dst);
+    }
+  }
+
+private: // methods
+  RobotPose pose(const RobotPose &prev_pose, double dir, double dst) {
     if (!_base_pose_is_set) {
       _base_pose = prev_pose;
       _base_pose_is_set = true;
     }
 
-    auto delta = RobotPoseDelta{std::cos(_dir) * _dst,
-                                std::sin(_dir) * _dst, 0};
+    auto delta = RobotPoseDelta(std::cos(dir) * dst, std::sin(dir) * dst, 0);
     return _base_pose + delta;
   }
 
-  void reset() override {
-    _dir = _from_dir;
-    _dst = _from_dst;
-  }
-
-  void feedback(bool pose_is_acceptable) override {
+  void advance(double &dir, double &dst) const {
     // HACK: use switch falls to simplify code (no nested ifs)
     switch (0) {
     case 0:
-      if (_dir < _to_dir) { _dir += _step_dir; break; }
-      else                { _dir = _from_dir; /* to dst */ }
+      if (dir < _to_dir) { dir += _step_dir; break; }
+      else               { dir = _from_dir; /* to dst */ }
     case 1:
-      _dst += _step_dst;
+      dst += _step_dst;
     }
   }
 
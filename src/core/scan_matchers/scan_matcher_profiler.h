@@ -0,0 +1,157 @@
+#ifndef SLAM_CTOR_CORE_SCAN_MATCHER_PROFILER_H
+#define SLAM_CTOR_CORE_SCAN_MATCHER_PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "grid_scan_matcher.h"
+
+// Search statistics of matchings of a window (see ScanMatcherProfiler)
+struct ScanMatchingWindowStats {
+  std::size_t matchings_nm = 0;
+  double ms_mean = 0, ms_p50 = 0, ms_p95 = 0, ms_max = 0;
+  double tests_mean = 0, tests_max = 0;
+  double moves_mean = 0, moves_max = 0;
+  // scan tests per millisecond of matching
+  double tests_rate = 0;
+};
+
+/* Collects search statistics of each matching of a scan matcher
+ * (time, scan tests, accepted moves) and dumps statistics of the last
+ * window_size matchings once the window is full, a line per window.
+ * Formats are "csv" (a header goes first) and "json" (a line is an object).
+ * The statistics help to tune search limits (e.g. attempts of HC/MC or
+ * the M3RSM accuracy) on real data.
+ * NB: scan tests are reported by pose enumerating matchers only;
+ *     accepted moves of other matchers are their pose updates.
+ * PERFORMANCE: the observer requests no per-test events
+ *              (see GridScanMatcherObserver::scan_test_period). */
+class ScanMatcherProfiler : public GridScanMatcherObserver {
+private: // types
+  using Clock = std::chrono::steady_clock;
+
+  struct Matching {
+    double ms;
+    std::size_t tests_nm, moves_nm;
+  };
+public:
+  ScanMatcherProfiler(const std::string &matcher_name,
+                      std::shared_ptr<std::ostream> os,
+                      std::size_t window_size = 100,
+                      const std::string &format = "csv")
+    : _matcher_name{matcher_name}, _os{os}
+    , _window_size{std::max<std::size_t>(window_size, 1)}
+    , _is_json{format == "json"} {
+    _window.reserve(_window_size);
+  }
+
+  ~ScanMatcherProfiler() { dump_window(); }
+
+  // GridScanMatcherObserver API implementation
+
+  unsigned scan_test_period() const override { return 0; }
+
+  void on_matching_start(const RobotPose &, const TransformedLaserScan &,
+                         const GridMap &) override {
+    _matching = Matching{0, 0, 0};
+    _matching_start = Clock::now();
+  }
+
+  void on_pose_update(const RobotPose &, const LaserScan2D &,
+                      double) override {
+    ++_matching.moves_nm;
+  }
+
+  // NB: the summary excludes the initial pose update of enumerating matchers
+  void on_scan_tests_summary(const ScanTestsSummary &summary) override {
+    _matching.tests_nm = summary.tests_nm;
+    _matching.moves_nm = summary.pose_updates_nm;
+  }
+
+  void on_matching_end(const RobotPose &, const LaserScan2D &,
+                       double) override {
+    _matching.ms = std::chrono::duration<double, std::milli>(
+      Clock::now() - _matching_start).count();
+    _window.push_back(_matching);
+    if (_window.size() == _window_size) { dump_window(); }
+  }
+
+  // Statistics of matchings of the current (not yet dumped) window
+  ScanMatchingWindowStats window_stats() const {
+    auto stats = ScanMatchingWindowStats{};
+    stats.matchings_nm = _window.size();
+    if (_window.empty()) { return stats; }
+
+    auto mss = std::vector<double>{};
+    double ms_sum = 0, tests_sum = 0, moves_sum = 0;
+    for (auto &m : _window) {
+      mss.push_back(m.ms);
+      ms_sum += m.ms;
+      tests_sum += m.tests_nm;
+      moves_sum += m.moves_nm;
+      stats.tests_max = std::max<double>(stats.tests_max, m.tests_nm);
+      stats.moves_max = std::max<double>(stats.moves_max, m.moves_nm);
+    }
+    std::sort(mss.begin(), mss.end());
+    auto percentile = [&mss](double p) {
+      return mss[std::min<std::size_t>(p * mss.size(), mss.size() - 1)];
+    };
+    stats.ms_mean = ms_sum / _window.size();
+    stats.ms_p50 = percentile(0.5);
+    stats.ms_p95 = percentile(0.95);
+    stats.ms_max = mss.back();
+    stats.tests_mean = tests_sum / _window.size();
+    stats.moves_mean = moves_sum / _window.size();
+    stats.tests_rate = ms_sum == 0 ? 0 : tests_sum / ms_sum;
+    return stats;
+  }
+
+private: // methods
+
+  void dump_window() {
+    if (_window.empty()) { return; }
+    auto s = window_stats();
+    auto &os = *_os;
+    if (_is_json) {
+      os << "{\"matcher\": \"" << _matcher_name << "\""
+         << ", \"matchings\": " << s.matchings_nm
+         << ", \"ms_mean\": " << s.ms_mean << ", \"ms_p50\": " << s.ms_p50
+         << ", \"ms_p95\": " << s.ms_p95 << ", \"ms_max\": " << s.ms_max
+         << ", \"tests_mean\": " << s.tests_mean
+         << ", \"tests_max\": " << s.tests_max
+         << ", \"moves_mean\": " << s.moves_mean
+         << ", \"moves_max\": " << s.moves_max
+         << ", \"tests_per_ms\": " << s.tests_rate << "}" << std::endl;
+    } else {
+      if (!_csv_header_is_written) {
+        os << "matcher,matchings,ms_mean,ms_p50,ms_p95,ms_max,"
+           << "tests_mean,tests_max,moves_mean,moves_max,tests_per_ms"
+           << std::endl;
+        _csv_header_is_written = true;
+      }
+      os << _matcher_name << "," << s.matchings_nm << ","
+         << s.ms_mean << "," << s.ms_p50 << "," << s.ms_p95 << ","
+         << s.ms_max << "," << s.tests_mean << "," << s.tests_max << ","
+         << s.moves_mean << "," << s.moves_max << "," << s.tests_rate
+         << std::endl;
+    }
+    _window.clear();
+  }
+
+private: // fields
+  std::string _matcher_name;
+  std::shared_ptr<std::ostream> _os;
+  std::size_t _window_size;
+  bool _is_json;
+  bool _csv_header_is_written = false;
+
+  std::vector<Matching> _window;
+  Matching _matching = {0, 0, 0};
+  Clock::time_point _matching_start;
+};
+
+#endif
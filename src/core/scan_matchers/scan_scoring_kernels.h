@@ -0,0 +1,211 @@
+#ifndef SLAM_CTOR_CORE_SCAN_SCORING_KERNELS_H
+#define SLAM_CTOR_CORE_SCAN_SCORING_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SLAM_CTOR_SCAN_SCORING_AVX2
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SLAM_CTOR_SCAN_SCORING_NEON
+#endif
+
+#include "../math_utils.h"
+#include "../maps/area_score_tables.h"
+
+/* Kernels that score scan points moved by a translation against flat
+ * cell scores (see CellScoresView):
+ *   sum(weights[i] * scores[cell(xs[i] + dx, ys[i] + dy)]).
+ * A cell of a point is found the way RegularSquaresGrid::world_to_cell
+ * does (floor of a coordinate divided by the cell scale).
+ * The ISA is detected at runtime on x86 (AVX2 kernels are compiled
+ * with a target attribute, so no extra compiler flags are required);
+ * NEON is a part of the AArch64 baseline.
+ * Coordinates are of the geometry precision (see Real); single-precision
+ * ones are widened to double in lanes, so only their loads are halved.
+ * NB: vector kernels accumulate points in lanes, so sums may differ
+ *     from the scalar one by rounding. */
+enum class ScanScoringIsa { Scalar, Avx2, Neon };
+
+class ScanScoringKernels {
+public:
+  static bool is_supported(ScanScoringIsa isa) {
+    switch (isa) {
+    case ScanScoringIsa::Scalar: return true;
+    case ScanScoringIsa::Avx2:
+#ifdef SLAM_CTOR_SCAN_SCORING_AVX2
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    case ScanScoringIsa::Neon:
+#ifdef SLAM_CTOR_SCAN_SCORING_NEON
+      return true;
+#else
+      return false;
+#endif
+    }
+    return false;
+  }
+
+  // The fastest ISA supported by the CPU (detected once)
+  static ScanScoringIsa best_isa() {
+    static const auto isa = is_supported(ScanScoringIsa::Avx2) ?
+      ScanScoringIsa::Avx2 : is_supported(ScanScoringIsa::Neon) ?
+      ScanScoringIsa::Neon : ScanScoringIsa::Scalar;
+    return isa;
+  }
+
+  // NB: an unsupported ISA falls back to the scalar kernel
+  static double weighted_cell_scores(ScanScoringIsa isa,
+                                     const CellScoresView &view,
+                                     const Real *xs, const Real *ys,
+                                     const double *weights, std::size_t n,
+                                     double dx, double dy) {
+    switch (isa) {
+#ifdef SLAM_CTOR_SCAN_SCORING_AVX2
+    case ScanScoringIsa::Avx2:
+      if (!is_supported(isa)) { break; }
+      return weighted_cell_scores_avx2(view, xs, ys, weights, n, dx, dy);
+#endif
+#ifdef SLAM_CTOR_SCAN_SCORING_NEON
+    case ScanScoringIsa::Neon:
+      return weighted_cell_scores_neon(view, xs, ys, weights, n, dx, dy);
+#endif
+    default: break;
+    }
+    return weighted_cell_scores_scalar(view, xs, ys, weights, n, dx, dy);
+  }
+
+private: // methods
+
+  static double weighted_cell_scores_scalar(const CellScoresView &view,
+                                            const Real *xs,
+                                            const Real *ys,
+                                            const double *weights,
+                                            std::size_t n,
+                                            double dx, double dy) {
+    auto sum = double{0};
+    for (std::size_t i = 0; i < n; ++i) {
+      auto x = int(std::floor((xs[i] + dx) / view.scale)) - view.min.x;
+      auto y = int(std::floor((ys[i] + dy) / view.scale)) - view.min.y;
+      auto is_inside = 0 <= x && x < view.width && 0 <= y && y < view.height;
+      sum += weights[i] * (is_inside ? view.scores[y * view.width + x]
+                                     : view.unknown_score);
+    }
+    return sum;
+  }
+
+#ifdef SLAM_CTOR_SCAN_SCORING_AVX2
+
+  __attribute__((target("avx2")))
+  static __m256d load4_avx2(const double *values) {
+    return _mm256_loadu_pd(values);
+  }
+
+  __attribute__((target("avx2")))
+  static __m256d load4_avx2(const float *values) {
+    return _mm256_cvtps_pd(_mm_loadu_ps(values));
+  }
+
+  __attribute__((target("avx2")))
+  static double weighted_cell_scores_avx2(const CellScoresView &view,
+                                          const Real *xs, const Real *ys,
+                                          const double *weights,
+                                          std::size_t n,
+                                          double dx, double dy) {
+    const auto v_dx = _mm256_set1_pd(dx), v_dy = _mm256_set1_pd(dy);
+    const auto v_scale = _mm256_set1_pd(view.scale);
+    const auto v_min_x = _mm256_set1_pd(view.min.x),
+               v_min_y = _mm256_set1_pd(view.min.y);
+    const auto v_w = _mm256_set1_pd(view.width),
+               v_h = _mm256_set1_pd(view.height);
+    const auto v_zero = _mm256_setzero_pd();
+    const auto v_unknown = _mm256_set1_pd(view.unknown_score);
+    auto v_sum = _mm256_setzero_pd();
+
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+      auto x = _mm256_sub_pd(_mm256_floor_pd(_mm256_div_pd(
+        _mm256_add_pd(load4_avx2(xs + i), v_dx), v_scale)), v_min_x);
+      auto y = _mm256_sub_pd(_mm256_floor_pd(_mm256_div_pd(
+        _mm256_add_pd(load4_avx2(ys + i), v_dy), v_scale)), v_min_y);
+      auto is_inside = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(v_zero, x, _CMP_LE_OQ),
+                      _mm256_cmp_pd(x, v_w, _CMP_LT_OQ)),
+        _mm256_and_pd(_mm256_cmp_pd(v_zero, y, _CMP_LE_OQ),
+                      _mm256_cmp_pd(y, v_h, _CMP_LT_OQ)));
+      // NB: indices of cells outside are garbage, but they are not gathered
+      auto ids =
+        _mm256_cvttpd_epi32(_mm256_add_pd(_mm256_mul_pd(y, v_w), x));
+      auto scores = _mm256_mask_i32gather_pd(v_unknown, view.scores, ids,
+                                             is_inside, sizeof(double));
+      auto ws = _mm256_loadu_pd(weights + i);
+      v_sum = _mm256_add_pd(v_sum, _mm256_mul_pd(ws, scores));
+    }
+
+    alignas(32) double lanes[4];
+    _mm256_store_pd(lanes, v_sum);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) +
+           weighted_cell_scores_scalar(view, xs + i, ys + i, weights + i,
+                                       n - i, dx, dy);
+  }
+
+#endif
+
+#ifdef SLAM_CTOR_SCAN_SCORING_NEON
+
+  static float64x2_t load2_neon(const double *values) {
+    return vld1q_f64(values);
+  }
+
+  static float64x2_t load2_neon(const float *values) {
+    return vcvt_f64_f32(vld1_f32(values));
+  }
+
+  static double weighted_cell_scores_neon(const CellScoresView &view,
+                                          const Real *xs, const Real *ys,
+                                          const double *weights,
+                                          std::size_t n,
+                                          double dx, double dy) {
+    const auto v_dx = vdupq_n_f64(dx), v_dy = vdupq_n_f64(dy);
+    const auto v_scale = vdupq_n_f64(view.scale);
+    const auto v_min_x = vdupq_n_f64(view.min.x),
+               v_min_y = vdupq_n_f64(view.min.y);
+    const auto v_w = vdupq_n_f64(view.width), v_h = vdupq_n_f64(view.height);
+    const auto v_zero = vdupq_n_f64(0);
+    auto v_sum = vdupq_n_f64(0);
+
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+      auto x = vsubq_f64(vrndmq_f64(vdivq_f64(
+        vaddq_f64(load2_neon(xs + i), v_dx), v_scale)), v_min_x);
+      auto y = vsubq_f64(vrndmq_f64(vdivq_f64(
+        vaddq_f64(load2_neon(ys + i), v_dy), v_scale)), v_min_y);
+      auto is_inside = vandq_u64(
+        vandq_u64(vcleq_f64(v_zero, x), vcltq_f64(x, v_w)),
+        vandq_u64(vcleq_f64(v_zero, y), vcltq_f64(y, v_h)));
+      auto ids = vcvtq_s64_f64(vaddq_f64(vmulq_f64(y, v_w), x));
+      // NB: NEON has no gather, so cells are loaded per lane
+      double lane_scores[2] = {
+        vgetq_lane_u64(is_inside, 0) ? view.scores[vgetq_lane_s64(ids, 0)]
+                                     : view.unknown_score,
+        vgetq_lane_u64(is_inside, 1) ? view.scores[vgetq_lane_s64(ids, 1)]
+                                     : view.unknown_score};
+      v_sum = vaddq_f64(v_sum, vmulq_f64(vld1q_f64(weights + i),
+                                         vld1q_f64(lane_scores)));
+    }
+
+    return vaddvq_f64(v_sum) +
+           weighted_cell_scores_scalar(view, xs + i, ys + i, weights + i,
+                                       n - i, dx, dy);
+  }
+
+#endif
+};
+
+#endif
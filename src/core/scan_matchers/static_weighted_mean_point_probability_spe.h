@@ -0,0 +1,76 @@
+#ifndef SLAM_CTOR_CORE_STATIC_WEIGHTED_MEAN_POINT_PROBABILITY_SPE_H
+#define SLAM_CTOR_CORE_STATIC_WEIGHTED_MEAN_POINT_PROBABILITY_SPE_H
+
+#include <memory>
+#include <typeinfo>
+
+#include "weighted_mean_point_probability_spe.h"
+#include "occupancy_observation_probability.h"
+
+// NB: the ScanPointWeighting type means an SPW of any type
+template <typename SpwT>
+double static_spw_weight(const SpwT &spw, const LaserScan2D::Points &points,
+                         ScanPointWeighting::PointId id) {
+  return spw.SpwT::weight(points, id);
+}
+
+inline double static_spw_weight(const ScanPointWeighting &spw,
+                                const LaserScan2D::Points &points,
+                                ScanPointWeighting::PointId id) {
+  return spw.weight(points, id);
+}
+
+/* A WeightedMeanPointProbabilitySPE with the OOPE, the SPW and the map
+ * of known types; the map type defines the cell type (e.g. TypedGridMap).
+ * PERFORMANCE: the OOPE, the SPW, the map and its cells are called
+ *              with qualified names per point, i.e. the whole point
+ *              estimation is inlined instead of a chain of virtual calls.
+ *              Maps of other types (e.g. coarser maps of a matcher)
+ *              and prerotated scans are estimated by virtual calls.
+ * NB: the OOPE and the SPW must be of the given types exactly. */
+template <typename OopeT, typename SpwT, typename MapT>
+class StaticWeightedMeanPointProbabilitySPE
+  : public WeightedMeanPointProbabilitySPE {
+public:
+  StaticWeightedMeanPointProbabilitySPE(std::shared_ptr<OopeT> oope,
+                                        std::shared_ptr<SpwT> spw,
+                                        unsigned skip_rate = 0,
+                                        double max_usable_range = -1)
+    : WeightedMeanPointProbabilitySPE{oope, spw, skip_rate, max_usable_range}
+    , _oope{oope}, _spw{spw} {}
+
+  void estimate_scan_probabilities(const LaserScan2D &scan,
+                                   const RobotPose *poses, std::size_t n,
+                                   const GridMap &map,
+                                   const SPEParams &params,
+                                   double *probabilities) const override {
+    // NB: the OOPE may have been replaced (see set_oope)
+    if (params.scan_is_prerotated || !scan.has_soa() ||
+        typeid(map) != typeid(MapT) ||
+        occupancy_observation_probability_estimator() != _oope) {
+      WeightedMeanPointProbabilitySPE::estimate_scan_probabilities(
+        scan, poses, n, map, params, probabilities);
+      return;
+    }
+
+    const auto &typed_map = static_cast<const MapT &>(map);
+    const auto &oope = *_oope;
+    const auto &spw = *_spw;
+    estimate_soa_scan_probabilities(
+      scan, poses, n, map, params, probabilities,
+      [&spw](const LaserScan2D::Points &points,
+             ScanPointWeighting::PointId i) {
+        return static_spw_weight(spw, points, i);
+      },
+      [&oope, &typed_map](const AreaOccupancyObservation &aoo,
+                          const LightWeightRectangle &area) {
+        return oope.map_probability(aoo, area, typed_map);
+      });
+  }
+
+private:
+  std::shared_ptr<OopeT> _oope;
+  std::shared_ptr<SpwT> _spw;
+};
+
+#endif
@@ -2,7 +2,10 @@
 #define SLAM_CTOR_CORE_WEIGHTED_MEAN_DISCREPANCY_SP_ESTIMATOR
 
 #include <cmath>
+#include <algorithm>
+#include <vector>
 #include "grid_scan_matcher.h"
+#include "scan_scoring_kernels.h"
 #include "../math_utils.h"
 #include "../maps/grid_rasterization.h"
 #include "../features/angle_histogram.h"
@@ -15,6 +18,17 @@ public:
   using PointId = LaserScan2D::Points::size_type;
   virtual void reset(const LaserScan2D &scan) {}
   virtual double weight(const LaserScan2D::Points &, PointId) const = 0;
+
+  // Weights of all points of the scan the weighting is reset with
+  virtual void weights(const LaserScan2D &scan,
+                       std::vector<double> &weights) const {
+    const auto &pts = scan.points();
+    weights.resize(pts.size());
+    for (PointId i = 0; i < pts.size(); ++i) {
+      weights[i] = weight(pts, i);
+    }
+  }
+
   virtual ~ScanPointWeighting() {}
 };
 
@@ -47,15 +61,34 @@ private:
 class VinySlamSPW : public ScanPointWeighting {
 public:
   double weight(const LaserScan2D::Points &pts, PointId id) const override {
-    const auto &sp = pts[id];
-    auto angle = sp.angle();
+    return point_weight(pts[id].range(), pts[id].angle());
+  }
+
+  // PERFORMANCE: polar coordinates are read from the SoA form if any.
+  void weights(const LaserScan2D &scan,
+               std::vector<double> &weights) const override {
+    if (!scan.has_soa()) {
+      ScanPointWeighting::weights(scan, weights);
+      return;
+    }
+
+    const auto &soa = scan.soa();
+    weights.resize(soa.size());
+    for (std::size_t i = 0; i < soa.size(); ++i) {
+      weights[i] = point_weight(soa.ranges[i], soa.angles[i]);
+    }
+  }
+
+private: // methods
+
+  static double point_weight(double range, double angle) {
     auto weight = std::abs(std::sin(angle)) + std::abs(std::cos(angle));
     if (0.9 < std::abs(std::cos(angle))) {
       weight = 3;
     } else if (0.8 < std::abs(std::cos(angle))) {
       weight = 2;
     }
-    return weight * std::sqrt(sp.range());
+    return weight * std::sqrt(range);
   }
 };
 
@@ -65,6 +98,10 @@ public:
 class WeightedMeanPointProbabilitySPE : public ScanProbabilityEstimator {
 protected:
   using SPW = std::shared_ptr<ScanPointWeighting>;
+public: // consts
+  // the number of points estimated between checks of the rejection
+  // threshold (see SPEParams::rejection_threshold)
+  static constexpr std::size_t Rejection_Check_Period = 16;
 public:
   WeightedMeanPointProbabilitySPE(OOPE oope, SPW spw,
                                   unsigned skip_rate = 0,
@@ -72,8 +109,24 @@ public:
     : ScanProbabilityEstimator{oope}, _spw{spw}
     , _pts_skip_rate{skip_rate}, _pt_max_usable_range{max_usable_range} {}
 
+  // The ISA of kernels that score points by flat cell scores
+  // (the fastest supported one by default).
+  void set_scoring_isa(ScanScoringIsa isa) { _scoring_isa = isa; }
+  ScanScoringIsa scoring_isa() const { return _scoring_isa; }
+
+  // PERFORMANCE: a prefiltered scan is reused if the map has cells
+  //              of all its points, i.e. only its points are copied.
   LaserScan2D filter_scan(const LaserScan2D &raw_scan, const RobotPose &pose,
                           const GridMap &map) override {
+    const auto *prefiltered = raw_scan.prefiltered();
+    if (prefiltered && map_covers(map, pose, *prefiltered)) {
+      auto scan = *prefiltered;
+      // NB: the provider of the raw scan may be the one of a thread
+      scan.trig_provider = raw_scan.trig_provider;
+      scan.trig_provider->set_base_angle(pose.theta);
+      return scan;
+    }
+
     LaserScan2D scan;
     scan.trig_provider = raw_scan.trig_provider;
     scan.trig_provider->set_base_angle(pose.theta);
@@ -90,7 +143,30 @@ public:
       scan_pts.push_back(sp);
     }
 
+    // NB: the scan is estimated for many poses
+    scan.update_soa();
     _spw->reset(scan);
+    scan.set_point_weights(point_weights(scan));
+    return scan;
+  }
+
+  // The result is the one of filter_scan against a map that has cells
+  // of all points
+  LaserScan2D prefilter_scan(const LaserScan2D &raw_scan) override {
+    LaserScan2D scan;
+    scan.trig_provider = raw_scan.trig_provider;
+    const auto &raw_points = raw_scan.points();
+    for (LaserScan2D::Points::size_type i = 0; i < raw_points.size(); ++i) {
+      if (_pts_skip_rate && i % _pts_skip_rate) { continue; }
+      if (!is_point_usable(raw_points[i])) { continue; }
+      scan.points().push_back(raw_points[i]);
+    }
+
+    scan.update_soa();
+    _spw->reset(scan);
+    scan.set_point_weights(point_weights(scan));
+    // NB: features are computed once to be shared by copies
+    scan.features();
     return scan;
   }
 
@@ -98,11 +174,21 @@ public:
                                    const RobotPose &pose,
                                    const GridMap &map,
                                    const SPEParams &params) const override {
+    if (!params.scan_is_prerotated && scan.has_soa()) {
+      // the whole scan is moved to the world frame at once
+      auto probability = double{0};
+      estimate_scan_probabilities(scan, &pose, 1, map, params, &probability);
+      return probability;
+    }
+
     auto total_weight = double{0};
     auto total_probability = double{0};
 
+    const auto *weights = scan.point_weights();
     auto observation = expected_scan_point_observation();
-    scan.trig_provider->set_base_angle(pose.theta);
+    if (!params.scan_is_prerotated) {
+      scan.trig_provider->set_base_angle(pose.theta);
+    }
     const auto &points = scan.points();
     for (LaserScan2D::Points::size_type i = 0; i < points.size(); ++i) {
       auto &sp = points[i];
@@ -120,8 +206,10 @@ public:
       auto aoo_prob = occupancy_observation_probability(observation,
                                                         obs_area, map);
 
-      auto sp_weight = _spw->weight(points, i);
-      total_probability += aoo_prob * sp_weight * sp.factor();
+      // NB: a point may represent several ones (e.g. a downsampled scan)
+      auto sp_weight = weights ? weights->values[i] :
+                                 _spw->weight(points, i) * sp.factor();
+      total_probability += aoo_prob * sp_weight;
       total_weight += sp_weight;
     }
     if (total_weight == 0) {
@@ -132,23 +220,286 @@ public:
     return total_probability / total_weight;
   }
 
+  // PERFORMANCE: weights are computed once per scan (see filter_scan)
+  //              or looked up once per batch, points are rotated
+  //              once per run of poses with the same theta, and a point is
+  //              estimated for all poses of a run in a row, so nearby map
+  //              areas are accessed together.
+  //              The result is the same as of per pose estimations.
+  //              A pose is rejected once its probability can't exceed
+  //              the rejection threshold even if remaining points are
+  //              estimated with the max probability (i.e. 1); the bound
+  //              is returned for such a pose.
+  //              If the OOPE looks up obstacles' cells and the map keeps
+  //              flat cell scores (see AreaScoreTablesGridMap) or a run
+  //              is covered by local scores (see SPEParams::local_scores),
+  //              points are scored by vector kernels
+  //              (see ScanScoringKernels).
+  // NB: thread-safe for scans with the SoA form (the SPW is reset by
+  //     filter_scan, so weights are only read).
+  void estimate_scan_probabilities(const LaserScan2D &scan,
+                                   const RobotPose *poses, std::size_t n,
+                                   const GridMap &map,
+                                   const SPEParams &params,
+                                   double *probabilities) const override {
+    if (params.scan_is_prerotated || !scan.has_soa()) {
+      ScanProbabilityEstimator::estimate_scan_probabilities(
+        scan, poses, n, map, params, probabilities);
+      return;
+    }
+
+    estimate_soa_scan_probabilities(
+      scan, poses, n, map, params, probabilities,
+      [this](const LaserScan2D::Points &points,
+             ScanPointWeighting::PointId i) {
+        return _spw->weight(points, i);
+      },
+      [this, &map](const AreaOccupancyObservation &aoo,
+                   const LightWeightRectangle &area) {
+        return occupancy_observation_probability(aoo, area, map);
+      });
+  }
+
+  bool scores_points_by_cells() const override {
+    return occupancy_observation_probability_estimator()
+             ->is_obstacle_cell_based() &&
+           AreaScoreTables::is_expected(expected_scan_point_observation());
+  }
+
+  // NB: points of a prerotated scan are moved without the (shared)
+  //     trigonometry provider.
+  bool supports_concurrent_estimations(
+      const LaserScan2D &scan, const SPEParams &params) const override {
+    return params.scan_is_prerotated || scan.has_soa();
+  }
+
 protected:
+  // Estimates probabilities of a scan with the SoA form (see above);
+  // point_weight(points, i) and point_probability(aoo, area) are
+  // the SPW's weight and the OOPE's probability against the map.
+  template <typename PointWeight, typename PointProbability>
+  void estimate_soa_scan_probabilities(const LaserScan2D &scan,
+                                       const RobotPose *poses, std::size_t n,
+                                       const GridMap &map,
+                                       const SPEParams &params,
+                                       double *probabilities,
+                                       PointWeight point_weight,
+                                       PointProbability point_probability)
+                                       const {
+    // buffers reused by estimations of a thread
+    static thread_local std::vector<double> own_weights;
+    static thread_local std::vector<Real> rotated_xs, rotated_ys;
+    static thread_local std::vector<char> is_rejected;
+
+    const auto &points = scan.points();
+    const auto &soa = scan.soa();
+    // NB: a point may represent several ones (e.g. a downsampled scan)
+    const std::vector<double> *weights = &own_weights;
+    auto total_weight = double{0};
+    if (auto scan_weights = scan.point_weights()) {
+      weights = &scan_weights->values;
+      total_weight = scan_weights->total;
+    } else {
+      own_weights.resize(points.size());
+      for (LaserScan2D::Points::size_type i = 0; i < points.size(); ++i) {
+        own_weights[i] = point_weight(points, i) * soa.factors[i];
+        total_weight += own_weights[i];
+      }
+    }
+    const auto &sp_weights = *weights;
+    if (total_weight == 0) {
+      // TODO: replace with writing to a proper logger
+      std::clog << "WARNING: unknown probability" << std::endl;
+      std::fill(probabilities, probabilities + n, unknown_probability());
+      return;
+    }
+
+    auto observation = expected_scan_point_observation();
+    const AreaScoreTables *tables = nullptr;
+    const CellScoresView *local_scores = nullptr;
+    if (scores_points_by_cells()) {
+      tables = map.area_score_tables();
+      local_scores = params.local_scores;
+    }
+    auto table_scores = CellScoresView{};
+    if (tables) { table_scores = tables->cell_scores(); }
+
+    std::fill(probabilities, probabilities + n, 0.0);
+    is_rejected.assign(n, false);
+    // NB: NaN (an unknown probability) never rejects
+    auto rejection_threshold = params.rejection_threshold * total_weight;
+    auto rejection_is_on = !std::isnan(rejection_threshold) &&
+                           0 < rejection_threshold;
+    std::size_t run_begin = 0;
+    while (run_begin < n) {
+      auto run_end = run_begin + 1;
+      while (run_end < n && poses[run_end].theta == poses[run_begin].theta) {
+        ++run_end;
+      }
+      soa.rotate(poses[run_begin].theta, rotated_xs, rotated_ys);
+      // NB: runs that leave local scores are estimated by the map
+      const CellScoresView *run_scores = tables ? &table_scores : nullptr;
+      if (!run_scores && local_scores &&
+          covers_run(*local_scores, rotated_xs, rotated_ys, poses,
+                     run_begin, run_end)) {
+        run_scores = local_scores;
+      }
+      if (run_scores) {
+        score_run(*run_scores, rotated_xs, rotated_ys,
+                  sp_weights, poses, run_begin, run_end, total_weight,
+                  rejection_is_on ? rejection_threshold : 0,
+                  probabilities, is_rejected);
+        run_begin = run_end;
+        continue;
+      }
+
+      auto remaining_weight = total_weight;
+      for (LaserScan2D::Points::size_type i = 0; i < points.size(); ++i) {
+        if (rejection_is_on && i % Rejection_Check_Period == 0 && i != 0 &&
+            reject_poses(probabilities, run_begin, run_end, remaining_weight,
+                         rejection_threshold, is_rejected)) {
+          break;
+        }
+        remaining_weight -= sp_weights[i];
+        // FIXME: assumption - sensor pose is in robot's (0,0), dir - 0
+        for (auto pose_i = run_begin; pose_i < run_end; ++pose_i) {
+          if (is_rejected[pose_i]) { continue; }
+          const auto &pose = poses[pose_i];
+          observation.obstacle = {rotated_xs[i] + pose.x,
+                                  rotated_ys[i] + pose.y};
+          auto obs_area =
+            params.sp_analysis_area.move_center(observation.obstacle);
+          auto aoo_prob = point_probability(observation, obs_area);
+          probabilities[pose_i] += aoo_prob * sp_weights[i];
+        }
+      }
+      run_begin = run_end;
+    }
+    for (std::size_t pose_i = 0; pose_i < n; ++pose_i) {
+      probabilities[pose_i] /= total_weight;
+    }
+  }
+
   virtual AreaOccupancyObservation expected_scan_point_observation() const {
     // TODO: use a strategy to convert obstacle->occupancy
     return {true, {1.0, 1.0}, {0, 0}, 1.0};
   }
 
+  // NB: points of a prefiltered scan are checked by is_point_usable and
+  //     by map cells only (see filter_scan).
   virtual bool should_skip_point(const ScanPoint2D &sp,
                                  const GridMap &map,
                                  const GridMap::Coord &area_id) const {
-    return !sp.is_occupied() || !map.has_cell(area_id) ||
-           (are_strictly_ordered(0.0, _pt_max_usable_range, sp.range()));
+    return !is_point_usable(sp) || !map.has_cell(area_id);
+  }
+
+  bool is_point_usable(const ScanPoint2D &sp) const {
+    return sp.is_occupied() &&
+           !are_strictly_ordered(0.0, _pt_max_usable_range, sp.range());
   }
 
 private:
+  // Whether the map has cells of all points of the scan at the pose
+  // NB: maps are rectangular, so the square around the farthest point
+  //     is checked.
+  static bool map_covers(const GridMap &map, const RobotPose &pose,
+                         const LaserScan2D &scan) {
+    auto max_range = double{0};
+    for (auto range : scan.soa().ranges) {
+      max_range = std::max<double>(max_range, range);
+    }
+    return map.has_cell(map.world_to_cell(pose.x - max_range,
+                                          pose.y - max_range)) &&
+           map.has_cell(map.world_to_cell(pose.x + max_range,
+                                          pose.y + max_range));
+  }
+
+  std::shared_ptr<ScanPointWeights> point_weights(const LaserScan2D &scan) {
+    auto weights = std::make_shared<ScanPointWeights>();
+    _spw->weights(scan, weights->values);
+    const auto &soa = scan.soa();
+    for (std::size_t i = 0; i < soa.size(); ++i) {
+      // NB: a point may represent several ones (e.g. a downsampled scan)
+      weights->values[i] *= soa.factors[i];
+      weights->total += weights->values[i];
+    }
+    return weights;
+  }
+
+  // Scores points of a run of poses by a kernel; rejection checks
+  // happen at the same points as of the per point estimation.
+  void score_run(const CellScoresView &scores,
+                 const std::vector<Real> &xs, const std::vector<Real> &ys,
+                 const std::vector<double> &ws, const RobotPose *poses,
+                 std::size_t run_begin, std::size_t run_end,
+                 double total_weight, double rejection_threshold,
+                 double *probabilities, std::vector<char> &is_rejected) const {
+    auto points_nm = ws.size();
+    auto chunk_size = 0 < rejection_threshold ? Rejection_Check_Period
+                                              : points_nm;
+    auto remaining_weight = total_weight;
+    for (std::size_t begin = 0; begin < points_nm; begin += chunk_size) {
+      if (begin != 0 &&
+          reject_poses(probabilities, run_begin, run_end, remaining_weight,
+                       rejection_threshold, is_rejected)) {
+        break;
+      }
+      auto end = std::min(begin + chunk_size, points_nm);
+      for (auto i = begin; i < end; ++i) { remaining_weight -= ws[i]; }
+      for (auto pose_i = run_begin; pose_i < run_end; ++pose_i) {
+        if (is_rejected[pose_i]) { continue; }
+        probabilities[pose_i] += ScanScoringKernels::weighted_cell_scores(
+          _scoring_isa, scores, xs.data() + begin, ys.data() + begin,
+          ws.data() + begin, end - begin, poses[pose_i].x, poses[pose_i].y);
+      }
+    }
+  }
+
+  // Whether points of all poses of a run are in the scores
+  static bool covers_run(const CellScoresView &scores,
+                         const std::vector<Real> &xs,
+                         const std::vector<Real> &ys,
+                         const RobotPose *poses,
+                         std::size_t run_begin, std::size_t run_end) {
+    if (xs.empty()) { return true; }
+    auto xs_range = std::minmax_element(xs.begin(), xs.end());
+    auto ys_range = std::minmax_element(ys.begin(), ys.end());
+    auto min_x = poses[run_begin].x, max_x = min_x;
+    auto min_y = poses[run_begin].y, max_y = min_y;
+    for (auto pose_i = run_begin + 1; pose_i < run_end; ++pose_i) {
+      min_x = std::min(min_x, poses[pose_i].x);
+      max_x = std::max(max_x, poses[pose_i].x);
+      min_y = std::min(min_y, poses[pose_i].y);
+      max_y = std::max(max_y, poses[pose_i].y);
+    }
+    return scores.covers(*xs_range.first + min_x, *ys_range.first + min_y,
+                         *xs_range.second + max_x, *ys_range.second + max_y);
+  }
+
+  // Marks poses of a run that can't exceed the threshold as rejected
+  // (their probabilities are set to the bound); returns whether all poses
+  // of the run are rejected.
+  static bool reject_poses(double *probabilities,
+                           std::size_t run_begin, std::size_t run_end,
+                           double remaining_weight, double threshold,
+                           std::vector<char> &is_rejected) {
+    auto all_are_rejected = true;
+    for (auto pose_i = run_begin; pose_i < run_end; ++pose_i) {
+      if (is_rejected[pose_i]) { continue; }
+      if (threshold < probabilities[pose_i] + remaining_weight) {
+        all_are_rejected = false;
+        continue;
+      }
+      probabilities[pose_i] += remaining_weight;
+      is_rejected[pose_i] = true;
+    }
+    return all_are_rejected;
+  }
+
   SPW _spw;
   unsigned _pts_skip_rate;
   double _pt_max_usable_range;
+  ScanScoringIsa _scoring_isa = ScanScoringKernels::best_isa();
 };
 
 #endif
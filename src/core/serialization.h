@@ -5,9 +5,19 @@
 #include <vector>
 #include <stdint.h>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <limits>
 
 #ifdef COMPRESSED_SERIALIZATION
 #include "roslz4/lz4s.h"
+#include "thread_pool.h"
+
+// Calls action(i) for each i in [0, n) using the shared thread pool
+template <typename Action>
+void run_in_parallel(size_t n, Action action) {
+    ThreadPool::shared()->parallel_for(n, action);
+}
 #endif
 
 class Serializer {
@@ -37,6 +47,10 @@ public:
         data.insert(data.end(), new_data.begin(), new_data.end());
     }
 
+    void append(const char* bytes, size_t size) {
+        data.insert(data.end(), bytes, bytes + size);
+    }
+
 #ifdef COMPRESSED_SERIALIZATION
     std::vector<char> compressed() const {
         std::vector<char> res;
@@ -48,6 +62,50 @@ public:
         delete[] output;
         return res;
     }
+
+    static constexpr size_t Default_Chunk_Size = 1 << 20;
+
+    // The data is split into chunks that are compressed independently
+    // in parallel. Format: chunks number, (raw size, stored size) of each
+    // chunk, chunks. A chunk that is not compressible is stored as is.
+    std::vector<char> compressed_chunks(
+            size_t chunk_size = Default_Chunk_Size) const {
+        size_t chunks_nm = (data.size() + chunk_size - 1) / chunk_size;
+        std::vector<std::vector<char>> chunks(chunks_nm);
+        run_in_parallel(chunks_nm, [&](size_t i) {
+            size_t begin = i * chunk_size;
+            chunks[i] = compress_chunk(data.data() + begin,
+                                       std::min(chunk_size,
+                                                data.size() - begin));
+        });
+
+        Serializer s;
+        s.add_value<uint64_t>(chunks_nm);
+        for (size_t i = 0; i < chunks_nm; ++i) {
+            s.add_value<uint64_t>(std::min(chunk_size,
+                                           data.size() - i * chunk_size));
+            s.add_value<uint64_t>(chunks[i].size());
+        }
+        for (auto &chunk : chunks) {
+            s.append(chunk);
+        }
+        return s.result();
+    }
+
+private:
+    static std::vector<char> compress_chunk(const char *chunk, size_t size) {
+        // NB: the worst case LZ4 output size
+        std::vector<char> res(size + size / 255 + 16);
+        unsigned int output_size = res.size();
+        if (roslz4_buffToBuffCompress(const_cast<char*>(chunk), size,
+                                      res.data(), &output_size, 7) ==
+                ROSLZ4_OK && output_size < size) {
+            res.resize(output_size);
+        } else {
+            res.assign(chunk, chunk + size);
+        }
+        return res;
+    }
 #endif
 
 private:
@@ -74,14 +132,28 @@ public:
         return ptr;
     }
 
+    // NB: a value that doesn't fit the data is read as Type{} and
+    //     the position is moved past the data's end, so truncated data
+    //     is detected once by is_overrun (or by a position of a cell).
     template<typename Type>
     Type read_value() {
-        Type value = *reinterpret_cast<const Type*>(data.data() + ptr);
+        Type value{};
+        if (ptr <= data.size() && sizeof(Type) <= data.size() - ptr) {
+            std::memcpy(&value, data.data() + ptr, sizeof(Type));
+        } else {
+            ptr = std::max(ptr, data.size());
+        }
         ptr += sizeof(Type);
         return value;
     }
 
+    bool is_overrun() const {
+        return data.size() < ptr;
+    }
+
 #ifdef COMPRESSED_SERIALIZATION
+    static constexpr uint64_t Max_Lz4_Ratio = 255;
+
     static std::vector<char> decompress(const char* data, size_t data_size, size_t expected_size) {
         std::vector<char> res;
         char *output = new char[expected_size];
@@ -93,6 +165,64 @@ public:
         delete[] output;
         return res;
     }
+
+    // Restores data made by Serializer::compressed_chunks;
+    // chunks are decompressed in parallel right to the result.
+    static std::vector<char> decompress_chunks(const char* data,
+                                               size_t data_size) {
+        std::vector<char> table(data, data + std::min(data_size,
+                                                      sizeof(uint64_t)));
+        uint64_t chunks_nm = Deserializer(table).read_value<uint64_t>();
+        // NB: a corrupt chunks number must not overflow the table size
+        if (table.size() < sizeof(uint64_t) ||
+                (data_size / sizeof(uint64_t) - 1) / 2 < chunks_nm) {
+            return {};
+        }
+        size_t table_size = sizeof(uint64_t) * (1 + 2 * chunks_nm);
+        table.assign(data, data + table_size);
+
+        Deserializer d(table, sizeof(uint64_t));
+        std::vector<uint64_t> raw_sizes(chunks_nm), stored_sizes(chunks_nm);
+        std::vector<size_t> raw_offsets(chunks_nm), stored_offsets(chunks_nm);
+        size_t raw_size = 0, stored_size = table_size;
+        for (size_t i = 0; i < chunks_nm; ++i) {
+            raw_sizes[i] = d.read_value<uint64_t>();
+            stored_sizes[i] = d.read_value<uint64_t>();
+            // NB: corrupt sizes must not make the result huge,
+            //     LZ4 doesn't compress better than Max_Lz4_Ratio
+            if (data_size - stored_size < stored_sizes[i] ||
+                    std::numeric_limits<unsigned int>::max() < raw_sizes[i] ||
+                    Max_Lz4_Ratio * stored_sizes[i] < raw_sizes[i]) {
+                return {};
+            }
+            raw_offsets[i] = raw_size;
+            stored_offsets[i] = stored_size;
+            raw_size += raw_sizes[i];
+            stored_size += stored_sizes[i];
+        }
+
+        std::vector<char> res(raw_size);
+        std::atomic<bool> is_valid{true};
+        run_in_parallel(chunks_nm, [&](size_t i) {
+            const char *chunk = data + stored_offsets[i];
+            char *output = res.data() + raw_offsets[i];
+            if (stored_sizes[i] == raw_sizes[i]) {
+                std::memcpy(output, chunk, raw_sizes[i]);
+                return;
+            }
+            unsigned int output_size = raw_sizes[i];
+            if (roslz4_buffToBuffDecompress(const_cast<char*>(chunk),
+                                            stored_sizes[i], output,
+                                            &output_size) != ROSLZ4_OK ||
+                    output_size != raw_sizes[i]) {
+                is_valid = false;
+            }
+        });
+        if (!is_valid) {
+            res.clear();
+        }
+        return res;
+    }
 #endif
 
 private:
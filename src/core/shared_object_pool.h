@@ -0,0 +1,40 @@
+#ifndef SLAM_CTOR_CORE_SHARED_OBJECT_POOL_H
+#define SLAM_CTOR_CORE_SHARED_OBJECT_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/* Objects that are handed to consumers by shared pointers and are reused
+ * once consumers release them, i.e. once the pool keeps the only
+ * reference (e.g. buffers of scans that are copied by a pipelined
+ * mapping for a while). */
+template <typename T>
+class SharedObjectPool {
+public:
+  explicit SharedObjectPool(std::size_t max_size = 4) {
+    _objects.reserve(max_size);
+  }
+
+  // An object released by consumers (nullptr if there is no one)
+  std::shared_ptr<T> released() const {
+    for (auto &object : _objects) {
+      if (object.use_count() != 1) { continue; }
+      // NB: synchronizes with the release of the last consumer's reference
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return object;
+    }
+    return nullptr;
+  }
+
+  // Keeps a new object for reuse if the pool is not full
+  void keep(std::shared_ptr<T> object) {
+    if (_objects.size() == _objects.capacity()) { return; }
+    _objects.push_back(std::move(object));
+  }
+
+private: // fields
+  std::vector<std::shared_ptr<T>> _objects;
+};
+
+#endif
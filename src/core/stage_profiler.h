@@ -0,0 +1,398 @@
+#ifndef SLAM_CTOR_CORE_STAGE_PROFILER_H
+#define SLAM_CTOR_CORE_STAGE_PROFILER_H
+
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "allocation_counter.h"
+#include "maps/grid_map_memory_usage.h"
+#include "trace_recorder.h"
+
+// Stages of a scan handling by a slam
+enum class SlamStage {
+  ScanConversion,       // a sensor message to a scan (e.g. by a ros node)
+  ScanFiltering,        // pose independent filtering (prefilter_scan)
+  ScanMatching,
+  MapInsertion,
+  Resampling,           // particle filters only
+  ObserversNotification
+};
+
+constexpr std::size_t Slam_Stages_Nm = 6;
+
+inline const char *slam_stage_name(SlamStage stage) {
+  switch (stage) {
+  case SlamStage::ScanConversion: return "conversion";
+  case SlamStage::ScanFiltering: return "filtering";
+  case SlamStage::ScanMatching: return "matching";
+  case SlamStage::MapInsertion: return "mapping";
+  case SlamStage::Resampling: return "resampling";
+  case SlamStage::ObserversNotification: return "notification";
+  }
+  return "unknown";
+}
+
+// Latencies are in milliseconds
+struct LatencyStats {
+  std::size_t count = 0;
+  double mean = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+};
+
+/* A histogram of latencies with log-linear buckets (8 buckets per
+ * power of 2 of nanoseconds), so a percentile is within 12.5%
+ * of the actual value.
+ * NB: latencies may be added concurrently. */
+class LatencyHistogram {
+private: // consts
+  static constexpr unsigned Sub_Bits = 3, Sub_Nm = 1u << Sub_Bits;
+  static constexpr std::size_t Buckets_Nm = (64 - Sub_Bits + 1) * Sub_Nm;
+public:
+  LatencyHistogram() { reset(); }
+
+  // PERFORMANCE: an addition is a couple of relaxed atomic increments
+  void add(uint64_t ns) {
+    _buckets[bucket_id(ns)].fetch_add(1, std::memory_order_relaxed);
+    _sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    auto max = _max_ns.load(std::memory_order_relaxed);
+    while (max < ns && !_max_ns.compare_exchange_weak(
+                         max, ns, std::memory_order_relaxed)) {}
+  }
+
+  // NB: latencies that are added concurrently may be lost
+  void reset() {
+    for (auto &bucket : _buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    _sum_ns.store(0, std::memory_order_relaxed);
+    _max_ns.store(0, std::memory_order_relaxed);
+  }
+
+  LatencyStats stats() const {
+    auto stats = LatencyStats{};
+    auto counts = std::vector<uint64_t>(Buckets_Nm);
+    for (std::size_t i = 0; i < Buckets_Nm; ++i) {
+      counts[i] = _buckets[i].load(std::memory_order_relaxed);
+      stats.count += counts[i];
+    }
+    if (stats.count == 0) { return stats; }
+
+    auto max_ns = _max_ns.load(std::memory_order_relaxed);
+    stats.mean = to_ms(_sum_ns.load(std::memory_order_relaxed)) / stats.count;
+    stats.max = to_ms(max_ns);
+    auto percentile = [&](double p) {
+      auto rank = static_cast<uint64_t>(p * stats.count);
+      uint64_t seen = 0;
+      for (std::size_t i = 0; i < Buckets_Nm; ++i) {
+        seen += counts[i];
+        if (rank < seen) {
+          return to_ms(std::min(bucket_upper_bound(i), max_ns));
+        }
+      }
+      return stats.max;
+    };
+    stats.p50 = percentile(0.5);
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    return stats;
+  }
+
+private: // methods
+
+  static std::size_t bucket_id(uint64_t ns) {
+    if (ns < Sub_Nm) { return ns; }
+    unsigned octave = 63 - __builtin_clzll(ns);
+    auto sub = (ns >> (octave - Sub_Bits)) & (Sub_Nm - 1);
+    return (octave - Sub_Bits + 1) * Sub_Nm + sub;
+  }
+
+  static uint64_t bucket_upper_bound(std::size_t id) {
+    if (id < Sub_Nm) { return id; }
+    unsigned octave = id / Sub_Nm + Sub_Bits - 1;
+    uint64_t sub = id % Sub_Nm;
+    auto width = uint64_t{1} << (octave - Sub_Bits);
+    return (uint64_t{1} << octave) + (sub + 1) * width - 1;
+  }
+
+  static double to_ms(uint64_t ns) { return ns / 1e6; }
+
+private: // fields
+  std::array<std::atomic<uint64_t>, Buckets_Nm> _buckets;
+  std::atomic<uint64_t> _sum_ns, _max_ns;
+};
+
+// Latencies of stages of scans handled during a report period
+struct StageProfile {
+  std::size_t cycles_nm = 0;
+  double period_secs = 0;
+  std::array<LatencyStats, Slam_Stages_Nm> stages;
+  // memory of maps of the slam at the report (empty if not reported)
+  GridMapMemoryUsage map_memory;
+  // heap allocations (tracked in the opt-in build mode only,
+  // see AllocationCount): totals of stages and of measured scans
+  std::array<AllocationCount, Slam_Stages_Nm> stage_allocations;
+  AllocationCount scan_allocations;
+  std::size_t allocation_scans_nm = 0;
+  uint64_t max_scan_allocs_nm = 0;
+
+  const LatencyStats &stage(SlamStage s) const {
+    return stages[static_cast<std::size_t>(s)];
+  }
+
+  // NB: stages are measured in each cycle, scans in measured ones
+  double stage_allocs_per_scan(std::size_t stage_id) const {
+    return cycles_nm == 0 ? 0 :
+      double(stage_allocations[stage_id].allocs_nm) / cycles_nm;
+  }
+
+  double allocs_per_scan(uint64_t allocs_nm) const {
+    return allocation_scans_nm == 0 ? 0 :
+      double(allocs_nm) / allocation_scans_nm;
+  }
+};
+
+class StageProfileObserver {
+public:
+  virtual void on_stage_profile(const StageProfile &profile) = 0;
+  virtual ~StageProfileObserver() = default;
+};
+
+/* Measures latencies of stages of a slam (see SlamStage) and reports
+ * them to observers (that are kept by the profiler) once per a period;
+ * stages are measured anew for each period. A cycle is a handled scan;
+ * the period is checked once per cycle, so observers are called
+ * by a slam thread.
+ * Client code example:
+ *   StageTimer timer{profiler, SlamStage::ScanMatching};
+ *   ... // the measured code
+ * Heap allocations of stages and scans are reported as well if they are
+ * tracked (see AllocationCount); a scan's allocations are the ones made
+ * by the slam thread between cycle finishes.
+ * PERFORMANCE: a measurement is two steady clock reads and a histogram
+ *              update; a null profiler measures nothing
+ *              (unless tracing is enabled, see StageTimer). */
+class StageProfiler {
+private: // types
+  using Clock = std::chrono::steady_clock;
+public:
+  explicit StageProfiler(double report_period_secs = 10)
+    : _report_period{report_period_secs}, _period_start{Clock::now()} {}
+
+  StageProfiler(const StageProfiler&) = delete;
+  StageProfiler& operator=(const StageProfiler&) = delete;
+
+  void subscribe(std::shared_ptr<StageProfileObserver> obs) {
+    auto lock = std::unique_lock<std::mutex>{_report_mutex};
+    _observers.push_back(obs);
+  }
+
+  void add(SlamStage stage, Clock::duration latency) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency);
+    histogram(stage).add(ns.count() < 0 ? 0 : ns.count());
+  }
+
+  void add_allocations(SlamStage stage, const AllocationCount &allocs) {
+    auto &stage_allocs = _stage_allocations[static_cast<std::size_t>(stage)];
+    stage_allocs.allocs_nm.fetch_add(allocs.allocs_nm,
+                                     std::memory_order_relaxed);
+    stage_allocs.bytes.fetch_add(allocs.bytes, std::memory_order_relaxed);
+  }
+
+  LatencyStats stats(SlamStage stage) const {
+    return _histograms[static_cast<std::size_t>(stage)].stats();
+  }
+
+  // Reports stages to observers if the report period has passed
+  // NB: a non-positive period disables reports
+  void finish_cycle() {
+    finish_cycle([]() { return GridMapMemoryUsage{}; });
+  }
+
+  // The memory usage is requested only if a report is made
+  template <typename MapMemoryUsage>
+  void finish_cycle(MapMemoryUsage map_memory_usage) {
+    ++_cycles_nm;
+    if (Allocations_Are_Tracked) { finish_scan_allocations(); }
+    if (_report_period <= 0) { return; }
+    auto now = Clock::now();
+    auto period = std::chrono::duration<double>(now - _period_start).count();
+    if (period < _report_period) { return; }
+
+    auto lock = std::unique_lock<std::mutex>{_report_mutex};
+    auto profile = StageProfile{};
+    profile.cycles_nm = _cycles_nm.exchange(0);
+    profile.period_secs = period;
+    for (std::size_t i = 0; i < Slam_Stages_Nm; ++i) {
+      profile.stages[i] = _histograms[i].stats();
+      _histograms[i].reset();
+    }
+    profile.map_memory = map_memory_usage();
+    if (Allocations_Are_Tracked) { take_allocations(profile); }
+    _period_start = now;
+    for (auto &obs : _observers) { obs->on_stage_profile(profile); }
+    // allocations of the report don't belong to the next scan
+    if (Allocations_Are_Tracked) {
+      _scan_allocs_start = thread_allocation_count();
+    }
+  }
+
+private: // types
+  struct AtomicAllocationCount {
+    std::atomic<uint64_t> allocs_nm{0}, bytes{0};
+  };
+
+private: // methods
+  LatencyHistogram &histogram(SlamStage stage) {
+    return _histograms[static_cast<std::size_t>(stage)];
+  }
+
+  // NB: the first cycle only starts the measurement since
+  //     the profiler may be created by another thread
+  void finish_scan_allocations() {
+    auto count = thread_allocation_count();
+    if (_scan_allocs_are_measured) {
+      auto scan_allocs = count - _scan_allocs_start;
+      _scan_allocations += scan_allocs;
+      _max_scan_allocs_nm = std::max(_max_scan_allocs_nm,
+                                     scan_allocs.allocs_nm);
+      ++_allocation_scans_nm;
+    }
+    _scan_allocs_start = count;
+    _scan_allocs_are_measured = true;
+  }
+
+  void take_allocations(StageProfile &profile) {
+    for (std::size_t i = 0; i < Slam_Stages_Nm; ++i) {
+      auto &stage_allocs = _stage_allocations[i];
+      profile.stage_allocations[i] = AllocationCount{
+        stage_allocs.allocs_nm.exchange(0), stage_allocs.bytes.exchange(0)};
+    }
+    profile.scan_allocations = _scan_allocations;
+    profile.allocation_scans_nm = _allocation_scans_nm;
+    profile.max_scan_allocs_nm = _max_scan_allocs_nm;
+    _scan_allocations = AllocationCount{};
+    _allocation_scans_nm = 0;
+    _max_scan_allocs_nm = 0;
+  }
+
+private: // fields
+  std::array<LatencyHistogram, Slam_Stages_Nm> _histograms;
+  std::atomic<std::size_t> _cycles_nm{0};
+  double _report_period;
+  Clock::time_point _period_start;
+  std::mutex _report_mutex;
+  std::vector<std::shared_ptr<StageProfileObserver>> _observers;
+  // allocations (see Allocations_Are_Tracked)
+  std::array<AtomicAllocationCount, Slam_Stages_Nm> _stage_allocations;
+  bool _scan_allocs_are_measured = false;
+  AllocationCount _scan_allocs_start, _scan_allocations;
+  std::size_t _allocation_scans_nm = 0;
+  uint64_t _max_scan_allocs_nm = 0;
+};
+
+// Measures a stage from the construction to the destruction
+// NB: the stage is traced as well if tracing is enabled (see TraceRecorder)
+class StageTimer {
+public:
+  StageTimer(StageProfiler *profiler, SlamStage stage)
+    : _profiler{profiler}, _recorder{TraceRecorder::active()}
+    , _stage{stage} {
+    if (!_profiler && !_recorder) { return; }
+    if (_recorder) { _scan_id = _recorder->scan_id(); }
+    if (Allocations_Are_Tracked) { _allocs_start = thread_allocation_count(); }
+    _start = std::chrono::steady_clock::now();
+  }
+
+  StageTimer(const std::shared_ptr<StageProfiler> &profiler, SlamStage stage)
+    : StageTimer{profiler.get(), stage} {}
+
+  StageTimer(const StageTimer&) = delete;
+  StageTimer& operator=(const StageTimer&) = delete;
+
+  ~StageTimer() {
+    if (!_profiler && !_recorder) { return; }
+    auto end = std::chrono::steady_clock::now();
+    if (_profiler) {
+      _profiler->add(_stage, end - _start);
+      if (Allocations_Are_Tracked) {
+        _profiler->add_allocations(
+          _stage, thread_allocation_count() - _allocs_start);
+      }
+    }
+    if (_recorder) {
+      _recorder->add(slam_stage_name(_stage), "stage", _start, end, _scan_id);
+    }
+  }
+
+private: // fields
+  StageProfiler *_profiler;
+  TraceRecorder *_recorder;
+  SlamStage _stage;
+  uint64_t _scan_id = 0;
+  AllocationCount _allocs_start;
+  std::chrono::steady_clock::time_point _start;
+};
+
+// Prints a line per report: "[PROFILE] <cycles> scans/<period> s:
+// <stage> p50/p95/p99/max ms ...; map <MB> ...; allocs/scan ..." (stages
+// without latencies are skipped, the map memory is printed if reported,
+// allocations are printed if they are tracked)
+class StageProfileLogger : public StageProfileObserver {
+public:
+  StageProfileLogger(std::ostream &os = std::cout) : _os(os) {}
+
+  void on_stage_profile(const StageProfile &profile) override {
+    _os << "[PROFILE] " << profile.cycles_nm << " scans/"
+        << std::fixed << std::setprecision(1) << profile.period_secs << " s:"
+        << std::setprecision(3);
+    for (std::size_t i = 0; i < Slam_Stages_Nm; ++i) {
+      auto &s = profile.stages[i];
+      if (s.count == 0) { continue; }
+      _os << " " << slam_stage_name(static_cast<SlamStage>(i)) << " "
+          << s.p50 << "/" << s.p95 << "/" << s.p99 << "/" << s.max;
+    }
+    _os << " ms (p50/p95/p99/max)";
+    auto &mem = profile.map_memory;
+    if (mem.total_bytes() != 0) {
+      _os << std::setprecision(1) << "; map " << to_mb(mem.total_bytes())
+          << " MB (cells " << to_mb(mem.cells_bytes) << ", amortized "
+          << to_mb(mem.amortized_bytes) << ")";
+      if (mem.tiles_nm != 0) {
+        _os << ", tiles " << mem.tiles_nm << " (shared "
+            << mem.shared_tiles_nm << ")";
+      }
+      if (1 < mem.levels_bytes.size()) {
+        _os << ", levels";
+        for (auto bytes : mem.levels_bytes) { _os << " " << to_mb(bytes); }
+        _os << " MB";
+      }
+    }
+    if (Allocations_Are_Tracked && profile.allocation_scans_nm != 0) {
+      _os << std::setprecision(1) << "; allocs/scan "
+          << profile.allocs_per_scan(profile.scan_allocations.allocs_nm)
+          << " (max " << profile.max_scan_allocs_nm << ", "
+          << profile.allocs_per_scan(profile.scan_allocations.bytes) / 1e3
+          << " KB):";
+      for (std::size_t i = 0; i < Slam_Stages_Nm; ++i) {
+        if (profile.stages[i].count == 0) { continue; }
+        _os << " " << slam_stage_name(static_cast<SlamStage>(i)) << " "
+            << profile.stage_allocs_per_scan(i);
+      }
+    }
+    _os << std::defaultfloat << std::endl;
+  }
+
+private: // methods
+  static double to_mb(std::size_t bytes) { return bytes / 1e6; }
+private: // fields
+  std::ostream &_os;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef SLAM_CTOR_CORE_COMPACT_LASER_SCAN_H
+#define SLAM_CTOR_CORE_COMPACT_LASER_SCAN_H
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+
+#include "sensor_data.h"
+
+// Angles of scan points by their indices (shared by scans of a sensor)
+struct ScanAngleTable {
+  std::vector<double> angles;
+  // whether indices are angle indices of points (see ScanPoint2D::angle_idx)
+  bool keeps_angle_idxs;
+};
+
+/* A compact copy of a transformed laser scan for a long-term storage
+ * (e.g. by pose graph nodes). A point takes ~4 bytes instead of
+ * a ScanPoint2D: a range is quantized to 16 bits (the step is
+ * max range / 65535, i.e. < 1 mm for a 60 m sensor), an angle is an index
+ * in a table shared by scans of a sensor (see CompactLaserScanEncoder),
+ * occupancy is a bit and factors are kept only if some differ from 1.
+ * NB: a trigonometry provider is not kept, it is set on decoding. */
+class CompactLaserScan {
+public: // types
+  using AngleTablePtr = std::shared_ptr<const ScanAngleTable>;
+public:
+  CompactLaserScan() = default;
+
+  // NB: angles of points are expected to be in the table
+  CompactLaserScan(const TransformedLaserScan &tr_scan, AngleTablePtr table,
+                   const std::vector<uint16_t> &angle_ids)
+    : _pose_delta{tr_scan.pose_delta}, _quality{tr_scan.quality}
+    , _angle_table{std::move(table)}, _angle_ids{angle_ids} {
+    const auto &points = tr_scan.scan.points();
+    assert(points.size() == _angle_ids.size());
+    auto max_range = double{0};
+    auto has_factors = false;
+    for (auto &sp : points) {
+      max_range = std::max<double>(max_range, sp.range());
+      has_factors |= sp.factor() != 1.0;
+    }
+    _range_step = 0 < max_range ? max_range / Max_Range_Id : 1.0;
+
+    _range_ids.reserve(points.size());
+    _is_occupied.reserve(points.size());
+    for (auto &sp : points) {
+      assert(std::isfinite(sp.range()));
+      _range_ids.push_back(uint16_t(std::lround(sp.range() / _range_step)));
+      _is_occupied.push_back(sp.is_occupied());
+      if (has_factors) { _factors.push_back(float(sp.factor())); }
+    }
+  }
+
+  std::size_t points_nm() const { return _range_ids.size(); }
+  const AngleTablePtr& angle_table() const { return _angle_table; }
+  // The max quantization error of a range
+  double range_tolerance() const { return _range_step / 2; }
+
+  TransformedLaserScan decode(
+      std::shared_ptr<TrigonometryProvider> trig_provider) const {
+    auto tr_scan = TransformedLaserScan{};
+    tr_scan.pose_delta = _pose_delta;
+    tr_scan.quality = _quality;
+    auto &scan = tr_scan.scan;
+    scan.trig_provider = std::move(trig_provider);
+    auto &points = scan.points();
+    points.reserve(points_nm());
+    for (std::size_t i = 0; i < points_nm(); ++i) {
+      auto angle_id = _angle_ids[i];
+      points.emplace_back(_range_ids[i] * _range_step,
+                          _angle_table->angles[angle_id], _is_occupied[i]);
+      if (_angle_table->keeps_angle_idxs) {
+        points.back().set_angle_idx(angle_id);
+      }
+      if (!_factors.empty()) { points.back().set_factor(_factors[i]); }
+    }
+    return tr_scan;
+  }
+
+  // Heap bytes taken by the scan (the shared angle table is not counted)
+  std::size_t heap_size() const {
+    return _range_ids.capacity() * sizeof(uint16_t) +
+           _angle_ids.capacity() * sizeof(uint16_t) +
+           _is_occupied.capacity() / 8 +
+           _factors.capacity() * sizeof(float);
+  }
+
+private: // consts
+  static constexpr double Max_Range_Id = UINT16_MAX;
+private: // fields
+  RobotPoseDelta _pose_delta;
+  double _quality = 0;
+  double _range_step = 1.0;
+  AngleTablePtr _angle_table;
+  std::vector<uint16_t> _range_ids, _angle_ids;
+  std::vector<bool> _is_occupied;
+  std::vector<float> _factors;
+};
+
+/* Encodes scans of a sensor to compact ones; the angle table is shared
+ * by consecutive scans while their angles are the same. */
+class CompactLaserScanEncoder {
+public:
+  CompactLaserScan encode(const TransformedLaserScan &tr_scan) {
+    const auto &points = tr_scan.scan.points();
+    _angle_ids.clear();
+    auto has_angle_idxs = std::all_of(
+      points.begin(), points.end(), [](const ScanPoint2D &sp) {
+        return 0 <= sp.angle_idx() && sp.angle_idx() <= UINT16_MAX;
+      });
+
+    if (has_angle_idxs) {
+      if (!table_keeps_angles_by_idxs(points)) {
+        auto table = std::make_shared<ScanAngleTable>();
+        table->keeps_angle_idxs = true;
+        for (auto &sp : points) {
+          auto idx = std::size_t(sp.angle_idx());
+          if (table->angles.size() <= idx) {
+            table->angles.resize(idx + 1, std::nan(""));
+          }
+          table->angles[idx] = sp.angle();
+        }
+        _table = std::move(table);
+      }
+      for (auto &sp : points) { _angle_ids.push_back(sp.angle_idx()); }
+    } else {
+      // NB: points are not bound to sensor angles, so the table is own
+      assert(points.size() <= std::size_t(UINT16_MAX) + 1);
+      auto table = std::make_shared<ScanAngleTable>();
+      table->keeps_angle_idxs = false;
+      for (auto &sp : points) {
+        _angle_ids.push_back(table->angles.size());
+        table->angles.push_back(sp.angle());
+      }
+      return CompactLaserScan{tr_scan, std::move(table), _angle_ids};
+    }
+    return CompactLaserScan{tr_scan, _table, _angle_ids};
+  }
+
+private: // methods
+
+  bool table_keeps_angles_by_idxs(const LaserScan2D::Points &points) const {
+    if (!_table) { return false; }
+    auto &angles = _table->angles;
+    for (auto &sp : points) {
+      auto idx = std::size_t(sp.angle_idx());
+      if (angles.size() <= idx || angles[idx] != sp.angle()) { return false; }
+    }
+    return true;
+  }
+
+private: // fields
+  CompactLaserScan::AngleTablePtr _table;
+  // a buffer reused by encodings
+  std::vector<uint16_t> _angle_ids;
+};
+
+#endif
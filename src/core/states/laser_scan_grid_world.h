@@ -1,8 +1,11 @@
 #ifndef SLAM_CTOR_CORE_LASER_SCAN_GRID_WORLD_H
 #define SLAM_CTOR_CORE_LASER_SCAN_GRID_WORLD_H
 
+#include <memory>
+
 #include "sensor_data.h"
 #include "world.h"
+#include "../stage_profiler.h"
 
 template <typename Map>
 class LaserScanGridWorld : public World<TransformedLaserScan, Map> {
@@ -14,12 +17,42 @@ public: // methods
   void handle_sensor_data(ScanType &scan) override {
     this->update_robot_pose(scan.pose_delta);
     handle_observation(scan);
-
-    this->notify_with_pose(this->pose());
-    this->notify_with_map(this->map());
+    finish_sensor_data_handling();
   }
 
   virtual void handle_observation(ScanType &tr_scan) = 0;
+
+  // Stages of scan handling are measured by the profiler if it is set
+  virtual std::shared_ptr<StageProfiler> stage_profiler() const {
+    return nullptr;
+  }
+
+  // Blocks until handled scans are in the map, i.e. map() is final
+  // (e.g. for a dump of the map after the last scan).
+  // NB: the default is for worlds that insert scans on handling
+  virtual void wait_for_mapping() {}
+
+  // Memory of maps the world keeps (reported by the stage profiler)
+  // NB: the default is for maps that are not grid maps
+  virtual GridMapMemoryUsage maps_memory_usage() const { return {}; }
+
+protected: // methods
+
+  // Notifies observers with the current state and closes the cycle
+  // of the profiler
+  void finish_sensor_data_handling() {
+    {
+      StageTimer timer{stage_profiler(),
+                       SlamStage::ObserversNotification};
+      // NB: the const map is notified, i.e. a mapping is not waited for
+      const auto &state = *this;
+      this->notify_with_pose(state.pose());
+      this->notify_with_map(state.map());
+    }
+    if (auto profiler = stage_profiler()) {
+      profiler->finish_cycle([this]() { return maps_memory_usage(); });
+    }
+  }
 };
 
 #endif
@@ -10,9 +10,9 @@
 class RobotPoseDelta {
 public: // methods
   RobotPoseDelta() : RobotPoseDelta(0, 0, 0){}
-  constexpr RobotPoseDelta(double d_x, double d_y, double d_th) :
+  constexpr RobotPoseDelta(Real d_x, Real d_y, Real d_th) :
     x(d_x), y(d_y), theta(d_th) {}
-  constexpr RobotPoseDelta(const Point2D &offset, double d_th) :
+  constexpr RobotPoseDelta(const Point2D &offset, Real d_th) :
     x(offset.x), y(offset.y), theta(d_th) {}
 
   RobotPoseDelta& operator+=(const RobotPoseDelta& delta) {
@@ -48,11 +48,11 @@ public: // methods
   RobotPoseDelta abs() const {
     return RobotPoseDelta{std::abs(x), std::abs(y), std::abs(theta)};
   }
-  double sq_dist() const { return x*x + y*y; }
+  Real sq_dist() const { return x*x + y*y; }
 
   void reset() { x = y = theta = 0; }
 public: // fields
-  double x, y, theta;
+  Real x, y, theta;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const RobotPoseDelta& rpd) {
@@ -85,8 +85,8 @@ public:
   ~RobotPoseDeltaRV() {}
 
   RobotPoseDelta sample(RandomEngineT &re) {
-    return RobotPoseDelta{_x_rv->sample(re), _y_rv->sample(re),
-                          _th_rv->sample(re)};
+    return RobotPoseDelta(_x_rv->sample(re), _y_rv->sample(re),
+                          _th_rv->sample(re));
   }
 
 private:
@@ -95,7 +95,7 @@ private:
 
 class RobotPose {
 public: // methods
-  RobotPose(double x, double y, double theta) : x(x), y(y), theta(theta) {}
+  RobotPose(Real x, Real y, Real theta) : x(x), y(y), theta(theta) {}
   RobotPose(const RobotPoseDelta& rpd) : RobotPose(rpd.x, rpd.y, rpd.theta) {}
 
   RobotPose() : RobotPose(0, 0, 0){}
@@ -132,7 +132,7 @@ public: // methods
 
   auto point() const { return Point2D{x, y}; }
 public:
-  double x, y, theta;
+  Real x, y, theta;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const RobotPose& rp) {
@@ -0,0 +1,103 @@
+#ifndef SLAM_CTOR_CORE_SCAN_VOXEL_DOWNSAMPLER_H
+#define SLAM_CTOR_CORE_SCAN_VOXEL_DOWNSAMPLER_H
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "sensor_data.h"
+#include "../flat_cell_map.h"
+
+/* Merges scan points that fall into the same cell of a grid with
+ * a given resolution (in the sensor frame) into a single point.
+ * The point of a cell that is the closest to the points centroid represents
+ * them with a factor that is a sum of their factors (see ScanPoint2D).
+ * Occupied and free points are merged separately; the points order is kept.
+ * NB: it is intended to be run once per scan before the scan is matched
+ *     and mapped; representatives are original points, so their angles
+ *     fit a cached trigonometry provider. */
+class ScanVoxelDownsampler {
+public:
+  ScanVoxelDownsampler(double resolution) : _resolution{resolution} {
+    assert(0 < _resolution);
+  }
+
+  double resolution() const { return _resolution; }
+
+  void downsample(LaserScan2D &scan) const {
+    auto &points = scan.points();
+    if (points.size() < 2) { return; }
+
+    scan.trig_provider->set_base_angle(0);
+    _voxel_ids[0].clear();
+    _voxel_ids[1].clear();
+    _voxels.clear();
+    _point_voxels.clear();
+    _point_voxels.reserve(points.size());
+    for (auto &sp : points) {
+      auto p = sp.move_origin(0, 0, scan.trig_provider);
+      auto voxel_id = _voxel_ids[sp.is_occupied()].emplace(voxel_coord(p),
+                                                           _voxels.size());
+      if (voxel_id.second) { _voxels.push_back(Voxel{}); }
+
+      auto &voxel = _voxels[*voxel_id.first];
+      voxel.x_sum += p.x;
+      voxel.y_sum += p.y;
+      voxel.factor += sp.factor();
+      ++voxel.points_nm;
+      _point_voxels.push_back({*voxel_id.first, p});
+    }
+    if (_voxels.size() == points.size()) { return; }
+
+    // pick representatives
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      auto &voxel = _voxels[_point_voxels[i].voxel_id];
+      auto &p = _point_voxels[i].point;
+      auto dist_sq = std::pow(p.x - voxel.x_sum / voxel.points_nm, 2) +
+                     std::pow(p.y - voxel.y_sum / voxel.points_nm, 2);
+      if (dist_sq < voxel.min_dist_sq) {
+        voxel.min_dist_sq = dist_sq;
+        voxel.representative = i;
+      }
+    }
+
+    std::size_t merged_nm = 0;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      auto &voxel = _voxels[_point_voxels[i].voxel_id];
+      if (voxel.representative != i) { continue; }
+      points[merged_nm] = points[i];
+      points[merged_nm].set_factor(voxel.factor);
+      ++merged_nm;
+    }
+    points.resize(merged_nm);
+  }
+
+private: // types
+  struct Voxel {
+    double x_sum = 0, y_sum = 0, factor = 0;
+    std::size_t points_nm = 0;
+    double min_dist_sq = std::numeric_limits<double>::infinity();
+    std::size_t representative = 0;
+  };
+
+  struct PointVoxel {
+    std::size_t voxel_id;
+    Point2D point;
+  };
+private: // methods
+
+  DiscretePoint2D voxel_coord(const Point2D &p) const {
+    return {static_cast<int>(std::floor(p.x / _resolution)),
+            static_cast<int>(std::floor(p.y / _resolution))};
+  }
+
+private: // fields
+  double _resolution;
+  // buffers reused by scans; voxel ids of free and occupied points
+  mutable FlatCellMap<std::size_t> _voxel_ids[2];
+  mutable std::vector<Voxel> _voxels;
+  mutable std::vector<PointVoxel> _point_voxels;
+};
+
+#endif
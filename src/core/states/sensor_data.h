@@ -3,6 +3,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <iostream>
@@ -16,7 +17,7 @@ public:
   enum class PointType {Polar, Cartesian};
 public: // methods
 
-  static ScanPoint2D make_polar(double range, double angle, bool is_occ) {
+  static ScanPoint2D make_polar(Real range, Real angle, bool is_occ) {
     return ScanPoint2D{PointType::Polar, range, angle, is_occ};
   }
 
@@ -24,8 +25,8 @@ public: // methods
     return ScanPoint2D{PointType::Cartesian, p.x, p.y, is_occ};
   }
 
-  ScanPoint2D(PointType type, double x_or_range, double y_or_angle, bool is_occ)
-    : _type{type}, _factor{1.0}, _is_occupied{is_occ} {
+  ScanPoint2D(PointType type, Real x_or_range, Real y_or_angle, bool is_occ)
+    : _type{type}, _factor{1}, _angle_idx{-1}, _is_occupied{is_occ} {
 
     switch (_type) {
     case PointType::Polar:
@@ -41,29 +42,29 @@ public: // methods
     }
   }
 
-  ScanPoint2D(double range = 0, double ang = 0, bool is_occ = true)
+  ScanPoint2D(Real range = 0, Real ang = 0, bool is_occ = true)
     : ScanPoint2D{PointType::Polar, range, ang, is_occ} {}
 
-  double range() const {
+  Real range() const {
     if (_type == PointType::Polar) {
       return _data.polar.range;
     }
     return std::sqrt(std::pow(_data.cartesian.x, 2) +
                      std::pow(_data.cartesian.y, 2));
   }
-  double angle() const {
+  Real angle() const {
     if (_type == PointType::Polar) {
       return _data.polar.angle;
     }
     return std::atan2(_data.cartesian.y, _data.cartesian.x);
   }
-  double x() const {
+  Real x() const {
     if (_type == PointType::Cartesian) {
       return _data.cartesian.x;
     }
     return _data.polar.range * std::cos(_data.polar.angle);
   }
-  double y() const {
+  Real y() const {
     if (_type == PointType::Cartesian) {
       return _data.cartesian.y;
     }
@@ -71,8 +72,13 @@ public: // methods
   }
   bool is_occupied() const { return _is_occupied; }
 
-  ScanPoint2D& set_factor(double factor) { _factor = factor; return *this; }
-  double factor() const { return _factor; }
+  ScanPoint2D& set_factor(Real factor) { _factor = factor; return *this; }
+  Real factor() const { return _factor; }
+
+  // An index of the point's angle in the sensor's angle grid
+  // (see TrigonometryProvider::sin_cos), negative if unknown.
+  ScanPoint2D& set_angle_idx(int idx) { _angle_idx = idx; return *this; }
+  int angle_idx() const { return _angle_idx; }
 
   ScanPoint2D to_cartesian(std::shared_ptr<TrigonometryProvider> tp) const {
     auto point = move_origin(0, 0, tp);
@@ -80,11 +86,11 @@ public: // methods
   }
 
   // NB: a rotation is preset in a given trigonometry provider
-  Point2D move_origin(double d_x, double d_y,
+  Point2D move_origin(Real d_x, Real d_y,
                       std::shared_ptr<TrigonometryProvider> tp) const {
-    return Point2D{d_x + range() * tp->cos(angle()),
-                   d_y + range() * tp->sin(angle())};
-
+    auto sin_cos = tp->sin_cos(angle(), _angle_idx);
+    auto r = range();
+    return Point2D(d_x + r * sin_cos.cos, d_y + r * sin_cos.sin);
   }
 
   Point2D move_origin(const Point2D &p,
@@ -93,18 +99,18 @@ public: // methods
 
   }
 
-  Point2D move_origin(double d_x, double d_y, double d_angle) const {
+  Point2D move_origin(Real d_x, Real d_y, Real d_angle) const {
     auto patched = ScanPoint2D{PointType::Polar,
                                range(), angle() + d_angle,
                                is_occupied()};
     return Point2D{patched.x() + d_x, patched.y() + d_y};
   }
 
-  Point2D move_origin(double d_x, double d_y) const {
+  Point2D move_origin(Real d_x, Real d_y) const {
     return Point2D{x() + d_x, y() + d_y};
   }
 
-  ScanPoint2D to_cartesian(double d_angle = 0, double d_range = 0) const {
+  ScanPoint2D to_cartesian(Real d_angle = 0, Real d_range = 0) const {
     auto patched = ScanPoint2D{PointType::Polar,
                                range() + d_range, angle() + d_angle,
                                is_occupied()};
@@ -112,7 +118,7 @@ public: // methods
                        patched.is_occupied()};
   }
 
-  ScanPoint2D to_polar(double d_x = 0, double d_y = 0) const {
+  ScanPoint2D to_polar(Real d_x = 0, Real d_y = 0) const {
     auto patched = ScanPoint2D{PointType::Cartesian,
                                x() + d_x, y() + d_y,
                                is_occupied()};
@@ -124,7 +130,7 @@ private: // data structs
   union PointData {
     PointData() : cartesian{0, 0} {}
     struct PolarPoint {
-      double range, angle;
+      Real range, angle;
     } polar;
     Point2D cartesian;
   };
@@ -132,7 +138,8 @@ private: // data structs
 private: // data
   PointType  _type;
   PointData _data;
-  double _factor;
+  Real _factor;
+  int _angle_idx;
   bool _is_occupied;
 };
 
@@ -141,16 +148,202 @@ inline std::ostream& operator<<(std::ostream &osm, const ScanPoint2D &sp) {
   return osm << "x: " << sp.x() << ", y: " << sp.y() << "}";
 }
 
+/* Structure-of-arrays form of scan points in the sensor frame.
+ * Polar and Cartesian coordinates of all points are computed once,
+ * so hot loops access them without per-point branching and trigonometry.
+ * NB: is a prerequisite for vectorized scan processing. */
+struct ScanPointsSoA {
+  std::vector<Real> ranges, angles, xs, ys, factors;
+  std::vector<int> angle_idxs;
+  std::vector<char> occupied;
+
+  template <typename Points>
+  explicit ScanPointsSoA(const Points &pts) { assign(pts); }
+
+  // NB: the storage is reused, i.e. an update of a kept SoA doesn't
+  //     allocate once its capacity is reached.
+  template <typename Points>
+  void assign(const Points &pts) {
+    ranges.clear();
+    angles.clear();
+    xs.clear();
+    ys.clear();
+    factors.clear();
+    angle_idxs.clear();
+    occupied.clear();
+    ranges.reserve(pts.size());
+    angles.reserve(pts.size());
+    xs.reserve(pts.size());
+    ys.reserve(pts.size());
+    factors.reserve(pts.size());
+    angle_idxs.reserve(pts.size());
+    occupied.reserve(pts.size());
+    for (auto &sp : pts) {
+      ranges.push_back(sp.range());
+      angles.push_back(sp.angle());
+      xs.push_back(sp.x());
+      ys.push_back(sp.y());
+      factors.push_back(sp.factor());
+      angle_idxs.push_back(sp.angle_idx());
+      occupied.push_back(sp.is_occupied());
+    }
+  }
+
+  std::size_t size() const { return ranges.size(); }
+
+  // Rotates the points by a given angle.
+  // PERFORMANCE: the rotation is computed once per scan and the loop
+  //              has neither calls nor branches, so a compiler vectorizes
+  //              it (and fuses multiply-adds if the target supports them).
+  void rotate(double angle,
+              std::vector<Real> &rotated_xs,
+              std::vector<Real> &rotated_ys) const {
+    const auto n = size();
+    rotated_xs.resize(n);
+    rotated_ys.resize(n);
+    const Real c = std::cos(angle), s = std::sin(angle);
+    const Real *src_xs = xs.data(), *src_ys = ys.data();
+    Real *dst_xs = rotated_xs.data(), *dst_ys = rotated_ys.data();
+    for (std::size_t i = 0; i < n; ++i) {
+      dst_xs[i] = c * src_xs[i] - s * src_ys[i];
+      dst_ys[i] = s * src_xs[i] + c * src_ys[i];
+    }
+  }
+
+  // Transforms the points to the world frame by a given sensor pose.
+  // NB: the result is the same as of a rotation followed by a translation
+  //     (e.g. poses with the same theta may share a rotation).
+  void to_world(const RobotPose &pose,
+                std::vector<Real> &world_xs,
+                std::vector<Real> &world_ys) const {
+    rotate(pose.theta, world_xs, world_ys);
+    const Real d_x = pose.x, d_y = pose.y;
+    Real *dst_xs = world_xs.data(), *dst_ys = world_ys.data();
+    for (std::size_t i = 0; i < size(); ++i) {
+      dst_xs[i] += d_x;
+      dst_ys[i] += d_y;
+    }
+  }
+};
+
+/* Features of scan points shared by consumers of a scan (e.g. point
+ * weightings, mapping quality estimators and drift detectors),
+ * so they are computed once per scan (see LaserScan2D::features). */
+struct ScanFeatures {
+  // A direction of a point from the previous one in [0, pi), Ox-based
+  // (the first point has no previous one, so its direction is 0)
+  std::vector<double> drift_dirs;
+
+  template <typename Points>
+  ScanFeatures(const Points &pts, const ScanPointsSoA *soa) {
+    drift_dirs.resize(pts.size(), 0.0);
+    for (std::size_t i = 1; i < pts.size(); ++i) {
+      drift_dirs[i] = soa ?
+        ox_based_angle(soa->xs[i] - soa->xs[i-1], soa->ys[i] - soa->ys[i-1]) :
+        ox_based_angle(pts[i].x() - pts[i-1].x(), pts[i].y() - pts[i-1].y());
+    }
+  }
+
+  // The angle between Ox and a direction in [0, pi)
+  static double ox_based_angle(double d_x, double d_y) {
+    if (d_y == 0) { // TODO: math utils
+      return 0; // 180 is equivalent to 0
+    }
+    auto d_d = std::sqrt(d_x*d_x + d_y*d_y);
+    auto angle = std::acos(d_x / d_d);
+
+    if (d_y < 0 && d_x != 0) { // TODO: math utils
+      angle = M_PI - angle;
+    }
+    // NB: acos rounds to pi if d_y is negligible against d_x
+    return angle < M_PI ? angle : 0;
+  }
+};
+
+// Weights of scan points assigned by a scan probability estimator
+// (see WeightedMeanPointProbabilitySPE::filter_scan)
+struct ScanPointWeights {
+  // NB: a weight is multiplied by the point's factor
+  std::vector<double> values;
+  double total = 0;
+};
+
 struct LaserScan2D {
 public:
   using Points = std::vector<ScanPoint2D>;
+  using SoAPtr = std::shared_ptr<const ScanPointsSoA>;
+  using FeaturesPtr = std::shared_ptr<const ScanFeatures>;
+  using WeightsPtr = std::shared_ptr<const ScanPointWeights>;
+  using PrefilteredPtr = std::shared_ptr<const LaserScan2D>;
 public:
   const Points& points() const { return _points; }
+  // NB: drops the SoA form, features, weights and the prefiltered scan
+  //     since points may be modified
   Points& points() {
-    return const_cast<Points&>(
-      static_cast<const LaserScan2D*>(this)->points());
+    _soa.reset();
+    _features.reset();
+    _point_weights.reset();
+    _prefiltered.reset();
+    return _points;
+  }
+
+  // The SoA form of points (see ScanPointsSoA) is optional and is expected
+  // to be computed once per scan after its points are set up.
+  // Copies of a scan share the form.
+  const ScanPointsSoA& update_soa() {
+    _soa = std::make_shared<const ScanPointsSoA>(_points);
+    return *_soa;
+  }
+  // NB: the SoA is expected to be computed from the current points
+  //     (e.g. a reused one, see ScanPointsSoA::assign)
+  void set_soa(SoAPtr soa) {
+    assert(soa->size() == _points.size());
+    _soa = std::move(soa);
+  }
+  bool has_soa() const { return bool(_soa); }
+  const ScanPointsSoA& soa() const {
+    assert(has_soa() && _soa->size() == _points.size());
+    return *_soa;
+  }
+
+  // Features of points (see ScanFeatures) are computed on the first
+  // request; copies of a scan made afterwards share them.
+  // NB: concurrent first requests are safe (only one result is kept).
+  FeaturesPtr features() const {
+    auto features = std::atomic_load(&_features);
+    if (features) { return features; }
+
+    auto expected = FeaturesPtr{};
+    features = std::make_shared<const ScanFeatures>(
+      _points, has_soa() ? _soa.get() : nullptr);
+    if (!std::atomic_compare_exchange_strong(&_features, &expected,
+                                             features)) {
+      return expected;
+    }
+    return features;
+  }
+
+  // Weights of points are optional and are expected to be set once
+  // per scan after its points are set up. Copies of a scan share them.
+  void set_point_weights(WeightsPtr weights) {
+    assert(weights->values.size() == _points.size());
+    _point_weights = std::move(weights);
+  }
+  const ScanPointWeights* point_weights() const {
+    return _point_weights.get();
+  }
+
+  // The scan filtered regardless of a pose and a map
+  // (see ScanProbabilityEstimator::prefilter_scan) is optional and is
+  // expected to be set once per scan, so consumers that match the scan
+  // against different maps (e.g. particles) share the filtering.
+  // Copies of a scan share it.
+  void set_prefiltered(PrefilteredPtr prefiltered) {
+    _prefiltered = std::move(prefiltered);
   }
+  const LaserScan2D* prefiltered() const { return _prefiltered.get(); }
 
+  // NB: weights are kept since points correspond to the original ones
   LaserScan2D to_cartesian(double angle) const {
     LaserScan2D cartsn_scan;
     cartsn_scan.points().reserve(_points.size());
@@ -161,6 +354,7 @@ public:
       auto cartesian_sp = sp.to_cartesian(cartsn_scan.trig_provider);
       cartsn_scan.points().push_back(cartesian_sp);
     }
+    cartsn_scan._point_weights = _point_weights;
     return cartsn_scan;
   }
 
@@ -171,6 +365,10 @@ public:
   std::shared_ptr<TrigonometryProvider> trig_provider;
 private:
   Points _points;
+  SoAPtr _soa;
+  mutable FeaturesPtr _features;
+  WeightsPtr _point_weights;
+  PrefilteredPtr _prefiltered;
 };
 
 struct TransformedLaserScan {
@@ -1,9 +1,16 @@
 #ifndef SLAM_CTOR_CORE_SINGLE_STATE_HYPOTHESIS_LASER_SCAN_GRID_WORLD_H
 #define SLAM_CTOR_CORE_SINGLE_STATE_HYPOTHESIS_LASER_SCAN_GRID_WORLD_H
 
+#include <cmath>
 #include <memory>
+#include <algorithm>
 #include <utility>
+#include <type_traits>
+#include <vector>
 
+#include "../bounded_task_queue.h"
+#include "../serialization.h"
+#include "../stage_profiler.h"
 #include "../maps/grid_map.h"
 #include "../maps/grid_map_scan_adders.h"
 #include "../scan_matchers/grid_scan_matcher.h"
@@ -19,19 +26,112 @@ struct SingleStateHypothesisLSGWProperties {
   std::shared_ptr<GridScanMatcher> gsm;
   std::shared_ptr<GridMapScanAdder> gmsa;
   GridMapParams map_props;
+  // Scans are inserted into the map on a dedicated worker, so a pose
+  // is published as soon as its scan is matched. A scan is matched
+  // against the latest map the worker has produced, i.e. the map may
+  // lack up to mapping_queue_size recent scans.
+  // NB: the map is copied per scan, so it is intended for maps
+  //     with copy-on-write storages (e.g. tiled ones).
+  bool pipelined_mapping = false;
+  // Max number of scans waiting for insertion; matching blocks on overflow
+  std::size_t mapping_queue_size = 1;
+  // scales localized_scan_quality of a scan whose matching has been
+  // stopped by the time budget (see GridScanMatcher::set_time_budget_ms)
+  double truncated_scan_quality_factor = 0.5;
+  // measures stages of scan handling if set (see StageProfiler)
+  std::shared_ptr<StageProfiler> stage_profiler;
+  // Scans are matched only, i.e. the map is kept as is (e.g. a prebuilt
+  // one, see load_map) and the scan adder is never called.
+  bool localization_only = false;
+  // Keyframe gating: a scan is matched and inserted only if the robot
+  // has moved further than keyframe_translation (meters) or has turned
+  // further than keyframe_rotation (radians) since the last handled scan,
+  // or keyframe_max_skipped scans in a row have been skipped (0 - no limit).
+  // The pose of a skipped scan is dead-reckoned by odometry.
+  // NB: the gating is off unless a threshold is positive.
+  double keyframe_translation = 0;
+  double keyframe_rotation = 0;
+  std::size_t keyframe_max_skipped = 0;
+  // Catch-up: a backlog of scans (see handle_sensor_data_batch) is
+  // handled in groups of up to catch_up_group_size scans. Only the newest
+  // scan of a group is matched; the others are placed at their odometry
+  // poses corrected by a share of the match correction proportional to
+  // the distance traveled, and the group is inserted into the map as
+  // a single batch (see GridMapScanAdder::append_scans).
+  // NB: the backlog is handled scan by scan if the size is below 2.
+  std::size_t catch_up_group_size = 0;
 };
 
 template <typename MapT>
 class SingleStateHypothesisLaserScanGridWorld
   : public LaserScanGridWorld<MapT> {
+private: // types
+  /* The queue of scan insertions of a pipelined world.
+   * An insertion writes the map of the world that has queued it,
+   * so a world is copied, moved or overwritten only when its
+   * insertions (and the ones of the copied world) are done.
+   * NB: the queue is the world's first member, i.e. it is copied
+   *     before the map; copies of a world share the worker. */
+  class MappingQueue {
+  public:
+    MappingQueue() = default;
+    MappingQueue(const MappingQueue &that) : _queue{that.idle_queue()} {}
+    MappingQueue(MappingQueue &&that) : _queue{that.idle_queue()} {}
+
+    MappingQueue& operator=(const MappingQueue &that) {
+      wait_for_idle();
+      _queue = that.idle_queue();
+      return *this;
+    }
+
+    MappingQueue& operator=(MappingQueue &&that) {
+      return *this = static_cast<const MappingQueue&>(that);
+    }
+
+    explicit operator bool() const { return bool(_queue); }
+    BoundedTaskQueue *operator->() const { return _queue.get(); }
+
+    void start(std::size_t size) {
+      _queue = std::make_shared<BoundedTaskQueue>(size);
+    }
+
+    void wait_for_idle() const {
+      if (_queue) { _queue->wait_for_idle(); }
+    }
+
+  private:
+    std::shared_ptr<BoundedTaskQueue> idle_queue() const {
+      wait_for_idle();
+      return _queue;
+    }
+
+  private:
+    std::shared_ptr<BoundedTaskQueue> _queue;
+  };
 public:
   using MapType = typename LaserScanGridWorld<MapT>::MapType;
   using Properties = SingleStateHypothesisLSGWProperties;
+public: // consts
+  // a session of another format is rejected (see load_session)
+  static constexpr uint32_t Session_Magic = 0x53534c53; // "SLSS"
+  static constexpr uint32_t Session_Version = 2;
 public:
   SingleStateHypothesisLaserScanGridWorld(const Properties &props)
     : _props{props}
     , _map{_props.cell_prototype->clone(), _props.map_props} {}
 
+  // NB: scans being inserted are waited for (see MappingQueue)
+  SingleStateHypothesisLaserScanGridWorld(
+    const SingleStateHypothesisLaserScanGridWorld&) = default;
+  SingleStateHypothesisLaserScanGridWorld(
+    SingleStateHypothesisLaserScanGridWorld&&) = default;
+  SingleStateHypothesisLaserScanGridWorld& operator=(
+    const SingleStateHypothesisLaserScanGridWorld&) = default;
+  SingleStateHypothesisLaserScanGridWorld& operator=(
+    SingleStateHypothesisLaserScanGridWorld&&) = default;
+
+  ~SingleStateHypothesisLaserScanGridWorld() { wait_for_mapping(); }
+
   // scan matcher access
   auto scan_matcher() { return _props.gsm; }
 
@@ -48,29 +148,378 @@ public:
   // scan adder access
   auto scan_adder() { return _props.gmsa; }
 
+  // NB: matchers and adders keep per-scan state, so copies of a world
+  //     handled in parallel (e.g. hypotheses) need own ones
+  void set_scan_matcher(std::shared_ptr<GridScanMatcher> gsm) {
+    _props.gsm = gsm;
+  }
+
+  void set_scan_adder(std::shared_ptr<GridMapScanAdder> gmsa) {
+    _props.gmsa = gmsa;
+  }
+
+  std::shared_ptr<StageProfiler> stage_profiler() const override {
+    return _props.stage_profiler;
+  }
+
+  // NB: in the pipelined mode the map being inserted into is skipped,
+  //     since it is modified concurrently; the copy shares most tiles.
+  GridMapMemoryUsage maps_memory_usage() const override {
+    return map().memory_usage();
+  }
+
   // state access
-  const MapType& map() const override { return _map; }
-  using LaserScanGridWorld<MapT>::map; // enable non-const map access
+  // NB: in the pipelined mode it is a consistent copy of the map
+  //     that lacks the scans being inserted.
+  const MapType& map() const override { return matching_map(); }
+
+  // NB: it is the map scans are inserted into, so the scans being
+  //     inserted are waited for (see wait_for_mapping).
+  MapType& map() override {
+    wait_for_mapping();
+    return _map;
+  }
+
+  bool is_mapping_pipelined() const {
+    return _props.pipelined_mapping &&
+           std::is_copy_constructible<MapType>::value;
+  }
+
+  // Blocks until the scans being inserted are in the map
+  void wait_for_mapping() override {
+    if (!_mapping_queue) { return; }
+    _mapping_queue.wait_for_idle();
+    adopt_published_map();
+  }
+
+  // Replaces the map with a saved state (see GridMap::save_state) and
+  // builds read-only structures of the map and the matcher up front,
+  // so matching against a frozen map doesn't pay for them per scan.
+  // Returns false if the map rejects the state (the map is kept).
+  bool load_map(const std::vector<char> &state) {
+    wait_for_mapping();
+    if (!_map.load_state(state)) { return false; }
+    _map.prepare_for_reads();
+    if (_matching_map) {
+      refresh_matching_map(std::is_copy_constructible<MapType>{});
+    }
+    scan_matcher()->prepare_map(matching_map());
+    return true;
+  }
+
+  // The state to resume the slam from (e.g. after a restart):
+  // the robot state (see save_robot_state) followed by the map state.
+  // NB: scan matchers keep no state between scans (their caches are
+  //     built from the map), so they are not saved.
+  std::vector<char> save_session() {
+    wait_for_mapping();
+    auto s = Serializer{};
+    s << Session_Magic << Session_Version << uint32_t(sizeof(Real));
+    save_robot_state(s);
+    s.append(_map.save_state());
+    return s.result();
+  }
+
+  // Resumes a session saved by save_session; returns false if the data
+  // is not a session of this build (e.g. of a single-precision one, see Real),
+  // it is truncated or the map rejects its state (the world is kept then).
+  bool load_session(const std::vector<char> &data) {
+    Deserializer d{data};
+    auto magic = d.read_value<uint32_t>();
+    auto version = d.read_value<uint32_t>();
+    auto real_size = d.read_value<uint32_t>();
+    if (d.is_overrun() || magic != Session_Magic ||
+        version != Session_Version || real_size != sizeof(Real) ||
+        data.size() - d.pos() < robot_state_size()) {
+      return false;
+    }
+    wait_for_mapping();
+    // NB: the robot state is of a fixed size, so the map state is loaded
+    //     before it and a rejected session changes nothing
+    auto map_pos = d.pos() + robot_state_size();
+    if (map_pos < data.size() && !_map.load_state(
+          std::vector<char>(data.begin() + map_pos, data.end()))) {
+      return false;
+    }
+    load_robot_state(data, d.pos());
+    _map.prepare_for_reads();
+    if (_matching_map) {
+      refresh_matching_map(std::is_copy_constructible<MapType>{});
+    }
+    scan_matcher()->prepare_map(matching_map());
+    return true;
+  }
+
+  // The pose and the keyframe gating state
+  virtual void save_robot_state(Serializer &s) const {
+    auto &pose = this->pose();
+    s << pose.x << pose.y << pose.theta
+      << _keyframe_pose.x << _keyframe_pose.y << _keyframe_pose.theta
+      << _has_keyframe << uint64_t(_skipped_scans_nm);
+  }
+
+  // The size of a state written by save_robot_state (it is fixed)
+  std::size_t robot_state_size() const {
+    auto s = Serializer{};
+    save_robot_state(s);
+    return s.result().size();
+  }
+
+  // Reads a state written by save_robot_state; returns the position
+  // after it (past the data's end if the state is truncated,
+  // see robot_state_size).
+  virtual std::size_t load_robot_state(const std::vector<char> &data,
+                                       std::size_t pos) {
+    Deserializer d{data, pos};
+    auto pose = RobotPose{};
+    d >> pose.x >> pose.y >> pose.theta
+      >> _keyframe_pose.x >> _keyframe_pose.y >> _keyframe_pose.theta
+      >> _has_keyframe;
+    _skipped_scans_nm = d.read_value<uint64_t>();
+    this->set_pose(pose);
+    return d.pos();
+  }
 
-  // TODO: return scan prob
   virtual void handle_observation(TransformedLaserScan &tr_scan) {
+    if (!is_keyframe()) {
+      ++_skipped_scans_nm;
+      return;
+    }
+    match_scan(tr_scan);
+
+    if (_props.localization_only) { return; }
+    if (!is_mapping_pipelined()) {
+      StageTimer timer{_props.stage_profiler, SlamStage::MapInsertion};
+      scan_adder()->append_scan(_map, this->pose(), tr_scan.scan,
+                                tr_scan.quality, _props.scan_margin);
+      return;
+    }
+
+    start_mapping_worker();
+    _mapping_queue->push(
+      [this, pose = this->pose(), scan = tr_scan.scan,
+       quality = tr_scan.quality]() {
+        // NB: the insertion is measured on the worker
+        StageTimer timer{_props.stage_profiler, SlamStage::MapInsertion};
+        scan_adder()->append_scan(_map, pose, scan, quality,
+                                  _props.scan_margin);
+        publish_map(std::is_copy_constructible<MapType>{});
+      });
+  }
+
+  // PERFORMANCE: a backlog costs a match per group of scans instead of
+  //              a match per scan (see catch_up_group_size).
+  void handle_sensor_data_batch(
+      std::vector<TransformedLaserScan> &batch) override {
+    auto group_size = _props.catch_up_group_size;
+    if (group_size < 2) {
+      LaserScanGridWorld<MapT>::handle_sensor_data_batch(batch);
+      return;
+    }
+
+    for (std::size_t begin = 0; begin < batch.size(); begin += group_size) {
+      auto end = std::min(begin + group_size, batch.size());
+      if (end - begin == 1) {
+        this->handle_sensor_data(batch[begin]);
+        continue;
+      }
+      catch_up(batch, begin, end);
+      // NB: the newest pose is published with the map
+      for (std::size_t i = 0; i + 1 < _catch_up_poses.size(); ++i) {
+        this->notify_with_pose(_catch_up_poses[i]);
+      }
+      this->finish_sensor_data_handling();
+    }
+  }
+
+  // The number of scans skipped in a row by the keyframe gating
+  std::size_t skipped_scans_nm() const { return _skipped_scans_nm; }
+
+  // The probability of the last matched scan at the found pose
+  // (see GridScanMatcher::process_scan)
+  double last_scan_probability() const { return _last_scan_prob; }
+
+private: // methods
+
+  // Matches the scan at the current pose and sets its quality
+  void match_scan(TransformedLaserScan &tr_scan) {
+    adopt_published_map();
     auto sm = scan_matcher();
+    auto profiler = _props.stage_profiler.get();
+    if (profiler && !tr_scan.scan.prefiltered()) {
+      // NB: the matcher reuses the prefiltered scan (the result is the
+      //     same), so filtering is measured apart from matching
+      StageTimer timer{profiler, SlamStage::ScanFiltering};
+      sm->prefilter_scan(tr_scan.scan);
+    }
     sm->reset_state();
 
     auto pose_delta = RobotPoseDelta{};
-    sm->process_scan(tr_scan, this->pose(), this->map(), pose_delta);
+    {
+      StageTimer timer{profiler, SlamStage::ScanMatching};
+      _last_scan_prob = sm->process_scan(tr_scan, this->pose(), matching_map(),
+                                         pose_delta);
+    }
     this->update_robot_pose(pose_delta);
+    _keyframe_pose = this->pose();
+    _has_keyframe = true;
+    _skipped_scans_nm = 0;
 
     tr_scan.quality = pose_delta ? _props.localized_scan_quality
                                  : _props.raw_scan_quality;
+    if (pose_delta && !sm->last_match_is_converged()) {
+      tr_scan.quality *= _props.truncated_scan_quality_factor;
+    }
+  }
+
+  // Handles scans [begin, end) of the batch as a group
+  // (see catch_up_group_size); poses of the scans are kept
+  // in _catch_up_poses.
+  void catch_up(std::vector<TransformedLaserScan> &batch,
+                std::size_t begin, std::size_t end) {
+    _catch_up_poses.clear();
+    _catch_up_path.clear();
+    auto translation = double{0}, rotation = double{0};
+    for (std::size_t i = begin; i < end; ++i) {
+      auto &delta = batch[i].pose_delta;
+      this->update_robot_pose(delta);
+      _catch_up_poses.push_back(this->pose());
+      translation += std::sqrt(delta.sq_dist());
+      rotation += std::fabs(delta.theta);
+      _catch_up_path.emplace_back(translation, rotation);
+    }
+    if (!is_keyframe()) {
+      _skipped_scans_nm += end - begin;
+      return;
+    }
+
+    auto &newest = batch[end - 1];
+    auto odometry_pose = this->pose();
+    match_scan(newest);
+    auto correction = this->pose() - odometry_pose;
+    auto scans_nm = end - begin;
+    for (std::size_t i = 0; i < scans_nm; ++i) {
+      // the share of the path to the scan; a turn in place is measured
+      // by rotation, no motion at all - by the scan index
+      auto &path = _catch_up_path[i];
+      auto share = 0 < translation ? path.first / translation :
+                   0 < rotation    ? path.second / rotation :
+                                     double(i + 1) / scans_nm;
+      _catch_up_poses[i] += RobotPoseDelta{correction.x * share,
+                                           correction.y * share,
+                                           correction.theta * share};
+      batch[begin + i].quality = newest.quality;
+    }
+    // NB: the newest pose is exactly the matched one
+    _catch_up_poses.back() = this->pose();
+
+    if (_props.localization_only) { return; }
+    if (!is_mapping_pipelined()) {
+      StageTimer timer{_props.stage_profiler, SlamStage::MapInsertion};
+      scan_adder()->append_scans(
+        _map, posed_scans(&batch[begin], _catch_up_poses),
+        _props.scan_margin);
+      return;
+    }
+
+    start_mapping_worker();
+    _mapping_queue->push(
+      [this, poses = _catch_up_poses,
+       scans = std::vector<TransformedLaserScan>(batch.begin() + begin,
+                                                 batch.begin() + end)]() {
+        StageTimer timer{_props.stage_profiler, SlamStage::MapInsertion};
+        scan_adder()->append_scans(_map, posed_scans(scans.data(), poses),
+                                   _props.scan_margin);
+        publish_map(std::is_copy_constructible<MapType>{});
+      });
+  }
+
+  static std::vector<PosedLaserScan> posed_scans(
+      const TransformedLaserScan *scans, const std::vector<RobotPose> &poses) {
+    auto posed = std::vector<PosedLaserScan>{};
+    posed.reserve(poses.size());
+    for (std::size_t i = 0; i < poses.size(); ++i) {
+      posed.push_back({poses[i], &scans[i].scan, scans[i].quality});
+    }
+    return posed;
+  }
 
-    scan_adder()->append_scan(_map, this->pose(), tr_scan.scan,
-                              tr_scan.quality, _props.scan_margin);
+  void start_mapping_worker() {
+    if (_mapping_queue) { return; }
+    // the worker has not touched the map yet, so it is copied here
+    refresh_matching_map(std::is_copy_constructible<MapType>{});
+    _mapping_queue.start(_props.mapping_queue_size);
   }
 
+  // PERFORMANCE: a skipped scan costs a pose subtraction,
+  //              i.e. an idle robot doesn't match and map the same view.
+  bool is_keyframe() const {
+    auto transl_gate = _props.keyframe_translation;
+    auto rot_gate = _props.keyframe_rotation;
+    if (!_has_keyframe || (transl_gate <= 0 && rot_gate <= 0)) {
+      return true;
+    }
+    auto max_skipped = _props.keyframe_max_skipped;
+    if (max_skipped && max_skipped <= _skipped_scans_nm) { return true; }
+
+    auto delta = this->pose() - _keyframe_pose;
+    auto rotation = std::fabs(std::remainder(delta.theta, 2 * M_PI));
+    return transl_gate * transl_gate < delta.sq_dist() ||
+           rot_gate < rotation;
+  }
+
+  void refresh_matching_map(std::true_type) {
+    _matching_map = std::make_shared<const MapType>(_map);
+  }
+
+  void refresh_matching_map(std::false_type) {}
+
+  // called by the mapping worker
+  void publish_map(std::true_type) {
+    std::atomic_store(&_published_map,
+                      std::make_shared<const MapType>(_map));
+  }
+
+  void publish_map(std::false_type) {}
+
+  const MapType& matching_map() const {
+    return _matching_map ? *_matching_map : _map;
+  }
+
+  // NB: _matching_map is replaced on the matching thread only,
+  //     so map() references stay valid until the next observation
+  void adopt_published_map() {
+    auto published = std::atomic_exchange(&_published_map,
+                                          std::shared_ptr<const MapType>{});
+    if (published) { _matching_map = std::move(published); }
+  }
+
+private:
+  // NB: the first member (see MappingQueue)
+  MappingQueue _mapping_queue;
 protected:
   Properties _props;
   MapType _map;
+private:
+  std::shared_ptr<const MapType> _matching_map;
+  std::shared_ptr<const MapType> _published_map;
+  // keyframe gating
+  RobotPose _keyframe_pose;
+  bool _has_keyframe = false;
+  std::size_t _skipped_scans_nm = 0;
+  double _last_scan_prob = 0;
+  // catch-up buffers reused by groups
+  std::vector<RobotPose> _catch_up_poses;
+  // (translation, rotation) traveled to a scan of the group
+  std::vector<std::pair<double, double>> _catch_up_path;
 };
 
+template <typename MapT>
+constexpr uint32_t
+SingleStateHypothesisLaserScanGridWorld<MapT>::Session_Magic;
+
+template <typename MapT>
+constexpr uint32_t
+SingleStateHypothesisLaserScanGridWorld<MapT>::Session_Version;
+
 #endif
@@ -5,11 +5,11 @@
 #include "../geometry_utils.h"
 
 struct Occupancy {
-  double prob_occ;
-  double estimation_quality;
+  Real prob_occ;
+  Real estimation_quality;
 
   // TODO: is NaN better for as a dflt value?
-  constexpr Occupancy(double prob = 0, double quality = 0)
+  constexpr Occupancy(Real prob = 0, Real quality = 0)
     : prob_occ(prob), estimation_quality(quality) {}
 
   operator double() const { return prob_occ; }
@@ -25,8 +25,8 @@ struct Occupancy {
   }
 
   static Occupancy invalid() {
-    static Occupancy invalid{std::numeric_limits<double>::quiet_NaN(),
-                             std::numeric_limits<double>::quiet_NaN()};
+    static Occupancy invalid{std::numeric_limits<Real>::quiet_NaN(),
+                             std::numeric_limits<Real>::quiet_NaN()};
     return invalid;
   }
 
@@ -2,6 +2,7 @@
 #define SLAM_CTOR_CORE_WORLD_H_INCLUDED
 
 #include <memory>
+#include <vector>
 
 #include "robot_pose.h"
 
@@ -9,6 +10,11 @@ template <typename SensorData>
 class SensorDataObserver {
 public:
   virtual void handle_sensor_data(SensorData &) = 0;
+  // Handles data that has been queued (e.g. by an observer that lags
+  // behind the data source) in the arrival order.
+  virtual void handle_sensor_data_batch(std::vector<SensorData> &batch) {
+    for (auto &data : batch) { handle_sensor_data(data); }
+  }
   // No virtual dtor, since a descendant is not suppoused to be
   // destroyed via a pointer to the class
 };
@@ -81,7 +87,9 @@ public:
   virtual const RobotPose& pose() const { return _pose; }
   virtual const MapType& map() const = 0;
 
-  MapType& map() {
+  // NB: worlds whose const map is not the one they modify (e.g. a copy
+  //     that is shared with readers) are expected to override it.
+  virtual MapType& map() {
     return const_cast<MapType&>(
       // TODO: try to use decltype
       static_cast<const World<ObservationType, MapT>*>(this)->map()
@@ -90,6 +98,9 @@ public:
 protected:
   virtual void handle_observation(ObservationType&) = 0;
   virtual ~World() = default;
+
+  // E.g. on a restore of a saved state
+  void set_pose(const RobotPose &pose) { _pose = pose; }
 private:
   RobotPose _pose;
 };
@@ -0,0 +1,297 @@
+#ifndef SLAM_CTOR_CORE_THREAD_POOL_H
+#define SLAM_CTOR_CORE_THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* A pool of worker threads that parallel stages of slams share
+ * (see ThreadPool::shared), so independent stages don't oversubscribe
+ * cores with own threads.
+ * Each worker has a queue of tasks; a worker runs its own tasks in LIFO
+ * order (they are hot in cache) and steals the oldest tasks of other
+ * workers when it runs out of them. A thread that waits for tasks
+ * (see TaskGroup::wait) runs queued tasks meanwhile, so nested parallel
+ * stages (e.g. a parallel matching of a particle of a parallel filter)
+ * don't deadlock and don't add threads.
+ * NB: a task is not expected to throw. */
+class ThreadPool {
+public: // types
+  using Task = std::function<void()>;
+public:
+  // NB: threads_nm includes the caller, i.e. threads_nm - 1 workers
+  //     are started; a worker i is pinned to the core i + 1 if requested.
+  explicit ThreadPool(unsigned threads_nm = default_threads_nm(),
+                      bool pin_to_cores = false)
+    : _is_pinned{pin_to_cores} {
+    auto workers_nm = std::max(threads_nm, 1u) - 1;
+    for (unsigned i = 0; i < workers_nm; ++i) {
+      _queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (unsigned i = 0; i < workers_nm; ++i) {
+      _workers.emplace_back(&ThreadPool::run_worker, this, i);
+      if (pin_to_cores) { pin_to_core(_workers.back(), i + 1); }
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // NB: queued tasks are completed before workers stop
+  ~ThreadPool() {
+    {
+      auto lock = std::unique_lock<std::mutex>{_sleep_mutex};
+      _is_stopped = true;
+    }
+    _has_work.notify_all();
+    for (auto &worker : _workers) { worker.join(); }
+  }
+
+  static unsigned default_threads_nm() {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  unsigned threads_nm() const { return _workers.size() + 1; }
+
+  // Calls action(i) for each i in [0, n) by at most max_threads_nm
+  // threads (0 - all threads of the pool) including the caller;
+  // returns once all calls are done.
+  // PERFORMANCE: indices are taken one by one by the threads, so threads
+  //              that have got cheap indices take more of them.
+  template <typename Action>
+  void parallel_for(std::size_t n, Action &&action,
+                    unsigned max_threads_nm = 0) {
+    auto threads_nm = std::min<std::size_t>(
+      n, max_threads_nm ? std::min(max_threads_nm, this->threads_nm())
+                        : this->threads_nm());
+    if (threads_nm < 2) {
+      for (std::size_t i = 0; i < n; ++i) { action(i); }
+      return;
+    }
+
+    std::atomic<std::size_t> next_i{0};
+    auto run_indices = [&action, &next_i, n]() {
+      for (auto i = next_i++; i < n; i = next_i++) { action(i); }
+    };
+    auto helpers_nm = threads_nm - 1;
+    std::atomic<std::size_t> pending_nm{helpers_nm};
+    for (std::size_t i = 0; i < helpers_nm; ++i) {
+      submit([this, &run_indices, &pending_nm]() {
+        run_indices();
+        finish_task(pending_nm);
+      });
+    }
+    run_indices();
+    wait_for(pending_nm);
+  }
+
+  // Queues the task; it is run by a worker or by a waiting thread
+  void submit(Task task) {
+    if (_queues.empty()) {
+      task();
+      return;
+    }
+    auto &worker = current_worker();
+    auto queue_i = worker.pool == this ? worker.queue_i
+                                       : _next_queue_i++ % _queues.size();
+    // NB: the task is counted before it is queued, so the counter
+    //     is never below the number of queued tasks
+    {
+      auto lock = std::unique_lock<std::mutex>{_sleep_mutex};
+      ++_queued_nm;
+    }
+    auto &queue = *_queues[queue_i];
+    {
+      auto lock = std::unique_lock<std::mutex>{queue.mutex};
+      queue.tasks.push_back(std::move(task));
+    }
+    _has_work.notify_all();
+  }
+
+  // Decrements the counter of unfinished tasks a thread waits for
+  // (see wait_for) and wakes the thread up
+  void finish_task(std::atomic<std::size_t> &pending_nm) {
+    {
+      auto lock = std::unique_lock<std::mutex>{_sleep_mutex};
+      --pending_nm;
+    }
+    _has_work.notify_all();
+  }
+
+  // Runs queued tasks until the counter of unfinished tasks is zero;
+  // sleeps while the tasks are run by other threads
+  void wait_for(const std::atomic<std::size_t> &pending_nm) {
+    while (pending_nm != 0) {
+      if (try_run_task()) { continue; }
+      auto lock = std::unique_lock<std::mutex>{_sleep_mutex};
+      _has_work.wait(lock, [this, &pending_nm]() {
+        return pending_nm == 0 || _queued_nm != 0;
+      });
+    }
+  }
+
+  // The pool parallel stages of slams share (see configure_shared)
+  static std::shared_ptr<ThreadPool> shared() {
+    auto lock = std::unique_lock<std::mutex>{shared_mutex()};
+    auto &pool = shared_pool();
+    if (!pool) { pool = std::make_shared<ThreadPool>(); }
+    return pool;
+  }
+
+  // NB: the shared pool is process-wide, so it is expected to be
+  //     configured on start; stages that run on the previous pool
+  //     finish on it.
+  static void configure_shared(unsigned threads_nm, bool pin_to_cores) {
+    threads_nm = threads_nm ? threads_nm : default_threads_nm();
+    auto lock = std::unique_lock<std::mutex>{shared_mutex()};
+    auto &pool = shared_pool();
+    if (pool && pool->threads_nm() == threads_nm &&
+        pool->_is_pinned == pin_to_cores) {
+      return;
+    }
+    // NB: a replaced pool is kept till the exit rather than destroyed
+    //     by its last user, which may be a worker of the pool itself
+    //     (a nested stage), i.e. the worker would join itself.
+    if (pool) { retired_pools().push_back(std::move(pool)); }
+    pool = std::make_shared<ThreadPool>(threads_nm, pin_to_cores);
+  }
+
+private: // types
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  struct WorkerId {
+    const ThreadPool *pool = nullptr;
+    std::size_t queue_i = 0;
+  };
+
+private: // methods
+
+  static WorkerId &current_worker() {
+    static thread_local WorkerId worker;
+    return worker;
+  }
+
+  static std::mutex &shared_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::shared_ptr<ThreadPool> &shared_pool() {
+    static std::shared_ptr<ThreadPool> pool;
+    return pool;
+  }
+
+  static std::vector<std::shared_ptr<ThreadPool>> &retired_pools() {
+    static std::vector<std::shared_ptr<ThreadPool>> pools;
+    return pools;
+  }
+
+  static void pin_to_core(std::thread &thread, unsigned core_i) {
+#ifdef __linux__
+    auto cpu_set = cpu_set_t{};
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core_i % default_threads_nm(), &cpu_set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set),
+                           &cpu_set);
+#else
+    (void)thread;
+    (void)core_i;
+#endif
+  }
+
+  // Runs a task of the current worker's queue or steals one;
+  // returns false if there are no queued tasks
+  bool try_run_task() {
+    auto task = Task{};
+    auto &worker = current_worker();
+    auto own_i = worker.pool == this ? worker.queue_i : 0;
+    for (std::size_t i = 0; i < _queues.size() && !task; ++i) {
+      auto queue_i = (own_i + i) % _queues.size();
+      auto &queue = *_queues[queue_i];
+      auto lock = std::unique_lock<std::mutex>{queue.mutex};
+      if (queue.tasks.empty()) { continue; }
+      bool is_own = worker.pool == this && queue_i == own_i;
+      if (is_own) {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    if (!task) { return false; }
+    --_queued_nm;
+    task();
+    return true;
+  }
+
+  void run_worker(std::size_t queue_i) {
+    current_worker() = WorkerId{this, queue_i};
+    while (true) {
+      if (try_run_task()) { continue; }
+      auto lock = std::unique_lock<std::mutex>{_sleep_mutex};
+      _has_work.wait(lock, [this]() {
+        return _is_stopped || _queued_nm != 0;
+      });
+      if (_is_stopped && _queued_nm == 0) { return; }
+    }
+  }
+
+private: // fields
+  std::vector<std::unique_ptr<TaskQueue>> _queues;
+  std::vector<std::thread> _workers;
+  std::atomic<std::size_t> _next_queue_i{0};
+  // NB: counters are changed under the mutex, so a sleeping thread
+  //     doesn't miss a wakeup
+  std::atomic<std::size_t> _queued_nm{0};
+  std::mutex _sleep_mutex;
+  std::condition_variable _has_work;
+  bool _is_stopped = false;
+  bool _is_pinned;
+};
+
+/* Tasks that are waited for together (e.g. stages of a scan) */
+class TaskGroup {
+public:
+  explicit TaskGroup(std::shared_ptr<ThreadPool> pool = ThreadPool::shared())
+    : _pool{std::move(pool)} {}
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  ~TaskGroup() { wait(); }
+
+  template <typename Function>
+  void run(Function &&f) {
+    ++_pending_nm;
+    _pool->submit([this, f = std::forward<Function>(f)]() mutable {
+      f();
+      _pool->finish_task(_pending_nm);
+    });
+  }
+
+  // NB: the caller runs queued tasks while it waits
+  void wait() { _pool->wait_for(_pending_nm); }
+
+private:
+  std::shared_ptr<ThreadPool> _pool;
+  std::atomic<std::size_t> _pending_nm{0};
+};
+
+#endif
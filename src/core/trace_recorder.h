@@ -0,0 +1,175 @@
+#ifndef SLAM_CTOR_CORE_TRACE_RECORDER_H
+#define SLAM_CTOR_CORE_TRACE_RECORDER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Records begin/end events of the slam pipeline (stages, scan matcher
+ * rounds, map growth) tagged with a scan id and a thread id and writes them
+ * as a Chrome trace JSON that is opened by chrome://tracing and
+ * the Perfetto UI (ui.perfetto.dev).
+ * Events are recorded by the active recorder (see install/TraceScope),
+ * so deeply nested code (e.g. maps) is traced without passing
+ * the recorder around.
+ * NB: a scan id is the one of the scan that is handled at the event start
+ *     (see TraceScan), so events of background tasks (e.g. a pipelined
+ *     map update) may be tagged with a later scan.
+ * PERFORMANCE: a traced scope costs an atomic load if tracing is
+ *              disabled; an enabled recorder keeps events in memory
+ *              (up to the limit) and writes them on destruction. */
+class TraceRecorder {
+private: // types
+  using Clock = std::chrono::steady_clock;
+
+  struct Event {
+    const char *name, *category;
+    double ts_us, dur_us;
+    unsigned tid;
+    uint64_t scan_id;
+  };
+public:
+  TraceRecorder(const std::string &fname,
+                std::size_t max_events_nm = 1000000)
+    : _fname{fname}, _max_events_nm{max_events_nm}, _start{Clock::now()} {
+    _events.reserve(std::min<std::size_t>(_max_events_nm, 1 << 16));
+  }
+
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+  ~TraceRecorder() { write(); }
+
+  // The recorder events are recorded to (null if tracing is disabled)
+  static TraceRecorder *active() {
+    return active_slot().load(std::memory_order_acquire);
+  }
+
+  // Makes the recorder active; the recorder is kept till the exit
+  // NB: the first installed recorder is kept (e.g. by a sweep of slam
+  //     configurations in a single process), so the others are ignored.
+  static bool install(std::unique_ptr<TraceRecorder> recorder) {
+    static std::unique_ptr<TraceRecorder> installed;
+    static std::mutex install_mutex;
+    auto lock = std::unique_lock<std::mutex>{install_mutex};
+    if (installed) { return false; }
+    installed = std::move(recorder);
+    active_slot().store(installed.get(), std::memory_order_release);
+    return true;
+  }
+
+  Clock::time_point now() const { return Clock::now(); }
+
+  uint64_t scan_id() const {
+    return _scan_id.load(std::memory_order_relaxed);
+  }
+
+  uint64_t start_scan() {
+    return _scan_id.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // NB: the name and the category are expected to be string literals
+  void add(const char *name, const char *category, Clock::time_point start,
+           Clock::time_point end, uint64_t scan_id) {
+    auto event = Event{name, category, to_us(start - _start),
+                       to_us(end - start), thread_id(), scan_id};
+    auto lock = std::unique_lock<std::mutex>{_events_mutex};
+    if (_events.size() == _max_events_nm) {
+      ++_dropped_events_nm;
+      return;
+    }
+    _events.push_back(event);
+  }
+
+  std::size_t events_nm() const {
+    auto lock = std::unique_lock<std::mutex>{_events_mutex};
+    return _events.size();
+  }
+
+  // Writes recorded events to the file (is called on destruction)
+  bool write() {
+    auto lock = std::unique_lock<std::mutex>{_events_mutex};
+    auto os = std::ofstream{_fname};
+    os << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":"
+       << _dropped_events_nm << "},\"traceEvents\":[";
+    os.precision(3);
+    os << std::fixed;
+    for (std::size_t i = 0; i < _events.size(); ++i) {
+      auto &e = _events[i];
+      os << (i ? ",\n" : "\n") << "{\"name\":\"" << e.name
+         << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"ts\":"
+         << e.ts_us << ",\"dur\":" << e.dur_us << ",\"pid\":1,\"tid\":"
+         << e.tid << ",\"args\":{\"scan\":" << e.scan_id << "}}";
+    }
+    os << "\n]}\n";
+    return bool(os);
+  }
+
+private: // methods
+  static std::atomic<TraceRecorder*> &active_slot() {
+    static std::atomic<TraceRecorder*> recorder{nullptr};
+    return recorder;
+  }
+
+  // Small sequential ids are readable in trace viewers
+  static unsigned thread_id() {
+    static std::atomic<unsigned> next_id{0};
+    thread_local unsigned id = next_id.fetch_add(1) + 1;
+    return id;
+  }
+
+  static double to_us(Clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+  }
+
+private: // fields
+  std::string _fname;
+  std::size_t _max_events_nm, _dropped_events_nm = 0;
+  Clock::time_point _start;
+  std::atomic<uint64_t> _scan_id{0};
+  mutable std::mutex _events_mutex;
+  std::vector<Event> _events;
+};
+
+// Traces a scope from the construction to the destruction
+// Client code example:
+//   TraceScope trace{"ensure_inside", "map"};
+class TraceScope {
+public:
+  TraceScope(const char *name, const char *category)
+    : _recorder{TraceRecorder::active()}, _name{name}, _category{category} {
+    if (!_recorder) { return; }
+    _scan_id = _recorder->scan_id();
+    _start = _recorder->now();
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  ~TraceScope() {
+    if (!_recorder) { return; }
+    _recorder->add(_name, _category, _start, _recorder->now(), _scan_id);
+  }
+
+protected: // fields
+  TraceRecorder *_recorder;
+  const char *_name, *_category;
+  uint64_t _scan_id = 0;
+  std::chrono::steady_clock::time_point _start;
+};
+
+// Traces handling of a new scan; the scan id tags events of the handling
+class TraceScan : public TraceScope {
+public:
+  TraceScan() : TraceScope{"scan", "slam"} {
+    if (_recorder) { _scan_id = _recorder->start_scan(); }
+  }
+};
+
+#endif
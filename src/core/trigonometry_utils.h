@@ -2,22 +2,46 @@
 #define SLAM_CTOR_CORE_TRIGONOMETRY_UTILS_H
 
 #include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
 #include <cmath>
 
 // NB: polymorphic-provider soluction is cleaner from the OOP PoV.
 //     in case of performance issues related to 'virtual calls'
 //     can be replaced with 'ifs' in clients.
+struct SinCos {
+  double sin, cos;
+};
+
 class TrigonometryProvider {
 public:
+  virtual ~TrigonometryProvider() = default;
+
+  // A provider with the same state that may be used independently
+  // (e.g. by scans that are handled concurrently)
+  virtual std::shared_ptr<TrigonometryProvider> clone() const = 0;
+
   virtual double sin(double angle_rad) const = 0;
   virtual double cos(double angle_rad) const = 0;
   virtual void set_base_angle(double angle_rad) = 0;
+
+  // Both functions of an angle with one call. The angle index (if known,
+  // i.e. not negative) identifies the angle in a regular angle grid of
+  // a sensor, so a provider that caches the grid does not recover it.
+  virtual SinCos sin_cos(double angle_rad, int /*angle_idx*/ = -1) const {
+    return {sin(angle_rad), cos(angle_rad)};
+  }
 };
 
 class RawTrigonometryProvider : public TrigonometryProvider {
 public:
   RawTrigonometryProvider() : _base_angle{0} {}
 
+  std::shared_ptr<TrigonometryProvider> clone() const override {
+    return std::make_shared<RawTrigonometryProvider>(*this);
+  }
+
   double sin(double angle_rad) const override {
     return std::sin(_base_angle + angle_rad);
   }
@@ -34,24 +58,81 @@ private:
   double _base_angle;
 };
 
+// sin/cos of a regular angle grid [angle_min, angle_max) with angle_delta step
+struct TrigonometryTable {
+  TrigonometryTable(double a_min, double a_max, double a_inc)
+    : angle_min{a_min}, angle_max{a_max}, angle_delta{a_inc} {
+    int angles_nm = (angle_max - angle_min) / angle_delta + 1;
+    sin.reserve(angles_nm);
+    cos.reserve(angles_nm);
+    for(double angle = angle_min; angle < angle_max; angle += angle_delta) {
+      sin.push_back(std::sin(angle));
+      cos.push_back(std::cos(angle));
+    }
+  }
+
+  bool matches(double a_min, double a_max, double a_inc) const {
+    return a_min == angle_min && a_max == angle_max && a_inc == angle_delta;
+  }
+
+  int angle_idx(double angle_rad) const {
+    // std::round is crucial to deal with inaccurate fp values
+    return std::round((angle_rad - angle_min) / angle_delta);
+  }
+
+  const double angle_min, angle_max, angle_delta;
+  std::vector<double> sin, cos;
+};
+
+/* Shares trigonometry tables of angle grids, so tables of a sensor are
+ * computed once and not per scan.
+ * NB: a provider has a base angle, i.e. a state, so it is not shared
+ *     (e.g. a scan is matched and inserted into a map concurrently). */
+class TrigonometryTableRegistry {
+public:
+  using TablePtr = std::shared_ptr<const TrigonometryTable>;
+
+  TablePtr table(double a_min, double a_max, double a_inc) {
+    auto key = std::make_tuple(a_min, a_max, a_inc);
+    auto &table = _tables[key];
+    if (!table) {
+      table = std::make_shared<const TrigonometryTable>(a_min, a_max, a_inc);
+    }
+    return table;
+  }
+
+private:
+  std::map<std::tuple<double, double, double>, TablePtr> _tables;
+};
+
 class CachedTrigonometryProvider : public TrigonometryProvider {
 public:
-  CachedTrigonometryProvider()
-    : _sin_base(0), _cos_base(0)
-    , _angle_min(0), _angle_max(0), _angle_delta(0) {
+  using TablePtr = TrigonometryTableRegistry::TablePtr;
+
+  CachedTrigonometryProvider(TablePtr table = nullptr)
+    : _table{std::move(table)}, _sin_base(0), _cos_base(0) {
     set_base_angle(0); // 'virtual call' is not virtual here, but it's ok.
   }
 
+  // NB: the table is shared by clones
+  std::shared_ptr<TrigonometryProvider> clone() const override {
+    return std::make_shared<CachedTrigonometryProvider>(*this);
+  }
+
   double sin(double angle_rad) const override {
-    // std::round is crucial to deal with inaccurate fp values
-    int angle_idx = std::round((angle_rad - _angle_min) / _angle_delta);
-    return _sin_base * _cos[angle_idx] + _cos_base * _sin[angle_idx];
+    return sin_cos(angle_rad).sin;
   }
 
   double cos(double angle_rad) const override {
-    // std::round is crucial to deal with inaccurate fp values
-    int angle_idx = std::round((angle_rad - _angle_min) / _angle_delta);
-    return _cos_base * _cos[angle_idx] - _sin_base * _sin[angle_idx];
+    return sin_cos(angle_rad).cos;
+  }
+
+  SinCos sin_cos(double angle_rad, int angle_idx = -1) const override {
+    if (angle_idx < 0) {
+      angle_idx = _table->angle_idx(angle_rad);
+    }
+    auto s = _table->sin[angle_idx], c = _table->cos[angle_idx];
+    return {_sin_base * c + _cos_base * s, _cos_base * c - _sin_base * s};
   }
 
   void set_base_angle(double angle_rad) override {
@@ -60,27 +141,15 @@ public:
   }
 
   void update(double a_min, double a_max, double a_inc) {
-    if (a_min == _angle_min && a_max == _angle_max && a_inc == _angle_delta)
-      return;
-    _sin.clear();
-    _cos.clear();
-    _angle_min = a_min;
-    _angle_max = a_max;
-    _angle_delta = a_inc;
-
-    int angles_nm = (_angle_max - _angle_min) / _angle_delta + 1;
-    _sin.reserve(angles_nm);
-    _cos.reserve(angles_nm);
-    for(double angle = _angle_min; angle < _angle_max; angle += _angle_delta) {
-      _sin.push_back(std::sin(angle));
-      _cos.push_back(std::cos(angle));
-    }
+    if (_table && _table->matches(a_min, a_max, a_inc)) { return; }
+    _table = std::make_shared<const TrigonometryTable>(a_min, a_max, a_inc);
   }
 
+  void update(TablePtr table) { _table = std::move(table); }
+
 private:
-  std::vector<double> _sin, _cos;
+  TablePtr _table;
   double _sin_base, _cos_base;
-  double _angle_min, _angle_max, _angle_delta;
 };
 
 #endif
@@ -0,0 +1,47 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <sensor_msgs/LaserScan.h>
+
+#include "init_utils.h"
+#include "bag_topic_with_transform.h"
+#include "decoded_scans.h"
+#include "../utils/properties_providers.h"
+
+// Extracts laser scans synchronized with odometry from a bag to
+// a scan log that is replayed by lslam2D_bag_runner without ROS decoding.
+int main(int argc, char** argv) {
+  if (argc != 3 && !(argc == 5 && std::string{argv[3]} == "-p")) {
+    std::cout << "Args: <bag file> <scan log file> "
+              << "[-p <properties file>]" << std::endl;
+    std::exit(-1);
+  }
+
+  auto props = FilePropertiesProvider{};
+  if (argc == 5) { props.append_file_content(argv[4]); }
+
+  ros::Time::init();
+  BagTopicWithTransform<sensor_msgs::LaserScan> bag{
+    argv[1], laser_scan_2D_ros_topic_name(props),
+    props.get_str("in/odometry/ros/tf/name", "/tf"),
+    tf_odom_frame_id(props)
+  };
+  bag.set_tf_ignores(tf_ignored_transforms(props));
+
+  auto log = ScanLogWriter{argv[2]};
+  auto records_nm = unsigned{0};
+  while (log.is_valid() && bag.extract_next_msg()) {
+    auto &msg = *bag.msg();
+    log.add_record(scan_log_record_header(msg, bag.transform()),
+                   msg.ranges.data());
+    ++records_nm;
+  }
+
+  if (!log.is_valid()) {
+    std::cerr << "[Error] Unable to write " << argv[2] << std::endl;
+    std::exit(-1);
+  }
+  std::cout << "Scans written: " << records_nm << std::endl;
+  return 0;
+}
@@ -15,22 +15,26 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include "tf_chain_interpolator.h"
+
 template <typename MsgType>
 class BagTopicWithTransform {
+public: // types
+  using Transforms = std::unordered_map<std::string, std::vector<std::string>>;
 protected:
   using vstr = std::vector<std::string>;
-  using Transforms = std::unordered_map<std::string, std::vector<std::string>>;
 public:
   BagTopicWithTransform(const std::string &bag_fname,
                         const std::string &topic_name,
                         const std::string &tf_topic_name,
-                        const std::string &target_frame)
+                        const std::string &target_frame,
+                        double tf_window_sec = 10.0)
     : _topic_name{topic_name}, _tf_topic_name{tf_topic_name}
     , _target_frame{target_frame}
     , _bag{bag_fname}
     , _view{_bag, rosbag::TopicQuery{vstr{_topic_name, _tf_topic_name}}}
     , _view_iter{_view.begin()}
-    , _tf_cache{true, ros::Duration{1000.0}} {}
+    , _tf_cache{tf_window_sec} {}
 
   ~BagTopicWithTransform() {
     _bag.close();
@@ -59,7 +63,7 @@ public:
           }
           tf::StampedTransform st;
           tf::transformStampedMsgToTF(t, st);
-          _tf_cache.setTransform(st);
+          _tf_cache.add_transform(st);
         }
       }
       if (has_synced_msg()) { return true; }
@@ -94,21 +98,14 @@ private:
     auto frame_id = FrameId<MsgType>::value(*msg);
     auto time = TimeStamp<MsgType>::value(*msg);
     tf::StampedTransform transform;
-    try {
-      _tf_cache.lookupTransform(_target_frame, frame_id, time, transform);
-    } catch (const tf::ExtrapolationException &e) {
-      auto reason = std::string{e.what()};
-      if (reason.find("extrapolation into the future") != std::string::npos) {
-        // ok, wait for tf transforms
-        return false;
-      }
-
-      std::cout << "[WARN][BagTopic] ";
-      if (reason.find("past") != std::string::npos) {
-         _msg_cache.pop();
-         std::cout << "Scan dropped. ";
-      }
-      std::cout << reason << std::endl;;
+    using LookupStatus = TfChainInterpolator::LookupStatus;
+    switch (_tf_cache.lookup(_target_frame, frame_id, time, transform)) {
+    case LookupStatus::Ok: break;
+    case LookupStatus::NotReady: return false; // wait for tf transforms
+    case LookupStatus::Expired:
+      _msg_cache.pop();
+      std::cout << "[WARN][BagTopic] Scan dropped. "
+                << "No transforms for its time." << std::endl;
       return false;
     }
 
@@ -125,7 +122,7 @@ private:
   rosbag::View::const_iterator _view_iter;
 
   Transforms _tf_ignores;
-  tf::Transformer _tf_cache;
+  TfChainInterpolator _tf_cache;
   std::queue<boost::shared_ptr<MsgType>> _msg_cache;
 
   boost::shared_ptr<MsgType> _msg;
@@ -0,0 +1,69 @@
+#ifndef SLAM_CTOR_ROS_DECODED_SCANS_H
+#define SLAM_CTOR_ROS_DECODED_SCANS_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sensor_msgs/LaserScan.h>
+#include <boost/shared_ptr.hpp>
+#include <tf/tf.h>
+
+#include "../utils/scan_log.h"
+
+inline ScanLogRecordHeader scan_log_record_header(
+    const sensor_msgs::LaserScan &msg, const tf::StampedTransform &t) {
+  auto header = ScanLogRecordHeader{};
+  header.sec = msg.header.stamp.sec;
+  header.nsec = msg.header.stamp.nsec;
+  header.x = t.getOrigin().getX();
+  header.y = t.getOrigin().getY();
+  header.theta = tf::getYaw(t.getRotation());
+  header.angle_min = msg.angle_min;
+  header.angle_max = msg.angle_max;
+  header.angle_increment = msg.angle_increment;
+  header.range_min = msg.range_min;
+  header.range_max = msg.range_max;
+  header.ranges_nm = msg.ranges.size();
+  return header;
+}
+
+/* Scans synchronized with odometry that are decoded once and then read
+ * by any number of runs (e.g. SLAMs of a parameter sweep) concurrently.
+ * NB: records are immutable, they point to a mapped scan log or to
+ *     ranges of kept messages. */
+class DecodedScans {
+public:
+  bool load_scan_log(const std::string &fname) {
+    _log = std::make_unique<ScanLogReader>(fname);
+    if (!_log->is_valid()) { return false; }
+    auto record = ScanLogRecord{};
+    while (_log->next(record)) { _records.push_back(record); }
+    return true;
+  }
+
+  // NB: the bag is expected to provide sensor_msgs::LaserScan messages
+  //     (see BagTopicWithTransform).
+  template <typename BagTopic>
+  void load_bag(BagTopic &bag) {
+    while (bag.extract_next_msg()) {
+      _msgs.push_back(bag.msg());
+      _headers.push_back(scan_log_record_header(*bag.msg(),
+                                                bag.transform()));
+      _records.push_back(ScanLogRecord{&_headers.back(),
+                                       _msgs.back()->ranges.data()});
+    }
+  }
+
+  const std::vector<ScanLogRecord>& records() const { return _records; }
+
+private: // fields
+  std::unique_ptr<ScanLogReader> _log;
+  std::vector<boost::shared_ptr<sensor_msgs::LaserScan>> _msgs;
+  // NB: a deque keeps addresses of headers on growth
+  std::deque<ScanLogRecordHeader> _headers;
+  std::vector<ScanLogRecord> _records;
+};
+
+#endif
@@ -2,17 +2,48 @@
 #define SLAM_CTOR_ROS_INIT_UTILS_H
 
 #include <string>
+#include <vector>
 #include <memory>
+#include <utility>
 
 #include <ros/ros.h>
 
 #include "../core/states/world.h"
+#include "../core/maps/async_grid_map_observer.h"
+#include "../core/states/scan_voxel_downsampler.h"
 
 #include "../utils/properties_providers.h"
 #include "topic_with_transform.h"
+#include "laser_scans_synchronizer.h"
 #include "pose_correction_tf_publisher.h"
 #include "robot_pose_observers.h"
 #include "occupancy_grid_publisher.h"
+#include "stage_profile_diagnostics_publisher.h"
+
+/* Objects of a running slam node (the slam, its data providers and
+ * publishers). They are released in the reverse order of keeping, so
+ * providers that are kept last stop first. */
+class SlamNodePins {
+public:
+  SlamNodePins() = default;
+  SlamNodePins(SlamNodePins&&) = default;
+  SlamNodePins& operator=(SlamNodePins&&) = default;
+
+  ~SlamNodePins() {
+    while (!_pins.empty()) { _pins.pop_back(); }
+  }
+
+  template <typename T>
+  void keep(std::shared_ptr<T> pin) { _pins.push_back(std::move(pin)); }
+
+  template <typename T>
+  void keep(std::unique_ptr<T> pin) {
+    _pins.push_back(std::shared_ptr<T>{std::move(pin)});
+  }
+
+private:
+  std::vector<std::shared_ptr<void>> _pins;
+};
 
 // TODO: remove
 std::string get_string_param(const std::string &name,
@@ -30,18 +61,23 @@ std::string tf_odom_frame_id(const PropertiesProvider &props) {
   return props.get_str("in/odometry/ros/tf/odom_frame_id", "odom_combined");
 }
 
-std::string tf_map_frame_id() { // TODO: obtain from props
+// NB: ros-specific parameters are read from properties, so they are
+//     private parameters of a nodelet as well (see SlamNodelet)
+std::string tf_map_frame_id(const PropertiesProvider &props) {
+  return props.get_str("ros/tf/map_frame_id", "map");
+}
+
+// TODO: remove (is used by tools that don't have properties)
+std::string tf_map_frame_id() {
   return get_string_param("~ros/tf/map_frame_id", "map");
 }
 
-std::string tf_robot_pose_frame_id() {
-  return get_string_param("~ros/tf/robot_pose_frame_id", "robot_pose");
+std::string tf_robot_pose_frame_id(const PropertiesProvider &props) {
+  return props.get_str("ros/tf/robot_pose_frame_id", "robot_pose");
 }
 
-bool is_async_correction() {
-  bool async_correction;
-  ros::param::param<bool>("~ros/tf/async_correction", async_correction, false);
-  return async_correction;
+bool is_async_correction(const PropertiesProvider &props) {
+  return props.get_bool("ros/tf/async_correction", false);
 }
 
 // scan handling
@@ -51,12 +87,66 @@ bool get_skip_exceeding_lsr(const PropertiesProvider &props) {
                         false);
 }
 
+// NB: a zero resolution disables downsampling
+std::shared_ptr<ScanVoxelDownsampler> get_scan_downsampler(
+    const PropertiesProvider &props) {
+  auto resolution = props.get_dbl("in/lscan2D/downsampling/resolution", 0);
+  if (resolution <= 0) { return nullptr; }
+  return std::make_shared<ScanVoxelDownsampler>(resolution);
+}
+
+// NB: policies are "none", "keep_latest", "drop_every_nth",
+//     "drop_while_busy" and "catch_up" (see OverloadPolicy)
+LoadSheddingParams get_scan_load_shedding_params(
+    const PropertiesProvider &props) {
+  static const std::unordered_map<std::string, OverloadPolicy> Policies = {
+    {"none", OverloadPolicy::None},
+    {"keep_latest", OverloadPolicy::KeepLatest},
+    {"drop_every_nth", OverloadPolicy::DropEveryNth},
+    {"drop_while_busy", OverloadPolicy::DropWhileBusy},
+    {"catch_up", OverloadPolicy::CatchUp}
+  };
+  auto params = LoadSheddingParams{};
+  auto policy = props.get_str("in/lscan2D/ros/overload/policy", "none");
+  auto policy_i = Policies.find(policy);
+  if (policy_i != Policies.end()) {
+    params.policy = policy_i->second;
+  } else {
+    std::cout << "[WARN] Unknown scan overload policy \"" << policy
+              << "\", none is used" << std::endl;
+  }
+  params.drop_period = props.get_uint("in/lscan2D/ros/overload/drop_period",
+                                      params.drop_period);
+  params.catch_up_threshold = props.get_uint(
+    "in/lscan2D/ros/overload/catch_up_threshold", params.catch_up_threshold);
+  return params;
+}
+
+// NB: a zero period disables logging
+double get_scan_stats_log_period(const PropertiesProvider &props) {
+  return props.get_dbl("in/lscan2D/ros/overload/stats_log_period", 0);
+}
+
 // performance
 
 bool get_use_trig_cache(const PropertiesProvider &props) {
   return props.get_bool("slam/performance/use_trig_cache", false);
 }
 
+// Publishes stage latencies of the slam (see init_stage_profiler) to the
+// diagnostics topic if profiling and the publishing are enabled
+void init_stage_profile_diagnostics(std::shared_ptr<StageProfiler> profiler,
+                                    ros::NodeHandle nh,
+                                    const PropertiesProvider &props) {
+  if (!profiler ||
+      !props.get_bool("slam/performance/profile_diagnostics", false)) {
+    return;
+  }
+  profiler->subscribe(std::make_shared<StageProfileDiagnosticsPublisher>(
+    nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 5),
+    ros::this_node::getName() + ": slam stages"));
+}
+
 // TODO: move to IO
 
 auto tf_ignored_transforms(const PropertiesProvider &props) {
@@ -87,13 +177,70 @@ auto tf_ignored_transforms(const PropertiesProvider &props) {
   return ignores;
 }
 
+// multiple lasers
+
+// NB: names are separated by ':'
+std::vector<std::string> extra_laser_scan_ros_topic_names(
+    const PropertiesProvider &props) {
+  auto names = std::vector<std::string>{};
+  auto data = props.get_str("in/lscan2D/ros/extra_topics/names", "");
+  auto next_name_i = std::string::size_type{0};
+  while (next_name_i < data.length()) {
+    auto sep_i = std::min(data.find(":", next_name_i), data.length());
+    if (next_name_i < sep_i) {
+      names.push_back(data.substr(next_name_i, sep_i - next_name_i));
+    }
+    next_name_i = sep_i + 1;
+  }
+  return names;
+}
+
+struct LaserScanInputs {
+  std::vector<std::unique_ptr<TopicWithTransform<sensor_msgs::LaserScan>>>
+    extra_topics;
+  std::shared_ptr<LaserScansSynchronizer> synchronizer;
+};
+
+// Subscribes the observer to scans of the main topic; if extra laser
+// topics are given, their scans are merged to the main topic's ones
+// (see LaserScansSynchronizer).
+std::unique_ptr<LaserScanInputs> subscribe_laser_scan_observer(
+    ros::NodeHandle nh,
+    TopicWithTransform<sensor_msgs::LaserScan> *scan_provider,
+    std::shared_ptr<LaserScanObserver> scan_obs,
+    const PropertiesProvider &props,
+    double ros_tf_buffer_size, int ros_filter_queue, int ros_subscr_queue) {
+  auto extra_topic_names = extra_laser_scan_ros_topic_names(props);
+  if (extra_topic_names.empty()) {
+    scan_provider->subscribe(scan_obs);
+    return nullptr;
+  }
+
+  auto inputs = std::make_unique<LaserScanInputs>();
+  inputs->synchronizer = std::make_shared<LaserScansSynchronizer>(
+    scan_obs, extra_topic_names.size() + 1,
+    props.get_dbl("in/lscan2D/ros/extra_topics/max_time_diff", 0.05));
+  scan_provider->subscribe(inputs->synchronizer->laser_observer(0));
+  for (auto &name : extra_topic_names) {
+    inputs->extra_topics.push_back(
+      std::make_unique<TopicWithTransform<sensor_msgs::LaserScan>>(
+        nh, name, tf_odom_frame_id(props),
+        ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue));
+    auto laser_id = inputs->extra_topics.size();
+    inputs->extra_topics.back()->subscribe(
+      inputs->synchronizer->laser_observer(laser_id));
+  }
+  return inputs;
+}
+
 template <typename ObservT, typename MapT>
 std::shared_ptr<PoseCorrectionTfPublisher<ObservT>>
 create_pose_correction_tf_publisher(WorldObservable<MapT> *slam,
                                     TopicWithTransform<ObservT> *scan_prov,
                                     const PropertiesProvider &props) {
   auto pose_publisher = std::make_shared<PoseCorrectionTfPublisher<ObservT>>(
-    tf_map_frame_id(), tf_odom_frame_id(props), is_async_correction()
+    tf_map_frame_id(props), tf_odom_frame_id(props),
+    is_async_correction(props)
   );
   scan_prov->subscribe(pose_publisher);
   slam->subscribe_pose(pose_publisher);
@@ -102,9 +249,10 @@ create_pose_correction_tf_publisher(WorldObservable<MapT> *slam,
 
 template <typename MapT>
 std::shared_ptr<RobotPoseTfPublisher>
-create_robot_pose_tf_publisher(WorldObservable<MapT> *slam) {
+create_robot_pose_tf_publisher(WorldObservable<MapT> *slam,
+                               const PropertiesProvider &props) {
   auto pose_publisher = std::make_shared<RobotPoseTfPublisher>(
-    tf_map_frame_id(), tf_robot_pose_frame_id());
+    tf_map_frame_id(props), tf_robot_pose_frame_id(props));
   slam->subscribe_pose(pose_publisher);
   return pose_publisher;
 }
@@ -116,33 +264,58 @@ auto make_pose_correction_observation_stamped_publisher(
   const PropertiesProvider &props) {
   using PosePubT = ObservationStampedRoboPoseTfPublisher<ObservT>;
   auto stamped_pose_publisher =
-    std::make_shared<PosePubT>(tf_map_frame_id(),
-                               tf_robot_pose_frame_id());
+    std::make_shared<PosePubT>(tf_map_frame_id(props),
+                               tf_robot_pose_frame_id(props));
   scan_provider->subscribe(stamped_pose_publisher);
   slam->subscribe_pose(stamped_pose_publisher);
   return stamped_pose_publisher;
 }
 
+// NB: a factor that is less than 2 disables the coarse map publishing
+int get_coarse_map_downsampling_factor(const PropertiesProvider &props) {
+  return props.get_int("ros/rviz/coarse_map/downsampling_factor", 0);
+}
+
+// NB: the map is published from a snapshot on a dedicated thread,
+//     so the publishing rate is enforced by the async observer
+//     (by ROS time as other publishers, i.e. by the bag's clock if the time
+//     is simulated); a coarse copy of the map is published from the same
+//     snapshot.
 template <typename MapT>
-std::shared_ptr<OccupancyGridPublisher<MapT>>
+std::shared_ptr<AsyncGridMapObserver<MapT>>
 create_occupancy_grid_publisher(WorldObservable<MapT> *slam,
                                 ros::NodeHandle nh,
-                                double ros_map_publishing_rate) {
-  auto map_publisher = std::make_shared<OccupancyGridPublisher<MapT>>(
+                                double ros_map_publishing_rate,
+                                const PropertiesProvider &props) {
+  auto map_publisher = std::make_shared<OccupancyGridPublisher<GridMap>>(
     nh.advertise<nav_msgs::OccupancyGrid>("map", 5),
-    tf_map_frame_id(), ros_map_publishing_rate);
-  slam->subscribe_map(map_publisher);
-  return map_publisher;
+    tf_map_frame_id(props), 0,
+    nh.advertise<map_msgs::OccupancyGridUpdate>("map_updates", 5));
+  auto async_map_publisher = std::make_shared<AsyncGridMapObserver<MapT>>(
+    map_publisher, ros_map_publishing_rate,
+    []() { return ros::Time::now().toSec(); });
+  auto coarse_map_factor = get_coarse_map_downsampling_factor(props);
+  if (1 < coarse_map_factor) {
+    async_map_publisher->subscribe(
+      std::make_shared<OccupancyGridPublisher<GridMap>>(
+        nh.advertise<nav_msgs::OccupancyGrid>("map_coarse", 5),
+        tf_map_frame_id(props), 0,
+        nh.advertise<map_msgs::OccupancyGridUpdate>("map_coarse_updates", 5),
+        coarse_map_factor));
+  }
+  slam->subscribe_map(async_map_publisher);
+  return async_map_publisher;
 }
 
-void init_constants_for_ros(double &ros_tf_buffer_size,
+void init_constants_for_ros(const PropertiesProvider &props,
+                            double &ros_tf_buffer_size,
                             double &ros_map_rate,
                             int &ros_filter_queue,
                             int &ros_subscr_queue) {
-  ros::param::param<double>("~ros/tf/buffer_duration",ros_tf_buffer_size, 5.0);
-  ros::param::param<double>("~ros/rviz/map_publishing_rate", ros_map_rate, 5.0);
-  ros::param::param<int>("~ros/filter_queue_size",ros_filter_queue, 1000);
-  ros::param::param<int>("~ros/subscribers_queue_size",ros_subscr_queue, 1000);
+  ros_tf_buffer_size = props.get_dbl("ros/tf/buffer_duration", 5.0);
+  ros_map_rate = props.get_dbl("ros/rviz/map_publishing_rate", 5.0);
+  ros_filter_queue = props.get_int("ros/filter_queue_size", 1000);
+  ros_subscr_queue = props.get_int("ros/subscribers_queue_size", 1000);
 }
 
 #endif
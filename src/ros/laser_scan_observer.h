@@ -3,8 +3,10 @@
 
 #include <utility>
 #include <memory>
+#include <vector>
 #include <sensor_msgs/LaserScan.h>
 #include <boost/shared_ptr.hpp>
+#include <cmath>
 #include <cassert>
 #include <iostream>
 
@@ -12,81 +14,234 @@
 #include "../core/states/robot_pose.h"
 #include "../core/states/world.h"
 #include "../core/states/sensor_data.h"
+#include "../core/states/scan_voxel_downsampler.h"
+#include "../core/shared_object_pool.h"
+#include "../core/stage_profiler.h"
 #include "topic_with_transform.h"
 
+// Ranges of a laser scan and the laser pose in the robot frame
+struct LaserRanges {
+  RobotPose laser_pose;
+  float angle_min, angle_max, angle_increment;
+  float range_min, range_max;
+  const float *ranges;
+  std::size_t ranges_nm;
+};
+
 class LaserScanObserver : public TopicObserver<sensor_msgs::LaserScan> {
-  using ScanPtr = boost::shared_ptr<sensor_msgs::LaserScan>;
+  using ScanPtr = boost::shared_ptr<const sensor_msgs::LaserScan>;
   using DstPtr = std::shared_ptr<SensorDataObserver<TransformedLaserScan>>;
+  using DownsamplerPtr = std::shared_ptr<ScanVoxelDownsampler>;
+  using ProfilerPtr = std::shared_ptr<StageProfiler>;
 public: //methods
 
+  // NB: a scan is downsampled (if a downsampler is set) before it is
+  //     passed to the slam, so matching and mapping share the work.
+  //     The conversion of a scan is measured by the profiler (if set);
+  //     handling of a scan is traced if tracing is enabled.
   LaserScanObserver(DstPtr slam,
                     bool skip_max_vals,
-                    bool use_cached_trig)
+                    bool use_cached_trig,
+                    DownsamplerPtr downsampler = nullptr,
+                    ProfilerPtr profiler = nullptr)
     : _slam(slam), _skip_max_vals(skip_max_vals)
-    , _use_cached_trig_provider{use_cached_trig} {}
+    , _use_cached_trig_provider{use_cached_trig}
+    , _downsampler{downsampler}, _profiler{profiler} {}
 
   virtual void handle_transformed_msg(
     const ScanPtr msg, const tf::StampedTransform& t) {
+    auto laser = laser_ranges(*msg);
+    handle_scans(robot_pose(t), &laser, 1);
+  }
+
+  // NB: the backlog is passed to the slam as a whole,
+  //     so the slam may catch up (see handle_sensor_data_batch).
+  void handle_transformed_msgs(
+      const std::vector<MsgWithTransform> &msgs) override {
+    TraceScan trace;
+    _backlog.clear();
+    for (auto &msg : msgs) {
+      auto laser = laser_ranges(*msg.first);
+      convert_scans(robot_pose(msg.second), &laser, 1);
+      _backlog.push_back(_scan);
+    }
+    _slam->handle_sensor_data_batch(_backlog);
+  }
+
+  // NB: ranges are only read, so they may be kept by a caller in place
+  //     (e.g. in a memory-mapped scan log, see ScanLogReader).
+  // PERFORMANCE: the scan is reused and its shared parts (the SoA form
+  //              and the trigonometry provider) are taken from pools once
+  //              the slam releases them, so a steady stream of scans
+  //              doesn't allocate memory here.
+  void handle_scan(const RobotPose &new_pose,
+                   float angle_min, float angle_max, float angle_increment,
+                   float range_min, float range_max,
+                   const float *ranges, std::size_t ranges_nm) {
+    auto laser = LaserRanges{RobotPose{}, angle_min, angle_max,
+                             angle_increment, range_min, range_max,
+                             ranges, ranges_nm};
+    handle_scans(new_pose, &laser, 1);
+  }
+
+  // Merges scans of several lasers (e.g. front and rear ones) to a single
+  // scan in the robot frame, so the slam matches and maps it once.
+  // NB: rays of the merged scan start at the robot pose, i.e. free space
+  //     of a laser that is shifted from the robot is approximated.
+  //     A single laser is expected to be at the robot pose.
+  void handle_scans(const RobotPose &new_pose,
+                    const LaserRanges *lasers, std::size_t lasers_nm) {
+    TraceScan trace;
+    convert_scans(new_pose, lasers, lasers_nm);
+    _slam->handle_sensor_data(_scan);
+  }
 
-    RobotPose new_pose(t.getOrigin().getX(), t.getOrigin().getY(),
-                       tf::getYaw(t.getRotation()));
+  const RobotPose &odometry_pose() const { return _prev_pose; }
+  void set_odometry_pose(const RobotPose& pose) { _prev_pose = pose; }
+
+private:
+
+  static RobotPose robot_pose(const tf::StampedTransform& t) {
+    return RobotPose{t.getOrigin().getX(), t.getOrigin().getY(),
+                     tf::getYaw(t.getRotation())};
+  }
+
+  static LaserRanges laser_ranges(const sensor_msgs::LaserScan &msg) {
+    return LaserRanges{RobotPose{}, msg.angle_min, msg.angle_max,
+                       msg.angle_increment, msg.range_min, msg.range_max,
+                       msg.ranges.data(), msg.ranges.size()};
+  }
 
-    TransformedLaserScan transformed_scan;
-    transformed_scan.scan.points().reserve(msg->ranges.size());
+  void convert_scans(const RobotPose &new_pose,
+                     const LaserRanges *lasers, std::size_t lasers_nm) {
+    StageTimer timer{_profiler, SlamStage::ScanConversion};
+    auto &transformed_scan = _scan;
+    auto &scan = transformed_scan.scan;
+    // NB: the previous scan's parts are returned to the pools
+    scan.trig_provider.reset();
+    auto &points = scan.points();
+    points.clear();
+    auto ranges_nm = std::size_t{0};
+    for (std::size_t i = 0; i < lasers_nm; ++i) {
+      ranges_nm += lasers[i].ranges_nm;
+    }
+    points.reserve(ranges_nm);
     transformed_scan.quality = 1.0;
+
     // TODO: move trig provider setup to the SLAM
-    transformed_scan.scan.trig_provider = trig_provider(msg);
-
-    double sp_angle = msg->angle_min - msg->angle_increment;
-    for (const auto &range : msg->ranges) {
-      bool sp_is_occupied = true;
-      double sp_range = range;
-      sp_angle += msg->angle_increment;
-
-      // filter points by range/angle
-      if (sp_range < msg->range_min) {
-        continue;
-      } else if (msg->range_max <= sp_range) {
-        sp_is_occupied = false;
-        sp_range = msg->range_max;
-        if (_skip_max_vals) {
-          continue;
-        }
+    if (lasers_nm == 1) {
+      auto &laser = lasers[0];
+      scan.trig_provider = trig_provider(laser.angle_min, laser.angle_max,
+                                         laser.angle_increment);
+      add_points(laser, points);
+    } else {
+      // NB: angles of merged points don't form a regular grid
+      scan.trig_provider = raw_trig_provider();
+      for (std::size_t i = 0; i < lasers_nm; ++i) {
+        add_robot_frame_points(lasers[i], points);
       }
+    }
 
-      // add a scan point to a scan
-      transformed_scan.scan.points().emplace_back(sp_range, sp_angle,
-                                                  sp_is_occupied);
+    if (_downsampler) {
+      _downsampler->downsample(scan);
     }
-    assert(are_equal(sp_angle, msg->angle_max));
+    update_soa(scan);
 
     transformed_scan.pose_delta = new_pose - _prev_pose;
     _prev_pose = new_pose;
+  }
 
-    _slam->handle_sensor_data(transformed_scan);
+  // filters points by range/angle;
+  // NB: an out of range value is clamped without a branch, the only one
+  //     is a point skip that is rare (i.e. is predicted well)
+  template <typename PointHandler>
+  void filter_points(const LaserRanges &laser, PointHandler &&handle_point) {
+    double sp_angle = laser.angle_min - laser.angle_increment;
+    for (std::size_t i = 0; i < laser.ranges_nm; ++i) {
+      sp_angle += laser.angle_increment;
+      const double sp_range = laser.ranges[i];
+      const bool sp_is_occupied = !(laser.range_max <= sp_range);
+      const bool is_skipped = (sp_range < laser.range_min) |
+                              (!sp_is_occupied & _skip_max_vals);
+      if (is_skipped) { continue; }
+
+      handle_point(sp_is_occupied ? sp_range : double(laser.range_max),
+                   sp_angle, sp_is_occupied, i);
+    }
+    assert(are_equal(sp_angle, laser.angle_max));
   }
 
-  const RobotPose &odometry_pose() const { return _prev_pose; }
-  void set_odometry_pose(const RobotPose& pose) { _prev_pose = pose; }
+  void add_points(const LaserRanges &laser, LaserScan2D::Points &points) {
+    filter_points(laser, [&points](double range, double angle, bool is_occ,
+                                   std::size_t i) {
+      points.emplace_back(range, angle, is_occ);
+      points.back().set_angle_idx(int(i));
+    });
+  }
 
-private:
+  void add_robot_frame_points(const LaserRanges &laser,
+                              LaserScan2D::Points &points) {
+    auto &lp = laser.laser_pose;
+    filter_points(laser, [&points, &lp](double range, double angle,
+                                        bool is_occ, std::size_t) {
+      auto x = lp.x + range * std::cos(lp.theta + angle);
+      auto y = lp.y + range * std::sin(lp.theta + angle);
+      points.emplace_back(std::sqrt(x * x + y * y), std::atan2(y, x), is_occ);
+    });
+  }
+
+  std::shared_ptr<TrigonometryProvider> raw_trig_provider() {
+    auto provider = _raw_trig_providers.released();
+    if (!provider) {
+      provider = std::make_shared<RawTrigonometryProvider>();
+      _raw_trig_providers.keep(provider);
+    }
+    provider->set_base_angle(0);
+    return provider;
+  }
+
+  std::shared_ptr<TrigonometryProvider> trig_provider(
+      float angle_min, float angle_max, float angle_increment) {
+    if (!_use_cached_trig_provider) { return raw_trig_provider(); }
+
+    // NB: the tables are shared, only the provider's base angle is per scan
+    auto table = _trig_tables.table(angle_min, angle_max + angle_increment,
+                                    angle_increment);
+    auto provider = _cached_trig_providers.released();
+    if (!provider) {
+      provider = std::make_shared<CachedTrigonometryProvider>(table);
+      _cached_trig_providers.keep(provider);
+    }
+    provider->update(std::move(table));
+    provider->set_base_angle(0);
+    return provider;
+  }
 
-  std::shared_ptr<TrigonometryProvider> trig_provider(const ScanPtr msg) {
-    if (_use_cached_trig_provider) {
-      auto provider = std::make_shared<CachedTrigonometryProvider>();
-      provider->update(msg->angle_min, msg->angle_max + msg->angle_increment,
-                       msg->angle_increment);
-      return provider;
+  void update_soa(LaserScan2D &scan) {
+    auto soa = _soas.released();
+    if (soa) {
+      soa->assign(scan.points());
     } else {
-      return std::make_shared<RawTrigonometryProvider>();
+      soa = std::make_shared<ScanPointsSoA>(scan.points());
+      _soas.keep(soa);
     }
+    scan.set_soa(std::move(soa));
   }
 
 private: // fields
   DstPtr _slam;
   bool _skip_max_vals;
   bool _use_cached_trig_provider;
+  TrigonometryTableRegistry _trig_tables;
+  DownsamplerPtr _downsampler;
+  ProfilerPtr _profiler;
   RobotPose _prev_pose;
+  // buffers reused by scans
+  TransformedLaserScan _scan;
+  std::vector<TransformedLaserScan> _backlog;
+  SharedObjectPool<ScanPointsSoA> _soas;
+  SharedObjectPool<RawTrigonometryProvider> _raw_trig_providers;
+  SharedObjectPool<CachedTrigonometryProvider> _cached_trig_providers;
 };
 
 #endif
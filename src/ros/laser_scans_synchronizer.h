@@ -0,0 +1,123 @@
+#ifndef SLAM_CTOR_ROS_LASER_SCANS_SYNCHRONIZER_H
+#define SLAM_CTOR_ROS_LASER_SCANS_SYNCHRONIZER_H
+
+#include <cmath>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include <sensor_msgs/LaserScan.h>
+#include <boost/shared_ptr.hpp>
+#include <tf/tf.h>
+
+#include "topic_with_transform.h"
+#include "laser_scan_observer.h"
+
+/* Merges scans of several lasers (e.g. front and rear ones) that come
+ * from separate topics, so the slam matches and maps one scan per cycle.
+ * A scan of the main laser (the first one) is merged with the latest
+ * not merged scans of other lasers that are close to it in time;
+ * the main laser's frame is the robot frame of a merged scan.
+ * NB: a pose of a laser relative to the main one is computed from
+ *     odometry transforms of both scans, so it includes both the laser's
+ *     extrinsics and the robot motion between the scans. */
+class LaserScansSynchronizer {
+private: // types
+  using ScanPtr = boost::shared_ptr<const sensor_msgs::LaserScan>;
+
+  struct StampedScan {
+    ScanPtr msg;
+    tf::StampedTransform transform;
+  };
+
+  class LaserObserver : public TopicObserver<sensor_msgs::LaserScan> {
+  public:
+    LaserObserver(LaserScansSynchronizer &sync, std::size_t laser_id)
+      : _sync(sync), _laser_id{laser_id} {}
+
+    void handle_transformed_msg(const ScanPtr msg,
+                                const tf::StampedTransform &t) override {
+      _sync.handle_laser_scan(_laser_id, msg, t);
+    }
+  private:
+    LaserScansSynchronizer &_sync;
+    std::size_t _laser_id;
+  };
+public:
+  LaserScansSynchronizer(std::shared_ptr<LaserScanObserver> scan_observer,
+                         std::size_t lasers_nm, double max_time_diff_secs)
+    : _scan_observer{scan_observer}, _max_time_diff{max_time_diff_secs}
+    , _latest_scans(lasers_nm) {
+    for (std::size_t id = 0; id < lasers_nm; ++id) {
+      _laser_observers.push_back(std::make_shared<LaserObserver>(*this, id));
+    }
+  }
+
+  LaserScansSynchronizer(const LaserScansSynchronizer&) = delete;
+  LaserScansSynchronizer& operator=(const LaserScansSynchronizer&) = delete;
+
+  // An observer of a topic of the given laser (0 is the main one)
+  std::shared_ptr<TopicObserver<sensor_msgs::LaserScan>>
+  laser_observer(std::size_t laser_id) {
+    return _laser_observers[laser_id];
+  }
+
+private: // methods
+
+  // NB: topics may be handled by different threads (see OverloadPolicy)
+  void handle_laser_scan(std::size_t laser_id, const ScanPtr &msg,
+                         const tf::StampedTransform &t) {
+    if (laser_id != 0) {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      _latest_scans[laser_id] = StampedScan{msg, t};
+      return;
+    }
+
+    _merged_scans.clear();
+    _merged_scans.push_back(StampedScan{msg, t});
+    {
+      auto lock = std::unique_lock<std::mutex>{_mutex};
+      for (std::size_t id = 1; id < _latest_scans.size(); ++id) {
+        auto &scan = _latest_scans[id];
+        if (!scan.msg || _max_time_diff <
+            std::abs((scan.transform.stamp_ - t.stamp_).toSec())) {
+          continue;
+        }
+        // NB: a scan is merged once
+        _merged_scans.push_back(std::move(scan));
+        scan = StampedScan{};
+      }
+    }
+
+    // NB: scans are expressed in the main laser's frame
+    auto robot2odom = t.inverse();
+    _lasers.clear();
+    for (auto &scan : _merged_scans) {
+      auto laser2robot = robot2odom * scan.transform;
+      auto &m = *scan.msg;
+      _lasers.push_back(LaserRanges{
+        RobotPose{laser2robot.getOrigin().getX(),
+                  laser2robot.getOrigin().getY(),
+                  tf::getYaw(laser2robot.getRotation())},
+        m.angle_min, m.angle_max, m.angle_increment,
+        m.range_min, m.range_max, m.ranges.data(), m.ranges.size()});
+    }
+    _scan_observer->handle_scans(
+      RobotPose{t.getOrigin().getX(), t.getOrigin().getY(),
+                tf::getYaw(t.getRotation())},
+      _lasers.data(), _lasers.size());
+  }
+
+private: // fields
+  std::shared_ptr<LaserScanObserver> _scan_observer;
+  double _max_time_diff;
+  std::vector<std::shared_ptr<LaserObserver>> _laser_observers;
+
+  std::mutex _mutex;
+  std::vector<StampedScan> _latest_scans;
+  // buffers of merging that are used by the main laser's handler only
+  std::vector<StampedScan> _merged_scans;
+  std::vector<LaserRanges> _lasers;
+};
+
+#endif
@@ -7,8 +7,14 @@
 
 #include "../utils/properties_providers.h"
 
+// Properties that are private parameters of a node (or of a nodelet)
 class LaunchPropertiesProvider : public PropertiesProvider {
 public:
+  LaunchPropertiesProvider() : _prefix{"~"} {}
+
+  // NB: a nodelet's private parameters are not in the process' namespace
+  explicit LaunchPropertiesProvider(const ros::NodeHandle &private_nh)
+    : _prefix{private_nh.getNamespace() + "/"} {}
 
   int get_int(const std::string &id, int dflt) const override {
     return launch_param<int>(id, dflt);
@@ -37,9 +43,12 @@ private:
   template <typename T>
   T launch_param(const std::string &id, const T &default_value) const {
     T value;
-    ros::param::param<T>("~" + id, value, default_value);
+    ros::param::param<T>(_prefix + id, value, default_value);
     return value;
   }
+
+private:
+  std::string _prefix;
 };
 
 #endif
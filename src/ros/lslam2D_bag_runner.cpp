@@ -1,25 +1,37 @@
 #include <cstdlib>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <memory>
 #include <vector>
 #include <string>
+#include <thread>
+#include <algorithm>
+#include <functional>
 
+#include <sys/resource.h>
 #include <sensor_msgs/LaserScan.h>
 
 #include "init_utils.h"
-#include "bag_topic_with_transform.h"
+#include "prefetching_bag_topic.h"
+#include "decoded_scans.h"
 #include "laser_scan_observer.h"
 #include "robot_pose_observers.h"
 #include "../utils/map_dumpers.h"
+#include "../utils/png_map_dumper.h"
 #include "../utils/properties_providers.h"
+#include "../utils/allocation_tracking.h"
+#include "../utils/init_session.h"
+#include "../core/stage_profiler.h"
+#include "../core/thread_pool.h"
 #include "../slams/viny/init_viny_slam.h"
 #include "../slams/tiny/init_tiny_slam.h"
 #include "../slams/gmapping/init_gmapping.h"
 
 struct ProgramArgs {
   static constexpr auto Slam_Type_Id = 0, Bag_Id = 1, Mandatory_Id_Nm = 2;
-  ProgramArgs() : is_valid{true}, is_verbose{false} {}
+  ProgramArgs() : is_valid{true}, is_verbose{false}, threads_nm{0} {}
 
   // TODO: refactor
   ProgramArgs& init(char **argv) {
@@ -52,9 +64,17 @@ struct ProgramArgs {
       } else if (flag == "-p") {
         props.append_file_content(*arg);
       } else if (flag == "-t") {
-        traj_dumper = std::make_shared<RobotPoseTumTrajectoryDumper>(*arg);
+        traj_fname = *arg;
       } else if (flag == "-m") {
         map_fname = *arg;
+      } else if (flag == "-M") {
+        map_state_fname = *arg;
+      } else if (flag == "-s") {
+        sweep_fname = *arg;
+      } else if (flag == "-j") {
+        threads_nm = std::stoul(*arg);
+      } else if (flag == "-b") {
+        benchmark_fname = *arg;
       } else {
         std::cout << "[Warn] Skip parameter for unknown flag \""
                   << flag << "\"" << std::endl;
@@ -66,9 +86,29 @@ struct ProgramArgs {
   }
 
   void print_usage(std::ostream &stream) {
-    stream << "Args: <slam type> <bag file>\n"
+    stream << "Args: <slam type> <bag file | scan log file (*.scanlog)>\n"
            << "      [-v] [-t <traj file>] [-m <map file>] \n"
-           << "      [-p <properties file>]\n";
+           << "      [-M <map state file>]\n"
+           << "      [-p <properties file>]\n"
+           << "      [-s <sweep file> [-j <threads number>]]\n"
+           << "      [-b <benchmark report file>]\n"
+           << "A line of a sweep file is a configuration that is run\n"
+           << "concurrently with others on the same decoded scans:\n"
+           << "  <name> [<property>=<value>]... (slam_type=<slam type>)\n"
+           << "Its trajectory and map files are named with the suffix\n"
+           << "<name>, e.g. traj.<name>.txt for -t traj.txt\n"
+           << "A map file is PNG if it ends with .png and PGM otherwise\n"
+           << "A map state file may be localized against later\n"
+           << "(see the slam/localization/map property)\n"
+           << "A benchmark report is JSON with throughput, scan latencies\n"
+           << "and time outside slams (decoding, sync) per run\n";
+  }
+
+  bool is_scan_log() const {
+    static const std::string Scan_Log_Ext = ".scanlog";
+    return Scan_Log_Ext.size() < bag_fname.size() &&
+           bag_fname.compare(bag_fname.size() - Scan_Log_Ext.size(),
+                             Scan_Log_Ext.size(), Scan_Log_Ext) == 0;
   }
 
   bool is_valid;
@@ -77,33 +117,277 @@ struct ProgramArgs {
   FilePropertiesProvider props;
   std::string bag_fname;
 // optional args
-  std::shared_ptr<RobotPoseTumTrajectoryDumper> traj_dumper;
+  std::string traj_fname;
   std::string map_fname;
+  std::string map_state_fname;
   bool is_verbose;
+  std::string sweep_fname;
+  unsigned threads_nm;
+  std::string benchmark_fname;
+};
+
+/* Timings of a run of a slam (see the -b flag). A scan latency is the one
+ * of its handling by the slam; the rest of the run (e.g. decoding of a bag
+ * and sync with transforms, trajectory logging) is outside the slam.
+ * Heap allocations of scan handling are reported if they are tracked
+ * (see AllocationCount).
+ * PERFORMANCE: a scan costs two steady clock reads and a histogram
+ *              update (see LatencyHistogram). */
+class RunBenchmark {
+private: // types
+  using Clock = std::chrono::steady_clock;
+public:
+  explicit RunBenchmark(const std::string &name) : _name{name} {}
+
+  RunBenchmark(const RunBenchmark&) = delete;
+  RunBenchmark& operator=(const RunBenchmark&) = delete;
+
+  void start() { _start = Clock::now(); }
+  void finish() { _total_secs = secs(Clock::now() - _start); }
+
+  template <typename ScanHandler>
+  void measure_scan(ScanHandler handle) {
+    auto allocs_start = thread_allocation_count();
+    auto start = Clock::now();
+    handle();
+    auto latency = Clock::now() - start;
+    if (Allocations_Are_Tracked) {
+      auto allocs = thread_allocation_count() - allocs_start;
+      _allocations += allocs;
+      _max_scan_allocs_nm = std::max(_max_scan_allocs_nm, allocs.allocs_nm);
+    }
+    _latencies.add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    _slam_secs += secs(latency);
+    ++_scans_nm;
+  }
+
+  void write_json(std::ostream &os) const {
+    auto l = _latencies.stats();
+    os << "{\"name\": \"" << _name << "\", \"scans\": " << _scans_nm
+       << ", \"total_secs\": " << _total_secs
+       << ", \"slam_secs\": " << _slam_secs
+       << ", \"outside_slam_secs\": " << _total_secs - _slam_secs
+       << ", \"scans_per_sec\": "
+       << (_total_secs == 0 ? 0 : _scans_nm / _total_secs)
+       << ", \"latency_ms\": {\"mean\": " << l.mean
+       << ", \"p50\": " << l.p50 << ", \"p95\": " << l.p95
+       << ", \"p99\": " << l.p99 << ", \"max\": " << l.max << "}";
+    if (Allocations_Are_Tracked) {
+      os << ", \"allocs_per_scan\": {\"mean\": "
+         << per_scan(_allocations.allocs_nm)
+         << ", \"max\": " << _max_scan_allocs_nm
+         << ", \"bytes_mean\": " << per_scan(_allocations.bytes) << "}";
+    }
+    os << "}";
+  }
+
+  void print_summary(std::ostream &os) const {
+    auto l = _latencies.stats();
+    os << "[BENCHMARK] " << _name << ": " << _scans_nm << " scans in "
+       << _total_secs << " s (" << _total_secs - _slam_secs
+       << " s outside slam), latency p50/p95/p99/max " << l.p50 << "/"
+       << l.p95 << "/" << l.p99 << "/" << l.max << " ms";
+    if (Allocations_Are_Tracked) {
+      os << ", allocs/scan " << per_scan(_allocations.allocs_nm)
+         << " (max " << _max_scan_allocs_nm << ")";
+    }
+    os << std::endl;
+  }
+
+private: // methods
+  double per_scan(uint64_t value) const {
+    return _scans_nm == 0 ? 0 : double(value) / _scans_nm;
+  }
+
+  static double secs(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  }
+
+private: // fields
+  std::string _name;
+  LatencyHistogram _latencies;
+  std::size_t _scans_nm = 0;
+  double _total_secs = 0, _slam_secs = 0;
+  AllocationCount _allocations;
+  uint64_t _max_scan_allocs_nm = 0;
+  Clock::time_point _start;
 };
 
-// TODO: consider moving map type to runtime params
+// NB: a null benchmark measures nothing
+template <typename ScanHandler>
+void handle_scan(RunBenchmark *benchmark, ScanHandler handle) {
+  if (benchmark) {
+    benchmark->measure_scan(handle);
+  } else {
+    handle();
+  }
+}
+
+// The peak resident set size of the process
+double peak_rss_mb() {
+  auto usage = rusage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0; // NB: kilobytes on Linux
+}
+
+/* Writes a JSON report of runs; the decoding time is the one of scans
+ * decoded before runs (a scan log or a sweep), a bag is decoded
+ * while a slam runs. */
+void write_benchmark_report(const ProgramArgs &args, double decoding_secs,
+                            const std::vector<const RunBenchmark*> &runs) {
+  if (args.benchmark_fname.empty()) { return; }
+  for (auto run : runs) { run->print_summary(std::cout); }
+  auto os = std::ofstream{args.benchmark_fname};
+  os << "{\"input\": \"" << args.bag_fname << "\""
+     << ", \"slam_type\": \"" << args.slam_type << "\""
+     << ", \"decoding_secs\": " << decoding_secs
+     << ", \"peak_rss_mb\": " << peak_rss_mb()
+     << ", \"runs\": [";
+  for (std::size_t i = 0; i < runs.size(); ++i) {
+    os << (i ? ", " : "");
+    runs[i]->write_json(os);
+  }
+  os << "]}" << std::endl;
+}
+
+// A configuration of a parameter sweep
+struct SweepConfig {
+  std::string name;
+  std::string slam_type;
+  FilePropertiesProvider props;
+};
+
+std::vector<SweepConfig> read_sweep_configs(const ProgramArgs &args) {
+  auto configs = std::vector<SweepConfig>{};
+  auto file = std::ifstream{args.sweep_fname};
+  auto line = std::string{};
+  while (std::getline(file, line)) {
+    auto entries = std::istringstream{line};
+    auto config = SweepConfig{"", args.slam_type, args.props};
+    if (!(entries >> config.name) || config.name.front() == '#') {
+      continue;
+    }
+    auto entry = std::string{};
+    while (entries >> entry) {
+      auto delim_i = entry.find('=');
+      if (delim_i == std::string::npos) {
+        std::cout << "[Warn] Skip sweep entry \"" << entry << "\"\n";
+        continue;
+      }
+      auto id = entry.substr(0, delim_i), value = entry.substr(delim_i + 1);
+      if (id == "slam_type") {
+        config.slam_type = value;
+      } else {
+        config.props.set_property(id, value);
+      }
+    }
+    configs.push_back(std::move(config));
+  }
+  return configs;
+}
+
+// E.g. "out/traj.txt" -> "out/traj.<suffix>.txt"
+std::string with_name_suffix(const std::string &fname,
+                             const std::string &suffix) {
+  if (fname.empty()) { return fname; }
+  auto dot_i = fname.rfind('.'), slash_i = fname.rfind('/');
+  if (dot_i == std::string::npos ||
+      (slash_i != std::string::npos && dot_i < slash_i)) {
+    return fname + "." + suffix;
+  }
+  return fname.substr(0, dot_i) + "." + suffix + fname.substr(dot_i);
+}
+
+// Calls handle(slam) for a slam of the given type and map backend
+// (see init_map_backend)
+template <typename SlamHandler>
+bool with_slam(const std::string &slam_type, const PropertiesProvider &props,
+               SlamHandler handle) {
+  if (slam_type == "viny") {
+    with_viny_slam(props, handle);
+  } else if (slam_type == "tiny") {
+    with_tiny_slam(props, handle);
+  } else if (slam_type == "gmapping") {
+    handle(init_gmapping(props));
+  } else {
+    std::cout << "Unkonw slam type: " << slam_type << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool is_png_fname(const std::string &fname) {
+  static const std::string Png_Ext = ".png";
+  return Png_Ext.size() < fname.size() &&
+         fname.compare(fname.size() - Png_Ext.size(),
+                       Png_Ext.size(), Png_Ext) == 0;
+}
+
+// NB: a png is deflated by threads_nm threads
 template <typename MapType>
-void run_slam(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
-              const ProgramArgs &args) {
-  auto lscan_observer = LaserScanObserver{
-    slam, get_skip_exceeding_lsr(args.props), get_use_trig_cache(args.props)};
+void dump_map(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
+              const std::string &map_fname, unsigned threads_nm = 1) {
+  if (map_fname.empty()) { return; }
+  auto map_file = std::ofstream{map_fname, std::ios::binary};
+  if (is_png_fname(map_fname)) {
+    GridMapToPngDumper<MapType>::dump_map(map_file, slam->map(), threads_nm);
+  } else {
+    GridMapToPgmDumber<MapType>::dump_map(map_file, slam->map());
+  }
+}
 
-  ros::Time::init();
+template <typename MapType>
+void dump_map_state(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
+                    const std::string &state_fname) {
+  if (state_fname.empty()) { return; }
+  auto state = slam->map().save_state();
+  if (state.empty()) {
+    std::cerr << "[Warn] The map type doesn't support states" << std::endl;
+    return;
+  }
+  auto state_file = std::ofstream{state_fname, std::ios::binary};
+  state_file.write(state.data(), state.size());
+}
+
+// Out-of-core maps keep tiles in memory once the backing file
+// can't be written (see GenericOutOfCoreTiledGridMap)
+template <typename MapType>
+void report_map_failures(const MapType &) {}
+
+template <typename CellStorage>
+void report_map_failures(
+    const GenericOutOfCoreTiledGridMap<CellStorage> &map) {
+  if (!map.is_eviction_failed()) { return; }
+  std::cerr << "[Warn] Unable to evict map tiles, "
+            << "they are kept in memory" << std::endl;
+}
+
+template <typename MapType>
+void handle_bag(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
+                const ProgramArgs &args,
+                RobotPoseTumTrajectoryDumper *traj_dumper,
+                RunBenchmark *benchmark) {
+  auto lscan_observer = LaserScanObserver{
+    slam, get_skip_exceeding_lsr(args.props), get_use_trig_cache(args.props),
+    nullptr, slam->stage_profiler()};
   assert(args.props.get_bool("in/lscan2D/ros/topic/enabled", false));
   assert(args.props.get_bool("in/odometry/ros/tf/enabled", false));
-  BagTopicWithTransform<sensor_msgs::LaserScan> bag{
+  // NB: the bag is decoded by a producer thread while the slam runs
+  PrefetchingBagTopicWithTransform<sensor_msgs::LaserScan> bag{
     args.bag_fname, laser_scan_2D_ros_topic_name(args.props),
     args.props.get_str("in/odometry/ros/tf/name", "/tf"),
-    tf_odom_frame_id(args.props)
+    tf_odom_frame_id(args.props), tf_ignored_transforms(args.props),
+    args.props.get_uint("in/bag/prefetched_msgs_nm", 64)
   };
-  bag.set_tf_ignores(tf_ignored_transforms(args.props));
 
   auto scan_id = unsigned{0};
   while (bag.extract_next_msg()) {
-    lscan_observer.handle_transformed_msg(bag.msg(), bag.transform());
-    if (args.traj_dumper) {
-      args.traj_dumper->log_robot_pose(bag.timestamp(), slam->pose());
+    handle_scan(benchmark, [&]() {
+      lscan_observer.handle_transformed_msg(bag.msg(), bag.transform());
+    });
+    if (traj_dumper) {
+      traj_dumper->log_robot_pose(bag.timestamp(), slam->pose());
     }
     ++scan_id;
 
@@ -111,13 +395,164 @@ void run_slam(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
       std::cout << "Handled scan #" << scan_id << std::endl;
     }
   }
+}
 
-  if (!args.map_fname.empty()) {
-    auto map_file = std::ofstream{args.map_fname, std::ios::binary};
-    GridMapToPgmDumber<MapType>::dump_map(map_file, slam->map());
+// NB: records are only read, so they may be replayed by concurrent slams
+template <typename MapType>
+void replay_scans(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
+                  const PropertiesProvider &props,
+                  const std::vector<ScanLogRecord> &records,
+                  RobotPoseTumTrajectoryDumper *traj_dumper,
+                  bool is_verbose, RunBenchmark *benchmark = nullptr) {
+  auto lscan_observer = LaserScanObserver{
+    slam, get_skip_exceeding_lsr(props), get_use_trig_cache(props),
+    nullptr, slam->stage_profiler()};
+
+  auto scan_id = unsigned{0};
+  for (auto &record : records) {
+    auto &h = *record.header;
+    handle_scan(benchmark, [&]() {
+      lscan_observer.handle_scan(record.pose(), h.angle_min, h.angle_max,
+                                 h.angle_increment, h.range_min, h.range_max,
+                                 record.ranges, h.ranges_nm);
+    });
+    if (traj_dumper) {
+      traj_dumper->log_robot_pose(ros::Time{h.sec, h.nsec}, slam->pose());
+    }
+    ++scan_id;
+
+    if (is_verbose) {
+      std::cout << "Handled scan #" << scan_id << std::endl;
+    }
   }
 }
 
+// NB: a scan log is extracted from a bag by bag_to_scan_log
+bool load_scans(const ProgramArgs &args, DecodedScans &scans) {
+  if (args.is_scan_log()) {
+    if (scans.load_scan_log(args.bag_fname)) { return true; }
+    std::cerr << "[Error] Unable to read scan log " << args.bag_fname
+              << std::endl;
+    return false;
+  }
+
+  PrefetchingBagTopicWithTransform<sensor_msgs::LaserScan> bag{
+    args.bag_fname, laser_scan_2D_ros_topic_name(args.props),
+    args.props.get_str("in/odometry/ros/tf/name", "/tf"),
+    tf_odom_frame_id(args.props), tf_ignored_transforms(args.props),
+    args.props.get_uint("in/bag/prefetched_msgs_nm", 64)
+  };
+  scans.load_bag(bag);
+  return true;
+}
+
+template <typename MapType>
+void run_slam(std::shared_ptr<LaserScanGridWorld<MapType>> slam,
+              const ProgramArgs &args) {
+  auto traj_dumper = std::unique_ptr<RobotPoseTumTrajectoryDumper>{};
+  if (!args.traj_fname.empty()) {
+    traj_dumper = std::make_unique<RobotPoseTumTrajectoryDumper>(
+      args.traj_fname);
+  }
+
+  auto benchmark = std::unique_ptr<RunBenchmark>{};
+  if (!args.benchmark_fname.empty()) {
+    benchmark = std::make_unique<RunBenchmark>(args.slam_type);
+  }
+  auto decoding_secs = double{0};
+  if (args.is_scan_log()) {
+    auto scans = DecodedScans{};
+    auto decoding_start = std::chrono::steady_clock::now();
+    if (!load_scans(args, scans)) { std::exit(-1); }
+    decoding_secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - decoding_start).count();
+    if (benchmark) { benchmark->start(); }
+    replay_scans(slam, args.props, scans.records(), traj_dumper.get(),
+                 args.is_verbose, benchmark.get());
+  } else {
+    if (benchmark) { benchmark->start(); }
+    handle_bag(slam, args, traj_dumper.get(), benchmark.get());
+  }
+  // NB: the last scans may be still inserted by a mapping worker,
+  //     so they are waited for by the run
+  slam->wait_for_mapping();
+  report_map_failures(slam->map());
+  // NB: poses are written in background, i.e. may be pending
+  if (traj_dumper) { traj_dumper->flush(); }
+  if (benchmark) {
+    benchmark->finish();
+    write_benchmark_report(args, decoding_secs, {benchmark.get()});
+  }
+  dump_map(slam, args.map_fname, std::max(1u, args.threads_nm ?
+    args.threads_nm : std::thread::hardware_concurrency()));
+  dump_map_state(slam, args.map_state_fname);
+}
+
+/* Runs slams of configurations of a sweep file concurrently.
+ * PERFORMANCE: scans are decoded once and shared read-only by the runs,
+ *              so a sweep costs a single decoding and the slams are
+ *              limited by cores rather than by I/O. */
+void run_sweep(const ProgramArgs &args) {
+  auto configs = read_sweep_configs(args);
+  auto scans = DecodedScans{};
+  auto decoding_start = std::chrono::steady_clock::now();
+  if (configs.empty() || !load_scans(args, scans)) {
+    std::cerr << "[Error] No sweep configurations or scans" << std::endl;
+    std::exit(-1);
+  }
+  auto decoding_secs = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - decoding_start).count();
+  std::cout << "Decoded scans: " << scans.records().size() << std::endl;
+
+  // NB: slams are created one by one, only their runs are concurrent
+  auto runs = std::vector<std::function<void()>>{};
+  auto benchmarks = std::vector<std::unique_ptr<RunBenchmark>>{};
+  for (auto &config : configs) {
+    auto traj_fname = with_name_suffix(args.traj_fname, config.name);
+    auto map_fname = with_name_suffix(args.map_fname, config.name);
+    auto map_state_fname = with_name_suffix(args.map_state_fname,
+                                            config.name);
+    RunBenchmark *benchmark = nullptr;
+    if (!args.benchmark_fname.empty()) {
+      benchmarks.push_back(std::make_unique<RunBenchmark>(config.name));
+      benchmark = benchmarks.back().get();
+    }
+    with_slam(config.slam_type, config.props, [&](auto slam) {
+      using MapType = typename decltype(slam)::element_type::MapType;
+      runs.push_back([slam, &config, &scans, traj_fname, map_fname,
+                      map_state_fname, benchmark]() {
+        auto traj_dumper = std::unique_ptr<RobotPoseTumTrajectoryDumper>{};
+        if (!traj_fname.empty()) {
+          traj_dumper = std::make_unique<RobotPoseTumTrajectoryDumper>(
+            traj_fname);
+        }
+        if (benchmark) { benchmark->start(); }
+        replay_scans<MapType>(slam, config.props, scans.records(),
+                              traj_dumper.get(), false, benchmark);
+        slam->wait_for_mapping();
+        report_map_failures(slam->map());
+        if (traj_dumper) { traj_dumper->flush(); }
+        if (benchmark) { benchmark->finish(); }
+        dump_map<MapType>(slam, map_fname);
+        dump_map_state<MapType>(slam, map_state_fname);
+        std::cout << "Configuration " << config.name << " is done\n";
+      });
+    });
+  }
+
+  auto threads_nm = args.threads_nm ? args.threads_nm
+                                    : std::thread::hardware_concurrency();
+  threads_nm = std::max(1u, std::min<unsigned>(threads_nm, runs.size()));
+  // NB: parallel stages of the runs share the pool with the runs
+  ThreadPool::shared()->parallel_for(runs.size(), [&runs](std::size_t i) {
+    runs[i]();
+  }, threads_nm);
+
+  auto reports = std::vector<const RunBenchmark*>{};
+  for (auto &benchmark : benchmarks) { reports.push_back(benchmark.get()); }
+  write_benchmark_report(args, decoding_secs, reports);
+}
+
 int main(int argc, char** argv) {
   auto args = ProgramArgs{}.init(argv);
   if (!args.is_valid) {
@@ -125,14 +560,15 @@ int main(int argc, char** argv) {
     std::exit(-1);
   }
 
-  if (args.slam_type == "viny") {
-    run_slam<typename VinySlam::MapType>(init_viny_slam(args.props), args);
-  } else if (args.slam_type == "tiny") {
-    run_slam<typename TinySlam::MapType>(init_tiny_slam(args.props), args);
-  } else if (args.slam_type == "gmapping") {
-    run_slam<typename Gmapping::MapType>(init_gmapping(args.props), args);
-  } else {
-    std::cout << "Unkonw slam type: " << args.slam_type << std::endl;
+  ros::Time::init();
+  if (!args.sweep_fname.empty()) {
+    run_sweep(args);
+    return 0;
   }
+  with_slam(args.slam_type, args.props, [&args](auto slam) {
+    using MapType = typename decltype(slam)::element_type::MapType;
+    run_slam<MapType>(slam, args);
+    save_session_file(init_session_fname(args.props), *slam);
+  });
   return 0;
 }
@@ -1,59 +1,207 @@
 #ifndef SLAM_CTOR_ROS_OCCUPANCY_GRID_PUBLISHER_H
 #define SLAM_CTOR_ROS_OCCUPANCY_GRID_PUBLISHER_H
 
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
 #include <ros/ros.h>
+#include <boost/make_shared.hpp>
 #include <nav_msgs/OccupancyGrid.h>
+#include <map_msgs/OccupancyGridUpdate.h>
 
 #include "../core/states/state_data.h"
 #include "../core/maps/grid_map.h"
 
+/* Publishes the map as a nav_msgs/OccupancyGrid.
+ * The message is cached, so only areas modified since the previous
+ * publishing are refreshed and are sent as map_msgs/OccupancyGridUpdate
+ * patches (if an updates publisher is given); the whole map is sent
+ * on geometry changes and every Full_Map_Period publishing.
+ * A message cell may cover a square of downsampling_factor^2 map cells
+ * (e.g. for remote operators on constrained links), its value is
+ * the mean of known values of the square (a box filter).
+ * PERFORMANCE: cells are read by rows (see GridMap::row_occupancies)
+ *              to a preallocated message buffer; the publisher is expected
+ *              to get map snapshots on its own thread (see
+ *              AsyncGridMapObserver), so the conversion doesn't delay
+ *              the mapping. Messages are published by shared pointers,
+ *              so subscribers of the same process (e.g. nodelets) get
+ *              them without serialization.
+ */
 template <typename GridMapType>
 class OccupancyGridPublisher : public WorldMapObserver<GridMapType> {
+public: // consts
+  static constexpr unsigned Full_Map_Period = 10;
 public: // method
   OccupancyGridPublisher(ros::Publisher pub,
                          const std::string &tf_map_frame_id,
-                         double publ_interval_secs = 5.0):
-    _map_pub{pub}, _tf_map_frame_id{tf_map_frame_id},
-    _publishing_interval{publ_interval_secs} {}
+                         double publ_interval_secs = 5.0,
+                         ros::Publisher updates_pub = ros::Publisher{},
+                         unsigned downsampling_factor = 1):
+    _map_pub{pub}, _updates_pub{updates_pub},
+    _tf_map_frame_id{tf_map_frame_id},
+    _publishing_interval{publ_interval_secs},
+    _factor{std::max(1, int(downsampling_factor))} {}
 
   void on_map_update(const GridMapType &map) override {
     if ((ros::Time::now() - _last_pub_time) < _publishing_interval) {
       return;
     }
 
-    nav_msgs::OccupancyGrid map_msg;
-    map_msg.header.frame_id = _tf_map_frame_id;
-    map_msg.info.map_load_time = ros::Time::now();
-    map_msg.info.width = map.width();
-    map_msg.info.height = map.height();
-    map_msg.info.resolution = map.scale();
+    auto modified_area = map.modified_area(_published_version);
+    _published_version = map.version();
+    if (!_updates_pub || !is_cached_geometry(map) || !modified_area.is_known ||
+        Full_Map_Period <= ++_patches_nm) {
+      publish_full_map(map);
+    } else if (!modified_area.is_empty()) {
+      publish_patch(map, modified_area);
+    }
+    _last_pub_time = ros::Time::now();
+  }
+
+private: // methods
+
+  static int8_t cell_value(double value) {
+    return value == -1 ? -1 : value * 100;
+  }
+
+  bool is_cached_geometry(const GridMapType &map) const {
+    return _has_map_msg && _map_width == map.width() &&
+           _map_height == map.height() &&
+           _map_msg.info.resolution == float(map.scale() * _factor) &&
+           _map_msg_origin == map.origin();
+  }
+
+  void publish_full_map(const GridMapType &map) {
+    _map_width = map.width();
+    _map_height = map.height();
+    _map_msg.header.frame_id = _tf_map_frame_id;
+    _map_msg.info.map_load_time = ros::Time::now();
+    _map_msg.info.width = (_map_width + _factor - 1) / _factor;
+    _map_msg.info.height = (_map_height + _factor - 1) / _factor;
+    _map_msg.info.resolution = map.scale() * _factor;
     // move map to the middle
-    nav_msgs::MapMetaData &info = map_msg.info;
+    nav_msgs::MapMetaData &info = _map_msg.info;
     DiscretePoint2D origin = map.origin();
-    info.origin.position.x = -info.resolution * origin.x;
-    info.origin.position.y = -info.resolution * origin.y;
+    auto map_resolution = float(map.scale());
+    info.origin.position.x = -map_resolution * origin.x;
+    info.origin.position.y = -map_resolution * origin.y;
     info.origin.position.z = 0;
-    map_msg.data.reserve(info.height * info.width);
-    DiscretePoint2D pnt;
-    DiscretePoint2D end_of_map = DiscretePoint2D(info.width,
-                                                 info.height) - origin;
-    for (pnt.y = -origin.y; pnt.y < end_of_map.y; ++pnt.y) {
-      for (pnt.x = -origin.x; pnt.x < end_of_map.x; ++pnt.x) {
-        double value = (double)map[pnt];
-        int cell_value = value == -1 ? -1 : value * 100;
-        map_msg.data.push_back(cell_value);
+    // NB: the buffer is reallocated on growth only
+    _map_msg.data.resize(info.height * info.width);
+    refresh_cells(map, 0, 0, info.width - 1, info.height - 1, nullptr);
+
+    // NB: a published message must not be modified,
+    //     so the cached one is copied
+    _map_pub.publish(boost::make_shared<nav_msgs::OccupancyGrid>(_map_msg));
+    _has_map_msg = true;
+    _map_msg_origin = origin;
+    _patches_nm = 0;
+  }
+
+  void publish_patch(const GridMapType &map, const ModifiedGridArea &area) {
+    // NB: the geometry is cached, so the area is clipped by the message
+    auto origin = map.origin();
+    int min_x = std::max(0, area.min.x + origin.x);
+    int min_y = std::max(0, area.min.y + origin.y);
+    int max_x = std::min(_map_width - 1, area.max.x + origin.x);
+    int max_y = std::min(_map_height - 1, area.max.y + origin.y);
+    if (max_x < min_x || max_y < min_y) { return; }
+    // to message cells
+    min_x /= _factor;
+    min_y /= _factor;
+    max_x /= _factor;
+    max_y /= _factor;
+
+    auto patch_msg = boost::make_shared<map_msgs::OccupancyGridUpdate>();
+    patch_msg->header.frame_id = _tf_map_frame_id;
+    patch_msg->header.stamp = ros::Time::now();
+    patch_msg->x = min_x;
+    patch_msg->y = min_y;
+    patch_msg->width = max_x - min_x + 1;
+    patch_msg->height = max_y - min_y + 1;
+    patch_msg->data.resize(patch_msg->width * patch_msg->height);
+    refresh_cells(map, min_x, min_y, max_x, max_y, patch_msg->data.data());
+    _updates_pub.publish(patch_msg);
+  }
+
+  // Refreshes message cells of the given rectangle (and copies them
+  // to the patch buffer if it is given)
+  void refresh_cells(const GridMapType &map, int min_x, int min_y,
+                     int max_x, int max_y, int8_t *patch) {
+    auto origin = map.origin();
+    int cells_nm = max_x - min_x + 1;
+    int map_min_x = min_x * _factor;
+    int map_end_x = std::min(_map_width, (max_x + 1) * _factor);
+    _row_probs.resize(map_end_x - map_min_x);
+    _prob_sums.resize(cells_nm);
+    _known_probs_nm.resize(cells_nm);
+
+    for (int y = min_y; y <= max_y; ++y) {
+      auto row = &_map_msg.data[y * _map_msg.info.width + min_x];
+      if (_factor == 1) {
+        map.row_occupancies(DiscretePoint2D{map_min_x, y} - origin,
+                            cells_nm, _row_probs.data());
+        for (int i = 0; i < cells_nm; ++i) {
+          row[i] = cell_value(_row_probs[i]);
+        }
+      } else {
+        downsample_row(map, y, map_min_x, map_end_x, row);
+      }
+      if (patch) {
+        std::copy(row, row + cells_nm, patch + (y - min_y) * cells_nm);
       }
     }
+  }
 
-    _map_pub.publish(map_msg);
-    _last_pub_time = ros::Time::now();
+  // Sets a message row by means of squares of map cells (a box filter)
+  void downsample_row(const GridMapType &map, int y,
+                      int map_min_x, int map_end_x, int8_t *row) {
+    auto origin = map.origin();
+    std::fill(_prob_sums.begin(), _prob_sums.end(), 0.0);
+    std::fill(_known_probs_nm.begin(), _known_probs_nm.end(), 0);
+    int map_end_y = std::min(_map_height, (y + 1) * _factor);
+    int map_row_len = map_end_x - map_min_x;
+    for (int map_y = y * _factor; map_y < map_end_y; ++map_y) {
+      map.row_occupancies(DiscretePoint2D{map_min_x, map_y} - origin,
+                          map_row_len, _row_probs.data());
+      for (std::size_t i = 0; i < _prob_sums.size(); ++i) {
+        int begin = i * _factor, end = std::min(begin + _factor, map_row_len);
+        for (int map_x = begin; map_x < end; ++map_x) {
+          auto prob = _row_probs[map_x];
+          if (prob == -1) { continue; }
+          _prob_sums[i] += prob;
+          _known_probs_nm[i] += 1;
+        }
+      }
+    }
+    for (std::size_t i = 0; i < _prob_sums.size(); ++i) {
+      row[i] = _known_probs_nm[i] == 0 ? -1 :
+        cell_value(_prob_sums[i] / _known_probs_nm[i]);
+    }
   }
 
 private: // fields
-  ros::Publisher _map_pub;
+  ros::Publisher _map_pub, _updates_pub;
   std::string _tf_map_frame_id;
   ros::Time _last_pub_time;
   ros::Duration _publishing_interval;
+  int _factor;
+
+  nav_msgs::OccupancyGrid _map_msg;
+  bool _has_map_msg = false;
+  int _map_width = 0, _map_height = 0;
+  DiscretePoint2D _map_msg_origin;
+  uint64_t _published_version = 0;
+  unsigned _patches_nm = 0;
+
+  // buffers of the cells refresh
+  std::vector<double> _row_probs, _prob_sums;
+  std::vector<int> _known_probs_nm;
 };
 
+template <typename GridMapType>
+constexpr unsigned OccupancyGridPublisher<GridMapType>::Full_Map_Period;
+
 #endif
@@ -29,7 +29,7 @@ public: //methods
   }
 
   virtual void handle_transformed_msg(
-    const boost::shared_ptr<ObservationType>,
+    const boost::shared_ptr<const ObservationType>,
     const tf::StampedTransform& t) override {
     // work with 2D pose
     _last_odom2base = t;
@@ -0,0 +1,75 @@
+#ifndef SLAM_CTOR_ROS_PREFETCHING_BAG_TOPIC_H
+#define SLAM_CTOR_ROS_PREFETCHING_BAG_TOPIC_H
+
+#include <string>
+#include <thread>
+
+#include "../core/bounded_buffer.h"
+#include "bag_topic_with_transform.h"
+
+/* BagTopicWithTransform that extracts messages ahead of a consumer.
+ * PERFORMANCE: bag reading, message decoding and tf synchronization run
+ *              on a producer thread that fills a bounded buffer of synced
+ *              (msg, transform) pairs, so a consumer (e.g. a SLAM) doesn't
+ *              wait for I/O while the producer keeps up with it. */
+template <typename MsgType>
+class PrefetchingBagTopicWithTransform {
+private: // types
+  using Topic = BagTopicWithTransform<MsgType>;
+  struct SyncedMsg {
+    boost::shared_ptr<MsgType> msg;
+    tf::StampedTransform transform;
+  };
+public:
+  // NB: tf ignores are passed on construction since the producer starts
+  //     extraction immediately.
+  PrefetchingBagTopicWithTransform(
+      const std::string &bag_fname, const std::string &topic_name,
+      const std::string &tf_topic_name, const std::string &target_frame,
+      const typename Topic::Transforms &tf_ignores,
+      std::size_t prefetched_msgs_nm)
+    : _topic{bag_fname, topic_name, tf_topic_name, target_frame}
+    , _synced_msgs{prefetched_msgs_nm} {
+    _topic.set_tf_ignores(tf_ignores);
+    _producer = std::thread{&PrefetchingBagTopicWithTransform::prefetch, this};
+  }
+
+  ~PrefetchingBagTopicWithTransform() {
+    // NB: the producer stops on a rejected push
+    _synced_msgs.close();
+    _producer.join();
+  }
+
+  PrefetchingBagTopicWithTransform(
+    const PrefetchingBagTopicWithTransform&) = delete;
+  PrefetchingBagTopicWithTransform& operator=(
+    const PrefetchingBagTopicWithTransform&) = delete;
+
+  // Blocks until the next synced message is prefetched
+  bool extract_next_msg() { return _synced_msgs.pop(_current); }
+
+  const auto &msg() const { return _current.msg; }
+  const auto &transform() const { return _current.transform; }
+  auto timestamp() const {
+    return ros::message_traits::TimeStamp<MsgType>::value(*_current.msg);
+  }
+
+private: // methods
+
+  void prefetch() {
+    while (_topic.extract_next_msg()) {
+      if (!_synced_msgs.push(SyncedMsg{_topic.msg(), _topic.transform()})) {
+        break;
+      }
+    }
+    _synced_msgs.close();
+  }
+
+private: // fields
+  Topic _topic;
+  BoundedBuffer<SyncedMsg> _synced_msgs;
+  SyncedMsg _current;
+  std::thread _producer;
+};
+
+#endif
@@ -1,12 +1,14 @@
 #ifndef SLAM_CTOR_ROS_ROBOT_POSE_OBSERVERS_H
 #define SLAM_CTOR_ROS_ROBOT_POSE_OBSERVERS_H
 
-#include <fstream>
+#include <cstdio>
+#include <algorithm>
 #include <ros/ros.h>
 #include <tf/transform_broadcaster.h>
 
 #include "topic_with_transform.h"
 #include "../core/states/world.h"
+#include "../utils/async_file_writer.h"
 
 class RobotPoseTfPublisher : public WorldPoseObserver {
 public: //methods
@@ -46,7 +48,7 @@ public:
     : RobotPoseTfPublisher{tf_map_frame_id, tf_robot_frame_id} {}
 
   void handle_transformed_msg(
-    const boost::shared_ptr<ObsType> obs,
+    const boost::shared_ptr<const ObsType> obs,
     const tf::StampedTransform&) override {
 
     _observation_time = ros::message_traits::TimeStamp<ObsType>::value(*obs);
@@ -62,11 +64,14 @@ private:
   ros::Time _observation_time;
 };
 
+/* Logs robot poses in the TUM format.
+ * PERFORMANCE: records are formatted to memory and are written to the file
+ *              by a background thread (see AsyncFileWriter). */
 class RobotPoseTumTrajectoryDumper : public WorldPoseObserver {
 public:
   RobotPoseTumTrajectoryDumper(const std::string &fname,
                                bool flush_every_entry = false)
-    : _fstream{fname, std::ios::out}
+    : _writer{fname}
     , _flush_every_entry{flush_every_entry} {}
 
   void on_pose_update(const RobotPose &pose) override {
@@ -75,17 +80,24 @@ public:
 
   void log_robot_pose(const ros::Time &time,  const RobotPose &pose) {
     auto q = tf::createQuaternionFromRPY(0, 0, pose.theta);
-    _fstream << time.sec << '.' << time.nsec
-             << ' ' << pose.x << ' ' << pose.y << ' ' << '0'
-             << ' ' << q.x() << ' ' << q.y() << ' ' << q.z() << ' ' << q.w()
-             << '\n';
+    // NB: %g is the default format of doubles of a stream
+    char record[256];
+    int record_size = std::snprintf(
+      record, sizeof(record), "%u.%u %g %g 0 %g %g %g %g\n",
+      time.sec, time.nsec, pose.x, pose.y, q.x(), q.y(), q.z(), q.w());
+    _writer.write(record, std::min<std::size_t>(record_size,
+                                                sizeof(record) - 1));
     if (_flush_every_entry) {
-      _fstream.flush();
+      _writer.flush();
     }
   }
 
+  // Blocks until logged poses are written to the file
+  // (NB: is done on destruction as well)
+  void flush() { _writer.flush(); }
+
 private:
-  std::ofstream _fstream;
+  AsyncFileWriter _writer;
   bool _flush_every_entry;
 };
 
@@ -0,0 +1,33 @@
+#ifndef SLAM_CTOR_ROS_SLAM_NODELET_H
+#define SLAM_CTOR_ROS_SLAM_NODELET_H
+
+#include <ros/ros.h>
+#include <nodelet/nodelet.h>
+
+#include "launch_properties_provider.h"
+#include "init_utils.h"
+
+/* A SLAM that runs in a nodelet manager's process, e.g. with a laser
+ * driver and a planner.
+ * PERFORMANCE: scans are got and maps are published by shared pointers,
+ *              so messages between nodelets of the same manager are
+ *              neither serialized nor copied by roscpp. */
+class SlamNodelet : public nodelet::Nodelet {
+protected:
+  // Connects a slam to data providers and publishers (see *_node.h)
+  virtual SlamNodePins start_node(ros::NodeHandle nh,
+                                  const PropertiesProvider &props) = 0;
+
+private: // methods
+
+  void onInit() override {
+    // NB: properties are private parameters of the nodelet
+    auto props = LaunchPropertiesProvider{getPrivateNodeHandle()};
+    _node_pins = start_node(getNodeHandle(), props);
+  }
+
+private: // fields
+  SlamNodePins _node_pins;
+};
+
+#endif
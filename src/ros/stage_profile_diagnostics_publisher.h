@@ -0,0 +1,105 @@
+#ifndef SLAM_CTOR_ROS_STAGE_PROFILE_DIAGNOSTICS_PUBLISHER_H
+#define SLAM_CTOR_ROS_STAGE_PROFILE_DIAGNOSTICS_PUBLISHER_H
+
+#include <string>
+#include <sstream>
+
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include "../core/stage_profiler.h"
+
+/* Publishes stage latencies, the map memory and allocations of a report
+ * (see StageProfiler) as a status of a diagnostics array,
+ * i.e. they are shown by rqt_runtime_monitor. */
+class StageProfileDiagnosticsPublisher : public StageProfileObserver {
+public:
+  StageProfileDiagnosticsPublisher(ros::Publisher pub,
+                                   const std::string &status_name)
+    : _pub{pub}, _status_name{status_name} {}
+
+  void on_stage_profile(const StageProfile &profile) override {
+    auto status = diagnostic_msgs::DiagnosticStatus{};
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = _status_name;
+    status.message = std::to_string(profile.cycles_nm) + " scans in " +
+                     to_string(profile.period_secs) + " s";
+    for (std::size_t i = 0; i < Slam_Stages_Nm; ++i) {
+      auto &s = profile.stages[i];
+      if (s.count == 0) { continue; }
+      auto stage = std::string{slam_stage_name(static_cast<SlamStage>(i))};
+      add_value(status, stage + " count", std::to_string(s.count));
+      add_value(status, stage + " p50, ms", to_string(s.p50));
+      add_value(status, stage + " p95, ms", to_string(s.p95));
+      add_value(status, stage + " p99, ms", to_string(s.p99));
+      add_value(status, stage + " max, ms", to_string(s.max));
+    }
+    add_map_memory_values(status, profile.map_memory);
+    add_allocation_values(status, profile);
+
+    auto msg = diagnostic_msgs::DiagnosticArray{};
+    msg.header.stamp = ros::Time::now();
+    msg.status.push_back(std::move(status));
+    _pub.publish(msg);
+  }
+
+private: // methods
+
+  static void add_map_memory_values(diagnostic_msgs::DiagnosticStatus &status,
+                                    const GridMapMemoryUsage &mem) {
+    if (mem.total_bytes() == 0) { return; }
+    add_value(status, "map, MB", to_string(to_mb(mem.total_bytes())));
+    add_value(status, "map cells, MB", to_string(to_mb(mem.cells_bytes)));
+    add_value(status, "map amortized, MB",
+              to_string(to_mb(mem.amortized_bytes)));
+    add_value(status, "map tiles", std::to_string(mem.tiles_nm));
+    add_value(status, "map shared tiles", std::to_string(mem.shared_tiles_nm));
+    for (std::size_t i = 0; i < mem.levels_bytes.size(); ++i) {
+      add_value(status, "map level " + std::to_string(i) + ", MB",
+                to_string(to_mb(mem.levels_bytes[i])));
+    }
+  }
+
+  static void add_allocation_values(diagnostic_msgs::DiagnosticStatus &status,
+                                    const StageProfile &profile) {
+    if (!Allocations_Are_Tracked || profile.allocation_scans_nm == 0) {
+      return;
+    }
+    auto &scan_allocs = profile.scan_allocations;
+    add_value(status, "allocs/scan",
+              to_string(profile.allocs_per_scan(scan_allocs.allocs_nm)));
+    add_value(status, "allocs/scan max",
+              std::to_string(profile.max_scan_allocs_nm));
+    add_value(status, "allocated/scan, KB",
+              to_string(profile.allocs_per_scan(scan_allocs.bytes) / 1e3));
+    for (std::size_t i = 0; i < Slam_Stages_Nm; ++i) {
+      if (profile.stages[i].count == 0) { continue; }
+      auto stage = std::string{slam_stage_name(static_cast<SlamStage>(i))};
+      add_value(status, stage + " allocs/scan",
+                to_string(profile.stage_allocs_per_scan(i)));
+    }
+  }
+
+  static void add_value(diagnostic_msgs::DiagnosticStatus &status,
+                        const std::string &key, const std::string &value) {
+    auto kv = diagnostic_msgs::KeyValue{};
+    kv.key = key;
+    kv.value = value;
+    status.values.push_back(std::move(kv));
+  }
+
+  static std::string to_string(double value) {
+    auto ss = std::ostringstream{};
+    ss.precision(3);
+    ss << std::fixed << value;
+    return ss.str();
+  }
+
+  static double to_mb(std::size_t bytes) { return bytes / 1e6; }
+
+private: // fields
+  ros::Publisher _pub;
+  std::string _status_name;
+};
+
+#endif
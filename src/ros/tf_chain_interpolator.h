@@ -0,0 +1,135 @@
+#ifndef SLAM_CTOR_ROS_TF_CHAIN_INTERPOLATOR_H
+#define SLAM_CTOR_ROS_TF_CHAIN_INTERPOLATOR_H
+
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+
+#include <tf/tf.h>
+
+/* Interpolates a transform between two frames of a short chain (e.g.
+ * odom -> base_link -> laser) by transforms of its links that are kept
+ * for a bounded time window.
+ * PERFORMANCE: unlike tf::Transformer, a lookup walks child -> parent
+ *              links only, finds samples with a binary search and
+ *              reports a not ready transform by a status rather than by
+ *              an exception; memory is bounded by the window, so it
+ *              doesn't grow with the length of a bag. */
+class TfChainInterpolator {
+public: // types
+  enum class LookupStatus {
+    Ok,
+    // newer transforms are expected (e.g. the time is not reached yet)
+    NotReady,
+    // the time precedes kept transforms (i.e. it is out of the window)
+    Expired
+  };
+private: // types
+  struct Link {
+    std::string parent;
+    // sorted by stamps
+    std::deque<tf::StampedTransform> samples;
+  };
+public:
+  explicit TfChainInterpolator(double window_sec = 10.0)
+    : _window{window_sec} {}
+
+  void add_transform(const tf::StampedTransform &st) {
+    auto &link = _links[frame_name(st.child_frame_id_)];
+    auto parent = frame_name(st.frame_id_);
+    if (link.parent != parent) {
+      // NB: the tree is changed, the link's history is irrelevant
+      link.parent = std::move(parent);
+      link.samples.clear();
+    }
+
+    auto &samples = link.samples;
+    if (samples.empty() || samples.back().stamp_ <= st.stamp_) {
+      samples.push_back(st);
+    } else {
+      samples.insert(std::upper_bound(samples.begin(), samples.end(), st,
+                                      stamp_is_less), st);
+    }
+    // NB: a sample at or before the window start is kept to interpolate
+    auto window_start = samples.back().stamp_ - ros::Duration{_window};
+    while (2 < samples.size() && samples[1].stamp_ <= window_start) {
+      samples.pop_front();
+    }
+  }
+
+  // Finds the transform from the source frame to the target one
+  LookupStatus lookup(const std::string &target_frame,
+                      const std::string &source_frame,
+                      const ros::Time &time,
+                      tf::StampedTransform &result) const {
+    auto target = frame_name(target_frame);
+    auto frame = frame_name(source_frame);
+    auto transform = tf::Transform::getIdentity();
+    for (unsigned links_nm = 0; frame != target; ++links_nm) {
+      auto link = _links.find(frame);
+      if (link == _links.end() || Max_Chain_Length <= links_nm) {
+        // NB: a missing link may be published later
+        return LookupStatus::NotReady;
+      }
+      auto link_transform = tf::Transform{};
+      auto status = interpolate(link->second.samples, time, link_transform);
+      if (status != LookupStatus::Ok) { return status; }
+      transform = link_transform * transform;
+      frame = link->second.parent;
+    }
+    result = tf::StampedTransform{transform, time, target_frame, source_frame};
+    return LookupStatus::Ok;
+  }
+
+private: // consts
+  static constexpr unsigned Max_Chain_Length = 16;
+private: // methods
+
+  static bool stamp_is_less(const tf::StampedTransform &a,
+                            const tf::StampedTransform &b) {
+    return a.stamp_ < b.stamp_;
+  }
+
+  // NB: frame ids of old bags may have a leading slash
+  static std::string frame_name(const std::string &frame_id) {
+    return !frame_id.empty() && frame_id[0] == '/' ? frame_id.substr(1)
+                                                   : frame_id;
+  }
+
+  static LookupStatus interpolate(
+      const std::deque<tf::StampedTransform> &samples,
+      const ros::Time &time, tf::Transform &transform) {
+    if (samples.size() == 1) {
+      // NB: a single sample is treated as a static transform (like tf)
+      transform = samples.front();
+      return LookupStatus::Ok;
+    }
+    auto next = std::upper_bound(
+      samples.begin(), samples.end(), time,
+      [](const ros::Time &t, const tf::StampedTransform &s) {
+        return t < s.stamp_;
+      });
+    if (next == samples.end()) {
+      if (samples.back().stamp_ != time) { return LookupStatus::NotReady; }
+      transform = samples.back();
+      return LookupStatus::Ok;
+    }
+    if (next == samples.begin()) { return LookupStatus::Expired; }
+
+    auto &prev = *(next - 1);
+    auto span = (next->stamp_ - prev.stamp_).toSec();
+    auto ratio = 0 < span ? (time - prev.stamp_).toSec() / span : 0.0;
+    transform.setOrigin(prev.getOrigin().lerp(next->getOrigin(), ratio));
+    transform.setRotation(prev.getRotation().slerp(next->getRotation(),
+                                                   ratio));
+    return LookupStatus::Ok;
+  }
+
+private: // fields
+  double _window;
+  // links by child frames
+  std::unordered_map<std::string, Link> _links;
+};
+
+#endif
@@ -2,6 +2,8 @@
 #define SLAM_CTOR_ROS_TOPIC_WITH_TRANSFORM_H
 
 #include <string>
+#include <utility>
+#include <algorithm>
 #include <vector>
 #include <memory>
 #include <message_filters/subscriber.h>
@@ -9,17 +11,39 @@
 #include <tf/transform_listener.h>
 #include <boost/shared_ptr.hpp>
 
+#include "../core/load_shedding_dispatcher.h"
+
 // TODO: make this class inner
+// NB: messages are shared by observers (and by other nodelets of
+//     a process), so they are const; a non-const message would be copied
+//     by roscpp on delivery.
 template <typename MType>
 class TopicObserver { // iface
+public: // types
+  using MsgWithTransform = std::pair<boost::shared_ptr<const MType>,
+                                     tf::StampedTransform>;
 public: // methods
-  virtual void handle_transformed_msg(const boost::shared_ptr<MType>,
+  virtual void handle_transformed_msg(const boost::shared_ptr<const MType>,
                                       const tf::StampedTransform&) = 0;
+
+  // Messages that have queued up while the observer was busy
+  // (see OverloadPolicy::CatchUp) in the arrival order
+  virtual void handle_transformed_msgs(
+      const std::vector<MsgWithTransform> &msgs) {
+    for (auto &msg : msgs) { handle_transformed_msg(msg.first, msg.second); }
+  }
 };
 
-// TODO: add scan drop
+/* Messages of a topic with transforms to a target frame.
+ * NB: by default messages are handled by the ros callback, so messages
+ *     that come while observers are busy wait in ros queues and the
+ *     delay of the handling grows if observers (e.g. a slam) are slower
+ *     than the topic; an overload policy (see LoadSheddingDispatcher)
+ *     drops such messages instead. */
 template <typename MsgType>
 class TopicWithTransform {
+  using MsgWithTransform =
+    typename TopicObserver<MsgType>::MsgWithTransform;
   /* NB: wasn't able to implement with TF2 (ROS jade),
          probably because of deadlock
            (https://github.com/ros/geometry2/pull/144)
@@ -32,8 +56,16 @@ public: // methods
                      const std::string& target_frame,
                      const double buffer_duration = 5.0,
                      const uint32_t tf_filter_queue_size = 1000,
-                     const uint32_t subscribers_queue_size = 1000):
+                     const uint32_t subscribers_queue_size = 1000,
+                     const LoadSheddingParams &shedding_params = {},
+                     const double stats_log_period = 0):
     _target_frame{target_frame},
+    _stats_log_period{stats_log_period},
+    _dispatcher{shedding_params, [this](MsgWithTransform &msg) {
+      notify_observers(msg.first, msg.second);
+    }, [this](std::vector<MsgWithTransform> &msgs) {
+      notify_observers(msgs);
+    }},
     _subscr{nh, topic_name, subscribers_queue_size},
     _tf_lsnr{ros::Duration(buffer_duration)},
     _msg_flt{new tf::MessageFilter<MsgType>{
@@ -45,8 +77,10 @@ public: // methods
   void subscribe(std::shared_ptr<TopicObserver<MsgType>> obs) {
     _observers.push_back(obs);
   }
+
+  LoadSheddingStats stats() const { return _dispatcher.stats(); }
 private: // methods
-  void transformed_msg_cb(const boost::shared_ptr<MsgType> msg) {
+  void transformed_msg_cb(const boost::shared_ptr<const MsgType> &msg) {
     tf::StampedTransform transform;
     std::string msg_frame_id =
       ros::message_traits::FrameId<MsgType>::value(*msg);
@@ -64,18 +98,55 @@ private: // methods
       return;
     }
 
+    _dispatcher.dispatch(MsgWithTransform{msg, transform});
+  }
+
+  void notify_observers(const boost::shared_ptr<const MsgType> &msg,
+                        const tf::StampedTransform &transform) {
     for (auto obs : _observers) {
       if (auto obs_ptr = obs.lock()) {
         obs_ptr->handle_transformed_msg(msg, transform);
       }
     }
+    update_stats(transform);
+  }
+
+  void notify_observers(const std::vector<MsgWithTransform> &msgs) {
+    for (auto obs : _observers) {
+      if (auto obs_ptr = obs.lock()) {
+        obs_ptr->handle_transformed_msgs(msgs);
+      }
+    }
+    // NB: the oldest message has the max latency
+    update_stats(msgs.front().second);
+  }
+
+  void update_stats(const tf::StampedTransform &transform) {
+    auto now = ros::Time::now();
+    auto latency = (now - transform.stamp_).toSec();
+    _max_latency = std::max(_max_latency, latency);
+    if (_stats_log_period <= 0 ||
+        (now - _last_stats_log_time).toSec() < _stats_log_period) {
+      return;
+    }
+    auto stats = _dispatcher.stats();
+    ROS_INFO("Topic messages: %zu received, %zu dropped, %zu pending; "
+             "max latency %.3f s", stats.received_nm, stats.dropped_nm,
+             stats.pending_nm, _max_latency);
+    _last_stats_log_time = now;
+    _max_latency = 0;
   }
 private: // fields
   std::string _target_frame;
+  std::vector<std::weak_ptr<TopicObserver<MsgType>>> _observers;
+  // latency (ros now - msg stamp) stats, updated by the handling thread
+  double _stats_log_period, _max_latency = 0;
+  ros::Time _last_stats_log_time;
+  // NB: is destroyed after ros callbacks and before observers
+  LoadSheddingDispatcher<MsgWithTransform> _dispatcher;
   message_filters::Subscriber<MsgType> _subscr;
   tf::TransformListener _tf_lsnr;
   std::unique_ptr<tf::MessageFilter<MsgType>> _msg_flt;
-  std::vector<std::weak_ptr<TopicObserver<MsgType>>> _observers;
 };
 
 #endif // macro guard
@@ -15,15 +15,22 @@ public:
     refresh_grid_cell();
   }
 
+  explicit CredibilistCell(const TBM &belief)
+    : GridCell{Occupancy()}, _belief{belief} {
+    refresh_grid_cell();
+  }
+
   std::unique_ptr<GridCell> clone() const override {
     return std::make_unique<CredibilistCell>(*this);
   }
 
+  std::size_t memory_size() const override { return sizeof(*this); }
+
   //update the map using the scan information
   void operator+=(const AreaOccupancyObservation &aoo) override {
     if (!aoo.occupancy.is_valid()) return;
-    _belief = conjunctive(_belief, AOO_to_TBM(aoo));
-    _belief.normalize_conflict();
+    auto masses = AOO_to_masses(aoo);
+    _belief = conjunctive_normalized(_belief, masses.empty, masses.occupied);
     refresh_grid_cell();
   }
   
@@ -17,6 +17,8 @@ public:
     return std::make_unique<GmappingBaseCell>(*this);
   }
 
+  std::size_t memory_size() const override { return sizeof(*this); }
+
   void operator+=(const AreaOccupancyObservation &aoo) override {
     if (!aoo.occupancy.is_valid()) { return; }
 
@@ -36,6 +38,19 @@ public:
     return 1.0 - similarity;
   }
 
+  std::vector<char> serialize() const override {
+    Serializer s(GridCell::serialize());
+    s << _hits << _tries << obst.x << obst.y;
+    return s.result();
+  }
+
+  std::size_t deserialize(const std::vector<char>& data,
+                          std::size_t pos = 0) override {
+    Deserializer d(data, GridCell::deserialize(data, pos));
+    d >> _hits >> _tries >> obst.x >> obst.y;
+    return d.pos();
+  }
+
 private:
   int _hits, _tries;
   Point2D obst;
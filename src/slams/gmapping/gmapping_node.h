@@ -0,0 +1,68 @@
+#ifndef SLAM_CTOR_SLAMS_GMAPPING_NODE_H
+#define SLAM_CTOR_SLAMS_GMAPPING_NODE_H
+
+#include <memory>
+
+#include <ros/ros.h>
+#include <sensor_msgs/LaserScan.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include "../../ros/topic_with_transform.h"
+#include "../../ros/laser_scan_observer.h"
+#include "../../ros/init_utils.h"
+
+#include "init_gmapping.h"
+
+// Connects GMapping to ros-topic based data providers and publishers
+// (both for a node and for a nodelet)
+inline SlamNodePins start_gmapping_node(ros::NodeHandle nh,
+                                        const PropertiesProvider &props) {
+  using ObservT = sensor_msgs::LaserScan;
+
+  auto slam = init_gmapping(props);
+
+  // TODO: code duplication (viny.cpp)
+  double ros_map_publishing_rate, ros_tf_buffer_size;
+  int ros_filter_queue, ros_subscr_queue;
+  init_constants_for_ros(props, ros_tf_buffer_size, ros_map_publishing_rate,
+                         ros_filter_queue, ros_subscr_queue);
+  auto scan_provider = std::make_unique<TopicWithTransform<ObservT>>(
+    nh, laser_scan_2D_ros_topic_name(props), tf_odom_frame_id(props),
+    ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue,
+    get_scan_load_shedding_params(props), get_scan_stats_log_period(props)
+  );
+  auto occup_grid_pub_pin = create_occupancy_grid_publisher(
+    slam.get(), nh, ros_map_publishing_rate, props);
+
+  auto pose_pub_pin = create_pose_correction_tf_publisher(
+    slam.get(), scan_provider.get(), props);
+  // publish a "raw" robot pose to be compatible with test service
+  // use ObservationStampedPublishing to be compatible with TUM evaluator
+  auto rp_pub_pin = make_pose_correction_observation_stamped_publisher(
+    slam.get(), scan_provider.get(), props);
+
+  // TODO: setup scan skip policy via param
+  auto scan_obs_pin = std::make_shared<LaserScanObserver>(
+    slam, get_skip_exceeding_lsr(props), get_use_trig_cache(props),
+    get_scan_downsampler(props), slam->stage_profiler());
+  init_stage_profile_diagnostics(slam->stage_profiler(), nh, props);
+  // NB: pose_pub_pin must be subscribed first
+  auto scan_inputs_pin = subscribe_laser_scan_observer(
+    nh, scan_provider.get(), scan_obs_pin, props,
+    ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue);
+
+  auto pins = SlamNodePins{};
+  // NB: pins are released in reverse order, so the session is saved
+  //     once scans are not handled
+  pins.keep(make_session_saver(slam, props));
+  pins.keep(slam);
+  pins.keep(occup_grid_pub_pin);
+  pins.keep(pose_pub_pin);
+  pins.keep(rp_pub_pin);
+  pins.keep(scan_obs_pin);
+  pins.keep(std::move(scan_provider));
+  pins.keep(std::move(scan_inputs_pin));
+  return pins;
+}
+
+#endif
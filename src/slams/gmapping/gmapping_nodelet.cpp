@@ -0,0 +1,18 @@
+#include <pluginlib/class_list_macros.h>
+
+#include "../../ros/slam_nodelet.h"
+#include "gmapping_node.h"
+
+namespace slam_constructor {
+
+class GMappingNodelet : public SlamNodelet {
+protected:
+  SlamNodePins start_node(ros::NodeHandle nh,
+                          const PropertiesProvider &props) override {
+    return start_gmapping_node(nh, props);
+  }
+};
+
+} // namespace slam_constructor
+
+PLUGINLIB_EXPORT_CLASS(slam_constructor::GMappingNodelet, nodelet::Nodelet)
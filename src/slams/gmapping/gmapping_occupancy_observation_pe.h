@@ -3,44 +3,59 @@
 
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 
 #include "../../core/scan_matchers/occupancy_observation_probability.h"
 #include "../../core/geometry_utils.h"
 
+/* The probability of an obstacle observation is the best match of
+ * the obstacle with a full cell (its occupancy is above the threshold)
+ * of a (2 * window + 1)^2 cells neighbourhood.
+ * NB: the estimator keeps no state, so it may be shared by threads
+ *     (e.g. particles observed concurrently).
+ * PERFORMANCE: the neighbourhood is read by rows of occupancies
+ *              (see GridMap::row_occupancies), so a row costs a single
+ *              virtual call; discrepancies are estimated for full cells
+ *              only that are rare (obstacles). */
 class GmappingOccupancyObservationPE
   : public OccupancyObservationProbabilityEstimator {
+private: // consts
+  // NB: a longer window row is read by chunks
+  static constexpr int Max_Row_Chunk = 32;
 public:
   GmappingOccupancyObservationPE(double fullness_th, unsigned window_size)
-    : Fullness_Th{fullness_th}, Window_Sz{int(window_size)}, _cached_prob{-1} {}
+    : Fullness_Th{fullness_th}, Window_Sz{int(window_size)} {}
+
   double probability(const AreaOccupancyObservation &aoo,
                      const LightWeightRectangle &,
                      const GridMap &map) const override {
     assert(aoo.is_occupied);
     auto sp_coord = map.world_to_cell(aoo.obstacle);
-    if (sp_coord == _cached_coord && _cached_prob != -1) {
-      return _cached_prob;
-    }
 
     double best_prob = 0;
-    for (int d_x = -Window_Sz; d_x <= Window_Sz; ++d_x) {
-      for (int d_y = -Window_Sz; d_y <= Window_Sz; ++d_y) {
-        auto cell_coord = sp_coord + DiscretePoint2D{d_x, d_y};
-        const auto &cell = map[cell_coord];
-        if (cell < Fullness_Th) { continue; }
-        best_prob = std::max(best_prob, 1.0 - cell.discrepancy(aoo));
+    double occupancies[Max_Row_Chunk];
+    for (int d_y = -Window_Sz; d_y <= Window_Sz; ++d_y) {
+      for (int d_x = -Window_Sz; d_x <= Window_Sz; d_x += Max_Row_Chunk) {
+        auto chunk_coord = sp_coord + DiscretePoint2D{d_x, d_y};
+        // NB: the const is not bound to a reference (std::min),
+        //     so it needs no definition out of the class
+        int chunk_len = Window_Sz - d_x + 1;
+        if (Max_Row_Chunk < chunk_len) { chunk_len = Max_Row_Chunk; }
+        map.row_occupancies(chunk_coord, chunk_len, occupancies);
+        for (int i = 0; i < chunk_len; ++i) {
+          if (occupancies[i] < Fullness_Th) { continue; }
+          auto cell_coord = chunk_coord + DiscretePoint2D{i, 0};
+          best_prob = std::max(best_prob,
+                               1.0 - map.discrepancy(cell_coord, aoo));
+        }
       }
     }
-
-    _cached_coord = sp_coord;
-    return _cached_prob = best_prob;
+    return best_prob;
   }
 
 private:
   const double Fullness_Th;
   const int Window_Sz;
-  mutable DiscretePoint2D _cached_coord;
-  mutable double _cached_prob;
 };
 
-
 #endif
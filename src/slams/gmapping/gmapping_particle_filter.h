@@ -4,9 +4,12 @@
 #include <memory>
 #include <vector>
 #include <cmath>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <iomanip>
 
+#include "../../core/thread_pool.h"
 #include "../../core/states/laser_scan_grid_world.h"
 #include "../../core/particle_filter.h"
 #include "gmapping_world.h"
@@ -15,14 +18,26 @@ class GmappingParticleFactory : public ParticleFactory<GmappingWorld> {
 public:
   GmappingParticleFactory(const SingleStateHypothesisLSGWProperties &shw_p,
                           const GMappingParams& gprms)
-    : _shw_p(shw_p), _gprms(gprms) {}
+    : _shw_p(shw_p), _gprms(gprms), _rnd_streams{gprms.seed} {}
 
+  // NB: particles are created and copied sequentially, so a particle
+  //     gets the same stream of the master seed in each run
   std::shared_ptr<GmappingWorld> create_particle() override {
-    return std::make_shared<GmappingWorld>(_shw_p, _gprms);
+    return std::make_shared<GmappingWorld>(_shw_p, _gprms,
+                                           _rnd_streams.next_engine());
+  }
+
+  // NB: the copy shares map tiles with the particle
+  std::shared_ptr<GmappingWorld> clone_particle(
+      const GmappingWorld &p) override {
+    auto copy = std::make_shared<GmappingWorld>(p);
+    copy->set_random_engine(_rnd_streams.next_engine());
+    return copy;
   }
 private:
   const SingleStateHypothesisLSGWProperties _shw_p;
   const GMappingParams _gprms;
+  RandomStreams _rnd_streams;
 };
 
 // TODO: add restriction on particle type
@@ -31,11 +46,24 @@ class GmappingParticleFilter :
 public:
   using MapType = GmappingWorld::MapType;
   using WorldT = LaserScanGridWorld<MapType>;
+  // Instances a thread matches and inserts scans with
+  struct ObservationHandlers {
+    std::shared_ptr<GridScanMatcher> gsm;
+    std::shared_ptr<GridMapScanAdder> gmsa;
+  };
+  using ObservationHandlersFactory = std::function<ObservationHandlers()>;
+public: // consts
+  // a session of another format is rejected (see load_session)
+  // NB: the consts are not bound to references, so they need
+  //     no definitions out of the class
+  static constexpr uint32_t Session_Magic = 0x53504d47; // "GMPS"
+  static constexpr uint32_t Session_Version = 2;
 public: // methods
 
   GmappingParticleFilter(const SingleStateHypothesisLSGWProperties &shw_p,
                          const GMappingParams& gprms, unsigned n = 1):
-    _pf(std::make_shared<GmappingParticleFactory>(shw_p, gprms), n) {
+    _pf(std::make_shared<GmappingParticleFactory>(shw_p, gprms), n)
+    , _stage_profiler{shw_p.stage_profiler} {
 
     for (auto &p : _pf.particles()) {
       p->sample();
@@ -43,11 +71,52 @@ public: // methods
     _pf.heaviest_particle().mark_master();
   }
 
+  void set_resampler(std::shared_ptr<ParticleResampler> resampler) {
+    _pf.set_resampler(resampler);
+  }
+
+  void set_particles_nm_adaptation(
+      std::shared_ptr<ParticlesNumberAdaptation<GmappingWorld>> adaptation) {
+    _pf.set_particles_nm_adaptation(adaptation);
+  }
+
+  // Particles are independent until their weights are normalized,
+  // so observations of particles are handled by threads_nm threads.
+  // Each thread uses own handlers (and a copy of a scan) since matchers,
+  // estimators and adders keep mutable state.
+  // NB: handlers are per thread rather than per particle, since particles
+  //     are copied by resampling.
+  void set_observation_threads(unsigned threads_nm,
+                               ObservationHandlersFactory handlers_factory) {
+    _workers.clear();
+    if (threads_nm < 2) { return; }
+    _workers.resize(threads_nm);
+    for (auto &worker : _workers) { worker.handlers = handlers_factory(); }
+  }
+
   void handle_sensor_data(TransformedLaserScan &scan) override {
     update_robot_pose(scan.pose_delta);
     handle_observation(scan);
-    notify_with_pose(pose());
-    notify_with_map(map());
+    {
+      StageTimer timer{_stage_profiler, SlamStage::ObserversNotification};
+      notify_with_pose(pose());
+      notify_with_map(map());
+    }
+    if (_stage_profiler) {
+      _stage_profiler->finish_cycle([this]() { return maps_memory_usage(); });
+    }
+  }
+
+  std::shared_ptr<StageProfiler> stage_profiler() const override {
+    return _stage_profiler;
+  }
+
+  // Totals of particles' maps; amortized bytes count a tile shared
+  // by particles once
+  GridMapMemoryUsage maps_memory_usage() const override {
+    auto usage = GridMapMemoryUsage{};
+    for (auto &p : _pf.particles()) { usage += p->maps_memory_usage(); }
+    return usage;
   }
 
   void update_robot_pose(const RobotPoseDelta& delta) override {
@@ -61,19 +130,131 @@ public: // methods
     return _pf.heaviest_particle();
   }
 
+  // Tiles of particles' maps by their sharing (in particles' order)
+  std::vector<TileSharingStats> tile_sharing_stats() const {
+    auto stats = std::vector<TileSharingStats>{};
+    for (auto &p : _pf.particles()) {
+      stats.push_back(p->map().tile_sharing_stats());
+    }
+    return stats;
+  }
+
+  void wait_for_mapping() override {
+    for (auto &p : _pf.particles()) { p->wait_for_mapping(); }
+  }
+
   const RobotPose& pose() const override { return world().pose(); }
   const GmappingWorld::MapType& map() const override { return world().map(); }
+  GmappingWorld::MapType& map() override {
+    return _pf.heaviest_particle().map();
+  }
+
+  // The state to resume the filter from: particles (their robot states,
+  // weights and map layouts) and tiles of their maps.
+  // PERFORMANCE: a tile shared by particles (i.e. not modified since
+  //              they have been resampled from the same one) is saved once.
+  std::vector<char> save_session() const {
+    auto tiles = MapType::TileTable{};
+    auto particles = Serializer{};
+    for (auto &p : _pf.particles()) {
+      p->save_robot_state(particles);
+      p->save_map_layout(particles, tiles);
+    }
+
+    auto s = Serializer{};
+    s << Session_Magic << Session_Version << uint32_t(sizeof(Real))
+      << _traversed_since_last_resample.x << _traversed_since_last_resample.y
+      << _traversed_since_last_resample.theta
+      << uint64_t(_pf.particles().size());
+    tiles.save(s);
+    s.append(particles.result());
+    return s.result();
+  }
+
+  // Resumes a session saved by save_session (the particles number is
+  // the saved one); returns false if the data is not a session of this
+  // build (see Real) or it is truncated (the filter is kept then).
+  bool load_session(const std::vector<char> &data) {
+    Deserializer d{data};
+    auto magic = d.read_value<uint32_t>();
+    auto version = d.read_value<uint32_t>();
+    auto real_size = d.read_value<uint32_t>();
+    auto traversed = RobotPoseDelta{};
+    d >> traversed.x >> traversed.y >> traversed.theta;
+    auto particles_nm = d.read_value<uint64_t>();
+    if (d.is_overrun() || magic != Session_Magic ||
+        version != Session_Version || real_size != sizeof(Real) ||
+        particles_nm == 0) {
+      return false;
+    }
+
+    auto tiles = MapType::TileTable{};
+    auto pos = tiles.load(data, d.pos(), GmappingBaseCell{});
+    // NB: a particle takes at least its robot state
+    auto robot_state_size = _pf.heaviest_particle().robot_state_size();
+    if (data.size() < pos ||
+        (data.size() - pos) / robot_state_size < particles_nm) {
+      return false;
+    }
+    wait_for_mapping();
+    auto kept_particles = _pf.particles();
+    _pf.reset_particles(particles_nm);
+    for (auto &p : _pf.particles()) {
+      pos = p->load_robot_state(data, pos);
+      pos = p->load_map_layout(data, pos, tiles);
+      if (data.size() < pos) {
+        _pf.particles() = std::move(kept_particles);
+        _pf.normalize_weights();
+        return false;
+      }
+    }
+    _traversed_since_last_resample = traversed;
+    _pf.normalize_weights();
+    ensure_master_exists();
+    return true;
+  }
 
 protected:
 
   void handle_observation(TransformedLaserScan &obs) override {
-    for (auto &world : _pf.particles()) {
-      world->handle_observation(obs);
+    auto &particles = _pf.particles();
+    // PERFORMANCE: particles share the pose-independent part of filtering
+    //              (NB: the raw scan is still used to update maps).
+    {
+      StageTimer timer{_stage_profiler, SlamStage::ScanFiltering};
+      particles.front()->scan_matcher()->prefilter_scan(obs.scan);
+    }
+    auto threads_nm = std::min(_workers.size(), particles.size());
+    if (threads_nm < 2) {
+      for (auto &world : particles) {
+        world->handle_observation(obs);
+      }
+    } else {
+      // PERFORMANCE: a particle is a work item, so threads that handle
+      //              cheap particles (e.g. not matched) take more of them.
+      std::atomic<std::size_t> next_particle_i{0};
+      auto handle_particles = [&](ObservationWorker &worker) {
+        worker.scan = obs;
+        worker.scan.scan.trig_provider = obs.scan.trig_provider->clone();
+        auto &handlers = worker.handlers;
+        for (auto i = next_particle_i++; i < particles.size();
+             i = next_particle_i++) {
+          particles[i]->handle_observation(worker.scan, *handlers.gsm,
+                                           *handlers.gmsa);
+        }
+      };
+      // NB: handlers of a worker are used by a single thread at a time
+      ThreadPool::shared()->parallel_for(threads_nm, [&](std::size_t i) {
+        handle_particles(_workers[i]);
+      }, threads_nm);
     }
 
     // NB: weights are updated during scan update for performance reasons
     _pf.normalize_weights();
-    try_resample();
+    {
+      StageTimer timer{_stage_profiler, SlamStage::Resampling};
+      try_resample();
+    }
 
     /*
     std::cout.setf(std::ios_base::fixed, std::ios_base::floatfield);
@@ -99,10 +280,10 @@ private:
 private:
 
   void ensure_master_exists() {
-    auto master_pred = [](std::shared_ptr<GmappingWorld> p) {
+    auto master_pred = [](const std::shared_ptr<GmappingWorld> &p) {
       return p->is_master();
     };
-    auto prts = _pf.particles();
+    const auto &prts = _pf.particles();
     bool master_survived = prts.end() !=
       std::find_if(prts.begin(), prts.end(), master_pred);
 
@@ -111,9 +292,18 @@ private:
     }
   }
 
+private: // types
+  struct ObservationWorker {
+    ObservationHandlers handlers;
+    // NB: a scan's trigonometry provider has a base angle, i.e. a state
+    TransformedLaserScan scan;
+  };
+
 private: // fields
   ParticleFilter<GmappingWorld> _pf;
+  std::vector<ObservationWorker> _workers;
   RobotPoseDelta _traversed_since_last_resample;
+  std::shared_ptr<StageProfiler> _stage_profiler;
 };
 
 #endif // header-guard
@@ -4,6 +4,7 @@
 #include <memory>
 #include <random>
 #include <cmath>
+#include <cstdint>
 
 #include "../../core/particle_filter.h"
 #include "../../core/states/single_state_hypothesis_laser_scan_grid_world.h"
@@ -15,40 +16,46 @@
 
 struct GMappingParams {
 private:
-  using RandomEngine = std::mt19937;
+  using RandomEngine = Xoshiro256PlusPlus;
   using GRV1D = GaussianRV1D<RandomEngine>;
   using URV1D = UniformRV1D<RandomEngine>;
 public:
   RobotPoseDeltaRV<RandomEngine> pose_guess_rv, next_sm_delta_rv;
+  // the master seed of engines of particles (see RandomStreams)
+  uint64_t seed;
 
   GMappingParams(double mean_sample_xy, double sigma_sample_xy,
                  double mean_sample_th, double sigma_sample_th,
                  double min_sm_lim_xy, double max_sm_lim_xy,
-                 double min_sm_lim_th, double max_sm_lim_th)
+                 double min_sm_lim_th, double max_sm_lim_th,
+                 uint64_t seed = std::random_device{}())
     : pose_guess_rv{GRV1D{mean_sample_xy, sigma_sample_xy},
                     GRV1D{mean_sample_xy, sigma_sample_xy},
                     GRV1D{mean_sample_th, sigma_sample_th}}
     , next_sm_delta_rv{URV1D{min_sm_lim_xy, max_sm_lim_xy},
                        URV1D{min_sm_lim_xy, max_sm_lim_xy},
-                       URV1D{min_sm_lim_th, max_sm_lim_th}} {}
+                       URV1D{min_sm_lim_th, max_sm_lim_th}}
+    , seed{seed} {}
 };
 
 class GmappingWorld
   : public Particle
-  , public SingleStateHypothesisLaserScanGridWorld<UnboundedLazyTiledGridMap> {
+  , public SingleStateHypothesisLaserScanGridWorld<
+             UnboundedValueLazyTiledGridMap<GmappingBaseCell>> {
 public:
-  using RandomEngine = std::mt19937;
+  using RandomEngine = Xoshiro256PlusPlus;
   using GRV1D = GaussianRV1D<RandomEngine>;
-  using MapType = UnboundedLazyTiledGridMap;
+  using MapType = UnboundedValueLazyTiledGridMap<GmappingBaseCell>;
 public:
 
+  // NB: engines of particles are expected to be of different streams
+  //     (see GmappingParticleFactory)
   GmappingWorld(const SingleStateHypothesisLSGWProperties &shw_params,
-                const GMappingParams &gparams)
-    // FIXME: [Performance] The adder does extra computations
-    //        related to blurring that are not actually used
+                const GMappingParams &gparams,
+                RandomEngine rnd_engine = RandomEngine{std::random_device{}()})
     : SingleStateHypothesisLaserScanGridWorld{shw_params}
     , _raw_odom_pose{0, 0, 0}
-    , _rnd_engine(std::random_device{}())
+    , _rnd_engine{rnd_engine}
     , _pose_guess_rv{gparams.pose_guess_rv}
     , _next_sm_delta_rv{gparams.next_sm_delta_rv} {
     reset_scan_matching_delta();
@@ -71,6 +78,14 @@ public:
   }
 
   void handle_observation(TransformedLaserScan &scan) override {
+    handle_observation(scan, *scan_matcher(), *scan_adder());
+  }
+
+  // NB: the matcher and the adder keep mutable state, so they are not
+  //     expected to be used by worlds that are handled concurrently
+  //     (see GmappingParticleFilter::set_observation_threads).
+  void handle_observation(TransformedLaserScan &scan, GridScanMatcher &gsm,
+                          GridMapScanAdder &gmsa) {
     if (_delta_since_last_sm.sq_dist() < _next_sm_delta.sq_dist() &&
         std::fabs(_delta_since_last_sm.theta) < _next_sm_delta.theta) {
       return;
@@ -84,15 +99,22 @@ public:
       LaserScanGridWorld<MapType>::update_robot_pose(noise);
     }
 
+    // NB: particles are measured separately, i.e. a stage is measured
+    //     per particle
+    auto profiler = stage_profiler();
     RobotPoseDelta pose_delta;
-    double scan_prob = scan_matcher()->process_scan(scan, pose(),
-                                                    map(), pose_delta);
+    double scan_prob;
+    {
+      StageTimer timer{profiler, SlamStage::ScanMatching};
+      scan_prob = gsm.process_scan(scan, pose(), map(), pose_delta);
+    }
     LaserScanGridWorld<MapType>::update_robot_pose(pose_delta);
 
     // TODO: scan_prob threshold to params
     if (0.0 < scan_prob || _scan_is_first) {
       // map update accordig to original gmapping code (ref?)
-      scan_adder()->append_scan(map(), pose(), scan.scan, scan.quality, 0);
+      StageTimer timer{profiler, SlamStage::MapInsertion};
+      gmsa.append_scan(map(), pose(), scan.scan, scan.quality, 0);
       _scan_is_first = false;
     }
 
@@ -111,6 +133,53 @@ public:
   bool is_master() { return _is_master; }
   void sample() override { _is_master = false; }
 
+  // E.g. a copy of a particle gets an engine of its own stream,
+  // otherwise it would repeat the noise of the particle
+  void set_random_engine(const RandomEngine &rnd_engine) {
+    _rnd_engine = rnd_engine;
+  }
+
+  // The weight and the scan matching schedule follow the robot state
+  void save_robot_state(Serializer &s) const override {
+    SingleStateHypothesisLaserScanGridWorld::save_robot_state(s);
+    s << weight() << _is_master << _scan_is_first
+      << _raw_odom_pose.x << _raw_odom_pose.y << _raw_odom_pose.theta
+      << _delta_since_last_sm.x << _delta_since_last_sm.y
+      << _delta_since_last_sm.theta
+      << _next_sm_delta.x << _next_sm_delta.y << _next_sm_delta.theta;
+  }
+
+  std::size_t load_robot_state(const std::vector<char> &data,
+                               std::size_t pos) override {
+    Deserializer d{data,
+      SingleStateHypothesisLaserScanGridWorld::load_robot_state(data, pos)};
+    set_weight(d.read_value<double>());
+    auto is_master = d.read_value<bool>();
+    d >> _scan_is_first
+      >> _raw_odom_pose.x >> _raw_odom_pose.y >> _raw_odom_pose.theta
+      >> _delta_since_last_sm.x >> _delta_since_last_sm.y
+      >> _delta_since_last_sm.theta
+      >> _next_sm_delta.x >> _next_sm_delta.y >> _next_sm_delta.theta;
+    if (is_master) {
+      mark_master();
+    } else {
+      sample();
+    }
+    return d.pos();
+  }
+
+  // The map as a layout of tiles in the table (see save_layout), so
+  // tiles shared by particles are saved once
+  void save_map_layout(Serializer &s, MapType::TileTable &tiles) const {
+    map().save_layout(s, tiles);
+  }
+
+  std::size_t load_map_layout(const std::vector<char> &data, std::size_t pos,
+                              const MapType::TileTable &tiles) {
+    wait_for_mapping();
+    return _map.load_layout(data, pos, tiles);
+  }
+
 private:
 
   void reset_scan_matching_delta() {
@@ -3,6 +3,9 @@
 
 #include "../../utils/init_scan_matching.h"
 #include "../../utils/init_occupancy_mapping.h"
+#include "../../utils/init_stage_profiling.h"
+#include "../../utils/init_session.h"
+#include "../../utils/init_map_backend.h"
 #include "../../core/scan_matchers/weighted_mean_point_probability_spe.h"
 
 #include "gmapping_occupancy_observation_pe.h"
@@ -12,6 +15,48 @@ auto init_particles_nm(const PropertiesProvider &props) {
   return props.get_uint("slam/particles/number", 30);
 }
 
+auto init_resampler(const PropertiesProvider &props) {
+  static const std::string RS_NS = "slam/particles/resampling/";
+  auto type = props.get_str(RS_NS + "type", "systematic");
+  auto seed = props.get_int(RS_NS + "seed", std::random_device{}());
+  auto resampler = std::shared_ptr<ParticleResampler>{};
+  if (type == "systematic") {
+    resampler = std::make_shared<SystematicResampler>(seed);
+  } else if (type == "stratified") {
+    resampler = std::make_shared<StratifiedResampler>(seed);
+  } else if (type == "residual") {
+    resampler = std::make_shared<ResidualResampler>(seed);
+  } else if (type == "multinomial") {
+    resampler = std::make_shared<MultinomialResampler>(seed);
+  } else {
+    std::cerr << "Unknown resampling type "
+              << "(" << RS_NS << "type) " << type << std::endl;
+    std::exit(-1);
+  }
+  return resampler;
+}
+
+auto init_particles_nm_adaptation(const PropertiesProvider &props) {
+  static const std::string KLD_NS = "slam/particles/kld/";
+  using Adaptation = KldParticlesNumberAdaptation<GmappingWorld>;
+  auto adaptation = std::shared_ptr<Adaptation>{};
+  if (!props.get_bool(KLD_NS + "enabled", false)) { return adaptation; }
+
+  auto params = Adaptation::Params{};
+  params.min_particles_nm = props.get_uint(KLD_NS + "min_number",
+                                           params.min_particles_nm);
+  params.max_particles_nm = props.get_uint(KLD_NS + "max_number",
+                                           params.max_particles_nm);
+  params.bin_size_xy = props.get_dbl(KLD_NS + "bin_size/xy",
+                                     params.bin_size_xy);
+  params.bin_size_theta = props.get_dbl(KLD_NS + "bin_size/theta",
+                                        params.bin_size_theta);
+  params.max_error = props.get_dbl(KLD_NS + "max_error", params.max_error);
+  params.upper_quantile = props.get_dbl(KLD_NS + "upper_quantile",
+                                        params.upper_quantile);
+  return std::make_shared<Adaptation>(params);
+}
+
 auto init_gmapping_params(const PropertiesProvider &props) {
   auto mean_sample_xy = props.get_dbl("slam/particles/sample/xy/mean", 0.0);
   auto sigma_sample_xy = props.get_dbl("slam/particles/sample/xy/sigma", 0.1);
@@ -27,10 +72,13 @@ auto init_gmapping_params(const PropertiesProvider &props) {
                                       0.3);
   auto max_sm_lim_th = props.get_dbl("slam/particles/sm_delta_lim/theta/max",
                                       0.4);
+  // NB: particles' noise is reproducible with the seed
+  auto seed = props.get_uint("slam/particles/seed", std::random_device{}());
+  std::cout << "[INFO] Particles seed: " << seed << std::endl;
   return GMappingParams{mean_sample_xy, sigma_sample_xy,
                         mean_sample_th, sigma_sample_th,
                         min_sm_lim_xy, max_sm_lim_xy,
-                        min_sm_lim_th, max_sm_lim_th};
+                        min_sm_lim_th, max_sm_lim_th, seed};
 }
 
 auto init_gmapping_prob_estimator(const PropertiesProvider &props) {
@@ -44,21 +92,41 @@ auto init_gmapping_prob_estimator(const PropertiesProvider &props) {
   return init_spe(props, oope);
 }
 
+auto init_gmapping_scan_matcher(const PropertiesProvider &props) {
+  // FIXME: move to params
+  return std::make_shared<HillClimbingScanMatcher>(
+    init_gmapping_prob_estimator(props), 6, 0.1, 0.1);
+}
+
 using Gmapping = GmappingParticleFilter;
 
 auto init_gmapping(const PropertiesProvider &props) {
+  // NB: particles are copied by resampling, so their maps share
+  //     copy-on-write tiles
+  if (init_map_backend(props, MapBackend::Tiled) != MapBackend::Tiled) {
+    std::cerr << "[ERROR] gmapping supports the tiled map backend only"
+              << std::endl;
+    std::exit(-1);
+  }
   // TODO: remove grid cell strategy
   auto shw_params = SingleStateHypothesisLSGWProperties{
     1.0, 1.0, 0, std::make_shared<GmappingBaseCell>(),
-    // FIXME: move to params
-    std::make_shared<HillClimbingScanMatcher>(
-      init_gmapping_prob_estimator(props),
-      6, 0.1, 0.1),
+    init_gmapping_scan_matcher(props),
     init_scan_adder(props),
     init_grid_map_params(props)
   };
-  return std::make_shared<GmappingParticleFilter>(shw_params,
+  shw_params.stage_profiler = init_stage_profiler(props);
+  auto gmapping = std::make_shared<GmappingParticleFilter>(shw_params,
     init_gmapping_params(props), init_particles_nm(props));
+  gmapping->set_resampler(init_resampler(props));
+  gmapping->set_particles_nm_adaptation(init_particles_nm_adaptation(props));
+  gmapping->set_observation_threads(
+    props.get_uint("slam/particles/threads", 1), [&props]() {
+      return GmappingParticleFilter::ObservationHandlers{
+        init_gmapping_scan_matcher(props), init_scan_adder(props)};
+    });
+  init_session(props, *gmapping);
+  return gmapping;
 }
 
 #endif
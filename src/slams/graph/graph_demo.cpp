@@ -19,13 +19,41 @@
 using ObservT = sensor_msgs::LaserScan;
 using VinySlamMap = GraphSlamWorld::MapType;
 
+auto init_submap_params(const PropertiesProvider &props) {
+  static const std::string Submaps_NS = "slam/graph/submaps/";
+  static const std::string Closure_NS = Submaps_NS + "closure/";
+  auto params = GraphSlamSubmapParams{};
+  params.enabled = props.get_bool(Submaps_NS + "enabled", params.enabled);
+  params.scans_per_submap = props.get_uint(Submaps_NS + "scans_nm",
+                                           params.scans_per_submap);
+  params.closure_search_radius = props.get_dbl(
+    Closure_NS + "search_radius", params.closure_search_radius);
+  params.closure.max_translation_error = props.get_dbl(
+    Closure_NS + "max_translation_error",
+    params.closure.max_translation_error);
+  params.closure.max_rotation_error = props.get_dbl(
+    Closure_NS + "max_rotation_error", params.closure.max_rotation_error);
+  params.closure.min_probability = props.get_dbl(
+    Closure_NS + "min_probability", params.closure.min_probability);
+  return params;
+}
+
+auto init_back_end_params(const PropertiesProvider &props) {
+  auto params = GraphSlamBackEndParams{};
+  params.is_asynchronous = props.get_bool("slam/graph/back_end/asynchronous",
+                                          params.is_asynchronous);
+  return params;
+}
+
 auto init_graph_slam(const PropertiesProvider &props) {
   auto slam_props = SingleStateHypothesisLSGWProperties{};
   slam_props.gsm = init_scan_matcher(props);
   slam_props.gmsa = init_scan_adder(props);
   slam_props.map_props = init_grid_map_params(props);
 
-  return std::make_shared<GraphSlamWorld>(slam_props);
+  return std::make_shared<GraphSlamWorld>(slam_props,
+                                          init_submap_params(props),
+                                          init_back_end_params(props));
 }
 
 int main(int argc, char** argv) {
@@ -38,27 +66,39 @@ int main(int argc, char** argv) {
   ros::NodeHandle nh;
   double ros_map_publishing_rate, ros_tf_buffer_size;
   int ros_filter_queue, ros_subscr_queue;
-  init_constants_for_ros(ros_tf_buffer_size, ros_map_publishing_rate,
-                          ros_filter_queue, ros_subscr_queue);
+  init_constants_for_ros(props, ros_tf_buffer_size, ros_map_publishing_rate,
+                         ros_filter_queue, ros_subscr_queue);
   auto scan_provider = std::make_unique<TopicWithTransform<ObservT>>(
      nh, laser_scan_2D_ros_topic_name(props), tf_odom_frame_id(props),
-     ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue
+     ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue,
+     get_scan_load_shedding_params(props), get_scan_stats_log_period(props)
   );
   //auto occup_grid_pub_pin = create_occupancy_grid_publisher<VinySlamMap>(
-  //   slam.get(), nh, ros_map_publishing_rate);
+  //   slam.get(), nh, ros_map_publishing_rate, props);
 
   auto pose_pub_pin = create_pose_correction_tf_publisher<ObservT, VinySlamMap>(
      slam.get(), scan_provider.get(), props);
-  auto rp_pub_pin = create_robot_pose_tf_publisher<VinySlamMap>(slam.get());
+  auto rp_pub_pin = create_robot_pose_tf_publisher<VinySlamMap>(slam.get(),
+                                                                props);
 
   auto scan_obs = std::make_shared<LaserScanObserver>(
-     slam, get_skip_exceeding_lsr(props), get_use_trig_cache(props));
+     slam, get_skip_exceeding_lsr(props), get_use_trig_cache(props),
+     get_scan_downsampler(props));
   // NB: pose_pub_pin must be subscribed first
-  scan_provider->subscribe(scan_obs);
+  auto scan_inputs_pin = subscribe_laser_scan_observer(
+    nh, scan_provider.get(), scan_obs, props,
+    ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue);
 
   // TODO: rename
+  auto viewer_params = RvizGraphViewerParams{};
+  viewer_params.publishing_period = props.get_dbl(
+    "slam/graph/viewer/publishing_period", viewer_params.publishing_period);
+  viewer_params.full_refresh_period = props.get_dbl(
+    "slam/graph/viewer/full_refresh_period",
+    viewer_params.full_refresh_period);
   auto graph_viewer = std::make_shared<RvizGraphViewer>(
-    nh.advertise<visualization_msgs::MarkerArray>("/graph_map", 5));
+    nh.advertise<visualization_msgs::MarkerArray>("/graph_map", 5),
+    viewer_params);
   slam->subscribe_map(graph_viewer);
 
 
@@ -3,12 +3,21 @@
 
 #include <iostream>
 #include <memory>
+#include <atomic>
+#include <deque>
+#include <utility>
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
 #include <cmath>
 #include "../../core/states/single_state_hypothesis_laser_scan_grid_world.h"
-#include "../../core/maps/plain_grid_map.h"
+#include "../../core/maps/scratch_grid_map.h"
+#include "../../core/bounded_task_queue.h"
 
 #include "pose_graph_map.h"
+#include "pose_graph_optimizer.h"
+#include "submap_loop_closer.h"
 
 class NodeCreationOracle {
 public:
@@ -30,6 +39,33 @@ private:
   const RobotPoseDelta _delta_limit;
 };
 
+struct GraphSlamSubmapParams {
+  // scans are matched against the active submap instead of the last scan
+  // and loop closures are looked up in finished submaps
+  bool enabled = false;
+  // a submap is finished once it has the number of scans and a node
+  // is created (a new submap is anchored at the node)
+  std::size_t scans_per_submap = 30;
+  // finished submaps which anchors are within the radius from a new node
+  // are loop closure candidates
+  double closure_search_radius = 5.0;
+  // submaps anchored at recent nodes are neighbours rather than closures
+  std::size_t min_closure_nodes_gap = 20;
+  // the information of a loop closure constraint (x, y, th)
+  RobotPoseDelta closure_information = {1, 1, 1};
+  SubmapLoopCloserParams closure;
+  // SubmapLoopCloser::default_spe() is used if unset
+  std::shared_ptr<ScanProbabilityEstimator> closure_spe;
+};
+
+struct GraphSlamBackEndParams {
+  // Nodes are added to the graph, loop closures are looked up and the graph
+  // is optimized on a dedicated worker, so a scan is never delayed by them.
+  // Corrected poses are adopted by the front end on later scans and map
+  // observers are notified by the worker.
+  bool is_asynchronous = false;
+};
+
 // TODO: remove Gridness
 class GraphSlamWorld : public LaserScanGridWorld<PoseGraphMap> {
 public: //types
@@ -37,26 +73,72 @@ public: //types
 public:
 
   // NCO: 0.5 m, 0.5 m, 30 deg
-  GraphSlamWorld(const SingleStateHypothesisLSGWProperties &props)
+  GraphSlamWorld(const SingleStateHypothesisLSGWProperties &props,
+                 const GraphSlamSubmapParams &submap_params = {},
+                 const GraphSlamBackEndParams &back_end_params = {})
     : _props{props}
-    , _last_scan(nullptr), _nco{RobotPoseDelta(0.5, 0.5, 0.5)} {}
+    , _last_scan(nullptr), _nco{RobotPoseDelta(0.5, 0.5, 0.5)}
+    , _rasterized_last{std::make_shared<GridCell>(Occupancy{0, 0}),
+                       MapValues::meters_per_cell}
+    , _submap_params(submap_params)
+    , _pending_jobs{std::make_shared<NodeJobs>()}
+    , _loop_closer{submap_params.closure_spe ?
+                     submap_params.closure_spe :
+                     SubmapLoopCloser::default_spe(),
+                   submap_params.closure} {
+    if (back_end_params.is_asynchronous) {
+      // NB: a single batch of nodes is processed at a time, the next one
+      //     is accumulated meanwhile
+      _back_end_queue = std::make_unique<BoundedTaskQueue>(1);
+    }
+  }
+
+  GraphSlamWorld(const GraphSlamWorld&) = delete;
+  GraphSlamWorld& operator=(const GraphSlamWorld&) = delete;
+
+  ~GraphSlamWorld() { wait_for_back_end(); }
 
+  // PERFORMANCE: the last scan is rasterized to the scratch map that
+  //              covers both scans only, so neither cells are allocated
+  //              nor the whole map is cleared per scan.
   auto estimate_pose_delta(const TransformedLaserScan &last_scan,
                            const TransformedLaserScan &curr_scan) {
     auto pose_delta = RobotPoseDelta{};
-    // plain cell
-    auto rasterized_last =
-      PlainGridMap{std::make_shared<GridCell>(Occupancy{0, 0}),
-                   {1000, 1000, 0.1}};
-    _props.gmsa->append_scan(rasterized_last,
-                             -curr_scan.pose_delta, last_scan.scan,
+    const RobotPose last_pose = -curr_scan.pose_delta;
+    auto last_range = max_range(last_scan.scan) + Scratch_Margin;
+    auto curr_range = max_range(curr_scan.scan) + Scratch_Margin;
+    _rasterized_last.reshape(
+      _rasterized_last.world_to_cell(
+        std::min(last_pose.x - last_range, -curr_range),
+        std::min(last_pose.y - last_range, -curr_range)),
+      _rasterized_last.world_to_cell(
+        std::max(last_pose.x + last_range, curr_range),
+        std::max(last_pose.y + last_range, curr_range)));
+    _props.gmsa->append_scan(_rasterized_last, last_pose, last_scan.scan,
                              last_scan.quality, _props.scan_margin);
     _props.gsm->process_scan(curr_scan, {0, 0, 0},
-                             rasterized_last, pose_delta);
+                             _rasterized_last, pose_delta);
     return pose_delta;
   }
 
+  // NB: with the asynchronous back end the map is notified by the worker
+  void handle_sensor_data(ScanType &scan) override {
+    if (!_back_end_queue) {
+      LaserScanGridWorld<PoseGraphMap>::handle_sensor_data(scan);
+      return;
+    }
+    update_robot_pose(scan.pose_delta);
+    handle_observation(scan);
+    notify_with_pose(pose());
+  }
+
   void handle_observation(ScanType &tr_scan) override {
+    adopt_correction();
+    if (_submap_params.enabled) {
+      handle_observation_with_submaps(tr_scan);
+      return;
+    }
+
     if (!_last_scan) {
       _last_scan.reset(new TransformedLaserScan());
     } else { // pose rifenement
@@ -67,17 +149,254 @@ public:
     if (!_nco.is_node_creation_required(tr_scan.pose_delta)) {
       return;
     }
-
-    _pose_graph.add_node(tr_scan, pose(), 0.7);
+    add_node(tr_scan, nullptr);
   }
 
+  // NB: with the asynchronous back end the graph is modified by the worker,
+  //     so it is expected to be read by map observers or once the worker
+  //     is idle (see wait_for_back_end).
   virtual const PoseGraphMap& map() const override { return _pose_graph;}
 
-private:
+  // Blocks until all created nodes are processed by the back end
+  // and adopts the corrections.
+  void wait_for_back_end() {
+    if (_back_end_queue) {
+      if (!_pending_jobs->empty()) {
+        _back_end_queue->push(back_end_task());
+        _pending_jobs = std::make_shared<NodeJobs>();
+      }
+      _back_end_queue->wait_for_idle();
+    }
+    adopt_correction();
+  }
+
+private: // types
+  // A node created by the front end
+  struct NodeJob {
+    std::size_t node_id;
+    TransformedLaserScan scan;
+    // the front end's pose and its change since the previous node's one
+    RobotPose pose;
+    RobotPoseDelta odometry;
+    // the submap finished by the node (if any)
+    std::shared_ptr<Submap> finished_submap;
+  };
+  using NodeJobs = std::vector<NodeJob>;
+
+  // The pose of the latest processed node estimated by the back end
+  struct NodeCorrection {
+    std::size_t node_id;
+    RobotPose pose;
+  };
+private: // consts
+  // a room for scan matching drifts and blurred obstacles
+  static constexpr double Scratch_Margin = 1.0;
+  // a submap map is unbounded, so it starts small
+  static constexpr int Submap_Init_Side_Cells = 64;
+private: // methods
+
+  /* Submap mode (in the spirit of Cartographer, Hess et al., 2016):
+   * a scan is matched against the active submap and inserted into it.
+   * A new node's scan is matched against nearby finished submaps by
+   * the loop closer and a found pose becomes a constraint to the anchor
+   * node of the submap. */
+  void handle_observation_with_submaps(ScanType &tr_scan) {
+    if (_active_submap) { // pose refinement
+      auto scan_pose = RobotPose{relative_pose(_active_anchor_pose, pose())};
+      auto correction = RobotPoseDelta{};
+      _props.gsm->process_scan(tr_scan, scan_pose, *_active_submap->map,
+                               correction);
+      move_robot_to(absolute_pose(_active_anchor_pose,
+                                  scan_pose + correction));
+    }
+
+    auto node_is_required = _nco.is_node_creation_required(tr_scan.pose_delta);
+    if (node_is_required || !_active_submap) {
+      auto finished_submap = std::shared_ptr<Submap>{};
+      if (!_active_submap ||
+          _submap_params.scans_per_submap <= _active_submap->scans_nm) {
+        finished_submap = start_submap();
+      }
+      add_node(tr_scan, std::move(finished_submap));
+    }
+
+    auto scan_pose = RobotPose{relative_pose(_active_anchor_pose, pose())};
+    _props.gmsa->append_scan(*_active_submap->map, scan_pose, tr_scan.scan,
+                             tr_scan.quality, _props.scan_margin);
+    ++_active_submap->scans_nm;
+  }
+
+  // Starts a submap anchored at the next node; returns the finished one
+  std::shared_ptr<Submap> start_submap() {
+    auto finished_submap = std::move(_active_submap);
+    if (finished_submap) { finished_submap->is_finished = true; }
+
+    auto prototype = _props.cell_prototype ? _props.cell_prototype :
+      std::make_shared<GridCell>(Occupancy{0, 0});
+    auto scale = 0 < _props.map_props.meters_per_cell ?
+      _props.map_props.meters_per_cell : MapValues::meters_per_cell;
+    _active_submap = std::make_shared<Submap>(
+      _nodes_nm, prototype,
+      GridMapParams{Submap_Init_Side_Cells, Submap_Init_Side_Cells, scale});
+    _active_anchor_pose = pose();
+    return finished_submap;
+  }
+
+  //--------------------------------------------------------------------------
+  // Front end <-> back end
+
+  // PERFORMANCE: a node is handed to the worker if it is idle, otherwise
+  //              nodes are accumulated and handed as a batch later, so
+  //              the front end never waits for the back end.
+  void add_node(const TransformedLaserScan &tr_scan,
+                std::shared_ptr<Submap> finished_submap) {
+    auto odometry = _front_nodes.empty() ? RobotPoseDelta{} :
+      relative_pose(_front_nodes.back().second, pose());
+    _pending_jobs->push_back(NodeJob{_nodes_nm, tr_scan, pose(), odometry,
+                                     std::move(finished_submap)});
+    auto &trig_provider = _pending_jobs->back().scan.scan.trig_provider;
+    if (_back_end_queue && trig_provider) {
+      // NB: a provider is shared by scans, its base angle is not
+      trig_provider = trig_provider->clone();
+    }
+    _front_nodes.emplace_back(_nodes_nm, pose());
+    ++_nodes_nm;
+
+    if (!_back_end_queue) {
+      process_jobs(*_pending_jobs);
+      _pending_jobs->clear();
+      adopt_correction();
+      return;
+    }
+    auto task = back_end_task();
+    if (_back_end_queue->try_push(task)) {
+      _pending_jobs = std::make_shared<NodeJobs>();
+    }
+  }
+
+  BoundedTaskQueue::Task back_end_task() {
+    return [this, jobs = _pending_jobs]() {
+      process_jobs(*jobs);
+      notify_with_map(_pose_graph);
+    };
+  }
+
+  // The correction of a node is applied to the front end's poses as
+  // a rigid transform, so the active submap stays consistent.
+  void adopt_correction() {
+    auto correction = std::atomic_exchange(
+      &_published_correction, std::shared_ptr<const NodeCorrection>{});
+    if (!correction) { return; }
+
+    while (_front_nodes.front().first < correction->node_id) {
+      _front_nodes.pop_front();
+    }
+    assert(_front_nodes.front().first == correction->node_id);
+    auto origin = _front_nodes.front().second;
+    auto correct = [&origin, &correction](const RobotPose &p) {
+      return absolute_pose(correction->pose, relative_pose(origin, p));
+    };
+    for (auto &node : _front_nodes) { node.second = correct(node.second); }
+    _active_anchor_pose = correct(_active_anchor_pose);
+    move_robot_to(correct(pose()));
+  }
+
+  //--------------------------------------------------------------------------
+  // Back end
+
+  void process_jobs(const NodeJobs &jobs) {
+    auto &nodes = _pose_graph.nodes();
+    for (auto &job : jobs) {
+      if (job.finished_submap) {
+        _finished_submap_ids.emplace(job.finished_submap->anchor_id,
+                                     _submaps.size());
+        _submaps.push_back(job.finished_submap);
+      }
+      auto pose = nodes.empty() ? job.pose :
+        absolute_pose(nodes.back()->pose, job.odometry);
+      _pose_graph.add_node(job.scan, pose, 0.7);
+      assert(nodes.back()->id == job.node_id);
+      if (_submap_params.enabled) { close_loop(nodes.back(), job.scan.scan); }
+    }
+    // NB: odometry-only updates refactor the last nodes only
+    _optimizer.update(_pose_graph);
+
+    std::atomic_store(&_published_correction,
+                      std::make_shared<const NodeCorrection>(
+                        NodeCorrection{nodes.back()->id, nodes.back()->pose}));
+  }
+
+  // PERFORMANCE: candidates are looked up by the node index of the graph
+  //              (see PoseGraphMap::nearest_nodes).
+  void close_loop(const NodePtr &node, const LaserScan2D &scan) {
+    auto radius = _submap_params.closure_search_radius;
+    auto &nodes = _pose_graph.nodes();
+    _candidate_ids.clear();
+    for (auto &near_node : _pose_graph.nearest_nodes(node->pose,
+                                                     radius * radius)) {
+      auto submap_id = _finished_submap_ids.find(near_node->id);
+      if (submap_id == _finished_submap_ids.end() ||
+          node->id < near_node->id + _submap_params.min_closure_nodes_gap) {
+        continue;
+      }
+      _candidate_ids.push_back(submap_id->second);
+    }
+    // NB: the order of candidates is fixed to make results reproducible
+    std::sort(_candidate_ids.begin(), _candidate_ids.end());
+    for (auto submap_id : _candidate_ids) {
+      auto &submap = *_submaps[submap_id];
+      _loop_closer.add_candidate(
+        submap_id, *submap.map,
+        RobotPose{relative_pose(nodes[submap.anchor_id]->pose, node->pose)});
+    }
+
+    auto closure = SubmapLoopClosure{};
+    if (!_loop_closer.find_closure(scan, closure)) { return; }
+    _pose_graph.add_edge(node, nodes[_submaps[closure.candidate_id]->anchor_id],
+                         closure.scan_pose,
+                         _submap_params.closure_information);
+  }
+
+  void move_robot_to(const RobotPose &target) {
+    auto &current = pose();
+    auto d_th = std::remainder(target.theta - current.theta, 2 * M_PI);
+    update_robot_pose(RobotPoseDelta(target.x - current.x,
+                                     target.y - current.y, d_th));
+  }
+
+  static double max_range(const LaserScan2D &scan) {
+    auto range = double{0};
+    for (auto &sp : scan.points()) {
+      range = std::max<double>(range, sp.range());
+    }
+    return range;
+  }
+
+private: // fields
+  // front end
   SingleStateHypothesisLSGWProperties _props;
   std::shared_ptr<TransformedLaserScan> _last_scan;
   NodeCreationOracle _nco;
+  ScratchGridMap<GridCell> _rasterized_last;
+  GraphSlamSubmapParams _submap_params;
+  std::shared_ptr<Submap> _active_submap;
+  RobotPose _active_anchor_pose;
+  std::size_t _nodes_nm = 0;
+  // ids and poses of nodes from the latest corrected one
+  std::deque<std::pair<std::size_t, RobotPose>> _front_nodes;
+  std::shared_ptr<NodeJobs> _pending_jobs;
+  // back end
   PoseGraphMap _pose_graph;
+  PoseGraphOptimizer _optimizer;
+  SubmapLoopCloser _loop_closer;
+  std::vector<std::shared_ptr<Submap>> _submaps;
+  // submap ids by ids of their anchors
+  std::unordered_map<std::size_t, std::size_t> _finished_submap_ids;
+  std::vector<std::size_t> _candidate_ids;
+  // NB: accessed atomically
+  std::shared_ptr<const NodeCorrection> _published_correction;
+  // NB: the last field, so the worker stops before the rest is destroyed
+  std::unique_ptr<BoundedTaskQueue> _back_end_queue;
 };
 
 
@@ -1,6 +1,8 @@
 #ifndef __POSE_GRAPH_MAP_H
 #define __POSE_GRAPH_MAP_H
 
+#include <cmath>
+#include <cstdint>
 #include <memory>
 
 #include <unordered_set>
@@ -8,6 +10,8 @@
 #include <list>
 #include "../../core/states/sensor_data.h"
 #include "../../core/states/state_data.h"
+#include "../../core/states/compact_laser_scan.h"
+#include "pose_grid_index.h"
 //#include "scan_diff_estimator.h"
 
 struct PoseGraphNode;
@@ -16,20 +20,50 @@ struct PoseGraphEdge;
 using NodePtr = std::shared_ptr<PoseGraphNode>;
 using EdgePtr = std::shared_ptr<PoseGraphEdge>;
 
+// A constraint on the pose of `from` in the frame of `to`
+// (see PoseGraphOptimizer); the information is a diagonal one (x, y, th).
 struct PoseGraphEdge {
-  PoseGraphEdge(NodePtr from_node, NodePtr to_node, RobotPoseDelta delta) :
-    pose_delta(delta), from(from_node), to(to_node) {}
+  PoseGraphEdge(NodePtr from_node, NodePtr to_node, RobotPoseDelta delta,
+                RobotPoseDelta info = {1, 1, 1}) :
+    pose_delta(delta), information(info), from(from_node), to(to_node) {}
 
+  // an index in the graph's edges
+  std::size_t id = 0;
   RobotPoseDelta pose_delta;
+  RobotPoseDelta information;
   NodePtr from, to;
 };
 
 struct PoseGraphNode {
-  TransformedLaserScan scan;
+  // an index in the graph's nodes
+  std::size_t id = 0;
+  // the graph version of the last node's modification (see PoseGraphMap)
+  uint64_t version = 0;
+  // NB: the scan is kept compact since nodes live as long as the graph;
+  //     it is decoded on demand (e.g. to match a loop closure candidate).
+  CompactLaserScan scan;
   RobotPose pose;
   std::list<std::shared_ptr<PoseGraphEdge>> edges;
 };
 
+// The pose of `pose` in the frame of `origin`
+inline RobotPoseDelta relative_pose(const RobotPose &origin,
+                                    const RobotPose &pose) {
+  auto c = std::cos(origin.theta), s = std::sin(origin.theta);
+  auto dx = pose.x - origin.x, dy = pose.y - origin.y;
+  return RobotPoseDelta(c * dx + s * dy, -s * dx + c * dy,
+                        std::remainder(pose.theta - origin.theta, 2 * M_PI));
+}
+
+// The pose given in the frame of `origin` (the inverse of relative_pose)
+inline RobotPose absolute_pose(const RobotPose &origin,
+                               const RobotPose &pose) {
+  auto c = std::cos(origin.theta), s = std::sin(origin.theta);
+  return {origin.x + c * pose.x - s * pose.y,
+          origin.y + s * pose.x + c * pose.y,
+          origin.theta + pose.theta};
+}
+
 #include <iostream>
 #include <memory>
 #include <vector>
@@ -53,9 +87,12 @@ public:
     }
 
     std::shared_ptr<PoseGraphNode> new_node{new PoseGraphNode()};
-    new_node->scan = scan;
+    new_node->id = _nodes.size();
+    new_node->scan = _scan_encoder.encode(scan);
     new_node->pose = pose;
+    new_node->version = ++_version;
     _nodes.push_back(new_node);
+    _node_index.add(new_node->id, pose);
 
     if (!_current_node) {
       _current_node = new_node;
@@ -70,6 +107,58 @@ public:
   const std::vector<NodePtr>& nodes() const { return _nodes;}
   const std::vector<EdgePtr>& edges() const { return _edges;}
 
+  // The version of the graph; it grows on each modification, so nodes
+  // added or moved since a version are those with a greater one.
+  // NB: edges are only appended, i.e. new ones follow the known ones.
+  uint64_t version() const { return _version; }
+
+  // NB: node poses are expected to be modified by the method only
+  //     (e.g. by an optimizer), so lookups follow them.
+  void set_node_pose(const NodePtr &node, const RobotPose &pose) {
+    auto &old_pose = node->pose;
+    if (old_pose.x == pose.x && old_pose.y == pose.y &&
+        old_pose.theta == pose.theta) {
+      return;
+    }
+    node->pose = pose;
+    node->version = ++_version;
+    _node_index.move(node->id, pose);
+  }
+
+  // Loop closure candidates
+  // PERFORMANCE: nodes are looked up by a grid index of their positions,
+  //              so only nodes around the pose are checked.
+  const std::unordered_set<NodePtr> nearest_nodes(
+      const RobotPose& pose, double max_sq_dist) const {
+
+    std::unordered_set<NodePtr> near_nodes;
+    _node_index.for_each_candidate(
+      pose.x, pose.y, std::sqrt(max_sq_dist),
+      [this, &pose, &near_nodes, max_sq_dist](std::size_t id) {
+        auto &node = _nodes[id];
+        if ((node->pose - pose).sq_dist() < max_sq_dist) {
+          near_nodes.insert(node);
+        }
+      });
+    // Do we really need the current node?
+    if (_current_node) {
+      near_nodes.insert(_current_node);
+    }
+    return near_nodes;
+  }
+
+  // E.g. a loop closure found by scan matching
+  void add_edge(NodePtr from, NodePtr to, const RobotPoseDelta &delta,
+                const RobotPoseDelta &information) {
+    EdgePtr new_edge{new PoseGraphEdge(from, to, delta, information)};
+    new_edge->id = _edges.size();
+    ++_version;
+    from->edges.push_back(new_edge);
+    to->edges.push_back(new_edge);
+
+    _edges.push_back(new_edge);
+  }
+
 private:
 
   bool close_loop(const TransformedLaserScan& scan,
@@ -98,35 +187,17 @@ private:
     /* return true; */
   }
 
-  const std::unordered_set<NodePtr> nearest_nodes(
-      const RobotPose& pose, double max_sq_dist) {
-
-    // TODO: performance bug -- bf
-    std::unordered_set<NodePtr> near_nodes;
-    for (auto& node : nodes()) {
-      if ((node->pose - pose).sq_dist() < max_sq_dist) {
-        near_nodes.insert(node);
-      }
-    }
-    // Do we really need the current node?
-    if (_current_node) {
-      near_nodes.insert(_current_node);
-    }
-    return near_nodes;
-  }
-
   void add_edge(NodePtr n1, NodePtr n2) {
-    EdgePtr new_edge{new PoseGraphEdge(n1, n2, n1->pose - n2->pose)};
-    n1->edges.push_back(new_edge);
-    n2->edges.push_back(new_edge);
-
-    _edges.push_back(new_edge);
+    add_edge(n1, n2, relative_pose(n2->pose, n1->pose), {1, 1, 1});
   }
 
 private:
   NodePtr _current_node;
   std::vector<NodePtr> _nodes;
   std::vector<EdgePtr> _edges;
+  PoseGridIndex _node_index;
+  CompactLaserScanEncoder _scan_encoder;
+  uint64_t _version = 0;
 };
 
 #endif
@@ -0,0 +1,400 @@
+#ifndef SLAM_CTOR_GRAPH_POSE_GRAPH_OPTIMIZER_H
+#define SLAM_CTOR_GRAPH_POSE_GRAPH_OPTIMIZER_H
+
+#include <array>
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "../../core/incremental_sparse_cholesky.h"
+#include "pose_graph_map.h"
+
+struct PoseGraphOptimizerParams {
+  unsigned max_iterations_nm = 20;
+  // the initial Levenberg-Marquardt damping
+  double init_damping = 1e-4;
+  // iterations stop once no pose component changes more
+  double min_step = 1e-6;
+  // the incremental mode relinearizes constraints of nodes that have moved
+  // farther from their linearization points
+  double relinearization_translation = 0.01;
+  double relinearization_rotation = 0.005;
+  // the first node is anchored to fix the gauge freedom
+  double anchor_information = 1e6;
+  // the incremental mode updates deltas of nodes that precede modified
+  // ones while changes exceed the tolerance
+  double backsubstitution_tolerance = 1e-6;
+};
+
+struct PoseGraphOptimizationStats {
+  unsigned iterations_nm = 0;
+  // NB: it is computed by the full optimization only
+  double chi2 = 0;
+  // rows of the factor recomputed by the last iteration (3 per node)
+  std::size_t refactored_rows_nm = 0;
+};
+
+/* A sparse nonlinear least squares optimizer of a pose graph over SE(2).
+ * An edge constrains the pose of its `from` node in the frame of its `to`
+ * node, the error is t2v(Z^-1 * (X_to^-1 * X_from)) (as in g2o's EdgeSE2).
+ * The normal equations keep 3x3 blocks per node and per edge and are solved
+ * by a sparse Cholesky factorization; nodes are eliminated in the order
+ * of their ids, i.e. a trajectory is eliminated along itself.
+ * - optimize runs Levenberg-Marquardt on the whole graph;
+ * - update is an incremental step in the spirit of iSAM2 (Kaess et al.,
+ *   2012): estimates are kept as linearization points + deltas, and only
+ *   constraints that are new or that touch nodes moved beyond thresholds
+ *   are relinearized. Since the factor is computed row by row, rows of
+ *   nodes that precede the earliest modified one are reused, so appending
+ *   odometry costs a few rows and a loop closure costs the rows from
+ *   the closed node on rather than the whole graph. Deltas of preceding
+ *   nodes are updated only while they change noticeably.
+ * NB: node poses of the graph are updated by both modes (see
+ *     PoseGraphMap::set_node_pose); the optimizer expects nodes and edges
+ *     to be only appended to the graph. */
+class PoseGraphOptimizer {
+private: // types
+  using Vector3 = std::array<double, 3>;
+  // row-major
+  using Block = std::array<double, 9>;
+
+  struct NodeState {
+    RobotPose lin;
+    Vector3 delta;
+    std::vector<std::size_t> edges;
+  };
+
+  // Jacobian products of an edge from b to a (a is the `to` node)
+  struct EdgeState {
+    std::size_t a, b;
+    Block h_aa, h_ab, h_bb;
+    Vector3 b_a, b_b;
+  };
+public:
+  explicit PoseGraphOptimizer(const PoseGraphOptimizerParams &params = {})
+    : _params(params) {}
+
+  PoseGraphOptimizationStats optimize(PoseGraphMap &graph) {
+    register_additions(graph);
+    auto stats = PoseGraphOptimizationStats{};
+    auto damping = _params.init_damping;
+    stats.chi2 = estimates_chi2(graph);
+    for (unsigned i = 0; i < _params.max_iterations_nm; ++i) {
+      ++stats.iterations_nm;
+      for (auto &node : _nodes) {
+        node.lin = estimate(node);
+        node.delta = {0, 0, 0};
+      }
+      for (auto &edge : _edges) { linearize(edge, graph); }
+      for (std::size_t n = 0; n < _nodes.size(); ++n) {
+        build_column(n, damping);
+      }
+      _cholesky.invalidate_from(0);
+      stats.refactored_rows_nm = _cholesky.size();
+      if (!solve(0, 0)) {
+        damping *= 10;
+        continue;
+      }
+
+      auto step_chi2 = estimates_chi2(graph);
+      if (stats.chi2 <= step_chi2) {
+        for (auto &node : _nodes) { node.delta = {0, 0, 0}; }
+        std::fill(_solution.begin(), _solution.end(), 0);
+        damping *= 10;
+        continue;
+      }
+      stats.chi2 = step_chi2;
+      damping = std::max(damping / 10, 1e-12);
+      if (max_step() < _params.min_step) { break; }
+    }
+
+    // NB: the system is damped, so it is rebuilt by the next update
+    for (std::size_t n = 0; n < _nodes.size(); ++n) { mark_dirty(n); }
+    auto &nodes = graph.nodes();
+    for (std::size_t n = 0; n < _nodes.size(); ++n) {
+      graph.set_node_pose(nodes[n], estimate(_nodes[n]));
+    }
+    return stats;
+  }
+
+  // PERFORMANCE: only nodes that have been moved by the previous update
+  //              are checked for relinearization.
+  PoseGraphOptimizationStats update(PoseGraphMap &graph) {
+    register_additions(graph);
+    for (auto n : _moved_nodes) {
+      _node_is_moved[n] = false;
+      auto &node = _nodes[n];
+      auto &d = node.delta;
+      if (std::sqrt(d[0] * d[0] + d[1] * d[1]) <=
+            _params.relinearization_translation &&
+          std::abs(d[2]) <= _params.relinearization_rotation) {
+        continue;
+      }
+      node.lin = estimate(node);
+      node.delta = {0, 0, 0};
+      for (auto e : node.edges) { mark_stale(e); }
+    }
+    _moved_nodes.clear();
+    for (auto e : _stale_edges) {
+      _edge_is_stale[e] = false;
+      linearize(_edges[e], graph);
+      mark_dirty(_edges[e].a);
+      mark_dirty(_edges[e].b);
+    }
+    _stale_edges.clear();
+
+    auto stats = PoseGraphOptimizationStats{};
+    if (_dirty_nodes.empty()) { return stats; }
+    auto first_dirty = _nodes.size();
+    for (auto n : _dirty_nodes) {
+      build_column(n, 0);
+      first_dirty = std::min(first_dirty, n);
+    }
+    _cholesky.invalidate_from(3 * first_dirty);
+    stats.iterations_nm = 1;
+    stats.refactored_rows_nm = _cholesky.size() - _cholesky.valid_rows_nm();
+    if (solve(3 * first_dirty, _params.backsubstitution_tolerance)) {
+      auto &nodes = graph.nodes();
+      for (auto n : _moved_nodes) {
+        graph.set_node_pose(nodes[n], estimate(_nodes[n]));
+      }
+    }
+    return stats;
+  }
+
+  // The weighted squared error of node poses of the graph
+  double chi2(const PoseGraphMap &graph) const {
+    return chi2(graph, [&graph](std::size_t n) {
+      return graph.nodes()[n]->pose;
+    });
+  }
+
+private: // methods
+
+  double estimates_chi2(const PoseGraphMap &graph) const {
+    return chi2(graph, [this](std::size_t n) {
+      return estimate(_nodes[n]);
+    });
+  }
+
+  template <typename PoseByNode>
+  double chi2(const PoseGraphMap &graph, PoseByNode pose_by_node) const {
+    auto total = double{0};
+    for (auto &edge : graph.edges()) {
+      auto e = edge_error(*edge, pose_by_node(edge->to->id),
+                          pose_by_node(edge->from->id));
+      auto &info = edge->information;
+      total += info.x * e[0] * e[0] + info.y * e[1] * e[1] +
+               info.theta * e[2] * e[2];
+    }
+    // NB: the anchor is set once the first node is registered
+    if (!_nodes.empty()) {
+      auto e = anchor_error(pose_by_node(0));
+      total += _params.anchor_information *
+               (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+    }
+    return total;
+  }
+
+  static RobotPose estimate(const NodeState &node) {
+    return RobotPose(node.lin.x + node.delta[0], node.lin.y + node.delta[1],
+                     std::remainder(node.lin.theta + node.delta[2], 2 * M_PI));
+  }
+
+  static Vector3 edge_error(const PoseGraphEdge &edge,
+                            const RobotPose &to, const RobotPose &from) {
+    auto h = relative_pose(to, from);
+    auto &z = edge.pose_delta;
+    auto c = std::cos(z.theta), s = std::sin(z.theta);
+    auto dx = h.x - z.x, dy = h.y - z.y;
+    return {c * dx + s * dy, -s * dx + c * dy,
+            std::remainder(h.theta - z.theta, 2 * M_PI)};
+  }
+
+  Vector3 anchor_error(const RobotPose &pose) const {
+    return {pose.x - _anchor.x, pose.y - _anchor.y,
+            std::remainder(pose.theta - _anchor.theta, 2 * M_PI)};
+  }
+
+  void register_additions(const PoseGraphMap &graph) {
+    auto &nodes = graph.nodes();
+    if (_nodes.empty() && !nodes.empty()) { _anchor = nodes[0]->pose; }
+    for (auto n = _nodes.size(); n < nodes.size(); ++n) {
+      assert(nodes[n]->id == n);
+      _nodes.push_back({nodes[n]->pose, {0, 0, 0}, {}});
+      _node_is_dirty.push_back(false);
+      _node_is_moved.push_back(false);
+      mark_dirty(n);
+    }
+    _cholesky.resize(3 * _nodes.size());
+    _rhs.resize(3 * _nodes.size(), 0);
+    _solution.resize(3 * _nodes.size(), 0);
+
+    auto &edges = graph.edges();
+    for (auto e = _edges.size(); e < edges.size(); ++e) {
+      auto a = edges[e]->to->id, b = edges[e]->from->id;
+      assert(a != b);
+      _edges.push_back({a, b, {}, {}, {}, {}, {}});
+      _edge_is_stale.push_back(false);
+      mark_stale(e);
+      _nodes[a].edges.push_back(e);
+      _nodes[b].edges.push_back(e);
+    }
+  }
+
+  void mark_stale(std::size_t e) {
+    if (_edge_is_stale[e]) { return; }
+    _edge_is_stale[e] = true;
+    _stale_edges.push_back(e);
+  }
+
+  void mark_dirty(std::size_t n) {
+    if (_node_is_dirty[n]) { return; }
+    _node_is_dirty[n] = true;
+    _dirty_nodes.push_back(n);
+  }
+
+  // Computes the edge's Jacobian products at linearization points
+  void linearize(EdgeState &state, const PoseGraphMap &graph) {
+    auto &edge = *graph.edges()[&state - _edges.data()];
+    auto &to = _nodes[state.a].lin, &from = _nodes[state.b].lin;
+    auto e = edge_error(edge, to, from);
+
+    // d(e_xy) / d(from_xy) is the rotation by -(to.theta + z.theta)
+    auto angle = to.theta + edge.pose_delta.theta;
+    auto c = std::cos(angle), s = std::sin(angle);
+    auto dx = from.x - to.x, dy = from.y - to.y;
+    auto j_b = Block{c, s, 0,
+                     -s, c, 0,
+                     0, 0, 1};
+    auto j_a = Block{-c, -s, -s * dx + c * dy,
+                     s, -c, -c * dx - s * dy,
+                     0, 0, -1};
+    auto &info = edge.information;
+    auto w = Vector3{info.x, info.y, info.theta};
+
+    state.h_aa = weighted_product(j_a, w, j_a);
+    state.h_ab = weighted_product(j_a, w, j_b);
+    state.h_bb = weighted_product(j_b, w, j_b);
+    state.b_a = weighted_product(j_a, w, e);
+    state.b_b = weighted_product(j_b, w, e);
+  }
+
+  // J1^T * diag(w) * J2
+  static Block weighted_product(const Block &j1, const Vector3 &w,
+                                const Block &j2) {
+    auto result = Block{};
+    for (int r = 0; r < 3; ++r) {
+      for (int c = 0; c < 3; ++c) {
+        auto &v = result[3 * r + c];
+        for (int k = 0; k < 3; ++k) {
+          v += j1[3 * k + r] * w[k] * j2[3 * k + c];
+        }
+      }
+    }
+    return result;
+  }
+
+  // J^T * diag(w) * e
+  static Vector3 weighted_product(const Block &j, const Vector3 &w,
+                                  const Vector3 &e) {
+    auto result = Vector3{};
+    for (int r = 0; r < 3; ++r) {
+      for (int k = 0; k < 3; ++k) {
+        result[r] += j[3 * k + r] * w[k] * e[k];
+      }
+    }
+    return result;
+  }
+
+  // Assembles upper triangle columns of the node and its rhs entries
+  void build_column(std::size_t n, double damping) {
+    auto diag = Block{};
+    auto b = Vector3{};
+    _off_diag_blocks.clear();
+    for (auto e : _nodes[n].edges) {
+      auto &edge = _edges[e];
+      auto is_a = edge.a == n;
+      add(diag, is_a ? edge.h_aa : edge.h_bb);
+      for (int i = 0; i < 3; ++i) { b[i] += is_a ? edge.b_a[i] : edge.b_b[i]; }
+      auto other = is_a ? edge.b : edge.a;
+      if (n < other) { continue; }
+      // the block of the other node's rows and the node's columns
+      _off_diag_blocks.emplace_back(other,
+                                    is_a ? transposed(edge.h_ab) : edge.h_ab);
+    }
+    if (n == 0) {
+      auto e = anchor_error(_nodes[0].lin);
+      for (int i = 0; i < 3; ++i) {
+        diag[4 * i] += _params.anchor_information;
+        b[i] += _params.anchor_information * e[i];
+      }
+    }
+    for (int i = 0; i < 3; ++i) {
+      diag[4 * i] += damping;
+      _rhs[3 * n + i] = -b[i];
+    }
+
+    // NB: blocks of parallel edges are summed up by the factorization
+    for (int c = 0; c < 3; ++c) {
+      auto &column = _cholesky.column(3 * n + c);
+      column.clear();
+      for (auto &block : _off_diag_blocks) {
+        for (int r = 0; r < 3; ++r) {
+          column.add(3 * block.first + r, block.second[3 * r + c]);
+        }
+      }
+      for (int r = 0; r <= c; ++r) {
+        column.add(3 * n + r, diag[3 * r + c]);
+      }
+    }
+    _node_is_dirty[n] = false;
+  }
+
+  static void add(Block &dst, const Block &src) {
+    for (std::size_t i = 0; i < dst.size(); ++i) { dst[i] += src[i]; }
+  }
+
+  static Block transposed(const Block &b) {
+    return {b[0], b[3], b[6],
+            b[1], b[4], b[7],
+            b[2], b[5], b[8]};
+  }
+
+  // Factorizes invalidated rows and updates deltas by the solution
+  // (see IncrementalSparseCholesky::solve)
+  bool solve(int first_row, double tolerance) {
+    _dirty_nodes.clear();
+    if (!_cholesky.factorize()) { return false; }
+    for (auto row : _cholesky.solve(_rhs, first_row, tolerance, _solution)) {
+      auto n = std::size_t(row / 3);
+      _nodes[n].delta[row % 3] = _solution[row];
+      if (_node_is_moved[n]) { continue; }
+      _node_is_moved[n] = true;
+      _moved_nodes.push_back(n);
+    }
+    return true;
+  }
+
+  double max_step() const {
+    auto step = double{0};
+    for (auto v : _solution) { step = std::max(step, std::abs(v)); }
+    return step;
+  }
+
+private: // fields
+  PoseGraphOptimizerParams _params;
+  RobotPose _anchor;
+  std::vector<NodeState> _nodes;
+  std::vector<EdgeState> _edges;
+  std::vector<bool> _edge_is_stale, _node_is_dirty, _node_is_moved;
+  std::vector<std::size_t> _stale_edges, _dirty_nodes, _moved_nodes;
+  IncrementalSparseCholesky _cholesky;
+  std::vector<double> _rhs, _solution;
+  // a buffer reused by column assemblies
+  std::vector<std::pair<std::size_t, Block>> _off_diag_blocks;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef SLAM_CTOR_GRAPH_POSE_GRID_INDEX_H
+#define SLAM_CTOR_GRAPH_POSE_GRID_INDEX_H
+
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include "../../core/states/robot_pose.h"
+
+/* A uniform grid hash of positions of poses identified by indices
+ * (e.g. pose graph nodes). A radius query visits cells that intersect
+ * the query's bounding square only, so its cost depends on the density
+ * of poses around the query rather than on the number of poses.
+ * NB: a cell side close to a typical query radius is a good choice. */
+class PoseGridIndex {
+private: // types
+  using CellKey = uint64_t;
+public:
+  explicit PoseGridIndex(double cell_side = 1.0) : _cell_side{cell_side} {}
+
+  std::size_t size() const { return _cell_keys.size(); }
+
+  // NB: ids are expected to be added in order, i.e. id == size()
+  void add(std::size_t id, const RobotPose &pose) {
+    assert(id == _cell_keys.size());
+    auto key = cell_key(pose.x, pose.y);
+    _cell_keys.push_back(key);
+    _cells[key].push_back(id);
+  }
+
+  void move(std::size_t id, const RobotPose &pose) {
+    auto key = cell_key(pose.x, pose.y);
+    auto &old_key = _cell_keys[id];
+    if (key == old_key) { return; }
+
+    auto cell = _cells.find(old_key);
+    assert(cell != _cells.end());
+    auto &ids = cell->second;
+    auto id_it = std::find(ids.begin(), ids.end(), id);
+    assert(id_it != ids.end());
+    *id_it = ids.back();
+    ids.pop_back();
+    if (ids.empty()) { _cells.erase(cell); }
+
+    old_key = key;
+    _cells[key].push_back(id);
+  }
+
+  // Calls handle(id) for ids whose cells intersect the square around
+  // the position, i.e. candidates are expected to be checked by a caller.
+  template <typename IdHandler>
+  void for_each_candidate(double x, double y, double radius,
+                          IdHandler handle) const {
+    auto min_x = cell_coord(x - radius), max_x = cell_coord(x + radius);
+    auto min_y = cell_coord(y - radius), max_y = cell_coord(y + radius);
+    for (auto cx = min_x; cx <= max_x; ++cx) {
+      for (auto cy = min_y; cy <= max_y; ++cy) {
+        auto cell = _cells.find(cell_key(cx, cy));
+        if (cell == _cells.end()) { continue; }
+        for (auto id : cell->second) { handle(id); }
+      }
+    }
+  }
+
+private: // methods
+
+  int32_t cell_coord(double v) const {
+    return int32_t(std::floor(v / _cell_side));
+  }
+
+  CellKey cell_key(double x, double y) const {
+    return cell_key(cell_coord(x), cell_coord(y));
+  }
+
+  static CellKey cell_key(int32_t cx, int32_t cy) {
+    return (CellKey(uint32_t(cx)) << 32) | uint32_t(cy);
+  }
+
+private: // fields
+  double _cell_side;
+  std::unordered_map<CellKey, std::vector<std::size_t>> _cells;
+  // a cell of each id
+  std::vector<CellKey> _cell_keys;
+};
+
+#endif
@@ -1,8 +1,10 @@
 #ifndef __RVIZ_GRAPH_VIEWER_H
 #define __RVIZ_GRRAPH_VIEWER_H
 
+#include <set>
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include <algorithm>
 
 #include <ros/ros.h>
@@ -13,34 +15,103 @@
 #include "../../core/states/state_data.h"
 #include "pose_graph_map.h"
 
+struct RvizGraphViewerParams {
+  // a min period of map publishing, seconds
+  double publishing_period = 3.0;
+  // a min period of the whole graph resend, seconds
+  double full_refresh_period = 30.0;
+};
+
+/* Publishes a pose graph as markers of node and edge chunks.
+ * PERFORMANCE: only chunks with nodes/edges that are added or moved since
+ *              the last publishing are sent (see PoseGraphMap::version),
+ *              so an update costs the size of the change rather than of
+ *              the graph. The whole graph is resent rarely to recover
+ *              markers lost by subscribers (e.g. ones started later). */
 // TODO: move common code to RvizSlamViewer
-// TODO: add incremental map update (do not send entire graph all the time)
 class RvizGraphViewer : public WorldMapObserver<PoseGraphMap> {
 public: // method
-  RvizGraphViewer(ros::Publisher pub):
-    _map_pub(pub) {}
+  RvizGraphViewer(ros::Publisher pub,
+                  const RvizGraphViewerParams &params = {}):
+    _map_pub(pub), _params(params) {}
 
   void on_map_update(const PoseGraphMap &map) override {
-    // TODO: move map publishing rate to parameter
-    if ((ros::Time::now() - _last_pub_time).toSec() < 3.0) {
+    auto now = ros::Time::now();
+    if ((now - _last_pub_time).toSec() < _params.publishing_period) {
       return;
     }
+
     visualization_msgs::MarkerArray map_msg;
-    map_msg.markers.push_back(create_nodes_marker(map.nodes()));
-    map_msg.markers.push_back(create_edges_marker(map.edges()));
+    auto is_full_refresh =
+      _params.full_refresh_period <= (now - _last_refresh_time).toSec();
+    if (is_full_refresh) {
+      map_msg.markers.push_back(create_delete_all_marker());
+      _last_refresh_time = now;
+    }
+    auto node_chunks = std::set<std::size_t>{};
+    auto edge_chunks = std::set<std::size_t>{};
+    find_dirty_chunks(map, is_full_refresh, node_chunks, edge_chunks);
+    for (auto chunk : node_chunks) {
+      map_msg.markers.push_back(create_nodes_marker(map.nodes(), chunk));
+    }
+    for (auto chunk : edge_chunks) {
+      map_msg.markers.push_back(create_edges_marker(map.edges(), chunk));
+    }
 
+    _published_version = map.version();
+    _published_edges_nm = map.edges().size();
+    _last_pub_time = now;
+    if (map_msg.markers.empty()) { return; }
     _map_pub.publish(map_msg);
-    _last_pub_time = ros::Time::now();
   }
 
 private: // types
   //TODO: get from GraphMap type
   using NodePtr = std::shared_ptr<PoseGraphNode>;
   using EdgePtr = std::shared_ptr<PoseGraphEdge>;
+private: // consts
+  static constexpr std::size_t Chunk_Size = 256;
 private: // methods
 
+  // NB: a chunk of an edge is dirty if the edge is new or one of its
+  //     nodes is moved.
+  void find_dirty_chunks(const PoseGraphMap &map, bool all_are_dirty,
+                         std::set<std::size_t> &node_chunks,
+                         std::set<std::size_t> &edge_chunks) const {
+    auto &nodes = map.nodes();
+    auto &edges = map.edges();
+    if (all_are_dirty) {
+      for (std::size_t i = 0; i < nodes.size(); i += Chunk_Size) {
+        node_chunks.insert(i / Chunk_Size);
+      }
+      for (std::size_t i = 0; i < edges.size(); i += Chunk_Size) {
+        edge_chunks.insert(i / Chunk_Size);
+      }
+      return;
+    }
+
+    for (auto &node : nodes) {
+      if (node->version <= _published_version) { continue; }
+      node_chunks.insert(node->id / Chunk_Size);
+      for (auto &edge : node->edges) {
+        edge_chunks.insert(edge->id / Chunk_Size);
+      }
+    }
+    for (auto i = _published_edges_nm; i < edges.size(); ++i) {
+      edge_chunks.insert(i / Chunk_Size);
+    }
+  }
+
+  visualization_msgs::Marker create_delete_all_marker() {
+    visualization_msgs::Marker marker;
+    marker.header.frame_id = "odom_combined";
+    marker.header.stamp = ros::Time::now();
+    marker.action = visualization_msgs::Marker::DELETEALL;
+    return marker;
+  }
+
   visualization_msgs::Marker create_nodes_marker(
-      const std::vector<NodePtr> &nodes) {
+      const std::vector<NodePtr> &nodes, std::size_t chunk) {
     visualization_msgs::Marker nodes_marker;
 
     nodes_marker.header.frame_id = "odom_combined";
@@ -48,7 +119,8 @@ private: // methods
 
     nodes_marker.type = visualization_msgs::Marker::SPHERE_LIST;
     nodes_marker.ns = "graph_map_nodes";
-    nodes_marker.id = 0;
+    nodes_marker.id = chunk;
+    // NB: a marker with a known id is modified
     nodes_marker.action = visualization_msgs::Marker::ADD;
 
     nodes_marker.color.r = nodes_marker.color.a = 1.0;
@@ -57,15 +129,16 @@ private: // methods
 
     nodes_marker.scale.x = nodes_marker.scale.y = nodes_marker.scale.z = 0.2;
 
-    for (auto& node : nodes) {
-      nodes_marker.points.push_back(make_2D_point(node));
+    auto end = std::min(nodes.size(), (chunk + 1) * Chunk_Size);
+    for (auto i = chunk * Chunk_Size; i < end; ++i) {
+      nodes_marker.points.push_back(make_2D_point(nodes[i]));
     }
 
     return nodes_marker;
   }
 
   visualization_msgs::Marker create_edges_marker(
-      const std::vector<EdgePtr>& edges) {
+      const std::vector<EdgePtr>& edges, std::size_t chunk) {
     visualization_msgs::Marker edges_marker;
 
     edges_marker.header.frame_id = "odom_combined";
@@ -73,7 +146,7 @@ private: // methods
 
     edges_marker.type = visualization_msgs::Marker::LINE_LIST;
     edges_marker.ns = "graph_map_edges";
-    edges_marker.id = 0;
+    edges_marker.id = chunk;
     edges_marker.action = visualization_msgs::Marker::ADD;
 
     edges_marker.color.r = 0.0;
@@ -86,9 +159,10 @@ private: // methods
     edges_marker.scale.x = 0.07;
     edges_marker.scale.y = edges_marker.scale.z = 0.0;
 
-    for (auto& edge : edges) {
-      edges_marker.points.push_back(make_2D_point(edge->from));
-      edges_marker.points.push_back(make_2D_point(edge->to));
+    auto end = std::min(edges.size(), (chunk + 1) * Chunk_Size);
+    for (auto i = chunk * Chunk_Size; i < end; ++i) {
+      edges_marker.points.push_back(make_2D_point(edges[i]->from));
+      edges_marker.points.push_back(make_2D_point(edges[i]->to));
     }
 
     return edges_marker;
@@ -105,7 +179,11 @@ private: // methods
 
 private: // fields
   ros::Publisher _map_pub;
-  ros::Time _last_pub_time;
+  RvizGraphViewerParams _params;
+  ros::Time _last_pub_time, _last_refresh_time;
+  // the graph state known by subscribers
+  uint64_t _published_version = 0;
+  std::size_t _published_edges_nm = 0;
   tf::TransformBroadcaster _tf_brcst;
 };
 
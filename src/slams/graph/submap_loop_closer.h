@@ -0,0 +1,154 @@
+#ifndef SLAM_CTOR_GRAPH_SUBMAP_LOOP_CLOSER_H
+#define SLAM_CTOR_GRAPH_SUBMAP_LOOP_CLOSER_H
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "../../core/geometry_primitives.h"
+#include "../../core/maps/plain_grid_map.h"
+#include "../../core/maps/rescalable_caching_grid_map.h"
+#include "../../core/scan_matchers/m3rsm_engine.h"
+#include "../../core/scan_matchers/occupancy_observation_probability.h"
+#include "../../core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "pose_graph_map.h"
+
+// A local map of consecutive scans built in the frame of its anchor node,
+// i.e. the submap follows the node once the graph is optimized.
+// NB: the anchor is referred by an id since a submap may be started
+//     before the node is added to the graph (see GraphSlamWorld).
+struct Submap {
+  using MapType = RescalableCachingGridMap<UnboundedPlainGridMap>;
+
+  Submap(std::size_t anchor_node_id, std::shared_ptr<GridCell> prototype,
+         const GridMapParams &params)
+    : anchor_id{anchor_node_id}
+    , map{std::make_unique<MapType>(prototype, params)} {}
+
+  std::size_t anchor_id;
+  // NB: the map is kept by a pointer since matchers refer to it
+  std::unique_ptr<MapType> map;
+  std::size_t scans_nm = 0;
+  // a finished submap is not updated and may be a loop closure candidate
+  bool is_finished = false;
+};
+
+struct SubmapLoopCloserParams {
+  // the search window around a candidate pose
+  double max_translation_error = 2.0;
+  double max_rotation_error = deg2rad(30);
+  double rotation_step = deg2rad(1);
+  double translation_step = 0.05;
+  // a closure is accepted if the scan probability is not less
+  double min_probability = 0.6;
+};
+
+struct SubmapLoopClosure {
+  // an id of a candidate (see SubmapLoopCloser::add_candidate)
+  std::size_t candidate_id;
+  // the pose of the scan in the frame of the candidate's map
+  RobotPoseDelta scan_pose;
+  double probability;
+};
+
+/* Verifies loop closure candidates by matching a scan against maps of
+ * the candidates (e.g. submaps) in windows around expected scan poses.
+ * PERFORMANCE: requests for all candidates share a single branch-and-bound
+ *              search of M3RSMEngine (the many-to-many matching of Olson,
+ *              2015), so coarse bounds of rescaled maps prune poses of all
+ *              candidates at once and only the best one is refined to
+ *              the finest resolution. Windows of a few meters and tens
+ *              of degrees are affordable this way. */
+class SubmapLoopCloser {
+private: // types
+  struct Candidate {
+    std::size_t id;
+    GridMap *map;
+    RobotPose scan_pose;
+  };
+public:
+  // NB: a scan probability of the estimator is expected to be bounded
+  //     by its probability on a coarser map of a rescalable one, e.g.
+  //     observations are estimated by max occupancies of areas.
+  SubmapLoopCloser(std::shared_ptr<ScanProbabilityEstimator> spe,
+                   const SubmapLoopCloserParams &params = {})
+    : _spe{std::move(spe)}, _params(params) {}
+
+  static std::shared_ptr<ScanProbabilityEstimator> default_spe() {
+    return std::make_shared<WeightedMeanPointProbabilitySPE>(
+      std::make_shared<MaxOccupancyObservationPE>(),
+      std::make_shared<EvenSPW>());
+  }
+
+  const SubmapLoopCloserParams& params() const { return _params; }
+
+  // NB: the map is rescaled by the search (and restored on its end),
+  //     so it is expected to be a rescalable one.
+  void add_candidate(std::size_t id, GridMap &map,
+                     const RobotPose &scan_pose) {
+    _candidates.push_back(Candidate{id, &map, scan_pose});
+  }
+
+  // Finds the most probable pose of the scan among added candidates;
+  // the candidates are dropped.
+  bool find_closure(const LaserScan2D &scan, SubmapLoopClosure &closure) {
+    auto is_found = false;
+    if (_candidates.empty()) { return is_found; }
+
+    // NB: improbable candidates are pruned by coarse bounds
+    _engine.set_min_probability(_params.min_probability);
+    _engine.reset_engine_state();
+    _engine.set_translation_lookup_range(_params.max_translation_error,
+                                         _params.max_translation_error);
+    _engine.set_rotation_lookup_range(2 * _params.max_rotation_error,
+                                      _params.rotation_step);
+    // NB: candidates are not modified further, so poses are not moved
+    for (auto &candidate : _candidates) {
+      candidate.map->rescale(0);
+      _engine.add_scan_matching_request(_spe, candidate.scan_pose, scan,
+                                        *candidate.map, true);
+    }
+
+    while (1) {
+      auto match = _engine.next_best_match(_params.translation_step);
+      if (!match.is_valid()) { break; } // nothing is probable enough
+      if (!match.is_finest()) {
+        // NB: see BruteForceMultiResolutionScanMatcher::process_scan
+        auto crucial_points = match.translation_drift.corners();
+        crucial_points.push_back(match.translation_drift.center());
+        for (const auto &cp : crucial_points) {
+          _engine.add_refined_match(match, M3RSMEngine::Rect{cp});
+        }
+        continue;
+      }
+      // NB: the bound of a finest match is its probability and matches
+      //     are found by bounds, so the rest ones are not more probable.
+      auto candidate = std::find_if(
+        _candidates.begin(), _candidates.end(),
+        [&match](const Candidate &c) { return c.map == match.map; });
+      assert(candidate != _candidates.end());
+      auto drift = match.translation_drift.center();
+      auto &pose = candidate->scan_pose;
+      closure = SubmapLoopClosure{
+        candidate->id,
+        RobotPoseDelta(pose.x + drift.x, pose.y + drift.y,
+                       pose.theta + match.rotation),
+        match.prob_upper_bound};
+      is_found = true;
+      break;
+    }
+
+    for (auto &candidate : _candidates) { candidate.map->rescale(0); }
+    _candidates.clear();
+    return is_found;
+  }
+
+private: // fields
+  std::shared_ptr<ScanProbabilityEstimator> _spe;
+  SubmapLoopCloserParams _params;
+  M3RSMEngine _engine;
+  std::vector<Candidate> _candidates;
+};
+
+#endif
@@ -6,6 +6,9 @@
 
 #include "../../utils/init_scan_matching.h"
 #include "../../utils/init_occupancy_mapping.h"
+#include "../../utils/init_stage_profiling.h"
+#include "../../utils/init_session.h"
+#include "../../utils/init_map_backend.h"
 
 #include "../../core/maps/plain_grid_map.h"
 #include "../../core/states/single_state_hypothesis_laser_scan_grid_world.h"
@@ -35,14 +38,40 @@ void setup_tiny_cell_prototype(const PropertiesProvider &props,
 }
 
 // FIXME: ~code duplication init_viny_slam.cpp
+template <typename SlamT = TinySlam>
 auto init_tiny_slam(const PropertiesProvider &props) {
   auto slam_props = SingleStateHypothesisLSGWProperties{};
   setup_tiny_cell_prototype(props, slam_props);
 
-  slam_props.gsm = init_scan_matcher(props);
+  slam_props.gsm = init_scan_matcher<typename SlamT::MapType>(props);
   slam_props.gmsa = init_scan_adder(props);
   slam_props.map_props = init_grid_map_params(props);
-  return std::make_shared<TinySlam>(slam_props);
+  slam_props.stage_profiler = init_stage_profiler(props);
+  slam_props.pipelined_mapping = init_pipelined_mapping(props);
+  slam_props.mapping_queue_size = init_mapping_queue_size(props);
+  slam_props.localization_only = init_localization_only(props);
+  setup_keyframe_gating(props, slam_props);
+  setup_catch_up(props, slam_props);
+  auto slam = std::make_shared<SlamT>(slam_props);
+  init_localization_map(props, *slam);
+  init_session(props, *slam);
+  return slam;
+}
+
+// NB: the cell type is chosen at runtime (see setup_tiny_cell_prototype),
+//     so cells are polymorphic
+using TinyMapBackends = MapBackends<PolymorphicCellStorage>;
+
+// Calls handle(slam) with tinySLAM of the configured map backend
+// (see init_map_backend)
+template <typename SlamHandler>
+void with_tiny_slam(const PropertiesProvider &props, SlamHandler &&handle) {
+  with_map_backend<TinyMapBackends>(props, MapBackend::Plain,
+                                    [&props, &handle](auto map_tag) {
+    using MapT = typename decltype(map_tag)::type;
+    handle(init_tiny_slam<SingleStateHypothesisLaserScanGridWorld<MapT>>(
+      props));
+  });
 }
 
 #endif
@@ -1,6 +1,8 @@
 #ifndef SLAM_CTOR_SLAM_TINY_GRID_CELL_H
 #define SLAM_CTOR_SLAM_TINY_GRID_CELL_H
 
+#include <typeinfo>
+
 #include "../../core/maps/grid_cell.h"
 
 //------------------------------------------------------------------------------
@@ -14,6 +16,8 @@ public:
     return std::make_unique<BaseTinyCell>(*this);
   }
 
+  virtual std::size_t memory_size() const { return sizeof(*this); }
+
   virtual void operator+=(const AreaOccupancyObservation &aoo) {
     if (!aoo.occupancy.is_valid()) { return; }
 
@@ -33,6 +37,8 @@ public:
     return std::make_unique<AvgTinyCell>(*this);
   }
 
+  virtual std::size_t memory_size() const { return sizeof(*this); }
+
   virtual void operator+=(const AreaOccupancyObservation &aoo) {
     if (!aoo.occupancy.is_valid()) { return; }
 
@@ -41,6 +47,18 @@ public:
     _occupancy.prob_occ = ((*this) * (_n - 1) + that_p) / _n;
   }
 
+  // NB: the average of all observations of both cells
+  virtual void merge(const GridCell &that) {
+    if (typeid(that) != typeid(AvgTinyCell)) {
+      GridCell::merge(that);
+      return;
+    }
+    auto that_n = static_cast<const AvgTinyCell &>(that)._n;
+    if (that_n == 0) { return; }
+    _occupancy.prob_occ = ((*this) * _n + that * that_n) / (_n + that_n);
+    _n += that_n;
+  }
+
 private:
   double _n;
 };
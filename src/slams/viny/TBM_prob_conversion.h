@@ -5,26 +5,31 @@
 #include "../../core/states/state_data.h"
 
 // TBM ---> Occupancy
-Occupancy TBM_to_O(const TBM& tbm) {
+inline Occupancy TBM_to_O(const TBM& tbm) {
   /* double qual = tbm.occupied() + tbm.empty(); */
   /* double p_occu = tbm.occupied() / qual; */
   /* return Occupancy { p_occu, qual }; */
-  return Occupancy{ tbm.occupied() + 0.5 * tbm.unknown(), 1.0 };
+  return Occupancy(tbm.occupied() + 0.5 * tbm.unknown(), 1.0);
 }
 
-// AreaOccupancyObservation ---> TBM
-TBM AOO_to_TBM(const AreaOccupancyObservation& aoo) {
-  if (!aoo.occupancy.is_valid())
-    return TBM();
-  
+// Masses of the belief of an observation; the unknown mass is the rest,
+// the conflict one is 0.
+struct ObservationMasses {
+  double empty, occupied;
+
+  TBM belief() const {
+    return TBM{1.0 - occupied - empty, empty, occupied, 0.0};
+  }
+};
+
+// AreaOccupancyObservation ---> masses of a TBM
+// NB: the observation occupancy is expected to be valid.
+inline ObservationMasses AOO_to_masses(const AreaOccupancyObservation& aoo) {
   // TODO: consider other conversion schemas
   double prob_occ = aoo.occupancy.prob_occ;
   double est_qual = aoo.occupancy.estimation_quality * aoo.quality;
-  
-  double occupied = prob_occ * est_qual;
-  double empty = (1 - prob_occ) * est_qual;
-  return TBM{1.0 - occupied - empty, empty, occupied, 0.0};
-  
+  return {(1 - prob_occ) * est_qual, prob_occ * est_qual};
+
   /*
   if (aoo.is_occupied) {
     _occupied = prob_occ * est_qual;
@@ -36,4 +41,11 @@ TBM AOO_to_TBM(const AreaOccupancyObservation& aoo) {
   */
 }
 
+// AreaOccupancyObservation ---> TBM
+inline TBM AOO_to_TBM(const AreaOccupancyObservation& aoo) {
+  if (!aoo.occupancy.is_valid())
+    return TBM();
+  return AOO_to_masses(aoo).belief();
+}
+
 #endif
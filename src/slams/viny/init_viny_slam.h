@@ -5,14 +5,25 @@
 
 #include "../../utils/init_scan_matching.h"
 #include "../../utils/init_occupancy_mapping.h"
+#include "../../utils/init_stage_profiling.h"
+#include "../../utils/init_session.h"
+#include "../../utils/init_map_backend.h"
 
-#include "../../core/maps/plain_grid_map.h"
+#include "../../core/maps/typed_grid_map.h"
+#include "../../core/maps/lazy_tiled_grid_map.h"
+#include "../../core/maps/packed_tbm_cell_codec.h"
 #include "../../core/states/single_state_hypothesis_laser_scan_grid_world.h"
 
 #include "viny_grid_cell.h"
 
-using VinySlam = SingleStateHypothesisLaserScanGridWorld<UnboundedPlainGridMap>;
+using VinySlam = SingleStateHypothesisLaserScanGridWorld<
+  TypedGridMap<VinyDSCell>>;
+// NB: a 128x128 tile of packed cells (12 bytes per cell) fits L2 cache
+using PackedVinySlam = SingleStateHypothesisLaserScanGridWorld<
+  GenericUnboundedLazyTiledGridMap<
+    QuantizedCellStorage<PackedTBMCellCodec<VinyDSCell>>>>;
 
+template <typename SlamT = VinySlam>
 auto init_viny_slam(const PropertiesProvider &props) {
   auto slam_props = SingleStateHypothesisLSGWProperties{};
   // FIXME: move to params
@@ -20,10 +31,46 @@ auto init_viny_slam(const PropertiesProvider &props) {
   slam_props.raw_scan_quality = 0.6;
   slam_props.cell_prototype = std::make_shared<VinyDSCell>();
 
-  slam_props.gsm = init_scan_matcher(props);
+  slam_props.gsm = init_scan_matcher<typename SlamT::MapType>(props);
   slam_props.gmsa = init_scan_adder(props);
   slam_props.map_props = init_grid_map_params(props);
-  return std::make_shared<VinySlam>(slam_props);
+  slam_props.stage_profiler = init_stage_profiler(props);
+  slam_props.pipelined_mapping = init_pipelined_mapping(props);
+  slam_props.mapping_queue_size = init_mapping_queue_size(props);
+  slam_props.localization_only = init_localization_only(props);
+  setup_keyframe_gating(props, slam_props);
+  setup_catch_up(props, slam_props);
+  auto slam = std::make_shared<SlamT>(slam_props);
+  init_localization_map(props, *slam);
+  init_session(props, *slam);
+  return slam;
+}
+
+// NB: the plain map keeps typed cells, so cell operations are inlined
+struct VinyMapBackends : MapBackends<ValueCellStorage<VinyDSCell>> {
+  using Plain = VinySlam::MapType;
+  using Rescalable = RescalableCachingGridMap<Plain>;
+};
+
+using PackedVinyMapBackends = MapBackends<
+  QuantizedCellStorage<PackedTBMCellCodec<VinyDSCell>>>;
+
+// Calls handle(slam) with vinySLAM of the configured cells and map backend
+// (see init_packed_cells, init_map_backend)
+template <typename SlamHandler>
+void with_viny_slam(const PropertiesProvider &props, SlamHandler &&handle) {
+  auto handle_map_type = [&props, &handle](auto map_tag) {
+    using MapT = typename decltype(map_tag)::type;
+    handle(init_viny_slam<SingleStateHypothesisLaserScanGridWorld<MapT>>(
+      props));
+  };
+  if (init_packed_cells(props)) {
+    with_map_backend<PackedVinyMapBackends>(props, MapBackend::Tiled,
+                                            handle_map_type);
+  } else {
+    with_map_backend<VinyMapBackends>(props, MapBackend::Plain,
+                                      handle_map_type);
+  }
 }
 
 #endif
@@ -3,39 +3,60 @@
 
 #include "../../core/maps/grid_cell.h"
 #include "../../core/maps/transferable_belief_model.h"
+#include "../../core/maps/quantized_cell_storage.h"
 #include "TBM_prob_conversion.h"
 #include <ostream>
+#include <typeinfo>
 
 class VinyDSCell : public GridCell {
 public:
   VinyDSCell(): GridCell{Occupancy{0.5, 1}} {}
+  explicit VinyDSCell(const TBM &belief)
+    : GridCell{TBM_to_O(belief)}, _belief{belief} {}
 
   std::unique_ptr<GridCell> clone() const override {
     return std::make_unique<VinyDSCell>(*this);
   }
 
+  std::size_t memory_size() const override { return sizeof(*this); }
+
   void operator+=(const AreaOccupancyObservation &aoo) override {
     if (!aoo.occupancy.is_valid()) { return; }
 
-    _belief = conjunctive(_belief, AOO_to_TBM(aoo));
-    _belief.normalize_conflict();
+    // PERFORMANCE: the observation belief is not built,
+    //              its masses are combined directly.
+    auto masses = AOO_to_masses(aoo);
+    _belief = conjunctive_normalized(_belief, masses.empty, masses.occupied);
     _occupancy = TBM_to_O(_belief);
   }
 
   double discrepancy(const AreaOccupancyObservation &aoo) const override {
-    auto that_belief = AOO_to_TBM(aoo);
-    auto total_unknown = that_belief.unknown() + _belief.unknown();
-    auto d_occ = std::abs(that_belief.occupied() - _belief.occupied());
-    auto combined_belief = that_belief;
-    combined_belief = conjunctive(combined_belief, _belief);
-    /* return combined_belief.conflict() + d_occ + total_unknown; */
+    return discrepancy(AOO_to_TBM(aoo));
+  }
 
-    // original "combined.conflict() + d_occ + total_unknown" was replaced
-    // with the following rule to put the discrepancy in [0; 1].
-    auto unknown = total_unknown / 2.0;
-    auto known = 1 - unknown;
-    auto known_discrepancy = known * (combined_belief.conflict() + d_occ) / 2.0;
-    return unknown / 2 + known_discrepancy;
+  // NB: beliefs of maps are combined as independent evidences,
+  //     the unknown belief (of an unexplored area) changes nothing.
+  void merge(const GridCell &that) override {
+    if (typeid(that) != typeid(VinyDSCell)) {
+      GridCell::merge(that);
+      return;
+    }
+    _belief = conjunctive(_belief,
+                          static_cast<const VinyDSCell &>(that)._belief);
+    _belief.normalize_conflict();
+    _occupancy = TBM_to_O(_belief);
+  }
+
+  // Discrepancies of n cells with the same observation
+  // PERFORMANCE: the observation belief is computed once for all cells
+  //              (e.g. for a row of a map with cells stored by value).
+  static void discrepancies(const VinyDSCell *cells, std::size_t n,
+                            const AreaOccupancyObservation &aoo,
+                            double *discrepancies) {
+    auto that_belief = AOO_to_TBM(aoo);
+    for (std::size_t i = 0; i < n; ++i) {
+      discrepancies[i] = cells[i].discrepancy(that_belief);
+    }
   }
 
   std::vector<char> serialize() const override {
@@ -55,8 +76,44 @@ public:
   }
 
   const TBM& belief() const { return _belief; }
+private:
+  double discrepancy(const TBM &that_belief) const {
+    auto total_unknown = that_belief.unknown() + _belief.unknown();
+    auto d_occ = std::abs(that_belief.occupied() - _belief.occupied());
+    auto conflict = conjunctive_conflict(that_belief, _belief);
+    /* return combined_belief.conflict() + d_occ + total_unknown; */
+
+    // original "combined.conflict() + d_occ + total_unknown" was replaced
+    // with the following rule to put the discrepancy in [0; 1].
+    auto unknown = total_unknown / 2.0;
+    auto known = 1 - unknown;
+    auto known_discrepancy = known * (conflict + d_occ) / 2.0;
+    return unknown / 2 + known_discrepancy;
+  }
 private:
   TBM _belief;
 };
 
+// Keeps belief masses in fixed point (4 * sizeof(UInt) bytes per cell)
+template <typename UInt = uint16_t>
+struct QuantizedVinyDSCellCodec {
+  using Cell = VinyDSCell;
+  struct Packed {
+    UInt unknown, empty, occupied, conflict;
+  };
+
+  static Packed encode(const Cell &c) {
+    using FP = UnitFixedPoint<UInt>;
+    const auto &b = c.belief();
+    return {FP::encode(b.unknown()), FP::encode(b.empty()),
+            FP::encode(b.occupied()), FP::encode(b.conflict())};
+  }
+
+  static Cell decode(const Packed &p) {
+    using FP = UnitFixedPoint<UInt>;
+    return Cell{TBM{FP::decode(p.unknown), FP::decode(p.empty),
+                    FP::decode(p.occupied), FP::decode(p.conflict)}};
+  }
+};
+
 #endif
@@ -0,0 +1,75 @@
+#ifndef SLAM_CTOR_SLAMS_VINY_SLAM_NODE_H
+#define SLAM_CTOR_SLAMS_VINY_SLAM_NODE_H
+
+#include <memory>
+
+#include <ros/ros.h>
+#include <sensor_msgs/LaserScan.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include "../../ros/topic_with_transform.h"
+#include "../../ros/laser_scan_observer.h"
+#include "../../ros/init_utils.h"
+
+#include "init_viny_slam.h"
+
+template <typename SlamT>
+SlamNodePins start_viny_slam_node(std::shared_ptr<SlamT> slam,
+                                  ros::NodeHandle nh,
+                                  const PropertiesProvider &props) {
+  using ObservT = sensor_msgs::LaserScan;
+  using VinySlamMap = typename SlamT::MapType;
+
+  // connect the slam to a ros-topic based data provider
+  double ros_map_publishing_rate, ros_tf_buffer_size;
+  int ros_filter_queue, ros_subscr_queue;
+  init_constants_for_ros(props, ros_tf_buffer_size, ros_map_publishing_rate,
+                         ros_filter_queue, ros_subscr_queue);
+  auto scan_provider = std::make_unique<TopicWithTransform<ObservT>>(
+    nh, laser_scan_2D_ros_topic_name(props), tf_odom_frame_id(props),
+    ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue,
+    get_scan_load_shedding_params(props), get_scan_stats_log_period(props)
+  );
+  auto occup_grid_pub_pin = create_occupancy_grid_publisher<VinySlamMap>(
+    slam.get(), nh, ros_map_publishing_rate, props);
+
+  auto pose_pub_pin = create_pose_correction_tf_publisher<ObservT, VinySlamMap>(
+    slam.get(), scan_provider.get(), props);
+  auto rp_pub_pin = create_robot_pose_tf_publisher<VinySlamMap>(slam.get(),
+                                                                props);
+
+  auto scan_obs = std::make_shared<LaserScanObserver>(
+    slam, get_skip_exceeding_lsr(props), get_use_trig_cache(props),
+    get_scan_downsampler(props), slam->stage_profiler());
+  init_stage_profile_diagnostics(slam->stage_profiler(), nh, props);
+  // NB: pose_pub_pin must be subscribed first
+  auto scan_inputs_pin = subscribe_laser_scan_observer(
+    nh, scan_provider.get(), scan_obs, props,
+    ros_tf_buffer_size, ros_filter_queue, ros_subscr_queue);
+
+  auto pins = SlamNodePins{};
+  // NB: pins are released in reverse order, so the session is saved
+  //     once scans are not handled
+  pins.keep(make_session_saver(slam, props));
+  pins.keep(slam);
+  pins.keep(occup_grid_pub_pin);
+  pins.keep(pose_pub_pin);
+  pins.keep(rp_pub_pin);
+  pins.keep(scan_obs);
+  pins.keep(std::move(scan_provider));
+  pins.keep(std::move(scan_inputs_pin));
+  return pins;
+}
+
+// Connects vinySLAM to ros-topic based data providers and publishers
+// (both for a node and for a nodelet)
+inline SlamNodePins start_viny_slam_node(ros::NodeHandle nh,
+                                         const PropertiesProvider &props) {
+  auto pins = SlamNodePins{};
+  with_viny_slam(props, [&](auto slam) {
+    pins = start_viny_slam_node(slam, nh, props);
+  });
+  return pins;
+}
+
+#endif
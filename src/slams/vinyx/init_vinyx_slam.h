@@ -5,6 +5,7 @@
 
 #include "../../utils/init_scan_matching.h"
 #include "../../utils/init_occupancy_mapping.h"
+#include "../../utils/init_stage_profiling.h"
 
 #include "../../core/maps/plain_grid_map.h"
 #include "../../core/states/single_state_hypothesis_laser_scan_grid_world.h"
@@ -12,15 +13,25 @@
 #include "vinyx_world.h"
 
 auto init_vinyx_slam(const PropertiesProvider &props) {
-  auto slam_props = SingleStateHypothesisLSGWProperties{};
+  auto slam_props = VinyXWorldProperties{};
   // FIXME: move to params, init_viny_slam.h code duplication
   slam_props.localized_scan_quality = 0.9;
   slam_props.raw_scan_quality = 0.6;
   slam_props.cell_prototype = std::make_shared<VinyXDSCell>();
 
-  slam_props.gsm = init_scan_matcher(props);
+  slam_props.gsm = init_scan_matcher<VinyXWorld::MapType>(props);
   slam_props.gmsa = init_scan_adder(props);
   slam_props.map_props = init_grid_map_params(props);
+  slam_props.stage_profiler = init_stage_profiler(props);
+  // hypotheses are matched and mapped in parallel, so each has own ones
+  auto hypotheses_nm = props.get_uint("slam/vinyx/max_hypotheses", 4);
+  for (unsigned i = 1; i < hypotheses_nm; ++i) {
+    slam_props.extra_gsms.push_back(
+      init_scan_matcher<VinyXWorld::MapType>(props));
+    slam_props.extra_gmsas.push_back(init_scan_adder(props));
+  }
+  slam_props.min_hypothesis_mass_ratio =
+    props.get_dbl("slam/vinyx/min_hypothesis_mass_ratio", 0.05);
   return std::make_shared<VinyXWorld>(slam_props);
 }
 
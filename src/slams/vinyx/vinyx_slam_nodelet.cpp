@@ -0,0 +1,18 @@
+#include <pluginlib/class_list_macros.h>
+
+#include "../../ros/slam_nodelet.h"
+#include "vinyx_slam_node.h"
+
+namespace slam_constructor {
+
+class VinySlamXNodelet : public SlamNodelet {
+protected:
+  SlamNodePins start_node(ros::NodeHandle nh,
+                          const PropertiesProvider &props) override {
+    return start_vinyx_slam_node(nh, props);
+  }
+};
+
+} // namespace slam_constructor
+
+PLUGINLIB_EXPORT_CLASS(slam_constructor::VinySlamXNodelet, nodelet::Nodelet)
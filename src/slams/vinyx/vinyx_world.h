@@ -5,12 +5,18 @@
  * vinySLAM+ world.
  * FIXME: add a brief description
  * Each hypothesis is tracked by single-hypothesis vinySLAM.
+ * A hypothesis is split at each distinct peak of an ambiguous scan
+ * and is pruned once its mass (a product of probabilities
+ * of its matched scans) collapses relative to the best one.
  *
  * author: hatless.fox
  */
 
+#include <cmath>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include "../../core/thread_pool.h"
 #include "../../core/states/single_state_hypothesis_laser_scan_grid_world.h"
 
 #include "../viny/viny_grid_cell.h"
@@ -25,94 +31,258 @@ public:
     return std::make_unique<VinyXDSCell>(*this);
   }
 
-  double discrepancy(const AreaOccupancyObservation &aoo) const override {
-    // TODO: consider normalized discrepancy usage in plain vinySLAM
-    // FIXME:
-    return 0;
-  }
+  std::size_t memory_size() const override { return sizeof(*this); }
+
+  // NB: the discrepancy of VinyDSCell is normalized to [0, 1], so scan
+  //     probabilities of peaks are comparable.
 };
 
 // FIXME: rm from the global namespace
-using VinyXMapT = RescalableCachingGridMap<UnboundedLazyTiledGridMap>;
+using VinyXMapT =
+  RescalableCachingGridMap<UnboundedValueLazyTiledGridMap<VinyXDSCell>>;
+
+struct VinyXWorldProperties : SingleStateHypothesisLSGWProperties {
+  // Matchers and adders of hypotheses split from the initial one
+  // (gsm and gmsa), i.e. their number limits the number of hypotheses;
+  // the ones of a pruned hypothesis are reused by a new one.
+  std::vector<std::shared_ptr<GridScanMatcher>> extra_gsms;
+  std::vector<std::shared_ptr<GridMapScanAdder>> extra_gmsas;
+  // a hypothesis is pruned once its mass is below the ratio of the max one
+  double min_hypothesis_mass_ratio = 0.05;
+};
 
 class VinyXWorld : public World<TransformedLaserScan,
                                 VinyXMapT> {
 public:
   using WorldT = SingleStateHypothesisLaserScanGridWorld<VinyXMapT>;
-  using Properties = SingleStateHypothesisLSGWProperties;
+  using Properties = VinyXWorldProperties;
+
+  struct Peak {
+    RobotPose pose;
+    double probability;
+  };
+public: // consts
+  // peaks search params
+  static constexpr std::size_t Max_Peaks_Nm = 4;
+  static constexpr double Peak_Prob_Ratio = 0.97, Min_Peak_Prob = 0.5;
+  static constexpr double Translation_Lookup_Range = 0.4,
+                          Rotation_Lookup_Range = 0.2,
+                          Rotation_Step = 0.05,
+                          Translation_Step = 0.4;
 public: // methods
   VinyXWorld(const Properties &props)
     : _props{props} {
-    _hypotheses.push_back(WorldT{props});
+    _hypotheses.push_back(Hypothesis{WorldT{props}, 1.0});
+    for (std::size_t i = 0; i < _props.extra_gsms.size() &&
+                            i < _props.extra_gmsas.size(); ++i) {
+      _free_gsms.push_back(_props.extra_gsms[i]);
+      _free_gmsas.push_back(_props.extra_gmsas[i]);
+    }
+    _peaks_engine.set_translation_lookup_range(Translation_Lookup_Range,
+                                               Translation_Lookup_Range);
+    _peaks_engine.set_rotation_lookup_range(Rotation_Lookup_Range,
+                                            Rotation_Step);
+    _peaks_engine.set_finest_prob_ratio(Peak_Prob_Ratio);
   }
 
   void handle_sensor_data(TransformedLaserScan &scan) override {
     update_robot_pose(scan.pose_delta);
     handle_observation(scan);
-    notify_with_pose(pose());
-    notify_with_map(map());
+    {
+      StageTimer timer{stage_profiler(), SlamStage::ObserversNotification};
+      // NB: the const map is notified, i.e. a mapping is not waited for
+      const auto &state = *this;
+      notify_with_pose(state.pose());
+      notify_with_map(state.map());
+    }
+    if (auto profiler = stage_profiler()) {
+      profiler->finish_cycle([this]() { return maps_memory_usage(); });
+    }
+  }
+
+  // NB: hypotheses are measured separately
+  std::shared_ptr<StageProfiler> stage_profiler() const {
+    return _props.stage_profiler;
+  }
+
+  // Totals of hypotheses' maps
+  // NB: tiles shared by hypotheses are counted by each of them
+  GridMapMemoryUsage maps_memory_usage() const {
+    auto usage = GridMapMemoryUsage{};
+    for (auto &h : _hypotheses) { usage += h.world.maps_memory_usage(); }
+    return usage;
   }
 
   void update_robot_pose(const RobotPoseDelta& delta) override {
     for (auto &h : _hypotheses) {
-      h.update_robot_pose(delta);
+      h.world.update_robot_pose(delta);
     }
   }
 
+  // The hypothesis of the max mass
   const WorldT& world() const override {
-    // TODO: return a max peak?
-    return _hypotheses[0];
+    return _hypotheses[_best_hypothesis_id].world;
   }
 
   const RobotPose& pose() const override { return world().pose(); }
   const VinyXMapT& map() const override { return world().map(); }
+  VinyXMapT& map() override {
+    return _hypotheses[_best_hypothesis_id].world.map();
+  }
+
+  std::size_t hypotheses_nm() const { return _hypotheses.size(); }
+
+  // Masses of hypotheses normalized by the max one
+  std::vector<double> hypotheses_masses() const {
+    auto masses = std::vector<double>{};
+    for (auto &h : _hypotheses) { masses.push_back(h.mass); }
+    return masses;
+  }
+
+  // Splits the best hypothesis, i.e. the new one starts at the pose with
+  // the same map (e.g. on an ambiguous scan, see peaks);
+  // returns false if there are no matchers for more hypotheses.
+  // PERFORMANCE: hypotheses share map tiles until they are modified.
+  bool split_hypothesis(const RobotPose &pose, double mass) {
+    if (_free_gsms.empty()) { return false; }
+    auto &best = _hypotheses[_best_hypothesis_id].world;
+    // NB: a world is not copied while a scan is inserted
+    best.wait_for_mapping();
+    auto split = Hypothesis{WorldT{best}, mass};
+    split.world.update_robot_pose(pose - best.pose());
+    split.world.set_scan_matcher(_free_gsms.back());
+    split.world.set_scan_adder(_free_gmsas.back());
+    _free_gsms.pop_back();
+    _free_gmsas.pop_back();
+    _hypotheses.push_back(std::move(split));
+    return true;
+  }
 
   void handle_observation(TransformedLaserScan &obs) override {
-    //detect_peaks(obs);
-    for (auto &h : _hypotheses) {
-      // FIXME: use peaks info in order to just update world state
-      h.handle_observation(obs);
+    // PERFORMANCE: hypotheses share the pose-independent part of filtering
+    {
+      StageTimer timer{_props.stage_profiler, SlamStage::ScanFiltering};
+      _props.gsm->prefilter_scan(obs.scan);
     }
+    detect_peaks(obs);
+    split_by_peaks();
+    track_hypotheses(obs);
+    prune_hypotheses();
   }
 
-private:
+  // Distinct poses that explain the latest scan almost as well as the best
+  // one (i.e. the scan is ambiguous if there are several ones).
+  const std::vector<Peak>& peaks() const { return _peaks; }
 
+private: // types
+  struct Hypothesis {
+    WorldT world;
+    double mass;
+  };
+
+private: // methods
+
+  // PERFORMANCE: the engine is reused by scans and peaks are enumerated
+  //              by a single search (see M3RSMEngine::next_peaks).
   void detect_peaks(const TransformedLaserScan &raw_scan) {
-    //std::cout << "=== Detect Peaks ===" << std::endl;
-    M3RSMEngine engine;
-    engine.set_translation_lookup_range(0.4, 0.4);
-    engine.set_rotation_lookup_range(0.2, 0.05);
+    _peaks_engine.reset_engine_state();
     SafeRescalableMap rescalable_map{map()};
     // FIXME: use custom SPE, not necessary GridWorldOne
     auto spe = _props.gsm->scan_probability_estimator();
-    engine.add_scan_matching_request(spe, pose(),
-                                     raw_scan.scan, rescalable_map, true);
-    double max_prob = -1;
-    unsigned peaks_nm = 0;
-    while (1) {
-      auto best_match = engine.next_best_match(0.4);
-      if (!best_match.is_valid()) {
-        break;
+    auto search_pose = pose();
+    _peaks_engine.add_scan_matching_request(spe, search_pose, raw_scan.scan,
+                                            rescalable_map, true);
+    _peaks_engine.next_peaks(Max_Peaks_Nm, Translation_Step,
+                             Translation_Step, Rotation_Step, _matches);
+
+    _peaks.clear();
+    for (auto &match : _matches) {
+      if (match.prob_upper_bound < Min_Peak_Prob) { break; }
+      auto drift = match.translation_drift.center();
+      _peaks.push_back(Peak{search_pose + RobotPoseDelta(drift.x, drift.y,
+                                                         match.rotation),
+                            match.prob_upper_bound});
+    }
+  }
+
+  // A hypothesis is split to each peak of the best one that is not
+  // tracked yet; its mass is proportional to the peak probability.
+  void split_by_peaks() {
+    if (_peaks.size() < 2) { return; }
+    auto best_mass = _hypotheses[_best_hypothesis_id].mass;
+    for (std::size_t i = 1; i < _peaks.size(); ++i) {
+      if (is_tracked(_peaks[i].pose)) { continue; }
+      auto mass = best_mass * _peaks[i].probability / _peaks[0].probability;
+      if (!split_hypothesis(_peaks[i].pose, mass)) { break; }
+    }
+  }
+
+  bool is_tracked(const RobotPose &pose) const {
+    for (auto &h : _hypotheses) {
+      auto delta = pose - h.world.pose();
+      if (delta.sq_dist() < Translation_Step * Translation_Step &&
+          std::fabs(std::remainder(delta.theta, 2 * M_PI)) < Rotation_Step) {
+        return true;
       }
-      if (best_match.is_finest()) {
-        double p = best_match.prob_upper_bound;
-        if (max_prob == -1) { max_prob = p; }
-        //std::cout << "next prob: " << p << std::endl;
-        if (p < max_prob * 0.97 || p < 0.5) {
-          break;
-        }
-        peaks_nm++;
+    }
+    return false;
+  }
+
+  // PERFORMANCE: hypotheses are matched and mapped in parallel;
+  //              each has own matcher and adder, maps share tiles
+  //              copy-on-write.
+  void track_hypotheses(TransformedLaserScan &obs) {
+    // NB: a hypothesis sets the quality of its scan
+    auto scans = std::vector<TransformedLaserScan>(_hypotheses.size() - 1,
+                                                   obs);
+    ThreadPool::shared()->parallel_for(
+      _hypotheses.size(), [this, &obs, &scans](std::size_t i) {
+        _hypotheses[i].world.handle_observation(i ? scans[i - 1] : obs);
+      });
+
+    for (auto &h : _hypotheses) {
+      // NB: a scan skipped by the keyframe gating doesn't change masses
+      if (h.world.skipped_scans_nm() != 0) { continue; }
+      h.mass *= h.world.last_scan_probability();
+    }
+  }
+
+  // Masses are normalized by the max one, so the best hypothesis
+  // has the unit mass and is never pruned.
+  void prune_hypotheses() {
+    auto max_mass = 0.0;
+    for (auto &h : _hypotheses) { max_mass = std::max(max_mass, h.mass); }
+    if (max_mass <= 0) { return; }
+
+    auto kept_nm = std::size_t{0};
+    _best_hypothesis_id = 0;
+    for (std::size_t i = 0; i < _hypotheses.size(); ++i) {
+      auto &h = _hypotheses[i];
+      h.mass /= max_mass;
+      if (h.mass < _props.min_hypothesis_mass_ratio) {
+        h.world.wait_for_mapping();
+        _free_gsms.push_back(h.world.scan_matcher());
+        _free_gmsas.push_back(h.world.scan_adder());
         continue;
       }
-      auto drift_center = best_match.translation_drift.center();
-      engine.add_match(Match{M3RSMEngine::Rect{drift_center}, best_match});
+      if (h.mass == 1.0) { _best_hypothesis_id = kept_nm; }
+      if (kept_nm != i) { _hypotheses[kept_nm] = std::move(h); }
+      ++kept_nm;
     }
-    if (1 < peaks_nm) { std::cout << "PEAKS NM: " << peaks_nm << std::endl; }
+    _hypotheses.erase(_hypotheses.begin() + kept_nm, _hypotheses.end());
   }
 
 private: // fields
   Properties _props;
-  std::vector<WorldT> _hypotheses;
+  std::vector<Hypothesis> _hypotheses;
+  std::size_t _best_hypothesis_id = 0;
+  std::vector<std::shared_ptr<GridScanMatcher>> _free_gsms;
+  std::vector<std::shared_ptr<GridMapScanAdder>> _free_gmsas;
+  M3RSMEngine _peaks_engine;
+  // NB: matches refer to the map rescaled by the search,
+  //     so only their results are kept as peaks
+  std::vector<Match> _matches;
+  std::vector<Peak> _peaks;
 };
 
 #endif
@@ -0,0 +1,63 @@
+#ifndef SLAM_CTOR_UTILS_ALLOCATION_TRACKING_H
+#define SLAM_CTOR_UTILS_ALLOCATION_TRACKING_H
+
+/* Replaces the global operator new/delete to count heap allocations of
+ * each thread (see AllocationCount) if the tree is built with
+ * SLAM_CTOR_TRACK_ALLOCATIONS; does nothing otherwise.
+ * NB: the header must be included by a single translation unit of
+ *     an executable (e.g. the one with main). */
+
+#include "../core/allocation_counter.h"
+
+#ifdef SLAM_CTOR_TRACK_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+inline void *tracked_malloc(std::size_t size) noexcept {
+  auto &count = thread_allocation_counter();
+  ++count.allocs_nm;
+  count.bytes += size;
+  return std::malloc(size ? size : 1);
+}
+
+void *operator new(std::size_t size) {
+  if (auto ptr = tracked_malloc(size)) { return ptr; }
+  throw std::bad_alloc{};
+}
+
+void *operator new[](std::size_t size) {
+  if (auto ptr = tracked_malloc(size)) { return ptr; }
+  throw std::bad_alloc{};
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return tracked_malloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return tracked_malloc(size);
+}
+
+// NB: the deallocation is not inlined, otherwise GCC warns of a mismatch
+//     of new and free at call sites (-Wmismatched-new-delete).
+__attribute__((noinline)) void tracked_free(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr) noexcept { tracked_free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { tracked_free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { tracked_free(ptr); }
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  tracked_free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  tracked_free(ptr);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SLAM_CTOR_UTILS_ASYNC_FILE_WRITER_H
+#define SLAM_CTOR_UTILS_ASYNC_FILE_WRITER_H
+
+#include <string>
+#include <memory>
+#include <fstream>
+
+#include "../core/bounded_task_queue.h"
+#include "../core/shared_object_pool.h"
+
+/* Writes data to a file from a background thread, e.g. logs that are
+ * produced on the slam path. Data are appended to an in-memory chunk
+ * that is passed to the writing thread once it is full.
+ * PERFORMANCE: a write is a copy to memory, so slow storage (e.g. flash)
+ *              doesn't add jitter to the producer. At most chunks_nm
+ *              chunks wait for the storage, a producer that outpaces
+ *              the storage is blocked (i.e. memory is bounded);
+ *              chunks are reused once written. */
+class AsyncFileWriter {
+private: // types
+  using Chunk = std::string;
+public:
+  AsyncFileWriter(const std::string &fname,
+                  std::size_t chunk_size = 1 << 16,
+                  std::size_t chunks_nm = 4)
+    : _fstream{fname, std::ios::out | std::ios::binary}
+    , _is_valid{_fstream.is_open()}
+    , _chunk_size{chunk_size ? chunk_size : 1}
+    , _chunks{chunks_nm + 1}
+    , _write_queue{chunks_nm} {
+    _chunk = acquire_chunk();
+  }
+
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  ~AsyncFileWriter() { flush(); }
+
+  bool is_valid() const { return _is_valid; }
+
+  void write(const char *data, std::size_t size) {
+    if (_chunk_size < _chunk->size() + size) { submit_chunk(); }
+    _chunk->append(data, size);
+  }
+
+  // Blocks until all written data are passed to the file
+  void flush() {
+    submit_chunk();
+    _write_queue.push([this]() { _fstream.flush(); });
+    _write_queue.wait_for_idle();
+  }
+
+private: // methods
+
+  std::shared_ptr<Chunk> acquire_chunk() {
+    auto chunk = _chunks.released();
+    if (!chunk) {
+      chunk = std::make_shared<Chunk>();
+      chunk->reserve(_chunk_size);
+      _chunks.keep(chunk);
+    }
+    chunk->clear();
+    return chunk;
+  }
+
+  void submit_chunk() {
+    if (_chunk->empty()) { return; }
+    auto chunk = std::move(_chunk);
+    // NB: the task is the only writer of the file
+    _write_queue.push([this, chunk]() {
+      _fstream.write(chunk->data(), chunk->size());
+    });
+    _chunk = acquire_chunk();
+  }
+
+private: // fields
+  // NB: the file outlives the queue, i.e. its pending writes
+  std::ofstream _fstream;
+  bool _is_valid;
+  std::size_t _chunk_size;
+  SharedObjectPool<Chunk> _chunks;
+  std::shared_ptr<Chunk> _chunk;
+  BoundedTaskQueue _write_queue;
+};
+
+#endif
@@ -12,11 +12,11 @@
 class GridMapPatcher {
 private:
 
+  // A run of areas of a raster row that starts at the coord (along x)
   struct GridMapPatch {
-    GridMapPatch(const DiscretePoint2D &c, const Occupancy &occ)
-      : coord{c}, occupancy{occ} {}
+    explicit GridMapPatch(const DiscretePoint2D &c) : coord{c} {}
     DiscretePoint2D coord;
-    Occupancy occupancy;
+    std::vector<AreaOccupancyObservation> observations;
   };
 
   using GMPatches = std::vector<GridMapPatch>;
@@ -39,7 +39,7 @@ public:
 private: // methods
 
   Occupancy char_to_occupancy(char ch) {
-    return Occupancy{ch == ' ' ? 0.0 : 1.0, 1.0};
+    return Occupancy(ch == ' ' ? 0.0 : 1.0, 1.0);
   }
 
   template<typename MapType>
@@ -59,6 +59,8 @@ private: // methods
     GMPatches patches;
     _curr_raster_w = _curr_raster_h = 0;
 
+    auto aoo = AreaOccupancyObservation{true, Occupancy{0, 0},
+                                        Point2D{0, 0}, 1 /* quality */};
     auto world_coord = DiscretePoint2D{0, 0};
     std::string raw_map_row;
     while (raster.good()) {
@@ -69,12 +71,12 @@ private: // methods
 
       for (int row_i = 0; row_i < h_scale; ++row_i) {
         world_coord.x = 0;
+        patches.emplace_back(world_coord);
+        auto &observations = patches.back().observations;
+        observations.reserve(raw_map_row.size() * w_scale);
         for (auto ch : raw_map_row) {
-          auto occupancy = char_to_occupancy(ch);
-          for (int col_i = 0; col_i < w_scale; ++col_i) {
-            patches.emplace_back(world_coord, occupancy);
-            world_coord.x += 1;
-          }
+          aoo.occupancy = char_to_occupancy(ch);
+          observations.insert(observations.end(), w_scale, aoo);
         }
         world_coord.y -= 1;
       } // for row_i
@@ -85,15 +87,25 @@ private: // methods
     return patches;
   }
 
+  // PERFORMANCE: the map is prepared for the raster once
+  //              and is updated by rows.
   template<typename MapType>
   void apply_patches(MapType &dst_map,
                      const DiscretePoint2D &offset, const GMPatches &patches) {
+    if (patches.empty()) { return; }
 
-    auto aoo = AreaOccupancyObservation{true, Occupancy{0, 0},
-                                        Point2D{0, 0}, 1 /* quality */};
-    for (auto &upd_req : patches) {
-      aoo.occupancy = upd_req.occupancy;
-      dst_map.update(upd_req.coord + offset, aoo);
+    auto max_row_w = std::size_t{0};
+    for (auto &patch : patches) {
+      max_row_w = std::max(max_row_w, patch.observations.size());
+    }
+    auto top_left = patches.front().coord + offset;
+    dst_map.reserve_area(
+      {top_left.x, patches.back().coord.y + offset.y},
+      {top_left.x + int(max_row_w) - 1, top_left.y});
+    for (auto &patch : patches) {
+      dst_map.update_row(patch.coord + offset,
+                         int(patch.observations.size()),
+                         patch.observations.data());
     }
   }
 
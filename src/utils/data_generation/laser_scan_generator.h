@@ -3,9 +3,11 @@
 
 #include <memory>
 #include <cmath>
+#include <vector>
 
 #include "../../core/math_utils.h"
 #include "../../core/maps/grid_map.h"
+#include "../../core/maps/grid_ray_caster.h"
 #include "../../core/states/sensor_data.h"
 #include "../../core/geometry_utils.h"
 
@@ -30,7 +32,10 @@ constexpr static auto to_lsp(double max_dist, double fow_deg, unsigned pts_nm) {
 
 class LaserScanGenerator {
 public:
-  LaserScanGenerator(LaserScannerParams ls_params = {}) : _lsp{ls_params} {}
+  // NB: beams of a scan are cast by threads_nm threads (see GridRayCaster)
+  LaserScanGenerator(LaserScannerParams ls_params = {},
+                     unsigned threads_nm = 1)
+    : _lsp{ls_params}, _ray_caster{threads_nm} {}
 
   LaserScan2D laser_scan_2D(const GridMap& map, const RobotPose& pose,
                             double occ_threshold = 1) {
@@ -44,43 +49,40 @@ public:
            "LS Gen: robot at cell boundary is not supported");
 
     auto hhsector = _lsp.h_hsector; // horiz. half-sector
+    _beam_angles.clear();
+    _world_beam_angles.clear();
     for (double a = -hhsector; a <= hhsector; a += _lsp.h_angle_inc) {
       if (2*M_PI <= hhsector + a) { break; }
-      auto beam_dir = Point2D{_lsp.max_dist * std::cos(a + pose.theta),
-                              _lsp.max_dist * std::sin(a + pose.theta)};
-      auto area_ids = map.world_to_cells({robot_point, robot_point + beam_dir});
-      for (auto& area_id : area_ids) {
-        if (map[area_id] < occ_threshold) { continue; }
-        // NB: Beam-goes-through-the-cell-center assumption is not safe,
-        //     so use more sophisticated analysis based on intersections.
-        auto ray = Ray{robot_point.x, beam_dir.x, robot_point.y, beam_dir.y};
-        auto inters = map.world_cell_bounds(area_id).find_intersections(ray);
-        if (inters.size() == 1) { // Assume beam touches the cell.
-          // NB: Ignores "pierce" case for simplicity,
-          //     increase max_dist in this case.
-          continue;
-        }
+      _beam_angles.push_back(a);
+      _world_beam_angles.push_back(a + pose.theta);
+    }
 
-        assert(2 == inters.size() && "BUG! LS Gen: obstacle is not pierced");
-        auto obst_pnt = Point2D{(inters[0].x + inters[1].x) / 2,
-                                (inters[0].y + inters[1].y) / 2};
-        auto range = std::sqrt(robot_point.dist_sq(obst_pnt));
-        auto scan_point = ScanPoint2D::make_polar(range, a, true);
-        scan.points().push_back(scan_point);
+    // NB: Beam-goes-through-the-cell-center assumption is not safe,
+    //     so a beam hits the middle of its chord of an obstacle cell.
+    //     A beam that only touches a cell ignores it.
+    _ray_caster.cast(map, robot_point, _world_beam_angles, _lsp.max_dist,
+                     GridRayCaster::occupancy_threshold(map, occ_threshold),
+                     _hits);
+    for (std::size_t i = 0; i < _hits.size(); ++i) {
+      const auto &hit = _hits[i];
+      if (!hit.is_hit) { continue; }
+      auto scan_point = ScanPoint2D::make_polar(hit.range, _beam_angles[i],
+                                                true);
+      scan.points().push_back(scan_point);
 
-        auto added_wp = scan_point.move_origin(pose.x, pose.y, pose.theta);
-        auto sp_area_id = map.world_to_cell(added_wp);
-        assert(area_id == sp_area_id &&
-               "[BUG] Estimated scan point doesn't lie is expected area");
-        //std::cout << "==> Add point " << range << " " << a << std::endl;
-        break;
-      }
+      auto added_wp = scan_point.move_origin(pose.x, pose.y, pose.theta);
+      assert(hit.area_id == map.world_to_cell(added_wp) &&
+             "[BUG] Estimated scan point doesn't lie is expected area");
     }
     return scan;
   }
 
 private:
   LaserScannerParams _lsp;
+  GridRayCaster _ray_caster;
+  // buffers reused by scans
+  std::vector<double> _beam_angles, _world_beam_angles;
+  std::vector<RayCastHit> _hits;
 };
 
 #endif
@@ -0,0 +1,178 @@
+/* Compares grid map implementations (plain, unbounded plain, lazy tiled,
+ * rescalable caching; cells stored by pointers and by value) with cells
+ * of the provided slams on the map operations:
+ *   - fill: random updates over the world that start with a 1x1 map,
+ *     i.e. include map growth (ensure_inside) of unbounded maps;
+ *   - sequential and random reads (operator[]);
+ *   - random updates of cells;
+ *   - reads of rasterized rectangles (GridRasterizedRectangle);
+ *   - state saving and loading (save_state/load_state) throughput.
+ * Reads and updates are reported in millions of operations per second,
+ * save/load in MB per second ("-" if a map doesn't support them).
+ * Usage: grid_map_benchmark [meters_per_cell [world_side_in_meters]]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../core/maps/grid_cell.h"
+#include "../core/maps/plain_grid_map.h"
+#include "../core/maps/lazy_tiled_grid_map.h"
+#include "../core/maps/rescalable_caching_grid_map.h"
+#include "../core/maps/grid_rasterization.h"
+#include "../slams/tiny/tiny_grid_cell.h"
+#include "../slams/viny/viny_grid_cell.h"
+#include "../slams/gmapping/gmapping_grid_cell.h"
+
+struct BenchmarkParams {
+  double meters_per_cell = 0.05;
+  double world_side = 100;      // meters
+  unsigned fill_updates_nm = 4000000;
+  unsigned random_ops_nm = 4000000;
+  unsigned rectangles_nm = 200000;
+  double rectangle_side = 0.5;  // meters
+};
+
+template <typename Action>
+double measure_ms(Action action) {
+  auto start = std::chrono::high_resolution_clock::now();
+  action();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// millions of operations per second
+double mops(double ops_nm, double ms) { return ops_nm / ms / 1000; }
+
+template <typename MapT>
+void run_benchmark(const std::string &name, std::shared_ptr<GridCell> cell,
+                   bool is_bounded, const BenchmarkParams &bp) {
+  int side_cells = bp.world_side / bp.meters_per_cell;
+  auto initial_side = is_bounded ? side_cells : 1;
+  auto map = MapT{cell, {initial_side, initial_side, bp.meters_per_cell}};
+  using Coord = typename MapT::Coord;
+
+  auto rnd_engine = std::mt19937{42};
+  auto half_side = bp.world_side / 2 - bp.rectangle_side;
+  auto coord_rv = std::uniform_real_distribution<double>{-half_side,
+                                                         half_side};
+  auto prob_rv = std::uniform_real_distribution<double>{0.01, 0.99};
+  auto random_area_id = [&]() {
+    return map.world_to_cell(coord_rv(rnd_engine), coord_rv(rnd_engine));
+  };
+  auto random_aoo = [&]() {
+    auto p = prob_rv(rnd_engine);
+    return AreaOccupancyObservation{0.5 < p, {p, 1},
+                                    {coord_rv(rnd_engine), 0}, 1};
+  };
+
+  auto fill_ms = measure_ms([&]() {
+    for (unsigned i = 0; i < bp.fill_updates_nm; ++i) {
+      map.update(random_area_id(), random_aoo());
+    }
+  });
+
+  double checksum = 0;
+  auto origin = map.origin();
+  int w = map.width(), h = map.height();
+  auto seq_read_ms = measure_ms([&]() {
+    auto area_id = Coord{};
+    for (area_id.y = -origin.y; area_id.y < h - origin.y; ++area_id.y) {
+      for (area_id.x = -origin.x; area_id.x < w - origin.x; ++area_id.x) {
+        checksum += map[area_id];
+      }
+    }
+  });
+
+  auto area_ids = std::vector<Coord>{};
+  area_ids.reserve(bp.random_ops_nm);
+  for (unsigned i = 0; i < bp.random_ops_nm; ++i) {
+    area_ids.push_back(random_area_id());
+  }
+  auto rnd_read_ms = measure_ms([&]() {
+    for (auto &area_id : area_ids) { checksum += map[area_id]; }
+  });
+  auto aoo = random_aoo();
+  auto update_ms = measure_ms([&]() {
+    for (auto &area_id : area_ids) { map.update(area_id, aoo); }
+  });
+
+  auto hs = bp.rectangle_side / 2;
+  auto rect_cells_nm = std::size_t{0};
+  auto rect_ms = measure_ms([&]() {
+    for (unsigned i = 0; i < bp.rectangles_nm; ++i) {
+      auto x = coord_rv(rnd_engine), y = coord_rv(rnd_engine);
+      auto rect_ids = GridRasterizedRectangle{
+        map, LightWeightRectangle{y - hs, y + hs, x - hs, x + hs}};
+      while (rect_ids.has_next()) {
+        checksum += map[rect_ids.next()];
+        ++rect_cells_nm;
+      }
+    }
+  });
+
+  auto state = std::vector<char>{};
+  auto save_ms = measure_ms([&]() { state = map.save_state(); });
+  auto load_ms = measure_ms([&]() {
+    if (!state.empty() && !map.load_state(state)) {
+      std::cerr << "WARNING: " << name << " rejected its own state\n";
+    }
+  });
+  auto state_mb = state.size() / 1e6;
+
+  auto throughput = [](double mb, double ms) {
+    return mb == 0 ? std::string{"-"} : std::to_string(int(mb / ms * 1000));
+  };
+  std::cout << std::setw(34) << std::left << name
+            << std::fixed << std::setprecision(1)
+            << std::setw(8) << fill_ms
+            << std::setw(8) << mops(w * h, seq_read_ms)
+            << std::setw(8) << mops(area_ids.size(), rnd_read_ms)
+            << std::setw(8) << mops(area_ids.size(), update_ms)
+            << std::setw(8) << mops(rect_cells_nm, rect_ms)
+            << std::setw(8) << throughput(state_mb, save_ms)
+            << std::setw(8) << throughput(state_mb, load_ms)
+            << std::defaultfloat
+            << " (" << w << "x" << h << ", checksum " << checksum << ")"
+            << std::endl;
+}
+
+template <typename CellT>
+void run_cell_benchmarks(const std::string &cell_name,
+                         const BenchmarkParams &bp) {
+  auto cell = std::make_shared<CellT>();
+  run_benchmark<PlainGridMap>("plain/" + cell_name, cell, true, bp);
+  run_benchmark<UnboundedPlainGridMap>("unbounded-plain/" + cell_name,
+                                       cell, false, bp);
+  run_benchmark<UnboundedContiguousPlainGridMap<CellT>>(
+    "unbounded-contiguous/" + cell_name, cell, false, bp);
+  run_benchmark<UnboundedLazyTiledGridMap>("lazy-tiled/" + cell_name,
+                                           cell, false, bp);
+  run_benchmark<UnboundedValueLazyTiledGridMap<CellT>>(
+    "value-lazy-tiled/" + cell_name, cell, false, bp);
+  run_benchmark<RescalableCachingGridMap<UnboundedPlainGridMap>>(
+    "rescalable/" + cell_name, cell, false, bp);
+}
+
+int main(int argc, char **argv) {
+  auto bp = BenchmarkParams{};
+  if (1 < argc) { bp.meters_per_cell = std::stod(argv[1]); }
+  if (2 < argc) { bp.world_side = std::stod(argv[2]); }
+
+  std::cout << "== " << bp.meters_per_cell << " meters per cell, "
+            << bp.world_side << " meters world ==" << std::endl;
+  std::cout << std::setw(34) << std::left << "map/cell"
+            << std::setw(8) << "fill,ms" << std::setw(8) << "seq-rd"
+            << std::setw(8) << "rnd-rd" << std::setw(8) << "update"
+            << std::setw(8) << "rect" << std::setw(8) << "save"
+            << std::setw(8) << "load" << std::endl;
+  run_cell_benchmarks<BaseTinyCell>("tiny", bp);
+  run_cell_benchmarks<VinyDSCell>("viny", bp);
+  run_cell_benchmarks<GmappingBaseCell>("gmapping", bp);
+  return 0;
+}
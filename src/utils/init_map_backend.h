@@ -0,0 +1,92 @@
+#ifndef SLAM_CTOR_UTILS_INIT_MAP_BACKEND_H
+#define SLAM_CTOR_UTILS_INIT_MAP_BACKEND_H
+
+#include <string>
+#include <cstdlib>
+#include <iostream>
+
+#include "properties_providers.h"
+
+#include "../core/maps/plain_grid_map.h"
+#include "../core/maps/lazy_tiled_grid_map.h"
+#include "../core/maps/sparse_tiled_grid_map.h"
+#include "../core/maps/out_of_core_tiled_grid_map.h"
+#include "../core/maps/coarsening_tiled_grid_map.h"
+#include "../core/maps/rescalable_caching_grid_map.h"
+
+/* Map types a slam is instantiated with (see with_map_backend):
+ * - plain: a single contiguous grid; the fastest access;
+ * - tiled: copy-on-write tiles that are allocated on the first write,
+ *          so copies of a map (e.g. in the pipelined mapping) are cheap;
+ * - hashed: tiles in a hash table, i.e. memory follows the explored area
+ *           rather than its bounding box;
+ * - out_of_core: hashed tiles, cold ones are paged out to a file;
+ * - coarsening: hashed tiles, ones far from the working area are kept
+ *               coarse until the next write (see TileCoarseningParams);
+ * - rescalable: a plain map with cached coarser maps. */
+enum class MapBackend {
+  Plain, Tiled, Hashed, OutOfCore, Coarsening, Rescalable
+};
+
+// NB: an empty property selects the default backend of a slam
+MapBackend init_map_backend(const PropertiesProvider &props,
+                            MapBackend dflt) {
+  static const std::string Backend_Prop = "slam/map/backend";
+  auto type = props.get_str(Backend_Prop, "");
+  if (type.empty()) { return dflt; }
+  if (type == "plain") { return MapBackend::Plain; }
+  if (type == "tiled") { return MapBackend::Tiled; }
+  if (type == "hashed") { return MapBackend::Hashed; }
+  if (type == "out_of_core") { return MapBackend::OutOfCore; }
+  if (type == "coarsening") { return MapBackend::Coarsening; }
+  if (type == "rescalable") { return MapBackend::Rescalable; }
+  std::cerr << "Unknown map backend (" << Backend_Prop << ") "
+            << type << std::endl;
+  std::exit(-1);
+}
+
+// Map types of the backends for cells kept by the storage;
+// a slam may override a type (e.g. with a typed plain map).
+template <typename CellStorage>
+struct MapBackends {
+  using Plain = GenericUnboundedPlainGridMap<CellStorage>;
+  using Tiled = GenericUnboundedLazyTiledGridMap<CellStorage>;
+  using Hashed = GenericSparseTiledGridMap<CellStorage>;
+  using OutOfCore = GenericOutOfCoreTiledGridMap<CellStorage>;
+  using Coarsening = GenericCoarseningTiledGridMap<CellStorage>;
+  using Rescalable = RescalableCachingGridMap<Plain>;
+};
+
+template <typename MapT>
+struct MapTypeTag {
+  using type = MapT;
+};
+
+// Calls handle(MapTypeTag<MapT>{}) with the map type of the backend,
+// i.e. a handler is instantiated for each backend.
+template <typename Backends, typename MapTypeHandler>
+void with_map_backend(const PropertiesProvider &props, MapBackend dflt,
+                      MapTypeHandler &&handle) {
+  switch (init_map_backend(props, dflt)) {
+  case MapBackend::Plain:
+    handle(MapTypeTag<typename Backends::Plain>{});
+    break;
+  case MapBackend::Tiled:
+    handle(MapTypeTag<typename Backends::Tiled>{});
+    break;
+  case MapBackend::Hashed:
+    handle(MapTypeTag<typename Backends::Hashed>{});
+    break;
+  case MapBackend::OutOfCore:
+    handle(MapTypeTag<typename Backends::OutOfCore>{});
+    break;
+  case MapBackend::Coarsening:
+    handle(MapTypeTag<typename Backends::Coarsening>{});
+    break;
+  case MapBackend::Rescalable:
+    handle(MapTypeTag<typename Backends::Rescalable>{});
+    break;
+  }
+}
+
+#endif
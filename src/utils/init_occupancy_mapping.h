@@ -3,12 +3,18 @@
 
 #include <memory>
 #include <limits>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 
 #include "properties_providers.h"
 
 #include "../core/maps/grid_map.h"
 #include "../core/maps/grid_map_scan_adders.h"
 #include "../core/maps/area_occupancy_estimator.h"
+#include "../core/maps/tabulated_area_occupancy_estimator.h"
 #include "../core/maps/const_occupancy_estimator.h"
 
 auto init_grid_map_params(const PropertiesProvider &props) {
@@ -21,22 +27,94 @@ auto init_grid_map_params(const PropertiesProvider &props) {
                        scale};
 }
 
+bool init_pipelined_mapping(const PropertiesProvider &props) {
+  return props.get_bool("slam/mapping/pipelined", false);
+}
+
+std::size_t init_mapping_queue_size(const PropertiesProvider &props) {
+  return props.get_uint("slam/mapping/queue_size", 2);
+}
+
+// Sets up keyframe gating of single-hypothesis slams
+// (see SingleStateHypothesisLSGWProperties)
+template <typename SlamProps>
+void setup_keyframe_gating(const PropertiesProvider &props,
+                           SlamProps &slam_props) {
+  static const std::string Keyframes_NS = "slam/keyframes/";
+  slam_props.keyframe_translation =
+    props.get_dbl(Keyframes_NS + "translation", 0);
+  slam_props.keyframe_rotation = props.get_dbl(Keyframes_NS + "rotation", 0);
+  slam_props.keyframe_max_skipped =
+    props.get_uint(Keyframes_NS + "max_skipped", 0);
+}
+
+// Sets up handling of scan backlogs (see OverloadPolicy::CatchUp)
+// by single-hypothesis slams (see SingleStateHypothesisLSGWProperties)
+template <typename SlamProps>
+void setup_catch_up(const PropertiesProvider &props, SlamProps &slam_props) {
+  slam_props.catch_up_group_size =
+    props.get_uint("slam/catch_up/group_size", 4);
+}
+
+// A saved map state (see GridMap::save_state) to localize against;
+// the map is not updated if it is set.
+std::string init_localization_map_fname(const PropertiesProvider &props) {
+  return props.get_str("slam/localization/map", "");
+}
+
+bool init_localization_only(const PropertiesProvider &props) {
+  return !init_localization_map_fname(props).empty();
+}
+
+// Loads the map to localize against into the slam (see load_map)
+template <typename SlamT>
+void init_localization_map(const PropertiesProvider &props, SlamT &slam) {
+  auto fname = init_localization_map_fname(props);
+  if (fname.empty()) { return; }
+
+  auto file = std::ifstream{fname, std::ios::binary};
+  if (!file) {
+    std::cerr << "[ERROR] Unable to read a localization map from "
+              << fname << std::endl;
+    std::exit(-1);
+  }
+  auto state = std::vector<char>{std::istreambuf_iterator<char>{file},
+                                 std::istreambuf_iterator<char>{}};
+  // NB: maps w/o state support reject any state
+  if (!slam.load_map(state)) {
+    std::cerr << "[ERROR] The map state in " << fname << " is corrupt "
+              << "or is not supported by the map type" << std::endl;
+    std::exit(-1);
+  }
+}
+
+// Belief-based SLAMs keep cells packed (see PackedTBMCellCodec) if enabled
+bool init_packed_cells(const PropertiesProvider &props) {
+  return props.get_bool("slam/map/packed_cells", false);
+}
+
 std::shared_ptr<CellOccupancyEstimator> init_occ_estimator(
     const PropertiesProvider &props) {
 
   // TODO: replace with "slam/mapping" after the config refactoring
   static const auto MAPPING_NS = std::string{"slam/"};
   static const auto COE_NS = MAPPING_NS + "occupancy_estimator/";
-  auto base_occ = Occupancy{props.get_dbl(COE_NS + "base_occupied/prob", 0.95),
-                            props.get_dbl(COE_NS + "base_occupied/qual", 1.0)};
-  auto base_empty = Occupancy{props.get_dbl(COE_NS + "base_empty/prob", 0.01),
-                              props.get_dbl(COE_NS + "base_empty/qual", 1.0)};
+  auto base_occ = Occupancy(props.get_dbl(COE_NS + "base_occupied/prob", 0.95),
+                            props.get_dbl(COE_NS + "base_occupied/qual", 1.0));
+  auto base_empty = Occupancy(props.get_dbl(COE_NS + "base_empty/prob", 0.01),
+                              props.get_dbl(COE_NS + "base_empty/qual", 1.0));
 
   auto type = props.get_str(COE_NS + "type", "const");
   if (type == "const") {
     return std::make_shared<ConstOccupancyEstimator>(base_occ, base_empty);
   } else if (type == "area") {
     return std::make_shared<AreaOccupancyEstimator>(base_occ, base_empty);
+  } else if (type == "tabulated_area") {
+    auto resolution = props.get_uint(
+      COE_NS + "tabulated_area/resolution",
+      TabulatedAreaOccupancyEstimator::Default_Resolution);
+    return std::make_shared<TabulatedAreaOccupancyEstimator>(
+      base_occ, base_empty, resolution);
   } else {
     std::cerr << "Unknown estimator type: " << type << std::endl;
     std::exit(-1);
@@ -61,6 +139,20 @@ std::shared_ptr<ObservationMappingQualityEstimator> init_omqe(
   }
 }
 
+ScanInsertionMode init_scan_insertion_mode(const PropertiesProvider &props) {
+  auto mode = props.get_str("slam/mapping/insertion", "immediate");
+  if (mode == "immediate") {
+    return ScanInsertionMode::Immediate;
+  } else if (mode == "batched") {
+    return ScanInsertionMode::Batched;
+  } else if (mode == "batched_merged_free") {
+    return ScanInsertionMode::Batched_Merged_Free;
+  } else {
+    std::cerr << "[ERROR] Unknown scan insertion mode: " << mode << std::endl;
+    std::exit(-1);
+  }
+}
+
 auto init_scan_adder(const PropertiesProvider &props) {
   static const auto DBL_INF = std::numeric_limits<double>::infinity();
   auto builder = WallDistanceBlurringScanAdder::builder();
@@ -70,6 +162,9 @@ auto init_scan_adder(const PropertiesProvider &props) {
            .set_blur_distance(props.get_dbl("slam/mapping/blur", 0.0))
            .set_max_usable_range(props.get_dbl("slam/mapping/max_range",
                                                DBL_INF))
+           .set_insertion_mode(init_scan_insertion_mode(props))
+           .set_insertion_threads_nm(
+              props.get_uint("slam/mapping/insertion_threads", 1))
            .build();
 }
 
@@ -3,7 +3,11 @@
 
 #include <string>
 #include <memory>
+#include <utility>
+#include <fstream>
 #include <iostream>
+#include <typeinfo>
+#include <type_traits>
 
 #include "properties_providers.h"
 
@@ -13,9 +17,14 @@
 #include "../core/scan_matchers/hill_climbing_scan_matcher.h"
 #include "../core/scan_matchers/hcsm_fixed.h"
 #include "../core/scan_matchers/brute_force_scan_matcher.h"
+#include "../core/scan_matchers/correlative_scan_matcher.h"
+#include "../core/scan_matchers/gauss_newton_scan_matcher.h"
 #include "../core/scan_matchers/no_action_scan_matcher.h"
 #include "../core/scan_matchers/connect_the_dots_ambiguous_drift_detector.h"
 #include "../core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "../core/scan_matchers/static_weighted_mean_point_probability_spe.h"
+#include "../core/scan_matchers/beam_model_spe.h"
+#include "../core/scan_matchers/scan_matcher_profiler.h"
 
 static const std::string Slam_SM_NS = "slam/scmtch/";
 
@@ -65,16 +74,89 @@ auto init_swp(const PropertiesProvider &props) {
   return swp;
 }
 
-auto init_spe(const PropertiesProvider &props,
-              std::shared_ptr<OccupancyObservationProbabilityEstimator> oope) {
+template <typename MapT, typename OopeT>
+std::shared_ptr<ScanProbabilityEstimator> make_static_wmpp_spe(
+    std::shared_ptr<OopeT> oope, std::shared_ptr<ScanPointWeighting> spw,
+    unsigned skip_rate, double max_range) {
+  // NB: SPWs of other types are called virtually
+  //     (points are usually weighted once per scan anyway)
+  if (typeid(*spw) == typeid(EvenSPW)) {
+    return std::make_shared<StaticWeightedMeanPointProbabilitySPE<
+      OopeT, EvenSPW, MapT>>(oope, std::static_pointer_cast<EvenSPW>(spw),
+                             skip_rate, max_range);
+  }
+  if (typeid(*spw) == typeid(VinySlamSPW)) {
+    return std::make_shared<StaticWeightedMeanPointProbabilitySPE<
+      OopeT, VinySlamSPW, MapT>>(oope,
+                                 std::static_pointer_cast<VinySlamSPW>(spw),
+                                 skip_rate, max_range);
+  }
+  return std::make_shared<StaticWeightedMeanPointProbabilitySPE<
+    OopeT, ScanPointWeighting, MapT>>(oope, spw, skip_rate, max_range);
+}
+
+// The WMPP SPE composed at compile time for the common OOPEs
+// (see StaticWeightedMeanPointProbabilitySPE); nullptr for other OOPEs
+// and for maps of unknown types.
+template <typename MapT>
+std::shared_ptr<ScanProbabilityEstimator> init_static_wmpp_spe(
+    std::shared_ptr<OccupancyObservationProbabilityEstimator> oope,
+    std::shared_ptr<ScanPointWeighting> spw,
+    unsigned skip_rate, double max_range) {
+  if (std::is_same<MapT, GridMap>::value) { return nullptr; }
+
+  if (typeid(*oope) == typeid(ObstacleBasedOccupancyObservationPE)) {
+    return make_static_wmpp_spe<MapT>(
+      std::static_pointer_cast<ObstacleBasedOccupancyObservationPE>(oope),
+      spw, skip_rate, max_range);
+  }
+  if (typeid(*oope) == typeid(MaxOccupancyObservationPE)) {
+    return make_static_wmpp_spe<MapT>(
+      std::static_pointer_cast<MaxOccupancyObservationPE>(oope),
+      spw, skip_rate, max_range);
+  }
+  if (typeid(*oope) == typeid(MeanOccupancyObservationPE)) {
+    return make_static_wmpp_spe<MapT>(
+      std::static_pointer_cast<MeanOccupancyObservationPE>(oope),
+      spw, skip_rate, max_range);
+  }
+  return nullptr;
+}
+
+// NB: MapT is the type of the map of a slam; the SPE is composed
+//     at compile time for it if possible (see init_static_wmpp_spe).
+template <typename MapT = GridMap>
+std::shared_ptr<ScanProbabilityEstimator> init_spe(
+    const PropertiesProvider &props,
+    std::shared_ptr<OccupancyObservationProbabilityEstimator> oope) {
   auto type = props.get_str(Slam_SM_NS + "spe/type", "<undefined>");
   if (type == "wmpp") {
     const std::string WMPP_Prefix = Slam_SM_NS + "spe/wmpp";
     auto skip_rate = props.get_uint(WMPP_Prefix + "/sp_skip_rate", 0);
     auto max_range = props.get_dbl(WMPP_Prefix + "/sp_max_usable_range", -1);
+    auto spw = init_swp(props);
+    if (props.get_bool(Slam_SM_NS + "spe/static_dispatch", true)) {
+      auto spe = init_static_wmpp_spe<MapT>(oope, spw, skip_rate, max_range);
+      if (spe) { return spe; }
+    }
     using WmppSpe = WeightedMeanPointProbabilitySPE;
-    return std::make_shared<WmppSpe>(oope, init_swp(props),
-                                     skip_rate, max_range);
+    return std::make_shared<WmppSpe>(oope, spw, skip_rate, max_range);
+  } else if (type == "beam") {
+    const std::string Beam_Prefix = Slam_SM_NS + "spe/beam/";
+    auto cache_params = ExpectedRangeCacheParams{};
+    cache_params.max_range = props.get_dbl(Beam_Prefix + "max_range",
+                                           cache_params.max_range);
+    cache_params.angle_bins_nm = props.get_uint(Beam_Prefix + "angle_bins",
+                                                cache_params.angle_bins_nm);
+    cache_params.lattice_step = props.get_uint(Beam_Prefix + "lattice_step",
+                                               cache_params.lattice_step);
+    cache_params.obstacle_threshold = props.get_dbl(
+      Beam_Prefix + "obstacle_threshold", cache_params.obstacle_threshold);
+    auto hit_sigma = props.get_dbl(Beam_Prefix + "hit_sigma", 0.1);
+    auto random_weight = props.get_dbl(Beam_Prefix + "random_weight", 0.05);
+    auto skip_rate = props.get_uint(Beam_Prefix + "sp_skip_rate", 0);
+    return std::make_shared<BeamModelSPE>(oope, init_swp(props), cache_params,
+                                          hit_sigma, random_weight, skip_rate);
   } else {
     std::cerr << "Unknown Scan Probability Estimator type ("
               << Slam_SM_NS << "spe/type): " << type << std::endl;
@@ -82,13 +164,34 @@ auto init_spe(const PropertiesProvider &props,
   }
 };
 
+template <typename MapT = GridMap>
 auto init_spe(const PropertiesProvider &props) {
-  return init_spe(props, init_oope(props));
+  return init_spe<MapT>(props, init_oope(props));
 };
 
 /*============================================================================*/
 /* Init Scan Matcher Algorithm                                                */
 
+template <typename ScanMatcherT>
+auto init_estimation_threads(const PropertiesProvider &props,
+                             std::shared_ptr<ScanMatcherT> sm) {
+  sm->set_estimation_threads_nm(
+    props.get_uint(Slam_SM_NS + "estimation_threads", 1));
+  return sm;
+}
+
+template <typename ScanMatcherT>
+auto init_correction_prior(const PropertiesProvider &props,
+                           std::shared_ptr<ScanMatcherT> sm) {
+  static const std::string CP_NS = Slam_SM_NS + "correction_prior/";
+  if (!props.get_bool(CP_NS + "enabled", false)) { return sm; }
+
+  sm->set_correction_prior_model(std::make_shared<CorrectionPriorModel>(
+    props.get_dbl(CP_NS + "smoothing", 0.5),
+    props.get_dbl(CP_NS + "error_factor", 2)));
+  return sm;
+}
+
 auto init_monte_carlo_sm(const PropertiesProvider &props,
                          std::shared_ptr<ScanProbabilityEstimator> spe) {
   static const std::string SM_NS = Slam_SM_NS + "MC/";
@@ -101,11 +204,18 @@ auto init_monte_carlo_sm(const PropertiesProvider &props,
 
   auto attempts_limit = props.get_uint(SM_NS + "attempts_limit", 100);
   auto seed = props.get_int(SM_NS + "seed", std::random_device{}());
+  // NB: > 1 changes the search (see GaussianPoseEnumerator)
+  auto speculative_attempts = props.get_uint(SM_NS + "speculative_attempts",
+                                             1);
+  // "random" (i.i.d. samples) or "halton" (quasi-random ones)
+  auto sampling = props.get_str(SM_NS + "sampling", "random");
 
   std::cout << "[INFO] MC Scan Matcher seed: " << seed << std::endl;
-  return std::make_shared<MonteCarloScanMatcher>(
+  return init_correction_prior(props, init_estimation_threads(props,
+    std::make_shared<MonteCarloScanMatcher>(
       spe, seed, transl_dispersion, rot_dispersion,
-      failed_attempts_per_dispersion_limit, attempts_limit);
+      failed_attempts_per_dispersion_limit, attempts_limit,
+      speculative_attempts, sampling == "halton")));
 }
 
 auto init_hill_climbing_sm(const PropertiesProvider &props,
@@ -117,8 +227,10 @@ auto init_hill_climbing_sm(const PropertiesProvider &props,
   auto rot_distorsion = props.get_dbl(DIST_NS + "rotation", 0.1);
   auto fal = props.get_uint(DIST_NS + "failed_attempts_limit", 6);
 
-  return std::make_shared<HillClimbingScanMatcher>(
-      spe, fal, transl_distorsion, rot_distorsion);
+  auto hcsm = std::make_shared<HillClimbingScanMatcher>(
+    spe, fal, transl_distorsion, rot_distorsion);
+  hcsm->set_scales_nm(props.get_uint(SM_NS + "scales_nm", 1));
+  return init_correction_prior(props, init_estimation_threads(props, hcsm));
 }
 
 auto init_brute_force_sm(const PropertiesProvider &props,
@@ -136,18 +248,75 @@ auto init_brute_force_sm(const PropertiesProvider &props,
 
   #undef INIT_BFSM_RANGE
 
-  return std::make_shared<BruteForceScanMatcher>(
-    spe, from_x, to_x, step_x, from_y, to_y, step_y, from_t, to_t, step_t);
+  return init_estimation_threads(props,
+    std::make_shared<BruteForceScanMatcher>(
+      spe, from_x, to_x, step_x, from_y, to_y, step_y, from_t, to_t, step_t));
+}
+
+auto init_correlative_sm(const PropertiesProvider &props,
+                         std::shared_ptr<ScanProbabilityEstimator> spe) {
+  static const std::string SM_NS = Slam_SM_NS + "CBF/";
+
+  // NB: translations are enumerated with the map resolution
+  auto max_x_error = props.get_dbl(SM_NS + "x/max_error", 0.5);
+  auto max_y_error = props.get_dbl(SM_NS + "y/max_error", 0.5);
+  auto from_t = props.get_dbl(SM_NS + "t/from", -deg2rad(5));
+  auto to_t = props.get_dbl(SM_NS + "t/to", deg2rad(5));
+  auto step_t = props.get_dbl(SM_NS + "t/step", deg2rad(0.5));
+
+  return std::make_shared<CorrelativeScanMatcher>(
+    spe, max_x_error, max_y_error, from_t, to_t, step_t);
 }
 
+auto init_gauss_newton_sm(const PropertiesProvider &props,
+                          std::shared_ptr<ScanProbabilityEstimator> spe) {
+  static const std::string SM_NS = Slam_SM_NS + "GN/";
+
+  auto max_iterations_nm = props.get_uint(SM_NS + "max_iterations", 10);
+  // NB: coarser scales are used only if the map is rescalable
+  auto scales_nm = props.get_uint(SM_NS + "scales_nm", 3);
+
+  return std::make_shared<GaussNewtonScanMatcher>(spe, max_iterations_nm,
+                                                  scales_nm);
+}
+
+// Subscribes a profiler of search statistics (see ScanMatcherProfiler)
+// to the matcher if an output file is given.
+// NB: the profiler is kept by the returned pointer to the matcher.
+std::shared_ptr<GridScanMatcher> init_scan_matcher_profiling(
+    const PropertiesProvider &props, std::shared_ptr<GridScanMatcher> sm,
+    const std::string &sm_type) {
+  static const std::string Profile_NS = Slam_SM_NS + "profile/";
+  auto fname = props.get_str(Profile_NS + "output", "");
+  if (fname.empty()) { return sm; }
+
+  auto os = std::make_shared<std::ofstream>(fname);
+  if (!os->is_open()) {
+    std::cerr << "Unable to open scan matcher profile " << fname << std::endl;
+    return sm;
+  }
+  auto profiler = std::make_shared<ScanMatcherProfiler>(
+    sm_type, os, props.get_uint(Profile_NS + "window", 100),
+    props.get_str(Profile_NS + "format", "csv"));
+  sm->subscribe(profiler);
+  auto owner = std::make_shared<std::pair<std::shared_ptr<GridScanMatcher>,
+                                          decltype(profiler)>>(sm, profiler);
+  return std::shared_ptr<GridScanMatcher>{owner, sm.get()};
+}
+
+// NB: MapT is the type of the map the matcher matches scans against
+//     (see init_spe)
+template <typename MapT = GridMap>
 auto init_scan_matcher(const PropertiesProvider &props) {
-  auto spe = init_spe(props);
+  auto spe = init_spe<MapT>(props);
   auto sm = std::shared_ptr<GridScanMatcher>{};
   auto sm_type = props.get_str(Slam_SM_NS + "type", "<undefined>");
   std::cout << "Used Scan Matcher: " << sm_type << std::endl;
   if      (sm_type == "MC") { sm = init_monte_carlo_sm(props, spe); }
   else if (sm_type == "HC") { sm = init_hill_climbing_sm(props, spe); }
   else if (sm_type == "BF") { sm = init_brute_force_sm(props, spe); }
+  else if (sm_type == "CBF") { sm = init_correlative_sm(props, spe); }
+  else if (sm_type == "GN") { sm = init_gauss_newton_sm(props, spe); }
   else if (sm_type == "idle") {
     sm = std::make_shared<NoActionScanMatcher>(spe);
   }
@@ -159,6 +328,10 @@ auto init_scan_matcher(const PropertiesProvider &props) {
     std::exit(-1);
   }
 
+  // NB: respected by pose enumerating matchers (MC, HC, BF)
+  sm->set_time_budget_ms(props.get_dbl(Slam_SM_NS + "time_budget_ms", 0));
+  sm = init_scan_matcher_profiling(props, sm, sm_type);
+
   // TODO: do we need AmbDD to be a wrapper?
   if (props.get_bool(Slam_SM_NS + "use_amb_drift_detector", false)) {
     sm = std::make_shared<ConnectTheDotsAmbiguousDriftDetector>(sm);
@@ -0,0 +1,91 @@
+#ifndef SLAM_CTOR_UTILS_INIT_SESSION_H
+#define SLAM_CTOR_UTILS_INIT_SESSION_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "properties_providers.h"
+
+// A saved session (see save_session of a slam) to resume the slam from
+// at start if the file exists; the session is saved back to the file
+// at the end of a run (see save_session_file).
+std::string init_session_fname(const PropertiesProvider &props) {
+  return props.get_str("slam/session/file", "");
+}
+
+// Resumes the slam from the session file if it exists
+template <typename SlamT>
+void init_session(const PropertiesProvider &props, SlamT &slam) {
+  auto fname = init_session_fname(props);
+  if (fname.empty()) { return; }
+
+  auto file = std::ifstream{fname, std::ios::binary};
+  // NB: no file - a new session
+  if (!file) { return; }
+  auto session = std::vector<char>{std::istreambuf_iterator<char>{file},
+                                   std::istreambuf_iterator<char>{}};
+  if (!slam.load_session(session)) {
+    std::cerr << "[ERROR] " << fname << " is not a session of the slam "
+              << "(or of this build) or it is truncated" << std::endl;
+    std::exit(-1);
+  }
+}
+
+template <typename SlamT>
+auto save_session(SlamT &slam, const std::string &fname, int)
+  -> decltype(slam.save_session(), bool()) {
+  auto session = slam.save_session();
+  // NB: the session is replaced at once, so an interrupted save
+  //     doesn't spoil the previous one
+  auto tmp_fname = fname + ".tmp";
+  {
+    auto file = std::ofstream{tmp_fname, std::ios::binary};
+    file.write(session.data(), session.size());
+    if (!file) { return false; }
+  }
+  return std::rename(tmp_fname.c_str(), fname.c_str()) == 0;
+}
+
+template <typename SlamT>
+bool save_session(SlamT &, const std::string &, long) {
+  std::cerr << "[Warn] The slam doesn't support sessions" << std::endl;
+  return true;
+}
+
+// Saves the session of the slam to the file (if it is set)
+template <typename SlamT>
+void save_session_file(const std::string &fname, SlamT &slam) {
+  if (fname.empty() || save_session(slam, fname, 0)) { return; }
+  std::cerr << "[ERROR] Unable to save the session to " << fname
+            << std::endl;
+}
+
+// Saves the session of the slam when a node stops (see SlamNodePins)
+template <typename SlamT>
+class SessionSaver {
+public:
+  SessionSaver(std::shared_ptr<SlamT> slam, const PropertiesProvider &props)
+    : _slam{slam}, _fname{init_session_fname(props)} {}
+
+  SessionSaver(const SessionSaver&) = delete;
+  SessionSaver& operator=(const SessionSaver&) = delete;
+
+  ~SessionSaver() { save_session_file(_fname, *_slam); }
+
+private:
+  std::shared_ptr<SlamT> _slam;
+  std::string _fname;
+};
+
+template <typename SlamT>
+auto make_session_saver(std::shared_ptr<SlamT> slam,
+                        const PropertiesProvider &props) {
+  return std::make_shared<SessionSaver<SlamT>>(slam, props);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SLAM_CTOR_UTILS_INIT_STAGE_PROFILING_H
+#define SLAM_CTOR_UTILS_INIT_STAGE_PROFILING_H
+
+#include <memory>
+
+#include "properties_providers.h"
+#include "../core/stage_profiler.h"
+#include "../core/trace_recorder.h"
+#include "../core/thread_pool.h"
+
+// NB: tracing is disabled by default (no trace file);
+//     the trace is written on the process exit.
+void init_slam_tracing(const PropertiesProvider &props) {
+  static const std::string Trace_NS = "slam/performance/trace";
+  auto fname = props.get_str(Trace_NS, "");
+  if (fname.empty()) { return; }
+  TraceRecorder::install(std::make_unique<TraceRecorder>(
+    fname, props.get_uint(Trace_NS + "_max_events", 1000000)));
+}
+
+// NB: the pool of parallel stages is shared by slams of the process,
+//     so it is configured once on start (0 threads - all cores).
+void init_thread_pool(const PropertiesProvider &props) {
+  static const std::string Threads_NS = "slam/performance/threads";
+  ThreadPool::configure_shared(props.get_uint(Threads_NS, 0),
+                               props.get_bool("slam/performance/pin_threads",
+                                              false));
+}
+
+// NB: profiling is disabled by default (the profiler is null);
+//     stage latencies are logged once per the report period.
+std::shared_ptr<StageProfiler> init_stage_profiler(
+    const PropertiesProvider &props) {
+  static const std::string Profile_NS = "slam/performance/profile";
+  init_slam_tracing(props);
+  init_thread_pool(props);
+  if (!props.get_bool(Profile_NS, false)) { return nullptr; }
+
+  auto profiler = std::make_shared<StageProfiler>(
+    props.get_dbl(Profile_NS + "_report_period", 10));
+  profiler->subscribe(std::make_shared<StageProfileLogger>());
+  return profiler;
+}
+
+#endif
@@ -2,20 +2,66 @@
 #define SLAM_CTOR_UTIL_MAP_DUMPERS
 
 #include <cmath>
+#include <memory>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 #include "../core/math_utils.h"
+#include "../core/bounded_task_queue.h"
 #include "../core/states/world.h"
 #include "../core/states/state_data.h"
 #include "../core/maps/grid_map.h"
 
+/* Reads a map by rows (the top one first) as 8-bit gray intensities:
+ * occupied areas are black, unknown ones are gray.
+ * PERFORMANCE: a row is read at once from the map's storage (see
+ *              GridMap::row_occupancies), e.g. unknown tiles of tiled maps
+ *              are not touched; memory is independent of the map height. */
+template <typename GridMapType>
+class GridMapIntensityRows {
+public:
+  using Intensity = unsigned char;
+  static constexpr Intensity Max_Intensity = 255;
+public:
+  GridMapIntensityRows(const GridMapType &map)
+    : _map(map), _origin{map.origin()}, _probs(map.width()) {}
+
+  int width() const { return _map.width(); }
+  int height() const { return _map.height(); }
+
+  // Reads the row_i-th row (from the top) to width() intensities
+  void read(int row_i, Intensity *row) {
+    _map.row_occupancies({-_origin.x, height() - _origin.y - 1 - row_i},
+                         width(), _probs.data());
+    for (std::size_t i = 0; i < _probs.size(); ++i) {
+      auto occ = _probs[i];
+      auto value = 1.0 - (occ == -1 ? 0.5 : bound_value(0.0, occ, 1.0));
+      row[i] = static_cast<Intensity>(Max_Intensity * value);
+    }
+  }
+
+private:
+  const GridMapType &_map;
+  DiscretePoint2D _origin;
+  std::vector<double> _probs;
+};
+
+/* Dumps every map update to a separate PGM file.
+ * PERFORMANCE: a map is formatted to memory, files are written by
+ *              a background thread; at most Pending_Files_Nm files wait for
+ *              the storage (i.e. a slow storage throttles the mapping
+ *              rather than accumulates maps). */
 template <typename GridMapType>
 class GridMapToPgmDumber : public WorldMapObserver<GridMapType> {
   // Used PGM format discription: http://netpbm.sourceforge.net/doc/pgm.html
 private:
   using IntensityType = unsigned char;
   static constexpr IntensityType Max_Intensity = 255;
+  static constexpr std::size_t Pending_Files_Nm = 2;
+  static constexpr std::size_t Rows_Block_Size = 1 << 20;
 private:
   class PgmHeader {
   public:
@@ -56,41 +102,48 @@ public:
     , _id{0} {}
 
   void on_map_update(const GridMapType &map) override {
-    auto dst = std::ofstream{_base_fname + std::to_string(_id) + ".pgm",
-                             std::ios::binary | std::ios::out};
-    dump_map(dst, map);
-    dst.close();
+    // NB: the stream is read by the writing thread
+    auto pgm = std::make_shared<std::stringstream>(
+      std::ios::binary | std::ios::in | std::ios::out);
+    dump_map(*pgm, map);
+    auto fname = _base_fname + std::to_string(_id) + ".pgm";
+    _write_queue.push([fname, pgm]() {
+      auto dst = std::ofstream{fname, std::ios::binary | std::ios::out};
+      dst << pgm->rdbuf();
+    });
     ++_id;
   }
 
-  static void dump_map(std::ofstream &os, const GridMapType &map) {
-    auto w = map.width(), h = map.height();
-    auto origin = map.origin();
+  // Blocks until dumped maps are written to files
+  // (NB: is done on destruction as well)
+  void flush() { _write_queue.wait_for_idle(); }
+
+  // PERFORMANCE: rows are streamed by blocks of Rows_Block_Size bytes
+  static void dump_map(std::ostream &os, const GridMapType &map) {
+    auto rows = GridMapIntensityRows<GridMapType>{map};
+    auto w = rows.width(), h = rows.height();
     // write pgm header
     PgmHeader{w, h, Max_Intensity}.write(os);
     char new_line = '\n';
     os.write(&new_line, sizeof(new_line));
 
     // write map content
-    using AreaId = typename GridMapType::Coord;
-    auto area_id = AreaId{};
-
-    int val_nm = 0;
-    for (area_id.y = h - origin.y - 1; -origin.y <= area_id.y; --area_id.y) {
-      for (area_id.x = -origin.x; area_id.x < w - origin.x; ++area_id.x) {
-        auto occ = map.occupancy(area_id);
-        auto value = 1.0 - (occ == -1 ? 0.5 : bound_value(0.0, occ, 1.0));
-        auto intensity = static_cast<IntensityType>(Max_Intensity * value);
-        static_assert(sizeof(intensity) == 1, "PGM insensity is not char");
-        os.write(reinterpret_cast<char*>(&intensity), sizeof(intensity));
-        ++val_nm;
+    static_assert(sizeof(IntensityType) == 1, "PGM insensity is not char");
+    int block_rows_nm = std::max(1, int(Rows_Block_Size / std::max(1, w)));
+    auto block = std::vector<IntensityType>(block_rows_nm * std::size_t(w));
+    for (int row_i = 0; row_i < h; row_i += block_rows_nm) {
+      int rows_nm = std::min(block_rows_nm, h - row_i);
+      for (int i = 0; i < rows_nm; ++i) {
+        rows.read(row_i + i, block.data() + i * std::size_t(w));
       }
+      os.write(reinterpret_cast<const char*>(block.data()),
+               rows_nm * std::size_t(w));
     }
-    assert(val_nm == w * h); // sanity
   }
 private:
   std::string _base_fname;
   unsigned long long _id;
+  BoundedTaskQueue _write_queue{Pending_Files_Nm};
 };
 
 #endif
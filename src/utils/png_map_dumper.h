@@ -0,0 +1,160 @@
+#ifndef SLAM_CTOR_UTILS_PNG_MAP_DUMPER_H
+#define SLAM_CTOR_UTILS_PNG_MAP_DUMPER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <initializer_list>
+
+#include <zlib.h>
+
+#include "map_dumpers.h"
+#include "../core/thread_pool.h"
+
+/* Dumps a map to a grayscale 8-bit PNG.
+ * Rows are split to blocks that are deflated independently by several
+ * threads (as pigz does): a block is a raw deflate stream that ends
+ * at a byte boundary (Z_SYNC_FLUSH), so blocks are concatenated to
+ * a single zlib stream whose checksum is combined from ones of blocks.
+ * PERFORMANCE: rows are read (see GridMapIntensityRows) and written by
+ *              batches of threads_nm blocks, so memory depends on the map
+ *              width only. Blocks are compressed with Z_BEST_SPEED
+ *              by default, maps are mostly runs of equal values. */
+template <typename GridMapType>
+class GridMapToPngDumper {
+private: // types
+  using Bytes = std::vector<unsigned char>;
+
+  struct Block {
+    Bytes raw, deflated;
+    uLong adler;
+    bool is_last;
+  };
+public: // consts
+  static constexpr std::size_t Rows_Block_Size = 1 << 20;
+public:
+  static bool dump_map(std::ostream &os, const GridMapType &map,
+                       unsigned threads_nm = 1,
+                       int compression_level = Z_BEST_SPEED,
+                       std::size_t block_size = Rows_Block_Size) {
+    auto rows = GridMapIntensityRows<GridMapType>{map};
+    std::size_t w = rows.width(), h = rows.height();
+    if (w == 0 || h == 0) { return false; }
+
+    static const unsigned char Signature[] = {
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    os.write(reinterpret_cast<const char*>(Signature), sizeof(Signature));
+    auto ihdr = Bytes{};
+    append_u32(ihdr, w);
+    append_u32(ihdr, h);
+    // bit depth, grayscale, deflate, adaptive filtering, no interlace
+    ihdr.insert(ihdr.end(), {8, 0, 0, 0, 0});
+    write_chunk(os, "IHDR", {&ihdr});
+
+    // NB: a scanline is prepended with a filter type (0, i.e. none)
+    auto line_size = w + 1;
+    auto block_rows_nm = std::max<std::size_t>(1, block_size / line_size);
+    auto blocks = std::vector<Block>(std::max(1u, threads_nm));
+    auto adler = adler32(0, Z_NULL, 0);
+    auto is_first_block = true;
+    for (std::size_t row_i = 0; row_i < h;) {
+      // read a batch of blocks
+      std::size_t batch_size = 0;
+      for (; batch_size < blocks.size() && row_i < h; ++batch_size) {
+        auto &block = blocks[batch_size];
+        auto rows_nm = std::min(block_rows_nm, h - row_i);
+        block.raw.resize(rows_nm * line_size);
+        for (std::size_t i = 0; i < rows_nm; ++i) {
+          block.raw[i * line_size] = 0;
+          rows.read(row_i + i, &block.raw[i * line_size + 1]);
+        }
+        row_i += rows_nm;
+        block.is_last = row_i == h;
+      }
+
+      // deflate blocks of the batch concurrently
+      ThreadPool::shared()->parallel_for(batch_size, [&](std::size_t i) {
+        deflate_block(blocks[i], compression_level);
+      }, threads_nm);
+
+      // write blocks in order
+      for (std::size_t i = 0; i < batch_size; ++i) {
+        auto &block = blocks[i];
+        adler = adler32_combine(adler, block.adler, block.raw.size());
+        auto header = Bytes{}, trailer = Bytes{};
+        if (is_first_block) {
+          // deflate, 32K window, no dictionary (see RFC 1950)
+          header = {0x78, 0x01};
+          is_first_block = false;
+        }
+        if (block.is_last) { append_u32(trailer, adler); }
+        write_chunk(os, "IDAT", {&header, &block.deflated, &trailer});
+      }
+    }
+    write_chunk(os, "IEND", {});
+    return bool(os);
+  }
+
+private: // methods
+
+  static void deflate_block(Block &block, int compression_level) {
+    block.adler = adler32(adler32(0, Z_NULL, 0), block.raw.data(),
+                          block.raw.size());
+    auto strm = z_stream{};
+    // NB: negative window bits mean a raw deflate stream (no zlib header)
+    deflateInit2(&strm, compression_level, Z_DEFLATED, -15, 8,
+                 Z_DEFAULT_STRATEGY);
+    block.deflated.resize(deflateBound(&strm, block.raw.size()) + 16);
+    strm.next_in = block.raw.data();
+    strm.avail_in = block.raw.size();
+    strm.next_out = block.deflated.data();
+    strm.avail_out = block.deflated.size();
+    auto flush = block.is_last ? Z_FINISH : Z_SYNC_FLUSH;
+    deflate(&strm, flush);
+    while (strm.avail_out == 0) {
+      auto used = block.deflated.size();
+      block.deflated.resize(2 * used);
+      strm.next_out = block.deflated.data() + used;
+      strm.avail_out = block.deflated.size() - used;
+      deflate(&strm, flush);
+    }
+    block.deflated.resize(block.deflated.size() - strm.avail_out);
+    deflateEnd(&strm);
+  }
+
+  static void append_u32(Bytes &bytes, uint32_t value) {
+    for (int shift = 24; 0 <= shift; shift -= 8) {
+      bytes.push_back((value >> shift) & 0xFF);
+    }
+  }
+
+  // Writes a chunk whose data is a concatenation of the given parts
+  static void write_chunk(std::ostream &os, const char *type,
+                          std::initializer_list<const Bytes*> data) {
+    std::size_t data_size = 0;
+    for (auto part : data) { data_size += part->size(); }
+    auto prefix = Bytes{};
+    append_u32(prefix, data_size);
+    prefix.insert(prefix.end(), type, type + 4);
+    // NB: the crc covers the type and the data
+    auto crc = crc32(0, Z_NULL, 0);
+    crc = crc32(crc, prefix.data() + 4, 4);
+    os.write(reinterpret_cast<const char*>(prefix.data()), prefix.size());
+    for (auto part : data) {
+      // NB: crc32 with a null buffer returns the initial value
+      if (part->empty()) { continue; }
+      crc = crc32(crc, part->data(), part->size());
+      os.write(reinterpret_cast<const char*>(part->data()), part->size());
+    }
+    auto suffix = Bytes{};
+    append_u32(suffix, crc);
+    os.write(reinterpret_cast<const char*>(suffix.data()), suffix.size());
+  }
+};
+
+template <typename GridMapType>
+constexpr std::size_t GridMapToPngDumper<GridMapType>::Rows_Block_Size;
+
+#endif
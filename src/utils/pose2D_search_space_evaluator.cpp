@@ -1,7 +1,36 @@
+/* Evaluates landscapes of scan probability estimators (SPE) around
+ * the actual pose on synthetic worlds: a closed corridor, an open corridor
+ * and several corridors. A scan is generated from the actual pose and
+ * estimated for each pose of a grid of [-range, range] translations
+ * (the score of a translation is the best one among rotations).
+ * Each combination of an occupancy observation probability estimator
+ * (OOPE) and a scan point weighting (SPW) is evaluated; reported per
+ * world and combination:
+ *   - evaluation throughput (poses and scan points per second);
+ *   - the number of local maxima of the landscape (8-neighborhood);
+ *   - the share of poses from which hill climbing over the grid reaches
+ *     the global maximum (i.e. how unimodal the landscape is);
+ *   - the distance of the best pose to the actual one.
+ * Input maps, scans and landscapes are dumped as pgm images.
+ * PERFORMANCE: rows of the grid are evaluated by threads, a row is
+ *              estimated by a single batch (see
+ *              ScanProbabilityEstimator::estimate_scan_probabilities).
+ * Usage: p2D_ss_evaluator [threads_nm [max_rotation_deg
+ *                                      [rotation_step_deg]]]
+ */
+
 #include <iostream>
+#include <iomanip>
 #include <memory>
 #include <utility>
 #include <chrono>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <cmath>
 
 #include "../core/maps/grid_cell.h"
 #include "../core/maps/plain_grid_map.h"
@@ -14,7 +43,6 @@
 #include "../core/maps/const_occupancy_estimator.h"
 #include "../core/scan_matchers/occupancy_observation_probability.h"
 #include "../core/scan_matchers/weighted_mean_point_probability_spe.h"
-#include "../core/scan_matchers/brute_force_scan_matcher.h"
 
 // FIXME: code duplication with tests's MockGridCell
 class LastWriteWinsGridCell : public GridCell {
@@ -28,40 +56,293 @@ public:
   }
 };
 
-class ScanMatcherSearchSpaceBuilder : public GridScanMatcherObserver {
-public:
+struct EvaluationParams {
+  // translations of the grid are in [-range, range] with the resolution
+  double search_range = 1;  // meters
+  double resolution = 0.01; // meters
+  // rotations are in [-max, max] with the step
+  double max_rotation = 0;  // degrees
+  double rotation_step = 1; // degrees
+  unsigned threads_nm = std::max(1u, std::thread::hardware_concurrency());
 
-  ScanMatcherSearchSpaceBuilder(double resolution)
-    : _map{
-      std::make_shared<UnboundedPlainGridMap>(
-        std::make_shared<LastWriteWinsGridCell>(),
-        GridMapParams{100, 100, resolution}
-       )} {}
-  
-  std::shared_ptr<GridMap> map() {
-    return _map;
+  int side_poses_nm() const {
+    return 2 * static_cast<int>(std::round(search_range / resolution)) + 1;
   }
-  
-  void on_scan_test(const RobotPose &pose, const LaserScan2D &,
-                    double score) override {
-    auto coord = _map->world_to_cell({pose.x, pose.y});
-    auto eff_score = score;
-
-    // if (are_equal(pose.x, 0.05)) {
-    //    std::cout << pose << " -> " << score << " ~ "
-    //              << eff_score << std::endl;
-    // }
-    
-    _map->update(coord, {true, {eff_score, 0}, {0, 0}, 1.0});
+};
+
+struct SpeCase {
+  std::string name;
+  std::function<std::shared_ptr<ScanProbabilityEstimator>()> make;
+};
+
+std::vector<SpeCase> make_spe_cases() {
+  using OOPE = std::shared_ptr<OccupancyObservationProbabilityEstimator>;
+  using SPW = std::shared_ptr<ScanPointWeighting>;
+  using OopeFactory = std::function<OOPE()>;
+  using SpwFactory = std::function<SPW()>;
+  auto oopes = std::vector<std::pair<std::string, OopeFactory>>{
+    {"obstacle", []() {
+      return std::make_shared<ObstacleBasedOccupancyObservationPE>(); }},
+    {"max", []() {
+      return std::make_shared<MaxOccupancyObservationPE>(); }},
+    {"mean", []() {
+      return std::make_shared<MeanOccupancyObservationPE>(); }},
+    {"overlap", []() {
+      return std::make_shared<OverlapWeightedOccupancyObservationPE>(); }}
+  };
+  auto spws = std::vector<std::pair<std::string, SpwFactory>>{
+    {"even", []() { return std::make_shared<EvenSPW>(); }},
+    {"ahr", []() { return std::make_shared<AngleHistogramReciprocalSPW>(); }},
+    {"viny", []() { return std::make_shared<VinySlamSPW>(); }}
+  };
+
+  auto cases = std::vector<SpeCase>{};
+  for (auto &oope : oopes) {
+    for (auto &spw : spws) {
+      auto make_oope = oope.second;
+      auto make_spw = spw.second;
+      cases.push_back({oope.first + "-" + spw.first, [=]() {
+        return std::make_shared<WeightedMeanPointProbabilitySPE>(
+          make_oope(), make_spw());
+      }});
+    }
   }
+  return cases;
+}
 
-private:
-  std::shared_ptr<GridMap> _map;
+// Scores of a square grid of translations, rows go along y
+struct Landscape {
+  int side;
+  std::vector<double> scores;
+  double evaluation_secs = 0;
+
+  double score(int x_i, int y_i) const { return scores[y_i * side + x_i]; }
+};
+
+struct LandscapeShape {
+  std::size_t peaks_nm = 0;
+  // the share of poses hill climbing reaches the global maximum from
+  double basin_share = 0;
+  // the distance of the best pose to the center of the grid
+  double best_pose_offset = 0;
 };
 
-void run_evaluation(const GridMap &map, double resolution);
+Landscape evaluate_landscape(const ScanProbabilityEstimator &spe,
+                             const LaserScan2D &scan, const GridMap &map,
+                             const RobotPose &center,
+                             const EvaluationParams &ep) {
+  auto landscape = Landscape{ep.side_poses_nm(), {}};
+  auto &side = landscape.side;
+  landscape.scores.assign(side * side, 0);
+
+  auto rotations = std::vector<double>{0};
+  auto rotations_nm = 0 < ep.rotation_step ?
+    static_cast<int>(std::floor(ep.max_rotation / ep.rotation_step)) : 0;
+  for (int i = 1; i <= rotations_nm; ++i) {
+    rotations.push_back(deg2rad(i * ep.rotation_step));
+    rotations.push_back(-deg2rad(i * ep.rotation_step));
+  }
 
-void run_closed_corridor_case() {
+  auto params = ScanProbabilityEstimator::SPEParams{};
+  auto half_cell = map.scale() / 2;
+  params.sp_analysis_area = {-half_cell, half_cell, -half_cell, half_cell};
+  auto threads_nm = spe.supports_concurrent_estimations(scan, params) ?
+    ep.threads_nm : 1;
+
+  auto offset = [&ep, side](int i) {
+    return (i - side / 2) * ep.resolution;
+  };
+  std::atomic<int> next_row{0};
+  auto evaluate_rows = [&]() {
+    // NB: poses of a rotation go in a row, so the scan is rotated once
+    auto poses = std::vector<RobotPose>{};
+    auto probabilities = std::vector<double>{};
+    int y_i;
+    while ((y_i = next_row++) < side) {
+      poses.clear();
+      for (auto rotation : rotations) {
+        for (int x_i = 0; x_i < side; ++x_i) {
+          poses.emplace_back(center.x + offset(x_i), center.y + offset(y_i),
+                             center.theta + rotation);
+        }
+      }
+      probabilities.resize(poses.size());
+      spe.estimate_scan_probabilities(scan, poses.data(), poses.size(), map,
+                                      params, probabilities.data());
+      auto *row = &landscape.scores[y_i * side];
+      for (std::size_t i = 0; i < probabilities.size(); ++i) {
+        // NB: an unknown probability (NaN) is never the best one
+        auto &score = row[i % side];
+        if (score < probabilities[i]) { score = probabilities[i]; }
+      }
+    }
+  };
+
+  auto start = std::chrono::high_resolution_clock::now();
+  auto workers = std::vector<std::thread>{};
+  for (unsigned i = 1; i < threads_nm; ++i) {
+    workers.emplace_back(evaluate_rows);
+  }
+  evaluate_rows();
+  for (auto &worker : workers) { worker.join(); }
+  auto end = std::chrono::high_resolution_clock::now();
+  landscape.evaluation_secs = std::chrono::duration<double>(end - start)
+                                .count();
+  return landscape;
+}
+
+// NB: hill climbing moves to the best of 8 neighbors while it is better;
+//     a plateau (equal neighbors) is left through its best neighbor,
+//     so a peak is a plateau without better neighbors.
+LandscapeShape analyze_landscape(const Landscape &landscape,
+                                 double resolution) {
+  auto side = landscape.side;
+  auto poses_nm = side * side;
+  auto &scores = landscape.scores;
+  auto for_each_neighbor = [side](int i, std::function<void(int)> action) {
+    auto x_i = i % side, y_i = i / side;
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        auto nx = x_i + dx, ny = y_i + dy;
+        if ((dx == 0 && dy == 0) || nx < 0 || side <= nx ||
+            ny < 0 || side <= ny) {
+          continue;
+        }
+        action(ny * side + nx);
+      }
+    }
+  };
+
+  // plateaus and the best better neighbor of each one
+  auto plateau_ids = std::vector<int>(poses_nm, -1);
+  auto plateau_sizes = std::vector<std::size_t>{};
+  auto exits = std::vector<int>{};
+  auto stack = std::vector<int>{};
+  for (int i = 0; i < poses_nm; ++i) {
+    if (plateau_ids[i] != -1) { continue; }
+    auto id = static_cast<int>(plateau_sizes.size());
+    auto exit = -1;
+    plateau_sizes.push_back(0);
+    plateau_ids[i] = id;
+    stack.push_back(i);
+    while (!stack.empty()) {
+      auto current = stack.back();
+      stack.pop_back();
+      ++plateau_sizes[id];
+      for_each_neighbor(current, [&](int n) {
+        if (scores[n] == scores[i] && plateau_ids[n] == -1) {
+          plateau_ids[n] = id;
+          stack.push_back(n);
+        } else if (scores[i] < scores[n] &&
+                   (exit == -1 || scores[exit] < scores[n])) {
+          exit = n;
+        }
+      });
+    }
+    exits.push_back(exit);
+  }
+
+  // the peak plateau climbing from a plateau ends at; scores strictly
+  // increase along a climb, so it ends
+  auto peaks = std::vector<int>(plateau_sizes.size(), -1);
+  auto peak_of = [&](int id) {
+    auto path = std::vector<int>{};
+    while (peaks[id] == -1 && exits[id] != -1) {
+      path.push_back(id);
+      id = plateau_ids[exits[id]];
+    }
+    auto peak = peaks[id] == -1 ? id : peaks[id];
+    peaks[id] = peak;
+    for (auto path_id : path) { peaks[path_id] = peak; }
+    return peak;
+  };
+
+  auto best_i = std::max_element(scores.begin(), scores.end()) -
+                scores.begin();
+  auto best_plateau = plateau_ids[best_i];
+  auto shape = LandscapeShape{};
+  std::size_t basin_nm = 0;
+  for (std::size_t id = 0; id < plateau_sizes.size(); ++id) {
+    if (exits[id] == -1) { ++shape.peaks_nm; }
+    if (peak_of(id) == best_plateau) { basin_nm += plateau_sizes[id]; }
+  }
+
+  shape.basin_share = double(basin_nm) / poses_nm;
+  auto dx = (best_i % side - side / 2) * resolution;
+  auto dy = (best_i / side - side / 2) * resolution;
+  shape.best_pose_offset = std::sqrt(dx * dx + dy * dy);
+  return shape;
+}
+
+void dump_landscape(const std::string &name, const Landscape &landscape,
+                    double resolution) {
+  auto map = UnboundedPlainGridMap{std::make_shared<LastWriteWinsGridCell>(),
+                                   {landscape.side, landscape.side,
+                                    resolution}};
+  auto side = landscape.side;
+  auto row = std::vector<AreaOccupancyObservation>(
+    side, AreaOccupancyObservation{true, {0, 0}, {0, 0}, 1.0});
+  map.reserve_area({-side / 2, -side / 2},
+                   {side - 1 - side / 2, side - 1 - side / 2});
+  for (int y_i = 0; y_i < side; ++y_i) {
+    for (int x_i = 0; x_i < side; ++x_i) {
+      row[x_i].occupancy = {landscape.score(x_i, y_i), 0};
+    }
+    map.update_row({-side / 2, y_i - side / 2}, side, row.data());
+  }
+  GridMapToPgmDumber<decltype(map)>{name}.on_map_update(map);
+}
+
+void dump_scan(const std::string &name, const LaserScan2D &scan,
+               const RobotPose &pose) {
+  auto map = UnboundedPlainGridMap{std::make_shared<LastWriteWinsGridCell>(),
+                                   {100, 100, 0.1}};
+  auto scan_adder = WallDistanceBlurringScanAdder::builder()
+    .set_occupancy_estimator(
+      std::make_shared<ConstOccupancyEstimator>(Occupancy{1.0, 1.0},
+                                                Occupancy{0.0, 1.0}))
+    .set_observation_quality_estimator(std::make_shared<IdleOMQE>())
+    .build();
+  scan_adder->append_scan(map, pose, scan, 1.0);
+  GridMapToPgmDumber<decltype(map)>{name + "_scan"}.on_map_update(map);
+}
+
+void run_evaluation(const std::string &name, const GridMap &map,
+                    const EvaluationParams &ep) {
+  auto pose = RobotPose{0.05, 0.05, 0};
+  auto raw_scan = LaserScanGenerator{to_lsp(100, 270, 1000)}
+                    .laser_scan_2D(map, pose, 1);
+  dump_scan(name, raw_scan, pose);
+
+  auto poses_nm = double(ep.side_poses_nm()) * ep.side_poses_nm() *
+    (1 + 2 * (0 < ep.rotation_step ?
+                std::floor(ep.max_rotation / ep.rotation_step) : 0));
+  std::cout << std::setw(16) << std::left << "spe"
+            << std::setw(11) << "poses/s" << std::setw(9) << "Mpts/s"
+            << std::setw(7) << "peaks" << std::setw(9) << "basin,%"
+            << "offset,cm" << std::endl;
+  for (auto &spe_case : make_spe_cases()) {
+    auto spe = spe_case.make();
+    // NB: the scan is filtered once, so all poses share its SoA form
+    auto scan = spe->filter_scan(raw_scan, pose, map);
+    auto landscape = evaluate_landscape(*spe, scan, map, pose, ep);
+    auto shape = analyze_landscape(landscape, ep.resolution);
+    dump_landscape(name + "_sss_" + spe_case.name, landscape, ep.resolution);
+
+    auto poses_per_sec = poses_nm / landscape.evaluation_secs;
+    std::cout << std::setw(16) << std::left << spe_case.name
+              << std::fixed << std::setprecision(0)
+              << std::setw(11) << poses_per_sec
+              << std::setprecision(1)
+              << std::setw(9) << poses_per_sec * scan.points().size() / 1e6
+              << std::setw(7) << shape.peaks_nm
+              << std::setw(9) << 100 * shape.basin_share
+              << 100 * shape.best_pose_offset
+              << std::defaultfloat << std::endl;
+  }
+}
+
+void run_closed_corridor_case(const EvaluationParams &ep) {
   std::cout << "[1] Closed Corridor" << std::endl;
   auto map = UnboundedPlainGridMap{std::make_shared<LastWriteWinsGridCell>(),
                                    {100, 100, 0.1}};
@@ -75,18 +356,13 @@ void run_closed_corridor_case() {
   auto p = CecumTextRasterMapPrimitive{
     20, 40, CecumTextRasterMapPrimitive::BoundPosition::Bot};
   GridMapPatcher{}.apply_text_raster(map, p.to_stream(), {-20, -9}, 1, 1);
-  for (int x = -20; x < 0; x++) {
-    for (int y = -8; y < 10; y++) {
-      map.update({x, y}, {false, {0, 0}, {0, 0}, 1});
-    }
-  }
+  map.update_area({-20, -8}, {-1, 9}, {false, {0, 0}, {0, 0}, 1});
 
-  GridMapToPgmDumber<decltype(map)>{"input_map"}.on_map_update(map);
-  // TODO: dump scan
-  run_evaluation(map, 0.01);
+  GridMapToPgmDumber<decltype(map)>{"closed_corridor_map"}.on_map_update(map);
+  run_evaluation("closed_corridor", map, ep);
 }
 
-void run_open_corridor_case() {
+void run_open_corridor_case(const EvaluationParams &ep) {
   std::cout << "[2] Open Corridor" << std::endl;
   auto map = UnboundedPlainGridMap{std::make_shared<LastWriteWinsGridCell>(),
                                    {100, 100, 0.1}};
@@ -95,28 +371,13 @@ void run_open_corridor_case() {
   GridMapPatcher{}.apply_text_raster(map, primitive.to_stream(),
                                      {-40, 10}, 1, 1);
   // FIXME: none bounded case
-  for (int y = -8; y < 10; y++) {
-    map.update({39, y}, {false, {0, 0}, {0, 0}, 1});
-  }
-  
-  // auto pr = CecumTextRasterMapPrimitive{
-  //   20, 40, CecumTextRasterMapPrimitive::BoundPosition::Top};
-  // GridMapPatcher{}.apply_text_raster(map, pr.to_stream(), {-20, 49}, 1, 1);
-  // auto p = CecumTextRasterMapPrimitive{
-  //   20, 40, CecumTextRasterMapPrimitive::BoundPosition::Bot};
-  // GridMapPatcher{}.apply_text_raster(map, p.to_stream(), {-20, -9}, 1, 1);
-  // for (int x = -20; x < 0; x++) {
-  //   for (int y = -8; y < 10; y++) {
-  //     map.update({x, y}, {false, {0, 0}, {0, 0}, 1});
-  //   }
-  // }
-
-  GridMapToPgmDumber<decltype(map)>{"input_map"}.on_map_update(map);
-  // TODO: dump scan
-  run_evaluation(map, 0.01);
+  map.update_area({39, -8}, {39, 9}, {false, {0, 0}, {0, 0}, 1});
+
+  GridMapToPgmDumber<decltype(map)>{"open_corridor_map"}.on_map_update(map);
+  run_evaluation("open_corridor", map, ep);
 }
 
-void run_several_corridors_case() {
+void run_several_corridors_case(const EvaluationParams &ep) {
   std::cout << "[3] Several Corridors" << std::endl;
   auto map = UnboundedPlainGridMap{std::make_shared<LastWriteWinsGridCell>(),
                                    {100, 100, 0.1}};
@@ -125,59 +386,19 @@ void run_several_corridors_case() {
   GridMapPatcher{}.apply_text_raster(map, primitive.to_stream(), {0, 2}, 1, 1);
   GridMapPatcher{}.apply_text_raster(map, primitive.to_stream(), {0, 7}, 1, 1);
 
-
-  GridMapToPgmDumber<decltype(map)>{"input_map"}.on_map_update(map);
-  // TODO: dump scan
-  run_evaluation(map, 0.01);
+  GridMapToPgmDumber<decltype(map)>{"several_corridors_map"}
+    .on_map_update(map);
+  run_evaluation("several_corridors", map, ep);
 }
 
 int main(int argc, char **argv) {
-  run_closed_corridor_case();
-  run_open_corridor_case();
-  run_several_corridors_case();
-  return 0;
-}
+  auto ep = EvaluationParams{};
+  if (1 < argc) { ep.threads_nm = std::max(1ul, std::stoul(argv[1])); }
+  if (2 < argc) { ep.max_rotation = std::stod(argv[2]); }
+  if (3 < argc) { ep.rotation_step = std::stod(argv[3]); }
 
-void dump_scan(const LaserScan2D &scan, const RobotPose &pose) {
-  auto map = UnboundedPlainGridMap{std::make_shared<LastWriteWinsGridCell>(),
-                                   {100, 100, 0.1}};
-  auto scan_adder = WallDistanceBlurringScanAdder::builder()
-    .set_occupancy_estimator(
-      std::make_shared<ConstOccupancyEstimator>(Occupancy{1.0, 1.0},
-                                                Occupancy{0.0, 1.0}))
-    .build();
-  scan_adder->append_scan(map, pose, scan, 1.0);
-  GridMapToPgmDumber<decltype(map)>{"scan"}.on_map_update(map);
-}
-
-void run_evaluation(const GridMap &map, double resolution) {
-  auto sssb = std::make_shared<ScanMatcherSearchSpaceBuilder>(resolution);
-  auto tscan = TransformedLaserScan{};
-  tscan.pose_delta = RobotPoseDelta{};
-  // FIXME: scan generation from 0, 0
-  tscan.scan = LaserScanGenerator{to_lsp(100, 270, 1000)}
-                       .laser_scan_2D(map, {0.05, 0.05, 0}, 1);
-  dump_scan(tscan.scan, {0.05, 0.05, 0});
-  // generate plan brute force search space map
-  auto bfsm = BruteForceScanMatcher{
-    std::make_shared<WeightedMeanPointProbabilitySPE>(
-      std::make_shared<ObstacleBasedOccupancyObservationPE>(),
-      std::make_shared<EvenSPW>()
-     ),
-    -1, 1, resolution,
-    -1, 1, resolution,
-    0, 0, 0.1}; // TODO: rotation; FIXME: hand if delta is 0; accurate poses
-  bfsm.subscribe(sssb);
-  
-  auto result = RobotPoseDelta{};
-  auto start_time = std::chrono::high_resolution_clock::now();
-  bfsm.process_scan(tscan, RobotPose{0.05, 0.05, 0}, map, result);
-  auto end_time = std::chrono::high_resolution_clock::now();
-  auto diff = std::chrono::duration<double>(end_time - start_time);
-  std::cout << "BF: " << diff.count() << std::endl;
-  
-  GridMapToPgmDumber<GridMap>{"sss_map"}
-    .on_map_update(*(sssb->map()));
-
-  // TODO: generate testee search space map
+  run_closed_corridor_case(ep);
+  run_open_corridor_case(ep);
+  run_several_corridors_case(ep);
+  return 0;
 }
@@ -82,6 +82,11 @@ public:
     _props += parse_file(path);
   }
 
+  // NB: unlike file content, the value replaces a set one
+  void set_property(const std::string &id, const std::string &value) {
+    _props.set_property(id, value);
+  }
+
   int get_int(const std::string &id, int dflt) const override {
     return _props.get_int(id, dflt);
   }
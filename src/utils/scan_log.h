@@ -0,0 +1,164 @@
+#ifndef SLAM_CTOR_UTILS_SCAN_LOG_H
+#define SLAM_CTOR_UTILS_SCAN_LOG_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../core/states/robot_pose.h"
+
+/* A binary log of laser scans synchronized with odometry, e.g. extracted
+ * from a bag once to be replayed many times (see bag_to_scan_log).
+ * Format: a file header followed by records; a record is a fixed-size
+ * header followed by float ranges padded to 8 bytes, so the whole file
+ * is a sequence of aligned plain values.
+ * NB: values are kept in the host byte order. */
+
+struct ScanLogFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct ScanLogRecordHeader {
+  // the scan timestamp
+  uint32_t sec, nsec;
+  // the odometry pose of the scan
+  double x, y, theta;
+  float angle_min, angle_max, angle_increment;
+  float range_min, range_max;
+  uint32_t ranges_nm;
+};
+
+static_assert(std::is_trivially_copyable<ScanLogRecordHeader>::value &&
+              sizeof(ScanLogRecordHeader) % 8 == 0,
+              "A record header is expected to keep ranges aligned");
+
+struct ScanLogRecord {
+  const ScanLogRecordHeader *header;
+  // NB: points to the log's memory, i.e. valid while the log is open
+  const float *ranges;
+
+  RobotPose pose() const {
+    return RobotPose(header->x, header->y, header->theta);
+  }
+};
+
+class ScanLogFormat {
+public:
+  static constexpr const char *Magic = "SCANLOG";
+  static constexpr uint32_t Version = 1;
+
+  static std::size_t ranges_size(uint32_t ranges_nm) {
+    return (ranges_nm * sizeof(float) + 7) / 8 * 8;
+  }
+};
+
+class ScanLogWriter {
+public:
+  explicit ScanLogWriter(const std::string &fname)
+    : _out{fname, std::ios::binary} {
+    auto header = ScanLogFileHeader{};
+    std::strncpy(header.magic, ScanLogFormat::Magic, sizeof(header.magic));
+    header.version = ScanLogFormat::Version;
+    write(&header, sizeof(header));
+  }
+
+  bool is_valid() const { return bool(_out); }
+
+  void add_record(const ScanLogRecordHeader &header, const float *ranges) {
+    write(&header, sizeof(header));
+    write(ranges, header.ranges_nm * sizeof(float));
+    auto padding = ScanLogFormat::ranges_size(header.ranges_nm) -
+                   header.ranges_nm * sizeof(float);
+    static const char Zeros[8] = {};
+    write(Zeros, padding);
+  }
+
+private: // methods
+
+  void write(const void *data, std::size_t size) {
+    _out.write(reinterpret_cast<const char*>(data), size);
+  }
+
+private: // fields
+  std::ofstream _out;
+};
+
+/* Reads records of a scan log mapped to memory.
+ * PERFORMANCE: ranges are not copied and not parsed, a record is
+ *              a pointer to the mapped file, so a replay is limited by
+ *              memory (or page cache) bandwidth rather than decoding. */
+class ScanLogReader {
+public:
+  explicit ScanLogReader(const std::string &fname) {
+    auto fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0) { return; }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 &&
+        sizeof(ScanLogFileHeader) <= std::size_t(st.st_size)) {
+      auto data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        _data = static_cast<const char*>(data);
+        _size = st.st_size;
+        ::madvise(data, _size, MADV_SEQUENTIAL);
+      }
+    }
+    ::close(fd);
+    if (!_data) { return; }
+
+    auto header = reinterpret_cast<const ScanLogFileHeader*>(_data);
+    if (std::strncmp(header->magic, ScanLogFormat::Magic,
+                     sizeof(header->magic)) != 0 ||
+        header->version != ScanLogFormat::Version) {
+      unmap();
+      return;
+    }
+    _offset = sizeof(ScanLogFileHeader);
+  }
+
+  ~ScanLogReader() { unmap(); }
+
+  ScanLogReader(const ScanLogReader&) = delete;
+  ScanLogReader& operator=(const ScanLogReader&) = delete;
+
+  bool is_valid() const { return _data != nullptr; }
+
+  // NB: a truncated record ends the log
+  bool next(ScanLogRecord &record) {
+    if (!_data || _size < _offset + sizeof(ScanLogRecordHeader)) {
+      return false;
+    }
+    auto header = reinterpret_cast<const ScanLogRecordHeader*>(
+      _data + _offset);
+    auto record_size = sizeof(ScanLogRecordHeader) +
+                       ScanLogFormat::ranges_size(header->ranges_nm);
+    if (_size < _offset + record_size) { return false; }
+
+    record.header = header;
+    record.ranges = reinterpret_cast<const float*>(header + 1);
+    _offset += record_size;
+    return true;
+  }
+
+private: // methods
+
+  void unmap() {
+    if (!_data) { return; }
+    ::munmap(const_cast<char*>(_data), _size);
+    _data = nullptr;
+  }
+
+private: // fields
+  const char *_data = nullptr;
+  std::size_t _size = 0, _offset = 0;
+};
+
+#endif
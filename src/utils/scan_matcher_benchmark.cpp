@@ -0,0 +1,355 @@
+/* Compares scan matchers (hill climbing, monte carlo, fixed hill climbing,
+ * brute force, brute force multi-resolution with and without a score
+ * pyramid, i.e. M3RSM) on synthetic worlds: a corridor, a cecum and
+ * a cluttered room. A scan is generated from a known pose of a world and
+ * every matcher corrects each initial pose of a grid of pose errors.
+ * Reported per world and matcher:
+ *   - scan probability estimations (SPE calls) per scan;
+ *   - wall time per scan;
+ *   - the distribution (50th, 90th percentiles and max) of residual
+ *     errors, i.e. errors of corrected poses, and the share of corrections
+ *     within a cell and a degree of the actual pose.
+ * NB: all worlds and matchers are seeded, so runs are reproducible and
+ *     a matcher speedup may be checked not to cost accuracy.
+ * Usage: scan_matcher_benchmark [errors_per_dim [max_translation_error
+ *                                                [max_rotation_error_deg]]]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#include "../core/maps/grid_cell.h"
+#include "../core/maps/plain_grid_map.h"
+#include "../core/maps/rescalable_caching_grid_map.h"
+#include "data_generation/map_primitives.h"
+#include "data_generation/grid_map_patcher.h"
+#include "data_generation/laser_scan_generator.h"
+
+#include "../core/scan_matchers/occupancy_observation_probability.h"
+#include "../core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "../core/scan_matchers/hill_climbing_scan_matcher.h"
+#include "../core/scan_matchers/monte_carlo_scan_matcher.h"
+#include "../core/scan_matchers/hcsm_fixed.h"
+#include "../core/scan_matchers/brute_force_scan_matcher.h"
+#include "../core/scan_matchers/bf_multi_res_scan_matcher.h"
+
+// FIXME: code duplication with tests's MockGridCell
+class LastWriteWinsGridCell : public GridCell {
+public:
+  LastWriteWinsGridCell(double prob = 0.5) : GridCell{Occupancy{prob, 0}} {}
+  std::unique_ptr<GridCell> clone() const override {
+    return std::make_unique<LastWriteWinsGridCell>(*this);
+  }
+  void operator+= (const AreaOccupancyObservation &aoo) override {
+    _occupancy = aoo.occupancy;
+  }
+};
+
+/* A closed room with obstacles of a cell at random positions;
+ * the center of the room is kept free. */
+class ClutteredRoomTextRasterMapPrimitive : public TextRasterMapPrimitive {
+public:
+  ClutteredRoomTextRasterMapPrimitive(int w, int h, double clutter_ratio,
+                                      int free_radius, unsigned seed)
+    : _width{w}, _height{h} {
+    auto rnd_engine = std::mt19937{seed};
+    auto is_obstacle_rv = std::bernoulli_distribution{clutter_ratio};
+    for (int row_i = 0; row_i < h; ++row_i) {
+      for (int col_i = 0; col_i < w; ++col_i) {
+        bool is_wall = row_i == 0 || row_i == h - 1 ||
+                       col_i == 0 || col_i == w - 1;
+        bool is_center = std::abs(row_i - h / 2) <= free_radius &&
+                         std::abs(col_i - w / 2) <= free_radius;
+        bool is_occ = is_wall || (!is_center && is_obstacle_rv(rnd_engine));
+        _raster += is_occ ? Completely_Occupied_Marker
+                          : Completely_Free_Marker;
+      }
+      _raster += Row_End_Marker;
+    }
+  }
+
+  int width() const override { return _width; };
+  int height() const override { return _height; };
+protected: // methods
+  std::string text_raster() const override { return _raster; };
+private: // fields
+  int _width, _height;
+  std::string _raster;
+};
+
+/* Counts scan probability estimations of a wrapped estimator. */
+class CountingSPE : public ScanProbabilityEstimator {
+public:
+  CountingSPE(std::shared_ptr<ScanProbabilityEstimator> spe)
+    : ScanProbabilityEstimator{
+        spe->occupancy_observation_probability_estimator()}
+    , _spe{spe} {}
+
+  std::size_t estimations_nm() const { return _estimations_nm; }
+
+  LaserScan2D filter_scan(const LaserScan2D &scan, const RobotPose &pose,
+                          const GridMap &map) override {
+    return _spe->filter_scan(scan, pose, map);
+  }
+
+  LaserScan2D prefilter_scan(const LaserScan2D &scan) override {
+    return _spe->prefilter_scan(scan);
+  }
+
+  double estimate_scan_probability(const LaserScan2D &scan,
+                                   const RobotPose &pose,
+                                   const GridMap &map,
+                                   const SPEParams &params) const override {
+    ++_estimations_nm;
+    return _spe->estimate_scan_probability(scan, pose, map, params);
+  }
+
+  void estimate_scan_probabilities(const LaserScan2D &scan,
+                                   const RobotPose *poses, std::size_t n,
+                                   const GridMap &map,
+                                   const SPEParams &params,
+                                   double *probabilities) const override {
+    _estimations_nm += n;
+    _spe->estimate_scan_probabilities(scan, poses, n, map, params,
+                                      probabilities);
+  }
+
+  bool supports_concurrent_estimations(
+      const LaserScan2D &scan, const SPEParams &params) const override {
+    return _spe->supports_concurrent_estimations(scan, params);
+  }
+
+  bool scores_points_by_cells() const override {
+    return _spe->scores_points_by_cells();
+  }
+
+private: // fields
+  std::shared_ptr<ScanProbabilityEstimator> _spe;
+  mutable std::atomic<std::size_t> _estimations_nm{0};
+};
+
+using WorldMap = RescalableCachingGridMap<UnboundedPlainGridMap>;
+
+struct World {
+  std::string name;
+  std::shared_ptr<WorldMap> map;
+  RobotPose pose;
+};
+
+struct BenchmarkParams {
+  double meters_per_cell = 0.125;
+  // laser scanner
+  double ls_max_dist = 15;  // meters
+  double ls_fow = 270;      // degrees
+  unsigned ls_pts_nm = 360;
+  // initial pose errors are a grid of [-max, max] with errors_per_dim
+  // errors per dimension (an odd number includes the error-free pose)
+  unsigned errors_per_dim = 5;
+  double max_translation_error = 0.2;  // meters
+  double max_rotation_error = 4;       // degrees
+  // a correction is successful if it is within the error of the pose
+  double acceptable_rotation_error = 1;  // degrees
+};
+
+using ScanMatcherFactory = std::function<
+  std::shared_ptr<GridScanMatcher>(std::shared_ptr<ScanProbabilityEstimator>,
+                                   const BenchmarkParams&)>;
+
+struct ScanMatcherCase {
+  std::string name;
+  ScanMatcherFactory make;
+};
+
+template <typename Action>
+double measure_ms(Action action) {
+  auto start = std::chrono::high_resolution_clock::now();
+  action();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// NB: the pose is set to the center of the given cell
+World make_world(const std::string &name, const TextRasterMapPrimitive &mp,
+                 const DiscretePoint2D &pose_cell, double theta,
+                 const BenchmarkParams &bp) {
+  auto map = std::make_shared<WorldMap>(
+    std::make_shared<LastWriteWinsGridCell>(),
+    GridMapParams{100, 100, bp.meters_per_cell});
+  GridMapPatcher{}.apply_text_raster(*map, mp.to_stream(), {}, 1, 1);
+  auto pose = RobotPose{(pose_cell.x + 0.5) * bp.meters_per_cell,
+                        (pose_cell.y + 0.5) * bp.meters_per_cell, theta};
+  return World{name, map, pose};
+}
+
+std::vector<World> make_worlds(const BenchmarkParams &bp) {
+  using CecumMp = CecumTextRasterMapPrimitive;
+  auto worlds = std::vector<World>{};
+  // NB: a primitive's top-left cell is (0, 0), rows go down
+  worlds.push_back(make_world(
+    "corridor", CecumMp{40, 5, CecumMp::BoundPosition::Right},
+    {20, -2}, deg2rad(10), bp));
+  worlds.push_back(make_world(
+    "cecum", CecumMp{15, 13, CecumMp::BoundPosition::Top},
+    {7, -12}, deg2rad(90), bp));
+  worlds.push_back(make_world(
+    "cluttered-room", ClutteredRoomTextRasterMapPrimitive{30, 30, 0.03, 3, 42},
+    {15, -15}, deg2rad(30), bp));
+  return worlds;
+}
+
+std::vector<ScanMatcherCase> make_scan_matcher_cases() {
+  using SPE = std::shared_ptr<ScanProbabilityEstimator>;
+  using BP = BenchmarkParams;
+  auto bfmr = [](SPE spe, const BP &bp, bool uses_score_pyramid) {
+    auto sm = std::make_shared<BruteForceMultiResolutionScanMatcher>(
+      spe, deg2rad(0.5), bp.meters_per_cell / 2);
+    sm->set_lookup_ranges(1.25 * bp.max_translation_error,
+                          1.25 * bp.max_translation_error,
+                          deg2rad(1.25 * bp.max_rotation_error));
+    sm->set_uses_score_pyramid(uses_score_pyramid);
+    return sm;
+  };
+  return {
+    {"HC", [](SPE spe, const BP &) {
+      return std::make_shared<HillClimbingScanMatcher>(spe, 6, 0.1, 0.1);
+    }},
+    {"MC", [](SPE spe, const BP &) {
+      return std::make_shared<MonteCarloScanMatcher>(spe, 42, 0.1, 0.1,
+                                                     20, 100);
+    }},
+    {"HC-fixed", [](SPE spe, const BP &) {
+      return std::make_shared<HillClimbingSMFixed>(spe);
+    }},
+    {"BF", [](SPE spe, const BP &bp) {
+      auto max_t = 1.25 * bp.max_translation_error;
+      auto max_r = deg2rad(1.25 * bp.max_rotation_error);
+      return std::make_shared<BruteForceScanMatcher>(
+        spe, -max_t, max_t, bp.meters_per_cell / 2,
+        -max_t, max_t, bp.meters_per_cell / 2,
+        -max_r, max_r, deg2rad(0.5));
+    }},
+    {"BFMR", [bfmr](SPE spe, const BP &bp) { return bfmr(spe, bp, false); }},
+    {"BFMR-pyramid (M3RSM)", [bfmr](SPE spe, const BP &bp) {
+      return bfmr(spe, bp, true);
+    }},
+  };
+}
+
+std::vector<RobotPoseDelta> make_pose_errors(const BenchmarkParams &bp) {
+  auto errors = std::vector<RobotPoseDelta>{};
+  auto n = std::max(bp.errors_per_dim, 1u);
+  auto error_at = [n](double max_error, unsigned i) {
+    return n == 1 ? 0 : -max_error + 2 * max_error * i / (n - 1);
+  };
+  for (unsigned x_i = 0; x_i < n; ++x_i) {
+    for (unsigned y_i = 0; y_i < n; ++y_i) {
+      for (unsigned t_i = 0; t_i < n; ++t_i) {
+        errors.emplace_back(error_at(bp.max_translation_error, x_i),
+                            error_at(bp.max_translation_error, y_i),
+                            deg2rad(error_at(bp.max_rotation_error, t_i)));
+      }
+    }
+  }
+  return errors;
+}
+
+// NB: the values are sorted
+double percentile(const std::vector<double> &values, double p) {
+  if (values.empty()) { return 0; }
+  auto i = static_cast<std::size_t>(std::ceil(p * values.size()));
+  return values[std::min(std::max(i, std::size_t{1}), values.size()) - 1];
+}
+
+void run_benchmark(const World &world, const ScanMatcherCase &smc,
+                   const TransformedLaserScan &scan,
+                   const std::vector<RobotPoseDelta> &pose_errors,
+                   const BenchmarkParams &bp) {
+  auto spe = std::make_shared<CountingSPE>(
+    std::make_shared<WeightedMeanPointProbabilitySPE>(
+      std::make_shared<MaxOccupancyObservationPE>(),
+      std::make_shared<EvenSPW>()));
+  auto sm = smc.make(spe, bp);
+
+  auto transl_residuals = std::vector<double>{};
+  auto rot_residuals = std::vector<double>{};
+  std::size_t successes_nm = 0;
+  double total_ms = 0;
+  for (auto &error : pose_errors) {
+    auto correction = RobotPoseDelta{};
+    total_ms += measure_ms([&]() {
+      sm->process_scan(scan, world.pose + error, *world.map, correction);
+    });
+    auto residual = error + correction;
+    auto transl_residual = std::sqrt(residual.x * residual.x +
+                                     residual.y * residual.y);
+    auto rot_residual = std::abs(rad2deg(residual.theta));
+    transl_residuals.push_back(transl_residual);
+    rot_residuals.push_back(rot_residual);
+    if (transl_residual <= bp.meters_per_cell &&
+        rot_residual <= bp.acceptable_rotation_error) {
+      ++successes_nm;
+    }
+  }
+  std::sort(transl_residuals.begin(), transl_residuals.end());
+  std::sort(rot_residuals.begin(), rot_residuals.end());
+
+  auto scans_nm = pose_errors.size();
+  std::cout << std::setw(22) << std::left << smc.name
+            << std::fixed << std::setprecision(1)
+            << std::setw(10) << double(spe->estimations_nm()) / scans_nm
+            << std::setprecision(2)
+            << std::setw(10) << total_ms / scans_nm
+            << std::setprecision(1);
+  // translation residuals are in centimeters
+  for (auto p : {0.5, 0.9, 1.0}) {
+    std::cout << std::setw(7) << 100 * percentile(transl_residuals, p);
+  }
+  std::cout << std::setprecision(2);
+  for (auto p : {0.5, 0.9, 1.0}) {
+    std::cout << std::setw(7) << percentile(rot_residuals, p);
+  }
+  std::cout << std::setprecision(1)
+            << 100.0 * successes_nm / scans_nm
+            << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char **argv) {
+  auto bp = BenchmarkParams{};
+  if (1 < argc) { bp.errors_per_dim = std::stoul(argv[1]); }
+  if (2 < argc) { bp.max_translation_error = std::stod(argv[2]); }
+  if (3 < argc) { bp.max_rotation_error = std::stod(argv[3]); }
+
+  auto pose_errors = make_pose_errors(bp);
+  auto sm_cases = make_scan_matcher_cases();
+  for (auto &world : make_worlds(bp)) {
+    auto scan = TransformedLaserScan{};
+    scan.pose_delta = RobotPoseDelta{};
+    scan.scan = LaserScanGenerator{
+      to_lsp(bp.ls_max_dist, bp.ls_fow, bp.ls_pts_nm)
+    }.laser_scan_2D(*world.map, world.pose, 1);
+    scan.quality = 1.0;
+
+    std::cout << "== " << world.name << ": " << scan.scan.points().size()
+              << " scan points, " << pose_errors.size()
+              << " initial pose errors up to " << bp.max_translation_error
+              << " m, " << bp.max_rotation_error << " deg ==" << std::endl;
+    std::cout << std::setw(22) << std::left << "matcher"
+              << std::setw(10) << "spe/scan" << std::setw(10) << "ms/scan"
+              << std::setw(21) << "cm p50/p90/max"
+              << std::setw(21) << "deg p50/p90/max"
+              << "ok,%" << std::endl;
+    for (auto &smc : sm_cases) {
+      run_benchmark(world, smc, scan, pose_errors, bp);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+/* Compares tile geometries (size, cells layout) of lazy tiled grid maps
+ * on access patterns typical for the framework:
+ *   - beam rasterization (world_to_cells) with cells update
+ *     (scan insertion);
+ *   - reading small square neighbourhoods of a point
+ *     (MaxOccupancyObservationPE).
+ * Usage: tiled_grid_map_benchmark [meters_per_cell, ...]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "../core/maps/grid_cell.h"
+#include "../core/maps/lazy_tiled_grid_map.h"
+#include "../core/maps/grid_rasterization.h"
+
+// FIXME: code duplication with tests's MockGridCell
+class LastWriteWinsGridCell : public GridCell {
+public:
+  LastWriteWinsGridCell(double prob = 0.5) : GridCell{Occupancy{prob, 0}} {}
+  std::unique_ptr<GridCell> clone() const override {
+    return std::make_unique<LastWriteWinsGridCell>(*this);
+  }
+  void operator+= (const AreaOccupancyObservation &aoo) override {
+    _occupancy = aoo.occupancy;
+  }
+};
+
+struct BenchmarkParams {
+  double meters_per_cell;
+  double world_side = 40;       // meters
+  double max_beam_length = 8;   // meters
+  unsigned scans_nm = 100, beams_per_scan_nm = 360;
+  unsigned neighbourhoods_nm = 2000000;
+  double neighbourhood_side = 3; // cells
+};
+
+template <typename Action>
+double measure_ms(Action action) {
+  auto start = std::chrono::high_resolution_clock::now();
+  action();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template <typename MapT>
+void run_benchmark(const std::string &name, const BenchmarkParams &bp) {
+  auto map = MapT{std::make_shared<LastWriteWinsGridCell>(),
+                  {1, 1, bp.meters_per_cell}};
+  auto rnd_engine = std::mt19937{42};
+  auto half_side = bp.world_side / 2;
+  auto coord_rv = std::uniform_real_distribution<double>{-half_side,
+                                                         half_side};
+  auto angle_rv = std::uniform_real_distribution<double>{-M_PI, M_PI};
+  auto range_rv = std::uniform_real_distribution<double>{0.1,
+                                                         bp.max_beam_length};
+
+  auto insertion_ms = measure_ms([&]() {
+    auto beam_area_ids = std::vector<typename MapT::Coord>{};
+    for (unsigned scan_i = 0; scan_i < bp.scans_nm; ++scan_i) {
+      auto robot = Point2D{coord_rv(rnd_engine), coord_rv(rnd_engine)};
+      for (unsigned beam_i = 0; beam_i < bp.beams_per_scan_nm; ++beam_i) {
+        auto th = angle_rv(rnd_engine), r = range_rv(rnd_engine);
+        auto obstacle = Point2D{robot.x + r * std::cos(th),
+                                robot.y + r * std::sin(th)};
+        auto aoo = AreaOccupancyObservation{false, {0.2, 1}, obstacle, 1};
+        map.world_to_cells({robot, obstacle}, beam_area_ids);
+        for (auto &area_id : beam_area_ids) {
+          map.update(area_id, aoo);
+        }
+      }
+    }
+  });
+
+  double total_occ = 0;
+  auto hw = bp.neighbourhood_side * bp.meters_per_cell / 2;
+  auto reading_ms = measure_ms([&]() {
+    for (unsigned i = 0; i < bp.neighbourhoods_nm; ++i) {
+      auto x = coord_rv(rnd_engine), y = coord_rv(rnd_engine);
+      auto area_ids = GridRasterizedRectangle{
+        map, LightWeightRectangle{y - hw, y + hw, x - hw, x + hw}};
+      while (area_ids.has_next()) {
+        total_occ += map[area_ids.next()];
+      }
+    }
+  });
+
+  std::cout << std::setw(20) << std::left << name
+            << " insertion: " << std::setw(8) << insertion_ms << " ms;"
+            << " neighbourhoods: " << std::setw(8) << reading_ms << " ms"
+            << " (checksum " << total_occ << ")" << std::endl;
+}
+
+template <unsigned TileSizeBits>
+void run_tile_size_benchmarks(const BenchmarkParams &bp) {
+  using Cell = LastWriteWinsGridCell;
+  auto suffix = std::to_string(1 << TileSizeBits);
+  run_benchmark<UnboundedValueLazyTiledGridMap<
+    Cell, TileSizeBits, ColumnMajorTileLayout>>("column-major/" + suffix, bp);
+  run_benchmark<UnboundedValueLazyTiledGridMap<
+    Cell, TileSizeBits, MortonTileLayout>>("morton/" + suffix, bp);
+}
+
+int main(int argc, char **argv) {
+  auto scales = std::vector<double>{};
+  for (int i = 1; i < argc; ++i) { scales.push_back(std::stod(argv[i])); }
+  if (scales.empty()) { scales = {0.05, 0.1}; }
+
+  for (auto scale : scales) {
+    auto bp = BenchmarkParams{};
+    bp.meters_per_cell = scale;
+    std::cout << "== " << scale << " meters per cell ==" << std::endl;
+    run_tile_size_benchmarks<5>(bp);
+    run_tile_size_benchmarks<6>(bp);
+    run_tile_size_benchmarks<7>(bp);
+    run_tile_size_benchmarks<8>(bp);
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+// the test is built in the allocation tracking mode
+#define SLAM_CTOR_TRACK_ALLOCATIONS
+#include "../../src/utils/allocation_tracking.h"
+#include "../../src/core/stage_profiler.h"
+
+class AllocationTrackingTest : public ::testing::Test {
+protected: // types
+  struct ProfileCollector : public StageProfileObserver {
+    void on_stage_profile(const StageProfile &profile) override {
+      profiles.push_back(profile);
+    }
+    std::vector<StageProfile> profiles;
+  };
+protected: // methods
+  // NB: allocations are kept, so they are not elided by a compiler
+  void allocate(std::size_t bytes) {
+    kept.push_back(std::make_unique<std::vector<char>>(bytes));
+  }
+protected: // fields
+  std::vector<std::unique_ptr<std::vector<char>>> kept;
+};
+
+TEST_F(AllocationTrackingTest, allocationsOfThreadAreCounted) {
+  kept.reserve(2);
+  auto start = thread_allocation_count();
+  allocate(100);
+  auto allocs = thread_allocation_count() - start;
+  // the vector object and its buffer
+  ASSERT_EQ(2u, allocs.allocs_nm);
+  ASSERT_EQ(sizeof(std::vector<char>) + 100, allocs.bytes);
+}
+
+TEST_F(AllocationTrackingTest, allocationsOfOtherThreadsAreNotCounted) {
+  auto start = thread_allocation_count();
+  std::thread{[]() { std::make_unique<std::vector<char>>(100); }}.join();
+  auto allocs = thread_allocation_count() - start;
+  // NB: the thread state may be allocated by the parent thread
+  ASSERT_GE(1u, allocs.allocs_nm);
+}
+
+TEST_F(AllocationTrackingTest, stageAllocationsAreReported) {
+  kept.reserve(4);
+  auto profiler = std::make_shared<StageProfiler>(1e-9);
+  auto collector = std::make_shared<ProfileCollector>();
+  profiler->subscribe(collector);
+  // NB: the first cycle starts the measurement of scans
+  profiler->finish_cycle();
+  {
+    StageTimer timer{profiler, SlamStage::ScanMatching};
+    allocate(10);
+  }
+  {
+    StageTimer timer{profiler, SlamStage::MapInsertion};
+  }
+  allocate(10);
+  profiler->finish_cycle();
+
+  ASSERT_EQ(2u, collector->profiles.size());
+  auto &profile = collector->profiles.back();
+  auto stage_allocs = [&profile](SlamStage stage) {
+    return profile.stage_allocations[static_cast<std::size_t>(stage)];
+  };
+  ASSERT_EQ(2u, stage_allocs(SlamStage::ScanMatching).allocs_nm);
+  ASSERT_EQ(0u, stage_allocs(SlamStage::MapInsertion).allocs_nm);
+  ASSERT_EQ(2.0, profile.stage_allocs_per_scan(
+                   static_cast<std::size_t>(SlamStage::ScanMatching)));
+  ASSERT_EQ(1u, profile.allocation_scans_nm);
+  // allocations outside stages belong to the scan
+  ASSERT_LE(4u, profile.scan_allocations.allocs_nm);
+  ASSERT_EQ(profile.scan_allocations.allocs_nm, profile.max_scan_allocs_nm);
+  ASSERT_EQ(double(profile.max_scan_allocs_nm),
+            profile.allocs_per_scan(profile.scan_allocations.allocs_nm));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../src/core/bounded_buffer.h"
+
+class BoundedBufferTest : public ::testing::Test {
+protected: // methods
+  static void sleep_ms(unsigned ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+};
+
+TEST_F(BoundedBufferTest, valuesArePoppedInPushOrder) {
+  BoundedBuffer<int> buffer{3};
+  auto producer = std::thread{[&buffer]() {
+    for (int i = 0; i != 100; ++i) { buffer.push(i); }
+    buffer.close();
+  }};
+
+  auto values = std::vector<int>{};
+  auto value = int{0};
+  while (buffer.pop(value)) { values.push_back(value); }
+  producer.join();
+
+  ASSERT_EQ(100u, values.size());
+  for (int i = 0; i != 100; ++i) {
+    ASSERT_EQ(i, values[i]);
+  }
+}
+
+TEST_F(BoundedBufferTest, pushBlocksWhileFull) {
+  BoundedBuffer<int> buffer{2};
+  ASSERT_TRUE(buffer.push(0));
+  ASSERT_TRUE(buffer.push(1));
+
+  std::atomic<bool> is_pushed{false};
+  auto producer = std::thread{[&buffer, &is_pushed]() {
+    buffer.push(2);
+    is_pushed = true;
+  }};
+  sleep_ms(20);
+  ASSERT_FALSE(is_pushed);
+
+  auto value = int{-1};
+  ASSERT_TRUE(buffer.pop(value));
+  ASSERT_EQ(0, value);
+  producer.join();
+  ASSERT_TRUE(is_pushed);
+}
+
+TEST_F(BoundedBufferTest, closeReleasesBlockedPushAndKeepsValues) {
+  BoundedBuffer<int> buffer{1};
+  ASSERT_TRUE(buffer.push(7));
+
+  std::atomic<bool> is_rejected{false};
+  auto producer = std::thread{[&buffer, &is_rejected]() {
+    is_rejected = !buffer.push(8);
+  }};
+  sleep_ms(20);
+  buffer.close();
+  producer.join();
+  ASSERT_TRUE(is_rejected);
+
+  // the pushed value is still available, then the buffer is exhausted
+  auto value = int{0};
+  ASSERT_TRUE(buffer.pop(value));
+  ASSERT_EQ(7, value);
+  ASSERT_FALSE(buffer.pop(value));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../src/core/bounded_task_queue.h"
+
+class BoundedTaskQueueTest : public ::testing::Test {
+protected: // methods
+  static void sleep_ms(unsigned ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+};
+
+TEST_F(BoundedTaskQueueTest, tasksRunInSubmissionOrder) {
+  auto order = std::vector<int>{};
+  BoundedTaskQueue queue{3};
+  for (int i = 0; i != 10; ++i) {
+    queue.push([&order, i]() { order.push_back(i); });
+  }
+  queue.wait_for_idle();
+
+  ASSERT_EQ(10u, order.size());
+  for (int i = 0; i != 10; ++i) {
+    ASSERT_EQ(i, order[i]);
+  }
+}
+
+TEST_F(BoundedTaskQueueTest, pushDoesNotWaitForTaskWhileNotFull) {
+  std::atomic<bool> is_released{false};
+  BoundedTaskQueue queue{2};
+  queue.push([&is_released]() { while (!is_released) { sleep_ms(1); } });
+  // the second task fits the queue, so the push returns immediately
+  std::atomic<bool> is_pushed{false};
+  queue.push([&is_pushed]() { is_pushed = true; });
+  ASSERT_FALSE(is_pushed);
+
+  is_released = true;
+  queue.wait_for_idle();
+  ASSERT_TRUE(is_pushed);
+}
+
+TEST_F(BoundedTaskQueueTest, pushBlocksWhileFull) {
+  std::atomic<bool> is_released{false};
+  BoundedTaskQueue queue{1};
+  queue.push([&is_released]() { while (!is_released) { sleep_ms(1); } });
+
+  std::atomic<bool> is_pushed{false};
+  auto producer = std::thread{[&queue, &is_pushed]() {
+    queue.push([]() {});
+    is_pushed = true;
+  }};
+  sleep_ms(20);
+  ASSERT_FALSE(is_pushed);
+
+  is_released = true;
+  producer.join();
+  ASSERT_TRUE(is_pushed);
+}
+
+TEST_F(BoundedTaskQueueTest, tryPushKeepsTaskWhileFull) {
+  std::atomic<bool> is_released{false};
+  BoundedTaskQueue queue{1};
+  auto blocker = BoundedTaskQueue::Task{[&is_released]() {
+    while (!is_released) { sleep_ms(1); }
+  }};
+  ASSERT_TRUE(queue.try_push(blocker));
+
+  std::atomic<bool> is_done{false};
+  auto task = BoundedTaskQueue::Task{[&is_done]() { is_done = true; }};
+  ASSERT_FALSE(queue.try_push(task));
+  ASSERT_TRUE(bool(task));
+
+  is_released = true;
+  queue.wait_for_idle();
+  ASSERT_TRUE(queue.try_push(task));
+  queue.wait_for_idle();
+  ASSERT_TRUE(is_done);
+}
+
+TEST_F(BoundedTaskQueueTest, destructionFinishesPendingTasks) {
+  std::atomic<unsigned> done_nm{0};
+  {
+    BoundedTaskQueue queue{4};
+    for (int i = 0; i != 4; ++i) {
+      queue.push([&done_nm]() { sleep_ms(1); ++done_nm; });
+    }
+  }
+  ASSERT_EQ(4u, done_nm);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -43,6 +43,13 @@ TEST_F(AHAngleEstimationTest, angle180) {
   test_angle_estimation({5, 3}, {0, 3}, 0);
 }
 
+TEST_F(AHAngleEstimationTest, almostAngle180) {
+  // NB: acos rounds the direction to 180
+  auto angle = AngleHistogram::estimate_ox_based_angle(-5, 1e-12);
+  ASSERT_LE(0, angle);
+  ASSERT_LT(angle, M_PI);
+}
+
 TEST_F(AHAngleEstimationTest, angle225) {
   test_angle_estimation({5, 3}, {-5, -7}, 45);
 }
@@ -59,6 +66,26 @@ TEST_F(AHAngleEstimationTest, angle330) {
   test_angle_estimation({5, 3}, {6, 3 - std::tan(deg2rad(30))}, 150);
 }
 
+TEST(AngleHistogramTest, soaBasedResetMatchesPointBasedOne) {
+  auto scan = LaserScan2D{};
+  for (int i = 0; i < 40; ++i) {
+    auto range = 2 + std::sin(i * 0.7);
+    scan.points().push_back(ScanPoint2D{range, deg2rad(-100 + 5 * i), true});
+  }
+  auto hist = AngleHistogram{};
+  hist.reset(scan);
+  scan.update_soa();
+  auto soa_hist = AngleHistogram{};
+  soa_hist.reset(scan);
+
+  const auto &pts = static_cast<const LaserScan2D&>(scan).points();
+  for (std::size_t i = 0; i < pts.size(); ++i) {
+    ASSERT_EQ(hist.value(pts, i), soa_hist.value(pts, i));
+  }
+  ASSERT_EQ(hist.max_i(), soa_hist.max_i());
+  ASSERT_EQ(hist.major_direction(), soa_hist.major_direction());
+}
+
 //----------------------------------------------------------------------------//
 
 int main (int argc, char *argv[]) {
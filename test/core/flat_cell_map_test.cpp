@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+
+#include "../../src/core/flat_cell_map.h"
+
+class FlatCellMapTest : public ::testing::Test {
+protected: // fields
+  FlatCellMap<int> map;
+};
+
+TEST_F(FlatCellMapTest, emptyMapHasNoCells) {
+  ASSERT_TRUE(map.empty());
+  ASSERT_EQ(nullptr, map.find({0, 0}));
+  ASSERT_FALSE(map.contains({0, 0}));
+}
+
+TEST_F(FlatCellMapTest, emplaceKeepsTheFirstValue) {
+  auto inserted = map.emplace({1, -2}, 5);
+  ASSERT_TRUE(inserted.second);
+  ASSERT_EQ(5, *inserted.first);
+
+  auto present = map.emplace({1, -2}, 7);
+  ASSERT_FALSE(present.second);
+  ASSERT_EQ(5, *present.first);
+  ASSERT_EQ(1u, map.size());
+  ASSERT_FALSE(map.contains({-2, 1}));
+}
+
+TEST_F(FlatCellMapTest, valuesAreUpdatedInPlace) {
+  *map.emplace({3, 3}).first += 2;
+  *map.emplace({3, 3}).first += 2;
+  ASSERT_EQ(4, *map.find({3, 3}));
+}
+
+TEST_F(FlatCellMapTest, clearRemovesCells) {
+  map.emplace({0, 0}, 1);
+  map.emplace({-1, 0}, 2);
+  map.clear();
+  ASSERT_TRUE(map.empty());
+  ASSERT_FALSE(map.contains({0, 0}));
+  ASSERT_FALSE(map.contains({-1, 0}));
+
+  ASSERT_TRUE(map.emplace({-1, 0}, 3).second);
+  ASSERT_EQ(3, *map.find({-1, 0}));
+  ASSERT_EQ(1u, map.size());
+}
+
+TEST_F(FlatCellMapTest, growingKeepsCells) {
+  auto expected = std::map<std::pair<int, int>, int>{};
+  auto rnd_engine = std::mt19937{42};
+  auto coord = std::uniform_int_distribution<int>{-1000, 1000};
+  for (int round = 0; round < 3; ++round) {
+    map.clear();
+    expected.clear();
+    for (int i = 0; i < 5000; ++i) {
+      auto x = coord(rnd_engine), y = coord(rnd_engine);
+      auto is_new = expected.emplace(std::make_pair(x, y), i).second;
+      ASSERT_EQ(is_new, map.emplace({x, y}, i).second);
+    }
+    ASSERT_EQ(expected.size(), map.size());
+    for (auto &cell_value : expected) {
+      auto value = map.find({cell_value.first.first, cell_value.first.second});
+      ASSERT_NE(nullptr, value);
+      ASSERT_EQ(cell_value.second, *value);
+    }
+
+    std::size_t visited_nm = 0;
+    map.for_each([&](const DiscretePoint2D &cell, int value) {
+      ASSERT_EQ(expected.at(std::make_pair(cell.x, cell.y)), value);
+      ++visited_nm;
+    });
+    ASSERT_EQ(expected.size(), visited_nm);
+  }
+}
+
+TEST_F(FlatCellMapTest, setReportsSeenCells) {
+  auto set = FlatCellSet{16};
+  ASSERT_TRUE(set.insert({2, 3}));
+  ASSERT_FALSE(set.insert({2, 3}));
+  ASSERT_TRUE(set.contains({2, 3}));
+  set.clear();
+  ASSERT_FALSE(set.contains({2, 3}));
+  ASSERT_TRUE(set.insert({2, 3}));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
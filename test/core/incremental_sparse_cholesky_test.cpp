@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "../../src/core/incremental_sparse_cholesky.h"
+
+class IncrementalSparseCholeskyTest : public ::testing::Test {
+protected: // types
+  using Matrix = std::vector<std::vector<double>>;
+protected: // methods
+  IncrementalSparseCholeskyTest() : rnd_engine{42} {}
+
+  // A banded matrix with a few far entries (like a trajectory with
+  // loop closures) that is diagonally dominant, i.e. positive definite
+  Matrix random_spd(int n) {
+    auto value_rv = std::uniform_real_distribution<double>{-1, 1};
+    auto index_rv = std::uniform_int_distribution<int>{0, n - 1};
+    auto a = Matrix(n, std::vector<double>(n, 0));
+    auto set = [&a](int i, int j, double v) { a[i][j] = a[j][i] = v; };
+    for (int i = 1; i < n; ++i) { set(i - 1, i, value_rv(rnd_engine)); }
+    for (int k = 0; k < n / 5; ++k) {
+      auto i = index_rv(rnd_engine), j = index_rv(rnd_engine);
+      if (i != j) { set(i, j, value_rv(rnd_engine)); }
+    }
+    for (int i = 0; i < n; ++i) {
+      a[i][i] = 1;
+      for (int j = 0; j < n; ++j) { a[i][i] += i != j ? std::abs(a[i][j]) : 0; }
+    }
+    return a;
+  }
+
+  static void set_columns(IncrementalSparseCholesky &cholesky,
+                          const Matrix &a, int from) {
+    for (int k = from; k < int(a.size()); ++k) {
+      auto &column = cholesky.column(k);
+      column.clear();
+      for (int i = 0; i <= k; ++i) {
+        if (a[i][k] != 0) { column.add(i, a[i][k]); }
+      }
+    }
+  }
+
+  static void assert_solution(const Matrix &a, const std::vector<double> &b,
+                              const std::vector<double> &x) {
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      auto v = double{0};
+      for (std::size_t j = 0; j < a.size(); ++j) { v += a[i][j] * x[j]; }
+      ASSERT_NEAR(b[i], v, 1e-9);
+    }
+  }
+
+  std::vector<double> random_vector(int n) {
+    auto value_rv = std::uniform_real_distribution<double>{-5, 5};
+    auto b = std::vector<double>(n);
+    for (auto &v : b) { v = value_rv(rnd_engine); }
+    return b;
+  }
+
+protected: // fields
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(IncrementalSparseCholeskyTest, fullFactorizationSolves) {
+  auto a = random_spd(60);
+  auto cholesky = IncrementalSparseCholesky{};
+  cholesky.resize(a.size());
+  set_columns(cholesky, a, 0);
+  ASSERT_TRUE(cholesky.factorize());
+
+  auto b = random_vector(a.size()), x = std::vector<double>{};
+  cholesky.solve(b, x);
+  assert_solution(a, b, x);
+}
+
+TEST_F(IncrementalSparseCholeskyTest, partialRefactorizationSolves) {
+  auto a = random_spd(60);
+  auto cholesky = IncrementalSparseCholesky{};
+  cholesky.resize(40);
+  auto head = Matrix(40);
+  for (int i = 0; i < 40; ++i) {
+    head[i].assign(a[i].begin(), a[i].begin() + 40);
+  }
+  set_columns(cholesky, head, 0);
+  ASSERT_TRUE(cholesky.factorize());
+
+  // appended variables and an entry that connects a middle one to them
+  a[25][55] = a[55][25] = 0.5;
+  a[25][25] += 0.5;
+  a[55][55] += 0.5;
+  cholesky.resize(a.size());
+  cholesky.invalidate_from(25);
+  set_columns(cholesky, a, 25);
+  ASSERT_TRUE(cholesky.factorize());
+  ASSERT_EQ(int(a.size()), cholesky.valid_rows_nm());
+
+  auto b = random_vector(a.size()), x = std::vector<double>{};
+  cholesky.solve(b, x);
+  assert_solution(a, b, x);
+
+  // the factor is the same as the one computed from scratch
+  auto full = IncrementalSparseCholesky{};
+  full.resize(a.size());
+  set_columns(full, a, 0);
+  ASSERT_TRUE(full.factorize());
+  ASSERT_EQ(full.factor_nonzeros_nm(), cholesky.factor_nonzeros_nm());
+}
+
+TEST_F(IncrementalSparseCholeskyTest, partialSolutionUpdate) {
+  auto a = random_spd(60);
+  auto cholesky = IncrementalSparseCholesky{};
+  cholesky.resize(a.size());
+  set_columns(cholesky, a, 0);
+  ASSERT_TRUE(cholesky.factorize());
+  auto b = random_vector(a.size()), x = std::vector<double>{};
+  cholesky.solve(b, x);
+
+  // the tail of the matrix and of the right-hand side is modified
+  for (int i = 45; i < int(a.size()); ++i) {
+    a[i][i] += 1;
+    b[i] += 1;
+  }
+  cholesky.invalidate_from(45);
+  set_columns(cholesky, a, 45);
+  ASSERT_TRUE(cholesky.factorize());
+  auto &updated = cholesky.solve(b, 45, 0, x);
+  ASSERT_LE(a.size() - 45, updated.size());
+  assert_solution(a, b, x);
+}
+
+TEST_F(IncrementalSparseCholeskyTest, indefiniteMatrixIsRejected) {
+  auto a = Matrix{{1, 2}, {2, 1}};
+  auto cholesky = IncrementalSparseCholesky{};
+  cholesky.resize(2);
+  set_columns(cholesky, a, 0);
+  ASSERT_FALSE(cholesky.factorize());
+  ASSERT_EQ(1, cholesky.valid_rows_nm());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include "../../src/core/load_shedding_dispatcher.h"
+
+class LoadSheddingDispatcherTest : public ::testing::Test {
+protected: // methods
+  LoadSheddingParams params(OverloadPolicy policy) {
+    auto params = LoadSheddingParams{};
+    params.policy = policy;
+    params.drop_period = 3;
+    return params;
+  }
+
+  // NB: the handler is blocked by the first value until it is released
+  void handle(int &value) {
+    auto lock = std::unique_lock<std::mutex>{mutex};
+    handled.push_back(value);
+    is_handling = true;
+    state_changed.notify_all();
+    state_changed.wait(lock, [this] { return !handler_is_blocked; });
+    is_handling = false;
+    state_changed.notify_all();
+  }
+
+  void wait_handling(std::size_t values_nm) {
+    auto lock = std::unique_lock<std::mutex>{mutex};
+    state_changed.wait(lock, [&] {
+      return handled.size() == values_nm && is_handling;
+    });
+  }
+
+  void release_handler() {
+    auto lock = std::unique_lock<std::mutex>{mutex};
+    handler_is_blocked = false;
+    state_changed.notify_all();
+  }
+
+  template <typename Dispatcher>
+  void wait_handled(const Dispatcher &dispatcher, std::size_t values_nm) {
+    while (dispatcher.stats().handled_nm != values_nm) {
+      std::this_thread::yield();
+    }
+  }
+
+protected: // fields
+  std::mutex mutex;
+  std::condition_variable state_changed;
+  std::vector<int> handled;
+  bool handler_is_blocked = true, is_handling = false;
+};
+
+TEST_F(LoadSheddingDispatcherTest, dropEveryNthDropsPeriodically) {
+  handler_is_blocked = false;
+  LoadSheddingDispatcher<int> dispatcher{
+    params(OverloadPolicy::DropEveryNth), [this](int &v) { handle(v); }};
+  for (int i = 1; i <= 7; ++i) { dispatcher.dispatch(i); }
+
+  ASSERT_EQ((std::vector<int>{1, 2, 4, 5, 7}), handled);
+  auto stats = dispatcher.stats();
+  ASSERT_EQ(7u, stats.received_nm);
+  ASSERT_EQ(2u, stats.dropped_nm);
+  ASSERT_EQ(5u, stats.handled_nm);
+}
+
+TEST_F(LoadSheddingDispatcherTest, keepLatestReplacesPendingValue) {
+  LoadSheddingDispatcher<int> dispatcher{
+    params(OverloadPolicy::KeepLatest), [this](int &v) { handle(v); }};
+  dispatcher.dispatch(1);
+  wait_handling(1);
+  for (int i = 2; i <= 5; ++i) { dispatcher.dispatch(i); }
+  ASSERT_EQ(1u, dispatcher.stats().pending_nm);
+
+  release_handler();
+  wait_handled(dispatcher, 2);
+  ASSERT_EQ((std::vector<int>{1, 5}), handled);
+  auto stats = dispatcher.stats();
+  ASSERT_EQ(5u, stats.received_nm);
+  ASSERT_EQ(3u, stats.dropped_nm);
+  ASSERT_EQ(0u, stats.pending_nm);
+}
+
+TEST_F(LoadSheddingDispatcherTest, dropWhileBusyDropsNewValues) {
+  LoadSheddingDispatcher<int> dispatcher{
+    params(OverloadPolicy::DropWhileBusy), [this](int &v) { handle(v); }};
+  dispatcher.dispatch(1);
+  wait_handling(1);
+  for (int i = 2; i <= 5; ++i) { dispatcher.dispatch(i); }
+
+  release_handler();
+  wait_handled(dispatcher, 1);
+  dispatcher.dispatch(6);
+  wait_handled(dispatcher, 2);
+  ASSERT_EQ((std::vector<int>{1, 6}), handled);
+  ASSERT_EQ(4u, dispatcher.stats().dropped_nm);
+}
+
+TEST_F(LoadSheddingDispatcherTest, catchUpBatchesBacklog) {
+  auto catch_up_params = params(OverloadPolicy::CatchUp);
+  catch_up_params.catch_up_threshold = 3;
+  auto batch_sizes = std::vector<std::size_t>{};
+  LoadSheddingDispatcher<int> dispatcher{
+    catch_up_params, [this](int &v) { handle(v); },
+    [&](std::vector<int> &batch) {
+      batch_sizes.push_back(batch.size());
+      for (auto &v : batch) { handle(v); }
+    }};
+  dispatcher.dispatch(1);
+  wait_handling(1);
+  for (int i = 2; i <= 5; ++i) { dispatcher.dispatch(i); }
+  ASSERT_EQ(4u, dispatcher.stats().pending_nm);
+
+  release_handler();
+  wait_handled(dispatcher, 5);
+  dispatcher.dispatch(6);
+  wait_handled(dispatcher, 6);
+  ASSERT_EQ((std::vector<int>{1, 2, 3, 4, 5, 6}), handled);
+  ASSERT_EQ((std::vector<std::size_t>{4}), batch_sizes);
+  ASSERT_EQ(0u, dispatcher.stats().dropped_nm);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <random>
+
 #include "../../../src/core/maps/area_occupancy_estimator.h"
 
 //--------- Subsuits ---------------------//
@@ -12,6 +14,7 @@
 // === A diagonal beam stops at a vertex
 // === Beam starts from a target cell
 // === Robot is on an edge
+// === Beam walk
 //----------------------------------------//
 
 class AreaOccupancyEstimatorTest : public ::testing::Test {
@@ -24,10 +27,26 @@ protected: // methods
   AreaOccupancyEstimatorTest()
     : aoe{Occupancy{Base_Occup_Prob, 1.0}, Occupancy{Base_Empty_Prob, 1.0},
           Low_Est_Qual, Unknown_Est_Qual}
-    , cell{-1, 1, -1, 1} {}
+    , cell{-1, 1, -1, 1}
+    , grid{100, 100, 0.1} {}
+
+  // empty cells of the beam are estimated by the walk as one by one
+  void check_beam_walk(const Segment2D &beam) {
+    auto cells = grid.world_to_cells(beam);
+    cells.pop_back();
+    auto occupancies = std::vector<Occupancy>{};
+    aoe.estimate_beam_occupancies(beam, grid, cells, occupancies);
+    ASSERT_EQ(cells.size(), occupancies.size());
+    for (std::size_t i = 0; i < cells.size(); ++i) {
+      auto expected = aoe.estimate_occupancy(
+        beam, grid.world_cell_bounds(cells[i]), false);
+      ASSERT_EQ(expected, occupancies[i]);
+    }
+  }
 protected: // fields
   AreaOccupancyEstimator aoe;
   Rectangle cell;
+  RegularSquaresGrid grid;
 };
 
 //----------------------------------------//
@@ -427,6 +446,33 @@ TEST_F(AreaOccupancyEstimatorTest, emptyOnEdgeOutNotThrouhCell) {
   ASSERT_EQ(Occupancy::invalid(), aoe.estimate_occupancy(beam, cell, false));
 }
 
+//-----------------//
+// === Beam walk === //
+
+TEST_F(AreaOccupancyEstimatorTest, beamWalkRandomBeams) {
+  auto rnd_engine = std::mt19937{42};
+  auto coord = std::uniform_real_distribution<double>{-2, 2};
+  for (int i = 0; i < 1000; ++i) {
+    check_beam_walk({{coord(rnd_engine), coord(rnd_engine)},
+                     {coord(rnd_engine), coord(rnd_engine)}});
+  }
+}
+
+TEST_F(AreaOccupancyEstimatorTest, beamWalkDiagonalPassesVertices) {
+  check_beam_walk({{0.05, 0.05}, {1.05, 1.05}});
+  check_beam_walk({{0.15, -0.05}, {-0.85, 0.95}});
+}
+
+TEST_F(AreaOccupancyEstimatorTest, beamWalkOnGridLine) {
+  check_beam_walk({{0.03, 0.2}, {1.57, 0.2}});
+  check_beam_walk({{-0.3, 1.13}, {-0.3, -0.51}});
+}
+
+TEST_F(AreaOccupancyEstimatorTest, beamWalkAxisParallel) {
+  check_beam_walk({{0.03, 0.25}, {1.57, 0.25}});
+  check_beam_walk({{-0.35, 1.13}, {-0.35, -0.51}});
+}
+
 int main (int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/area_score_tables_grid_map.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+
+class AreaScoreTablesGridMapTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+  using MapT = AreaScoreTablesGridMap<UnboundedPlainGridMap>;
+protected: // methods
+  AreaScoreTablesGridMapTest()
+    : expected{AreaScoreTables::expected_observation()}
+    , cell_proto{std::make_shared<MockGridCell>(0.5)}
+    , rnd_engine{42} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  // updates both maps the same way
+  void update_maps(GridMap &map, GridMap &plain_map, unsigned updates_nm) {
+    auto coord_rv = std::uniform_int_distribution<int>{-20, 20};
+    auto occ_rv = std::uniform_real_distribution<double>{0, 1};
+    for (unsigned i = 0; i < updates_nm; ++i) {
+      auto area_id = Coord{coord_rv(rnd_engine), coord_rv(rnd_engine)};
+      auto aoo = obs(occ_rv(rnd_engine));
+      map.update(area_id, aoo);
+      plain_map.update(area_id, aoo);
+    }
+  }
+
+  // NB: sides are longer than a cell, so the naive overlap estimation
+  //     of the plain map is exact.
+  LightWeightRectangle random_area() {
+    auto center_rv = std::uniform_real_distribution<double>{-12, 12};
+    auto half_side_rv = std::uniform_real_distribution<double>{0.4, 2.5};
+    auto x = center_rv(rnd_engine), y = center_rv(rnd_engine);
+    auto hw = half_side_rv(rnd_engine), hh = half_side_rv(rnd_engine);
+    return {y - hh, y + hh, x - hw, x + hw};
+  }
+
+  void test_estimator(const OccupancyObservationProbabilityEstimator &oope,
+                      unsigned max_levels_nm) {
+    auto map = MapT{cell_proto, {1, 1, 0.5}, max_levels_nm};
+    auto plain_map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.5}};
+    for (int batch_i = 0; batch_i < 5; ++batch_i) {
+      update_maps(map, plain_map, 300);
+      for (int i = 0; i < 200; ++i) {
+        auto area = random_area();
+        ASSERT_NEAR(oope.probability(expected, area, plain_map),
+                    oope.probability(expected, area, map), 1e-6);
+      }
+    }
+  }
+
+protected: // fields
+  AreaOccupancyObservation expected;
+  std::shared_ptr<GridCell> cell_proto;
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(AreaScoreTablesGridMapTest, tablesAreKeptOnlyByDecoratedMap) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  auto plain_map = UnboundedPlainGridMap{cell_proto, {1, 1, 1}};
+  ASSERT_NE(nullptr, map.area_score_tables());
+  ASSERT_EQ(nullptr, plain_map.area_score_tables());
+}
+
+TEST_F(AreaScoreTablesGridMapTest, unknownArea) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  map.update({0, 0}, obs(1.0));
+  auto tables = map.area_score_tables();
+  ASSERT_NEAR(0.5, tables->max_score({100, 100}, {103, 101}), 1e-6);
+  ASSERT_NEAR(4.0, tables->score_sum({100, 100}, {103, 101}), 1e-6);
+  // the area is partially inside the map
+  ASSERT_NEAR(1.0, tables->max_score({-1, -1}, {0, 0}), 1e-6);
+  ASSERT_NEAR(2.5, tables->score_sum({-1, -1}, {0, 0}), 1e-6);
+}
+
+TEST_F(AreaScoreTablesGridMapTest, modificationsAreSynced) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  map.update({0, 0}, obs(1.0));
+  ASSERT_NEAR(1.0, map.area_score_tables()->max_score({0, 0}, {0, 0}), 1e-6);
+  map.update({0, 0}, obs(0.2));
+  ASSERT_FALSE(map.supports_concurrent_reads());
+  ASSERT_NEAR(0.2, map.area_score_tables()->max_score({0, 0}, {0, 0}), 1e-6);
+  ASSERT_NEAR(0.2, map.area_score_tables()->score_sum({0, 0}, {0, 0}), 1e-6);
+  ASSERT_TRUE(map.supports_concurrent_reads());
+}
+
+TEST_F(AreaScoreTablesGridMapTest, maxEstimator) {
+  test_estimator(MaxOccupancyObservationPE{}, 4);
+}
+
+TEST_F(AreaScoreTablesGridMapTest, maxEstimatorWithShallowPyramid) {
+  test_estimator(MaxOccupancyObservationPE{}, 2);
+}
+
+TEST_F(AreaScoreTablesGridMapTest, meanEstimator) {
+  test_estimator(MeanOccupancyObservationPE{}, 4);
+}
+
+TEST_F(AreaScoreTablesGridMapTest, overlapWeightedEstimator) {
+  test_estimator(OverlapWeightedOccupancyObservationPE{}, 4);
+}
+
+TEST_F(AreaScoreTablesGridMapTest, otherObservationsAreNotAffected) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  map.update({0, 0}, obs(1.0));
+  auto area = LightWeightRectangle{-0.5, 0.5, -0.5, 0.5};
+  ASSERT_NEAR(0.8, MaxOccupancyObservationPE{}.probability(
+                     obs(0.8), area, map), 1e-6);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
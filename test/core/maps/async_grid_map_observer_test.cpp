@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/async_grid_map_observer.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/sparse_tiled_grid_map.h"
+#include "../../../src/core/maps/out_of_core_tiled_grid_map.h"
+
+class AsyncGridMapObserverTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+
+  class RecordingObserver : public WorldMapObserver<GridMap> {
+  public:
+    void on_map_update(const GridMap &map) override {
+      auto lock = std::unique_lock<std::mutex>{mutex};
+      ++updates_nm;
+      last_occupancy = map[{3, 4}].occupancy().prob_occ;
+    }
+
+    std::mutex mutex;
+    unsigned updates_nm = 0;
+    double last_occupancy = -1;
+  };
+protected: // methods
+  AsyncGridMapObserverTest()
+    : cell_proto{std::make_shared<MockGridCell>(0.5)} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  template <typename MapT>
+  void test_snapshot_is_immutable() {
+    auto map = MapT{cell_proto, {10, 10, 1}};
+    map.update({3, 4}, obs(0.9));
+    auto snapshot = map.snapshot();
+    ASSERT_TRUE(bool(snapshot));
+
+    map.update({3, 4}, obs(0.1));
+    map.update({100, -100}, obs(0.7));
+    auto area_id = Coord{3, 4};
+    ASSERT_NEAR(0.9, (*snapshot)[area_id].occupancy().prob_occ, 1e-6);
+    ASSERT_NEAR(0.1, map[area_id].occupancy().prob_occ, 1e-6);
+  }
+
+  template <typename MapT>
+  void test_final_state_is_observed() {
+    auto map = MapT{cell_proto, {10, 10, 1}};
+    auto recorder = std::make_shared<RecordingObserver>();
+    {
+      AsyncGridMapObserver<GridMap> async_obs{recorder};
+      for (int i = 1; i <= 100; ++i) {
+        map.update({3, 4}, obs(i / 100.0));
+        async_obs.on_map_update(map);
+      }
+    }
+    ASSERT_LE(1u, recorder->updates_nm);
+    ASSERT_LE(recorder->updates_nm, 100u);
+    ASSERT_NEAR(1.0, recorder->last_occupancy, 1e-6);
+  }
+protected: // fields
+  std::shared_ptr<GridCell> cell_proto;
+};
+
+TEST_F(AsyncGridMapObserverTest, plainMapSnapshotIsImmutable) {
+  test_snapshot_is_immutable<UnboundedPlainGridMap>();
+}
+
+TEST_F(AsyncGridMapObserverTest, lazyTiledMapSnapshotIsImmutable) {
+  test_snapshot_is_immutable<UnboundedLazyTiledGridMap>();
+}
+
+TEST_F(AsyncGridMapObserverTest, sparseTiledMapSnapshotIsImmutable) {
+  test_snapshot_is_immutable<SparseTiledGridMap>();
+}
+
+TEST_F(AsyncGridMapObserverTest, outOfCoreTiledMapSnapshotIsImmutable) {
+  test_snapshot_is_immutable<OutOfCoreTiledGridMap>();
+}
+
+TEST_F(AsyncGridMapObserverTest, finalStateIsObserved) {
+  test_final_state_is_observed<UnboundedLazyTiledGridMap>();
+}
+
+TEST_F(AsyncGridMapObserverTest, updatesAreThrottled) {
+  auto map = UnboundedPlainGridMap{cell_proto, {10, 10, 1}};
+  auto recorder = std::make_shared<RecordingObserver>();
+  {
+    AsyncGridMapObserver<GridMap> async_obs{recorder, 3600};
+    for (int i = 0; i < 10; ++i) {
+      async_obs.on_map_update(map);
+    }
+  }
+  ASSERT_EQ(1u, recorder->updates_nm);
+}
+
+TEST_F(AsyncGridMapObserverTest, updatesAreThrottledByGivenClock) {
+  // NB: updates of a map w/o snapshots are observed synchronously,
+  //     so none of them is dropped by the observer
+  struct MapWithoutSnapshots : public UnboundedPlainGridMap {
+    using UnboundedPlainGridMap::UnboundedPlainGridMap;
+    std::shared_ptr<const GridMap> snapshot() const override {
+      return nullptr;
+    }
+  };
+  auto map = MapWithoutSnapshots{cell_proto, {10, 10, 1}};
+  auto recorder = std::make_shared<RecordingObserver>();
+  auto now_secs = 100.0;
+  {
+    AsyncGridMapObserver<GridMap> async_obs{recorder, 1,
+                                            [&now_secs]() { return now_secs; }};
+    for (auto secs : {100.0, 100.5, 101.0, 101.9, 102.0,
+                      // the clock goes back (e.g. a bag is replayed)
+                      50.0, 50.5}) {
+      now_secs = secs;
+      async_obs.on_map_update(map);
+    }
+  }
+  // at 100, 101, 102 and 50
+  ASSERT_EQ(4u, recorder->updates_nm);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <algorithm>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/coarsening_tiled_grid_map.h"
+
+class CoarseningTiledGridMapTest : public ::testing::Test {
+protected: // types
+  // 4x4 cells tiles, 2x2 cells coarse tiles
+  using MapT = GenericCoarseningTiledGridMap<PolymorphicCellStorage, 2,
+                                             ColumnMajorTileLayout, 1>;
+protected: // methods
+  static TileCoarseningParams coarsening(double distance,
+                                         uint64_t idle_updates = 0) {
+    auto params = TileCoarseningParams{};
+    params.distance = distance;
+    params.idle_updates = idle_updates;
+    params.check_period = 1;
+    return params;
+  }
+
+  static MapT make_map(const TileCoarseningParams &params) {
+    return MapT{std::make_shared<MockGridCell>(), {1, 1, 1}, params};
+  }
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  static double value(int x, int y) { return 100.0 * x + y; }
+
+  // the tile of areas [20; 23]x[20; 23]
+  static void fill_far_tile(MapT &map) {
+    for (int x = 20; x < 24; ++x) {
+      for (int y = 20; y < 24; ++y) {
+        map.update({x, y}, obs(value(x, y)));
+      }
+    }
+  }
+
+  // the most occupied area of the 2x2 block
+  static double block_value(int x, int y) {
+    return value(x | 1, y | 1);
+  }
+};
+
+TEST_F(CoarseningTiledGridMapTest, farTilesAreCoarsened) {
+  auto map = make_map(coarsening(3));
+  fill_far_tile(map);
+  ASSERT_EQ(0u, map.coarse_tiles_nm());
+  map.update({0, 0}, obs(0.1));
+  ASSERT_EQ(1u, map.coarse_tiles_nm());
+  ASSERT_EQ(1u, map.known_tiles_nm());
+
+  for (int x = 20; x < 24; ++x) {
+    for (int y = 20; y < 24; ++y) {
+      ASSERT_EQ(block_value(x, y), (map[{x, y}]));
+    }
+  }
+  ASSERT_EQ(0.1, (map[{0, 0}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{30, 30}]));
+}
+
+TEST_F(CoarseningTiledGridMapTest, coarseTileIsRefinedOnWrite) {
+  auto map = make_map(coarsening(3));
+  fill_far_tile(map);
+  map.update({0, 0}, obs(0.9));
+  map.update({23, 22}, obs(-1));
+  // the robot has left the first tile, its obstacle is kept
+  ASSERT_EQ(1u, map.coarse_tiles_nm());
+  ASSERT_EQ(0.9, (map[{1, 1}]));
+
+  ASSERT_EQ(-1, (map[{23, 22}]));
+  ASSERT_EQ(block_value(23, 23), (map[{23, 23}]));
+  ASSERT_EQ(block_value(20, 20), (map[{20, 21}]));
+}
+
+TEST_F(CoarseningTiledGridMapTest, idleTilesAreCoarsened) {
+  auto map = make_map(coarsening(0, 3));
+  map.update({0, 0}, obs(0.9));
+  for (int i = 0; i < 3; ++i) {
+    map.update({4, i}, obs(0.2));
+    ASSERT_EQ(0u, map.coarse_tiles_nm());
+  }
+  map.update({4, 3}, obs(0.2));
+  ASSERT_EQ(1u, map.coarse_tiles_nm());
+  ASSERT_EQ(0.9, (map[{1, 0}]));
+}
+
+TEST_F(CoarseningTiledGridMapTest, memoryTracksWorkingArea) {
+  auto map = make_map(coarsening(8));
+  auto sparse_map = GenericSparseTiledGridMap<PolymorphicCellStorage, 2>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  // a long corridor
+  for (int x = 0; x < 400; ++x) {
+    for (int y = 0; y < 4; ++y) {
+      map.update({x, y}, obs(value(x, y)));
+      sparse_map.update({x, y}, obs(value(x, y)));
+    }
+  }
+  ASSERT_LE(map.known_tiles_nm(), 4u);
+  ASSERT_LT(map.memory_usage().cells_bytes,
+            sparse_map.memory_usage().cells_bytes / 2);
+  ASSERT_EQ(block_value(6, 2), (map[{6, 2}]));
+}
+
+TEST_F(CoarseningTiledGridMapTest, coarseTilesAreSavedRefined) {
+  auto map = make_map(coarsening(3));
+  fill_far_tile(map);
+  map.update({0, 0}, obs(0.1));
+  ASSERT_EQ(1u, map.coarse_tiles_nm());
+
+  auto restored = make_map(coarsening(3));
+  restored.load_state(map.save_state());
+  ASSERT_EQ(0u, restored.coarse_tiles_nm());
+  for (int x = 20; x < 24; ++x) {
+    for (int y = 20; y < 24; ++y) {
+      ASSERT_EQ((map[{x, y}]), (restored[{x, y}]));
+    }
+  }
+  ASSERT_EQ(0.1, (restored[{0, 0}]));
+}
+
+TEST_F(CoarseningTiledGridMapTest, modifyMapCopy) {
+  auto map = make_map(coarsening(3));
+  fill_far_tile(map);
+  auto map_copy = map;
+  map.update({0, 0}, obs(0.1));
+  ASSERT_EQ(0u, map_copy.coarse_tiles_nm());
+  ASSERT_EQ(value(20, 20), (map_copy[{20, 20}]));
+  ASSERT_EQ(block_value(20, 20), (map[{20, 20}]));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/expected_range_cache.h"
+
+class ExpectedRangeCacheTest : public ::testing::Test {
+protected: // methods
+  ExpectedRangeCacheTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 0.1}} {
+    params.max_range = 3;
+    params.angle_bins_nm = 36;
+    params.lattice_step = 2;
+    // a square room of 6x6 meters
+    for (int i = -30; i <= 30; ++i) {
+      set_occupancy({i, -30}, 1);
+      set_occupancy({i, 30}, 1);
+      set_occupancy({-30, i}, 1);
+      set_occupancy({30, i}, 1);
+    }
+  }
+
+  void set_occupancy(const GridMap::Coord &area_id, double prob) {
+    map.update(area_id, {true, {prob, 1}, {0, 0}, 1});
+  }
+
+  double cast(const GridMap::Coord &area_id, double angle) {
+    auto hit = GridRayCaster::cast(
+      map, map.cell_to_world(area_id), angle, params.max_range,
+      GridRayCaster::occupancy_threshold(map, params.obstacle_threshold));
+    return hit.is_hit ? std::min(hit.range, params.max_range)
+                      : params.max_range;
+  }
+
+protected: // fields
+  UnboundedPlainGridMap map;
+  ExpectedRangeCacheParams params;
+};
+
+TEST_F(ExpectedRangeCacheTest, latticeRangesAreCastRanges) {
+  auto cache = ExpectedRangeCache{params};
+  cache.sync(map);
+  for (int y = -20; y <= 20; y += 2) {
+    for (int x = -20; x <= 20; x += 2) {
+      for (int bin = 0; bin < 36; ++bin) {
+        auto angle = bin * 2 * M_PI / 36;
+        ASSERT_NEAR(cast({x, y}, angle),
+                    cache.expected_range(map, map.cell_to_world({x, y}),
+                                         angle), 1e-5);
+      }
+    }
+  }
+}
+
+TEST_F(ExpectedRangeCacheTest, queriesAreSnappedToLatticeAndBins) {
+  auto cache = ExpectedRangeCache{params};
+  cache.sync(map);
+  auto lattice_pt = map.cell_to_world({4, -6});
+  auto expected = cache.expected_range(map, lattice_pt, -M_PI / 2);
+  ASSERT_NEAR(2.4, expected, 1e-5);
+  ASSERT_EQ(expected, cache.expected_range(
+    map, lattice_pt + Point2D{0.09, -0.08}, -M_PI / 2 + 0.08));
+  ASSERT_EQ(expected, cache.expected_range(map, lattice_pt,
+                                           -M_PI / 2 - 4 * M_PI));
+  // misses are at the max range
+  ASSERT_EQ(3, cache.expected_range(map, map.cell_to_world({0, 0}), 0));
+}
+
+TEST_F(ExpectedRangeCacheTest, obstacleChangeDropsReachedTiles) {
+  auto cache = ExpectedRangeCache{params};
+  cache.sync(map);
+  // tiles are 1.6m wide, so the ones are beyond the max range of each other
+  cache.expected_range(map, {-2.5, -2.5}, 0);
+  cache.expected_range(map, {2.5, 2.5}, 0);
+  ASSERT_EQ(2u, cache.tiles_nm());
+  ASSERT_NEAR(3, cache.expected_range(map, {2.45, 2.45}, M_PI), 1e-5);
+
+  set_occupancy({20, 24}, 0.9);
+  cache.sync(map);
+  ASSERT_EQ(1u, cache.tiles_nm());
+  ASSERT_NEAR(cast({24, 24}, M_PI),
+              cache.expected_range(map, {2.45, 2.45}, M_PI), 1e-5);
+  ASSERT_NEAR(0.4, cache.expected_range(map, {2.45, 2.45}, M_PI), 1e-5);
+}
+
+TEST_F(ExpectedRangeCacheTest, estimatesUpdatesKeepTiles) {
+  auto cache = ExpectedRangeCache{params};
+  cache.sync(map);
+  cache.expected_range(map, {0, 0}, 0);
+  ASSERT_EQ(1u, cache.tiles_nm());
+
+  // obstacles and free space remain the same
+  set_occupancy({30, 5}, 0.8);
+  set_occupancy({3, 5}, 0.2);
+  cache.sync(map);
+  ASSERT_EQ(1u, cache.tiles_nm());
+}
+
+TEST_F(ExpectedRangeCacheTest, replacedMapIsCachedAgain) {
+  auto tiled_map = UnboundedLazyTiledGridMap{std::make_shared<MockGridCell>(),
+                                             {1, 1, 0.1}};
+  // NB: the copy keeps the map's versions
+  auto map_copy = tiled_map;
+  auto cache = ExpectedRangeCache{params};
+  cache.sync(tiled_map);
+  auto origin = tiled_map.cell_to_world({0, 0});
+  ASSERT_EQ(3, cache.expected_range(tiled_map, origin, 0));
+
+  map_copy.update({10, 0}, {true, {1, 1}, {0, 0}, 1});
+  tiled_map = map_copy;
+  cache.sync(tiled_map);
+  ASSERT_LT(cache.expected_range(tiled_map, origin, 0), 1.1);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
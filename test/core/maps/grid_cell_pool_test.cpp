@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/grid_cell_pool.h"
+
+class LargeGridCell : public MockGridCell {
+public:
+  std::unique_ptr<GridCell> clone() const override {
+    return std::make_unique<LargeGridCell>(*this);
+  }
+private:
+  char _payload[2 * GridCellPool::Max_Block_Size];
+};
+
+TEST(GridCellPoolTest, freedCellsAreReused) {
+  auto proto = MockGridCell{0.3};
+  auto cells = std::vector<std::unique_ptr<GridCell>>{};
+  for (int i = 0; i < 1000; ++i) { cells.push_back(proto.clone()); }
+  auto addresses = std::set<const GridCell *>{};
+  for (auto &cell : cells) { addresses.insert(cell.get()); }
+  ASSERT_EQ(cells.size(), addresses.size());
+
+  cells.clear();
+  for (int i = 0; i < 1000; ++i) {
+    auto cell = proto.clone();
+    ASSERT_EQ(1u, addresses.count(cell.get()));
+    ASSERT_NEAR(0.3, cell->occupancy().prob_occ, 1e-9);
+    cells.push_back(std::move(cell));
+  }
+}
+
+TEST(GridCellPoolTest, largeCellsAreSupported) {
+  auto proto = LargeGridCell{};
+  auto cells = std::vector<std::unique_ptr<GridCell>>{};
+  for (int i = 0; i < 100; ++i) { cells.push_back(proto.clone()); }
+  ASSERT_EQ(100u, cells.size());
+}
+
+TEST(GridCellPoolTest, cellsAreAligned) {
+  auto proto = MockGridCell{};
+  for (int i = 0; i < 100; ++i) {
+    auto cell = proto.clone();
+    ASSERT_EQ(0u, reinterpret_cast<std::uintptr_t>(cell.get()) %
+                  alignof(std::max_align_t));
+  }
+}
+
+TEST(GridCellPoolTest, emptySlabsAreReleased) {
+  auto proto = MockGridCell{0.3};
+  auto init_slabs_nm = GridCellPool::slabs_nm();
+  auto cells = std::vector<std::unique_ptr<GridCell>>{};
+  for (int i = 0; i < 100000; ++i) { cells.push_back(proto.clone()); }
+  ASSERT_LT(init_slabs_nm + 10, GridCellPool::slabs_nm());
+
+  cells.clear();
+  // NB: a slab may be kept by free blocks of the thread
+  //     and as the last one with free blocks
+  ASSERT_LE(GridCellPool::slabs_nm(), init_slabs_nm + 2);
+}
+
+TEST(GridCellPoolTest, concurrentClonesAreDistinct) {
+  constexpr int Threads_Nm = 8, Cells_Nm = 20000;
+  auto proto = MockGridCell{0.3};
+  auto thread_cells = std::vector<std::vector<std::unique_ptr<GridCell>>>(
+    Threads_Nm);
+  auto threads = std::vector<std::thread>{};
+  for (int t = 0; t < Threads_Nm; ++t) {
+    threads.emplace_back([&, t]() {
+      auto &cells = thread_cells[t];
+      for (int i = 0; i < Cells_Nm; ++i) {
+        cells.push_back(proto.clone());
+        if (i % 3 == 0) { cells.pop_back(); }
+      }
+    });
+  }
+  for (auto &thread : threads) { thread.join(); }
+
+  // cells of a thread are freed by another one
+  threads.clear();
+  auto freed_cells = std::vector<std::vector<std::unique_ptr<GridCell>>>(
+    Threads_Nm);
+  for (int t = 0; t < Threads_Nm; ++t) {
+    freed_cells[t] = std::move(thread_cells[(t + 1) % Threads_Nm]);
+  }
+  thread_cells.clear();
+  thread_cells.resize(Threads_Nm);
+  for (int t = 0; t < Threads_Nm; ++t) {
+    threads.emplace_back([&, t]() {
+      auto &cells = thread_cells[t];
+      for (int i = 0; i < Cells_Nm; ++i) {
+        if (i % 2 == 0 && !freed_cells[t].empty()) {
+          freed_cells[t].pop_back();
+        }
+        cells.push_back(proto.clone());
+      }
+    });
+  }
+  for (auto &thread : threads) { thread.join(); }
+
+  auto addresses = std::set<const GridCell *>{};
+  auto cells_nm = std::size_t{0};
+  for (auto &cells : thread_cells) {
+    for (auto &cell : cells) {
+      ASSERT_NEAR(0.3, cell->occupancy().prob_occ, 1e-9);
+      addresses.insert(cell.get());
+    }
+    cells_nm += cells.size();
+  }
+  for (auto &cells : freed_cells) {
+    for (auto &cell : cells) { addresses.insert(cell.get()); }
+    cells_nm += cells.size();
+  }
+  ASSERT_EQ(cells_nm, addresses.size());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
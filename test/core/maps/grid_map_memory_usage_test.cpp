@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/rescalable_caching_grid_map.h"
+
+class GridMapMemoryUsageTest : public ::testing::Test {
+protected: // methods
+  GridMapMemoryUsageTest()
+    : cell_proto{std::make_shared<MockGridCell>()}
+    , data{true, {0.5, 0.5}, {0, 0}, 0} {}
+protected: // fields
+  std::shared_ptr<GridCell> cell_proto;
+  AreaOccupancyObservation data;
+};
+
+TEST_F(GridMapMemoryUsageTest, tilesSharing) {
+  GridMapMemoryUsage usage;
+  usage.add_tile(100, 1);
+  usage.add_tile(100, 4);
+  usage.add_overhead(8, 2);
+  ASSERT_EQ(200u, usage.cells_bytes);
+  ASSERT_EQ(208u, usage.total_bytes());
+  ASSERT_EQ(100u + 25 + 4, usage.amortized_bytes);
+  ASSERT_EQ(2u, usage.tiles_nm);
+  ASSERT_EQ(1u, usage.shared_tiles_nm);
+}
+
+TEST_F(GridMapMemoryUsageTest, levelsAreAddedLevelWise) {
+  GridMapMemoryUsage usage, that;
+  usage.levels_bytes = {10};
+  that.levels_bytes = {1, 2};
+  usage += that;
+  ASSERT_EQ(2u, usage.levels_bytes.size());
+  ASSERT_EQ(11u, usage.levels_bytes[0]);
+  ASSERT_EQ(2u, usage.levels_bytes[1]);
+}
+
+TEST_F(GridMapMemoryUsageTest, plainMapCells) {
+  PlainGridMap map{cell_proto, {10, 20, 1}};
+  auto usage = map.memory_usage();
+  auto cell_bytes = sizeof(std::unique_ptr<GridCell>) +
+                    cell_proto->memory_size();
+  ASSERT_EQ(200 * cell_bytes, usage.cells_bytes);
+  ASSERT_EQ(0u, usage.tiles_nm);
+  ASSERT_EQ(usage.total_bytes(), usage.amortized_bytes);
+}
+
+TEST_F(GridMapMemoryUsageTest, lazyTiledMapAllocatesUpdatedTiles) {
+  UnboundedLazyTiledGridMap map{cell_proto, {1, 1, 1}};
+  ASSERT_EQ(0u, map.memory_usage().tiles_nm);
+  ASSERT_EQ(0u, map.memory_usage().cells_bytes);
+
+  map.update({0, 0}, data);
+  auto usage = map.memory_usage();
+  ASSERT_EQ(1u, usage.tiles_nm);
+  ASSERT_EQ(0u, usage.shared_tiles_nm);
+  ASSERT_LT(0u, usage.cells_bytes);
+  ASSERT_LT(0u, usage.overhead_bytes);
+}
+
+TEST_F(GridMapMemoryUsageTest, copiesAmortizeSharedTiles) {
+  UnboundedLazyTiledGridMap map{cell_proto, {1, 1, 1}};
+  map.update({0, 0}, data);
+  auto single_usage = map.memory_usage();
+
+  UnboundedLazyTiledGridMap map_copy = map;
+  auto usage = map.memory_usage(), copy_usage = map_copy.memory_usage();
+  ASSERT_EQ(1u, usage.shared_tiles_nm);
+  ASSERT_EQ(1u, copy_usage.shared_tiles_nm);
+  ASSERT_EQ(single_usage.cells_bytes, usage.cells_bytes);
+  // the shared tile is held once by both maps
+  auto amortized_bytes = usage.amortized_bytes + copy_usage.amortized_bytes;
+  ASSERT_LE(usage.cells_bytes, amortized_bytes);
+  ASSERT_LT(amortized_bytes, usage.total_bytes() + copy_usage.total_bytes());
+}
+
+TEST_F(GridMapMemoryUsageTest, rescalableMapLevels) {
+  RescalableCachingGridMap<UnboundedPlainGridMap> map{cell_proto,
+                                                      {4, 4, 1}};
+  map.update({0, 0}, data);
+  // coarser levels are built on demand
+  ASSERT_EQ(1u, map.memory_usage().levels_bytes.size());
+
+  auto scales_nm = map.scales_nm();
+  auto usage = map.memory_usage();
+  ASSERT_EQ(scales_nm, usage.levels_bytes.size());
+  auto levels_total = std::size_t{0};
+  for (auto bytes : usage.levels_bytes) { levels_total += bytes; }
+  ASSERT_LE(levels_total, usage.total_bytes());
+  ASSERT_LT(0u, usage.levels_bytes[0]);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
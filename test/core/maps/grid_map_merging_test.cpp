@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/grid_map_merging.h"
+#include "../../../src/slams/viny/viny_grid_cell.h"
+#include "../../../src/slams/tiny/tiny_grid_cell.h"
+
+class GridMapMergingTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+protected: // methods
+  GridMapMergingTest()
+    : cell_proto{std::make_shared<MockGridCell>()}, rnd_engine{42} {}
+
+  AreaOccupancyObservation random_aoo() {
+    auto occ_rv = std::uniform_real_distribution<double>{0.05, 0.95};
+    auto quality_rv = std::uniform_real_distribution<double>{0.1, 1};
+    return {true, Occupancy(occ_rv(rnd_engine), quality_rv(rnd_engine)),
+            {0, 0}, 0};
+  }
+
+  // fills a square of the side 2 * lim with random estimates
+  void fill(GridMap &map, int lim, int step = 1) {
+    for (int y = -lim; y < lim; y += step) {
+      for (int x = -lim; x < lim; x += step) {
+        map.update({x, y}, random_aoo());
+      }
+    }
+  }
+
+  // the estimate of the dst area is merged by cells
+  void assert_merged(const GridMap &merged, const GridMap &dst,
+                     const GridMap &src, const Coord &offset, int lim) {
+    for (int y = -lim; y < lim; ++y) {
+      for (int x = -lim; x < lim; ++x) {
+        auto expected = dst[{x, y}].clone();
+        expected->merge(src[Coord{x, y} - offset]);
+        auto &actual = merged[{x, y}];
+        ASSERT_EQ(double(*expected), double(actual));
+        ASSERT_EQ(expected->occupancy().estimation_quality,
+                  actual.occupancy().estimation_quality);
+      }
+    }
+  }
+
+protected: // fields
+  std::shared_ptr<GridCell> cell_proto;
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(GridMapMergingTest, knownCellsAreAveragedByQuality) {
+  auto cell = MockGridCell{Occupancy{0.2, 1}};
+  cell.merge(MockGridCell{Occupancy{0.8, 3}});
+  ASSERT_NEAR(0.65, cell.occupancy().prob_occ, 1e-9);
+  ASSERT_EQ(3, cell.occupancy().estimation_quality);
+}
+
+TEST_F(GridMapMergingTest, unknownCellIsIdentity) {
+  auto cell = MockGridCell{Occupancy{0.2, 1}};
+  cell.merge(MockGridCell{});
+  ASSERT_EQ(0.2, cell.occupancy().prob_occ);
+
+  auto unknown = MockGridCell{};
+  unknown.merge(cell);
+  ASSERT_EQ(0.2, unknown.occupancy().prob_occ);
+}
+
+TEST_F(GridMapMergingTest, vinyCellsConjunctBeliefs) {
+  auto cell = VinyDSCell{TBM{0.5, 0.1, 0.4, 0}};
+  auto that = VinyDSCell{TBM{0.3, 0.6, 0.1, 0}};
+  auto expected = conjunctive(cell.belief(), that.belief());
+  expected.normalize_conflict();
+
+  cell.merge(that);
+  ASSERT_NEAR(expected.occupied(), cell.belief().occupied(), 1e-9);
+  ASSERT_NEAR(expected.empty(), cell.belief().empty(), 1e-9);
+  ASSERT_NEAR(TBM_to_O(expected).prob_occ, cell.occupancy().prob_occ, 1e-9);
+
+  auto unknown = VinyDSCell{};
+  unknown.merge(cell);
+  ASSERT_NEAR(cell.occupancy().prob_occ, unknown.occupancy().prob_occ, 1e-9);
+}
+
+TEST_F(GridMapMergingTest, avgTinyCellsAverageAllObservations) {
+  auto cell = AvgTinyCell{}, that = AvgTinyCell{}, expected = AvgTinyCell{};
+  for (auto p : {0.9, 0.7}) {
+    cell += {true, {p, 1}, {0, 0}, 1};
+    expected += {true, {p, 1}, {0, 0}, 1};
+  }
+  for (auto p : {0.1, 0.3, 0.2}) {
+    that += {true, {p, 1}, {0, 0}, 1};
+    expected += {true, {p, 1}, {0, 0}, 1};
+  }
+
+  cell.merge(that);
+  ASSERT_NEAR(double(expected), double(cell), 1e-9);
+  // the merged cell keeps the number of observations
+  cell += {true, {1, 1}, {0, 0}, 1};
+  expected += {true, {1, 1}, {0, 0}, 1};
+  ASSERT_NEAR(double(expected), double(cell), 1e-9);
+}
+
+TEST_F(GridMapMergingTest, tileAlignedShiftAdoptsUnknownTiles) {
+  using MapT = UnboundedLazyTiledGridMap;
+  constexpr int Tile_Size = 128; // the default one
+  auto src = MapT{cell_proto, {1, 1, 0.1}};
+  fill(src, Tile_Size);
+  auto dst = MapT{cell_proto, {1, 1, 0.1}};
+  fill(dst, Tile_Size / 2, 7);
+  auto expected = dst;
+
+  auto offset = Coord{Tile_Size, -2 * Tile_Size};
+  merge_grid_map(dst, src, {offset.x * 0.1, offset.y * 0.1, 0});
+
+  // tiles of areas unknown to the dst map are shared with the src map
+  ASSERT_LT(0u, dst.tile_sharing_stats().shared_tiles_nm);
+  assert_merged(dst, expected, src, offset, 3 * Tile_Size);
+}
+
+TEST_F(GridMapMergingTest, tileAlignedShiftMergesKnownTiles) {
+  using MapT = UnboundedLazyTiledGridMap;
+  constexpr int Tile_Size = 128; // the default one
+  auto src = MapT{cell_proto, {1, 1, 0.1}};
+  fill(src, Tile_Size);
+  auto dst = MapT{cell_proto, {1, 1, 0.1}};
+  fill(dst, Tile_Size, 3);
+  auto expected = dst;
+
+  merge_grid_map(dst, src, {0, 0, 0});
+  assert_merged(dst, expected, src, {0, 0}, 2 * Tile_Size);
+  // the src map isn't changed by writes to the dst one
+  dst.update({0, 0}, random_aoo());
+  ASSERT_NE(double(dst[{0, 0}]), double(src[{0, 0}]));
+}
+
+TEST_F(GridMapMergingTest, plainMapIsMergedOutsideTiledMapBounds) {
+  auto src = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill(src, 40);
+  auto dst = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+  auto expected = dst;
+
+  // the shift is area aligned, so the src map is merged by areas
+  auto offset = Coord{300, -250};
+  merge_grid_map(dst, src, {offset.x * 0.1, offset.y * 0.1, 0});
+  assert_merged(dst, expected, src, offset, 350);
+}
+
+TEST_F(GridMapMergingTest, tiledMapOfOtherCellIsMergedOutsideBounds) {
+  // a cell type the dst map can't share tiles with
+  struct OtherMockGridCell : public MockGridCell {
+    std::unique_ptr<GridCell> clone() const override {
+      return std::make_unique<OtherMockGridCell>(*this);
+    }
+  };
+  auto src = UnboundedLazyTiledGridMap{std::make_shared<OtherMockGridCell>(),
+                                       {1, 1, 0.1}};
+  fill(src, 40);
+  auto dst = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+  fill(dst, 10);
+  auto expected = dst;
+
+  auto offset = Coord{-200, 310};
+  merge_grid_map(dst, src, {offset.x * 0.1, offset.y * 0.1, 0});
+  assert_merged(dst, expected, src, offset, 360);
+}
+
+TEST_F(GridMapMergingTest, unalignedShiftOfTiledMaps) {
+  using MapT = UnboundedLazyTiledGridMap;
+  auto src = MapT{cell_proto, {1, 1, 0.1}};
+  fill(src, 150);
+  auto dst = MapT{cell_proto, {1, 1, 0.1}};
+  fill(dst, 100, 5);
+  auto expected = dst;
+
+  auto offset = Coord{37, -101};
+  merge_grid_map(dst, src, {offset.x * 0.1, offset.y * 0.1, 4 * M_PI});
+  assert_merged(dst, expected, src, offset, 300);
+}
+
+TEST_F(GridMapMergingTest, shiftOfPlainMaps) {
+  auto src = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill(src, 40);
+  auto dst = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill(dst, 30, 2);
+  auto expected = dst;
+
+  auto offset = Coord{-13, 21};
+  merge_grid_map(dst, src, {offset.x * 0.1, offset.y * 0.1, 0});
+  assert_merged(dst, expected, src, offset, 80);
+}
+
+TEST_F(GridMapMergingTest, rotatedMapIsResampled) {
+  auto src = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill(src, 20);
+  auto dst = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+
+  // the area (x, y) of the src map is the area (-y - 1, x) of the dst one
+  merge_grid_map(dst, src, {0, 0, M_PI / 2});
+  for (int y = -20; y < 20; ++y) {
+    for (int x = -20; x < 20; ++x) {
+      ASSERT_EQ(double(src[{x, y}]), double(dst[{-y - 1, x}]));
+    }
+  }
+}
+
+TEST_F(GridMapMergingTest, scaledMapIsResampled) {
+  auto src = UnboundedPlainGridMap{cell_proto, {1, 1, 0.2}};
+  fill(src, 10);
+  auto dst = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+
+  merge_grid_map(dst, src, {0.02, 0, 0});
+  for (int y = -20; y < 20; ++y) {
+    for (int x = -20; x < 20; ++x) {
+      auto src_id = Coord{int(std::floor((x * 0.1 + 0.03) / 0.2)),
+                          int(std::floor((y + 0.5) * 0.1 / 0.2))};
+      ASSERT_EQ(double(src[src_id]), double(dst[{x, y}]));
+    }
+  }
+}
+
+TEST_F(GridMapMergingTest, unknownMapChangesNothing) {
+  auto src = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+  auto dst = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+  fill(dst, 50);
+  auto expected = dst;
+
+  merge_grid_map(dst, src, {0.3, -0.2, 0});
+  merge_grid_map(dst, src, {0.03, 0.1, 0.7});
+  for (int y = -50; y < 50; ++y) {
+    for (int x = -50; x < 50; ++x) {
+      ASSERT_EQ(double(expected[{x, y}]), double(dst[{x, y}]));
+    }
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
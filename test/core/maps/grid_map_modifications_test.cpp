@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/grid_map_modifications.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/sparse_tiled_grid_map.h"
+
+class GridMapModificationsTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+protected: // methods
+  GridMapModificationsTest()
+    : cell_proto{std::make_shared<MockGridCell>(0.5)} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  static void assert_area(const ModifiedGridArea &area,
+                          const Coord &min, const Coord &max) {
+    ASSERT_TRUE(area.is_known);
+    ASSERT_FALSE(area.is_empty());
+    ASSERT_EQ(min, area.min);
+    ASSERT_EQ(max, area.max);
+  }
+
+  template <typename MapT>
+  void test_map_modifications() {
+    auto map = MapT{cell_proto, {10, 10, 1}};
+    map.update({1, 2}, obs(0.9));
+    auto v0 = map.version();
+    ASSERT_TRUE(map.modified_area(v0).is_empty());
+
+    map.update({-3, 4}, obs(0.9));
+    map.reset({2, -1}, MockGridCell{0.1});
+    auto v1 = map.version();
+    ASSERT_NE(v0, v1);
+    assert_area(map.modified_area(v0), {-3, -1}, {2, 4});
+
+    // a snapshot ends the version
+    auto snapshot = map.snapshot();
+    map.update({30, 30}, obs(0.9));
+    auto v2 = snapshot->version();
+    assert_area(snapshot->modified_area(v0), {-3, -1}, {2, 4});
+    assert_area(map.modified_area(v2), {30, 30}, {30, 30});
+    assert_area(map.modified_area(v0), {-3, -1}, {30, 30});
+  }
+protected: // fields
+  std::shared_ptr<GridCell> cell_proto;
+};
+
+TEST_F(GridMapModificationsTest, versionIsBumpedAfterRead) {
+  auto mods = GridMapModifications{};
+  mods.on_area_modified({0, 0});
+  mods.on_area_modified({1, 1});
+  auto v0 = mods.version();
+  ASSERT_EQ(v0, mods.version());
+  mods.on_area_modified({2, 2});
+  mods.on_area_modified({3, 3});
+  ASSERT_EQ(v0 + 1, mods.version());
+  assert_area(mods.modified_area(v0), {2, 2}, {3, 3});
+}
+
+TEST_F(GridMapModificationsTest, oldHistoryIsForgotten) {
+  auto mods = GridMapModifications{};
+  auto v0 = mods.version();
+  for (unsigned i = 0; i < GridMapModifications::Max_Versions + 1; ++i) {
+    mods.on_area_modified({int(i), 0});
+    mods.version();
+  }
+  ASSERT_FALSE(mods.modified_area(v0).is_known);
+  ASSERT_TRUE(mods.modified_area(v0 + 1).is_known);
+}
+
+TEST_F(GridMapModificationsTest, resetForgetsHistory) {
+  auto mods = GridMapModifications{};
+  mods.on_area_modified({0, 0});
+  auto v0 = mods.version();
+  mods.reset();
+  auto v1 = mods.version();
+  ASSERT_FALSE(mods.modified_area(v0).is_known);
+  ASSERT_TRUE(mods.modified_area(v1).is_known);
+  ASSERT_TRUE(mods.modified_area(v1).is_empty());
+}
+
+TEST_F(GridMapModificationsTest, unboundedPlainMap) {
+  test_map_modifications<UnboundedPlainGridMap>();
+}
+
+TEST_F(GridMapModificationsTest, unboundedLazyTiledMap) {
+  test_map_modifications<UnboundedLazyTiledGridMap>();
+}
+
+TEST_F(GridMapModificationsTest, sparseTiledMap) {
+  test_map_modifications<SparseTiledGridMap>();
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -7,6 +7,7 @@
 #include "../mock_grid_cell.h"
 #include "../../../src/core/maps/const_occupancy_estimator.h"
 #include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
 #include "../../../src/core/math_utils.h"
 #include "../../../src/utils/data_generation/grid_map_patcher.h"
 #include "../../../src/utils/data_generation/laser_scan_generator.h"
@@ -125,13 +126,18 @@ protected:
     , dst_map{cell_proto, {MAP_WIDTH, MAP_HEIGHT, MAP_SCALE}}
     , pose{0, 0, 0} {}
 
-  std::shared_ptr<GridMapScanAdder> adder(double blurring_width) const {
+  std::shared_ptr<GridMapScanAdder> adder(
+    double blurring_width,
+    ScanInsertionMode mode = ScanInsertionMode::Immediate,
+    unsigned threads_nm = 1) const {
     auto oe = std::make_shared<ConstOccupancyEstimator>(Occup, Empty);
     auto omqe = std::make_shared<IdleOMQE>();
     auto builder = WallDistanceBlurringScanAdder::builder();
     return builder.set_occupancy_estimator(oe)
                   .set_observation_quality_estimator(omqe)
                   .set_blur_distance(blurring_width)
+                  .set_insertion_mode(mode)
+                  .set_insertion_threads_nm(threads_nm)
                   .build();
   }
 
@@ -176,6 +182,162 @@ TEST_F(DistanceBasedWallBlurringTest, smokeDistanceBaseBlurringTest) {
   ASSERT_TRUE(1 < occupied_cells);
 }
 
+TEST_F(DistanceBasedWallBlurringTest, adderIsSpecializedByBlurring) {
+  using NoBlurAdder = GenericWallDistanceBlurringScanAdder<NoWallBlurring>;
+  using FixedBlurAdder =
+    GenericWallDistanceBlurringScanAdder<FixedWallBlurring>;
+  using DynamicBlurAdder =
+    GenericWallDistanceBlurringScanAdder<DynamicWallBlurring>;
+  ASSERT_TRUE(bool(std::dynamic_pointer_cast<NoBlurAdder>(adder(0))));
+  ASSERT_TRUE(bool(std::dynamic_pointer_cast<FixedBlurAdder>(adder(3))));
+  ASSERT_TRUE(bool(std::dynamic_pointer_cast<DynamicBlurAdder>(adder(-0.1))));
+}
+
+//----------------------------------------------------------------------------//
+// Batched scan insertion
+
+class CountingGridCell : public MockGridCell {
+public:
+  std::unique_ptr<GridCell> clone() const override {
+    return std::make_unique<CountingGridCell>(*this);
+  }
+
+  void operator+=(const AreaOccupancyObservation &aoo) override {
+    MockGridCell::operator+=(aoo);
+    (aoo.is_occupied ? occupied_nm : free_nm) += 1;
+  }
+
+  unsigned occupied_nm = 0, free_nm = 0;
+};
+
+class BatchedScanInsertionTest : public DistanceBasedWallBlurringTest {
+protected:
+  LaserScan2D generate_scan() {
+    auto aoo = AreaOccupancyObservation{true, {1.0, 1.0}, {0, 0}, 1.0};
+    for (int i = -30; i <= 30; ++i) {
+      src_map.update({20, i}, aoo);
+      src_map.update({i, -25}, aoo);
+    }
+    pose += RobotPoseDelta{src_map.scale() / 2, src_map.scale() / 2, 0};
+    constexpr auto lsp = to_lsp(MAP_WIDTH * 2, 360, 360);
+    return LaserScanGenerator{lsp}.laser_scan_2D(src_map, pose, 1);
+  }
+
+  template <typename CellAction>
+  void for_each_cell(const GridMap &map, CellAction action) const {
+    auto raw_coord = GridMap::Coord{0, 0};
+    for (raw_coord.x = 0; raw_coord.x < map.width(); ++raw_coord.x) {
+      for (raw_coord.y = 0; raw_coord.y < map.height(); ++raw_coord.y) {
+        action(map.internal2external(raw_coord));
+      }
+    }
+  }
+
+  void test_concurrent_insertion(ScanInsertionMode mode) {
+    auto scan = generate_scan();
+    // NB: small maps are expanded before the concurrent updates
+    using SmallTilesMap =
+      GenericUnboundedLazyTiledGridMap<PolymorphicCellStorage, 3>;
+    auto map_params = GridMapParams{16, 16, MAP_SCALE};
+    auto sequential_map = SmallTilesMap{cell_proto, map_params};
+    auto concurrent_map = SmallTilesMap{cell_proto, map_params};
+    adder(3, mode)->append_scan(sequential_map, pose, scan, 1.0, 0);
+    auto concurrent_adder = adder(3, mode, 4);
+    ASSERT_EQ(4u, concurrent_adder->insertion_threads_nm());
+    concurrent_adder->append_scan(concurrent_map, pose, scan, 1.0, 0);
+
+    // NB: maps may be expanded differently, so both extents are checked
+    auto assert_same_cell = [&](const GridMap::Coord &coord) {
+      ASSERT_EQ(sequential_map[coord].occupancy().prob_occ,
+                concurrent_map[coord].occupancy().prob_occ);
+    };
+    for_each_cell(sequential_map, assert_same_cell);
+    for_each_cell(concurrent_map, assert_same_cell);
+  }
+};
+
+TEST_F(BatchedScanInsertionTest, batchedInsertionMatchesImmediate) {
+  auto scan = generate_scan();
+  auto batched_map = UnboundedPlainGridMap{cell_proto,
+                                           {MAP_WIDTH, MAP_HEIGHT, MAP_SCALE}};
+  adder(3)->append_scan(dst_map, pose, scan, 1.0, 0);
+  adder(3, ScanInsertionMode::Batched)->append_scan(batched_map, pose,
+                                                    scan, 1.0, 0);
+  ASSERT_TRUE(map_was_modified(dst_map));
+  ASSERT_EQ(dst_map.width(), batched_map.width());
+  ASSERT_EQ(dst_map.height(), batched_map.height());
+  for_each_cell(dst_map, [&](const GridMap::Coord &coord) {
+    ASSERT_EQ(dst_map[coord].occupancy().prob_occ,
+              batched_map[coord].occupancy().prob_occ);
+  });
+}
+
+TEST_F(BatchedScanInsertionTest, freeObservationsAreMerged) {
+  auto scan = generate_scan();
+  auto counting_proto = std::make_shared<CountingGridCell>();
+  auto map_params = GridMapParams{MAP_WIDTH, MAP_HEIGHT, MAP_SCALE};
+  auto immediate_map = UnboundedPlainGridMap{counting_proto, map_params};
+  auto merged_map = UnboundedPlainGridMap{counting_proto, map_params};
+  adder(0)->append_scan(immediate_map, pose, scan, 1.0, 0);
+  adder(0, ScanInsertionMode::Batched_Merged_Free)->append_scan(
+    merged_map, pose, scan, 1.0, 0);
+
+  unsigned max_immediate_free_nm = 0;
+  for_each_cell(merged_map, [&](const GridMap::Coord &coord) {
+    auto &immediate = static_cast<const CountingGridCell &>(
+      immediate_map[coord]);
+    auto &merged = static_cast<const CountingGridCell &>(merged_map[coord]);
+    max_immediate_free_nm = std::max(max_immediate_free_nm,
+                                     immediate.free_nm);
+    ASSERT_EQ(immediate.occupied_nm, merged.occupied_nm);
+    ASSERT_EQ(std::min(immediate.free_nm, 1u), merged.free_nm);
+  });
+  ASSERT_LT(1u, max_immediate_free_nm);
+}
+
+TEST_F(BatchedScanInsertionTest, scansBatchMergesFreeObservations) {
+  auto scan = generate_scan();
+  auto counting_proto = std::make_shared<CountingGridCell>();
+  auto map_params = GridMapParams{MAP_WIDTH, MAP_HEIGHT, MAP_SCALE};
+  auto single_map = UnboundedPlainGridMap{counting_proto, map_params};
+  auto batch_map = UnboundedPlainGridMap{counting_proto, map_params};
+  adder(0)->append_scan(single_map, pose, scan, 1.0, 0);
+  // NB: the batch is merged regardless of the insertion mode
+  adder(0)->append_scans(batch_map, {{pose, &scan, 1.0}, {pose, &scan, 1.0}});
+
+  for_each_cell(batch_map, [&](const GridMap::Coord &coord) {
+    auto &single = static_cast<const CountingGridCell &>(single_map[coord]);
+    auto &batch = static_cast<const CountingGridCell &>(batch_map[coord]);
+    ASSERT_EQ(2 * single.occupied_nm, batch.occupied_nm);
+    ASSERT_EQ(std::min(single.free_nm, 1u), batch.free_nm);
+  });
+}
+
+TEST_F(BatchedScanInsertionTest, concurrentInsertionMatchesSequential) {
+  test_concurrent_insertion(ScanInsertionMode::Batched);
+}
+
+TEST_F(BatchedScanInsertionTest, concurrentMergedInsertionMatchesSequential) {
+  test_concurrent_insertion(ScanInsertionMode::Batched_Merged_Free);
+}
+
+TEST_F(BatchedScanInsertionTest, concurrentInsertionImpliesBatching) {
+  auto concurrent_adder = adder(0, ScanInsertionMode::Immediate, 2);
+  ASSERT_EQ(ScanInsertionMode::Batched, concurrent_adder->insertion_mode());
+
+  // a map without concurrent updates support is updated sequentially
+  auto scan = generate_scan();
+  auto sequential_map = UnboundedPlainGridMap{cell_proto,
+                                              {MAP_WIDTH, MAP_HEIGHT,
+                                               MAP_SCALE}};
+  adder(0)->append_scan(sequential_map, pose, scan, 1.0, 0);
+  concurrent_adder->append_scan(dst_map, pose, scan, 1.0, 0);
+  for_each_cell(dst_map, [&](const GridMap::Coord &coord) {
+    ASSERT_EQ(sequential_map[coord].occupancy().prob_occ,
+              dst_map[coord].occupancy().prob_occ);
+  });
+}
+
 //============================================================================//
 
 int main (int argc, char *argv[]) {
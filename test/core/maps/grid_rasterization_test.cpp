@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "../directions.h"
 #include "../../../src/core/maps/grid_rasterization.h"
 
@@ -23,8 +25,8 @@ protected: // methods
 
   AreaIds area_to_ids(const Point2D &center, double side_len) {
     auto half_side = side_len / 2;
-    auto rect = Rectangle{-half_side, half_side,
-                          -half_side, half_side}.move_center(center);
+    auto rect = Rectangle(-half_side, half_side,
+                          -half_side, half_side).move_center(center);
     auto raw_ids = GridRasterizedRectangle{grid, rect}.to_vector();
     return AreaIds{raw_ids.begin(), raw_ids.end()};
   }
@@ -32,8 +34,8 @@ protected: // methods
   AreaIds area_to_ids(const Point2D &offset,
                       double bot_len, double top_len,
                       double left_len, double right_len) {
-    auto rect = Rectangle{-bot_len + offset.y, top_len + offset.y,
-                          -left_len + offset.x, right_len + offset.x};
+    auto rect = Rectangle(-bot_len + offset.y, top_len + offset.y,
+                          -left_len + offset.x, right_len + offset.x);
     auto raw_ids = GridRasterizedRectangle{grid, rect}.to_vector();
     return AreaIds{raw_ids.begin(), raw_ids.end()};
   }
@@ -361,6 +363,41 @@ TEST_F(RectangleGridRasterizationTest, areaInfinite) {
   ASSERT_EQ(expected, actual);
 }
 
+TEST_F(RectangleGridRasterizationTest, iteratorsFollowTraversalOrder) {
+  auto rect = Rectangle{-Cell_Len, Half_Cell_Len,
+                        0, 2 * Cell_Len + Half_Cell_Len};
+  using Order = GridTraversalOrder;
+  auto expected_col_major = std::vector<AreaId>{
+    {0, -1}, {0, 0}, {1, -1}, {1, 0}, {2, -1}, {2, 0}};
+  auto expected_row_major = std::vector<AreaId>{
+    {0, -1}, {1, -1}, {2, -1}, {0, 0}, {1, 0}, {2, 0}};
+  auto col_major = GridRasterizedRectangle{grid, rect, true,
+                                           Order::Column_Major};
+  auto row_major = GridRasterizedRectangle{grid, rect, true,
+                                           Order::Row_Major};
+  ASSERT_EQ(expected_col_major,
+            std::vector<AreaId>(col_major.begin(), col_major.end()));
+  ASSERT_EQ(expected_row_major,
+            std::vector<AreaId>(row_major.begin(), row_major.end()));
+  ASSERT_EQ(expected_col_major, std::move(col_major).to_vector());
+  ASSERT_EQ(expected_row_major, std::move(row_major).to_vector());
+}
+
+TEST_F(RectangleGridRasterizationTest, rowsCoverRectangle) {
+  auto rect = Rectangle{-Cell_Len, Half_Cell_Len,
+                        0, 2 * Cell_Len + Half_Cell_Len};
+  auto rasterized_rect = GridRasterizedRectangle{grid, rect};
+  auto by_rows = std::vector<AreaId>{};
+  rasterized_rect.for_each_row([&](const AreaId &row_begin, int row_len) {
+    for (int i = 0; i < row_len; ++i) {
+      by_rows.emplace_back(row_begin.x + i, row_begin.y);
+    }
+  });
+  auto by_areas = AreaIds{rasterized_rect.begin(), rasterized_rect.end()};
+  ASSERT_EQ(6u, by_rows.size());
+  ASSERT_EQ(by_areas, AreaIds(by_rows.begin(), by_rows.end()));
+}
+
 //============================================================================//
 
 int main (int argc, char *argv[]) {
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/grid_ray_caster.h"
+
+class GridRayCasterTest : public ::testing::Test {
+protected: // methods
+  GridRayCasterTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 1}}, rnd_engine{42} {}
+
+  void add_obstacle(const GridMap::Coord &area_id) {
+    map.update(area_id, {true, {1, 1}, {0, 0}, 1});
+  }
+
+  // the beam is rasterized and the first pierced obstacle area is found
+  RayCastHit reference_cast(const Point2D &origin, double angle,
+                            double max_range) {
+    auto beam = Point2D{max_range * std::cos(angle),
+                        max_range * std::sin(angle)};
+    for (auto &area_id : map.world_to_cells({origin, origin + beam})) {
+      if (map[area_id] < 1) { continue; }
+      auto ray = Ray{origin.x, beam.x, origin.y, beam.y};
+      auto inters = map.world_cell_bounds(area_id).find_intersections(ray);
+      if (inters.size() != 2) { continue; }
+      auto hit = RayCastHit{};
+      hit.is_hit = true;
+      hit.area_id = area_id;
+      hit.range = std::sqrt(origin.dist_sq({(inters[0].x + inters[1].x) / 2,
+                                            (inters[0].y + inters[1].y) / 2}));
+      return hit;
+    }
+    return RayCastHit{};
+  }
+
+  static void assert_hit(const RayCastHit &expected, const RayCastHit &actual,
+                         double range_eps = 1e-9) {
+    ASSERT_EQ(expected.is_hit, actual.is_hit);
+    if (!expected.is_hit) { return; }
+    ASSERT_EQ(expected.area_id, actual.area_id);
+    ASSERT_NEAR(expected.range, actual.range, range_eps);
+  }
+
+  RayCastHit cast(const Point2D &origin, double angle, double max_range) {
+    return GridRayCaster::cast(map, origin, angle, max_range,
+                               GridRayCaster::occupancy_threshold(map, 1));
+  }
+
+protected: // fields
+  UnboundedPlainGridMap map;
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(GridRayCasterTest, axisParallelRays) {
+  add_obstacle({5, 0});
+  add_obstacle({0, -3});
+  auto origin = Point2D{0.5, 0.5};
+  assert_hit({true, {5, 0}, 5}, cast(origin, 0, 100));
+  assert_hit({true, {0, -3}, 3}, cast(origin, -M_PI / 2, 100));
+  assert_hit({}, cast(origin, M_PI / 2, 100));
+  assert_hit({}, cast(origin, M_PI, 100));
+}
+
+TEST_F(GridRayCasterTest, maxRangeLimitsRays) {
+  add_obstacle({5, 0});
+  auto origin = Point2D{0.5, 0.5};
+  assert_hit({}, cast(origin, 0, 4.4));
+  // the area of the ray's end is traversed
+  assert_hit({true, {5, 0}, 5}, cast(origin, 0, 4.6));
+}
+
+TEST_F(GridRayCasterTest, cornerTouchIsNotHit) {
+  add_obstacle({1, 0});
+  add_obstacle({0, 1});
+  add_obstacle({3, 3});
+  assert_hit({true, {3, 3}, 3 * std::sqrt(2)},
+             cast({0.5, 0.5}, M_PI / 4, 100));
+}
+
+TEST_F(GridRayCasterTest, originAreaIsHitByItsChord) {
+  add_obstacle({0, 0});
+  assert_hit({true, {0, 0}, 0}, cast({0.5, 0.5}, 0.3, 100));
+  assert_hit({true, {0, 0}, 0.25}, cast({0.25, 0.5}, 0, 100));
+}
+
+TEST_F(GridRayCasterTest, matchesRasterizedBeam) {
+  auto coord_rv = std::uniform_int_distribution<int>{-30, 30};
+  for (int i = 0; i < 300; ++i) {
+    add_obstacle({coord_rv(rnd_engine), coord_rv(rnd_engine)});
+  }
+
+  auto pos_rv = std::uniform_real_distribution<double>{-10, 10};
+  auto angle_rv = std::uniform_real_distribution<double>{-M_PI, M_PI};
+  for (int i = 0; i < 2000; ++i) {
+    auto origin = Point2D{pos_rv(rnd_engine), pos_rv(rnd_engine)};
+    auto angle = angle_rv(rnd_engine);
+    assert_hit(reference_cast(origin, angle, 40), cast(origin, angle, 40),
+               1e-6);
+  }
+}
+
+TEST_F(GridRayCasterTest, concurrentCastIsSequentialOne) {
+  auto coord_rv = std::uniform_int_distribution<int>{-20, 20};
+  for (int i = 0; i < 100; ++i) {
+    add_obstacle({coord_rv(rnd_engine), coord_rv(rnd_engine)});
+  }
+
+  auto angles = std::vector<double>{};
+  for (int i = 0; i < 1000; ++i) { angles.push_back(i * 2 * M_PI / 1000); }
+  auto origin = Point2D{0.3, 0.6};
+  auto is_obstacle = GridRayCaster::occupancy_threshold(map, 1);
+  auto hits = std::vector<RayCastHit>{}, concurrent_hits = hits;
+  GridRayCaster{}.cast(map, origin, angles, 30, is_obstacle, hits);
+  GridRayCaster{4}.cast(map, origin, angles, 30, is_obstacle,
+                        concurrent_hits);
+  ASSERT_EQ(angles.size(), concurrent_hits.size());
+  for (std::size_t i = 0; i < angles.size(); ++i) {
+    assert_hit(hits[i], concurrent_hits[i], 0);
+    assert_hit(cast(origin, angles[i], 30), hits[i], 0);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
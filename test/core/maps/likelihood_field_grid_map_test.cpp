@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <algorithm>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/likelihood_field_grid_map.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+
+class LikelihoodFieldGridMapTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+  using MapT = LikelihoodFieldGridMap<UnboundedPlainGridMap>;
+protected: // methods
+  LikelihoodFieldGridMapTest()
+    : expected{MapT::expected_observation()}
+    , cell_proto{std::make_shared<MockGridCell>(0.5)} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  // the field by definition
+  double expected_discrepancy(const MapT &map, const Coord &area_id) {
+    int r = map.radius();
+    double min_discrepancy = 1;
+    for (int dy = -r; dy <= r; ++dy) {
+      for (int dx = -r; dx <= r; ++dx) {
+        auto &cell = map[area_id + Coord{dx, dy}];
+        min_discrepancy = std::min(cell.discrepancy(expected),
+                                   min_discrepancy);
+      }
+    }
+    return min_discrepancy;
+  }
+
+  void test_field(unsigned radius) {
+    auto map = MapT{cell_proto, {1, 1, 1}, radius};
+    auto rnd_engine = std::mt19937{42};
+    auto coord_rv = std::uniform_int_distribution<int>{-20, 20};
+    auto occ_rv = std::uniform_real_distribution<double>{0, 1};
+
+    for (int batch_i = 0; batch_i < 5; ++batch_i) {
+      for (int i = 0; i < 200; ++i) {
+        map.update({coord_rv(rnd_engine), coord_rv(rnd_engine)},
+                   obs(occ_rv(rnd_engine)));
+      }
+      for (int y = -25; y <= 25; ++y) {
+        for (int x = -25; x <= 25; ++x) {
+          ASSERT_NEAR(expected_discrepancy(map, {x, y}),
+                      map.discrepancy({x, y}, expected), 1e-6);
+        }
+      }
+    }
+  }
+protected: // fields
+  AreaOccupancyObservation expected;
+  std::shared_ptr<GridCell> cell_proto;
+};
+
+TEST_F(LikelihoodFieldGridMapTest, unknownArea) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  ASSERT_NEAR(0.5, map.discrepancy({1000, -1000}, expected), 1e-6);
+}
+
+TEST_F(LikelihoodFieldGridMapTest, otherObservationsAreNotAffected) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  map.update({0, 0}, obs(1.0));
+  ASSERT_NEAR(0.0, map.discrepancy({1, 1}, expected), 1e-6);
+  ASSERT_NEAR(0.3, map.discrepancy({1, 1}, obs(0.8)), 1e-6);
+  ASSERT_NEAR(0.2, map.discrepancy({0, 0}, obs(0.8)), 1e-6);
+}
+
+TEST_F(LikelihoodFieldGridMapTest, preparedFieldSupportsConcurrentReads) {
+  auto map = MapT{cell_proto, {1, 1, 1}};
+  map.update({0, 0}, obs(1.0));
+  ASSERT_FALSE(map.supports_concurrent_reads());
+
+  map.prepare_for_reads();
+  ASSERT_TRUE(map.supports_concurrent_reads());
+  ASSERT_NEAR(0.0, map.discrepancy({1, 1}, expected), 1e-6);
+  ASSERT_NEAR(0.5, map.discrepancy({2, 2}, expected), 1e-6);
+}
+
+TEST_F(LikelihoodFieldGridMapTest, fieldRadius0) { test_field(0); }
+TEST_F(LikelihoodFieldGridMapTest, fieldRadius1) { test_field(1); }
+TEST_F(LikelihoodFieldGridMapTest, fieldRadius3) { test_field(3); }
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
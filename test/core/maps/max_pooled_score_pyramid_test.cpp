@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <algorithm>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/max_pooled_score_pyramid.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+
+class MaxPooledScorePyramidTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+protected: // methods
+  MaxPooledScorePyramidTest()
+    : expected{MaxPooledScorePyramid::expected_observation()}
+    , map{std::make_shared<MockGridCell>(0.5), {1, 1, 1}} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  // the window max by definition
+  double expected_score(unsigned level, const Coord &c) {
+    int window_len = 1 << level;
+    double max_score = 0;
+    for (int dy = 0; dy < window_len; ++dy) {
+      for (int dx = 0; dx < window_len; ++dx) {
+        auto &cell = map[c + Coord{dx, dy}];
+        max_score = std::max(1.0 - cell.discrepancy(expected), max_score);
+      }
+    }
+    return max_score;
+  }
+
+  void update_randomly(std::mt19937 &rnd_engine, int updates_nm) {
+    auto coord_rv = std::uniform_int_distribution<int>{-20, 20};
+    auto occ_rv = std::uniform_real_distribution<double>{0, 1};
+    for (int i = 0; i < updates_nm; ++i) {
+      map.update({coord_rv(rnd_engine), coord_rv(rnd_engine)},
+                 obs(occ_rv(rnd_engine)));
+    }
+  }
+
+  // NB: windows that start outside the map are only bounded
+  void check_pyramid(const MaxPooledScorePyramid &pyramid) {
+    auto map_min = map.internal2external({0, 0});
+    for (unsigned level = 0; level < pyramid.levels_nm(); ++level) {
+      for (int y = -28; y <= 28; ++y) {
+        for (int x = -28; x <= 28; ++x) {
+          auto expected_s = expected_score(level, {x, y});
+          auto actual_s = pyramid.score(level, {x, y});
+          if (x < map_min.x || y < map_min.y) {
+            ASSERT_LE(expected_s, actual_s + 1e-6);
+          } else {
+            ASSERT_NEAR(expected_s, actual_s, 1e-6);
+          }
+        }
+      }
+    }
+  }
+protected: // fields
+  AreaOccupancyObservation expected;
+  UnboundedPlainGridMap map;
+};
+
+TEST_F(MaxPooledScorePyramidTest, unknownArea) {
+  auto pyramid = MaxPooledScorePyramid{3};
+  pyramid.sync(map);
+  ASSERT_NEAR(0.5, pyramid.score(2, {1000, -1000}), 1e-6);
+}
+
+TEST_F(MaxPooledScorePyramidTest, levelCoversTranslationRange) {
+  auto pyramid = MaxPooledScorePyramid{};
+  ASSERT_EQ(0u, pyramid.level(0, 0.125));
+  // e.g. [0.0625, 0.1875] touches 2 cells
+  ASSERT_EQ(1u, pyramid.level(0.125, 0.125));
+  // e.g. [0.0625, 0.3125] touches 3 cells
+  ASSERT_EQ(2u, pyramid.level(0.25, 0.125));
+  pyramid.ensure_levels(0.25, 0.125);
+  ASSERT_EQ(3u, pyramid.levels_nm());
+}
+
+TEST_F(MaxPooledScorePyramidTest, levelsAreMaxPooledScores) {
+  auto rnd_engine = std::mt19937{42};
+  update_randomly(rnd_engine, 300);
+  auto pyramid = MaxPooledScorePyramid{4};
+  pyramid.sync(map);
+  check_pyramid(pyramid);
+}
+
+TEST_F(MaxPooledScorePyramidTest, incrementalSync) {
+  auto rnd_engine = std::mt19937{42};
+  update_randomly(rnd_engine, 300);
+  auto pyramid = MaxPooledScorePyramid{4};
+  pyramid.sync(map);
+
+  // the map doesn't grow, so only modified areas are refreshed
+  auto occ_rv = std::uniform_real_distribution<double>{0, 1};
+  auto coord_rv = std::uniform_int_distribution<int>{-20, 20};
+  for (int batch_i = 0; batch_i < 5; ++batch_i) {
+    for (int i = 0; i < 3; ++i) {
+      auto area_id = Coord{coord_rv(rnd_engine), coord_rv(rnd_engine)};
+      if (!map.has_cell(area_id)) { continue; }
+      map.update(area_id, obs(occ_rv(rnd_engine)));
+    }
+    pyramid.sync(map);
+    check_pyramid(pyramid);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/out_of_core_tiled_grid_map.h"
+
+class OutOfCoreTiledGridMapTest : public ::testing::Test {
+protected: // consts
+  static constexpr unsigned Budget = 4;
+  static constexpr int Lim = 20;
+protected: // types
+  // 4x4 cells tiles
+  using MapT = GenericOutOfCoreTiledGridMap<PolymorphicCellStorage, 2>;
+protected: // methods
+  OutOfCoreTiledGridMapTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 1}, Budget} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+
+  static double value(int x, int y, int k = 1) { return k * (100.0 * x + y); }
+
+  void fill(MapT &m, int k = 1) {
+    for (int x = -Lim; x != Lim; ++x) {
+      for (int y = -Lim; y != Lim; ++y) {
+        m.update({x, y}, obs(value(x, y, k)));
+      }
+    }
+  }
+
+  void check(const MapT &m, int k = 1) {
+    for (int y = -Lim; y != Lim; ++y) {
+      for (int x = -Lim; x != Lim; ++x) {
+        ASSERT_EQ(value(x, y, k), (m[{x, y}]));
+        ASSERT_LE(m.known_tiles_nm(), Budget);
+      }
+    }
+  }
+protected: // fields
+  MapT map;
+};
+
+constexpr unsigned OutOfCoreTiledGridMapTest::Budget;
+constexpr int OutOfCoreTiledGridMapTest::Lim;
+
+TEST_F(OutOfCoreTiledGridMapTest, residentTilesAreBounded) {
+  fill(map);
+  ASSERT_LE(map.known_tiles_nm(), Budget);
+  ASSERT_LT(0u, map.evicted_tiles_nm());
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{10 * Lim, 10 * Lim}]));
+}
+
+TEST_F(OutOfCoreTiledGridMapTest, evictedTilesArePagedIn) {
+  fill(map);
+  // column-wise reading order differs from the writing one
+  check(map);
+  fill(map, 2);
+  check(map, 2);
+}
+
+TEST_F(OutOfCoreTiledGridMapTest, fileSpaceIsReused) {
+  fill(map);
+  check(map);
+  auto file_bytes = map.backing_file_bytes();
+  ASSERT_LT(0u, file_bytes);
+  for (int k = 2; k < 6; ++k) {
+    fill(map, k);
+    check(map, k);
+  }
+  ASSERT_EQ(file_bytes, map.backing_file_bytes());
+  ASSERT_FALSE(map.is_eviction_failed());
+}
+
+TEST_F(OutOfCoreTiledGridMapTest, fileSpaceOfCopyIsKept) {
+  fill(map);
+  auto map_copy = map;
+  auto file_bytes = map.backing_file_bytes();
+  fill(map, 2);
+  // slots the copy refers to are not reused
+  ASSERT_LT(file_bytes, map.backing_file_bytes());
+  check(map_copy);
+  check(map, 2);
+}
+
+TEST_F(OutOfCoreTiledGridMapTest, modifyMapCopy) {
+  fill(map);
+  auto map_copy = map;
+  fill(map_copy, 3);
+  check(map);
+  check(map_copy, 3);
+}
+
+TEST_F(OutOfCoreTiledGridMapTest, checkpointsWithEvictedTiles) {
+  fill(map);
+  auto base = map.save_full_checkpoint();
+  map.update({-Lim, -Lim}, obs(-1));
+  map.update({Lim - 1, Lim - 1}, obs(-2));
+  auto delta = map.save_delta_checkpoint();
+
+  auto restored = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}, Budget};
+  restored.load_state(base);
+  check(restored);
+  restored.load_state(delta);
+  ASSERT_LE(restored.known_tiles_nm(), Budget);
+  ASSERT_EQ(-1, (restored[{-Lim, -Lim}]));
+  ASSERT_EQ(-2, (restored[{Lim - 1, Lim - 1}]));
+  ASSERT_EQ(value(0, 0), (restored[{0, 0}]));
+}
+
+TEST(ValueOutOfCoreTiledGridMapTest, singleResidentTile) {
+  auto map = ValueOutOfCoreTiledGridMap<MockGridCell, 1>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}, 1};
+  map.update({0, 0}, {true, {0.1, 0}, {0, 0}, 0});
+  map.update({5, 5}, {true, {0.2, 0}, {0, 0}, 0});
+  map.update({-5, 5}, {true, {0.3, 0}, {0, 0}, 0});
+  ASSERT_EQ(1u, map.known_tiles_nm());
+  ASSERT_EQ(2u, map.evicted_tiles_nm());
+
+  ASSERT_EQ(0.1, (map[{0, 0}]));
+  ASSERT_EQ(0.2, (map[{5, 5}]));
+  ASSERT_EQ(0.3, (map[{-5, 5}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{-4, 5}]));
+  ASSERT_EQ(1u, map.known_tiles_nm());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
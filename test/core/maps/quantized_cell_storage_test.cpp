@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <cstdint>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/quantized_cell_storage.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/typed_grid_map.h"
+#include "../../../src/core/maps/packed_tbm_cell_codec.h"
+#include "../../../src/slams/viny/viny_grid_cell.h"
+#include "../../../src/slams/credibilist/grid_cell.h"
+
+template <typename UInt>
+void test_fixed_point_precision() {
+  using FP = UnitFixedPoint<UInt>;
+  const double max_error = 0.5 / FP::Max_Value + 1e-12;
+  for (double v = 0; v <= 1.0; v += 0.001) {
+    ASSERT_NEAR(v, FP::decode(FP::encode(v)), max_error);
+  }
+  ASSERT_EQ(0.0, FP::decode(FP::encode(-0.5)));
+  ASSERT_EQ(1.0, FP::decode(FP::encode(1.5)));
+}
+
+TEST(UnitFixedPointTest, precision8bit) {
+  test_fixed_point_precision<uint8_t>();
+}
+
+TEST(UnitFixedPointTest, precision16bit) {
+  test_fixed_point_precision<uint16_t>();
+}
+
+TEST(QuantizedCellStorageTest, packedSize) {
+  ASSERT_EQ(2u, sizeof(QuantizedOccupancyCodec<MockGridCell,
+                                               uint8_t>::Packed));
+  ASSERT_EQ(4u, sizeof(QuantizedOccupancyCodec<MockGridCell>::Packed));
+  ASSERT_EQ(8u, sizeof(QuantizedVinyDSCellCodec<>::Packed));
+  ASSERT_EQ(12u, sizeof(PackedTBMCellCodec<VinyDSCell>::Packed));
+  ASSERT_EQ(6u, (sizeof(PackedTBMCellCodec<VinyDSCell, uint16_t>::Packed)));
+  ASSERT_LE(3 * sizeof(PackedTBMCellCodec<VinyDSCell>::Packed),
+            sizeof(VinyDSCell));
+  ASSERT_LE(4 * sizeof(QuantizedOccupancyCodec<MockGridCell>::Packed),
+            sizeof(MockGridCell));
+}
+
+template <typename MapT>
+void test_quantized_map_read_write(double max_error) {
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  static constexpr int Lim = 20;
+  auto value = [](int i, int j) { return ((i + Lim) * 2 * Lim + j + Lim) /
+                                         (4.0 * Lim * Lim); };
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      map.update({i, j}, {true, {value(i, j), 1}, {0, 0}, 0});
+    }
+  }
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      ASSERT_NEAR(value(i, j), (map[{i, j}]), max_error);
+      auto aoo = AreaOccupancyObservation{true, {1, 1}, {0, 0}, 0};
+      ASSERT_NEAR(1 - value(i, j), map.discrepancy({i, j}, aoo), max_error);
+    }
+  }
+  ASSERT_NEAR(MockGridCell::Default_Occ_Prob, (map[{3 * Lim, 0}]),
+              max_error);
+}
+
+TEST(QuantizedCellStorageTest, plainMap8bit) {
+  using Storage = QuantizedCellStorage<QuantizedOccupancyCodec<MockGridCell,
+                                                               uint8_t>>;
+  test_quantized_map_read_write<GenericUnboundedPlainGridMap<Storage>>(
+    1.0 / 255);
+}
+
+TEST(QuantizedCellStorageTest, tiledMap16bit) {
+  using Storage = QuantizedCellStorage<QuantizedOccupancyCodec<MockGridCell>>;
+  test_quantized_map_read_write<GenericUnboundedLazyTiledGridMap<Storage>>(
+    1.0 / 65535);
+}
+
+TEST(QuantizedCellStorageTest, vinyCellCodec) {
+  auto cell = VinyDSCell{};
+  auto aoo = AreaOccupancyObservation{true, {0.8, 0.7}, {0, 0}, 1};
+  cell += aoo;
+  cell += aoo;
+
+  using Codec = QuantizedVinyDSCellCodec<>;
+  auto decoded = Codec::decode(Codec::encode(cell));
+  ASSERT_NEAR(cell.belief().occupied(), decoded.belief().occupied(), 1e-4);
+  ASSERT_NEAR(cell.belief().empty(), decoded.belief().empty(), 1e-4);
+  ASSERT_NEAR(cell.belief().unknown(), decoded.belief().unknown(), 1e-4);
+  ASSERT_NEAR(cell.occupancy().prob_occ, decoded.occupancy().prob_occ, 1e-4);
+  ASSERT_NEAR(cell.discrepancy(aoo), decoded.discrepancy(aoo), 1e-4);
+}
+
+template <typename Codec>
+void test_packed_tbm_cell_codec(double max_error) {
+  using Cell = typename Codec::Cell;
+  auto cell = Cell{};
+  auto aoo = AreaOccupancyObservation{true, {0.8, 0.7}, {0, 0}, 1};
+  cell += aoo;
+  cell += AreaOccupancyObservation{false, {0.1, 0.4}, {0, 0}, 1};
+
+  auto decoded = Codec::decode(Codec::encode(cell));
+  ASSERT_NEAR(cell.belief().occupied(), decoded.belief().occupied(),
+              max_error);
+  ASSERT_NEAR(cell.belief().empty(), decoded.belief().empty(), max_error);
+  ASSERT_NEAR(cell.belief().unknown(), decoded.belief().unknown(), max_error);
+  ASSERT_EQ(0.0, decoded.belief().conflict());
+  ASSERT_NEAR(cell.occupancy().prob_occ, decoded.occupancy().prob_occ,
+              max_error);
+  ASSERT_NEAR(cell.discrepancy(aoo), decoded.discrepancy(aoo), 2 * max_error);
+}
+
+TEST(QuantizedCellStorageTest, packedVinyCellCodec) {
+  test_packed_tbm_cell_codec<PackedTBMCellCodec<VinyDSCell>>(1e-6);
+  test_packed_tbm_cell_codec<PackedTBMCellCodec<VinyDSCell, uint16_t>>(1e-4);
+}
+
+TEST(QuantizedCellStorageTest, packedCredibilistCellCodec) {
+  test_packed_tbm_cell_codec<PackedTBMCellCodec<CredibilistCell>>(1e-6);
+}
+
+TEST(QuantizedCellStorageTest, packedVinyCellsTiledMap) {
+  using Codec = PackedTBMCellCodec<VinyDSCell>;
+  using MapT = GenericUnboundedLazyTiledGridMap<QuantizedCellStorage<Codec>>;
+  auto map = MapT{std::make_shared<VinyDSCell>(), {1, 1, 1}};
+  auto ref_map = TypedGridMap<VinyDSCell>{std::make_shared<VinyDSCell>(),
+                                          {1, 1, 1}};
+  for (int i = -20; i != 20; ++i) {
+    auto aoo = AreaOccupancyObservation{i % 3 == 0, {(i + 20) / 40.0, 0.9},
+                                        {0, 0}, 0.8};
+    map.update({i, i}, aoo);
+    map.update({i, i}, aoo);
+    ref_map.update({i, i}, aoo);
+    ref_map.update({i, i}, aoo);
+  }
+  auto aoo = AreaOccupancyObservation{true, {0.9, 1}, {0, 0}, 1};
+  for (int i = -30; i != 30; ++i) {
+    ASSERT_NEAR(ref_map.occupancy({i, i}), map.occupancy({i, i}), 1e-6);
+    ASSERT_NEAR(ref_map.discrepancy({i, i}, aoo),
+                map.discrepancy({i, i}, aoo), 1e-6);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
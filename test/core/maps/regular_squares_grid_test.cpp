@@ -281,6 +281,15 @@ TEST_F(RSGSegmentRasterizationTest, verticalLineAlinedBwd) {
             DSegment({{0, 0}, {-1, 0}, {-2, 0}, {-3, 0}, {-4, 0}}));
 }
 
+TEST_F(RSGSegmentRasterizationTest, reusedBuffer) {
+  auto cells = DSegment{{-1, -1}, {-2, -2}, {-3, -3}, {-4, -4}, {-5, -5},
+                        {-6, -6}, {-7, -7}};
+  grid.world_to_cells({cell_middle({0, 0}), cell_middle({3, 2})}, cells);
+  ASSERT_EQ(DSegment({{0, 0}, {1, 0}, {1, 1}, {2, 1}, {2, 2}, {3, 2}}), cells);
+  grid.world_to_cells({cell_middle({0, 0}), cell_middle({0, 3})}, cells);
+  ASSERT_EQ(DSegment({{0, 0}, {0, 1}, {0, 2}, {0, 3}}), cells);
+}
+
 //============================================================================//
 
 class RSGInfinityScalingTest : public ::testing::Test {
@@ -210,6 +210,73 @@ TEST_F(RescalableCachingGridMapTest, approximationLevelExtension) {
   }
 }
 
+TEST_F(RescalableCachingGridMapTest, batchedUpdatesPropagation) {
+  auto map = TesteeMapType<>{cell_proto, {16, 16, 1}};
+  map.set_scale_id(map.finest_scale_id());
+
+  auto aoo = AreaOccupancyObservation{true, Occupancy{0, 0}, Point2D{0, 0}, 1};
+  // several updates of the same coarse areas within a batch
+  for (auto &coord_occ : {std::make_pair(DiscretePoint2D{1, 1}, 5.0),
+                          std::make_pair(DiscretePoint2D{0, 1}, 7.0),
+                          std::make_pair(DiscretePoint2D{1, 1}, 3.0)}) {
+    aoo.occupancy.prob_occ = coord_occ.second;
+    map.update(coord_occ.first, aoo);
+  }
+  map.rescale(4);
+  ASSERT_EQ(7.0, double(map[map.world_to_cell(1.5, 1.5)]));
+
+  map.set_scale_id(map.finest_scale_id());
+  aoo.occupancy.prob_occ = 9;
+  map.update({1, 0}, aoo);
+  map.sync_coarser_maps();
+  map.set_scale_id(map.coarsest_scale_id());
+  ASSERT_EQ(9.0, double(map[{0, 0}]));
+}
+
+TEST_F(RescalableCachingGridMapTest, lazyCoarserMapsInit) {
+  auto map = TesteeMapType<>{cell_proto, {16, 16, 1}};
+  // updates before coarser maps are requested
+  auto aoo = AreaOccupancyObservation{true, Occupancy{4, 0}, Point2D{0, 0}, 1};
+  map.update({2, 3}, aoo);
+  aoo.occupancy.prob_occ = 6;
+  map.update({-5, -4}, aoo);
+
+  map.rescale(4);
+  ASSERT_EQ(4, map.scale());
+  ASSERT_EQ(4.0, double(map[map.world_to_cell(2.5, 3.5)]));
+  ASSERT_EQ(6.0, double(map[map.world_to_cell(-4.5, -3.5)]));
+  map.rescale(3);
+  ASSERT_EQ(4, map.scale());
+  map.rescale(1e6);
+  ASSERT_EQ(map.coarsest_scale_id(), map.scale_id());
+  ASSERT_EQ(6.0, double(map[{0, 0}]));
+  map.rescale(0.5);
+  ASSERT_EQ(map.finest_scale_id(), map.scale_id());
+}
+
+TEST_F(RescalableCachingGridMapTest, copyIsIndependentAndSharesTiles) {
+  auto map = TesteeMapType<UnboundedLazyTiledGridMap>{cell_proto,
+                                                     {16, 16, 1}};
+  auto aoo = AreaOccupancyObservation{true, Occupancy{4, 0}, Point2D{0, 0}, 1};
+  map.update({2, 3}, aoo);
+  map.rescale(4);
+  map.set_scale_id(map.finest_scale_id());
+
+  auto copy = map;
+  ASSERT_EQ(map.memory_usage().levels_bytes, copy.memory_usage().levels_bytes);
+  aoo.occupancy.prob_occ = 8;
+  copy.update({-5, -4}, aoo);
+  ASSERT_EQ(8.0, double(copy[{-5, -4}]));
+  ASSERT_EQ(Default_Occupancy_Prob, double(map[{-5, -4}]));
+  ASSERT_EQ(4.0, double(copy[{2, 3}]));
+
+  // coarser maps are synced per copy
+  copy.rescale(1e6);
+  map.rescale(1e6);
+  ASSERT_EQ(8.0, double(copy[{0, 0}]));
+  ASSERT_EQ(4.0, double(map[{0, 0}]));
+}
+
 int main (int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/scratch_grid_map.h"
+
+class ScratchGridMapTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+protected: // methods
+  ScratchGridMapTest()
+    : map{std::make_shared<MockGridCell>(), 1} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+protected: // fields
+  ScratchGridMap<MockGridCell> map;
+};
+
+TEST_F(ScratchGridMapTest, reshapeCoversRequestedAreas) {
+  map.reshape({-3, 5}, {4, 7});
+  ASSERT_EQ(8, map.width());
+  ASSERT_EQ(3, map.height());
+  ASSERT_TRUE(map.has_cell({-3, 5}));
+  ASSERT_TRUE(map.has_cell({4, 7}));
+  ASSERT_FALSE(map.has_cell({-4, 5}));
+  ASSERT_FALSE(map.has_cell({4, 8}));
+
+  map.update({4, 7}, obs(0.9));
+  map.update({-3, 5}, obs(0.1));
+  ASSERT_EQ(0.9, (map[{4, 7}]));
+  ASSERT_EQ(0.1, (map[{-3, 5}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{0, 6}]));
+}
+
+TEST_F(ScratchGridMapTest, reshapeResetsWrittenCellsOnly) {
+  map.reshape({0, 0}, {9, 9});
+  map.update({1, 2}, obs(0.9));
+  map.update({1, 2}, obs(0.8));
+  map.reset({3, 4}, MockGridCell{0.2});
+  ASSERT_EQ(2u, map.written_cells_nm());
+
+  // a narrower map reuses the buffer, so stale cells would be visible
+  map.reshape({-2, -1}, {2, 1});
+  ASSERT_EQ(0u, map.written_cells_nm());
+  for (int x = -2; x <= 2; ++x) {
+    for (int y = -1; y <= 1; ++y) {
+      ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{x, y}]));
+    }
+  }
+
+  // a larger map grows the buffer
+  map.update({2, 1}, obs(0.7));
+  map.reshape({-20, -20}, {20, 20});
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{20, 20}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{0, 0}]));
+}
+
+TEST_F(ScratchGridMapTest, rowDiscrepanciesMatchCellOnes) {
+  map.reshape({-2, -2}, {2, 2});
+  for (int x = -2; x <= 2; ++x) {
+    map.update({x, 1}, obs(0.1 * (x + 3)));
+  }
+
+  // NB: the row starts and ends outside the map
+  auto expected_obs = obs(1.0);
+  auto row = std::vector<double>(9);
+  map.row_discrepancies({-4, 1}, row.size(), expected_obs, row.data());
+  auto unknown_discrepancy = MockGridCell{}.discrepancy(expected_obs);
+  for (int i = 0; i < int(row.size()); ++i) {
+    auto x = -4 + i;
+    auto expected = map.has_cell({x, 1}) ?
+      map.discrepancy({x, 1}, expected_obs) : unknown_discrepancy;
+    ASSERT_NEAR(expected, row[i], 1e-9);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
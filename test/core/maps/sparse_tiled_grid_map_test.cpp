@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/sparse_tiled_grid_map.h"
+#include "../../../src/core/maps/rescalable_caching_grid_map.h"
+
+class SparseTiledGridMapTest : public ::testing::Test {
+protected: // methods
+  SparseTiledGridMapTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 1}} {}
+
+  static AreaOccupancyObservation obs(double occ) {
+    return {true, {occ, 0}, {0, 0}, 0};
+  }
+protected: // fields
+  SparseTiledGridMap map;
+};
+
+TEST_F(SparseTiledGridMapTest, unknownCellsAreNotAllocated) {
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{100000, -100000}]));
+  ASSERT_EQ(0u, map.known_tiles_nm());
+}
+
+TEST_F(SparseTiledGridMapTest, farApartUpdates) {
+  static constexpr int Far = 1000000;
+  map.update({Far, Far}, obs(0.1));
+  map.update({-Far, Far}, obs(0.2));
+  map.update({-Far, -Far - 1}, obs(0.3));
+  map.update({0, -1}, obs(0.4));
+
+  ASSERT_EQ(0.1, (map[{Far, Far}]));
+  ASSERT_EQ(0.2, (map[{-Far, Far}]));
+  ASSERT_EQ(0.3, (map[{-Far, -Far - 1}]));
+  ASSERT_EQ(0.4, (map[{0, -1}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{0, 0}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{-Far, -Far}]));
+  ASSERT_EQ(4u, map.known_tiles_nm());
+
+  // the bounding box covers updated cells
+  using Coord = DiscretePoint2D;
+  for (auto &c : {Coord{Far, Far}, Coord{-Far, -Far - 1}}) {
+    auto ic = c + map.origin();
+    ASSERT_TRUE(0 <= ic.x && ic.x < map.width());
+    ASSERT_TRUE(0 <= ic.y && ic.y < map.height());
+  }
+}
+
+TEST_F(SparseTiledGridMapTest, modifyMapCopy) {
+  static constexpr int Lim = 300;
+  for (int i = -Lim; i < Lim; i += 7) {
+    map.update({i, -i}, obs(i));
+  }
+  auto map_copy = map;
+  for (int i = -Lim; i < Lim; i += 7) {
+    map_copy.update({i, -i}, obs(2 * i));
+  }
+  map_copy.update({5 * Lim, 5 * Lim}, obs(42));
+
+  for (int i = -Lim; i < Lim; i += 7) {
+    ASSERT_EQ(i, (map[{i, -i}]));
+    ASSERT_EQ(2 * i, (map_copy[{i, -i}]));
+  }
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (map[{5 * Lim, 5 * Lim}]));
+  ASSERT_EQ(42, (map_copy[{5 * Lim, 5 * Lim}]));
+}
+
+TEST_F(SparseTiledGridMapTest, deltaCheckpoints) {
+  map.update({0, 0}, obs(0.1));
+  map.update({-500, 300}, obs(0.2));
+  auto base = map.save_full_checkpoint();
+  ASSERT_EQ(0u, map.modified_tiles_nm());
+
+  map.update({1, 1}, obs(0.3));
+  map.update({2, 2}, obs(0.4));
+  ASSERT_EQ(1u, map.modified_tiles_nm());
+  auto delta1 = map.save_delta_checkpoint();
+  map.update({900, -900}, obs(0.5));
+  auto delta2 = map.save_delta_checkpoint();
+  // a delta contains only modified tiles
+  ASSERT_LT(delta2.size(), base.size());
+
+  auto restored = SparseTiledGridMap{std::make_shared<MockGridCell>(),
+                                     {1, 1, 1}};
+  ASSERT_TRUE(restored.load_state(base));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (restored[{1, 1}]));
+  ASSERT_TRUE(restored.load_state(delta1));
+  ASSERT_TRUE(restored.load_state(delta2));
+
+  auto compacted = SparseTiledGridMap{std::make_shared<MockGridCell>(),
+                                      {1, 1, 1}};
+  compacted.load_state(TiledMapCheckpoint::compact(base, {delta1, delta2}));
+  auto full = SparseTiledGridMap{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  full.load_state(map.save_state());
+
+  for (auto m : {&restored, &compacted, &full}) {
+    ASSERT_EQ(map.known_tiles_nm(), m->known_tiles_nm());
+    ASSERT_EQ(map.origin(), m->origin());
+    ASSERT_EQ(map.width(), m->width());
+    ASSERT_EQ(0.1, ((*m)[{0, 0}]));
+    ASSERT_EQ(0.2, ((*m)[{-500, 300}]));
+    ASSERT_EQ(0.3, ((*m)[{1, 1}]));
+    ASSERT_EQ(0.4, ((*m)[{2, 2}]));
+    ASSERT_EQ(0.5, ((*m)[{900, -900}]));
+  }
+}
+
+TEST_F(SparseTiledGridMapTest, corruptCheckpointsAreRejected) {
+  map.update({0, 0}, obs(0.1));
+  map.update({-500, 300}, obs(0.2));
+  auto base = map.save_full_checkpoint();
+  map.update({900, -900}, obs(0.3));
+  auto delta = map.save_delta_checkpoint();
+
+  auto restored = SparseTiledGridMap{std::make_shared<MockGridCell>(),
+                                     {1, 1, 1}};
+  ASSERT_TRUE(restored.load_state(base));
+  auto truncated_delta = std::vector<char>(delta.begin(), delta.end() - 1);
+  ASSERT_FALSE(restored.load_state(truncated_delta));
+  // the header only
+  ASSERT_FALSE(restored.load_state(std::vector<char>(
+    delta.begin(), delta.begin() + 2 * sizeof(uint32_t) + 1)));
+  ASSERT_FALSE(restored.load_state({}));
+  ASSERT_TRUE(TiledMapCheckpoint::compact(base, {truncated_delta}).empty());
+
+  // a checkpoint of a map with another tile size
+  auto small_tiles_map = ValueSparseTiledGridMap<MockGridCell, 3>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  small_tiles_map.update({7, 7}, obs(0.4));
+  ASSERT_FALSE(restored.load_state(small_tiles_map.save_state()));
+
+  // the map is kept
+  ASSERT_EQ(2u, restored.known_tiles_nm());
+  ASSERT_EQ(0.1, (restored[{0, 0}]));
+  ASSERT_EQ(0.2, (restored[{-500, 300}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (restored[{900, -900}]));
+  ASSERT_EQ(MockGridCell::Default_Occ_Prob, (restored[{7, 7}]));
+}
+
+TEST(ValueSparseTiledGridMapTest, smallTilesReadWrite) {
+  auto map = ValueSparseTiledGridMap<MockGridCell, 2>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  for (int x = -9; x != 9; ++x) {
+    for (int y = -9; y != 9; ++y) {
+      map.update({x, y}, {true, {100.0 * x + y, 0}, {0, 0}, 0});
+    }
+  }
+  for (int x = -9; x != 9; ++x) {
+    for (int y = -9; y != 9; ++y) {
+      ASSERT_EQ(100.0 * x + y, (map[{x, y}]));
+    }
+  }
+  ASSERT_EQ(36u, map.known_tiles_nm());
+}
+
+TEST(SparseTiledGridMapRescalingTest, backMapOfRescalableCachingGridMap) {
+  auto map = RescalableCachingGridMap<SparseTiledGridMap>{
+    std::make_shared<MockGridCell>(0), {1, 1, 1}};
+  map.update({-200, 3}, {true, {0.7, 0}, {0, 0}, 0});
+  map.update({150, -40}, {true, {0.9, 0}, {0, 0}, 0});
+
+  map.set_scale_id(map.coarsest_scale_id());
+  ASSERT_EQ(0.9, (map[{0, 0}]));
+  map.set_scale_id(map.finest_scale_id());
+  ASSERT_EQ(0.7, (map[{-200, 3}]));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
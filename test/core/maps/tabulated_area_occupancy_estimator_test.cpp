@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+#include "../../../src/core/maps/tabulated_area_occupancy_estimator.h"
+
+class TabulatedAreaOccupancyEstimatorTest : public ::testing::Test {
+protected: // consts
+  static constexpr double Base_Empty_Prob = 0.01;
+  static constexpr double Base_Occup_Prob = 0.95;
+  static constexpr unsigned Resolution = 16;
+protected: // methods
+  TabulatedAreaOccupancyEstimatorTest()
+    : base_occ{Base_Occup_Prob, 1.0}, base_empty{Base_Empty_Prob, 1.0}
+    , aoe{base_occ, base_empty}
+    , taoe{base_occ, base_empty, Resolution}
+    , cell{-0.5, 0.5, 2, 3} {}
+
+  // a beam between random points on circles that enclose the cell
+  Segment2D random_beam() {
+    auto angle = std::uniform_real_distribution<double>{0, 2 * M_PI};
+    auto c = cell.center();
+    auto beg_th = angle(rnd_engine), end_th = angle(rnd_engine);
+    return {{c.x + 2 * std::cos(beg_th), c.y + 2 * std::sin(beg_th)},
+            {c.x + 3 * std::cos(end_th), c.y + 3 * std::sin(end_th)}};
+  }
+
+protected: // fields
+  Occupancy base_occ, base_empty;
+  AreaOccupancyEstimator aoe;
+  TabulatedAreaOccupancyEstimator taoe;
+  Rectangle cell;
+  std::mt19937 rnd_engine{42};
+};
+
+TEST_F(TabulatedAreaOccupancyEstimatorTest, piercedCellErrorIsBounded) {
+  unsigned pierced_nm = 0;
+  for (int i = 0; i < 10000; ++i) {
+    auto beam = random_beam();
+    auto expected = aoe.estimate_occupancy(beam, cell, false);
+    auto actual = taoe.estimate_occupancy(beam, cell, false);
+    if (!expected.is_valid()) { continue; }
+    ++pierced_nm;
+    ASSERT_EQ(expected.prob_occ, actual.prob_occ);
+    ASSERT_NEAR(expected.estimation_quality, actual.estimation_quality,
+                1.0 / Resolution);
+  }
+  ASSERT_LT(1000u, pierced_nm);
+}
+
+TEST_F(TabulatedAreaOccupancyEstimatorTest, beamEndCellsAreExact) {
+  auto c = cell.center();
+  auto stops_inside = Segment2D{{c.x - 3, c.y - 1}, {c.x + 0.1, c.y + 0.2}};
+  auto starts_inside = Segment2D{{c.x + 0.3, c.y - 0.1}, {c.x - 4, c.y + 1}};
+  for (bool is_occ : {true, false}) {
+    ASSERT_EQ(aoe.estimate_occupancy(stops_inside, cell, is_occ),
+              taoe.estimate_occupancy(stops_inside, cell, is_occ));
+    ASSERT_EQ(aoe.estimate_occupancy(starts_inside, cell, is_occ),
+              taoe.estimate_occupancy(starts_inside, cell, is_occ));
+  }
+}
+
+TEST_F(TabulatedAreaOccupancyEstimatorTest, unrelatedCellIsInvalid) {
+  auto beam = Segment2D{{cell.left() - 1, cell.top() + 1},
+                        {cell.right() + 1, cell.top() + 2}};
+  ASSERT_EQ(Occupancy::invalid(), taoe.estimate_occupancy(beam, cell, false));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "../../../src/core/maps/transferable_belief_model.h"
+#include "../../../src/core/maps/typed_grid_map.h"
+#include "../../../src/slams/viny/viny_grid_cell.h"
+#include "../../../src/slams/credibilist/grid_cell.h"
+
+class TBMTest : public ::testing::Test {
+protected: // methods
+  TBM random_tbm() {
+    auto mass = std::uniform_real_distribution<double>{0, 1};
+    return TBM{mass(rnd_engine), mass(rnd_engine),
+               mass(rnd_engine), mass(rnd_engine)};
+  }
+
+  // the generic combination: masses of a|b get products of a and b masses
+  static TBM reference_conjunctive(const TBM &lhs, const TBM &rhs) {
+    double l[] = {lhs.unknown(), lhs.empty(), lhs.occupied(), lhs.conflict()};
+    double r[] = {rhs.unknown(), rhs.empty(), rhs.occupied(), rhs.conflict()};
+    double result[4] = {};
+    for (int l_id = 0; l_id < 4; ++l_id) {
+      for (int r_id = 0; r_id < 4; ++r_id) {
+        result[l_id | r_id] += l[l_id] * r[r_id];
+      }
+    }
+    auto tbm = TBM{result[0], result[1], result[2], result[3]};
+    tbm.normalize();
+    return tbm;
+  }
+
+  // the two-step update of a belief with an observation
+  static TBM reference_update(const TBM &belief,
+                              const AreaOccupancyObservation &aoo) {
+    auto updated = conjunctive(belief, AOO_to_TBM(aoo));
+    updated.normalize_conflict();
+    return updated;
+  }
+
+  static void assert_tbm_near(const TBM &expected, const TBM &actual) {
+    ASSERT_NEAR(expected.unknown(), actual.unknown(), 1e-12);
+    ASSERT_NEAR(expected.empty(), actual.empty(), 1e-12);
+    ASSERT_NEAR(expected.occupied(), actual.occupied(), 1e-12);
+    ASSERT_EQ(0.0, actual.conflict());
+  }
+
+  static void assert_tbm(const TBM &expected, const TBM &actual) {
+    ASSERT_EQ(expected.unknown(), actual.unknown());
+    ASSERT_EQ(expected.empty(), actual.empty());
+    ASSERT_EQ(expected.occupied(), actual.occupied());
+    ASSERT_EQ(expected.conflict(), actual.conflict());
+  }
+protected: // fields
+  std::mt19937 rnd_engine{42};
+};
+
+TEST_F(TBMTest, conjunctiveMatchesGenericCombination) {
+  for (int i = 0; i < 1000; ++i) {
+    auto lhs = random_tbm(), rhs = random_tbm();
+    auto combined = conjunctive(lhs, rhs);
+    assert_tbm(reference_conjunctive(lhs, rhs), combined);
+    ASSERT_EQ(combined.conflict(), conjunctive_conflict(lhs, rhs));
+  }
+}
+
+TEST_F(TBMTest, conjunctiveOfZeroMassesIsUnknown) {
+  auto zero = TBM{0, 0, 0, 0};
+  assert_tbm(TBM{}, conjunctive(zero, random_tbm()));
+  ASSERT_EQ(0.0, conjunctive_conflict(random_tbm(), zero));
+}
+
+TEST_F(TBMTest, conjunctiveNormalizedMatchesTwoStepCombination) {
+  auto mass = std::uniform_real_distribution<double>{0, 1};
+  for (int i = 0; i < 1000; ++i) {
+    auto lhs = random_tbm();
+    auto empty = mass(rnd_engine), occupied = mass(rnd_engine) * (1 - empty);
+    auto expected = conjunctive(lhs, TBM{1 - empty - occupied, empty,
+                                         occupied, 0});
+    expected.normalize_conflict();
+    assert_tbm_near(expected, conjunctive_normalized(lhs, empty, occupied));
+  }
+  // total conflict
+  assert_tbm(TBM{}, conjunctive_normalized(TBM{0, 1, 0, 0}, 0, 1));
+}
+
+TEST_F(TBMTest, cellsAreUpdatedWithObservationMasses) {
+  auto prob = std::uniform_real_distribution<double>{0, 1};
+  auto viny_cell = VinyDSCell{};
+  auto credibilist_cell = CredibilistCell{};
+  auto expected = TBM{};
+  for (int i = 0; i < 100; ++i) {
+    auto aoo = AreaOccupancyObservation{i % 3 == 0,
+                                        {prob(rnd_engine), prob(rnd_engine)},
+                                        {0, 0}, prob(rnd_engine)};
+    expected = reference_update(expected, aoo);
+    viny_cell += aoo;
+    credibilist_cell += aoo;
+    assert_tbm_near(expected, viny_cell.belief());
+    assert_tbm_near(expected, credibilist_cell.belief());
+    ASSERT_NEAR(TBM_to_O(expected).prob_occ, viny_cell.occupancy().prob_occ,
+                1e-12);
+  }
+  // an invalid observation changes nothing
+  viny_cell += {true, Occupancy::invalid(), {0, 0}, 1};
+  assert_tbm_near(expected, viny_cell.belief());
+}
+
+TEST_F(TBMTest, vinyCellRowDiscrepancies) {
+  auto map = TypedGridMap<VinyDSCell>{std::make_shared<VinyDSCell>(),
+                                      {16, 16, 1}};
+  auto prob = std::uniform_real_distribution<double>{0, 1};
+  for (int x = 0; x < 16; ++x) {
+    map.update({x, 3}, {x % 2 == 0, {prob(rnd_engine), 1}, {0, 0}, 0.8});
+  }
+
+  auto aoo = AreaOccupancyObservation{true, {0.9, 1}, {0, 0}, 0.7};
+  auto discrepancies = std::vector<double>(20);
+  map.row_discrepancies({-2, 3}, 20, aoo, discrepancies.data());
+  for (int i = 0; i < 20; ++i) {
+    auto area_id = GridMap::Coord{i - 2, 3};
+    ASSERT_EQ(map.discrepancy(area_id, aoo), discrepancies[i]);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
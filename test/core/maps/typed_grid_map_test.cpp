@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/typed_grid_map.h"
+
+class TypedGridMapTest : public ::testing::Test {
+protected: // methods
+  TypedGridMapTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 1}} {}
+
+  AreaOccupancyObservation aoo(double prob_occ) const {
+    return {true, {prob_occ, 0}, {0, 0}, 0};
+  }
+protected: // fields
+  TypedGridMap<MockGridCell> map;
+};
+
+TEST_F(TypedGridMapTest, unknownCell) {
+  ASSERT_EQ((map.cell({7, -3})), MockGridCell::Default_Occ_Prob);
+  ASSERT_EQ((map[{7, -3}]), MockGridCell::Default_Occ_Prob);
+  ASSERT_EQ(1, map.width());
+  ASSERT_EQ(1, map.height());
+}
+
+TEST_F(TypedGridMapTest, updateExpands) {
+  map.update({-2, 3}, aoo(0.7));
+  ASSERT_EQ(3, map.width());
+  ASSERT_EQ(4, map.height());
+  ASSERT_EQ((map.cell({-2, 3})), 0.7);
+  ASSERT_EQ(map.occupancy({-2, 3}), 0.7);
+  ASSERT_EQ((map.cell({0, 0})), MockGridCell::Default_Occ_Prob);
+}
+
+TEST_F(TypedGridMapTest, discrepancyMatchesCell) {
+  map.update({1, 1}, aoo(0.9));
+  auto obs = aoo(0.4);
+  ASSERT_EQ(map.discrepancy({1, 1}, obs), (map[{1, 1}].discrepancy(obs)));
+  ASSERT_NEAR(map.discrepancy({1, 1}, obs), 0.5, 1e-9);
+}
+
+TEST_F(TypedGridMapTest, resetThroughGridMapApi) {
+  GridMap &grid_map = map;
+  grid_map.reset({-1, -1}, MockGridCell{0.3});
+  ASSERT_EQ((map.cell({-1, -1})), 0.3);
+  ASSERT_EQ((grid_map[{-1, -1}]), 0.3);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "../mock_grid_cell.h"
 
@@ -76,6 +78,243 @@ TEST_F(UnboundedLazyTiledGridMapTest, modifyMapCopy) {
 
 }
 
+TEST(UnboundedValueLazyTiledGridMapTest, modifyMapCopyCell) {
+  auto map = UnboundedValueLazyTiledGridMap<MockGridCell>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  map.update({-200, 300}, {true, {0.7, 0}, {0, 0}, 0});
+  map.update({-199, 300}, {true, {0.3, 0}, {0, 0}, 0});
+
+  auto map_copy = map;
+  map_copy.update({-200, 300}, {true, {0.1, 0}, {0, 0}, 0});
+
+  ASSERT_EQ(MapInfo(map), MapInfo(map_copy));
+  ASSERT_EQ((map[{-200, 300}]), 0.7);
+  ASSERT_EQ((map_copy[{-200, 300}]), 0.1);
+  ASSERT_EQ((map[{-199, 300}]), 0.3);
+  ASSERT_EQ((map_copy[{-199, 300}]), 0.3);
+  ASSERT_EQ((map_copy[{0, 0}]), MockGridCell::Default_Occ_Prob);
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, copiesShareUnmodifiedTiles) {
+  using MapT = UnboundedValueLazyTiledGridMap<MockGridCell, 3>;
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  for (int x = 0; x < 32; x += 8) {
+    map.update({x, 0}, {true, {0.7, 0}, {0, 0}, 0});
+  }
+  ASSERT_EQ(4u, map.tile_sharing_stats().unique_tiles_nm);
+  ASSERT_EQ(0u, map.tile_sharing_stats().shared_tiles_nm);
+
+  auto map_copy = map;
+  map_copy.update({0, 0}, {true, {0.1, 0}, {0, 0}, 0});
+  ASSERT_EQ(1u, map.tile_sharing_stats().unique_tiles_nm);
+  ASSERT_EQ(3u, map.tile_sharing_stats().shared_tiles_nm);
+  ASSERT_EQ(1u, map_copy.tile_sharing_stats().unique_tiles_nm);
+  ASSERT_EQ(3u, map_copy.tile_sharing_stats().shared_tiles_nm);
+
+  // tiles are released with the last map that refers them
+  {
+    auto tmp_copy = map;
+  }
+  map_copy = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  ASSERT_EQ(4u, map.tile_sharing_stats().unique_tiles_nm);
+  ASSERT_EQ(0u, map.tile_sharing_stats().shared_tiles_nm);
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, stateIsRestored) {
+  using MapT = UnboundedValueLazyTiledGridMap<MockGridCell, 3>;
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  map.update({-200, 300}, {true, {0.7, 0}, {0, 0}, 0});
+  map.update({40, -5}, {true, {0.2, 0}, {0, 0}, 0});
+
+  auto restored = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  ASSERT_TRUE(restored.load_state(map.save_state()));
+  ASSERT_EQ(MapInfo(map), MapInfo(restored));
+  ASSERT_EQ((restored[{-200, 300}]), 0.7);
+  ASSERT_EQ((restored[{40, -5}]), 0.2);
+  ASSERT_EQ((restored[{0, 0}]), MockGridCell::Default_Occ_Prob);
+  // unknown tiles are not restored
+  ASSERT_EQ(2u, restored.tile_sharing_stats().unique_tiles_nm);
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, corruptStateIsRejected) {
+  using MapT = UnboundedValueLazyTiledGridMap<MockGridCell, 3>;
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  map.update({-200, 300}, {true, {0.7, 0}, {0, 0}, 0});
+  auto state = map.save_state();
+
+  auto restored = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  restored.update({0, 0}, {true, {0.2, 0}, {0, 0}, 0});
+  auto restored_info = MapInfo(restored);
+  // truncated tiles and a truncated layout
+  ASSERT_FALSE(restored.load_state(
+    std::vector<char>(state.begin(), state.begin() + 16)));
+  ASSERT_FALSE(restored.load_state(
+    std::vector<char>(state.begin(), state.end() - 1)));
+  ASSERT_FALSE(restored.load_state({}));
+  // the map is kept
+  ASSERT_EQ(restored_info, MapInfo(restored));
+  ASSERT_EQ((restored[{0, 0}]), 0.2);
+
+  // a layout that refers an unknown tile
+  auto tiles = MapT::TileTable{};
+  auto layout = Serializer{};
+  map.save_layout(layout, tiles);
+  ASSERT_LT(layout.result().size(),
+            restored.load_layout(layout.result(), 0, MapT::TileTable{}));
+  ASSERT_EQ((restored[{0, 0}]), 0.2);
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, sharedTilesAreSavedOnce) {
+  using MapT = UnboundedValueLazyTiledGridMap<MockGridCell, 3>;
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  for (int x = 0; x < 32; x += 8) {
+    map.update({x, 0}, {true, {0.7, 0}, {0, 0}, 0});
+  }
+  auto map_copy = map;
+  map_copy.update({0, 0}, {true, {0.1, 0}, {0, 0}, 0});
+
+  auto tiles = MapT::TileTable{};
+  auto layouts = Serializer{};
+  map.save_layout(layouts, tiles);
+  map_copy.save_layout(layouts, tiles);
+  ASSERT_EQ(5u, tiles.size());
+
+  auto tiles_state = Serializer{};
+  tiles.save(tiles_state);
+  auto restored = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  auto restored_copy = restored;
+  {
+    // NB: tiles are released by the table with the maps that refer them
+    auto restored_tiles = MapT::TileTable{};
+    restored_tiles.load(tiles_state.result(), 0, MockGridCell{});
+    ASSERT_EQ(5u, restored_tiles.size());
+
+    auto layouts_data = layouts.result();
+    auto pos = restored.load_layout(layouts_data, 0, restored_tiles);
+    ASSERT_EQ(layouts_data.size(),
+              restored_copy.load_layout(layouts_data, pos, restored_tiles));
+  }
+  ASSERT_EQ((restored[{0, 0}]), 0.7);
+  ASSERT_EQ((restored_copy[{0, 0}]), 0.1);
+  ASSERT_EQ((restored_copy[{24, 0}]), 0.7);
+  ASSERT_EQ(1u, restored_copy.tile_sharing_stats().unique_tiles_nm);
+  ASSERT_EQ(3u, restored_copy.tile_sharing_stats().shared_tiles_nm);
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, copiesAreUpdatedConcurrently) {
+  using MapT = UnboundedValueLazyTiledGridMap<MockGridCell, 3>;
+  static constexpr int Lim = 16;
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      map.update({i, j}, {true, {0.5, 0}, {0, 0}, 0});
+    }
+  }
+
+  auto copies = std::vector<MapT>(4, map);
+  auto updaters = std::vector<std::thread>{};
+  for (std::size_t copy_i = 0; copy_i < copies.size(); ++copy_i) {
+    updaters.emplace_back([&copies, copy_i]() {
+      auto &copy = copies[copy_i];
+      for (int i = -Lim; i != Lim; ++i) {
+        for (int j = -Lim; j != Lim; ++j) {
+          copy.update({i, j}, {true, {0.1 * copy_i, 0}, {0, 0}, 0});
+        }
+      }
+    });
+  }
+  for (auto &updater : updaters) { updater.join(); }
+
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      ASSERT_EQ((map[{i, j}]), 0.5);
+      for (std::size_t copy_i = 0; copy_i < copies.size(); ++copy_i) {
+        ASSERT_EQ((copies[copy_i][{i, j}]), 0.1 * copy_i);
+      }
+    }
+  }
+  for (auto &copy : copies) {
+    ASSERT_EQ(0u, copy.tile_sharing_stats().shared_tiles_nm);
+  }
+}
+
+template <typename MapT>
+void test_tile_geometry_value_storage() {
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  static constexpr int Lim = 40;
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      map.update({i, j}, {true, {(double)Lim * i + j, 0}, {0, 0}, 0});
+    }
+  }
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      ASSERT_EQ((map[{i, j}]), ((double)Lim * i + j));
+    }
+  }
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, smallColumnMajorTiles) {
+  test_tile_geometry_value_storage<
+    UnboundedValueLazyTiledGridMap<MockGridCell, 3>>();
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, smallMortonTiles) {
+  test_tile_geometry_value_storage<
+    UnboundedValueLazyTiledGridMap<MockGridCell, 3, MortonTileLayout>>();
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, defaultSizeMortonTiles) {
+  test_tile_geometry_value_storage<
+    UnboundedValueLazyTiledGridMap<MockGridCell, 7, MortonTileLayout>>();
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, rowOccupanciesOverUnknownTiles) {
+  auto map = UnboundedValueLazyTiledGridMap<MockGridCell, 3>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  // known tiles are separated by unknown ones
+  for (int i = -30; i < 30; i += 20) {
+    for (int j = 0; j < 3; ++j) {
+      map.update({i + j, 5}, {true, {0.1 * (j + 1), 0}, {0, 0}, 0});
+    }
+  }
+  // the row exceeds the map on both sides
+  static constexpr int Row_Len = 100;
+  double probs[Row_Len];
+  for (int y : {5, 6, 100}) {
+    map.row_occupancies({-50, y}, Row_Len, probs);
+    for (int i = 0; i < Row_Len; ++i) {
+      ASSERT_EQ(map.occupancy({-50 + i, y}), probs[i]);
+    }
+  }
+}
+
+TEST(UnboundedValueLazyTiledGridMapTest, bulkUpdatesMatchAreaUpdates) {
+  using Map = UnboundedValueLazyTiledGridMap<MockGridCell, 3>;
+  auto map = Map{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  auto reference = Map{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  auto aoo = AreaOccupancyObservation{true, {0.9, 0}, {0, 0}, 0};
+  // rows cross several tiles
+  map.update_area({-13, -2}, {20, 9}, aoo);
+  for (int y = -2; y <= 9; ++y) {
+    for (int x = -13; x <= 20; ++x) { reference.update({x, y}, aoo); }
+  }
+  // tiles of a copy are shared, so they are copied on a bulk write
+  auto map_copy = map;
+  map.clear_area({-5, 0}, {11, 3});
+  for (int y = 0; y <= 3; ++y) {
+    for (int x = -5; x <= 11; ++x) { reference.reset({x, y}, MockGridCell{}); }
+  }
+
+  for (int y = -20; y <= 20; ++y) {
+    for (int x = -20; x <= 30; ++x) {
+      ASSERT_EQ(reference.occupancy({x, y}), map.occupancy({x, y}));
+      bool is_filled = -13 <= x && x <= 20 && -2 <= y && y <= 9;
+      ASSERT_EQ(is_filled ? 0.9 : MockGridCell::Default_Occ_Prob,
+                map_copy.occupancy({x, y}));
+    }
+  }
+}
 
 int main (int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
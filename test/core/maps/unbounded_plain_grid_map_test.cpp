@@ -2,10 +2,13 @@
 
 #include <memory>
 #include <ostream>
+#include <cstdio>
+#include <vector>
 
 #include "../mock_grid_cell.h"
 
 #include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/quantized_cell_storage.h"
 
 class UnboundedPlainGridMapTest : public ::testing::Test {
 protected: // methods
@@ -96,6 +99,213 @@ TEST_F(UnboundedPlainGridMapTest, valueStorage) {
 
 }
 
+TEST_F(UnboundedPlainGridMapTest, alternatingGrowth) {
+  // expands the map to different sides interleaving reallocations
+  // with expansions to the reserved space
+  static constexpr int Steps = 120;
+  for (int i = 0; i != Steps; ++i) {
+    int sign = i % 2 ? 1 : -1;
+    map.update({sign * i, -sign * i / 2}, {true, {(double)i, 0}, {0, 0}, 0});
+  }
+  for (int i = 0; i != Steps; ++i) {
+    int sign = i % 2 ? 1 : -1;
+    ASSERT_EQ((map[{sign * i, -sign * i / 2}]), (double)i);
+  }
+  ASSERT_EQ((map[{Steps, Steps}]), MockGridCell::Default_Occ_Prob);
+  ASSERT_EQ((map[{-Steps / 2, 3}]), MockGridCell::Default_Occ_Prob);
+}
+
+TEST_F(UnboundedPlainGridMapTest, rowDiscrepancies) {
+  for (int i = -5; i < 5; ++i) {
+    map.update({i, 2}, {true, {0.1 * (i + 5), 0}, {0, 0}, 0});
+  }
+  // the row exceeds the map on both sides
+  static constexpr int Row_Len = 20;
+  double discrepancies[Row_Len];
+  map.row_discrepancies({-10, 2}, Row_Len, data, discrepancies);
+  for (int i = 0; i < Row_Len; ++i) {
+    ASSERT_NEAR(map.discrepancy({-10 + i, 2}, data), discrepancies[i], 1e-9);
+  }
+  map.row_discrepancies({-3, 100}, 3, data, discrepancies);
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_NEAR(map.discrepancy({-3 + i, 100}, data), discrepancies[i], 1e-9);
+  }
+}
+
+TEST_F(UnboundedPlainGridMapTest, rowOccupancies) {
+  for (int i = -5; i < 5; ++i) {
+    map.update({i, 2}, {true, {0.1 * (i + 5), 0}, {0, 0}, 0});
+  }
+  // the row exceeds the map on both sides
+  static constexpr int Row_Len = 20;
+  double probs[Row_Len];
+  map.row_occupancies({-10, 2}, Row_Len, probs);
+  for (int i = 0; i < Row_Len; ++i) {
+    ASSERT_EQ(map.occupancy({-10 + i, 2}), probs[i]);
+  }
+}
+
+class UnboundedContiguousPlainGridMapTest : public ::testing::Test {
+protected: // methods
+  UnboundedContiguousPlainGridMapTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 1}} {}
+protected: // fields
+  UnboundedContiguousPlainGridMap<MockGridCell> map;
+};
+
+TEST_F(UnboundedContiguousPlainGridMapTest, expandLeftDown) {
+  map.update({-2, -2}, {true, {0.5, 0.5}, {-1, -1}, 0});
+  ASSERT_EQ(MapInfo(map), MapInfo(3, 3, 2, 2));
+}
+
+TEST_F(UnboundedContiguousPlainGridMapTest, valueStorage) {
+  static constexpr int Lim = 50;
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      map.update({i, j}, {true, {(double)Lim * i + j, 0}, {0, 0}, 0});
+    }
+  }
+  for (int i = -Lim; i != Lim; ++i) {
+    for (int j = -Lim; j != Lim; ++j) {
+      ASSERT_EQ((map[{i, j}]), ((double)Lim * i + j));
+    }
+  }
+}
+
+TEST_F(UnboundedContiguousPlainGridMapTest, saveLoadState) {
+  map.update({-3, 2}, {true, {0.7, 0}, {0, 0}, 0});
+  map.update({4, -1}, {true, {0.2, 0}, {0, 0}, 0});
+
+  auto restored = UnboundedContiguousPlainGridMap<MockGridCell>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  ASSERT_TRUE(restored.load_state(map.save_state()));
+  ASSERT_EQ(MapInfo(restored), MapInfo(map));
+  ASSERT_EQ((restored[{-3, 2}]), 0.7);
+  ASSERT_EQ((restored[{4, -1}]), 0.2);
+  ASSERT_EQ((restored[{0, 0}]), MockGridCell::Default_Occ_Prob);
+}
+
+TEST_F(UnboundedContiguousPlainGridMapTest, corruptStateIsRejected) {
+  map.update({-3, 2}, {true, {0.7, 0}, {0, 0}, 0});
+  auto state = map.save_state();
+
+  auto restored = UnboundedContiguousPlainGridMap<MockGridCell>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  restored.update({0, 0}, {true, {0.2, 0}, {0, 0}, 0});
+  auto restored_info = MapInfo(restored);
+  ASSERT_FALSE(restored.load_state(
+    std::vector<char>(state.begin(), state.end() - 1)));
+  ASSERT_FALSE(restored.load_state(
+    std::vector<char>(state.begin(), state.begin() + 3)));
+  ASSERT_FALSE(restored.load_state({}));
+  // the map is kept
+  ASSERT_EQ(restored_info, MapInfo(restored));
+  ASSERT_EQ((restored[{0, 0}]), 0.2);
+}
+
+TEST_F(UnboundedContiguousPlainGridMapTest, saveLoadSnapshot) {
+  static const char *Snapshot_Path = "serialized_cells_snapshot.bin";
+  map.update({-3, 2}, {true, {0.7, 0}, {0, 0}, 0});
+  map.update({4, -1}, {true, {0.2, 0}, {0, 0}, 0});
+
+  auto restored = UnboundedContiguousPlainGridMap<MockGridCell>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  ASSERT_TRUE(map.save_snapshot(Snapshot_Path));
+  ASSERT_TRUE(restored.load_snapshot(Snapshot_Path));
+  std::remove(Snapshot_Path);
+  ASSERT_EQ(MapInfo(restored), MapInfo(map));
+  ASSERT_EQ((restored[{-3, 2}]), 0.7);
+  ASSERT_EQ((restored[{4, -1}]), 0.2);
+  ASSERT_EQ((restored[{0, 0}]), MockGridCell::Default_Occ_Prob);
+
+  // the restored map remains growable
+  restored.update({10, 10}, {true, {0.1, 0}, {0, 0}, 0});
+  ASSERT_EQ((restored[{10, 10}]), 0.1);
+  ASSERT_EQ((restored[{-3, 2}]), 0.7);
+}
+
+TEST(QuantizedUnboundedPlainGridMapTest, saveLoadRawSnapshot) {
+  static const char *Snapshot_Path = "raw_elements_snapshot.bin";
+  using MapT = GenericUnboundedPlainGridMap<QuantizedCellStorage<
+    QuantizedOccupancyCodec<MockGridCell, uint8_t>>>;
+  auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  map.update({-5, 3}, {true, {1, 0}, {0, 0}, 0});
+  map.update({6, -2}, {true, {0, 0}, {0, 0}, 0});
+  ASSERT_TRUE(map.save_snapshot(Snapshot_Path));
+
+  auto restored = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+  ASSERT_TRUE(restored.load_snapshot(Snapshot_Path));
+  ASSERT_EQ(MapInfo(restored), MapInfo(map));
+  ASSERT_EQ((restored[{-5, 3}]), 1);
+  ASSERT_EQ((restored[{6, -2}]), 0);
+  ASSERT_EQ((restored[{0, 0}]), double(map[{0, 0}]));
+
+  // a snapshot of another cell layout is rejected
+  auto other = UnboundedContiguousPlainGridMap<MockGridCell>{
+    std::make_shared<MockGridCell>(), {1, 1, 1}};
+  ASSERT_FALSE(other.load_snapshot(Snapshot_Path));
+  std::remove(Snapshot_Path);
+  ASSERT_FALSE(other.load_snapshot(Snapshot_Path));
+  ASSERT_EQ(MapInfo(other), MapInfo(1, 1, 0, 0));
+}
+
+TEST_F(UnboundedPlainGridMapTest, reservedAreaIsExpandedOnce) {
+  map.reserve_area({-10, -5}, {20, 7});
+  auto expanded = MapInfo(map);
+  ASSERT_EQ(expanded, MapInfo(31, 13, 10, 5));
+  // the map holds the area already
+  map.update_area({-10, -5}, {20, 7}, data);
+  ASSERT_EQ(expanded, MapInfo(map));
+}
+
+TEST_F(UnboundedPlainGridMapTest, bulkUpdatesMatchAreaUpdates) {
+  auto reference = UnboundedPlainGridMap{std::make_shared<MockGridCell>(),
+                                         {1, 1, 1}};
+  map.update_area({-7, -3}, {4, 5}, data);
+  for (int y = -3; y <= 5; ++y) {
+    for (int x = -7; x <= 4; ++x) { reference.update({x, y}, data); }
+  }
+
+  // a raster that crosses bounds of the map
+  static constexpr int W = 6, H = 4;
+  auto raster = std::vector<AreaOccupancyObservation>{};
+  for (int i = 0; i < W * H; ++i) {
+    raster.push_back({true, {0.05 * i, 0}, {0, 0}, 0});
+  }
+  map.update_raster({2, 3}, W, H, raster.data());
+  for (int y = 0; y < H; ++y) {
+    for (int x = 0; x < W; ++x) {
+      reference.update({2 + x, 3 + y}, raster[y * W + x]);
+    }
+  }
+
+  map.clear_area({-1, -1}, {1, 4});
+  for (int y = -1; y <= 4; ++y) {
+    for (int x = -1; x <= 1; ++x) { reference.reset({x, y}, MockGridCell{}); }
+  }
+
+  for (int y = -10; y <= 10; ++y) {
+    for (int x = -10; x <= 10; ++x) {
+      ASSERT_EQ(reference.occupancy({x, y}), map.occupancy({x, y}));
+    }
+  }
+}
+
+TEST_F(UnboundedPlainGridMapTest, bulkUpdatesAreReportedAsModifications) {
+  auto version = map.version();
+  map.update_area({-4, 2}, {3, 6}, data);
+  auto area = map.modified_area(version);
+  ASSERT_TRUE(area.is_known);
+  ASSERT_EQ(DiscretePoint2D(-4, 2), area.min);
+  ASSERT_EQ(DiscretePoint2D(3, 6), area.max);
+
+  version = map.version();
+  map.clear_area({0, -8}, {1, -7});
+  area = map.modified_area(version);
+  ASSERT_EQ(DiscretePoint2D(0, -8), area.min);
+  ASSERT_EQ(DiscretePoint2D(1, -7), area.max);
+}
+
 int main (int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -8,7 +8,8 @@ public:
   static constexpr double Default_Occ_Prob = 0.5;
 public:
   MockGridCell(double occ_prob = Default_Occ_Prob)
-    : GridCell{Occupancy{occ_prob, 0}} {}
+    : GridCell{Occupancy(occ_prob, 0)} {}
+  MockGridCell(const Occupancy &occ) : GridCell{occ} {}
 
   std::unique_ptr<GridCell> clone() const override {
     return std::make_unique<MockGridCell>(*this);
@@ -0,0 +1,247 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "../../src/core/particle_filter.h"
+
+class ParticleResamplersTest : public ::testing::Test {
+protected: // consts
+  static constexpr unsigned Seed = 42;
+protected: // methods
+  ParticleResamplersTest()
+    : weights{0.05, 0, 0.3, 0.025, 0.125, 0, 0.4, 0.1} {}
+
+  std::vector<unsigned> copies_nm(ParticleResampler &resampler) {
+    auto indices = std::vector<unsigned>{};
+    resampler.resample(weights, indices);
+    EXPECT_EQ(weights.size(), indices.size());
+    auto copies = std::vector<unsigned>(weights.size(), 0);
+    for (auto i : indices) {
+      EXPECT_LT(i, weights.size());
+      ++copies[i];
+    }
+    return copies;
+  }
+
+  // particles with zero weights are never picked; a particle with weight w
+  // is picked at least floor(n*w) times if the floor is kept
+  void test_copies(ParticleResampler &resampler, bool floor_is_kept) {
+    for (unsigned attempt = 0; attempt < 100; ++attempt) {
+      auto copies = copies_nm(resampler);
+      for (std::size_t i = 0; i < weights.size(); ++i) {
+        auto expected_copies = weights[i] * weights.size();
+        if (floor_is_kept) {
+          ASSERT_LE(std::floor(expected_copies), copies[i]);
+        }
+        if (weights[i] == 0) { ASSERT_EQ(0u, copies[i]); }
+      }
+    }
+  }
+
+  void test_is_unbiased(ParticleResampler &resampler) {
+    auto attempts_nm = 20000u;
+    auto total_copies = std::vector<double>(weights.size(), 0);
+    for (unsigned attempt = 0; attempt < attempts_nm; ++attempt) {
+      auto copies = copies_nm(resampler);
+      for (std::size_t i = 0; i < weights.size(); ++i) {
+        total_copies[i] += copies[i];
+      }
+    }
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+      ASSERT_NEAR(weights[i] * weights.size(),
+                  total_copies[i] / attempts_nm, 0.05);
+    }
+  }
+
+protected: // fields
+  std::vector<double> weights;
+};
+
+TEST_F(ParticleResamplersTest, systematic) {
+  auto resampler = SystematicResampler{Seed};
+  for (unsigned attempt = 0; attempt < 100; ++attempt) {
+    auto copies = copies_nm(resampler);
+    for (std::size_t i = 0; i < weights.size(); ++i) {
+      auto expected_copies = weights[i] * weights.size();
+      ASSERT_LE(std::floor(expected_copies), copies[i]);
+      ASSERT_LE(copies[i], std::ceil(expected_copies));
+    }
+  }
+  test_is_unbiased(resampler);
+}
+
+TEST_F(ParticleResamplersTest, stratified) {
+  auto resampler = StratifiedResampler{Seed};
+  test_copies(resampler, false);
+  test_is_unbiased(resampler);
+}
+
+TEST_F(ParticleResamplersTest, residual) {
+  auto resampler = ResidualResampler{Seed};
+  test_copies(resampler, true);
+  test_is_unbiased(resampler);
+}
+
+TEST_F(ParticleResamplersTest, multinomial) {
+  auto resampler = MultinomialResampler{Seed};
+  test_copies(resampler, false);
+  test_is_unbiased(resampler);
+}
+
+TEST_F(ParticleResamplersTest, unnormalizedWeights) {
+  auto resampler = SystematicResampler{Seed};
+  auto normalized_copies = copies_nm(resampler);
+  for (auto &w : weights) { w *= 3; }
+  resampler = SystematicResampler{Seed};
+  ASSERT_EQ(normalized_copies, copies_nm(resampler));
+}
+
+class CountedParticle : public Particle {
+public:
+  CountedParticle(unsigned id) : id{id} {}
+  void sample() override { ++samples_nm; }
+  unsigned id, samples_nm = 0;
+};
+
+class CountedParticleFactory : public ParticleFactory<CountedParticle> {
+public:
+  std::shared_ptr<CountedParticle> create_particle() override {
+    return std::make_shared<CountedParticle>(created_nm++);
+  }
+  std::shared_ptr<CountedParticle> clone_particle(
+      const CountedParticle &p) override {
+    ++cloned_nm;
+    return std::make_shared<CountedParticle>(p);
+  }
+  unsigned created_nm = 0, cloned_nm = 0;
+};
+
+TEST(ParticleFilterTest, resamplingMovesPickedParticles) {
+  auto factory = std::make_shared<CountedParticleFactory>();
+  auto pf = ParticleFilter<CountedParticle>{factory, 4};
+  pf.set_resampler(std::make_shared<SystematicResampler>(42));
+  auto weights = std::vector<double>{0, 3, 0.5, 0.5};
+  auto originals = std::vector<CountedParticle*>{};
+  for (std::size_t i = 0; i < weights.size(); ++i) {
+    pf.particles()[i]->set_weight(weights[i]);
+    originals.push_back(pf.particles()[i].get());
+  }
+  ASSERT_TRUE(pf.try_resample());
+
+  const auto &particles = pf.particles();
+  ASSERT_EQ(weights.size(), particles.size());
+  // NB: 3 copies of the second particle (incl. the original) + 1 of another
+  ASSERT_EQ(originals[1], particles[0].get());
+  ASSERT_EQ(0u, particles[0]->samples_nm);
+  for (std::size_t i = 1; i < 3; ++i) {
+    ASSERT_NE(originals[1], particles[i].get());
+    ASSERT_EQ(1u, particles[i]->samples_nm);
+  }
+  ASSERT_TRUE(particles[3].get() == originals[2] ||
+              particles[3].get() == originals[3]);
+  ASSERT_EQ(weights.size(), factory->created_nm);
+  ASSERT_EQ(2u, factory->cloned_nm);
+
+  auto total_weight = double{0};
+  for (auto &p : particles) { total_weight += p->weight(); }
+  ASSERT_NEAR(1.0, total_weight, 1e-12);
+  ASSERT_FALSE(pf.try_resample());
+}
+
+TEST(ParticleFilterTest, heaviestParticleIsTrackedOnNormalization) {
+  auto pf = ParticleFilter<CountedParticle>{
+    std::make_shared<CountedParticleFactory>(), 4};
+  ASSERT_EQ(pf.particles().back().get(), &pf.heaviest_particle());
+
+  auto weights = std::vector<double>{0.1, 0.5, 0.2, 0.5};
+  for (std::size_t i = 0; i < weights.size(); ++i) {
+    pf.particles()[i]->set_weight(weights[i]);
+  }
+  pf.normalize_weights();
+  ASSERT_EQ(pf.particles()[3].get(), &pf.heaviest_particle());
+
+  pf.particles()[1]->set_weight(2);
+  pf.normalize_weights();
+  ASSERT_EQ(pf.particles()[1].get(), &pf.heaviest_particle());
+  const auto &const_pf = pf;
+  ASSERT_EQ(&pf.heaviest_particle(), &const_pf.heaviest_particle());
+}
+
+struct TestPose {
+  double x, y, theta;
+};
+
+class PosedParticle : public Particle {
+public:
+  const TestPose &pose() const { return _pose; }
+  void set_pose(const TestPose &pose) { _pose = pose; }
+private:
+  TestPose _pose = {0, 0, 0};
+};
+
+class PosedParticleFactory : public ParticleFactory<PosedParticle> {
+public:
+  std::shared_ptr<PosedParticle> create_particle() override {
+    return std::make_shared<PosedParticle>();
+  }
+};
+
+class KldParticlesNumberTest : public ::testing::Test {
+protected: // types
+  using Adaptation = KldParticlesNumberAdaptation<PosedParticle>;
+protected: // methods
+  KldParticlesNumberTest()
+    : pf{std::make_shared<PosedParticleFactory>(), 40} {
+    pf.set_resampler(std::make_shared<SystematicResampler>(42));
+    params.min_particles_nm = 5;
+    params.max_particles_nm = 200;
+    pf.set_particles_nm_adaptation(std::make_shared<Adaptation>(params));
+  }
+
+  // NB: the first particle dominates, so resampling is required
+  void resample_with_spread(double spread_xy) {
+    auto &particles = pf.particles();
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+      particles[i]->set_pose({spread_xy * i, 0, 0});
+      particles[i]->set_weight(i == 0 ? 1 : 0.01);
+    }
+    ASSERT_TRUE(pf.try_resample());
+  }
+
+protected: // fields
+  ParticleFilter<PosedParticle> pf;
+  Adaptation::Params params;
+};
+
+TEST_F(KldParticlesNumberTest, requiredNumberGrowsWithBins) {
+  ASSERT_EQ(0.0, Adaptation::required_particles_nm(1, 0.05, 2.326));
+  auto prev_nm = double{0};
+  for (std::size_t bins_nm = 2; bins_nm < 100; ++bins_nm) {
+    auto nm = Adaptation::required_particles_nm(bins_nm, 0.05, 2.326);
+    ASSERT_LT(prev_nm, nm);
+    prev_nm = nm;
+  }
+}
+
+TEST_F(KldParticlesNumberTest, concentratedParticlesShrink) {
+  resample_with_spread(0);
+  ASSERT_EQ(params.min_particles_nm, pf.particles().size());
+}
+
+TEST_F(KldParticlesNumberTest, spreadParticlesGrow) {
+  resample_with_spread(10 * params.bin_size_xy);
+  auto particles_nm = pf.particles().size();
+  ASSERT_LT(40u, particles_nm);
+  ASSERT_LE(particles_nm, params.max_particles_nm);
+
+  auto total_weight = double{0};
+  for (auto &p : pf.particles()) { total_weight += p->weight(); }
+  ASSERT_NEAR(1.0, total_weight, 1e-12);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
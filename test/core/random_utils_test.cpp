@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "../../src/core/random_utils.h"
+
+class RandomUtilsTest : public ::testing::Test {
+protected: // consts
+  static constexpr unsigned Samples_Nm = 200000;
+protected: // methods
+
+  // moments of samples of the standard normal distribution are expected
+  template <typename Engine>
+  static void test_standard_normal(Engine &engine) {
+    auto sum = double{0}, sq_sum = double{0};
+    auto beyond_2_nm = 0u, beyond_tail_nm = 0u;
+    for (unsigned i = 0; i < Samples_Nm; ++i) {
+      auto x = ZigguratNormal::sample(engine);
+      sum += x;
+      sq_sum += x * x;
+      if (2 < std::abs(x)) { ++beyond_2_nm; }
+      if (3.442619855899 < std::abs(x)) { ++beyond_tail_nm; }
+    }
+    auto mean = sum / Samples_Nm;
+    ASSERT_NEAR(0, mean, 0.01);
+    ASSERT_NEAR(1, sq_sum / Samples_Nm - mean * mean, 0.01);
+    // P(|x| > 2) = 0.0455, P(|x| > R) = 0.000576
+    ASSERT_NEAR(0.0455, double(beyond_2_nm) / Samples_Nm, 0.002);
+    ASSERT_NEAR(0.000576, double(beyond_tail_nm) / Samples_Nm, 0.0002);
+  }
+};
+
+TEST_F(RandomUtilsTest, xoshiroSequenceIsReference) {
+  auto engine = Xoshiro256PlusPlus{42};
+  ASSERT_EQ(0x5b5e4a1bffcbb2f3ull, engine());
+  ASSERT_EQ(0xdad6b47570f6111dull, engine());
+  ASSERT_EQ(0xaa41d8357b710b2full, engine());
+  ASSERT_EQ(0x4d508bae6104bff7ull, (Xoshiro256PlusPlus{42, 1}()));
+}
+
+TEST_F(RandomUtilsTest, streamsAreReproducibleAndDistinct) {
+  auto streams = RandomStreams{7}, same_streams = RandomStreams{7};
+  auto engines = std::vector<Xoshiro256PlusPlus>{};
+  for (int i = 0; i < 16; ++i) {
+    engines.push_back(streams.next_engine());
+    ASSERT_EQ(engines.back(), same_streams.next_engine());
+  }
+  // first numbers of streams differ
+  auto firsts = std::vector<uint64_t>{};
+  for (auto &engine : engines) { firsts.push_back(engine()); }
+  std::sort(firsts.begin(), firsts.end());
+  ASSERT_EQ(firsts.end(), std::unique(firsts.begin(), firsts.end()));
+  ASSERT_NE(RandomStreams{8}.next_engine(), RandomStreams{7}.next_engine());
+}
+
+TEST_F(RandomUtilsTest, xoshiroBitsAreBalanced) {
+  auto engine = Xoshiro256PlusPlus{1};
+  auto ones_nm = std::vector<unsigned>(64, 0);
+  for (unsigned i = 0; i < Samples_Nm / 10; ++i) {
+    auto bits = engine();
+    for (unsigned b = 0; b < 64; ++b) { ones_nm[b] += (bits >> b) & 1; }
+  }
+  for (auto nm : ones_nm) {
+    ASSERT_NEAR(0.5, double(nm) / (Samples_Nm / 10), 0.02);
+  }
+}
+
+TEST_F(RandomUtilsTest, zigguratIsStandardNormalWithXoshiro) {
+  auto engine = Xoshiro256PlusPlus{42};
+  test_standard_normal(engine);
+}
+
+TEST_F(RandomUtilsTest, zigguratIsStandardNormalWith32BitEngine) {
+  auto engine = std::mt19937{42};
+  test_standard_normal(engine);
+}
+
+TEST_F(RandomUtilsTest, gaussianRvIsScaledAndDeterministic) {
+  auto rv = GaussianRV1D<Xoshiro256PlusPlus>{3, 0.5};
+  auto engine = Xoshiro256PlusPlus{5}, same_engine = engine;
+  auto sum = double{0};
+  for (unsigned i = 0; i < Samples_Nm; ++i) {
+    auto x = rv.sample(engine);
+    ASSERT_EQ(x, rv.clone()->sample(same_engine));
+    sum += x;
+  }
+  ASSERT_NEAR(3, sum / Samples_Nm, 0.01);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
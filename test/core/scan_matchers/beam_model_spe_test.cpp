@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/scan_matchers/beam_model_spe.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/utils/data_generation/laser_scan_generator.h"
+
+class BeamModelSPETest : public ::testing::Test {
+protected: // methods
+  BeamModelSPETest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 0.1}}
+    , spe{std::make_shared<ObstacleBasedOccupancyObservationPE>(),
+          std::make_shared<EvenSPW>(), cache_params(), 0.1, 0.05} {
+    // a room of 6x4 meters with a column
+    for (int i = -30; i <= 30; ++i) {
+      set_obstacle({i, -20});
+      set_obstacle({i, 20});
+    }
+    for (int i = -20; i <= 20; ++i) {
+      set_obstacle({-30, i});
+      set_obstacle({30, i});
+    }
+    for (int i = 5; i < 10; ++i) {
+      set_obstacle({i, 5});
+      set_obstacle({i, 9});
+      set_obstacle({5, i});
+      set_obstacle({9, i});
+    }
+  }
+
+  static ExpectedRangeCacheParams cache_params() {
+    auto params = ExpectedRangeCacheParams{};
+    params.max_range = 8;
+    params.angle_bins_nm = 360;
+    params.lattice_step = 1;
+    return params;
+  }
+
+  void set_obstacle(const GridMap::Coord &area_id) {
+    map.update(area_id, {true, {1, 1}, {0, 0}, 1});
+  }
+
+  LaserScan2D generate_scan(const RobotPose &pose) {
+    return LaserScanGenerator{to_lsp(8, 360, 360)}.laser_scan_2D(map, pose);
+  }
+
+  double estimate(const LaserScan2D &raw_scan, const RobotPose &pose) {
+    auto scan = spe.filter_scan(raw_scan, pose, map);
+    return spe.estimate_scan_probability(scan, pose, map);
+  }
+
+protected: // fields
+  UnboundedPlainGridMap map;
+  BeamModelSPE spe;
+};
+
+TEST_F(BeamModelSPETest, truePoseIsTheMostProbable) {
+  auto pose = RobotPose{-1.05, 0.35, 0.3};
+  auto scan = generate_scan(pose);
+  auto true_prob = estimate(scan, pose);
+  ASSERT_LT(0.95, true_prob);
+
+  for (auto &delta : {RobotPoseDelta{0.2, 0, 0}, RobotPoseDelta{0, -0.2, 0},
+                      RobotPoseDelta{0, 0, 0.1}, RobotPoseDelta{0.1, 0.1, 0}}) {
+    ASSERT_LT(estimate(scan, pose + delta), true_prob);
+  }
+}
+
+TEST_F(BeamModelSPETest, freeBeamIsPenalizedByObstaclesInFront) {
+  auto pose = RobotPose{0.05, 0.05, 0};
+  auto scan = LaserScan2D{};
+  scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+  // the room's wall is 3m ahead
+  scan.points().push_back(ScanPoint2D::make_polar(1.5, 0, false));
+  auto short_free_prob = estimate(scan, pose);
+  ASSERT_NEAR(1.0, short_free_prob, 1e-9);
+
+  scan.points().clear();
+  scan.points().push_back(ScanPoint2D::make_polar(5, 0, false));
+  ASSERT_LT(estimate(scan, pose), 0.1);
+  // an obstacle is expected at the wall
+  scan.points().clear();
+  scan.points().push_back(ScanPoint2D::make_polar(3, 0, true));
+  ASSERT_NEAR(1.0, estimate(scan, pose), 1e-3);
+}
+
+TEST_F(BeamModelSPETest, rejectedPoseIsBoundedByThreshold) {
+  auto pose = RobotPose{-1.05, 0.35, 0.3};
+  auto raw_scan = generate_scan(pose);
+  auto far_pose = pose + RobotPoseDelta{1, -1, 1};
+  auto scan = spe.filter_scan(raw_scan, far_pose, map);
+  auto prob = spe.estimate_scan_probability(scan, far_pose, map);
+
+  auto params = ScanProbabilityEstimator::SPEParams{};
+  params.rejection_threshold = 0.9;
+  auto bound = spe.estimate_scan_probability(scan, far_pose, map, params);
+  ASSERT_LE(prob, bound);
+  ASSERT_LE(bound, 0.9);
+}
+
+TEST_F(BeamModelSPETest, cacheFollowsMapUpdates) {
+  auto pose = RobotPose{-1.05, 0.35, 0.3};
+  auto scan = generate_scan(pose);
+  auto prob = estimate(scan, pose);
+  ASSERT_LT(0u, spe.expected_ranges().tiles_nm());
+
+  // a new wall in front of the robot
+  for (int i = -20; i <= 20; ++i) { set_obstacle({-5, i}); }
+  ASSERT_LT(estimate(scan, pose), prob);
+  ASSERT_LT(0.95, estimate(generate_scan(pose), pose));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -142,6 +142,58 @@ TYPED_TEST(BFMRScanMatcherSmokeTest, cecumComboStepsDrift) {
   this->test_scan_matcher(noise);
 }
 
+TYPED_TEST(BFMRScanMatcherSmokeTest, cecumComboStepsDriftScorePyramid) {
+  const auto Translation_Error = this->SM_Max_Translation_Error / 2;
+  const auto Rotation_Error = this->SM_Max_Rotation_Error;
+  this->init_pose_facing_top_cecum_bound();
+  this->bfmrsm.set_uses_score_pyramid(true);
+  this->test_scan_matcher({-Translation_Error, Translation_Error,
+                           -Rotation_Error});
+  // the pyramid is refreshed, not rebuilt for the second scan
+  this->test_scan_matcher({Translation_Error, 0, Rotation_Error});
+}
+
+TYPED_TEST(BFMRScanMatcherSmokeTest, reusedEngineGivesSameResult) {
+  const auto Translation_Error = this->SM_Max_Translation_Error / 2;
+  this->init_pose_facing_top_cecum_bound();
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{this->default_lsp}.laser_scan_2D(
+    this->map, this->rpose, 1);
+  auto noisy_pose = this->rpose + RobotPoseDelta{Translation_Error, 0, 0};
+
+  auto first_correction = RobotPoseDelta{};
+  auto first_prob = this->bfmrsm.process_scan(tr_scan, noisy_pose, this->map,
+                                              first_correction);
+  auto second_correction = RobotPoseDelta{};
+  auto second_prob = this->bfmrsm.process_scan(tr_scan, noisy_pose, this->map,
+                                               second_correction);
+  ASSERT_EQ(first_prob, second_prob);
+  ASSERT_EQ(first_correction.x, second_correction.x);
+  ASSERT_EQ(first_correction.y, second_correction.y);
+  ASSERT_EQ(first_correction.theta, second_correction.theta);
+}
+
+TYPED_TEST(BFMRScanMatcherSmokeTest, parallelExpansionFindsSameMatch) {
+  const auto Translation_Error = this->SM_Max_Translation_Error / 2;
+  const auto Rotation_Error = this->SM_Max_Rotation_Error;
+  this->init_pose_facing_top_cecum_bound();
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{this->default_lsp}.laser_scan_2D(
+    this->map, this->rpose, 1);
+  auto noisy_pose = this->rpose + RobotPoseDelta{-Translation_Error,
+                                                 Translation_Error,
+                                                 Rotation_Error};
+
+  auto seq_correction = RobotPoseDelta{};
+  auto seq_prob = this->bfmrsm.process_scan(tr_scan, noisy_pose, this->map,
+                                            seq_correction);
+  this->bfmrsm.set_estimation_threads_nm(4);
+  auto par_correction = RobotPoseDelta{};
+  auto par_prob = this->bfmrsm.process_scan(tr_scan, noisy_pose, this->map,
+                                            par_correction);
+  ASSERT_EQ(seq_prob, par_prob);
+}
+
 //------------------------------------------------------------------------------
 // A suit with tests specific to RescalabeMap
 // Motivation: some test cases run slowly on a plain map.
@@ -163,6 +215,76 @@ TEST_F(BFMRScanMatcherResclalableMapSpecificTest, hugeWindowLookup) {
   this->test_scan_matcher(noise);
 }
 
+TEST_F(BFMRScanMatcherResclalableMapSpecificTest, timeBudgetStopsMatching) {
+  init_pose_facing_top_cecum_bound();
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  const auto Max_Error = SM_Max_Translation_Error;
+  auto noisy_pose = rpose + RobotPoseDelta{Max_Error / 2, 0, 0};
+  auto map_scale = map.scale();
+
+  // NB: the budget is exceeded on the first coarse match
+  bfmrsm.set_time_budget_ms(1e-9);
+  auto correction = RobotPoseDelta{};
+  auto truncated_prob = bfmrsm.process_scan(tr_scan, noisy_pose, map,
+                                            correction);
+  ASSERT_FALSE(bfmrsm.last_match_is_converged());
+  ASSERT_EQ(map_scale, map.scale());
+  ASSERT_LE(std::abs(correction.x), Max_Error);
+  ASSERT_LE(std::abs(correction.y), Max_Error);
+  ASSERT_TRUE(0 <= truncated_prob && truncated_prob <= 1);
+
+  bfmrsm.set_time_budget_ms(0);
+  auto converged_prob = bfmrsm.process_scan(tr_scan, noisy_pose, map,
+                                            correction);
+  ASSERT_TRUE(bfmrsm.last_match_is_converged());
+  ASSERT_LE(truncated_prob, converged_prob);
+}
+
+TEST_F(BFMRScanMatcherResclalableMapSpecificTest, peaksAreDistinct) {
+  const auto Peak_Dist = SM_Max_Translation_Error / 2;
+  init_pose_facing_top_cecum_bound();
+  auto scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  auto noisy_pose = rpose + RobotPoseDelta{SM_Max_Translation_Error / 2, 0, 0};
+  auto init_engine = [&](M3RSMEngine &engine) {
+    engine.set_translation_lookup_range(SM_Max_Translation_Error,
+                                        SM_Max_Translation_Error);
+    engine.set_rotation_lookup_range(2 * SM_Max_Rotation_Error, SM_Ang_Step);
+    engine.set_finest_prob_ratio(0.9);
+    engine.add_scan_matching_request(spe, noisy_pose, scan, map);
+  };
+
+  auto best_engine = M3RSMEngine{};
+  init_engine(best_engine);
+  auto best_match = best_engine.next_best_match(SM_Transl_Step);
+  while (best_match.is_valid() && !best_match.is_finest()) {
+    best_engine.add_refined_match(
+      best_match, M3RSMEngine::Rect{best_match.translation_drift.center()});
+    best_match = best_engine.next_best_match(SM_Transl_Step);
+  }
+
+  auto peaks_engine = M3RSMEngine{};
+  init_engine(peaks_engine);
+  auto peaks = std::vector<Match>{};
+  peaks_engine.next_peaks(4, SM_Transl_Step, Peak_Dist, SM_Ang_Step, peaks);
+
+  ASSERT_FALSE(peaks.empty());
+  ASSERT_EQ(best_match.prob_upper_bound, peaks.front().prob_upper_bound);
+  for (std::size_t i = 1; i < peaks.size(); ++i) {
+    ASSERT_LE(peaks[i].prob_upper_bound, peaks[i - 1].prob_upper_bound);
+    ASSERT_LE(0.9 * peaks.front().prob_upper_bound,
+              peaks[i].prob_upper_bound);
+    auto c = peaks[i].translation_drift.center();
+    for (std::size_t j = 0; j < i; ++j) {
+      auto peak_c = peaks[j].translation_drift.center();
+      ASSERT_TRUE(Peak_Dist < std::abs(c.x - peak_c.x) ||
+                  Peak_Dist < std::abs(c.y - peak_c.y) ||
+                  SM_Ang_Step < std::abs(peaks[i].rotation -
+                                         peaks[j].rotation));
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 
 // TODO: More sophisticated testing (e.g. an arbitrary noise cases,
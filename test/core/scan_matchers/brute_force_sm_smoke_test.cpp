@@ -7,7 +7,40 @@
 #include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
 #include "../../../src/core/maps/plain_grid_map.h"
 
-// TODO: BruteForcePoseEnumeratorTest
+//------------------------------------------------------------------------------
+// Pose Enumerator Tests
+
+TEST(BruteForcePoseEnumeratorTest, batchesMatchSequentialEnumeration) {
+  auto make_pe = []() {
+    return BruteForcePoseEnumerator{-0.2, 0.2, 0.1, -0.1, 0.1, 0.1,
+                                    -0.02, 0.02, 0.01};
+  };
+  auto base_pose = RobotPose{1, 2, 0.5};
+  auto expected = std::vector<RobotPose>{};
+  auto seq_pe = make_pe();
+  while (seq_pe.has_next()) {
+    expected.push_back(seq_pe.next(base_pose));
+    seq_pe.feedback(expected.size() % 3 == 0);
+  }
+
+  auto actual = std::vector<RobotPose>{}, batch = std::vector<RobotPose>{};
+  auto batch_pe = make_pe();
+  while (batch_pe.has_next()) {
+    batch_pe.next_batch(base_pose, 7, batch);
+    ASSERT_TRUE(0 < batch.size() && batch.size() <= 7);
+    for (auto &pose : batch) {
+      actual.push_back(pose);
+      batch_pe.feedback(actual.size() % 3 == 0);
+    }
+  }
+
+  ASSERT_EQ(expected.size(), actual.size());
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(expected[i].x, actual[i].x);
+    ASSERT_EQ(expected[i].y, actual[i].y);
+    ASSERT_EQ(expected[i].theta, actual[i].theta);
+  }
+}
 
 //------------------------------------------------------------------------------
 // Smoke Tests Suite
@@ -113,6 +146,76 @@ TEST_F(BruteForceScanMatcherSmokeTest, cecumComboStepsDrift) {
   test_scan_matcher({2*Step_Translation, -3*Step_Translation, Step_Rotation});
 }
 
+TEST_F(BruteForceScanMatcherSmokeTest, batchEstimationMatchesPerPoseOne) {
+  init_pose_facing_top_cecum_bound();
+  auto raw_scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  auto scan = spe->filter_scan(raw_scan, rpose, map);
+  ASSERT_TRUE(scan.has_soa());
+
+  auto poses = std::vector<RobotPose>{};
+  auto pe = BruteForcePoseEnumerator{-0.1, 0.1, 0.05, -0.1, 0.1, 0.05,
+                                     -0.02, 0.02, 0.01};
+  pe.next_batch(rpose, 1000, poses);
+  auto probs = std::vector<double>(poses.size());
+  spe->estimate_scan_probabilities(scan, poses.data(), poses.size(), map,
+                                   ScanProbabilityEstimator::SPEParams{},
+                                   probs.data());
+  for (std::size_t i = 0; i < poses.size(); ++i) {
+    ASSERT_EQ(spe->estimate_scan_probability(scan, poses[i], map), probs[i]);
+  }
+}
+
+TEST_F(BruteForceScanMatcherSmokeTest, rejectedEstimationsAreBounded) {
+  init_pose_facing_top_cecum_bound();
+  // NB: the rejection is checked per several points
+  auto lsp = to_lsp(LS_Max_Dist, LS_FoW, 200);
+  auto raw_scan = LaserScanGenerator{lsp}.laser_scan_2D(map, rpose, 1);
+  auto scan = spe->filter_scan(raw_scan, rpose, map);
+
+  auto poses = std::vector<RobotPose>{};
+  auto pe = BruteForcePoseEnumerator{-0.3, 0.3, 0.1, -0.3, 0.3, 0.1,
+                                     -0.1, 0.1, 0.05};
+  pe.next_batch(rpose, 1000, poses);
+  auto params = ScanProbabilityEstimator::SPEParams{};
+  params.rejection_threshold = spe->estimate_scan_probability(scan, rpose, map);
+  auto probs = std::vector<double>(poses.size());
+  spe->estimate_scan_probabilities(scan, poses.data(), poses.size(), map,
+                                   params, probs.data());
+  auto early_rejected_nm = std::size_t{0};
+  for (std::size_t i = 0; i < poses.size(); ++i) {
+    auto prob = spe->estimate_scan_probability(scan, poses[i], map);
+    if (params.rejection_threshold < prob) {
+      ASSERT_EQ(prob, probs[i]);
+      continue;
+    }
+    ASSERT_LE(probs[i], params.rejection_threshold);
+    ASSERT_LE(prob, probs[i] + 1e-12);
+    early_rejected_nm += prob != probs[i];
+  }
+  ASSERT_LT(0u, early_rejected_nm);
+}
+
+TEST_F(BruteForceScanMatcherSmokeTest, parallelMatchingMatchesSequential) {
+  init_pose_facing_top_cecum_bound();
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  auto noisy_pose = rpose + RobotPoseDelta{2*Step_Translation,
+                                           -Step_Translation, Step_Rotation};
+
+  auto seq_correction = RobotPoseDelta{};
+  auto seq_prob = _bfsm.process_scan(tr_scan, noisy_pose, map, seq_correction);
+
+  _bfsm.set_estimation_threads_nm(4);
+  ASSERT_TRUE(map.supports_concurrent_reads());
+  auto par_correction = RobotPoseDelta{};
+  auto par_prob = _bfsm.process_scan(tr_scan, noisy_pose, map, par_correction);
+
+  ASSERT_EQ(seq_prob, par_prob);
+  ASSERT_EQ(seq_correction.x, par_correction.x);
+  ASSERT_EQ(seq_correction.y, par_correction.y);
+  ASSERT_EQ(seq_correction.theta, par_correction.theta);
+}
+
 //----------------------------------------------------------------------------//
 
 int main (int argc, char *argv[]) {
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/scan_matchers/connect_the_dots_ambiguous_drift_detector.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "../../../src/utils/data_generation/laser_scan_generator.h"
+
+// Returns the given pose delta (e.g. a drifted match)
+class FixedDeltaScanMatcher : public GridScanMatcher {
+public:
+  FixedDeltaScanMatcher(SPE spe, const RobotPoseDelta &delta)
+    : GridScanMatcher{spe}, _delta{delta} {}
+
+  double process_scan(const TransformedLaserScan &raw_scan,
+                      const RobotPose &init_pose, const GridMap &map,
+                      RobotPoseDelta &pose_delta) override {
+    last_scan_is_prefiltered = raw_scan.scan.prefiltered() != nullptr;
+    pose_delta = _delta;
+    auto pose = init_pose + _delta;
+    return scan_probability(filter_scan(raw_scan.scan, pose, map), pose, map);
+  }
+
+  bool last_scan_is_prefiltered = false;
+private:
+  RobotPoseDelta _delta;
+};
+
+class ConnectTheDotsAmbiguousDriftDetectorTest : public ::testing::Test {
+protected: // methods
+  ConnectTheDotsAmbiguousDriftDetectorTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 0.02}}
+    , spe{std::make_shared<WeightedMeanPointProbabilitySPE>(
+        std::make_shared<ObstacleBasedOccupancyObservationPE>(),
+        std::make_shared<EvenSPW>())} {}
+
+  void add_wall(const GridMap::Coord &min, const GridMap::Coord &max) {
+    map.update_area(min, max, {true, {1, 1}, {0, 0}, 1});
+  }
+
+  // a corridor along Ox of 2 meters wide that is closed at the right
+  void add_dead_end_corridor() {
+    add_wall({-400, -50}, {100, -50});
+    add_wall({-400, 50}, {100, 50});
+    add_wall({100, -50}, {100, 50});
+  }
+
+  RobotPoseDelta match(const RobotPose &pose, const RobotPoseDelta &drift,
+                       bool prefilter = false) {
+    auto tr_scan = TransformedLaserScan{};
+    tr_scan.scan = LaserScanGenerator{to_lsp(4, 360, 90)}
+      .laser_scan_2D(map, pose, 1);
+    tr_scan.quality = 1.0;
+
+    sm = std::make_shared<FixedDeltaScanMatcher>(spe, drift);
+    detector = std::make_shared<ConnectTheDotsAmbiguousDriftDetector>(sm);
+    if (prefilter) { detector->prefilter_scan(tr_scan.scan); }
+    auto delta = RobotPoseDelta{};
+    detector->process_scan(tr_scan, pose, map, delta);
+    return delta;
+  }
+
+protected: // fields
+  UnboundedPlainGridMap map;
+  std::shared_ptr<ScanProbabilityEstimator> spe;
+  std::shared_ptr<FixedDeltaScanMatcher> sm;
+  std::shared_ptr<ConnectTheDotsAmbiguousDriftDetector> detector;
+};
+
+TEST_F(ConnectTheDotsAmbiguousDriftDetectorTest, driftAlongCorridorIsFixed) {
+  add_dead_end_corridor();
+  auto delta = match({0.01, 0.01, 0}, {0.2, 0, 0});
+  ASSERT_TRUE(detector->last_scan_is_ambiguous());
+  ASSERT_NEAR(0, delta.x, 0.05);
+  // the search is along the mean direction of corridor's points
+  ASSERT_NEAR(0, delta.y, 0.01);
+  ASSERT_NEAR(0, delta.theta, 1e-9);
+}
+
+TEST_F(ConnectTheDotsAmbiguousDriftDetectorTest,
+       driftAlongRotatedCorridorIsFixed) {
+  add_dead_end_corridor();
+  // the robot looks back, so the corridor is along Ox of the robot still
+  auto delta = match({0.01, 0.01, M_PI}, {-0.2, 0, 0});
+  ASSERT_TRUE(detector->last_scan_is_ambiguous());
+  ASSERT_NEAR(0, delta.x, 0.05);
+  // the search is along the mean direction of corridor's points
+  ASSERT_NEAR(0, delta.y, 0.01);
+}
+
+TEST_F(ConnectTheDotsAmbiguousDriftDetectorTest, roomMatchIsKept) {
+  add_wall({-100, -100}, {100, -100});
+  add_wall({-100, 100}, {100, 100});
+  add_wall({-100, -100}, {-100, 100});
+  add_wall({100, -100}, {100, 100});
+  auto drift = RobotPoseDelta{0.1, 0, 0};
+  auto delta = match({0.01, 0.01, 0}, drift);
+  ASSERT_FALSE(detector->last_scan_is_ambiguous());
+  ASSERT_EQ(drift, delta);
+}
+
+TEST_F(ConnectTheDotsAmbiguousDriftDetectorTest, matcherGetsPrefilteredScan) {
+  add_dead_end_corridor();
+  match({0.01, 0.01, 0}, {}, false);
+  ASSERT_TRUE(sm->last_scan_is_prefiltered);
+  match({0.01, 0.01, 0}, {}, true);
+  ASSERT_TRUE(sm->last_scan_is_prefiltered);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
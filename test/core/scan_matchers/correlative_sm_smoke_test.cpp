@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "../mock_grid_cell.h"
+#include "scan_matcher_test_utils.h"
+
+#include "../../../src/core/scan_matchers/correlative_scan_matcher.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+
+//------------------------------------------------------------------------------
+// Smoke Tests Suite
+// NB: the suit checks _fundamental_ abilities to find a correction.
+
+class CorrelativeScanMatcherSmokeTest
+  : public ScanMatcherTestBase<UnboundedPlainGridMap> {
+protected: // consts
+  // map params
+  static constexpr int Map_Width = 100;
+  static constexpr int Map_Height = 100;
+  static constexpr double Map_Scale = 0.1;
+
+  // map patching params
+  static constexpr int Cecum_Patch_W = 15, Cecum_Patch_H = 13;
+  static constexpr int Patch_Scale = 1;
+
+  // laser scanner params
+  static constexpr double LS_Max_Dist = 15;
+  static constexpr int LS_FoW = 270;
+  static constexpr int LS_Pts_Nm = 100;
+
+  // scan matcher params
+  static constexpr double Max_Translation_Error = 0.5;
+  static constexpr double From_Rotation = deg2rad(-10);
+  static constexpr double To_Rotation   = deg2rad(10);
+  static constexpr double Step_Rotation = deg2rad(1);
+protected: // type aliases
+  using SPE = typename ScanMatcherTestBase<UnboundedPlainGridMap>::DefaultSPE;
+  using OOPE = ObstacleBasedOccupancyObservationPE;
+  using SPW = EvenSPW;
+protected: // methods
+  CorrelativeScanMatcherSmokeTest()
+    : ScanMatcherTestBase{std::make_shared<SPE>(std::make_shared<OOPE>(),
+                                                std::make_shared<SPW>()),
+                          Map_Width, Map_Height, Map_Scale,
+                          to_lsp(LS_Max_Dist, LS_FoW, LS_Pts_Nm)}
+    , _csm{spe, Max_Translation_Error, Max_Translation_Error,
+           From_Rotation, To_Rotation, Step_Rotation} {}
+
+  GridScanMatcher& scan_matcher() override { return _csm; };
+
+  RobotPoseDelta default_acceptable_error() override {
+    return {Map_Scale / 2, Map_Scale / 2, Step_Rotation / 2};
+  }
+
+  void init_pose_facing_top_cecum_bound() {
+    using CecumMp = CecumTextRasterMapPrimitive;
+    auto bnd_pos = CecumMp::BoundPosition::Top;
+    auto cecum_mp = CecumMp{Cecum_Patch_W, Cecum_Patch_H, bnd_pos};
+    add_primitive_to_map(cecum_mp, {}, Patch_Scale, Patch_Scale);
+
+    rpose += RobotPoseDelta{
+      (cecum_mp.width() * Patch_Scale / 2) * map.scale(),
+      (-cecum_mp.height() * Patch_Scale + 1) * map.scale(),
+      deg2rad(90)
+    };
+  }
+
+protected: // fields
+  CorrelativeScanMatcher _csm;
+};
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumNoPoseNoise) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{0, 0, 0});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumLinStepXLeftDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{-3 * Map_Scale, 0, 0});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumLinStepXRightDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{Max_Translation_Error, 0, 0});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumLinStepYUpDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{0, -2 * Map_Scale, 0});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumLinStepYDownDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{0, 4 * Map_Scale, 0});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumAngStepThetaCcwDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{0, 0, -3 * Step_Rotation});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumAngStepThetaCwDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher(RobotPoseDelta{0, 0, To_Rotation});
+}
+
+TEST_F(CorrelativeScanMatcherSmokeTest, cecumComboStepsDrift) {
+  init_pose_facing_top_cecum_bound();
+  test_scan_matcher({2 * Map_Scale, -3 * Map_Scale, 2 * Step_Rotation});
+}
+
+//----------------------------------------------------------------------------//
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include "../mock_grid_cell.h"
+#include "scan_matcher_test_utils.h"
+
+#include "../../../src/core/scan_matchers/gauss_newton_scan_matcher.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/rescalable_caching_grid_map.h"
+
+//------------------------------------------------------------------------------
+// Smoke Tests Suite
+// NB: the suit checks _fundamental_ abilities to find a correction.
+
+template <typename MapType>
+class GaussNewtonScanMatcherSmokeTest : public ScanMatcherTestBase<MapType> {
+protected: // consts
+  // map params
+  static constexpr int Map_Width = 100;
+  static constexpr int Map_Height = 100;
+  static constexpr double Map_Scale = 0.1;
+
+  // map patching params
+  static constexpr int Cecum_Patch_W = 15, Cecum_Patch_H = 13;
+  static constexpr int Patch_Scale = 1;
+
+  // laser scanner params
+  static constexpr double LS_Max_Dist = 15;
+  static constexpr int LS_FoW = 270;
+  static constexpr int LS_Pts_Nm = 100;
+
+  // scan matcher params
+  static constexpr unsigned Max_Iterations_Nm = 10;
+  static constexpr unsigned Scales_Nm = 3;
+protected: // type aliases
+  using SPE = typename ScanMatcherTestBase<MapType>::DefaultSPE;
+  using OOPE = ObstacleBasedOccupancyObservationPE;
+  using SPW = EvenSPW;
+protected: // methods
+  GaussNewtonScanMatcherSmokeTest()
+    : ScanMatcherTestBase<MapType>{
+        std::make_shared<SPE>(std::make_shared<OOPE>(),
+                              std::make_shared<SPW>()),
+        Map_Width, Map_Height, Map_Scale,
+        to_lsp(LS_Max_Dist, LS_FoW, LS_Pts_Nm)}
+    , _gnsm{this->spe, Max_Iterations_Nm, Scales_Nm} {}
+
+  GridScanMatcher& scan_matcher() override { return _gnsm; };
+
+  RobotPoseDelta default_acceptable_error() override {
+    return {Map_Scale / 4, Map_Scale / 4, deg2rad(0.5)};
+  }
+
+  void init_pose_facing_top_cecum_bound() {
+    using CecumMp = CecumTextRasterMapPrimitive;
+    auto bnd_pos = CecumMp::BoundPosition::Top;
+    auto cecum_mp = CecumMp{Cecum_Patch_W, Cecum_Patch_H, bnd_pos};
+    this->add_primitive_to_map(cecum_mp, {}, Patch_Scale, Patch_Scale);
+
+    this->rpose += RobotPoseDelta{
+      (cecum_mp.width() * Patch_Scale / 2) * this->map.scale(),
+      (-cecum_mp.height() * Patch_Scale + 1) * this->map.scale(),
+      deg2rad(90)
+    };
+  }
+
+protected: // fields
+  GaussNewtonScanMatcher _gnsm;
+};
+
+using MapTs = ::testing::Types<UnboundedPlainGridMap,
+                               RescalableCachingGridMap<UnboundedPlainGridMap>>;
+
+TYPED_TEST_CASE(GaussNewtonScanMatcherSmokeTest, MapTs);
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumNoPoseNoise) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{0, 0, 0});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumLinStepXLeftDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{-1.5 * this->Map_Scale, 0, 0});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumLinStepXRightDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{1.5 * this->Map_Scale, 0, 0});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumLinStepYUpDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{0, -1.5 * this->Map_Scale, 0});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumLinStepYDownDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{0, 1.5 * this->Map_Scale, 0});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumAngStepThetaCcwDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{0, 0, deg2rad(3)});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumAngStepThetaCwDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher(RobotPoseDelta{0, 0, -deg2rad(3)});
+}
+
+TYPED_TEST(GaussNewtonScanMatcherSmokeTest, cecumComboStepsDrift) {
+  this->init_pose_facing_top_cecum_bound();
+  this->test_scan_matcher({1.5 * this->Map_Scale, -1.5 * this->Map_Scale,
+                           deg2rad(2)});
+}
+
+//----------------------------------------------------------------------------//
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
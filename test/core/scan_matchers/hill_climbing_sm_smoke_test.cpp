@@ -8,6 +8,7 @@
 #include "../../../src/core/scan_matchers/hill_climbing_scan_matcher.h"
 #include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
 #include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/rescalable_caching_grid_map.h"
 
 //------------------------------------------------------------------------------
 // Smoke Tests Suite
@@ -100,6 +101,199 @@ TEST_F(HillClimbingScanMatcherSmokeTest, cecumAngStepThetaCwDrift) {
   test_scan_matcher(RobotPoseDelta{0, 0, -Init_Ang_Step});
 }
 
+TEST_F(HillClimbingScanMatcherSmokeTest, steadyDriftIsWarmStarted) {
+  class TestsCounter : public GridScanMatcherObserver {
+  public:
+    void on_scan_test(const RobotPose &, const LaserScan2D &,
+                      double) override { ++tests_nm; }
+    unsigned tests_nm = 0;
+  };
+
+  init_pose_facing_top_cecum_bound();
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  auto noise = RobotPoseDelta{Init_Lin_Step, 0, 0};
+  auto counter = std::make_shared<TestsCounter>();
+  _hcsm.subscribe(counter);
+  auto prior_model = std::make_shared<CorrectionPriorModel>();
+  _hcsm.set_correction_prior_model(prior_model);
+
+  auto tests_nm = std::vector<unsigned>{};
+  for (unsigned i = 0; i < CorrectionPriorModel::Min_Corrections_Nm + 1; ++i) {
+    auto correction = RobotPoseDelta{};
+    counter->tests_nm = 0;
+    _hcsm.reset_state();
+    _hcsm.process_scan(tr_scan, rpose + noise, map, correction);
+    tests_nm.push_back(counter->tests_nm);
+    ASSERT_NEAR(-noise.x, correction.x, Init_Lin_Step / 2);
+  }
+  ASSERT_TRUE(prior_model->is_ready());
+  ASSERT_NEAR(-noise.x, prior_model->predicted_correction().x,
+              Init_Lin_Step / 2);
+  ASSERT_LT(tests_nm.back(), tests_nm.front());
+}
+
+TEST_F(HillClimbingScanMatcherSmokeTest, scanTestsAreSampledAndSummarized) {
+  class TestsSampler : public GridScanMatcherObserver {
+  public:
+    TestsSampler(unsigned period) : period{period} {}
+    unsigned scan_test_period() const override { return period; }
+    void on_scan_test(const RobotPose &, const LaserScan2D &,
+                      double score) override {
+      ++tests_nm;
+      max_score = std::max(max_score, score);
+    }
+    void on_scan_tests_summary(const ScanTestsSummary &s) override {
+      summary = s;
+    }
+    unsigned period, tests_nm = 0;
+    double max_score = 0;
+    ScanTestsSummary summary;
+  };
+
+  init_pose_facing_top_cecum_bound();
+  auto all_tests = std::make_shared<TestsSampler>(1);
+  auto sampled_tests = std::make_shared<TestsSampler>(4);
+  auto summary_only = std::make_shared<TestsSampler>(0);
+  _hcsm.subscribe(all_tests);
+  _hcsm.subscribe(sampled_tests);
+  _hcsm.subscribe(summary_only);
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  auto correction = RobotPoseDelta{};
+  _hcsm.process_scan(tr_scan, rpose + RobotPoseDelta{Init_Lin_Step, 0, 0},
+                     map, correction);
+
+  ASSERT_LT(1u, all_tests->tests_nm);
+  ASSERT_EQ((all_tests->tests_nm + 3) / 4, sampled_tests->tests_nm);
+  ASSERT_EQ(0u, summary_only->tests_nm);
+  ASSERT_EQ(all_tests->tests_nm, summary_only->summary.tests_nm);
+  ASSERT_EQ(all_tests->max_score, summary_only->summary.max_score);
+  ASSERT_LT(0u, summary_only->summary.pose_updates_nm);
+}
+
+TEST_F(HillClimbingScanMatcherSmokeTest, timeBudgetStopsMatching) {
+  init_pose_facing_top_cecum_bound();
+  auto tr_scan = TransformedLaserScan{};
+  tr_scan.scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+  auto noisy_pose = rpose + RobotPoseDelta{Init_Lin_Step, 0, 0};
+
+  auto correction = RobotPoseDelta{};
+  _hcsm.process_scan(tr_scan, noisy_pose, map, correction);
+  ASSERT_TRUE(_hcsm.last_match_is_converged());
+
+  // NB: the budget is exceeded before the first batch
+  _hcsm.set_time_budget_ms(1e-9);
+  _hcsm.reset_state();
+  auto init_prob = _hcsm.scan_probability(
+    _hcsm.filter_scan(tr_scan.scan, noisy_pose, map), noisy_pose, map);
+  auto truncated_prob = _hcsm.process_scan(tr_scan, noisy_pose, map,
+                                           correction);
+  ASSERT_FALSE(_hcsm.last_match_is_converged());
+  ASSERT_FALSE(correction);
+  ASSERT_EQ(init_prob, truncated_prob);
+
+  _hcsm.set_time_budget_ms(0);
+  _hcsm.process_scan(tr_scan, noisy_pose, map, correction);
+  ASSERT_TRUE(_hcsm.last_match_is_converged());
+}
+
+//------------------------------------------------------------------------------
+// Coarse-to-fine climbing on a rescalable map
+
+class CoarseToFineHillClimbingSmokeTest
+  : public ScanMatcherTestBase<RescalableCachingGridMap<UnboundedPlainGridMap>> {
+protected: // type aliases
+  using Base =
+    ScanMatcherTestBase<RescalableCachingGridMap<UnboundedPlainGridMap>>;
+  using SPE = Base::DefaultSPE;
+  using OOPE = ObstacleBasedOccupancyObservationPE;
+  using SPW = EvenSPW;
+protected: // consts
+  // NB: use 1/2^n to make coarser scales exact
+  static constexpr int Map_Width = 128;
+  static constexpr int Map_Height = 128;
+  static constexpr double Map_Scale = 0.0625;
+
+  static constexpr int Cecum_Patch_W = 31, Cecum_Patch_H = 27;
+
+  static constexpr double LS_Max_Dist = 15;
+  static constexpr int LS_FoW = 270;
+  static constexpr int LS_Pts_Nm = 100;
+
+  static constexpr int Max_SM_Shirnks_Nm = 10;
+  static constexpr double Init_Lin_Step = Map_Scale;
+  static constexpr double Init_Ang_Step = deg2rad(10);
+protected: // methods
+  CoarseToFineHillClimbingSmokeTest()
+    : Base{std::make_shared<SPE>(std::make_shared<OOPE>(),
+                                 std::make_shared<SPW>()),
+           Map_Width, Map_Height, Map_Scale,
+           to_lsp(LS_Max_Dist, LS_FoW, LS_Pts_Nm)}
+    , _hcsm{spe, Max_SM_Shirnks_Nm, Init_Lin_Step, Init_Ang_Step} {}
+
+  GridScanMatcher& scan_matcher() override { return _hcsm; };
+
+  void init_pose_facing_top_cecum_bound() {
+    using CecumMp = CecumTextRasterMapPrimitive;
+    auto bnd_pos = CecumMp::BoundPosition::Top;
+    auto cecum_mp = CecumMp{Cecum_Patch_W, Cecum_Patch_H, bnd_pos};
+    add_primitive_to_map(cecum_mp, {}, 1, 1);
+
+    rpose += RobotPoseDelta{
+      (cecum_mp.width() / 2) * map.scale(),
+      (-cecum_mp.height() / 2) * map.scale(),
+      deg2rad(90)
+    };
+  }
+
+  unsigned tests_nm(const RobotPoseDelta &noise, RobotPoseDelta &correction) {
+    class TestsCounter : public GridScanMatcherObserver {
+    public:
+      void on_scan_test(const RobotPose &, const LaserScan2D &,
+                        double) override { ++tests_nm; }
+      unsigned tests_nm = 0;
+    };
+    auto tr_scan = TransformedLaserScan{};
+    tr_scan.scan = LaserScanGenerator{default_lsp}.laser_scan_2D(map, rpose, 1);
+    auto counter = std::make_shared<TestsCounter>();
+    _hcsm.subscribe(counter);
+    _hcsm.reset_state();
+    _hcsm.process_scan(tr_scan, rpose + noise, map, correction);
+    _hcsm.unsubscribe(counter);
+    return counter->tests_nm;
+  }
+
+protected: // fields
+  HillClimbingScanMatcher _hcsm;
+};
+
+TEST_F(CoarseToFineHillClimbingSmokeTest, smallDriftTakesFewerTests) {
+  init_pose_facing_top_cecum_bound();
+  auto noise = RobotPoseDelta{2 * Init_Lin_Step, -2 * Init_Lin_Step, 0.1};
+  auto correction = RobotPoseDelta{};
+  auto fine_tests_nm = tests_nm(noise, correction);
+  _hcsm.set_scales_nm(3);
+  auto coarse_tests_nm = tests_nm(noise, correction);
+  auto result_noise = noise + correction;
+  ASSERT_NEAR(0, result_noise.x, Init_Lin_Step / 2);
+  ASSERT_NEAR(0, result_noise.y, Init_Lin_Step / 2);
+  ASSERT_NEAR(0, result_noise.theta, Init_Ang_Step / 2);
+  ASSERT_LT(coarse_tests_nm, fine_tests_nm);
+}
+
+TEST_F(CoarseToFineHillClimbingSmokeTest, largeDriftIsCorrected) {
+  init_pose_facing_top_cecum_bound();
+  _hcsm.set_scales_nm(3);
+  auto noise = RobotPoseDelta{6 * Init_Lin_Step, -6 * Init_Lin_Step, 0.1};
+  auto correction = RobotPoseDelta{};
+  tests_nm(noise, correction);
+  auto result_noise = noise + correction;
+  ASSERT_NEAR(0, result_noise.x, Init_Lin_Step / 2);
+  ASSERT_NEAR(0, result_noise.y, Init_Lin_Step / 2);
+  ASSERT_NEAR(0, result_noise.theta, Init_Ang_Step / 2);
+}
+
 /* FIXME: looks like the method itself should be fixed.
 TEST_F(HillClimbingScanMatcherSmokeTest, cecumComboStepsDrift) {
   init_pose_facing_top_cecum_bound();
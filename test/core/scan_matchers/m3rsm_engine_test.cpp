@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/max_pooled_score_pyramid.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/scan_matchers/m3rsm_engine.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/scan_matchers/weighted_mean_point_probability_spe.h"
+
+class M3RSMEngineTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+  using Rect = M3RSMEngine::Rect;
+protected: // consts
+  // NB: drifts of the search are split exactly
+  static constexpr double Map_Scale = 0.125;
+  static constexpr double Max_Error = 8 * Map_Scale;
+protected: // methods
+  M3RSMEngineTest()
+    : map{std::make_shared<MockGridCell>(0.5), {1, 1, Map_Scale}}
+    , spe{std::make_shared<WeightedMeanPointProbabilitySPE>(
+        std::make_shared<ObstacleBasedOccupancyObservationPE>(),
+        std::make_shared<EvenSPW>())}
+    , rnd_engine{42} {
+    // NB: the map and scans are mostly at negative coordinates
+    auto occ_rv = std::uniform_real_distribution<double>{0, 0.5};
+    for (int y = -100; y <= 40; ++y) {
+      for (int x = -100; x <= 40; ++x) {
+        map.update({x, y}, {true, {occ_rv(rnd_engine), 0}, {0, 0}, 0});
+      }
+    }
+    pyramid.ensure_levels(4 * Max_Error, map.scale());
+    pyramid.sync(map);
+  }
+
+  // Marks cells of the scan's points translated by the drift as obstacles,
+  // so bounds that miss the cells of points are below the expected ones.
+  void add_obstacles(const LaserScan2D &scan, const RobotPose &pose,
+                     double d_x, double d_y) {
+    for (const auto &sp : scan.points()) {
+      map.update({int(std::floor((sp.x() + (pose.x + d_x)) / Map_Scale)),
+                  int(std::floor((sp.y() + (pose.y + d_y)) / Map_Scale))},
+                 {true, {1.0, 0}, {0, 0}, 0});
+    }
+    pyramid.sync(map);
+  }
+
+  LaserScan2D random_scan(unsigned points_nm) {
+    auto range_rv = std::uniform_real_distribution<double>{0.1, 3.5};
+    auto angle_rv = std::uniform_real_distribution<double>{-M_PI, M_PI};
+    auto scan = LaserScan2D{};
+    scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+    for (unsigned i = 0; i < points_nm; ++i) {
+      scan.points().emplace_back(range_rv(rnd_engine), angle_rv(rnd_engine));
+    }
+    return scan;
+  }
+
+  RobotPose random_pose() {
+    auto x_rv = std::uniform_real_distribution<double>{-3.5, -1.5};
+    auto th_rv = std::uniform_real_distribution<double>{-M_PI, M_PI};
+    return {x_rv(rnd_engine), x_rv(rnd_engine), th_rv(rnd_engine)};
+  }
+
+  // points of the scan as they are prerotated by the engine
+  LaserScan2D prerotated_scan(const LaserScan2D &raw_scan,
+                              const RobotPose &pose, double rotation) {
+    return spe->filter_scan(raw_scan, pose, map).to_cartesian(rotation +
+                                                              pose.theta);
+  }
+
+  // The mean of max scores of cells hit by points moved by the drift,
+  // i.e. the tightest bound that scores points separately.
+  double per_point_bound(const LaserScan2D &scan, const RobotPose &pose,
+                         const Rect &drift) {
+    auto cell_of = [](double v) { return int(std::floor(v / Map_Scale)); };
+    auto total_score = double{0};
+    for (const auto &sp : scan.points()) {
+      auto max_score = double{0};
+      auto x = sp.x() + pose.x, y = sp.y() + pose.y;
+      for (int c_y = cell_of(y + drift.bot()); c_y <= cell_of(y + drift.top());
+           ++c_y) {
+        for (int c_x = cell_of(x + drift.left());
+             c_x <= cell_of(x + drift.right()); ++c_x) {
+          max_score = std::max<double>(max_score,
+                                       pyramid.score(0, {c_x, c_y}));
+        }
+      }
+      total_score += max_score;
+    }
+    return total_score / scan.points().size();
+  }
+
+  // The probability of a translation as it is estimated by the engine
+  double finest_score(const LaserScan2D &scan, const RobotPose &pose,
+                      double d_x, double d_y) {
+    auto total_score = double{0};
+    for (const auto &sp : scan.points()) {
+      total_score += pyramid.score(
+        0, {int(std::floor((sp.x() + (pose.x + d_x)) / Map_Scale)),
+            int(std::floor((sp.y() + (pose.y + d_y)) / Map_Scale))});
+    }
+    return total_score / scan.points().size();
+  }
+
+protected: // fields
+  UnboundedPlainGridMap map;
+  std::shared_ptr<ScanProbabilityEstimator> spe;
+  MaxPooledScorePyramid pyramid;
+  std::mt19937 rnd_engine;
+  M3RSMEngine engine;
+};
+
+TEST_F(M3RSMEngineTest, mergedPointsBoundsAreNotBelowPerPointBound) {
+  auto left_rv = std::uniform_real_distribution<double>{-Max_Error,
+                                                        Max_Error};
+  // NB: drifts span several grids (cells of the i-th one are 2^i long)
+  auto drift_lens = std::vector<double>{0, 0.5, 1, 1.5, 2, 3, 4, 5,
+                                        7.5, 8, 11, 16};
+  for (unsigned scan_i = 0; scan_i < 8; ++scan_i) {
+    auto pose = random_pose();
+    auto raw_scan = random_scan(100);
+    auto scan = prerotated_scan(raw_scan, pose, 0);
+    add_obstacles(scan, pose, 0, 0);
+    engine.reset_engine_state();
+    engine.set_translation_lookup_range(Max_Error, Max_Error);
+    engine.set_rotation_lookup_range(0, 0.1);
+    engine.add_scan_matching_request(pyramid, spe, pose, raw_scan, map);
+
+    for (auto drift_len : drift_lens) {
+      for (unsigned drift_i = 0; drift_i < 10; ++drift_i) {
+        auto left = left_rv(rnd_engine), bot = left_rv(rnd_engine);
+        auto drift = Rect{bot, bot + drift_len * Map_Scale,
+                          left, left + drift_len * Map_Scale};
+        auto expected = per_point_bound(scan, pose, drift);
+        // NB: windows of grids are rounded up to 2^level cells differently,
+        //     so only the per-point bound is below bounds of all grids
+        for (unsigned grid_i = 0; grid_i < pyramid.levels_nm(); ++grid_i) {
+          ASSERT_LE(expected, engine.pyramid_bound(0, drift, grid_i) + 1e-6)
+            << "grid " << grid_i << ", drift " << drift;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(M3RSMEngineTest, pyramidRequestFindsExhaustiveSearchBest) {
+  static constexpr double Rotation_Step = 0.05;
+  for (unsigned scan_i = 0; scan_i < 8; ++scan_i) {
+    auto pose = random_pose();
+    auto raw_scan = random_scan(100);
+    // obstacles are at a candidate drift
+    auto d_rv = std::uniform_int_distribution<int>{-16, 16};
+    auto rotation_rv = std::uniform_int_distribution<int>{-1, 1};
+    add_obstacles(prerotated_scan(raw_scan, pose,
+                                  rotation_rv(rnd_engine) * Rotation_Step),
+                  pose, d_rv(rnd_engine) * Map_Scale / 2,
+                  d_rv(rnd_engine) * Map_Scale / 2);
+    engine.reset_engine_state();
+    engine.set_translation_lookup_range(Max_Error, Max_Error);
+    engine.set_rotation_lookup_range(2 * Rotation_Step, Rotation_Step);
+    engine.add_scan_matching_request(pyramid, spe, pose, raw_scan, map);
+
+    // leaves of the search are cells of the lookup range that are shorter
+    // than the translation step (i.e. half map cells); their corners and
+    // centers are checked (see BruteForceMultiResolutionScanMatcher)
+    auto match = engine.next_best_match(Map_Scale);
+    ASSERT_TRUE(match.is_valid());
+    while (!match.is_finest()) {
+      auto points = match.translation_drift.corners();
+      points.push_back(match.translation_drift.center());
+      for (const auto &p : points) {
+        engine.add_refined_match(match, Rect{p});
+      }
+      match = engine.next_best_match(Map_Scale);
+      ASSERT_TRUE(match.is_valid());
+    }
+
+    auto best_score = double{-1};
+    auto best_drift = Point2D{};
+    auto best_rotation = double{0};
+    for (auto rotation : {0.0, -Rotation_Step, Rotation_Step}) {
+      auto scan = prerotated_scan(raw_scan, pose, rotation);
+      for (int y = -32; y <= 32; ++y) {
+        for (int x = -32; x <= 32; ++x) {
+          // NB: corners are at even quarter cells, centers - at odd ones
+          if ((x - y) % 2) { continue; }
+          auto d_x = x * Map_Scale / 4, d_y = y * Map_Scale / 4;
+          auto score = finest_score(scan, pose, d_x, d_y);
+          if (best_score < score) {
+            best_score = score;
+            best_drift = {d_x, d_y};
+            best_rotation = rotation;
+          }
+        }
+      }
+    }
+    ASSERT_NEAR(best_score, match.prob_upper_bound, 1e-9);
+    auto c = match.translation_drift.center();
+    ASSERT_NEAR(best_drift.x, c.x, 1e-9);
+    ASSERT_NEAR(best_drift.y, c.y, 1e-9);
+    ASSERT_NEAR(best_rotation, match.rotation, 1e-9);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "../../../src/core/scan_matchers/monte_carlo_scan_matcher.h"
+
+//------------------------------------------------------------------------------
+// Quasi-random sampling
+
+TEST(QuasiRandomSamplingTest, radicalInverse) {
+  ASSERT_EQ(0.0, radical_inverse(2, 0));
+  ASSERT_EQ(0.5, radical_inverse(2, 1));
+  ASSERT_EQ(0.25, radical_inverse(2, 2));
+  ASSERT_EQ(0.75, radical_inverse(2, 3));
+  ASSERT_NEAR(1.0 / 3, radical_inverse(3, 1), 1e-15);
+  ASSERT_NEAR(1.0 / 9 + 1.0 / 3, radical_inverse(3, 4), 1e-15);
+}
+
+TEST(QuasiRandomSamplingTest, standardNormalQuantile) {
+  ASSERT_NEAR(0, standard_normal_quantile(0.5), 1e-9);
+  ASSERT_NEAR(1.959963985, standard_normal_quantile(0.975), 1e-8);
+  ASSERT_NEAR(-1.959963985, standard_normal_quantile(0.025), 1e-8);
+  ASSERT_NEAR(-3.090232306, standard_normal_quantile(0.001), 1e-8);
+  ASSERT_NEAR(3.090232306, standard_normal_quantile(0.999), 1e-8);
+}
+
+TEST(QuasiRandomSamplingTest, haltonShiftsFollowDispersion) {
+  static constexpr double Dispersion = 0.2;
+  static constexpr unsigned Poses_Nm = 1000;
+  auto pe = HaltonGaussianPoseEnumerator{42, Dispersion, Dispersion,
+                                         Poses_Nm, Poses_Nm};
+  pe.reset();
+  double sum = 0, sq_sum = 0;
+  for (unsigned i = 0; i < Poses_Nm; ++i) {
+    auto pose = pe.next(RobotPose{});
+    pe.feedback(false);
+    sum += pose.x;
+    sq_sum += pose.x * pose.x;
+  }
+  ASSERT_NEAR(0, sum / Poses_Nm, 0.01);
+  ASSERT_NEAR(Dispersion, std::sqrt(sq_sum / Poses_Nm), 0.01);
+}
+
+TEST(QuasiRandomSamplingTest, haltonShiftsAreMoreEvenThanRandom) {
+  static constexpr unsigned Poses_Nm = 100;
+  // the max deviation of the empirical CDF of shifts from the Gaussian one
+  auto cdf_deviation = [](PoseEnumerator &pe) {
+    pe.reset();
+    auto xs = std::vector<double>{};
+    for (unsigned i = 0; i < Poses_Nm; ++i) {
+      xs.push_back(pe.next(RobotPose{}).x);
+      pe.feedback(false);
+    }
+    std::sort(xs.begin(), xs.end());
+    auto deviation = double{0};
+    for (unsigned i = 0; i < Poses_Nm; ++i) {
+      auto cdf = 0.5 * std::erfc(-xs[i] / std::sqrt(2));
+      deviation = std::max({deviation, std::abs(cdf - double(i) / Poses_Nm),
+                            std::abs(cdf - double(i + 1) / Poses_Nm)});
+    }
+    return deviation;
+  };
+
+  for (unsigned seed = 0; seed < 10; ++seed) {
+    auto random_pe = GaussianPoseEnumerator{seed, 1, 1, Poses_Nm, Poses_Nm};
+    auto halton_pe = HaltonGaussianPoseEnumerator{seed, 1, 1,
+                                                  Poses_Nm, Poses_Nm};
+    ASSERT_LT(cdf_deviation(halton_pe), cdf_deviation(random_pe));
+  }
+}
+
+//----------------------------------------------------------------------------//
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/scan_matchers/scan_matcher_profiler.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+
+class ScanMatcherProfilerTest : public ::testing::Test {
+protected: // methods
+  ScanMatcherProfilerTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 0.1}}
+    , os{std::make_shared<std::ostringstream>()} {}
+
+  // a matching of an enumerating matcher (with a summary of tests)
+  void match(ScanMatcherProfiler &profiler, std::size_t tests_nm,
+             std::size_t moves_nm) {
+    profiler.on_matching_start(pose, scan, map);
+    auto summary = ScanTestsSummary{};
+    for (std::size_t i = 0; i < tests_nm; ++i) { summary.add_test(0.5); }
+    // NB: the initial pose is reported as an update too
+    for (std::size_t i = 0; i <= moves_nm; ++i) {
+      profiler.on_pose_update(pose, scan.scan, 0.5);
+    }
+    summary.pose_updates_nm = moves_nm;
+    profiler.on_scan_tests_summary(summary);
+    profiler.on_matching_end(pose, scan.scan, 0.5);
+  }
+
+  std::size_t lines_nm() const {
+    auto text = os->str();
+    return std::count(text.begin(), text.end(), '\n');
+  }
+
+protected: // fields
+  UnboundedPlainGridMap map;
+  std::shared_ptr<std::ostringstream> os;
+  RobotPose pose;
+  TransformedLaserScan scan;
+};
+
+TEST_F(ScanMatcherProfilerTest, noPerTestEventsAreRequested) {
+  ScanMatcherProfiler profiler{"HC", os};
+  ASSERT_EQ(0u, profiler.scan_test_period());
+}
+
+TEST_F(ScanMatcherProfilerTest, windowStats) {
+  ScanMatcherProfiler profiler{"HC", os, 10};
+  match(profiler, 10, 1);
+  match(profiler, 30, 3);
+
+  auto stats = profiler.window_stats();
+  ASSERT_EQ(2u, stats.matchings_nm);
+  ASSERT_EQ(20, stats.tests_mean);
+  ASSERT_EQ(30, stats.tests_max);
+  ASSERT_EQ(2, stats.moves_mean);
+  ASSERT_EQ(3, stats.moves_max);
+  ASSERT_LE(stats.ms_p50, stats.ms_max);
+  ASSERT_EQ(0u, lines_nm());
+}
+
+TEST_F(ScanMatcherProfilerTest, movesOfMatchersWithoutTests) {
+  ScanMatcherProfiler profiler{"GN", os, 10};
+  profiler.on_matching_start(pose, scan, map);
+  profiler.on_pose_update(pose, scan.scan, 0.5);
+  profiler.on_pose_update(pose, scan.scan, 0.6);
+  profiler.on_matching_end(pose, scan.scan, 0.6);
+
+  auto stats = profiler.window_stats();
+  ASSERT_EQ(0, stats.tests_mean);
+  ASSERT_EQ(2, stats.moves_mean);
+}
+
+TEST_F(ScanMatcherProfilerTest, csvLinePerFullWindow) {
+  {
+    ScanMatcherProfiler profiler{"HC", os, 2};
+    for (int i = 0; i < 4; ++i) { match(profiler, 5, 1); }
+    // header and two windows
+    ASSERT_EQ(3u, lines_nm());
+    ASSERT_EQ(0u, profiler.window_stats().matchings_nm);
+    match(profiler, 5, 1);
+  }
+  // the incomplete window is dumped on destruction
+  ASSERT_EQ(4u, lines_nm());
+  ASSERT_EQ(0u, os->str().find("matcher,matchings,"));
+  ASSERT_NE(std::string::npos, os->str().find("\nHC,2,"));
+  ASSERT_NE(std::string::npos, os->str().find("\nHC,1,"));
+}
+
+TEST_F(ScanMatcherProfilerTest, jsonLinePerWindow) {
+  ScanMatcherProfiler profiler{"MC", os, 1, "json"};
+  match(profiler, 7, 2);
+  ASSERT_EQ(1u, lines_nm());
+  auto line = os->str();
+  ASSERT_EQ(0u, line.find("{\"matcher\": \"MC\", \"matchings\": 1,"));
+  ASSERT_NE(std::string::npos, line.find("\"tests_mean\": 7,"));
+  ASSERT_NE(std::string::npos, line.find("\"moves_max\": 2,"));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,283 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/area_score_tables_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/local_score_window.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/scan_matchers/scan_scoring_kernels.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/scan_matchers/weighted_mean_point_probability_spe.h"
+
+class ScanScoringKernelsTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+  using MapT = AreaScoreTablesGridMap<UnboundedPlainGridMap>;
+protected: // methods
+  ScanScoringKernelsTest()
+    : cell_proto{std::make_shared<MockGridCell>(0.5)}
+    , rnd_engine{42} {}
+
+  // fills both maps the same way
+  void fill_maps(GridMap &map, GridMap &plain_map) {
+    auto coord_rv = std::uniform_int_distribution<int>{-30, 30};
+    auto occ_rv = std::uniform_real_distribution<double>{0, 1};
+    for (unsigned i = 0; i < 2000; ++i) {
+      auto area_id = Coord{coord_rv(rnd_engine), coord_rv(rnd_engine)};
+      auto aoo = AreaOccupancyObservation{true, Occupancy(occ_rv(rnd_engine), 0),
+                                          {0, 0}, 0};
+      map.update(area_id, aoo);
+      plain_map.update(area_id, aoo);
+    }
+  }
+
+  LaserScan2D random_scan(unsigned points_nm) {
+    auto range_rv = std::uniform_real_distribution<double>{0.1, 3.5};
+    auto angle_rv = std::uniform_real_distribution<double>{-M_PI, M_PI};
+    auto scan = LaserScan2D{};
+    scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+    for (unsigned i = 0; i < points_nm; ++i) {
+      scan.points().emplace_back(range_rv(rnd_engine), angle_rv(rnd_engine));
+    }
+    return scan;
+  }
+
+  std::vector<RobotPose> random_poses(unsigned poses_nm) {
+    auto shift_rv = std::uniform_real_distribution<double>{-0.5, 0.5};
+    auto poses = std::vector<RobotPose>{};
+    for (unsigned i = 0; i < poses_nm; ++i) {
+      // NB: runs of poses with the same theta share rotated points
+      poses.emplace_back(shift_rv(rnd_engine), shift_rv(rnd_engine),
+                         (i / 4) * 0.1);
+    }
+    return poses;
+  }
+
+  void test_spe(std::shared_ptr<ScanPointWeighting> spw,
+                double rejection_threshold) {
+    auto map = MapT{cell_proto, {1, 1, 0.1}};
+    auto plain_map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+    fill_maps(map, plain_map);
+    auto spe = WeightedMeanPointProbabilitySPE{
+      std::make_shared<ObstacleBasedOccupancyObservationPE>(), spw};
+    auto scan = spe.filter_scan(random_scan(100), RobotPose{}, plain_map);
+    auto poses = random_poses(32);
+    auto params = ScanProbabilityEstimator::SPEParams{};
+    params.rejection_threshold = rejection_threshold;
+
+    auto expected = std::vector<double>(poses.size());
+    spe.estimate_scan_probabilities(scan, poses.data(), poses.size(),
+                                    plain_map, params, expected.data());
+    for (auto isa : {ScanScoringIsa::Scalar, ScanScoringIsa::Avx2,
+                     ScanScoringIsa::Neon}) {
+      spe.set_scoring_isa(isa);
+      auto actual = std::vector<double>(poses.size());
+      spe.estimate_scan_probabilities(scan, poses.data(), poses.size(),
+                                      map, params, actual.data());
+      for (std::size_t i = 0; i < poses.size(); ++i) {
+        ASSERT_NEAR(expected[i], actual[i], 1e-9);
+      }
+    }
+  }
+
+protected: // fields
+  std::shared_ptr<GridCell> cell_proto;
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(ScanScoringKernelsTest, kernelsMatchScalarOne) {
+  auto scores = std::vector<double>(20 * 10);
+  auto score_rv = std::uniform_real_distribution<double>{0, 1};
+  for (auto &score : scores) { score = score_rv(rnd_engine); }
+  auto view = CellScoresView{scores.data(), {-5, -3}, 20, 10, 0.1, 0.5};
+
+  // NB: some points are outside the scores
+  auto coord_rv = std::uniform_real_distribution<double>{-1.5, 2.5};
+  auto xs = std::vector<Real>{}, ys = xs;
+  auto ws = std::vector<double>{};
+  for (unsigned i = 0; i < 37; ++i) {
+    xs.push_back(coord_rv(rnd_engine));
+    ys.push_back(coord_rv(rnd_engine));
+    ws.push_back(score_rv(rnd_engine));
+  }
+
+  auto expected = ScanScoringKernels::weighted_cell_scores(
+    ScanScoringIsa::Scalar, view, xs.data(), ys.data(), ws.data(), xs.size(),
+    0.05, -0.15);
+  for (auto isa : {ScanScoringIsa::Avx2, ScanScoringIsa::Neon}) {
+    auto actual = ScanScoringKernels::weighted_cell_scores(
+      isa, view, xs.data(), ys.data(), ws.data(), xs.size(), 0.05, -0.15);
+    ASSERT_NEAR(expected, actual, 1e-9);
+  }
+}
+
+TEST_F(ScanScoringKernelsTest, evenWeightedScoring) {
+  test_spe(std::make_shared<EvenSPW>(), -1);
+}
+
+TEST_F(ScanScoringKernelsTest, vinyWeightedScoring) {
+  test_spe(std::make_shared<VinySlamSPW>(), -1);
+}
+
+TEST_F(ScanScoringKernelsTest, rejectedScoring) {
+  test_spe(std::make_shared<EvenSPW>(), 0.55);
+}
+
+TEST_F(ScanScoringKernelsTest, localWindowScoring) {
+  auto map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  auto other_map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill_maps(map, other_map);
+  auto spe = WeightedMeanPointProbabilitySPE{
+    std::make_shared<ObstacleBasedOccupancyObservationPE>(),
+    std::make_shared<VinySlamSPW>()};
+  ASSERT_TRUE(spe.scores_points_by_cells());
+  auto scan = spe.filter_scan(random_scan(100), RobotPose{}, map);
+  auto poses = random_poses(32);
+  auto expected = std::vector<double>(poses.size());
+  spe.estimate_scan_probabilities(scan, poses.data(), poses.size(), map,
+                                  {}, expected.data());
+
+  // NB: points leave the small window, so poses are estimated by the map;
+  //     the large window exceeds the map.
+  for (auto half_side : {2.0, 10.0}) {
+    auto window = LocalScoreWindow{};
+    window.extract(map, -half_side, -half_side, half_side, half_side);
+    auto scores = window.cell_scores();
+    auto params = ScanProbabilityEstimator::SPEParams{};
+    params.local_scores = &scores;
+    auto actual = std::vector<double>(poses.size());
+    spe.estimate_scan_probabilities(scan, poses.data(), poses.size(), map,
+                                    params, actual.data());
+    for (std::size_t i = 0; i < poses.size(); ++i) {
+      ASSERT_NEAR(expected[i], actual[i], 1e-9);
+    }
+  }
+}
+
+TEST_F(ScanScoringKernelsTest, syncedWindowFollowsMapUpdates) {
+  auto map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  auto other_map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill_maps(map, other_map);
+  auto window = LocalScoreWindow{};
+  ASSERT_FALSE(window.sync(map, -1, -1, 1, 1, 1));
+
+  // modifications both in and out of the window
+  auto obs = AreaOccupancyObservation{true, Occupancy(0.95, 0), {0, 0}, 0};
+  map.update({3, -2}, obs);
+  map.update({-40, 40}, obs);
+  ASSERT_TRUE(window.sync(map, -1.5, -0.5, 1.5, 0.5, 1));
+  auto expected_window = LocalScoreWindow{};
+  expected_window.extract(map, -2, -2, 2, 2);
+
+  auto actual = window.cell_scores(), expected = expected_window.cell_scores();
+  ASSERT_EQ(expected.min, actual.min);
+  ASSERT_EQ(expected.width, actual.width);
+  ASSERT_EQ(expected.height, actual.height);
+  for (int i = 0; i < expected.width * expected.height; ++i) {
+    ASSERT_EQ(expected.scores[i], actual.scores[i]);
+  }
+
+  // the window is extracted again once the rectangle leaves it
+  ASSERT_FALSE(window.sync(map, 1.5, -0.5, 2.5, 0.5, 1));
+  ASSERT_FALSE(window.sync(other_map, 1.5, -0.5, 2.5, 0.5, 1));
+}
+
+TEST_F(ScanScoringKernelsTest, syncedWindowTellsReplacedMapApart) {
+  auto map = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+  auto other_map = UnboundedLazyTiledGridMap{cell_proto, {1, 1, 0.1}};
+  fill_maps(map, other_map);
+  // NB: the copy keeps the map's versions
+  auto map_copy = map;
+  auto window = LocalScoreWindow{};
+  window.sync(map, -1, -1, 1, 1, 1);
+
+  auto obs = AreaOccupancyObservation{true, Occupancy(0.95, 0), {0, 0}, 0};
+  map_copy.update({0, 0}, obs);
+  map_copy.update({5, 5}, obs);
+  map = map_copy;
+  ASSERT_FALSE(window.sync(map, -1, -1, 1, 1, 1));
+  auto expected_window = LocalScoreWindow{};
+  expected_window.extract(map, -2, -2, 2, 2);
+
+  auto actual = window.cell_scores(), expected = expected_window.cell_scores();
+  ASSERT_EQ(expected.width, actual.width);
+  ASSERT_EQ(expected.height, actual.height);
+  for (int i = 0; i < expected.width * expected.height; ++i) {
+    ASSERT_EQ(expected.scores[i], actual.scores[i]);
+  }
+}
+
+TEST_F(ScanScoringKernelsTest, pointWeightsAreComputedOnFiltering) {
+  auto map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  auto other_map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill_maps(map, other_map);
+  auto spw = std::make_shared<VinySlamSPW>();
+  auto spe = WeightedMeanPointProbabilitySPE{
+    std::make_shared<ObstacleBasedOccupancyObservationPE>(), spw};
+  auto raw_scan = random_scan(100);
+  raw_scan.points()[0].set_factor(3);
+  const auto scan = spe.filter_scan(raw_scan, RobotPose{}, map);
+
+  const auto *weights = scan.point_weights();
+  ASSERT_NE(nullptr, weights);
+  const auto &pts = scan.points();
+  ASSERT_EQ(pts.size(), weights->values.size());
+  auto total_weight = double{0};
+  for (std::size_t i = 0; i < pts.size(); ++i) {
+    ASSERT_EQ(spw->weight(pts, i) * pts[i].factor(), weights->values[i]);
+    total_weight += weights->values[i];
+  }
+  ASSERT_EQ(total_weight, weights->total);
+
+  // prerotated copies keep weights of their points
+  auto pose = RobotPose{0.1, -0.2, 0.3};
+  auto rotated_scan = scan.to_cartesian(pose.theta);
+  ASSERT_EQ(weights, rotated_scan.point_weights());
+  auto params = ScanProbabilityEstimator::SPEParams{};
+  params.scan_is_prerotated = true;
+  ASSERT_NEAR(spe.estimate_scan_probability(scan, pose, map, {}),
+              spe.estimate_scan_probability(
+                rotated_scan, {pose.x, pose.y, 0}, map, params), 1e-9);
+}
+
+TEST_F(ScanScoringKernelsTest, prefilteredScanIsFilteredAsRawOne) {
+  auto map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  auto other_map = UnboundedPlainGridMap{cell_proto, {1, 1, 0.1}};
+  fill_maps(map, other_map);
+  auto spe = WeightedMeanPointProbabilitySPE{
+    std::make_shared<ObstacleBasedOccupancyObservationPE>(),
+    std::make_shared<VinySlamSPW>(), 2};
+  auto raw_scan = random_scan(100);
+  raw_scan.points()[1].set_factor(3);
+  raw_scan.points()[2] = ScanPoint2D{1.0, 0.5, false};
+  auto pose = RobotPose{0.1, -0.2, 0.3};
+  const auto expected = spe.filter_scan(raw_scan, pose, map);
+
+  raw_scan.set_prefiltered(
+    std::make_shared<const LaserScan2D>(spe.prefilter_scan(raw_scan)));
+  const auto actual = spe.filter_scan(raw_scan, pose, map);
+  ASSERT_EQ(raw_scan.prefiltered()->features(), actual.features());
+  ASSERT_EQ(expected.points().size(), actual.points().size());
+  for (std::size_t i = 0; i < expected.points().size(); ++i) {
+    ASSERT_EQ(expected.points()[i].range(), actual.points()[i].range());
+    ASSERT_EQ(expected.points()[i].angle(), actual.points()[i].angle());
+    ASSERT_EQ(expected.point_weights()->values[i],
+              actual.point_weights()->values[i]);
+  }
+  ASSERT_NEAR(spe.estimate_scan_probability(expected, pose, map, {}),
+              spe.estimate_scan_probability(actual, pose, map, {}), 1e-9);
+
+  // points are modified, so the prefiltered scan is dropped
+  raw_scan.points().pop_back();
+  ASSERT_EQ(nullptr, raw_scan.prefiltered());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/typed_grid_map.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/scan_matchers/static_weighted_mean_point_probability_spe.h"
+
+class StaticWmppSpeTest : public ::testing::Test {
+protected: // types
+  using Coord = DiscretePoint2D;
+  using MapT = TypedGridMap<MockGridCell>;
+protected: // methods
+  StaticWmppSpeTest()
+    : cell_proto{std::make_shared<MockGridCell>(0.5)}
+    , map{cell_proto, {1, 1, 0.1}}, plain_map{cell_proto, {1, 1, 0.1}}
+    , rnd_engine{42} {
+    auto coord_rv = std::uniform_int_distribution<int>{-30, 30};
+    auto occ_rv = std::uniform_real_distribution<double>{0, 1};
+    for (unsigned i = 0; i < 2000; ++i) {
+      auto area_id = Coord{coord_rv(rnd_engine), coord_rv(rnd_engine)};
+      auto aoo = AreaOccupancyObservation{true, Occupancy(occ_rv(rnd_engine),
+                                                          0),
+                                          {0, 0}, 0};
+      map.update(area_id, aoo);
+      plain_map.update(area_id, aoo);
+    }
+  }
+
+  LaserScan2D random_scan(unsigned points_nm) {
+    auto range_rv = std::uniform_real_distribution<double>{0.1, 3.5};
+    auto angle_rv = std::uniform_real_distribution<double>{-M_PI, M_PI};
+    auto scan = LaserScan2D{};
+    scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+    for (unsigned i = 0; i < points_nm; ++i) {
+      scan.points().emplace_back(range_rv(rnd_engine), angle_rv(rnd_engine));
+    }
+    return scan;
+  }
+
+  std::vector<RobotPose> random_poses(unsigned poses_nm) {
+    auto shift_rv = std::uniform_real_distribution<double>{-0.5, 0.5};
+    auto poses = std::vector<RobotPose>{};
+    for (unsigned i = 0; i < poses_nm; ++i) {
+      poses.emplace_back(shift_rv(rnd_engine), shift_rv(rnd_engine),
+                         (i / 4) * 0.1);
+    }
+    return poses;
+  }
+
+  // the static SPE estimates the same as the dynamic one on both maps
+  template <typename OopeT, typename SpwT>
+  void test_spe(double rejection_threshold = -1, double area_side = 0) {
+    auto oope = std::make_shared<OopeT>();
+    auto spw = std::make_shared<SpwT>();
+    auto dynamic_spe = WeightedMeanPointProbabilitySPE{oope, spw};
+    auto static_spe = StaticWeightedMeanPointProbabilitySPE<
+      OopeT, SpwT, MapT>{oope, spw};
+    auto scan = static_spe.filter_scan(random_scan(100), RobotPose{}, map);
+    auto poses = random_poses(32);
+    auto params = ScanProbabilityEstimator::SPEParams{};
+    params.rejection_threshold = rejection_threshold;
+    params.sp_analysis_area = {-area_side / 2, area_side / 2,
+                               -area_side / 2, area_side / 2};
+
+    auto expected = std::vector<double>(poses.size());
+    dynamic_spe.estimate_scan_probabilities(scan, poses.data(), poses.size(),
+                                            map, params, expected.data());
+    for (const GridMap *estimated_map : {(const GridMap*)&map,
+                                         (const GridMap*)&plain_map}) {
+      auto actual = std::vector<double>(poses.size());
+      static_spe.estimate_scan_probabilities(
+        scan, poses.data(), poses.size(), *estimated_map, params,
+        actual.data());
+      for (std::size_t i = 0; i < poses.size(); ++i) {
+        ASSERT_NEAR(expected[i], actual[i], 1e-9);
+      }
+    }
+    ASSERT_NEAR(expected[0], static_spe.estimate_scan_probability(
+                               scan, poses[0], map, params), 1e-9);
+  }
+
+protected: // fields
+  std::shared_ptr<GridCell> cell_proto;
+  MapT map;
+  UnboundedPlainGridMap plain_map;
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(StaticWmppSpeTest, obstacleEven) {
+  test_spe<ObstacleBasedOccupancyObservationPE, EvenSPW>();
+}
+
+TEST_F(StaticWmppSpeTest, obstacleViny) {
+  test_spe<ObstacleBasedOccupancyObservationPE, VinySlamSPW>();
+}
+
+TEST_F(StaticWmppSpeTest, obstacleAnyWeighting) {
+  test_spe<ObstacleBasedOccupancyObservationPE, AngleHistogramReciprocalSPW>();
+}
+
+TEST_F(StaticWmppSpeTest, obstacleRejected) {
+  test_spe<ObstacleBasedOccupancyObservationPE, EvenSPW>(0.55);
+}
+
+TEST_F(StaticWmppSpeTest, maxArea) {
+  test_spe<MaxOccupancyObservationPE, VinySlamSPW>(-1, 0.35);
+}
+
+TEST_F(StaticWmppSpeTest, meanArea) {
+  test_spe<MeanOccupancyObservationPE, EvenSPW>(-1, 0.35);
+}
+
+TEST_F(StaticWmppSpeTest, replacedOopeIsUsed) {
+  auto spw = std::make_shared<EvenSPW>();
+  auto spe = StaticWeightedMeanPointProbabilitySPE<
+    ObstacleBasedOccupancyObservationPE, EvenSPW, MapT>{
+      std::make_shared<ObstacleBasedOccupancyObservationPE>(), spw};
+  auto scan = spe.filter_scan(random_scan(50), RobotPose{}, map);
+  auto params = ScanProbabilityEstimator::SPEParams{};
+  params.sp_analysis_area = {-0.2, 0.2, -0.2, 0.2};
+  auto max_oope = std::make_shared<MaxOccupancyObservationPE>();
+  auto expected = WeightedMeanPointProbabilitySPE{max_oope, spw}
+                    .estimate_scan_probability(scan, RobotPose{}, map, params);
+
+  spe.set_oope(max_oope);
+  ASSERT_NEAR(expected,
+              spe.estimate_scan_probability(scan, RobotPose{}, map, params),
+              1e-9);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
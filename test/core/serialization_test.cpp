@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../../src/core/serialization.h"
+
+class SerializationTest : public ::testing::Test {
+protected: // methods
+  // Runs of equal bytes (compressible) interleaved with random bytes
+  static std::vector<char> make_data(std::size_t size) {
+    auto rnd_engine = std::mt19937{42};
+    auto data = std::vector<char>(size);
+    for (std::size_t i = 0; i < size; ++i) {
+      data[i] = (i / 100) % 2 ? char(rnd_engine()) : char(i / 200);
+    }
+    return data;
+  }
+};
+
+TEST_F(SerializationTest, valuesAreRestored) {
+  auto s = Serializer{};
+  s << uint32_t(7) << -2.5 << true;
+  auto data = s.result();
+
+  auto d = Deserializer{data};
+  ASSERT_EQ(7u, d.read_value<uint32_t>());
+  ASSERT_EQ(-2.5, d.read_value<double>());
+  ASSERT_TRUE(d.read_value<bool>());
+  ASSERT_EQ(data.size(), d.pos());
+  ASSERT_FALSE(d.is_overrun());
+}
+
+TEST_F(SerializationTest, truncatedValueIsNotRead) {
+  auto s = Serializer{};
+  s << uint32_t(7) << uint64_t(42);
+  auto data = s.result();
+  data.pop_back();
+
+  auto d = Deserializer{data};
+  ASSERT_EQ(7u, d.read_value<uint32_t>());
+  ASSERT_EQ(0u, d.read_value<uint64_t>());
+  ASSERT_TRUE(d.is_overrun());
+  ASSERT_LT(data.size(), d.pos());
+  // the position stays past the end
+  ASSERT_EQ(0, d.read_value<char>());
+  ASSERT_TRUE(d.is_overrun());
+}
+
+#ifdef COMPRESSED_SERIALIZATION
+
+TEST_F(SerializationTest, emptyDataChunks) {
+  auto chunks = Serializer{}.compressed_chunks();
+  ASSERT_EQ(sizeof(uint64_t), chunks.size());
+  ASSERT_TRUE(Deserializer::decompress_chunks(chunks.data(),
+                                              chunks.size()).empty());
+}
+
+TEST_F(SerializationTest, singleChunkIsRestored) {
+  auto data = make_data(1000);
+  auto chunks = Serializer{data}.compressed_chunks();
+  // a table of one chunk
+  ASSERT_EQ(1u, Deserializer{chunks}.read_value<uint64_t>());
+  ASSERT_EQ(data, Deserializer::decompress_chunks(chunks.data(),
+                                                  chunks.size()));
+}
+
+TEST_F(SerializationTest, manyChunksAreRestored) {
+  static constexpr std::size_t Chunk_Size = 64;
+  // the last chunk is a partial one
+  auto data = make_data(100 * Chunk_Size + 10);
+  auto chunks = Serializer{data}.compressed_chunks(Chunk_Size);
+  ASSERT_EQ(101u, Deserializer{chunks}.read_value<uint64_t>());
+  // runs of equal bytes are compressed
+  ASSERT_LT(chunks.size(), data.size());
+  ASSERT_EQ(data, Deserializer::decompress_chunks(chunks.data(),
+                                                  chunks.size()));
+}
+
+TEST_F(SerializationTest, truncatedChunksAreRejected) {
+  static constexpr std::size_t Chunk_Size = 64;
+  auto chunks = Serializer{make_data(10 * Chunk_Size)}.compressed_chunks(
+    Chunk_Size);
+  auto table_size = sizeof(uint64_t) * (1 + 2 * 10);
+  // a truncated chunks number, table and the last chunk
+  for (auto size : {std::size_t{3}, table_size - 1, chunks.size() - 1}) {
+    ASSERT_TRUE(Deserializer::decompress_chunks(chunks.data(),
+                                                size).empty());
+  }
+}
+
+TEST_F(SerializationTest, corruptTableIsRejected) {
+  static constexpr std::size_t Chunk_Size = 64;
+  auto data = make_data(10 * Chunk_Size);
+  auto chunks = Serializer{data}.compressed_chunks(Chunk_Size);
+  auto corrupt = [&chunks](std::size_t value_i, uint64_t value) {
+    auto corrupt_chunks = chunks;
+    auto pos = value_i * sizeof(uint64_t);
+    std::memcpy(corrupt_chunks.data() + pos, &value, sizeof(value));
+    return Deserializer::decompress_chunks(corrupt_chunks.data(),
+                                           corrupt_chunks.size());
+  };
+
+  // chunks numbers that overflow the table size
+  ASSERT_TRUE(corrupt(0, uint64_t(1) << 63).empty());
+  ASSERT_TRUE(corrupt(0, ~uint64_t(0)).empty());
+  ASSERT_TRUE(corrupt(0, 1000).empty());
+  // raw and stored sizes of the first chunk
+  ASSERT_TRUE(corrupt(1, ~uint64_t(0)).empty());
+  ASSERT_TRUE(corrupt(1, Chunk_Size + 1).empty());
+  ASSERT_TRUE(corrupt(2, ~uint64_t(0)).empty());
+  ASSERT_TRUE(corrupt(2, chunks.size()).empty());
+  // the table is kept intact
+  ASSERT_EQ(data, corrupt(1, Chunk_Size));
+}
+
+#endif
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
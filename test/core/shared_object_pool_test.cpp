@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../src/core/shared_object_pool.h"
+
+class SharedObjectPoolTest : public ::testing::Test {
+protected: // fields
+  SharedObjectPool<int> pool{2};
+};
+
+TEST_F(SharedObjectPoolTest, emptyPoolHasNoReleasedObject) {
+  ASSERT_EQ(nullptr, pool.released());
+}
+
+TEST_F(SharedObjectPoolTest, objectIsReusedOnlyAfterRelease) {
+  auto consumer_ref = std::make_shared<int>(1);
+  pool.keep(consumer_ref);
+  ASSERT_EQ(nullptr, pool.released());
+
+  auto object = consumer_ref.get();
+  consumer_ref.reset();
+  ASSERT_EQ(object, pool.released().get());
+}
+
+TEST_F(SharedObjectPoolTest, fullPoolDropsNewObjects) {
+  auto objects = std::vector<std::shared_ptr<int>>{
+    std::make_shared<int>(1), std::make_shared<int>(2),
+    std::make_shared<int>(3)};
+  for (auto &object : objects) { pool.keep(object); }
+
+  auto last = objects.back().get();
+  objects.clear();
+  for (unsigned i = 0; i < 2; ++i) {
+    auto released = pool.released();
+    ASSERT_NE(nullptr, released);
+    ASSERT_NE(last, released.get());
+    // NB: the object is held, so the next one is released
+    objects.push_back(released);
+  }
+  ASSERT_EQ(nullptr, pool.released());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "../../src/core/stage_profiler.h"
+
+class StageProfilerTest : public ::testing::Test {
+protected: // types
+  struct ProfileCollector : public StageProfileObserver {
+    void on_stage_profile(const StageProfile &profile) override {
+      profiles.push_back(profile);
+    }
+    std::vector<StageProfile> profiles;
+  };
+protected: // methods
+  // percentiles are upper bounds of buckets, i.e. they may exceed
+  // an actual value by at most 1/8 of it
+  void assert_latency(double expected_ms, double actual_ms) {
+    ASSERT_LE(expected_ms, actual_ms);
+    ASSERT_LE(actual_ms, expected_ms * 1.125);
+  }
+};
+
+TEST_F(StageProfilerTest, emptyHistogram) {
+  LatencyHistogram histogram;
+  auto stats = histogram.stats();
+  ASSERT_EQ(0u, stats.count);
+  ASSERT_EQ(0, stats.p50);
+  ASSERT_EQ(0, stats.max);
+}
+
+TEST_F(StageProfilerTest, smallLatenciesAreExact) {
+  LatencyHistogram histogram;
+  for (uint64_t ns = 0; ns < 8; ++ns) { histogram.add(ns); }
+  auto stats = histogram.stats();
+  ASSERT_EQ(8u, stats.count);
+  ASSERT_EQ(4e-6, stats.p50);
+  ASSERT_EQ(7e-6, stats.p99);
+  ASSERT_EQ(7e-6, stats.max);
+}
+
+TEST_F(StageProfilerTest, histogramPercentiles) {
+  LatencyHistogram histogram;
+  // 1..100 ms
+  for (uint64_t ms = 1; ms <= 100; ++ms) { histogram.add(ms * 1000000); }
+  auto stats = histogram.stats();
+  ASSERT_EQ(100u, stats.count);
+  ASSERT_DOUBLE_EQ(50.5, stats.mean);
+  assert_latency(51, stats.p50);
+  assert_latency(96, stats.p95);
+  assert_latency(100, stats.p99);
+  ASSERT_LE(stats.p99, stats.max);
+  ASSERT_EQ(100, stats.max);
+}
+
+TEST_F(StageProfilerTest, histogramReset) {
+  LatencyHistogram histogram;
+  histogram.add(1000000);
+  histogram.reset();
+  histogram.add(2000000);
+  auto stats = histogram.stats();
+  ASSERT_EQ(1u, stats.count);
+  ASSERT_EQ(2, stats.p50);
+  ASSERT_EQ(2, stats.max);
+}
+
+TEST_F(StageProfilerTest, nullProfilerTimerMeasuresNothing) {
+  StageTimer timer{nullptr, SlamStage::ScanMatching};
+}
+
+TEST_F(StageProfilerTest, stagesAreMeasuredSeparately) {
+  auto profiler = std::make_shared<StageProfiler>(0);
+  profiler->add(SlamStage::ScanMatching, std::chrono::milliseconds{3});
+  profiler->add(SlamStage::ScanMatching, std::chrono::milliseconds{3});
+  { StageTimer timer{profiler, SlamStage::MapInsertion}; }
+
+  ASSERT_EQ(2u, profiler->stats(SlamStage::ScanMatching).count);
+  ASSERT_EQ(3, profiler->stats(SlamStage::ScanMatching).max);
+  ASSERT_EQ(1u, profiler->stats(SlamStage::MapInsertion).count);
+  ASSERT_EQ(0u, profiler->stats(SlamStage::Resampling).count);
+}
+
+TEST_F(StageProfilerTest, disabledReports) {
+  StageProfiler profiler{0};
+  auto collector = std::make_shared<ProfileCollector>();
+  profiler.subscribe(collector);
+  profiler.add(SlamStage::ScanMatching, std::chrono::milliseconds{1});
+  profiler.finish_cycle();
+  ASSERT_TRUE(collector->profiles.empty());
+  ASSERT_EQ(1u, profiler.stats(SlamStage::ScanMatching).count);
+}
+
+TEST_F(StageProfilerTest, reportResetsStages) {
+  // NB: a tiny period passes by the end of the first cycle
+  auto profiler = std::make_shared<StageProfiler>(1e-9);
+  auto collector = std::make_shared<ProfileCollector>();
+  profiler->subscribe(collector);
+  profiler->add(SlamStage::ScanMatching, std::chrono::milliseconds{5});
+  profiler->add(SlamStage::ObserversNotification,
+                std::chrono::milliseconds{1});
+  profiler->finish_cycle();
+
+  ASSERT_EQ(1u, collector->profiles.size());
+  auto &profile = collector->profiles[0];
+  ASSERT_EQ(1u, profile.cycles_nm);
+  ASSERT_LT(0, profile.period_secs);
+  ASSERT_EQ(1u, profile.stage(SlamStage::ScanMatching).count);
+  ASSERT_EQ(5, profile.stage(SlamStage::ScanMatching).p50);
+  ASSERT_EQ(1u, profile.stage(SlamStage::ObserversNotification).count);
+  ASSERT_EQ(0u, profile.stage(SlamStage::MapInsertion).count);
+  ASSERT_EQ(0u, profiler->stats(SlamStage::ScanMatching).count);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+
+#include "../../../src/core/states/compact_laser_scan.h"
+#include "../../../src/core/trigonometry_utils.h"
+
+class CompactLaserScanTest : public ::testing::Test {
+protected: // consts
+  static constexpr int Points_Nm = 360;
+  static constexpr double Max_Range = 30;
+protected: // methods
+  CompactLaserScanTest() : rnd_engine{42} {}
+
+  TransformedLaserScan random_scan(bool has_angle_idxs) {
+    auto range_rv = std::uniform_real_distribution<double>{0.1, Max_Range};
+    auto tr_scan = TransformedLaserScan{};
+    tr_scan.pose_delta = {0.5, -0.2, 0.1};
+    tr_scan.quality = 0.75;
+    for (int i = 0; i < Points_Nm; ++i) {
+      auto sp = ScanPoint2D{range_rv(rnd_engine), 2 * M_PI * i / Points_Nm,
+                            i % 7 != 0};
+      if (has_angle_idxs) { sp.set_angle_idx(i); }
+      tr_scan.scan.points().push_back(sp);
+    }
+    return tr_scan;
+  }
+
+  static void assert_same(const TransformedLaserScan &expected,
+                          const CompactLaserScan &compact) {
+    auto actual = compact.decode(std::make_shared<RawTrigonometryProvider>());
+    ASSERT_EQ(expected.pose_delta, actual.pose_delta);
+    ASSERT_EQ(expected.quality, actual.quality);
+    auto &exp_pts = expected.scan.points();
+    auto &act_pts = static_cast<const LaserScan2D&>(actual.scan).points();
+    ASSERT_EQ(exp_pts.size(), act_pts.size());
+    for (std::size_t i = 0; i < exp_pts.size(); ++i) {
+      ASSERT_NEAR(exp_pts[i].range(), act_pts[i].range(),
+                  compact.range_tolerance() + 1e-12);
+      ASSERT_EQ(exp_pts[i].angle(), act_pts[i].angle());
+      ASSERT_EQ(exp_pts[i].angle_idx(), act_pts[i].angle_idx());
+      ASSERT_EQ(exp_pts[i].is_occupied(), act_pts[i].is_occupied());
+      ASSERT_FLOAT_EQ(exp_pts[i].factor(), act_pts[i].factor());
+    }
+  }
+
+protected: // fields
+  std::mt19937 rnd_engine;
+  CompactLaserScanEncoder encoder;
+};
+
+TEST_F(CompactLaserScanTest, decodedScanIsCloseToOriginal) {
+  auto tr_scan = random_scan(true);
+  auto compact = encoder.encode(tr_scan);
+  ASSERT_LT(compact.range_tolerance(), 0.001);
+  assert_same(tr_scan, compact);
+  // NB: a ScanPoint2D takes 40 bytes, a compact one takes ~4
+  ASSERT_LT(compact.heap_size() * 8,
+            tr_scan.scan.points().size() * sizeof(ScanPoint2D));
+}
+
+TEST_F(CompactLaserScanTest, factorsAndUnindexedAnglesAreKept) {
+  auto tr_scan = random_scan(false);
+  auto &points = tr_scan.scan.points();
+  points[3].set_factor(0.5);
+  points[10].set_factor(2);
+  assert_same(tr_scan, encoder.encode(tr_scan));
+}
+
+TEST_F(CompactLaserScanTest, angleTableIsSharedBySensorScans) {
+  auto first = encoder.encode(random_scan(true));
+  auto second = encoder.encode(random_scan(true));
+  ASSERT_EQ(first.angle_table(), second.angle_table());
+
+  // a scan with other angles gets its own table
+  auto shifted = random_scan(true);
+  for (auto &sp : shifted.scan.points()) {
+    sp = ScanPoint2D{sp.range(), sp.angle() + 0.01, sp.is_occupied()}
+           .set_angle_idx(sp.angle_idx());
+  }
+  auto third = encoder.encode(shifted);
+  ASSERT_NE(first.angle_table(), third.angle_table());
+  assert_same(shifted, third);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -3,6 +3,7 @@
 #include <functional>
 
 #include "../../../src/core/states/sensor_data.h"
+#include "../../../src/core/states/scan_voxel_downsampler.h"
 
 #include "../mock_grid_cell.h"
 #include "../../../src/core/maps/plain_grid_map.h"
@@ -131,6 +132,22 @@ TEST_F(ScanPoint2DTest, convertToCartesianWithProvider) {
   ASSERT_EQ(polar_sp.is_occupied(), cartesian_sp.is_occupied());
 }
 
+TEST_F(ScanPoint2DTest, moveOriginWithIndexedAngle) {
+  // the grid is [-30, 30) deg with 5 deg step, 10 deg has index 8
+  auto ctp = std::make_shared<CachedTrigonometryProvider>();
+  ctp->update(deg2rad(-30), deg2rad(30), deg2rad(5));
+  ctp->set_base_angle(deg2rad(23));
+  auto sp = ScanPoint2D{SPPT::Polar, 4, deg2rad(10), true};
+  auto expected = sp.move_origin(1, 2, ctp);
+
+  sp.set_angle_idx(8);
+  auto actual = sp.move_origin(1, 2, ctp);
+  ASSERT_EQ(expected.x, actual.x);
+  ASSERT_EQ(expected.y, actual.y);
+  ASSERT_NEAR(1 + 4 * std::cos(deg2rad(33)), actual.x, Acc_Error);
+  ASSERT_NEAR(2 + 4 * std::sin(deg2rad(33)), actual.y, Acc_Error);
+}
+
 //----------------------------------------------------------------------------//
 // LaserScan2D
 
@@ -170,6 +187,153 @@ TEST_F(LaserScan2DTest, toCartesianWithRotation) {
   }
 }
 
+TEST_F(LaserScan2DTest, soaMatchesPoints) {
+  auto scan = LaserScan2D{};
+  scan.points().push_back(ScanPoint2D{ScanPoint2D::PointType::Polar, 4, deg2rad(10), true});
+  scan.points().push_back(
+    ScanPoint2D{ScanPoint2D::PointType::Cartesian, -1, 2, false}.set_factor(3));
+  scan.points().back().set_angle_idx(7);
+  ASSERT_FALSE(scan.has_soa());
+
+  const auto &soa = scan.update_soa();
+  ASSERT_TRUE(scan.has_soa());
+  ASSERT_EQ(2u, soa.size());
+  const auto &pts = static_cast<const LaserScan2D&>(scan).points();
+  for (std::size_t i = 0; i < pts.size(); ++i) {
+    ASSERT_EQ(pts[i].range(), soa.ranges[i]);
+    ASSERT_EQ(pts[i].angle(), soa.angles[i]);
+    ASSERT_EQ(pts[i].x(), soa.xs[i]);
+    ASSERT_EQ(pts[i].y(), soa.ys[i]);
+    ASSERT_EQ(pts[i].factor(), soa.factors[i]);
+    ASSERT_EQ(pts[i].angle_idx(), soa.angle_idxs[i]);
+    ASSERT_EQ(pts[i].is_occupied(), bool(soa.occupied[i]));
+  }
+
+  // copies share the form, a modification drops it
+  auto scan_copy = scan;
+  ASSERT_EQ(&scan.soa(), &scan_copy.soa());
+  scan.points().pop_back();
+  ASSERT_FALSE(scan.has_soa());
+  ASSERT_TRUE(scan_copy.has_soa());
+}
+
+TEST_F(LaserScan2DTest, featuresAreComputedOnce) {
+  auto scan = LaserScan2D{};
+  scan.points().emplace_back(1, deg2rad(0));
+  scan.points().emplace_back(1, deg2rad(90));
+  scan.points().emplace_back(2, deg2rad(90));
+
+  auto features = scan.features();
+  ASSERT_EQ(3u, features->drift_dirs.size());
+  ASSERT_EQ(0, features->drift_dirs[0]);
+  ASSERT_NEAR(deg2rad(135), features->drift_dirs[1], 1e-9);
+  ASSERT_NEAR(deg2rad(90), features->drift_dirs[2], 1e-9);
+  scan.update_soa();
+  ASSERT_EQ(features, scan.features());
+
+  // copies share features, a modification drops them
+  auto scan_copy = scan;
+  ASSERT_EQ(features, scan_copy.features());
+  scan.points().pop_back();
+  ASSERT_EQ(2u, scan.features()->drift_dirs.size());
+  ASSERT_EQ(features, scan_copy.features());
+}
+
+TEST_F(LaserScan2DTest, soaToWorldMatchesMoveOrigin) {
+  auto scan = LaserScan2D{};
+  scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+  for (int i = 0; i < 37; ++i) {
+    scan.points().emplace_back(1 + 0.25 * i, deg2rad(-90 + 5 * i), true);
+  }
+  const auto &soa = scan.update_soa();
+
+  auto pose = RobotPose{3, -2, deg2rad(-37)};
+  auto world_xs = std::vector<Real>{}, world_ys = std::vector<Real>{};
+  soa.to_world(pose, world_xs, world_ys);
+
+  scan.trig_provider->set_base_angle(pose.theta);
+  const auto &pts = static_cast<const LaserScan2D&>(scan).points();
+  ASSERT_EQ(pts.size(), world_xs.size());
+  ASSERT_EQ(pts.size(), world_ys.size());
+  for (std::size_t i = 0; i < pts.size(); ++i) {
+    auto expected = pts[i].move_origin(pose.x, pose.y, scan.trig_provider);
+    ASSERT_NEAR(expected.x, world_xs[i], 1e-12);
+    ASSERT_NEAR(expected.y, world_ys[i], 1e-12);
+  }
+}
+
+//------------------------------------------------------------------------------
+// ScanVoxelDownsampler
+
+class ScanVoxelDownsamplerTest : public ::testing::Test {
+protected: // methods
+  ScanVoxelDownsamplerTest() {
+    scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+  }
+
+  void add_point(double x, double y, bool is_occ = true) {
+    scan.points().push_back(
+      ScanPoint2D{ScanPoint2D::PointType::Cartesian, x, y, is_occ}
+        .to_polar());
+  }
+
+  double total_factor() const {
+    double factor = 0;
+    for (auto &sp : scan.points()) { factor += sp.factor(); }
+    return factor;
+  }
+protected: // fields
+  LaserScan2D scan;
+};
+
+TEST_F(ScanVoxelDownsamplerTest, pointsOfCellAreMerged) {
+  add_point(1.1, 1.1);
+  add_point(1.5, 1.5);
+  add_point(1.8, 1.8);
+  add_point(3.5, 1.5);
+  ScanVoxelDownsampler{1}.downsample(scan);
+
+  ASSERT_EQ(2u, scan.points().size());
+  // the closest to the centroid point represents the cell
+  ASSERT_NEAR(1.5, scan.points()[0].x(), 1e-9);
+  ASSERT_NEAR(1.5, scan.points()[0].y(), 1e-9);
+  ASSERT_EQ(3, scan.points()[0].factor());
+  ASSERT_NEAR(3.5, scan.points()[1].x(), 1e-9);
+  ASSERT_EQ(1, scan.points()[1].factor());
+}
+
+TEST_F(ScanVoxelDownsamplerTest, freePointsAreMergedSeparately) {
+  add_point(-1.5, 0.5);
+  add_point(-1.4, 0.5, false);
+  add_point(-1.45, 0.45);
+  add_point(-1.3, 0.4);
+  ScanVoxelDownsampler{1}.downsample(scan);
+
+  ASSERT_EQ(2u, scan.points().size());
+  ASSERT_FALSE(scan.points()[0].is_occupied());
+  ASSERT_EQ(1, scan.points()[0].factor());
+  ASSERT_TRUE(scan.points()[1].is_occupied());
+  ASSERT_EQ(3, scan.points()[1].factor());
+}
+
+TEST_F(ScanVoxelDownsamplerTest, factorsAreAccumulated) {
+  for (int i = 0; i < 360; ++i) {
+    scan.points().emplace_back(5, deg2rad(i), i % 10 != 0);
+  }
+
+  auto raw_points_nm = scan.points().size();
+  auto downsampler = ScanVoxelDownsampler{2};
+  downsampler.downsample(scan);
+  ASSERT_LT(scan.points().size(), raw_points_nm);
+  ASSERT_EQ(raw_points_nm, total_factor());
+
+  // a downsampled scan is not changed by the downsampler
+  auto points_nm = scan.points().size();
+  downsampler.downsample(scan);
+  ASSERT_EQ(points_nm, scan.points().size());
+  ASSERT_EQ(raw_points_nm, total_factor());
+}
+
 //------------------------------------------------------------------------------
 
 int main (int argc, char *argv[]) {
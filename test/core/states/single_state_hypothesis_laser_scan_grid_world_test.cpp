@@ -0,0 +1,311 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../mock_grid_cell.h"
+
+#include "../../../src/core/states/single_state_hypothesis_laser_scan_grid_world.h"
+#include "../../../src/core/maps/plain_grid_map.h"
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/core/maps/const_occupancy_estimator.h"
+#include "../../../src/core/scan_matchers/no_action_scan_matcher.h"
+#include "../../../src/core/trigonometry_utils.h"
+
+class SingleStateHypothesisLSGWTest : public ::testing::Test {
+protected: // types
+  using World = SingleStateHypothesisLaserScanGridWorld<UnboundedPlainGridMap>;
+
+  class CountingScanMatcher : public NoActionScanMatcher {
+  public:
+    CountingScanMatcher() : NoActionScanMatcher{nullptr} {}
+    double process_scan(const TransformedLaserScan &scan,
+                        const RobotPose &init_pose, const GridMap &map,
+                        RobotPoseDelta &pose_delta) override {
+      ++scans_nm;
+      return NoActionScanMatcher::process_scan(scan, init_pose, map,
+                                               pose_delta);
+    }
+    unsigned scans_nm = 0;
+  };
+
+  // Corrects every scan by the same delta
+  class ShiftingScanMatcher : public CountingScanMatcher {
+  public:
+    double process_scan(const TransformedLaserScan &scan,
+                        const RobotPose &init_pose, const GridMap &map,
+                        RobotPoseDelta &pose_delta) override {
+      CountingScanMatcher::process_scan(scan, init_pose, map, pose_delta);
+      pose_delta = shift;
+      return 1.0;
+    }
+    RobotPoseDelta shift;
+  };
+
+  class CountingScanAdder : public GridMapScanAdder {
+  public:
+    CountingScanAdder()
+      : GridMapScanAdder{std::make_shared<ConstOccupancyEstimator>(
+                           Occupancy{0.9, 1}, Occupancy{0.1, 1}),
+                         std::make_shared<IdleOMQE>()} {}
+    mutable unsigned points_nm = 0;
+  protected:
+    void handle_scan_point(GridMap &, bool, double,
+                           const Segment2D &) const override {
+      ++points_nm;
+    }
+  };
+  // Slowly marks the area {<scan number>, 0} as occupied
+  class MarkingScanAdder : public CountingScanAdder {
+  protected:
+    void handle_scan_point(GridMap &map, bool, double,
+                           const Segment2D &) const override {
+      std::this_thread::sleep_for(std::chrono::milliseconds{5});
+      map.update({int(points_nm++), 0}, {true, {0.9, 1}, {0, 0}, 0});
+    }
+  };
+
+  class PoseRecorder : public WorldPoseObserver {
+  public:
+    PoseRecorder(std::vector<RobotPose> &poses) : _poses(poses) {}
+    void on_pose_update(const RobotPose &pose) override {
+      _poses.push_back(pose);
+    }
+  private:
+    std::vector<RobotPose> &_poses;
+  };
+protected: // methods
+  SingleStateHypothesisLSGWTest()
+    : gsm{std::make_shared<CountingScanMatcher>()}
+    , gmsa{std::make_shared<CountingScanAdder>()} {
+    props.cell_prototype = std::make_shared<MockGridCell>();
+    props.gsm = gsm;
+    props.gmsa = gmsa;
+    props.map_props = {10, 10, 1};
+  }
+
+  static TransformedLaserScan make_scan(const RobotPoseDelta &odom_delta) {
+    auto tr_scan = TransformedLaserScan{};
+    tr_scan.pose_delta = odom_delta;
+    tr_scan.scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+    tr_scan.scan.points().emplace_back(1.0, 0.0, true);
+    return tr_scan;
+  }
+
+  void handle_scan(World &world, const RobotPoseDelta &odom_delta) {
+    auto tr_scan = make_scan(odom_delta);
+    world.handle_sensor_data(tr_scan);
+  }
+protected: // fields
+  SingleStateHypothesisLSGWProperties props;
+  std::shared_ptr<CountingScanMatcher> gsm;
+  std::shared_ptr<CountingScanAdder> gmsa;
+};
+
+TEST_F(SingleStateHypothesisLSGWTest, everyScanIsHandledByDefault) {
+  auto world = World{props};
+  for (int i = 0; i < 3; ++i) { handle_scan(world, {0, 0, 0}); }
+  ASSERT_EQ(3u, gsm->scans_nm);
+  ASSERT_EQ(3u, gmsa->points_nm);
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, keyframesAreGatedByMotion) {
+  props.keyframe_translation = 0.5;
+  props.keyframe_rotation = 0.1;
+  auto world = World{props};
+  // the first scan is always handled
+  handle_scan(world, {0, 0, 0});
+  handle_scan(world, {0.3, 0, 0});
+  handle_scan(world, {0, 0, 0.05});
+  ASSERT_EQ(1u, gsm->scans_nm);
+  ASSERT_EQ(2u, world.skipped_scans_nm());
+  // skipped scans are dead-reckoned
+  ASSERT_NEAR(0.3, world.pose().x, 1e-6);
+
+  handle_scan(world, {0.3, 0, 0});
+  ASSERT_EQ(2u, gsm->scans_nm);
+  ASSERT_EQ(2u, gmsa->points_nm);
+  handle_scan(world, {0, 0, 0.2});
+  ASSERT_EQ(3u, gsm->scans_nm);
+  ASSERT_EQ(0u, world.skipped_scans_nm());
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, skippedScansAreLimited) {
+  props.keyframe_translation = 1;
+  props.keyframe_max_skipped = 2;
+  auto world = World{props};
+  for (int i = 0; i < 7; ++i) { handle_scan(world, {0, 0, 0}); }
+  // handled: 1st, 4th, 7th
+  ASSERT_EQ(3u, gsm->scans_nm);
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, localizationOnlyDoesNotMap) {
+  props.localization_only = true;
+  auto world = World{props};
+  handle_scan(world, {0, 0, 0});
+  handle_scan(world, {1, 0, 0});
+  ASSERT_EQ(2u, gsm->scans_nm);
+  ASSERT_EQ(0u, gmsa->points_nm);
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, backlogIsHandledScanByScanByDefault) {
+  auto world = World{props};
+  auto backlog = std::vector<TransformedLaserScan>(5, make_scan({0, 0, 0}));
+  world.handle_sensor_data_batch(backlog);
+  ASSERT_EQ(5u, gsm->scans_nm);
+  ASSERT_EQ(5u, gmsa->points_nm);
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, catchUpMatchesNewestScanOfGroup) {
+  auto sm = std::make_shared<ShiftingScanMatcher>();
+  sm->shift = {0.3, 0, 0.03};
+  props.gsm = sm;
+  props.catch_up_group_size = 3;
+  auto world = World{props};
+  auto poses = std::vector<RobotPose>{};
+  auto recorder = std::make_shared<PoseRecorder>(poses);
+  world.subscribe_pose(recorder);
+
+  auto backlog = std::vector<TransformedLaserScan>{
+    make_scan({1, 0, 0}), make_scan({2, 0, 0}), make_scan({0, 0, 0}),
+    make_scan({1, 0, 0})};
+  world.handle_sensor_data_batch(backlog);
+  // groups: 3 scans, 1 scan
+  ASSERT_EQ(2u, sm->scans_nm);
+  ASSERT_EQ(4u, gmsa->points_nm);
+  ASSERT_EQ(4u, poses.size());
+
+  // the correction is spread by the distance traveled
+  ASSERT_NEAR(1.1, poses[0].x, 1e-6);
+  ASSERT_NEAR(0.01, poses[0].theta, 1e-6);
+  ASSERT_NEAR(3.3, poses[1].x, 1e-6);
+  ASSERT_NEAR(3.3, poses[2].x, 1e-6);
+  ASSERT_NEAR(0.03, poses[2].theta, 1e-6);
+  ASSERT_NEAR(4.6, poses[3].x, 1e-6);
+  ASSERT_NEAR(4.6, world.pose().x, 1e-6);
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, pipelinedScansAreInMapAfterWait) {
+  using PipelinedWorld =
+    SingleStateHypothesisLaserScanGridWorld<UnboundedLazyTiledGridMap>;
+  props.gmsa = std::make_shared<MarkingScanAdder>();
+  props.pipelined_mapping = true;
+  props.mapping_queue_size = 4;
+  auto world = PipelinedWorld{props};
+  ASSERT_TRUE(world.is_mapping_pipelined());
+  for (int i = 0; i < 4; ++i) {
+    auto tr_scan = make_scan({0, 0, 0});
+    world.handle_sensor_data(tr_scan);
+  }
+
+  LaserScanGridWorld<UnboundedLazyTiledGridMap> &base_world = world;
+  base_world.wait_for_mapping();
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(0.9, (world.map()[{i, 0}]));
+  }
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, mutableMapIsTheInsertedOne) {
+  using PipelinedWorld =
+    SingleStateHypothesisLaserScanGridWorld<UnboundedLazyTiledGridMap>;
+  props.gmsa = std::make_shared<MarkingScanAdder>();
+  props.pipelined_mapping = true;
+  props.mapping_queue_size = 4;
+  auto world = PipelinedWorld{props};
+  for (int i = 0; i < 4; ++i) {
+    auto tr_scan = make_scan({0, 0, 0});
+    world.handle_sensor_data(tr_scan);
+  }
+
+  // NB: the const map may lack the scans being inserted
+  auto &map = world.map();
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(0.9, (map[{i, 0}]));
+  }
+  // the shared copy is not exposed for modifications
+  const auto &const_world = world;
+  ASSERT_NE(&map, &const_world.map());
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, pipelinedWorldIsCopiedWithScans) {
+  using PipelinedWorld =
+    SingleStateHypothesisLaserScanGridWorld<UnboundedLazyTiledGridMap>;
+  props.gmsa = std::make_shared<MarkingScanAdder>();
+  props.pipelined_mapping = true;
+  props.mapping_queue_size = 4;
+  auto world = PipelinedWorld{props};
+  for (int i = 0; i < 4; ++i) {
+    auto tr_scan = make_scan({0, 0, 0});
+    world.handle_sensor_data(tr_scan);
+  }
+
+  auto world_copy = world;
+  auto moved_world = std::move(world_copy);
+  // NB: the session is the map scans are inserted into
+  auto restored = PipelinedWorld{props};
+  ASSERT_TRUE(restored.load_session(moved_world.save_session()));
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(0.9, (restored.map()[{i, 0}]));
+  }
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, sessionIsResumed) {
+  props.keyframe_translation = 0.5;
+  auto world = World{props};
+  handle_scan(world, {1, 2, 0.5});
+  handle_scan(world, {0.1, 0, 0});
+  world.map().update({3, 4}, {true, {0.7, 1}, {0, 0}, 0});
+
+  auto resumed = World{props};
+  ASSERT_TRUE(resumed.load_session(world.save_session()));
+  ASSERT_NEAR(world.pose().x, resumed.pose().x, 1e-6);
+  ASSERT_NEAR(world.pose().y, resumed.pose().y, 1e-6);
+  ASSERT_NEAR(world.pose().theta, resumed.pose().theta, 1e-6);
+  ASSERT_EQ(1u, resumed.skipped_scans_nm());
+  ASSERT_NEAR(0.7, (resumed.map()[{3, 4}]), 1e-6);
+  // the keyframe is resumed as well, i.e. the scan is not a new one
+  handle_scan(resumed, {0.1, 0, 0});
+  ASSERT_EQ(1u, gsm->scans_nm);
+  ASSERT_EQ(2u, resumed.skipped_scans_nm());
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, truncatedSessionIsRejected) {
+  auto world = World{props};
+  handle_scan(world, {1, 2, 0.5});
+  world.map().update({3, 4}, {true, {0.7, 1}, {0, 0}, 0});
+  auto session = world.save_session();
+
+  auto resumed = World{props};
+  resumed.map().update({1, 1}, {true, {0.2, 1}, {0, 0}, 0});
+  auto header_size = 3 * sizeof(uint32_t);
+  auto map_pos = header_size + resumed.robot_state_size();
+  for (auto size : {header_size - 1, header_size, map_pos - 1,
+                    map_pos + 1, session.size() - 1}) {
+    ASSERT_FALSE(resumed.load_session(
+      std::vector<char>(session.begin(), session.begin() + size)));
+  }
+  // a session of a build with another floating point type (see Real)
+  auto other_real_session = session;
+  other_real_session[2 * sizeof(uint32_t)] ^= sizeof(float) ^ sizeof(double);
+  ASSERT_FALSE(resumed.load_session(other_real_session));
+
+  // the world is kept
+  ASSERT_EQ(0, resumed.pose().x);
+  ASSERT_EQ(0, resumed.pose().y);
+  ASSERT_NEAR(0.2, (resumed.map()[{1, 1}]), 1e-6);
+  ASSERT_TRUE(resumed.load_session(session));
+  ASSERT_NEAR(0.7, (resumed.map()[{3, 4}]), 1e-6);
+}
+
+TEST_F(SingleStateHypothesisLSGWTest, otherDataIsNotSession) {
+  auto world = World{props};
+  ASSERT_FALSE(world.load_session({}));
+  ASSERT_FALSE(world.load_session(std::vector<char>(16, 'x')));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
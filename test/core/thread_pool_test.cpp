@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../../src/core/thread_pool.h"
+
+class ThreadPoolTest : public ::testing::Test {
+protected: // methods
+  static void sleep_ms(unsigned ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+};
+
+TEST_F(ThreadPoolTest, eachIndexIsHandledOnce) {
+  ThreadPool pool{4};
+  auto hits = std::vector<std::atomic<int>>(1000);
+  pool.parallel_for(hits.size(), [&hits](std::size_t i) { ++hits[i]; });
+  for (auto &hit : hits) { ASSERT_EQ(1, hit); }
+}
+
+TEST_F(ThreadPoolTest, singleThreadRunsOnCaller) {
+  ThreadPool pool{1};
+  ASSERT_EQ(1u, pool.threads_nm());
+  auto caller_id = std::this_thread::get_id();
+  auto on_caller_nm = 0;
+  pool.parallel_for(10, [&](std::size_t) {
+    if (std::this_thread::get_id() == caller_id) { ++on_caller_nm; }
+  });
+  ASSERT_EQ(10, on_caller_nm);
+}
+
+TEST_F(ThreadPoolTest, threadsNumberIsLimited) {
+  ThreadPool pool{8};
+  std::atomic<int> running_nm{0}, max_running_nm{0};
+  pool.parallel_for(40, [&](std::size_t) {
+    auto now_running_nm = ++running_nm;
+    auto max_nm = max_running_nm.load();
+    while (max_nm < now_running_nm &&
+           !max_running_nm.compare_exchange_weak(max_nm, now_running_nm)) {}
+    sleep_ms(1);
+    --running_nm;
+  }, 2);
+  ASSERT_LE(max_running_nm, 2);
+}
+
+TEST_F(ThreadPoolTest, nestedLoopsDontDeadlock) {
+  ThreadPool pool{3};
+  std::atomic<int> sum{0};
+  pool.parallel_for(8, [&](std::size_t) {
+    pool.parallel_for(8, [&](std::size_t j) { sum += j; });
+  });
+  ASSERT_EQ(8 * 28, sum);
+}
+
+TEST_F(ThreadPoolTest, taskGroupWaitsForAllTasks) {
+  auto pool = std::make_shared<ThreadPool>(4);
+  std::atomic<int> done_nm{0};
+  {
+    TaskGroup group{pool};
+    for (int i = 0; i < 20; ++i) {
+      group.run([&done_nm]() {
+        sleep_ms(1);
+        ++done_nm;
+      });
+    }
+    group.wait();
+    ASSERT_EQ(20, done_nm);
+  }
+}
+
+TEST_F(ThreadPoolTest, sharedPoolIsReconfigured) {
+  ThreadPool::configure_shared(3, false);
+  auto pool = ThreadPool::shared();
+  ASSERT_EQ(3u, pool->threads_nm());
+  // the same configuration keeps the pool
+  ThreadPool::configure_shared(3, false);
+  ASSERT_EQ(pool, ThreadPool::shared());
+
+  ThreadPool::configure_shared(2, false);
+  ASSERT_EQ(2u, ThreadPool::shared()->threads_nm());
+  // the previous pool is still usable by its holders
+  std::atomic<int> sum{0};
+  pool->parallel_for(10, [&sum](std::size_t i) { sum += i; });
+  ASSERT_EQ(45, sum);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../../src/core/stage_profiler.h"
+#include "../../src/core/trace_recorder.h"
+
+class TraceRecorderTest : public ::testing::Test {
+protected: // methods
+  ~TraceRecorderTest() { std::remove(fname.c_str()); }
+
+  std::string trace() const {
+    auto is = std::ifstream{fname};
+    return std::string{std::istreambuf_iterator<char>{is},
+                       std::istreambuf_iterator<char>{}};
+  }
+
+  static std::size_t occurrences_nm(const std::string &text,
+                                    const std::string &pattern) {
+    auto nm = std::size_t{0};
+    for (auto pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos + 1)) {
+      ++nm;
+    }
+    return nm;
+  }
+protected: // fields
+  std::string fname = "trace_recorder_test.json";
+};
+
+TEST_F(TraceRecorderTest, emptyTrace) {
+  TraceRecorder{fname};
+  auto json = trace();
+  ASSERT_EQ(0u, json.find("{\"displayTimeUnit\""));
+  ASSERT_NE(std::string::npos, json.find("\"traceEvents\":[\n]}"));
+}
+
+TEST_F(TraceRecorderTest, completeEventsAreWritten) {
+  TraceRecorder recorder{fname};
+  auto scan_id = recorder.start_scan();
+  auto start = recorder.now();
+  recorder.add("matching", "stage", start, start, scan_id);
+  recorder.add("ensure_inside", "map", start, start, scan_id);
+  ASSERT_EQ(2u, recorder.events_nm());
+  ASSERT_TRUE(recorder.write());
+
+  auto json = trace();
+  ASSERT_EQ(2u, occurrences_nm(json, "\"ph\":\"X\""));
+  ASSERT_NE(std::string::npos, json.find("\"name\":\"matching\","
+                                         "\"cat\":\"stage\""));
+  ASSERT_NE(std::string::npos, json.find("\"name\":\"ensure_inside\","
+                                         "\"cat\":\"map\""));
+  ASSERT_EQ(2u, occurrences_nm(json, "\"args\":{\"scan\":1}"));
+}
+
+TEST_F(TraceRecorderTest, eventsOverLimitAreDropped) {
+  TraceRecorder recorder{fname, 2};
+  auto now = recorder.now();
+  for (int i = 0; i < 5; ++i) {
+    recorder.add("e", "test", now, now, 0);
+  }
+  ASSERT_EQ(2u, recorder.events_nm());
+  recorder.write();
+  ASSERT_NE(std::string::npos, trace().find("\"dropped_events\":3"));
+}
+
+TEST_F(TraceRecorderTest, threadsHaveDifferentIds) {
+  TraceRecorder recorder{fname};
+  auto now = recorder.now();
+  recorder.add("main", "test", now, now, 0);
+  std::thread{[&]() { recorder.add("worker", "test", now, now, 0); }}.join();
+  recorder.write();
+  auto json = trace();
+  auto main_tid = json.find("\"tid\":", json.find("\"main\""));
+  auto worker_tid = json.find("\"tid\":", json.find("\"worker\""));
+  ASSERT_NE(json.substr(main_tid, 8), json.substr(worker_tid, 8));
+}
+
+// NB: the active recorder is installed once per process,
+//     so the disabled tracing is checked first
+TEST_F(TraceRecorderTest, scopesAreTracedByActiveRecorder) {
+  {
+    ASSERT_EQ(nullptr, TraceRecorder::active());
+    TraceScan scan;
+    TraceScope scope{"idle", "test"};
+  }
+
+  auto recorder = std::make_unique<TraceRecorder>(fname);
+  auto recorder_ptr = recorder.get();
+  ASSERT_TRUE(TraceRecorder::install(std::move(recorder)));
+  ASSERT_FALSE(TraceRecorder::install(
+    std::make_unique<TraceRecorder>(fname)));
+  ASSERT_EQ(recorder_ptr, TraceRecorder::active());
+  {
+    TraceScan scan;
+    TraceScope scope{"ensure_inside", "map"};
+    StageTimer timer{nullptr, SlamStage::ScanMatching};
+  }
+  ASSERT_EQ(3u, recorder_ptr->events_nm());
+  recorder_ptr->write();
+  auto json = trace();
+  ASSERT_NE(std::string::npos, json.find("\"name\":\"scan\""));
+  ASSERT_NE(std::string::npos, json.find("\"name\":\"matching\","
+                                         "\"cat\":\"stage\""));
+  ASSERT_EQ(3u, occurrences_nm(json, "\"args\":{\"scan\":1}"));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -38,6 +38,58 @@ TEST_F(CachedTrigonometryProviderTest, sector120Step7Rotation3) {
   verify_cache(ctp, D_Theta, Min, Max, Step);
 }
 
+TEST_F(CachedTrigonometryProviderTest, indexedSinCos) {
+  const double Min = deg2rad(-120), Max = deg2rad(120), Step = deg2rad(7),
+               D_Theta = deg2rad(-11);
+
+  auto ctp = CachedTrigonometryProvider{};
+  ctp.update(Min, Max, Step);
+  ctp.set_base_angle(D_Theta);
+  int angle_idx = 0;
+  for (double a = Min; a < Max; a += Step, ++angle_idx) {
+    auto sin_cos = ctp.sin_cos(a, angle_idx);
+    ASSERT_EQ(ctp.sin(a), sin_cos.sin);
+    ASSERT_EQ(ctp.cos(a), sin_cos.cos);
+    sin_cos = ctp.sin_cos(a);
+    ASSERT_EQ(ctp.sin(a), sin_cos.sin);
+    ASSERT_EQ(ctp.cos(a), sin_cos.cos);
+  }
+}
+
+TEST_F(CachedTrigonometryProviderTest, clonesKeepOwnBaseAngles) {
+  const double Min = deg2rad(-120), Max = deg2rad(120), Step = deg2rad(7);
+
+  auto ctp = CachedTrigonometryProvider{};
+  ctp.update(Min, Max, Step);
+  ctp.set_base_angle(deg2rad(10));
+  auto clone = ctp.clone();
+  ASSERT_EQ(ctp.cos(Min), clone->cos(Min));
+  clone->set_base_angle(deg2rad(20));
+  ASSERT_NEAR(std::cos(deg2rad(-110)), ctp.cos(Min), 1e-12);
+  ASSERT_NEAR(std::cos(deg2rad(-100)), clone->cos(Min), 1e-12);
+}
+
+//----------------------------------------------------------------------------//
+// Trigonometry Table Registry Test
+
+TEST(TrigonometryTableRegistryTest, tablesAreSharedByAngleGrid) {
+  const double Min = deg2rad(-135), Max = deg2rad(135), Step = deg2rad(30);
+
+  auto registry = TrigonometryTableRegistry{};
+  auto table = registry.table(Min, Max, Step);
+  ASSERT_EQ(table, registry.table(Min, Max, Step));
+  ASSERT_NE(table, registry.table(Min, Max, Step / 2));
+  ASSERT_EQ(table, registry.table(Min, Max, Step));
+
+  // providers with a shared table keep their own base angles
+  auto ctp1 = CachedTrigonometryProvider{table};
+  auto ctp2 = CachedTrigonometryProvider{table};
+  ctp1.set_base_angle(deg2rad(10));
+  ctp2.set_base_angle(deg2rad(20));
+  ASSERT_NEAR(std::cos(deg2rad(-125)), ctp1.cos(Min), 1e-12);
+  ASSERT_NEAR(std::cos(deg2rad(-115)), ctp2.cos(Min), 1e-12);
+}
+
 //----------------------------------------------------------------------------//
 
 int main (int argc, char *argv[]) {
@@ -0,0 +1,267 @@
+/* Guards throughput of hot paths against regressions:
+ *   - SPE evaluation: a batch estimation of a grid of poses;
+ *   - scan insertion: scans appended to a lazy tiled map by
+ *     the wall distance blurring adder;
+ *   - M3RSM search: the brute force multi-resolution matcher with
+ *     a score pyramid.
+ * Each path runs on fixed synthetic data (a corridor world and a scan
+ * generated from a known pose); its throughput is the best of several
+ * trials, so a run is robust to a background load spike.
+ * Throughputs are compared with a per-machine baseline (a properties file,
+ * "perf/<hot path>=<operations per second>"); the test fails if a path is
+ * slower than its baseline by more than the budget.
+ * If allocations are tracked (the SLAM_CTOR_TRACK_ALLOCATIONS build), heap
+ * allocations of the last (steady state) trial are recorded as well ("perf/<hot path>_allocs"); the test fails if a path allocates
+ * more than its baseline, so a path that is made allocation-free stays so.
+ * Usage: hot_paths_perf_test <baseline file> [budget_percent [--update]]
+ * A missing baseline is recorded, --update rewrites it.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include "../../src/core/maps/plain_grid_map.h"
+#include "../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../src/core/maps/rescalable_caching_grid_map.h"
+#include "../../src/core/maps/grid_map_scan_adders.h"
+#include "../../src/core/maps/const_occupancy_estimator.h"
+#include "../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../src/core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "../../src/core/scan_matchers/bf_multi_res_scan_matcher.h"
+#include "../../src/slams/tiny/tiny_grid_cell.h"
+#include "../../src/utils/data_generation/map_primitives.h"
+#include "../../src/utils/data_generation/grid_map_patcher.h"
+#include "../../src/utils/data_generation/laser_scan_generator.h"
+#include "../../src/utils/properties_providers.h"
+#include "../../src/utils/allocation_tracking.h"
+
+// FIXME: code duplication with tests's MockGridCell
+class LastWriteWinsGridCell : public GridCell {
+public:
+  LastWriteWinsGridCell(double prob = 0.5) : GridCell{Occupancy{prob, 0}} {}
+  std::unique_ptr<GridCell> clone() const override {
+    return std::make_unique<LastWriteWinsGridCell>(*this);
+  }
+  void operator+= (const AreaOccupancyObservation &aoo) override {
+    _occupancy = aoo.occupancy;
+  }
+};
+
+constexpr double Meters_Per_Cell = 0.1;
+constexpr unsigned Trials_Nm = 5;
+
+using WorldMap = RescalableCachingGridMap<UnboundedPlainGridMap>;
+
+struct SyntheticWorld {
+  std::shared_ptr<WorldMap> map;
+  RobotPose pose;
+  TransformedLaserScan scan;
+};
+
+struct HotPath {
+  std::string name;
+  // runs a fixed amount of work, returns the number of operations
+  // NB: a path's state (e.g. a matcher) is created once, so steady state
+  //     allocations of the work are measured
+  std::function<double()> run;
+};
+
+struct Measurement {
+  double throughput = 0; // ops per second of the best trial
+  uint64_t allocs = 0;   // heap allocations of the last trial
+};
+
+SyntheticWorld make_world() {
+  using CecumMp = CecumTextRasterMapPrimitive;
+  auto world = SyntheticWorld{};
+  world.map = std::make_shared<WorldMap>(
+    std::make_shared<LastWriteWinsGridCell>(),
+    GridMapParams{100, 100, Meters_Per_Cell});
+  GridMapPatcher{}.apply_text_raster(
+    *world.map, CecumMp{40, 9, CecumMp::BoundPosition::Right}.to_stream(),
+    {}, 1, 1);
+  world.pose = RobotPose{20.5 * Meters_Per_Cell, -4.5 * Meters_Per_Cell,
+                         deg2rad(10)};
+  world.scan.pose_delta = RobotPoseDelta{};
+  world.scan.scan = LaserScanGenerator{to_lsp(15, 270, 720)}
+    .laser_scan_2D(*world.map, world.pose, 1);
+  world.scan.quality = 1.0;
+  return world;
+}
+
+std::shared_ptr<ScanProbabilityEstimator> make_spe() {
+  return std::make_shared<WeightedMeanPointProbabilitySPE>(
+    std::make_shared<MaxOccupancyObservationPE>(),
+    std::make_shared<EvenSPW>());
+}
+
+std::vector<HotPath> make_hot_paths(const SyntheticWorld &world) {
+  auto spe = make_spe();
+  auto poses = std::make_shared<std::vector<RobotPose>>();
+  for (int t = -2; t <= 2; ++t) {
+    for (int y = -20; y <= 20; ++y) {
+      for (int x = -20; x <= 20; ++x) {
+        poses->emplace_back(world.pose.x + x * 0.01, world.pose.y + y * 0.01,
+                            world.pose.theta + deg2rad(t));
+      }
+    }
+  }
+  auto probabilities = std::make_shared<std::vector<double>>(poses->size());
+  auto spe_evaluation = [&world, spe, poses, probabilities]() {
+    auto scan = spe->filter_scan(world.scan.scan, world.pose, *world.map);
+    spe->estimate_scan_probabilities(scan, poses->data(), poses->size(),
+                                     *world.map, {}, probabilities->data());
+    return double(poses->size());
+  };
+
+  auto adder = WallDistanceBlurringScanAdder::builder()
+    .set_occupancy_estimator(std::make_shared<ConstOccupancyEstimator>(
+      Occupancy{0.95, 1.0}, Occupancy{0.01, 1.0}))
+    .set_observation_quality_estimator(std::make_shared<IdleOMQE>())
+    .set_blur_distance(0.2)
+    .build();
+  auto map = std::make_shared<UnboundedLazyTiledGridMap>(
+    std::make_shared<BaseTinyCell>(),
+    GridMapParams{100, 100, Meters_Per_Cell});
+  auto scan_insertion = [&world, adder, map]() {
+    constexpr int Scans_Nm = 40;
+    for (int i = 0; i < Scans_Nm; ++i) {
+      auto pose = world.pose;
+      pose.x += 0.01 * i;
+      adder->append_scan(*map, pose, world.scan.scan, 1.0);
+    }
+    return double(Scans_Nm);
+  };
+
+  auto sm = std::make_shared<BruteForceMultiResolutionScanMatcher>(
+    make_spe(), deg2rad(0.5), Meters_Per_Cell / 2);
+  sm->set_lookup_ranges(0.3, 0.3, deg2rad(5));
+  sm->set_uses_score_pyramid(true);
+  auto m3rsm_search = [&world, sm]() {
+    constexpr int Errors_Nm = 8;
+    for (int i = 0; i < Errors_Nm; ++i) {
+      auto error = RobotPoseDelta{0.02 * (i % 3 - 1), 0.02 * (i % 2),
+                                  deg2rad(i % 4 - 2)};
+      auto correction = RobotPoseDelta{};
+      sm->process_scan(world.scan, world.pose + error, *world.map,
+                       correction);
+    }
+    return double(Errors_Nm);
+  };
+
+  return {{"spe_evaluation", spe_evaluation},
+          {"scan_insertion", scan_insertion},
+          {"m3rsm_search", m3rsm_search}};
+}
+
+Measurement measure(const HotPath &path) {
+  auto measurement = Measurement{};
+  for (unsigned i = 0; i < Trials_Nm; ++i) {
+    auto allocs_start = thread_allocation_count();
+    auto start = std::chrono::steady_clock::now();
+    auto ops_nm = path.run();
+    auto secs = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    auto allocs = thread_allocation_count() - allocs_start;
+    measurement.throughput = std::max(measurement.throughput, ops_nm / secs);
+    measurement.allocs = allocs.allocs_nm;
+  }
+  return measurement;
+}
+
+std::string baseline_id(const HotPath &path) { return "perf/" + path.name; }
+
+std::string allocs_baseline_id(const HotPath &path) {
+  return baseline_id(path) + "_allocs";
+}
+
+bool write_baseline(const std::string &fname,
+                    const std::vector<HotPath> &paths,
+                    const std::vector<Measurement> &measurements) {
+  auto file = std::ofstream{fname};
+  file << "# ops per second of hot paths (see hot_paths_perf_test)\n";
+  file << std::fixed << std::setprecision(1);
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    file << baseline_id(paths[i]) << "=" << measurements[i].throughput
+         << "\n";
+    if (Allocations_Are_Tracked) {
+      file << allocs_baseline_id(paths[i]) << "=" << measurements[i].allocs
+           << "\n";
+    }
+  }
+  return bool(file);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: hot_paths_perf_test <baseline file> "
+              << "[budget_percent [--update]]" << std::endl;
+    return 1;
+  }
+  auto baseline_fname = std::string{argv[1]};
+  auto budget = 2 < argc ? std::stod(argv[2]) : 10.0;
+  auto is_update = 3 < argc && std::string{argv[3]} == "--update";
+
+  auto world = make_world();
+  auto paths = make_hot_paths(world);
+  auto measurements = std::vector<Measurement>{};
+  for (auto &path : paths) {
+    measurements.push_back(measure(path));
+  }
+
+  if (is_update || !std::ifstream{baseline_fname}) {
+    if (!write_baseline(baseline_fname, paths, measurements)) {
+      std::cerr << "[Error] Unable to write " << baseline_fname << std::endl;
+      return 1;
+    }
+    std::cout << "The baseline is recorded to " << baseline_fname
+              << std::endl;
+    return 0;
+  }
+
+  auto baseline = FilePropertiesProvider{};
+  baseline.append_file_content(baseline_fname);
+  auto is_failed = false;
+  std::cout << std::setw(16) << std::left << "hot path"
+            << std::setw(14) << "ops/s" << std::setw(14) << "baseline"
+            << std::setw(9) << "change,%";
+  if (Allocations_Are_Tracked) {
+    std::cout << std::setw(11) << "allocs" << std::setw(11) << "baseline";
+  }
+  std::cout << std::endl;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    auto &measurement = measurements[i];
+    auto expected = baseline.get_dbl(baseline_id(paths[i]), 0);
+    auto change = expected == 0 ? 0 :
+      100 * (measurement.throughput - expected) / expected;
+    auto is_regressed = change < -budget;
+    std::cout << std::setw(16) << std::left << paths[i].name
+              << std::fixed << std::setprecision(1)
+              << std::setw(14) << measurement.throughput
+              << std::setw(14) << expected
+              << std::setw(9) << change;
+    if (Allocations_Are_Tracked) {
+      // NB: a baseline recorded without tracking has no allocations
+      auto expected_allocs = baseline.get_uint(allocs_baseline_id(paths[i]),
+                                               measurement.allocs);
+      is_regressed |= expected_allocs < measurement.allocs;
+      std::cout << std::setw(11) << measurement.allocs
+                << std::setw(11) << expected_allocs;
+    }
+    is_failed |= is_regressed;
+    std::cout << (is_regressed ? "REGRESSED" : "ok") << std::endl;
+  }
+  if (is_failed) {
+    std::cout << "[FAILED] A hot path is slower than its baseline by more "
+              << "than " << budget << "% or allocates more" << std::endl;
+  }
+  return is_failed ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <algorithm>
+
+#include "../../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../../src/slams/gmapping/gmapping_grid_cell.h"
+#include "../../../src/slams/gmapping/gmapping_occupancy_observation_pe.h"
+
+class GmappingOccupancyObservationPETest : public ::testing::Test {
+protected: // types
+  using MapT = UnboundedValueLazyTiledGridMap<GmappingBaseCell>;
+  using Coord = DiscretePoint2D;
+protected: // methods
+  GmappingOccupancyObservationPETest()
+    : map{std::make_shared<GmappingBaseCell>(), {1, 1, 0.1}}
+    , rnd_engine{42} {}
+
+  static AreaOccupancyObservation obstacle_obs(const Point2D &obstacle) {
+    return {true, {1.0, 1.0}, obstacle, 1.0};
+  }
+
+  void add_random_obstacles(unsigned obstacles_nm) {
+    auto coord_rv = std::uniform_real_distribution<double>{-5, 5};
+    for (unsigned i = 0; i < obstacles_nm; ++i) {
+      auto obstacle = Point2D{coord_rv(rnd_engine), coord_rv(rnd_engine)};
+      map.update(map.world_to_cell(obstacle), obstacle_obs(obstacle));
+    }
+  }
+
+  // the probability by definition
+  double expected_probability(const AreaOccupancyObservation &aoo,
+                              double fullness_th, int window) {
+    auto sp_coord = map.world_to_cell(aoo.obstacle);
+    double best_prob = 0;
+    for (int d_x = -window; d_x <= window; ++d_x) {
+      for (int d_y = -window; d_y <= window; ++d_y) {
+        const auto &cell = map[sp_coord + Coord{d_x, d_y}];
+        if (cell < fullness_th) { continue; }
+        best_prob = std::max(best_prob, 1.0 - cell.discrepancy(aoo));
+      }
+    }
+    return best_prob;
+  }
+
+  void test_window(unsigned window) {
+    auto oope = GmappingOccupancyObservationPE{0.1, window};
+    add_random_obstacles(2000);
+    auto coord_rv = std::uniform_real_distribution<double>{-6, 6};
+    for (unsigned i = 0; i < 500; ++i) {
+      auto aoo = obstacle_obs({coord_rv(rnd_engine), coord_rv(rnd_engine)});
+      ASSERT_NEAR(expected_probability(aoo, 0.1, window),
+                  oope.probability(aoo, {}, map), 1e-9);
+    }
+  }
+protected: // fields
+  MapT map;
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(GmappingOccupancyObservationPETest, unknownArea) {
+  auto oope = GmappingOccupancyObservationPE{0.1, 1};
+  ASSERT_EQ(0.0, oope.probability(obstacle_obs({100, -100}), {}, map));
+}
+
+TEST_F(GmappingOccupancyObservationPETest, window1) { test_window(1); }
+TEST_F(GmappingOccupancyObservationPETest, window3) { test_window(3); }
+// a row is read by several chunks
+TEST_F(GmappingOccupancyObservationPETest, window20) { test_window(20); }
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <unordered_set>
+
+#include "../../../src/slams/graph/pose_graph_map.h"
+
+class PoseGraphMapTest : public ::testing::Test {
+protected: // methods
+  PoseGraphMapTest() : rnd_engine{42} {}
+
+  RobotPose random_pose(double half_side) {
+    auto coord_rv = std::uniform_real_distribution<double>{-half_side,
+                                                           half_side};
+    return {coord_rv(rnd_engine), coord_rv(rnd_engine), 0};
+  }
+
+  // NB: the current node is a candidate regardless of its pose
+  std::unordered_set<NodePtr> brute_force_nearest_nodes(
+      const RobotPose &pose, double max_sq_dist) const {
+    auto near_nodes = std::unordered_set<NodePtr>{};
+    for (auto &node : graph.nodes()) {
+      if ((node->pose - pose).sq_dist() < max_sq_dist) {
+        near_nodes.insert(node);
+      }
+    }
+    near_nodes.insert(graph.nodes().back());
+    return near_nodes;
+  }
+
+protected: // fields
+  std::mt19937 rnd_engine;
+  PoseGraphMap graph;
+};
+
+TEST_F(PoseGraphMapTest, nearestNodesMatchBruteForceOnes) {
+  for (unsigned i = 0; i < 500; ++i) {
+    graph.add_node(TransformedLaserScan{}, random_pose(20), 0);
+  }
+
+  for (auto sq_dist : {0.01, 0.7, 4.0, 30.0}) {
+    for (unsigned i = 0; i < 50; ++i) {
+      auto pose = random_pose(25);
+      ASSERT_EQ(brute_force_nearest_nodes(pose, sq_dist),
+                graph.nearest_nodes(pose, sq_dist));
+    }
+  }
+}
+
+TEST_F(PoseGraphMapTest, nearestNodesFollowMovedNodes) {
+  for (unsigned i = 0; i < 100; ++i) {
+    graph.add_node(TransformedLaserScan{}, random_pose(10), 0);
+  }
+  auto node = graph.nodes()[3];
+  auto far_pose = RobotPose{100, -100, 0};
+  graph.set_node_pose(node, far_pose);
+
+  ASSERT_EQ(1u, graph.nearest_nodes(far_pose, 0.1).count(node));
+  for (unsigned i = 0; i < 50; ++i) {
+    auto pose = random_pose(12);
+    ASSERT_EQ(brute_force_nearest_nodes(pose, 4.0),
+              graph.nearest_nodes(pose, 4.0));
+  }
+}
+
+TEST_F(PoseGraphMapTest, versionTracksModifiedNodes) {
+  for (unsigned i = 0; i < 10; ++i) {
+    graph.add_node(TransformedLaserScan{}, random_pose(10), 0);
+  }
+  auto &nodes = graph.nodes();
+  auto &edges = graph.edges();
+  ASSERT_EQ(edges.size() - 1, edges.back()->id);
+  auto version = graph.version();
+  for (auto &node : nodes) { ASSERT_LE(node->version, version); }
+
+  // the same pose is not a modification
+  graph.set_node_pose(nodes[2], nodes[2]->pose);
+  ASSERT_EQ(version, graph.version());
+
+  graph.set_node_pose(nodes[5], RobotPose{100, 100, 0});
+  graph.add_node(TransformedLaserScan{}, random_pose(10), 0);
+  ASSERT_LT(version, graph.version());
+  auto modified_ids = std::unordered_set<std::size_t>{};
+  for (auto &node : nodes) {
+    if (version < node->version) { modified_ids.insert(node->id); }
+  }
+  ASSERT_EQ((std::unordered_set<std::size_t>{5, 10}), modified_ids);
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
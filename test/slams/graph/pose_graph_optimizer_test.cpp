@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "../../../src/slams/graph/pose_graph_optimizer.h"
+
+class PoseGraphOptimizerTest : public ::testing::Test {
+protected: // consts
+  static constexpr unsigned Lead_In_Nodes_Nm = 5, Side_Nodes_Nm = 10;
+  // odometry turns a bit more than the robot does
+  static constexpr double Odometry_Bias = 0.01;
+protected: // methods
+
+  // A straight lead-in followed by a square loop that returns to its end
+  static std::vector<RobotPoseDelta> true_steps() {
+    auto steps = std::vector<RobotPoseDelta>(Lead_In_Nodes_Nm,
+                                             RobotPoseDelta{1, 0, 0});
+    for (unsigned side = 0; side < 4; ++side) {
+      for (unsigned i = 0; i + 1 < Side_Nodes_Nm; ++i) {
+        steps.emplace_back(1, 0, 0);
+      }
+      steps.emplace_back(1, 0, M_PI / 2);
+    }
+    return steps;
+  }
+
+  // Adds a node per step; poses are integrated odometry
+  static void add_node(PoseGraphMap &graph, RobotPose &odom_pose,
+                       const RobotPoseDelta &step) {
+    auto c = std::cos(odom_pose.theta), s = std::sin(odom_pose.theta);
+    odom_pose = RobotPose{odom_pose.x + c * step.x - s * step.y,
+                          odom_pose.y + s * step.x + c * step.y,
+                          odom_pose.theta + step.theta + Odometry_Bias};
+    graph.add_node(TransformedLaserScan{}, odom_pose, 0);
+  }
+
+  static void close_loop(PoseGraphMap &graph) {
+    auto &nodes = graph.nodes();
+    // the loop end coincides with the loop start
+    graph.add_edge(nodes.back(), nodes[Lead_In_Nodes_Nm],
+                   {0, 0, 0}, {100, 100, 100});
+  }
+
+  static double loop_gap(const PoseGraphMap &graph) {
+    auto &nodes = graph.nodes();
+    auto gap = relative_pose(nodes[Lead_In_Nodes_Nm]->pose,
+                             nodes.back()->pose);
+    return std::sqrt(gap.sq_dist()) + std::abs(gap.theta);
+  }
+};
+
+constexpr unsigned PoseGraphOptimizerTest::Lead_In_Nodes_Nm;
+constexpr unsigned PoseGraphOptimizerTest::Side_Nodes_Nm;
+constexpr double PoseGraphOptimizerTest::Odometry_Bias;
+
+TEST_F(PoseGraphOptimizerTest, batchOptimizationClosesLoop) {
+  auto graph = PoseGraphMap{};
+  auto odom_pose = RobotPose{};
+  graph.add_node(TransformedLaserScan{}, odom_pose, 0);
+  for (auto &step : true_steps()) { add_node(graph, odom_pose, step); }
+  close_loop(graph);
+  ASSERT_LT(0.5, loop_gap(graph));
+
+  auto optimizer = PoseGraphOptimizer{};
+  auto init_chi2 = optimizer.chi2(graph);
+  auto stats = optimizer.optimize(graph);
+  ASSERT_LT(stats.chi2, init_chi2 / 100);
+  ASSERT_LT(loop_gap(graph), 0.05);
+  // the anchored node stays
+  ASSERT_NEAR(0, graph.nodes()[0]->pose.x, 1e-4);
+  ASSERT_NEAR(0, graph.nodes()[0]->pose.theta, 1e-4);
+}
+
+TEST_F(PoseGraphOptimizerTest, incrementalUpdatesMatchBatchOptimization) {
+  auto batch_graph = PoseGraphMap{}, graph = PoseGraphMap{};
+  auto batch_odom_pose = RobotPose{}, odom_pose = RobotPose{};
+  batch_graph.add_node(TransformedLaserScan{}, batch_odom_pose, 0);
+  graph.add_node(TransformedLaserScan{}, odom_pose, 0);
+
+  auto optimizer = PoseGraphOptimizer{};
+  optimizer.update(graph);
+  for (auto &step : true_steps()) {
+    add_node(batch_graph, batch_odom_pose, step);
+    add_node(graph, odom_pose, step);
+    // an odometry edge touches the last two nodes only
+    ASSERT_EQ(6u, optimizer.update(graph).refactored_rows_nm);
+  }
+
+  close_loop(batch_graph);
+  PoseGraphOptimizer{}.optimize(batch_graph);
+  close_loop(graph);
+  auto stats = optimizer.update(graph);
+  // nodes that precede the loop are not refactored
+  ASSERT_EQ(3 * (graph.nodes().size() - Lead_In_Nodes_Nm),
+            stats.refactored_rows_nm);
+  // NB: relinearization takes a few updates
+  for (unsigned i = 0; i < 5; ++i) { optimizer.update(graph); }
+
+  auto &nodes = graph.nodes(), &batch_nodes = batch_graph.nodes();
+  for (std::size_t i = 0; i < nodes.size(); ++i) {
+    ASSERT_NEAR(batch_nodes[i]->pose.x, nodes[i]->pose.x, 1e-3);
+    ASSERT_NEAR(batch_nodes[i]->pose.y, nodes[i]->pose.y, 1e-3);
+    ASSERT_NEAR(batch_nodes[i]->pose.theta, nodes[i]->pose.theta, 1e-3);
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
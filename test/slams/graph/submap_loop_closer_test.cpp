@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../core/mock_grid_cell.h"
+#include "../../../src/utils/data_generation/map_primitives.h"
+#include "../../../src/utils/data_generation/grid_map_patcher.h"
+#include "../../../src/utils/data_generation/laser_scan_generator.h"
+#include "../../../src/core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+
+#include "../../../src/slams/graph/submap_loop_closer.h"
+
+class SubmapLoopCloserTest : public ::testing::Test {
+protected: // consts
+  static constexpr double Map_Scale = 0.125;
+  static constexpr int Cecum_Patch_W = 15, Cecum_Patch_H = 13;
+protected: // methods
+  SubmapLoopCloserTest()
+    : spe{std::make_shared<WeightedMeanPointProbabilitySPE>(
+            std::make_shared<MaxOccupancyObservationPE>(),
+            std::make_shared<EvenSPW>())}
+    , closer{spe}
+    , lsp{to_lsp(15, 270, 2000)} {}
+
+  std::unique_ptr<Submap::MapType> make_map(bool has_cecum) {
+    auto map = std::make_unique<Submap::MapType>(
+      std::make_shared<MockGridCell>(), GridMapParams{100, 100, Map_Scale});
+    if (has_cecum) {
+      using CecumMp = CecumTextRasterMapPrimitive;
+      auto cecum_mp = CecumMp{Cecum_Patch_W, Cecum_Patch_H,
+                              CecumMp::BoundPosition::Top};
+      GridMapPatcher{}.apply_text_raster(*map, cecum_mp.to_stream(), {}, 1, 1);
+      scan_pose = RobotPose{(cecum_mp.width() / 2 + 0.5) * Map_Scale,
+                            (-cecum_mp.height() + 1.5) * Map_Scale,
+                            deg2rad(90)};
+    }
+    return map;
+  }
+
+  LaserScan2D scan_at(GridMap &map, const RobotPose &pose) {
+    return LaserScanGenerator{lsp}.laser_scan_2D(map, pose, 1);
+  }
+
+protected: // fields
+  std::shared_ptr<ScanProbabilityEstimator> spe;
+  SubmapLoopCloser closer;
+  LaserScannerParams lsp;
+  RobotPose scan_pose;
+};
+
+TEST_F(SubmapLoopCloserTest, closureIsFoundInWideWindow) {
+  auto map = make_map(true);
+  auto scan = scan_at(*map, scan_pose);
+  auto noise = RobotPoseDelta{0.6, -0.4, deg2rad(12)};
+  closer.add_candidate(7, *map, scan_pose + noise);
+
+  auto closure = SubmapLoopClosure{};
+  ASSERT_TRUE(closer.find_closure(scan, closure));
+  ASSERT_EQ(7u, closure.candidate_id);
+  ASSERT_EQ(double{Map_Scale}, map->scale());
+  auto &params = closer.params();
+  ASSERT_NEAR(scan_pose.x, closure.scan_pose.x, params.translation_step);
+  ASSERT_NEAR(scan_pose.y, closure.scan_pose.y, params.translation_step);
+  ASSERT_NEAR(scan_pose.theta, closure.scan_pose.theta, params.rotation_step);
+}
+
+TEST_F(SubmapLoopCloserTest, bestCandidateIsChosen) {
+  auto empty_map = make_map(false);
+  auto map = make_map(true);
+  auto scan = scan_at(*map, scan_pose);
+  auto noise = RobotPoseDelta{-0.3, 0.2, deg2rad(-5)};
+  closer.add_candidate(0, *empty_map, scan_pose + noise);
+  closer.add_candidate(1, *map, scan_pose + noise);
+
+  auto closure = SubmapLoopClosure{};
+  ASSERT_TRUE(closer.find_closure(scan, closure));
+  ASSERT_EQ(1u, closure.candidate_id);
+  ASSERT_LE(closer.params().min_probability, closure.probability);
+}
+
+TEST_F(SubmapLoopCloserTest, improbableClosureIsRejected) {
+  auto map = make_map(true);
+  auto scan = scan_at(*map, scan_pose);
+  auto empty_map = make_map(false);
+  closer.add_candidate(0, *empty_map, scan_pose);
+
+  auto closure = SubmapLoopClosure{};
+  ASSERT_FALSE(closer.find_closure(scan, closure));
+  // candidates are dropped by a search
+  ASSERT_FALSE(closer.find_closure(scan, closure));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../../../src/slams/vinyx/vinyx_world.h"
+#include "../../../src/core/maps/const_occupancy_estimator.h"
+#include "../../../src/core/scan_matchers/no_action_scan_matcher.h"
+#include "../../../src/core/scan_matchers/occupancy_observation_probability.h"
+#include "../../../src/core/scan_matchers/weighted_mean_point_probability_spe.h"
+#include "../../../src/core/trigonometry_utils.h"
+
+class VinyXWorldTest : public ::testing::Test {
+protected: // types
+  // keeps the pose and reports the given scan probability
+  class ConstProbScanMatcher : public NoActionScanMatcher {
+  public:
+    ConstProbScanMatcher(double prob)
+      : NoActionScanMatcher{std::make_shared<WeightedMeanPointProbabilitySPE>(
+          std::make_shared<ObstacleBasedOccupancyObservationPE>(),
+          std::make_shared<EvenSPW>())}
+      , prob{prob} {}
+
+    double process_scan(const TransformedLaserScan &scan,
+                        const RobotPose &init_pose, const GridMap &map,
+                        RobotPoseDelta &pose_delta) override {
+      ++scans_nm;
+      NoActionScanMatcher::process_scan(scan, init_pose, map, pose_delta);
+      return prob;
+    }
+
+    double prob;
+    unsigned scans_nm = 0;
+  };
+
+  class IdleScanAdder : public GridMapScanAdder {
+  public:
+    IdleScanAdder()
+      : GridMapScanAdder{std::make_shared<ConstOccupancyEstimator>(
+                           Occupancy{0.9, 1}, Occupancy{0.1, 1}),
+                         std::make_shared<IdleOMQE>()} {}
+  protected:
+    void handle_scan_point(GridMap &, bool, double,
+                           const Segment2D &) const override {}
+  };
+protected: // methods
+  VinyXWorldTest()
+    : gsm{std::make_shared<ConstProbScanMatcher>(0.9)}
+    , extra_gsm{std::make_shared<ConstProbScanMatcher>(0.9)} {
+    props.cell_prototype = std::make_shared<VinyXDSCell>();
+    props.gsm = gsm;
+    props.gmsa = std::make_shared<IdleScanAdder>();
+    props.extra_gsms = {extra_gsm};
+    props.extra_gmsas = {std::make_shared<IdleScanAdder>()};
+    props.map_props = {10, 10, 0.1};
+  }
+
+  void handle_scan(VinyXWorld &world, const RobotPoseDelta &odom_delta) {
+    auto tr_scan = TransformedLaserScan{};
+    tr_scan.pose_delta = odom_delta;
+    tr_scan.scan.trig_provider = std::make_shared<RawTrigonometryProvider>();
+    tr_scan.scan.points().emplace_back(1.0, 0.0, true);
+    world.handle_sensor_data(tr_scan);
+  }
+
+protected: // fields
+  VinyXWorldProperties props;
+  std::shared_ptr<ConstProbScanMatcher> gsm, extra_gsm;
+};
+
+TEST_F(VinyXWorldTest, hypothesesNmIsLimitedByMatchers) {
+  auto world = VinyXWorld{props};
+  ASSERT_TRUE(world.split_hypothesis({1, 2, 0.5}, 0.5));
+  ASSERT_EQ(2u, world.hypotheses_nm());
+  // no matchers for more hypotheses
+  ASSERT_FALSE(world.split_hypothesis({-1, 2, 0.5}, 0.5));
+  ASSERT_EQ(2u, world.hypotheses_nm());
+
+  // the best hypothesis is the initial one
+  ASSERT_EQ(0, world.pose().x);
+}
+
+TEST_F(VinyXWorldTest, hypothesesAreTrackedByOwnMatchers) {
+  auto world = VinyXWorld{props};
+  world.split_hypothesis({1, 2, 0.5}, 0.5);
+  for (int i = 0; i < 3; ++i) { handle_scan(world, {0.1, 0, 0}); }
+  ASSERT_EQ(3u, gsm->scans_nm);
+  ASSERT_EQ(3u, extra_gsm->scans_nm);
+  ASSERT_NEAR(0.3, world.pose().x, 1e-9);
+
+  auto masses = world.hypotheses_masses();
+  ASSERT_EQ(2u, masses.size());
+  ASSERT_EQ(1.0, masses[0]);
+  ASSERT_NEAR(0.5, masses[1], 1e-9);
+}
+
+TEST_F(VinyXWorldTest, collapsedHypothesisIsPruned) {
+  auto world = VinyXWorld{props};
+  world.map().update({3, 4}, {true, {0.9, 1}, {0, 0}, 1});
+  auto occupied_prob = double(world.map()[{3, 4}]);
+  world.split_hypothesis({1, 2, 0.5}, 0.5);
+  gsm->prob = 0.2;
+
+  // the split hypothesis becomes the best one
+  handle_scan(world, {0, 0, 0});
+  ASSERT_EQ(2u, world.hypotheses_nm());
+  ASSERT_NEAR(1, world.pose().x, 1e-9);
+  ASSERT_NEAR(0.2 / 0.45, world.hypotheses_masses()[0], 1e-9);
+
+  handle_scan(world, {0, 0, 0});
+  ASSERT_EQ(2u, world.hypotheses_nm());
+  // (0.2 / 0.45) * (0.2 / 0.9)^2 < 0.05
+  handle_scan(world, {0, 0, 0});
+  ASSERT_EQ(1u, world.hypotheses_nm());
+  ASSERT_NEAR(1, world.pose().x, 1e-9);
+  ASSERT_NEAR(2, world.pose().y, 1e-9);
+  ASSERT_EQ(3u, gsm->scans_nm);
+  // the split hypothesis has started with the map of the initial one
+  ASSERT_EQ(occupied_prob, double(world.map()[{3, 4}]));
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
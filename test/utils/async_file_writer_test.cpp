@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../../src/utils/async_file_writer.h"
+
+class AsyncFileWriterTest : public ::testing::Test {
+protected: // methods
+  ~AsyncFileWriterTest() { std::remove(File_Name); }
+
+  std::string file_content() const {
+    auto file = std::ifstream{File_Name, std::ios::binary};
+    auto content = std::ostringstream{};
+    content << file.rdbuf();
+    return content.str();
+  }
+
+protected: // consts
+  static constexpr const char *File_Name = "async_file_writer_test.txt";
+};
+
+TEST_F(AsyncFileWriterTest, dataAreWrittenInOrderAcrossChunks) {
+  auto expected = std::string{};
+  {
+    // NB: tiny chunks make writes to be submitted in background
+    AsyncFileWriter writer{File_Name, 16, 2};
+    ASSERT_TRUE(writer.is_valid());
+    for (int i = 0; i < 1000; ++i) {
+      auto record = std::to_string(i) + ' ';
+      writer.write(record.data(), record.size());
+      expected += record;
+    }
+  }
+  ASSERT_EQ(expected, file_content());
+}
+
+TEST_F(AsyncFileWriterTest, flushWritesPendingData) {
+  AsyncFileWriter writer{File_Name};
+  auto record = std::string{"1.5 0.1 0.2 0 0 0 0 1\n"};
+  writer.write(record.data(), record.size());
+  writer.flush();
+  ASSERT_EQ(record, file_content());
+
+  writer.write(record.data(), record.size());
+  writer.flush();
+  ASSERT_EQ(record + record, file_content());
+}
+
+TEST_F(AsyncFileWriterTest, largeRecordIsWritten) {
+  auto record = std::string(100, 'x');
+  {
+    AsyncFileWriter writer{File_Name, 8, 1};
+    writer.write(record.data(), record.size());
+  }
+  ASSERT_EQ(record, file_content());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "../core/mock_grid_cell.h"
+
+#include "../../src/utils/init_map_backend.h"
+
+class InitMapBackendTest : public ::testing::Test {
+protected: // types
+  using Backends = MapBackends<PolymorphicCellStorage>;
+protected: // methods
+  // the backend of the handled map type
+  MapBackend handled_backend() {
+    auto backend = MapBackend::Plain;
+    auto handled_nm = 0;
+    with_map_backend<Backends>(props, MapBackend::Plain, [&](auto map_tag) {
+      using MapT = typename decltype(map_tag)::type;
+      backend = backend_of(MapTypeTag<MapT>{});
+      ++handled_nm;
+    });
+    EXPECT_EQ(1, handled_nm);
+    return backend;
+  }
+
+  static MapBackend backend_of(MapTypeTag<Backends::Plain>) {
+    return MapBackend::Plain;
+  }
+  static MapBackend backend_of(MapTypeTag<Backends::Tiled>) {
+    return MapBackend::Tiled;
+  }
+  static MapBackend backend_of(MapTypeTag<Backends::Hashed>) {
+    return MapBackend::Hashed;
+  }
+  static MapBackend backend_of(MapTypeTag<Backends::OutOfCore>) {
+    return MapBackend::OutOfCore;
+  }
+  static MapBackend backend_of(MapTypeTag<Backends::Coarsening>) {
+    return MapBackend::Coarsening;
+  }
+  static MapBackend backend_of(MapTypeTag<Backends::Rescalable>) {
+    return MapBackend::Rescalable;
+  }
+
+  void set_backend(const std::string &backend) {
+    props.set_property("slam/map/backend", backend);
+  }
+protected: // fields
+  MapPropertiesProvider props;
+};
+
+TEST_F(InitMapBackendTest, slamDefaultIsUsedIfNotSet) {
+  ASSERT_EQ(MapBackend::Tiled, init_map_backend(props, MapBackend::Tiled));
+  ASSERT_EQ(MapBackend::Plain, handled_backend());
+}
+
+TEST_F(InitMapBackendTest, backendIsSelectedByProperty) {
+  set_backend("plain");
+  ASSERT_EQ(MapBackend::Plain, handled_backend());
+  set_backend("tiled");
+  ASSERT_EQ(MapBackend::Tiled, handled_backend());
+  set_backend("hashed");
+  ASSERT_EQ(MapBackend::Hashed, handled_backend());
+  set_backend("out_of_core");
+  ASSERT_EQ(MapBackend::OutOfCore, handled_backend());
+  set_backend("coarsening");
+  ASSERT_EQ(MapBackend::Coarsening, handled_backend());
+  set_backend("rescalable");
+  ASSERT_EQ(MapBackend::Rescalable, handled_backend());
+}
+
+TEST_F(InitMapBackendTest, backendsKeepSameCells) {
+  for (auto backend : {"plain", "tiled", "hashed", "out_of_core",
+                       "coarsening", "rescalable"}) {
+    set_backend(backend);
+    with_map_backend<Backends>(props, MapBackend::Plain, [&](auto map_tag) {
+      using MapT = typename decltype(map_tag)::type;
+      auto map = MapT{std::make_shared<MockGridCell>(), {1, 1, 1}};
+      map.update({-300, 200}, {true, {0.8, 0}, {0, 0}, 0});
+      map.update({150, -40}, {true, {0.3, 0}, {0, 0}, 0});
+      ASSERT_EQ((map[{-300, 200}]), 0.8) << backend;
+      ASSERT_EQ((map[{150, -40}]), 0.3) << backend;
+      ASSERT_EQ((map[{0, 0}]), MockGridCell::Default_Occ_Prob) << backend;
+    });
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "../core/mock_grid_cell.h"
+#include "../../src/core/maps/lazy_tiled_grid_map.h"
+#include "../../src/utils/png_map_dumper.h"
+
+class PngMapDumperTest : public ::testing::Test {
+protected: // types
+  using Bytes = std::vector<unsigned char>;
+protected: // methods
+  PngMapDumperTest()
+    : map{std::make_shared<MockGridCell>(), {1, 1, 1}} {
+    auto rnd_engine = std::mt19937{42};
+    auto coord_rv = std::uniform_int_distribution<int>{-150, 150};
+    auto prob_rv = std::uniform_real_distribution<double>{0, 1};
+    for (int i = 0; i < 5000; ++i) {
+      map.update({coord_rv(rnd_engine), coord_rv(rnd_engine) / 2},
+                 {true, {prob_rv(rnd_engine), 0}, {0, 0}, 0});
+    }
+  }
+
+  static uint32_t read_u32(const std::string &s, std::size_t pos) {
+    auto b = reinterpret_cast<const unsigned char*>(s.data()) + pos;
+    return (uint32_t(b[0]) << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+  }
+
+  // Unfiltered scanlines of the png's image (checks chunks on the way)
+  Bytes decode_scanlines(const std::string &png, uint32_t &w, uint32_t &h) {
+    static const std::string Signature = "\x89PNG\r\n\x1A\n";
+    EXPECT_EQ(Signature, png.substr(0, Signature.size()));
+    auto zdata = std::string{};
+    auto pos = Signature.size();
+    while (pos < png.size()) {
+      auto size = read_u32(png, pos);
+      auto type = png.substr(pos + 4, 4);
+      auto crc = crc32(0, reinterpret_cast<const Bytef*>(&png[pos + 4]),
+                       size + 4);
+      EXPECT_EQ(crc, read_u32(png, pos + 8 + size));
+      if (type == "IHDR") {
+        w = read_u32(png, pos + 8);
+        h = read_u32(png, pos + 12);
+      } else if (type == "IDAT") {
+        zdata += png.substr(pos + 8, size);
+      }
+      pos += 12 + size;
+    }
+    auto scanlines = Bytes((w + 1) * h);
+    auto scanlines_size = uLongf(scanlines.size());
+    // NB: the stream checksum is verified as well
+    EXPECT_EQ(Z_OK, uncompress(scanlines.data(), &scanlines_size,
+                               reinterpret_cast<const Bytef*>(zdata.data()),
+                               zdata.size()));
+    EXPECT_EQ(scanlines.size(), scanlines_size);
+    return scanlines;
+  }
+
+  void test_dump(unsigned threads_nm, std::size_t block_size) {
+    auto png = std::ostringstream{};
+    ASSERT_TRUE((GridMapToPngDumper<GridMap>::dump_map(
+      png, map, threads_nm, Z_BEST_SPEED, block_size)));
+    uint32_t w = 0, h = 0;
+    auto scanlines = decode_scanlines(png.str(), w, h);
+    ASSERT_EQ(uint32_t(map.width()), w);
+    ASSERT_EQ(uint32_t(map.height()), h);
+
+    auto pgm = std::ostringstream{};
+    GridMapToPgmDumber<GridMap>::dump_map(pgm, map);
+    auto pixels = pgm.str();
+    pixels = pixels.substr(pixels.size() - w * h);
+    for (uint32_t y = 0; y < h; ++y) {
+      ASSERT_EQ(0, scanlines[y * (w + 1)]);
+      for (uint32_t x = 0; x < w; ++x) {
+        ASSERT_EQ((unsigned char)pixels[y * w + x],
+                  scanlines[y * (w + 1) + 1 + x]);
+      }
+    }
+  }
+
+protected: // fields
+  UnboundedLazyTiledGridMap map;
+};
+
+TEST_F(PngMapDumperTest, singleBlock) {
+  test_dump(1, 1 << 20);
+}
+
+TEST_F(PngMapDumperTest, blocksOfSeveralBatches) {
+  test_dump(3, 1000);
+}
+
+TEST_F(PngMapDumperTest, pgmPixelsMatchMapOccupancies) {
+  auto pgm = std::ostringstream{};
+  GridMapToPgmDumber<GridMap>::dump_map(pgm, map);
+  auto pixels = pgm.str();
+  int w = map.width(), h = map.height();
+  pixels = pixels.substr(pixels.size() - w * h);
+  auto origin = map.origin();
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      auto occ = map.occupancy({x - origin.x, h - origin.y - 1 - y});
+      auto value = 1.0 - (occ == -1 ? 0.5 : bound_value(0.0, occ, 1.0));
+      ASSERT_EQ(static_cast<unsigned char>(255 * value),
+                (unsigned char)pixels[y * w + x]);
+    }
+  }
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../src/utils/scan_log.h"
+
+class ScanLogTest : public ::testing::Test {
+protected: // methods
+  ScanLogTest() : rnd_engine{42} {}
+  ~ScanLogTest() { std::remove(Log_Fname); }
+
+  ScanLogRecordHeader random_header(uint32_t ranges_nm) {
+    auto value_rv = std::uniform_real_distribution<double>{-10, 10};
+    auto header = ScanLogRecordHeader{};
+    header.sec = 1000 + ranges_nm;
+    header.nsec = 500;
+    header.x = value_rv(rnd_engine);
+    header.y = value_rv(rnd_engine);
+    header.theta = value_rv(rnd_engine);
+    header.angle_min = -1.5;
+    header.angle_max = 1.5;
+    header.angle_increment = 3.0 / (ranges_nm ? ranges_nm : 1);
+    header.range_min = 0.1;
+    header.range_max = 30;
+    header.ranges_nm = ranges_nm;
+    return header;
+  }
+
+  std::vector<float> random_ranges(uint32_t ranges_nm) {
+    auto range_rv = std::uniform_real_distribution<float>{0, 30};
+    auto ranges = std::vector<float>(ranges_nm);
+    for (auto &r : ranges) { r = range_rv(rnd_engine); }
+    return ranges;
+  }
+
+protected: // consts
+  static constexpr const char *Log_Fname = "scan_log_test.scanlog";
+protected: // fields
+  std::mt19937 rnd_engine;
+};
+
+TEST_F(ScanLogTest, recordsAreReadAsWritten) {
+  auto headers = std::vector<ScanLogRecordHeader>{};
+  auto ranges = std::vector<std::vector<float>>{};
+  {
+    auto log = ScanLogWriter{Log_Fname};
+    // NB: odd numbers of ranges require padding
+    for (auto ranges_nm : {0u, 1u, 7u, 360u, 1081u}) {
+      headers.push_back(random_header(ranges_nm));
+      ranges.push_back(random_ranges(ranges_nm));
+      log.add_record(headers.back(), ranges.back().data());
+    }
+    ASSERT_TRUE(log.is_valid());
+  }
+
+  ScanLogReader log{Log_Fname};
+  ASSERT_TRUE(log.is_valid());
+  auto record = ScanLogRecord{};
+  for (std::size_t i = 0; i < headers.size(); ++i) {
+    ASSERT_TRUE(log.next(record));
+    auto &h = *record.header;
+    ASSERT_EQ(headers[i].sec, h.sec);
+    ASSERT_EQ(headers[i].nsec, h.nsec);
+    ASSERT_EQ(headers[i].x, record.pose().x);
+    ASSERT_EQ(headers[i].y, record.pose().y);
+    ASSERT_EQ(headers[i].theta, record.pose().theta);
+    ASSERT_EQ(headers[i].angle_increment, h.angle_increment);
+    ASSERT_EQ(headers[i].ranges_nm, h.ranges_nm);
+    // ranges are mapped in place, so they are aligned
+    ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(record.ranges) % alignof(float));
+    for (std::size_t r = 0; r < ranges[i].size(); ++r) {
+      ASSERT_EQ(ranges[i][r], record.ranges[r]);
+    }
+  }
+  ASSERT_FALSE(log.next(record));
+}
+
+TEST_F(ScanLogTest, truncatedRecordEndsLog) {
+  {
+    auto log = ScanLogWriter{Log_Fname};
+    auto ranges = random_ranges(100);
+    log.add_record(random_header(100), ranges.data());
+    log.add_record(random_header(100), ranges.data());
+  }
+  {
+    // the second record loses its last ranges
+    auto log_file = std::ifstream{Log_Fname, std::ios::binary};
+    auto data = std::vector<char>{std::istreambuf_iterator<char>{log_file},
+                                  std::istreambuf_iterator<char>{}};
+    data.resize(data.size() - 16);
+    auto out = std::ofstream{Log_Fname, std::ios::binary | std::ios::trunc};
+    out.write(data.data(), data.size());
+  }
+
+  ScanLogReader log{Log_Fname};
+  auto record = ScanLogRecord{};
+  ASSERT_TRUE(log.next(record));
+  ASSERT_FALSE(log.next(record));
+}
+
+TEST_F(ScanLogTest, foreignFileIsRejected) {
+  {
+    auto out = std::ofstream{Log_Fname};
+    out << "not a scan log, but long enough to have a header";
+  }
+  ASSERT_FALSE(ScanLogReader{Log_Fname}.is_valid());
+  ASSERT_FALSE(ScanLogReader{"no_such_file.scanlog"}.is_valid());
+}
+
+int main (int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}